@@ -0,0 +1,109 @@
+#ifndef INTERFERENCE_H
+#define INTERFERENCE_H
+
+// What a solve meets in production and not in a loop of benchmark calls:
+// caches and TLB emptied by whatever ran since the last frame, or a
+// neighbor on the other cores streaming through memory all the while. The
+// benchmarks time their calls under either for the cold latencies, which
+// are the ones the deadlines are missed at.
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+// Fallback when the last-level cache's size isn't known.
+static const size_t DEFAULT_EVICT_BYTES = size_t(64) << 20;
+
+// Empties the caches and the TLB of what the caller left there, by writing
+// every line of a buffer twice the size of the last-level cache, in small
+// pages so that each of them takes a TLB entry.
+class CacheEvictor {
+ public:
+  CacheEvictor() : bytes_(DEFAULT_EVICT_BYTES), line_(64) {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc > 0) {
+      bytes_ = 2 * size_t(llc);
+    }
+    long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (line > 0) {
+      line_ = size_t(line);
+    }
+#endif
+    void* memory = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffer_ = memory == MAP_FAILED ? nullptr : static_cast<char*>(memory);
+#ifdef MADV_NOHUGEPAGE
+    if (buffer_) {
+      madvise(buffer_, bytes_, MADV_NOHUGEPAGE);
+    }
+#endif
+  }
+  ~CacheEvictor() {
+    if (buffer_) {
+      munmap(buffer_, bytes_);
+    }
+  }
+  CacheEvictor(const CacheEvictor&) = delete;
+  CacheEvictor& operator=(const CacheEvictor&) = delete;
+
+  void Evict() {
+    if (!buffer_) {
+      return;
+    }
+    // Every line, so that no set of the cache keeps a line of the caller's.
+    for (size_t i = 0; i < bytes_; i += line_) {
+      buffer_[i]++;
+    }
+  }
+
+  size_t bytes() const { return bytes_; }
+
+ private:
+  size_t bytes_;
+  size_t line_;
+  char* buffer_;
+};
+
+// A thread that streams through `bytes` of its own, reading and writing a
+// line at a time in a scattered order, until it is destroyed: the
+// benchmark's memory bandwidth and last-level cache are then shared, as
+// with the sessions, logging and I/O of the server.
+class MemoryNeighbor {
+ public:
+  explicit MemoryNeighbor(size_t bytes)
+      : bytes_(bytes), stop_(false), buffer_(new char[bytes]()),
+        thread_([this] { Run(); }) {}
+  ~MemoryNeighbor() {
+    stop_.store(true, std::memory_order_relaxed);
+    thread_.join();
+    delete[] buffer_;
+  }
+  MemoryNeighbor(const MemoryNeighbor&) = delete;
+  MemoryNeighbor& operator=(const MemoryNeighbor&) = delete;
+
+ private:
+  void Run() {
+    const size_t line = 64;
+    size_t lines = bytes_ / line;
+    // An odd stride visits every line of a power of two of them, and
+    // defeats the prefetchers either way.
+    const size_t stride = 4099;
+    size_t i = 0;
+    while (!stop_.load(std::memory_order_relaxed)) {
+      for (size_t k = 0; k < 4096; k++) {
+        i = (i + stride) % lines;
+        buffer_[i * line]++;
+      }
+    }
+  }
+
+  size_t bytes_;
+  std::atomic<bool> stop_;
+  char* buffer_;
+  std::thread thread_;
+};
+
+#endif /* INTERFERENCE_H */
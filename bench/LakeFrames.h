@@ -0,0 +1,111 @@
+#ifndef LAKE_FRAMES_H
+#define LAKE_FRAMES_H
+
+// Inputs for the benchmarks, from the lake track waypoints. No recording
+// ships with the repo, so frames are synthesized in the simulator's format
+// (see DATA.md): a car driving along the track, with the next 6 waypoints
+// of each frame.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "BicycleModel.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+// Read the "x,y" lines after the header line of a waypoint CSV.
+inline bool ReadWaypoints(const char* path, std::vector<double>& x,
+                          std::vector<double>& y) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    size_t comma = line.find(',');
+    if (comma != std::string::npos) {
+      x.push_back(atof(line.c_str()));
+      y.push_back(atof(line.c_str() + comma + 1));
+    }
+  }
+  return true;
+}
+
+// Frames from consecutive positions between the waypoints, printed with the
+// precision the simulator uses.
+inline std::vector<std::string> MakeFrames(const std::vector<double>& x,
+                                           const std::vector<double>& y) {
+  std::vector<std::string> frames;
+  size_t n = x.size();
+  const int steps = 20;
+  char buffer[128];
+  for (size_t i = 0; i < n; i++) {
+    size_t next = (i + 1) % n;
+    double psi = atan2(y[next] - y[i], x[next] - x[i]);
+    for (int s = 0; s < steps; s++) {
+      double f = double(s) / steps;
+      std::string frame = "[\"telemetry\",{\"ptsx\":[";
+      for (size_t k = 0; k < 6; k++) {
+        snprintf(buffer, sizeof(buffer), "%s%.7g", k ? "," : "",
+                 x[(i + k) % n]);
+        frame += buffer;
+      }
+      frame += "],\"ptsy\":[";
+      for (size_t k = 0; k < 6; k++) {
+        snprintf(buffer, sizeof(buffer), "%s%.7g", k ? "," : "",
+                 y[(i + k) % n]);
+        frame += buffer;
+      }
+      double wrapped = psi < 0 ? psi + 2 * M_PI : psi;
+      snprintf(buffer, sizeof(buffer),
+               "],\"psi\":%.7g,\"psi_unity\":%.7g,\"speed\":%.7g,"
+               "\"steering_angle\":%.7g,",
+               wrapped, fmod(2.5 * M_PI - wrapped, 2 * M_PI),
+               40 + 10 * sin(0.01 * frames.size()),
+               -0.05 * cos(0.03 * frames.size()));
+      frame += buffer;
+      snprintf(buffer, sizeof(buffer),
+               "\"throttle\":%.7g,\"x\":%.7g,\"y\":%.7g}]",
+               0.5 + 0.2 * sin(0.02 * frames.size()),
+               x[i] + f * (x[next] - x[i]), y[i] + f * (y[next] - y[i]));
+      frame += buffer;
+      frames.push_back(frame);
+    }
+  }
+  return frames;
+}
+
+// The fit and predicted state of frames, as Control() computes them: of
+// every `stride`th from the first, up to `limit` of them, for a car with
+// `Lf` whose actuations take `latency` seconds. Returns how many.
+inline size_t PrepareFrames(const std::vector<std::string>& frames, double Lf,
+                            double latency, States& states, Cubics& coeffs,
+                            size_t limit = size_t(-1), size_t stride = 1) {
+  size_t n = std::min(frames.size() / stride, limit);
+  WaypointFit fit;
+  states.resize(n);
+  coeffs.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    const std::string& frame = frames[i * stride];
+    Telemetry t;
+    ParseTelemetry(frame.data(), frame.data() + frame.size(), t);
+    double vx[MAX_WAYPOINTS];
+    double vy[MAX_WAYPOINTS];
+    ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints, vx, vy);
+    coeffs[i] = fit.Fit(vx, vy, t.n_waypoints);
+    double cte = polyeval(coeffs[i], 0);
+    double epsi = -atan(coeffs[i][1]);
+    states[i] = PredictState(t.v, t.delta, t.a, cte, epsi, Lf, latency);
+  }
+  return n;
+}
+
+#endif /* LAKE_FRAMES_H */
@@ -0,0 +1,75 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+// Timing for the benchmarks: samples summarized as their min, median and
+// p99, or any quantile, and calls timed in batches or one by one.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+struct Stats {
+  double min;
+  double median;
+  double p99;
+};
+
+// The p-quantile of sorted samples, p in [0, 1], by the nearest rank.
+inline double SortedPercentile(const std::vector<double>& sorted, double p) {
+  return sorted[std::min(sorted.size() - 1,
+                         size_t(p * (sorted.size() - 1) + 0.5))];
+}
+
+// The p-quantile of `samples`; 0 without any.
+inline double Percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return SortedPercentile(samples, p);
+}
+
+static Stats Summarize(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  Stats s;
+  s.min = samples.front();
+  s.median = samples[samples.size() / 2];
+  s.p99 = SortedPercentile(samples, 0.99);
+  return s;
+}
+
+// Time `batches` batches of calls f(0), ..., f(calls - 1), in seconds per
+// call.
+template <class F>
+static Stats Measure(F f, size_t calls, int batches) {
+  std::vector<double> samples;
+  for (int b = 0; b < batches; b++) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++) {
+      f(i);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    samples.push_back(elapsed.count() / calls);
+  }
+  return Summarize(samples);
+}
+
+// Time `samples` calls f(0), ..., f(samples - 1) one by one, in seconds per
+// call, each after an untimed call of before(), as to evict the caches.
+template <class F, class Before>
+static Stats MeasureEach(F f, Before before, size_t samples) {
+  std::vector<double> times;
+  for (size_t i = 0; i < samples; i++) {
+    before();
+    auto start = std::chrono::steady_clock::now();
+    f(i);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    times.push_back(elapsed.count());
+  }
+  return Summarize(times);
+}
+
+#endif /* MEASURE_H */
@@ -0,0 +1,160 @@
+// The server on each heap allocator, see HeapAllocator.h, under the same
+// load from tools/load_gen: for each, starts the server with the allocator
+// preloaded, has load_gen drive it with `sessions` sessions for one stage,
+// and prints load_gen's commands' times, misses and rate, with the
+// server's resident memory and heap at the end. glibc's malloc comes
+// first, then each library, by a path or a name for the dynamic linker to
+// find; one the server didn't end up running on is skipped. The server
+// must listen on 4567 and answer /metrics there.
+//
+// Usage: allocators [mpc] [load_gen] [sessions] [seconds] [library...]
+//
+// with ./mpc, ./load_gen, 64 and 60 unless given, and libjemalloc.so.2 and
+// libmimalloc.so.2 without libraries.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HttpClient.h"
+
+// How long the server may take to warm up and listen.
+static const double START_SECONDS = 120;
+
+static bool Scrape(std::string& text) {
+  int status = 0;
+  return HttpRequest("127.0.0.1", 4567, "GET", "/metrics", "", 5, status,
+                     text) &&
+         status == 200;
+}
+
+// The value of the metric line starting `prefix`, or 0.
+static double Metric(const std::string& text, const std::string& prefix) {
+  size_t at = text.find("\n" + prefix);
+  if (at == std::string::npos) {
+    return 0;
+  }
+  size_t space = text.find(' ', at + 1 + prefix.size());
+  return space == std::string::npos ? 0 : atof(text.c_str() + space + 1);
+}
+
+// Run the server on `library`, empty for glibc's malloc, under load_gen;
+// false if it couldn't be run on it.
+static bool Run(const std::string& server, const std::string& load_gen,
+                const std::string& sessions, const std::string& seconds,
+                const std::string& library) {
+  std::string name = library.empty() ? "glibc" : library;
+  pid_t child = fork();
+  if (child == 0) {
+    if (library.empty()) {
+      unsetenv("LD_PRELOAD");
+    } else {
+      setenv("LD_PRELOAD", library.c_str(), 1);
+    }
+    // The server's own output would get in the table's way.
+    if (!freopen("/dev/null", "w", stdout)) {
+      _exit(127);
+    }
+    execl(server.c_str(), server.c_str(), nullptr);
+    _exit(127);
+  }
+  if (child < 0) {
+    return false;
+  }
+  std::string text;
+  auto start = std::chrono::steady_clock::now();
+  while (!Scrape(text)) {
+    if (waitpid(child, nullptr, WNOHANG) == child ||
+        std::chrono::steady_clock::now() - start >
+            std::chrono::duration<double>(START_SECONDS)) {
+      fprintf(stderr, "%s: the server didn't start\n", name.c_str());
+      kill(child, SIGKILL);
+      waitpid(child, nullptr, 0);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  std::string allocator;
+  size_t label = text.find("mpc_heap_allocator{allocator=\"");
+  if (label != std::string::npos) {
+    label += strlen("mpc_heap_allocator{allocator=\"");
+    allocator = text.substr(label, text.find('"', label) - label);
+  }
+  bool expected = library.empty() ? allocator == "glibc"
+                                  : allocator != "glibc" && !allocator.empty();
+  std::string row;
+  if (expected) {
+    std::string settle =
+        std::to_string(std::max(1, atoi(seconds.c_str()) / 4));
+    std::string command = load_gen + " start=" + sessions + " step=" +
+                          sessions + " max=" + sessions + " stage=" +
+                          seconds + " settle=" + settle;
+    FILE* out = popen(command.c_str(), "r");
+    char line[256];
+    std::string previous;
+    while (out && fgets(line, sizeof(line), out)) {
+      if (strncmp(line, "knee:", 5) == 0) {
+        row = previous;
+      }
+      previous = line;
+    }
+    if (out) {
+      pclose(out);
+    }
+    Scrape(text);
+  }
+  kill(child, SIGTERM);
+  waitpid(child, nullptr, 0);
+  if (!expected) {
+    fprintf(stderr, "%s: the server ran on %s instead\n", name.c_str(),
+            allocator.empty() ? "an unknown allocator" : allocator.c_str());
+    return false;
+  }
+  // load_gen's row: sessions, open, p50, p99, max, missed, commands/s.
+  unsigned long open = 0;
+  double p50 = 0, p99 = 0, max = 0, missed = 0, rate = 0;
+  unsigned long total = 0;
+  if (sscanf(row.c_str(), "%lu %lu %lf %lf %lf %lf%% %lf", &total, &open,
+             &p50, &p99, &max, &missed, &rate) != 7) {
+    fprintf(stderr, "%s: no result from %s\n", name.c_str(),
+            load_gen.c_str());
+    return false;
+  }
+  printf("%-10s %8lu %9.1f %9.1f %9.1f %8.2f%% %10.0f %9.1f %9.1f %9.1f\n",
+         allocator.c_str(), open, p50, p99, max, missed, rate,
+         Metric(text, "process_resident_memory_bytes") / 1048576,
+         Metric(text, "mpc_heap_bytes{state=\"inuse\"}") / 1048576,
+         Metric(text, "mpc_heap_bytes{state=\"free\"}") / 1048576);
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  std::string server = argc > 1 ? argv[1] : "./mpc";
+  std::string load_gen = argc > 2 ? argv[2] : "./load_gen";
+  std::string sessions = argc > 3 ? argv[3] : "64";
+  std::string seconds = argc > 4 ? argv[4] : "60";
+  std::vector<std::string> libraries(1);
+  for (int i = 5; i < argc; i++) {
+    libraries.push_back(argv[i]);
+  }
+  if (argc <= 5) {
+    libraries.push_back("libjemalloc.so.2");
+    libraries.push_back("libmimalloc.so.2");
+  }
+  printf("%s sessions, %s s each\n", sessions.c_str(), seconds.c_str());
+  printf("%-10s %8s %9s %9s %9s %9s %10s %9s %9s %9s\n", "allocator", "open",
+         "p50 ms", "p99 ms", "max ms", "missed", "commands/s", "rss MB",
+         "inuse MB", "free MB");
+  fflush(stdout);
+  for (const std::string& library : libraries) {
+    Run(server, load_gen, sessions, seconds, library);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+// The stage dynamics taped as their operations against one BicycleAtomic
+// call per stage (see MpcConfig::atomicDynamics). At a few horizons, times
+// setting up a controller as the server's, most of which is recording the
+// tapes and detecting their sparsity, then solves the same frames with it
+// and prints the solve time, the part of it spent evaluating the problem,
+// and how far the first actuations are from those of the taped operations.
+//
+// Usage: atomic_dynamics [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-4s %-10s %10s %7s %12s %12s %12s %12s\n", "N", "dynamics",
+         "setup ms", "failed", "solve p50", "solve p99", "eval ms",
+         "max |du|");
+  const size_t horizons[] = {10, 20, 40, 80};
+  for (size_t N : horizons) {
+    std::vector<double> taped_delta(n);
+    std::vector<double> taped_a(n);
+    for (int atomic = 0; atomic < 2; atomic++) {
+      MpcConfig config = base;
+      config.N = N;
+      config.horizons.assign(1, Horizon{N, config.dt});
+      config.atomicDynamics = atomic;
+      auto start = std::chrono::steady_clock::now();
+      MPC mpc(config);
+      double setup_ms = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count();
+
+      std::vector<double> solve_ms;
+      double eval_ms = 0;
+      double max_du = 0;
+      size_t failed = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        const MPC::SolveStats& stats = mpc.stats();
+        solve_ms.push_back(stats.seconds * 1e3);
+        eval_ms += stats.evalSeconds * 1e3;
+        failed += stats.status != MPC::CONVERGED;
+        if (atomic) {
+          max_du = std::max(max_du, std::max(std::fabs(u[0] - taped_delta[i]),
+                                             std::fabs(u[1] - taped_a[i])));
+        } else {
+          taped_delta[i] = u[0];
+          taped_a[i] = u[1];
+        }
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      printf("%-4zu %-10s %10.1f %7zu %12.3f %12.3f %12.3f %12.3g\n", N,
+             atomic ? "atomic" : "taped", setup_ms, failed, solve_ms[n / 2],
+             solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))],
+             eval_ms / n, max_du);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
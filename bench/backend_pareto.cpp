@@ -0,0 +1,370 @@
+// Every backend of the controller against a tightly converged reference,
+// Ipopt with the offline-accurate profile, to pick one per deployment. Each
+// answers the frames of a scenario class through a Controller of its own,
+// as the server would, and is compared with the reference's actuations on
+// the same frames: the RMS steering and throttle differences, and their
+// normalized mean, the error its accuracy is ranked by. The closed loop
+// class instead drives cars around the track in SimEnvironments with each
+// backend and ranks it by the cars' mean distance from the track.
+//
+// The classes are the frames of a lap split into its straights and its
+// sharpest quarter of curvature, the turns; the lap again with the car off
+// the path and turned from it; the frames of a recording, if given; and
+// the closed loop. For each, the backends are listed by their 99th
+// percentile latency, a frame's Step end to end, with a * on those no
+// other backend beats on both latency and error: the Pareto front.
+//
+// Usage: backend_pareto [waypoints.csv] [frames.rec | -] [policy.bin]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "BinaryProtocol.h"
+#include "Controller.h"
+#include "FrameLog.h"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "SimEnvironments.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "TrackMap.h"
+
+static const double LATENCY = 0.1;
+// The closed loop: cars spread along the track, and the periods driven.
+static const size_t CARS = 8;
+static const size_t STEPS = 300;
+// How far the offset class puts the car off the path, in meters, and turns
+// it from the path, in radians, either way.
+static const double OFFSET = 1.5;
+static const double TURN = 0.25;
+
+struct Backend {
+  const char* name;
+  MPC::Method method;
+  LTVMPC::Formulation ltv;
+  MpcConfig::NlpSolver nlp;
+};
+
+static const Backend BACKENDS[] = {
+    {"ipopt", MPC::IPOPT, LTVMPC::SPARSE, MpcConfig::IPOPT},
+    {"interior-point", MPC::IPOPT, LTVMPC::SPARSE, MpcConfig::INTERIOR_POINT},
+    {"rti", MPC::REAL_TIME_ITERATION, LTVMPC::SPARSE, MpcConfig::IPOPT},
+    {"ltv-admm", MPC::LINEAR_TIME_VARYING, LTVMPC::SPARSE, MpcConfig::IPOPT},
+    {"ltv-condensed", MPC::LINEAR_TIME_VARYING, LTVMPC::CONDENSED,
+     MpcConfig::IPOPT},
+    {"ltv-riccati", MPC::LINEAR_TIME_VARYING, LTVMPC::RICCATI,
+     MpcConfig::IPOPT},
+    {"ltv-active-set", MPC::LINEAR_TIME_VARYING, LTVMPC::ACTIVE_SET,
+     MpcConfig::IPOPT},
+    {"frenet", MPC::FRENET, LTVMPC::SPARSE, MpcConfig::IPOPT},
+    {"mppi", MPC::PATH_INTEGRAL, LTVMPC::SPARSE, MpcConfig::IPOPT},
+    {"lqr", MPC::LQR, LTVMPC::SPARSE, MpcConfig::IPOPT},
+    {"policy", MPC::POLICY, LTVMPC::SPARSE, MpcConfig::IPOPT},
+};
+static const size_t BACKEND_COUNT = sizeof(BACKENDS) / sizeof(BACKENDS[0]);
+
+// A frame of a class, and the connection it came on: each gets a
+// controller of its own, with the warm starts of its frames before.
+struct Frame {
+  unsigned connection;
+  Telemetry t;
+};
+typedef std::vector<Frame> Frames;
+
+struct Row {
+  const char* name;
+  double p50;
+  double p99;
+  double steering;
+  double throttle;
+  double error;
+  size_t failed;
+};
+
+// A controller of `backend`, or of the reference if null; nullptr if the
+// backend can't run here, as the policy without its weights.
+static std::unique_ptr<Controller> MakeController(const Backend* backend,
+                                                  const char* policy) {
+  MpcConfig config;
+  if (!backend) {
+    ApplySolverProfile(config, "offline-accurate");
+  } else {
+    config.nlpSolver = backend->nlp;
+  }
+  std::unique_ptr<Controller> c(new Controller(config));
+  MPC& mpc = c->mpc();
+  mpc.fallback = false;
+  if (backend) {
+    mpc.method = backend->method;
+    mpc.ltvFormulation = backend->ltv;
+    if (backend->method == MPC::POLICY &&
+        !(policy && mpc.LoadPolicy(policy))) {
+      return nullptr;
+    }
+  }
+  return c;
+}
+
+static double Millis(std::chrono::steady_clock::time_point from) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - from)
+      .count();
+}
+
+// Answer `frames` with `backend`'s controllers, each frame's actuations
+// into `actions` as steering, throttle pairs, and its latency into `ms`.
+// False if the backend can't run here.
+static bool Answer(const Backend* backend, const char* policy,
+                   const Frames& frames, std::vector<double>& actions,
+                   std::vector<double>& ms, size_t& failed) {
+  std::map<unsigned, std::unique_ptr<Controller> > controllers;
+  Controller::Output out;
+  actions.assign(2 * frames.size(), 0);
+  ms.clear();
+  failed = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    std::unique_ptr<Controller>& c = controllers[frames[i].connection];
+    if (!c && !(c = MakeController(backend, policy))) {
+      return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    c->Step(frames[i].t, std::chrono::steady_clock::time_point::max(), out);
+    ms.push_back(Millis(start));
+    failed += c->mpc().stats().status == MPC::FAILED;
+    actions[2 * i] = out.steering;
+    actions[2 * i + 1] = out.throttle;
+  }
+  return true;
+}
+
+// The closed loop of `backend`: a controller per car. `cte` is the cars'
+// mean distance from the track, and `failed` the cars that left it.
+static bool Drive(const Backend* backend, const char* policy,
+                  const TrackMap& track, std::vector<double>& ms, double& cte,
+                  size_t& failed) {
+  MpcConfig config;
+  SimEnvironments envs(track, CARS, config.Lf);
+  std::vector<std::unique_ptr<Controller> > controllers;
+  for (size_t i = 0; i < CARS; i++) {
+    envs.Reset(i, track.length() * i / CARS, 30);
+    controllers.push_back(MakeController(backend, policy));
+    if (!controllers.back()) {
+      return false;
+    }
+  }
+  std::vector<Telemetry> observations(CARS);
+  std::vector<SimEnvironments::Action> actions(CARS);
+  Controller::Output out;
+  ms.clear();
+  cte = 0;
+  for (size_t k = 0; k < STEPS; k++) {
+    envs.Observe(observations.data());
+    for (size_t i = 0; i < CARS; i++) {
+      auto start = std::chrono::steady_clock::now();
+      controllers[i]->Step(observations[i],
+                           std::chrono::steady_clock::time_point::max(), out);
+      ms.push_back(Millis(start));
+      actions[i].steering = out.steering;
+      actions[i].throttle = out.throttle;
+    }
+    envs.Step(actions.data());
+    for (size_t i = 0; i < CARS; i++) {
+      cte += envs.cte(i);
+    }
+  }
+  cte /= CARS * STEPS;
+  failed = 0;
+  for (size_t i = 0; i < CARS; i++) {
+    failed += envs.off(i);
+  }
+  return true;
+}
+
+// Print `rows` by latency, marking the Pareto front of latency and error.
+static void PrintFront(const char* scenario, std::vector<Row> rows,
+                       const char* error) {
+  std::sort(rows.begin(), rows.end(),
+            [](const Row& a, const Row& b) { return a.p99 < b.p99; });
+  printf("\n%s\n%-2s%-16s %9s %9s %10s %10s %10s %7s\n", scenario, "",
+         "backend", "p50 ms", "p99 ms", "steer deg", "throttle", error,
+         "failed");
+  for (const Row& row : rows) {
+    bool front = true;
+    for (const Row& other : rows) {
+      if (other.p99 <= row.p99 && other.error <= row.error &&
+          (other.p99 < row.p99 || other.error < row.error)) {
+        front = false;
+      }
+    }
+    printf("%-2s%-16s %9.3f %9.3f %10.4f %10.4f %10.4f %7zu\n",
+           front ? "*" : "", row.name, row.p50, row.p99, row.steering,
+           row.throttle, row.error, row.failed);
+  }
+  fflush(stdout);
+}
+
+// Each backend on `frames` against the reference's `actions` there.
+static void Compare(const char* scenario, const Frames& frames,
+                    const std::vector<double>& reference,
+                    const char* policy) {
+  std::vector<Row> rows;
+  std::vector<double> actions;
+  std::vector<double> ms;
+  for (const Backend& backend : BACKENDS) {
+    Row row = {backend.name, 0, 0, 0, 0, 0, 0};
+    if (!Answer(&backend, policy, frames, actions, ms, row.failed)) {
+      continue;
+    }
+    double steering = 0;
+    double throttle = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+      steering += std::pow(actions[2 * i] - reference[2 * i], 2);
+      throttle += std::pow(actions[2 * i + 1] - reference[2 * i + 1], 2);
+    }
+    size_t n = std::max<size_t>(frames.size(), 1);
+    row.p50 = Percentile(ms, 0.5);
+    row.p99 = Percentile(ms, 0.99);
+    row.steering = std::sqrt(steering / n) * 180 / M_PI;
+    row.throttle = std::sqrt(throttle / n);
+    // Steering as a fraction of its range, as the throttle is.
+    row.error = std::sqrt(
+        (steering / (MAX_DELTA * MAX_DELTA) + throttle) / (2 * n));
+    rows.push_back(row);
+  }
+  char title[128];
+  snprintf(title, sizeof(title), "%s: %zu frames", scenario, frames.size());
+  PrintFront(title, rows, "error");
+}
+
+static void Prepare(Telemetry& t) {
+  t.latency = LATENCY;
+  t.prepared = false;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  const char* recording = argc > 2 && strcmp(argv[2], "-") != 0
+                              ? argv[2]
+                              : nullptr;
+  const char* policy = argc > 3 ? argv[3] : nullptr;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  TrackMap track;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6 || !track.Load(path)) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  Frames lap;
+  for (const std::string& text : MakeFrames(wx, wy)) {
+    Frame frame = {0, Telemetry()};
+    if (ParseTelemetry(text.data(), text.data() + text.size(), frame.t)) {
+      Prepare(frame.t);
+      lap.push_back(frame);
+    }
+  }
+  Frames offset = lap;
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  for (Frame& frame : offset) {
+    double side = OFFSET * uniform(random);
+    frame.t.px -= side * sin(frame.t.psi);
+    frame.t.py += side * cos(frame.t.psi);
+    frame.t.psi += TURN * uniform(random);
+  }
+  Frames recorded;
+  MappedFrames log;
+  if (recording) {
+    if (!log.Open(recording) || log.size() == 0) {
+      fprintf(stderr, "no frames in %s\n", recording);
+      return 1;
+    }
+    Arena arena;
+    for (size_t i = 0; i < log.size(); i++) {
+      MappedFrames::Frame f = log[i];
+      Frame frame = {f.connection, Telemetry()};
+      bool parsed = false;
+      const char* begin;
+      const char* end;
+      if (f.binary) {
+        parsed = ParseBinaryTelemetry(f.data, f.data + f.length, frame.t);
+      } else if (hasData(f.data, f.length, begin, end) && begin != end) {
+        try {
+          parsed = ParseTelemetry(begin, end, frame.t) ||
+                   ParseTelemetryJson(begin, end, frame.t, arena);
+        } catch (const std::exception&) {
+          parsed = false;
+        }
+      }
+      if (parsed) {
+        Prepare(frame.t);
+        recorded.push_back(frame);
+      }
+      arena.Reset();
+    }
+  }
+
+  // The lap split by the curvature of the path fitted to each frame.
+  std::vector<double> curvature;
+  {
+    std::unique_ptr<Controller> c = MakeController(nullptr, nullptr);
+    Controller::Output out;
+    for (const Frame& frame : lap) {
+      c->Step(frame.t, std::chrono::steady_clock::time_point::max(), out);
+      curvature.push_back(std::fabs(2 * out.reference[2]));
+    }
+  }
+  double sharp = Percentile(curvature, 0.75);
+  Frames parts[2];
+  for (size_t i = 0; i < lap.size(); i++) {
+    parts[curvature[i] > sharp].push_back(lap[i]);
+  }
+  printf("reference: offline-accurate Ipopt; turns above %.4f 1/m\n", sharp);
+
+  // Each part is answered on its own, without the warm starts of the other
+  // part's frames, by the backends and the reference alike.
+  std::vector<double> reference;
+  std::vector<double> ms;
+  size_t failed;
+  const char* const part_names[2] = {"lap straights", "lap turns"};
+  for (int k = 0; k < 2; k++) {
+    Answer(nullptr, nullptr, parts[k], reference, ms, failed);
+    Compare(part_names[k], parts[k], reference, policy);
+  }
+  Answer(nullptr, nullptr, offset, reference, ms, failed);
+  Compare("off the path", offset, reference, policy);
+  if (recording) {
+    Answer(nullptr, nullptr, recorded, reference, ms, failed);
+    Compare(recording, recorded, reference, policy);
+  }
+
+  // The closed loop, ranked by how far the cars strayed; the reference's
+  // own is listed with them.
+  std::vector<Row> rows;
+  for (size_t b = 0; b <= BACKEND_COUNT; b++) {
+    const Backend* backend = b < BACKEND_COUNT ? &BACKENDS[b] : nullptr;
+    Row row = {backend ? backend->name : "reference", 0, 0, 0, 0, 0, 0};
+    if (!Drive(backend, policy, track, ms, row.error, row.failed)) {
+      continue;
+    }
+    row.p50 = Percentile(ms, 0.5);
+    row.p99 = Percentile(ms, 0.99);
+    row.steering = NAN;
+    row.throttle = NAN;
+    rows.push_back(row);
+  }
+  char title[128];
+  snprintf(title, sizeof(title),
+           "closed loop: %zu cars, %zu periods; failed = left the track",
+           CARS, STEPS);
+  PrintFront(title, rows, "cte m");
+  return 0;
+}
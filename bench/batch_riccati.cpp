@@ -0,0 +1,197 @@
+// The lane-batched Riccati solver against the scalar one, by scalar and
+// lanes: the first table times a Factorize and Solve of BatchRiccati
+// against those of Riccati on each lane's problem in turn; the second,
+// LTVMPC's RICCATI formulation on a batch of cold-started problems, one
+// LTVMPC each, against BatchLTV, with the largest difference of the first
+// actuations. The problems are the frames of a vehicle weaving around a
+// gently curving path, as in ltv_formulations.
+//
+// Usage: batch_riccati [problems]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "BatchLTV.h"
+#include "BatchRiccati.h"
+#include "LTV.h"
+#include "MpcConfig.h"
+#include "Riccati.h"
+#include "SimdKernels.h"
+
+// Repetitions of each kernel timing.
+static const int REPEATS = 200;
+
+static double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+template <class Scalar>
+static const char* ScalarName() {
+  return sizeof(Scalar) == 4 ? "float" : "double";
+}
+
+// The LQ problems of the RICCATI formulation's first ADMM iteration for the
+// first Lanes problems, each into a Riccati of its own and a lane of
+// `batch`.
+template <class Scalar, int Lanes>
+static void Fill(const States& states, const Cubics& coeffs,
+                 const MpcConfig& config,
+                 BatchRiccati<8, 2, Scalar, Lanes>& batch,
+                 std::vector<std::unique_ptr<Riccati<8, 2, Scalar> > >& lanes) {
+  typedef BicycleTypes<Scalar> Types;
+  typedef BatchRiccati<8, 2, Scalar, Lanes> Batch;
+  const KinematicWeights& w = config.weights;
+  size_t T = config.N - 1;
+  typename Types::Matrix xbar = Types::Matrix::Zero(6, config.N);
+  typename Types::Matrix ubar = Types::Matrix::Zero(2, T);
+  for (int lane = 0; lane < Lanes; lane++) {
+    lanes.emplace_back(new Riccati<8, 2, Scalar>(T));
+    Riccati<8, 2, Scalar>& r = *lanes.back();
+    typename Types::Cubic c = coeffs[lane].cast<Scalar>();
+    typename Types::State x0 = states[lane].cast<Scalar>();
+    BicycleRollout(x0, ubar, c, Scalar(config.dt), Scalar(config.Lf), xbar);
+    for (size_t k = 0; k <= T; k++) {
+      if (k > 0) {
+        r.Q[k](3, 3) = 2 * w.v;
+        r.Q[k](4, 4) = 2 * w.cte;
+        r.Q[k](5, 5) = 2 * w.epsi;
+        r.q[k][3] = 2 * w.v * (xbar(3, k) - config.refV);
+        r.q[k][4] = 2 * w.cte * xbar(4, k);
+        r.q[k][5] = 2 * w.epsi * xbar(5, k);
+      }
+      Batch::Put(batch.Q[k], lane, r.Q[k]);
+      Batch::Put(batch.q[k], lane, r.q[k].transpose());
+      if (k == T) {
+        break;
+      }
+      typename Types::StateJacobian A;
+      typename Types::InputJacobian B;
+      typename Types::State s = xbar.col(k);
+      typename Types::Input u = ubar.col(k);
+      BicycleLinearize(s, u, c, Scalar(config.dt), Scalar(config.Lf), A, B);
+      r.A[k].template topLeftCorner<6, 6>() = A;
+      r.B[k].template topRows<6>() = B;
+      r.B[k].template bottomRows<2>().setIdentity();
+      r.R[k](0, 0) = 2 * w.delta + 0.1;
+      r.R[k](1, 1) = 2 * w.a + 0.1;
+      Batch::Put(batch.A[k], lane, r.A[k]);
+      Batch::Put(batch.B[k], lane, r.B[k]);
+      Batch::Put(batch.R[k], lane, r.R[k]);
+    }
+  }
+}
+
+// A Factorize and Solve of the batch against one of each lane's in turn.
+template <class Scalar, int Lanes>
+static void CompareKernels(const States& states, const Cubics& coeffs,
+                           const MpcConfig& config) {
+  typedef BatchRiccati<8, 2, Scalar, Lanes> Batch;
+  size_t T = config.N - 1;
+  Batch batch(T);
+  std::vector<std::unique_ptr<Riccati<8, 2, Scalar> > > lanes;
+  Fill(states, coeffs, config, batch, lanes);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < REPEATS; i++) {
+    for (int lane = 0; lane < Lanes; lane++) {
+      lanes[lane]->Factorize();
+      lanes[lane]->Solve();
+    }
+  }
+  double scalar_us = Since(start) / REPEATS;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < REPEATS; i++) {
+    batch.Factorize();
+    batch.Solve();
+  }
+  double batch_us = Since(start) / REPEATS;
+  double difference = 0;
+  for (int lane = 0; lane < Lanes; lane++) {
+    for (size_t k = 0; k < T; k++) {
+      Eigen::Matrix<Scalar, 1, 2> u;
+      Batch::Get(batch.u[k], lane, u);
+      difference = std::max(
+          difference,
+          double((u.transpose() - lanes[lane]->u[k]).cwiseAbs().maxCoeff()));
+    }
+  }
+  printf("%-7s %6d %12.2f %12.2f %9.2f %12.2e\n", ScalarName<Scalar>(),
+         Lanes, scalar_us, batch_us, scalar_us / batch_us, difference);
+}
+
+// The LTV QPs, one by one on a cold LTVMPC each, against in batches.
+template <class Scalar, int Lanes>
+static void CompareLTV(const States& states, const Cubics& coeffs,
+                       const MpcConfig& config) {
+  size_t n = states.size() / Lanes * Lanes;
+  std::shared_ptr<const ProblemIR> problem =
+      std::make_shared<ProblemIR>(config, config.dt);
+  std::vector<std::unique_ptr<BasicLTVMPC<Scalar> > > singles;
+  for (size_t i = 0; i < n; i++) {
+    singles.emplace_back(new BasicLTVMPC<Scalar>(config.N, problem));
+    singles.back()->formulation = LTVMPC::RICCATI;
+  }
+  std::vector<Input> single(n);
+  std::vector<double> x_vals;
+  std::vector<double> y_vals;
+  long single_iterations = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i++) {
+    x_vals.clear();
+    y_vals.clear();
+    single[i] = singles[i]->Solve(states[i], coeffs[i], x_vals, y_vals);
+    single_iterations += singles[i]->lastIterations;
+  }
+  double single_us = Since(start) / n;
+
+  BatchLTV<Scalar, Lanes> batch(config.N, config.dt, config.Lf, config.refV,
+                                config.weights);
+  double difference = 0;
+  long batch_iterations = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i += Lanes) {
+    batch.Solve(states.data() + i, coeffs.data() + i, Lanes);
+    for (int lane = 0; lane < Lanes; lane++) {
+      difference = std::max(
+          difference,
+          (batch.First(lane) - single[i + lane]).cwiseAbs().maxCoeff());
+      batch_iterations += batch.lastIterations[lane];
+    }
+  }
+  double batch_us = Since(start) / n;
+  printf("%-7s %6d %12.2f %12.2f %9.2f %12.2e %8.1f\n", ScalarName<Scalar>(),
+         Lanes, single_us, batch_us, single_us / batch_us, difference,
+         double(batch_iterations - single_iterations) / n);
+}
+
+int main(int argc, char* argv[]) {
+  size_t problems = argc > 1 ? std::max(atoi(argv[1]), 16) : 256;
+  MpcConfig config;
+  States states(problems);
+  Cubics coeffs(problems);
+  for (size_t i = 0; i < problems; i++) {
+    double phase = 0.05 * i;
+    coeffs[i] << 0.5 * sin(phase), 0.05 * cos(phase), -0.005, 0.0002;
+    states[i] << 0, 0, 0, 30 + 10 * sin(0.3 * phase), coeffs[i][0],
+        -atan(coeffs[i][1]);
+  }
+  printf("N = %zu, %s kernels\n", config.N, IsaName(Kernels().isa));
+  printf("%-7s %6s %12s %12s %9s %12s\n", "scalar", "lanes", "riccati_us",
+         "batch_us", "speedup", "max |du|");
+  CompareKernels<double, 4>(states, coeffs, config);
+  CompareKernels<double, 8>(states, coeffs, config);
+  CompareKernels<float, 8>(states, coeffs, config);
+  CompareKernels<float, 16>(states, coeffs, config);
+  // Per problem; the extra iterations are the batch's over the singles'.
+  printf("%-7s %6s %12s %12s %9s %12s %8s\n", "scalar", "lanes", "ltv_us",
+         "batch_us", "speedup", "max |du|", "extra");
+  CompareLTV<double, 4>(states, coeffs, config);
+  CompareLTV<double, 8>(states, coeffs, config);
+  CompareLTV<float, 8>(states, coeffs, config);
+  CompareLTV<float, 16>(states, coeffs, config);
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Throughput of MPC::SolveBatch on the frames of a lap, repeated into a
+// batch, on 1, 2, 4, ... threads, against the same problems solved one by
+// one on a single cold-started controller. Every thread count must answer
+// each problem as the single controller does, bit for bit. As with
+// parallel_solves, MUMPS solves take turns, so pass a thread-safe linear
+// solver to see the batch scale.
+//
+// Usage: batch_solves [waypoints.csv] [laps] [mumps|ma27|ma57|ma86|ma97]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t laps = argc > 2 ? atoi(argv[2]) : 3;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  MpcConfig config;
+  if (argc > 3) {
+    const char* names[] = {"mumps", "ma27", "ma57", "ma86", "ma97",
+                           "pardiso"};
+    int i = 0;
+    while (i < MpcConfig::LINEAR_SOLVERS && strcmp(argv[3], names[i]) != 0) {
+      i++;
+    }
+    if (i == MpcConfig::LINEAR_SOLVERS) {
+      fprintf(stderr, "unknown linear solver %s\n", argv[3]);
+      return 1;
+    }
+    config.linearSolver = MpcConfig::LinearSolver(i);
+  }
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  // The main thread, and the batch threads of every count tried at once,
+  // as the old ones exit while the new ones start.
+  MPC::SetupThreads(1 + 2 * cores);
+
+  // The lap's problems, `laps` times over.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  WaypointFit fit;
+  std::vector<MPC::BatchProblem> problems;
+  for (size_t lap = 0; lap < laps; lap++) {
+    for (const std::string& frame : frames) {
+      Telemetry t;
+      ParseTelemetry(frame.data(), frame.data() + frame.size(), t);
+      double vx[MAX_WAYPOINTS];
+      double vy[MAX_WAYPOINTS];
+      ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints, vx,
+                     vy);
+      MPC::BatchProblem problem;
+      problem.coeffs = fit.Fit(vx, vy, t.n_waypoints);
+      double cte = polyeval(problem.coeffs, 0);
+      double epsi = -atan(problem.coeffs[1]);
+      problem.state = PredictState(t.v, t.delta, t.a, cte, epsi, config.Lf,
+                                   LATENCY);
+      problems.push_back(problem);
+    }
+  }
+  size_t n = problems.size();
+
+  // Room for each problem's trajectory.
+  const size_t points = 64;
+  std::vector<double> x(n * points);
+  std::vector<double> y(n * points);
+  std::vector<MPC::Result> results(n);
+  auto reset = [&] {
+    for (size_t k = 0; k < n; k++) {
+      MPC::Result r = {0, 0, &x[k * points], &y[k * points], points, 0};
+      results[k] = r;
+    }
+  };
+
+  MPC mpc(config);
+  mpc.fallback = false;
+  mpc.warmStart = false;
+  std::vector<double> reference(2 * n);
+  reset();
+  auto start = std::chrono::steady_clock::now();
+  for (size_t k = 0; k < n; k++) {
+    mpc.Solve(problems[k].state, problems[k].coeffs, results[k]);
+    reference[2 * k] = results[k].delta;
+    reference[2 * k + 1] = results[k].a;
+  }
+  double one_by_one =
+      n / std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        start)
+              .count();
+  printf("%8s %12s %10s %11s %8s\n", "threads", "solves/s", "speedup",
+         "mismatches", "failed");
+  printf("%8s %12.1f %10.2f %11s %8s\n", "single", one_by_one, 1.0, "-", "-");
+
+  std::vector<MPC::Status> statuses(n);
+  bool mismatched = false;
+  for (size_t threads = 1; threads <= cores; threads *= 2) {
+    mpc.batchThreads = threads;
+    // The first batch builds the controllers; time the second.
+    reset();
+    mpc.SolveBatch(problems.data(), results.data(), std::min<size_t>(n, 1));
+    reset();
+    start = std::chrono::steady_clock::now();
+    mpc.SolveBatch(problems.data(), results.data(), n, statuses.data());
+    double rate =
+        n / std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count();
+    size_t mismatches = 0;
+    size_t failed = 0;
+    for (size_t k = 0; k < n; k++) {
+      mismatches += results[k].delta != reference[2 * k] ||
+                    results[k].a != reference[2 * k + 1];
+      failed += statuses[k] != MPC::CONVERGED;
+    }
+    mismatched |= mismatches > 0;
+    printf("%8zu %12.1f %10.2f %11zu %8zu\n", threads, rate,
+           rate / one_by_one, mismatches, failed);
+    fflush(stdout);
+  }
+  return mismatched ? 1 : 0;
+}
@@ -0,0 +1,185 @@
+// Sizes and encoding times of the dashboard stream, see Dashboard: each
+// session's predicted trajectory as the JSON the dashboards are sent by
+// default, against TrajectoryCodec's key frames and deltas, and the
+// bandwidth a dashboard takes for that many vehicles at 10 Hz. Every
+// compact update is decoded again and checked to be within half a
+// centimeter.
+//
+// The trajectories are synthesized from the lake track waypoints: vehicles
+// spread along the track, each seeing the next stretch of it in its own
+// coordinates, with a wobble standing in for the solver's.
+//
+// Usage: dashboard_stream [waypoints.csv] [vehicles] [frames] [points]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "LakeFrames.h"
+#include "SteerMessage.h"
+#include "TrajectoryCodec.h"
+
+// A point along the closed track at arc length `s`.
+struct Track {
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> s;
+  double length;
+
+  void At(double at, double& px, double& py) const {
+    at = fmod(at, length);
+    size_t i = 0;
+    while (i + 1 < s.size() && s[i + 1] <= at) {
+      i++;
+    }
+    size_t next = (i + 1) % x.size();
+    double segment = (i + 1 < s.size() ? s[i + 1] : length) - s[i];
+    double f = (at - s[i]) / segment;
+    px = x[i] + f * (x[next] - x[i]);
+    py = y[i] + f * (y[next] - y[i]);
+  }
+};
+
+// As Dashboard::Publish writes it.
+static void WriteJson(std::string& text, unsigned id, double steering,
+                      double throttle, const double* x, const double* y,
+                      size_t points) {
+  text.clear();
+  text.append("{\"session\":");
+  text.append(std::to_string(id));
+  text.append(",\"steering_angle\":");
+  AppendDouble(text, steering);
+  text.append(",\"throttle\":");
+  AppendDouble(text, throttle);
+  const double* lines[2] = {x, y};
+  const char* keys[2] = {",\"x\":[", "],\"y\":["};
+  for (int k = 0; k < 2; k++) {
+    text.append(keys[k]);
+    for (size_t i = 0; i < points; i++) {
+      if (i > 0) {
+        text.push_back(',');
+      }
+      AppendDouble(text, lines[k][i]);
+    }
+  }
+  text.append("]}");
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t vehicles = argc > 2 ? atoi(argv[2]) : 300;
+  size_t frames = argc > 3 ? atoi(argv[3]) : 200;
+  size_t points = argc > 4 ? atoi(argv[4]) : 20;
+
+  Track track;
+  if (!ReadWaypoints(path, track.x, track.y) || track.x.size() < 2) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  track.length = 0;
+  for (size_t i = 0; i < track.x.size(); i++) {
+    size_t next = (i + 1) % track.x.size();
+    track.s.push_back(track.length);
+    track.length += hypot(track.x[next] - track.x[i],
+                          track.y[next] - track.y[i]);
+  }
+
+  // Frame by frame, each vehicle 0.1 s further at 20 m/s, its trajectory a
+  // point every 0.1 s ahead.
+  const double step = 2;
+  std::vector<std::vector<double> > xs(vehicles * frames);
+  std::vector<std::vector<double> > ys(vehicles * frames);
+  for (size_t f = 0; f < frames; f++) {
+    for (size_t v = 0; v < vehicles; v++) {
+      double s = track.length * v / vehicles + step * f;
+      double cx, cy, ax, ay;
+      track.At(s, cx, cy);
+      track.At(s + 1, ax, ay);
+      double psi = atan2(ay - cy, ax - cx);
+      std::vector<double>& x = xs[f * vehicles + v];
+      std::vector<double>& y = ys[f * vehicles + v];
+      for (size_t i = 0; i < points; i++) {
+        double px, py;
+        track.At(s + step * (i + 1), px, py);
+        double dx = px - cx;
+        double dy = py - cy;
+        double wobble = 0.05 * sin(0.3 * f + 0.7 * v) * i / points;
+        x.push_back(dx * cos(psi) + dy * sin(psi));
+        y.push_back(-dx * sin(psi) + dy * cos(psi) + wobble);
+      }
+    }
+  }
+
+  std::string json;
+  size_t json_bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t f = 0; f < frames; f++) {
+    for (size_t v = 0; v < vehicles; v++) {
+      const std::vector<double>& x = xs[f * vehicles + v];
+      const std::vector<double>& y = ys[f * vehicles + v];
+      WriteJson(json, unsigned(v), 0.05, 0.5, x.data(), y.data(), points);
+      json_bytes += json.size();
+    }
+  }
+  double json_ns = std::chrono::duration<double, std::nano>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::vector<TrajectoryEncoder> encoders(vehicles);
+  std::string key;
+  std::string delta;
+  size_t key_bytes = 0;
+  size_t delta_bytes = 0;
+  size_t deltas = 0;
+  std::vector<std::string> sent;
+  sent.reserve(vehicles * frames);
+  start = std::chrono::steady_clock::now();
+  for (size_t f = 0; f < frames; f++) {
+    for (size_t v = 0; v < vehicles; v++) {
+      const std::vector<double>& x = xs[f * vehicles + v];
+      const std::vector<double>& y = ys[f * vehicles + v];
+      encoders[v].Encode(unsigned(v), 0.05, 0.5, x.data(), y.data(), points,
+                         key, delta);
+      key_bytes += key.size();
+      if (!delta.empty()) {
+        delta_bytes += delta.size();
+        deltas++;
+      }
+      sent.push_back(delta.empty() ? key : delta);
+    }
+  }
+  double compact_ns = std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+  TrajectoryDecoder decoder;
+  TrajectoryUpdate update;
+  double worst = 0;
+  size_t failed = 0;
+  for (size_t k = 0; k < sent.size(); k++) {
+    if (!decoder.Decode(sent[k].data(), sent[k].size(), update)) {
+      failed++;
+      continue;
+    }
+    for (size_t i = 0; i < points; i++) {
+      worst = std::max(worst, std::max(fabs(update.x[i] - xs[k][i]),
+                                       fabs(update.y[i] - ys[k][i])));
+    }
+  }
+
+  size_t updates = vehicles * frames;
+  double delta_mean = deltas ? double(delta_bytes) / deltas : 0;
+  printf("%zu vehicles, %zu frames, %zu points\n", vehicles, frames, points);
+  printf("%-12s %10s %12s %14s\n", "encoding", "bytes", "ns/update",
+         "kB/s at 10 Hz");
+  printf("%-12s %10.1f %12.0f %14.1f\n", "json", double(json_bytes) / updates,
+         json_ns / updates, 10e-3 * json_bytes / frames);
+  printf("%-12s %10.1f %12.0f %14.1f\n", "compact key",
+         double(key_bytes) / updates, compact_ns / updates,
+         10e-3 * key_bytes / frames);
+  printf("%-12s %10.1f %12s %14.1f\n", "compact delta", delta_mean, "",
+         10e-3 * delta_mean * vehicles);
+  printf("decoded: %zu failed, worst error %.4f m\n", failed, worst);
+  return failed == 0 && worst <= 0.005 + 1e-9 ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+// The problem's derivatives three ways: sweeps of the CppAD tape,
+// KinematicNLP's hand-written ones and AutoDiffNLP's per-stage
+// AutoDiffScalar (see MpcConfig::autoDiff). Solves the same frames with each
+// at the horizons KinematicNLP is instantiated for, with the exact and the
+// Gauss-Newton Hessian, and then on RK4 and the dynamic model, which only
+// the tape and AutoDiffNLP have. Prints the iterations, the solve time, the
+// part of it spent evaluating the problem, the largest difference of the
+// actuations from the tape's, and that of the derivatives from the tape's,
+// see MPC::CheckDerivatives.
+//
+// Usage: derivative_backends [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each backend, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+enum Backend { TAPE, ANALYTIC, AUTODIFF, BACKENDS };
+static const char* const BACKEND_NAMES[] = {"tape", "analytic", "autodiff"};
+
+struct Case {
+  const char* name;
+  MpcConfig::Hessian hessian;
+  MpcConfig::Integrator integrator;
+  MpcConfig::Model model;
+};
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  const Case cases[] = {
+      {"euler exact", MpcConfig::EXACT_HESSIAN, MpcConfig::EULER,
+       MpcConfig::KINEMATIC},
+      {"euler gn", MpcConfig::GAUSS_NEWTON, MpcConfig::EULER,
+       MpcConfig::KINEMATIC},
+      {"rk4 exact", MpcConfig::EXACT_HESSIAN, MpcConfig::RK4,
+       MpcConfig::KINEMATIC},
+      {"dynamic rk4", MpcConfig::EXACT_HESSIAN, MpcConfig::RK4,
+       MpcConfig::DYNAMIC},
+  };
+  printf("%-4s %-12s %-9s %7s %8s %11s %11s %9s %11s %11s\n", "N",
+         "problem", "backend", "failed", "iters", "solve p50", "solve p99",
+         "eval ms", "max du", "max dd");
+  const size_t horizons[] = {10, 20, 50};
+  for (size_t N : horizons) {
+    for (const Case& c : cases) {
+      // The tape's actuations of each frame, to compare the others with.
+      std::vector<std::vector<double> > tape(n);
+      for (int backend = 0; backend < BACKENDS; backend++) {
+        bool kinematic_euler = c.integrator == MpcConfig::EULER &&
+                               c.model == MpcConfig::KINEMATIC;
+        if (backend == ANALYTIC && !kinematic_euler) {
+          continue;
+        }
+        MpcConfig config = base;
+        config.N = N;
+        config.horizons.assign(1, Horizon{N, config.dt});
+        config.hessian = c.hessian;
+        config.integrator = c.integrator;
+        config.model = c.model;
+        config.autoDiff = backend == AUTODIFF;
+        MPC mpc(config, backend == ANALYTIC);
+        double max_dd = mpc.CheckDerivatives();
+
+        std::vector<double> solve_ms;
+        double iterations = 0;
+        double eval_ms = 0;
+        double max_du = 0;
+        size_t failed = 0;
+        std::vector<double> mpc_x;
+        std::vector<double> mpc_y;
+        for (size_t i = 0; i < n; i++) {
+          mpc_x.clear();
+          mpc_y.clear();
+          std::vector<double> u =
+              mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+          const MPC::SolveStats& stats = mpc.stats();
+          solve_ms.push_back(stats.seconds * 1e3);
+          iterations += stats.iterations;
+          eval_ms += stats.evalSeconds * 1e3;
+          failed += stats.status != MPC::CONVERGED;
+          if (backend == TAPE) {
+            tape[i] = u;
+          } else {
+            for (size_t k = 0; k < std::min(u.size(), tape[i].size()); k++) {
+              max_du = std::max(max_du, std::fabs(u[k] - tape[i][k]));
+            }
+          }
+        }
+        std::sort(solve_ms.begin(), solve_ms.end());
+        printf("%-4zu %-12s %-9s %7zu %8.1f %11.3f %11.3f %9.3f %11.2g "
+               "%11.2g\n",
+               N, c.name, BACKEND_NAMES[backend], failed, iterations / n,
+               solve_ms[n / 2],
+               solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))],
+               eval_ms / n, max_du, max_dd);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+// The energy mode, see MPC::energyMode, against the full NMPC: a car
+// driven around the track in SimEnvironments by each, at a few error
+// bounds, printing the CPU's joules per frame from the EnergyMeter, the
+// CPU time per frame, the mean distance from the track and, for the
+// energy mode, the frames run at each tier with their mean joules. The
+// CPU idles between frames for the rest of each period, as on a unit.
+// The RAPL counters usually need root.
+//
+// Usage: energy_mode [waypoints.csv] [periods]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "Controller.h"
+#include "EnergyMeter.h"
+#include "MPC.h"
+#include "Realtime.h"
+#include "SimEnvironments.h"
+#include "Telemetry.h"
+#include "TrackMap.h"
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t periods = argc > 2 ? atoi(argv[2]) : 600;
+  TrackMap track;
+  if (!track.Load(path) || track.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  EnergyMeter meter;
+  if (meter.Open()) {
+    printf("energy counters: %s\n", meter.source().c_str());
+  } else {
+    printf("no energy counters to read; joules print as 0\n");
+  }
+
+  // 0 for the full NMPC.
+  const double bounds[] = {0, 0.2, 0.5, 1.0};
+  printf("%-10s %10s %10s %10s %6s\n", "bound", "mJ/frame", "cpu ms",
+         "cte mean", "off");
+  for (double bound : bounds) {
+    MpcConfig config;
+    Controller controller(config);
+    MPC& mpc = controller.mpc();
+    mpc.energyMode = bound > 0;
+    mpc.governor.errorBound = bound;
+    mpc.energyMeter = meter.available() ? &meter : nullptr;
+    SimEnvironments envs(track, 1, config.Lf);
+    envs.Reset(0, 0, 30);
+    Telemetry t;
+    SimEnvironments::Action action;
+    Controller::Output out;
+    double joules = 0;
+    double cte = 0;
+    uint64_t cpu = 0;
+    auto next = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < periods; k++) {
+      envs.Observe(&t);
+      uint64_t before = ThreadCpuNanos();
+      controller.Step(t, std::chrono::steady_clock::time_point::max(), out);
+      cpu += ThreadCpuNanos() - before;
+      joules += mpc.stats().joules;
+      action.steering = out.steering;
+      action.throttle = out.throttle;
+      envs.Step(&action);
+      cte += envs.cte(0);
+      next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(envs.period));
+      std::this_thread::sleep_until(next);
+    }
+    char name[16] = "full";
+    if (bound > 0) {
+      snprintf(name, sizeof(name), "%.2f m", bound);
+    }
+    printf("%-10s %10.3f %10.3f %10.3f %6d\n", name, 1e3 * joules / periods,
+           1e-6 * cpu / periods, cte / periods, envs.off(0));
+    if (bound > 0) {
+      for (int tier = 0; tier < DegradationLadder::NUM_TIERS; tier++) {
+        DegradationLadder::Tier level = DegradationLadder::Tier(tier);
+        if (mpc.governor.frames(level) > 0) {
+          printf("  %-14s %6zu frames %10.3f mJ\n",
+                 DegradationLadder::Name(level), mpc.governor.frames(level),
+                 1e3 * std::max(mpc.governor.joules(level), 0.));
+        }
+      }
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+// The event-triggered mode of MPC::eventTriggered: the same sequence of
+// frames controlled with a solve every frame and with the trigger at a few
+// scales of its default thresholds. Prints the share of frames solved, the
+// forced solves, the CPU per frame, and how far the actuations are from
+// those of a solve every frame.
+//
+// Usage: event_trigger [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames controlled with each trigger, from the start of the lap, and the
+// time between them.
+static const size_t FRAMES = 400;
+static const double PERIOD = 0.1;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  // 0 solves every frame.
+  const double scales[] = {0, 0.5, 1, 2, 4};
+  std::vector<double> full_delta;
+  std::vector<double> full_a;
+  printf("%-6s %8s %8s %12s %12s %14s %14s\n", "scale", "solved", "forced",
+         "cpu mean", "cpu p99", "|ddelta| mean", "|da| mean");
+  for (double scale : scales) {
+    MPC mpc(base);
+    mpc.eventTriggered = scale > 0;
+    mpc.framePeriod = PERIOD;
+    mpc.trigger.cte *= scale;
+    mpc.trigger.epsi *= scale;
+    mpc.trigger.v *= scale;
+    mpc.trigger.curvature *= scale;
+
+    std::vector<double> frame_ms;
+    double total_ms = 0;
+    double delta_error = 0;
+    double a_error = 0;
+    size_t planned = 0;
+    size_t forced = 0;
+    std::vector<double> mpc_x;
+    std::vector<double> mpc_y;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      double ms = mpc.stats().seconds * 1e3;
+      frame_ms.push_back(ms);
+      total_ms += ms;
+      planned += mpc.usedPlan;
+      forced += mpc.forcedSolve;
+      if (scale == 0) {
+        full_delta.push_back(u[0]);
+        full_a.push_back(u[1]);
+      }
+      delta_error += fabs(u[0] - full_delta[i]);
+      a_error += fabs(u[1] - full_a[i]);
+    }
+    std::sort(frame_ms.begin(), frame_ms.end());
+    size_t p99 = std::min(n - 1, size_t(0.99 * (n - 1) + 0.5));
+    printf("%-6.1f %7.1f%% %8zu %12.3f %12.3f %14.5f %14.5f\n", scale,
+           100. * (n - planned) / n, forced, total_ms / n, frame_ms[p99],
+           delta_error / n, a_error / n);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Times the preparation of frames for their solves, the waypoints to the
+// car's frame, the cubic fit and the latency prediction, one frame at a
+// time through WaypointFit as Control() does it, against FrameBatch over
+// batches of 1, 4, 16 and 64 frames, on frames of the lake track, and
+// reports how far the batch's cubics and states are from the one-at-a-time
+// ones.
+//
+// Usage: frame_batch [waypoints.csv]
+#include <bench/BenchTimer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "BicycleModel.h"
+#include "FrameBatch.h"
+#include "LakeFrames.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+static const double LF = 2.67;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  std::vector<std::string> lines = MakeFrames(wx, wy);
+  size_t n = lines.size();
+  std::vector<Telemetry> frames(n);
+  for (size_t i = 0; i < n; i++) {
+    ParseTelemetry(lines[i].data(), lines[i].data() + lines[i].size(),
+                   frames[i]);
+    frames[i].latency = LATENCY;
+  }
+
+  // One at a time, as Control() does.
+  WaypointFit fit;
+  Cubics coeffs(n);
+  std::vector<State, Eigen::aligned_allocator<State> > states(n);
+  auto prepare = [&](size_t i) {
+    const Telemetry& t = frames[i];
+    coeffs[i] = fit.FitWorld(t.px, t.py, t.psi, t.ptsx, t.ptsy, 6);
+    states[i] = PredictState(t.v, t.delta, t.a, coeffs[i][0],
+                             -atan(coeffs[i][1]), LF, t.latency);
+  };
+  for (size_t i = 0; i < n; i++) {
+    prepare(i);
+  }
+
+  const int tries = 10;
+  const int passes = 20;
+  Eigen::BenchTimer single;
+  BENCH(single, tries, passes, {
+    for (size_t i = 0; i < n; i++) {
+      prepare(i);
+    }
+  });
+  double count = double(n) * passes;
+  printf("%zu frames\n", n);
+  printf("%-12s %8.1f ns/frame\n", "one by one", 1e9 * single.best() / count);
+
+  const size_t sizes[] = {1, 4, 16, 64};
+  for (size_t size : sizes) {
+    FrameBatch batch(size);
+    double state_error = 0;
+    double slope_error = 0;
+    auto run = [&](bool check) {
+      for (size_t first = 0; first < n; first += size) {
+        size_t last = std::min(n, first + size);
+        batch.Clear();
+        for (size_t i = first; i < last; i++) {
+          batch.Add(frames[i]);
+        }
+        batch.Prepare(LF);
+        if (!check) {
+          continue;
+        }
+        for (size_t i = first; i < last; i++) {
+          double c[4];
+          double s[6];
+          batch.Coeffs(i - first, c);
+          batch.State(i - first, s);
+          slope_error = std::max(slope_error, std::fabs(c[1] - coeffs[i][1]));
+          for (int k = 0; k < 6; k++) {
+            state_error = std::max(state_error, std::fabs(s[k] - states[i][k]));
+          }
+        }
+      }
+    };
+    run(true);
+    Eigen::BenchTimer timer;
+    BENCH(timer, tries, passes, run(false));
+    char name[32];
+    snprintf(name, sizeof(name), "batch of %zu", size);
+    printf("%-12s %8.1f ns/frame, slope off by %.2g, state by %.2g\n", name,
+           1e9 * timer.best() / count, slope_error, state_error);
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+// The FRENET method, in path coordinates on the path's curvature, against
+// the Cartesian IPOPT tape over the frames of a lap, with each integrator:
+// the time per frame, its worst, Ipopt's iterations, the frames that
+// converged, and how far FRENET's steering and throttle are from IPOPT's
+// on average.
+//
+// Usage: frenet [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+static const size_t STRIDE = 4;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs,
+                           size_t(-1), STRIDE);
+
+  const char* const integrators[] = {"euler", "midpoint", "rk4", "exact"};
+  printf("%-9s %-7s %10s %10s %8s %10s %12s %10s\n", "integr", "method",
+         "ms", "max ms", "iters", "converged", "|d delta|", "|d a|");
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  for (MpcConfig::Integrator integrator :
+       {MpcConfig::EULER, MpcConfig::RK4}) {
+    MpcConfig config = base;
+    config.integrator = integrator;
+    std::vector<Input, Eigen::aligned_allocator<Input> > reference(n);
+    for (MPC::Method method : {MPC::IPOPT, MPC::FRENET}) {
+      MPC mpc(config);
+      mpc.method = method;
+      mpc.WarmUp(1);
+      double ms = 0;
+      double worst = 0;
+      double iterations = 0;
+      size_t converged = 0;
+      double delta_error = 0;
+      double a_error = 0;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        ms += mpc.stats().seconds * 1e3;
+        worst = std::max(worst, mpc.stats().seconds * 1e3);
+        iterations += mpc.stats().iterations;
+        converged += mpc.stats().status == MPC::CONVERGED;
+        if (method == MPC::IPOPT) {
+          reference[i] = Input(u[0], u[1]);
+        } else {
+          delta_error += std::abs(u[0] - reference[i][0]);
+          a_error += std::abs(u[1] - reference[i][1]);
+        }
+      }
+      printf("%-9s %-7s %10.3f %10.3f %8.1f %10zu %12.5f %10.4f\n",
+             integrators[integrator],
+             method == MPC::IPOPT ? "ipopt" : "frenet", ms / n, worst,
+             iterations / n, converged, delta_error / n, a_error / n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
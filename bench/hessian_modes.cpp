@@ -0,0 +1,82 @@
+// The Hessian of the Lagrangian three ways: exact from the tape, the
+// Gauss-Newton approximation of the least-squares cost and Ipopt's L-BFGS
+// (see MpcConfig::hessian). Solves the same frames with each at a few
+// horizons, with a controller set up as the server's, and prints the
+// iterations, the solve time and the part of it spent evaluating the problem.
+//
+// Gauss-Newton drops the curvature of the dynamics, so it can take more
+// iterations than the exact Hessian for each of them being cheaper; it pays
+// off where second order sweeps dominate, at long horizons.
+//
+// Usage: hessian_modes [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+static const char* const MODE_NAMES[] = {"exact", "gauss-newton", "l-bfgs"};
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-4s %-13s %7s %10s %12s %12s %12s %12s\n", "N", "hessian",
+         "failed", "iters", "solve p50", "solve p99", "eval ms", "cost");
+  const size_t horizons[] = {10, 20, 40};
+  for (size_t N : horizons) {
+    for (int mode = 0; mode < 3; mode++) {
+      MpcConfig config = base;
+      config.N = N;
+      config.horizons.assign(1, Horizon{N, config.dt});
+      config.hessian = MpcConfig::Hessian(mode);
+      MPC mpc(config);
+
+      std::vector<double> solve_ms;
+      double iterations = 0;
+      double eval_ms = 0;
+      double cost = 0;
+      size_t failed = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        const MPC::SolveStats& stats = mpc.stats();
+        solve_ms.push_back(stats.seconds * 1e3);
+        iterations += stats.iterations;
+        eval_ms += stats.evalSeconds * 1e3;
+        cost += stats.cost;
+        failed += stats.status != MPC::CONVERGED;
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      printf("%-4zu %-13s %7zu %10.1f %12.3f %12.3f %12.3f %12.4g\n", N,
+             MODE_NAMES[mode], failed, iterations / n, solve_ms[n / 2],
+             solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))],
+             eval_ms / n, cost / n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
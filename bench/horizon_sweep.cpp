@@ -0,0 +1,118 @@
+// How MPC::Solve scales with the horizon: sweeps N from 5 to 100 and dt over
+// a few steps, solving the same frames at each point with a controller set
+// up exactly as the server's, and writes one CSV row per point: the solve
+// time, Ipopt's iterations, the time it spent evaluating the problem and in
+// the linear solver, and the memory the controller took.
+//
+// Memory is the tape's share of CppAD's allocator and the growth of the
+// resident set over building the controller and solving; the sweep runs from
+// short horizons to long so that the latter isn't hidden by freed memory.
+//
+// Usage: horizon_sweep [waypoints.csv] [out.csv]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved at each point, from the start of the lap.
+static const size_t FRAMES = 100;
+static const double LATENCY = 0.1;
+
+// Resident set size in kB; 0 where /proc isn't available.
+static long ResidentKB() {
+  std::ifstream statm("/proc/self/statm");
+  long pages = 0;
+  long resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "can't create %s\n", argv[2]);
+    return 1;
+  }
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  fprintf(out,
+          "N,dt,lookahead_s,frames,failed,solve_ms_median,solve_ms_p99,"
+          "iterations_mean,eval_ms_mean,linear_solve_ms_mean,other_ms_mean,"
+          "tape_kb,rss_growth_kb\n");
+  const size_t horizons[] = {5, 10, 15, 20, 25, 30, 40, 50, 60, 80, 100};
+  const double steps[] = {0.05, 0.1, 0.15, 0.2};
+  for (size_t N : horizons) {
+    for (double dt : steps) {
+      long rss_before = ResidentKB();
+      size_t tape_before = CppAD::thread_alloc::inuse(0);
+      MpcConfig config = base;
+      config.N = N;
+      config.dt = dt;
+      config.horizons.assign(1, Horizon{N, dt});
+      MPC mpc(config);
+      size_t tape = CppAD::thread_alloc::inuse(0) - tape_before;
+
+      std::vector<double> solve_ms;
+      double iterations = 0;
+      double eval_ms = 0;
+      double linear_ms = 0;
+      size_t failed = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        auto start = std::chrono::steady_clock::now();
+        mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        solve_ms.push_back(std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+        const MPC::SolveStats& stats = mpc.stats();
+        iterations += stats.iterations;
+        eval_ms += stats.evalSeconds * 1e3;
+        linear_ms += stats.linearSolveSeconds * 1e3;
+        failed += stats.status != MPC::CONVERGED;
+      }
+      long rss_growth = ResidentKB() - rss_before;
+
+      double total_ms = 0;
+      for (double ms : solve_ms) {
+        total_ms += ms;
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      fprintf(out, "%zu,%g,%g,%zu,%zu,%.3f,%.3f,%.1f,%.3f,%.3f,%.3f,%.1f,%ld\n",
+              N, dt, N * dt, n, failed, solve_ms[n / 2],
+              solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))],
+              iterations / n, eval_ms / n, linear_ms / n,
+              (total_ms - eval_ms - linear_ms) / n, tape / 1024.0, rss_growth);
+      fflush(out);
+      fprintf(stderr, "N=%zu dt=%g done\n", N, dt);
+    }
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
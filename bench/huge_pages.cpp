@@ -0,0 +1,128 @@
+// Many sessions' controllers on one worker, with the heap in small pages
+// and in huge ones, see HugePages.h: each round steps every controller once
+// on its own frame, as a worker goes through its sessions, so that each
+// step finds the TLB full of the others' pages. Prints, for each mode, the
+// time per step and the data TLB read misses per step of the solves, and
+// the memory that ended up in huge pages. Each mode runs in a process of
+// its own, since glibc takes it at startup; the explicit one needs pages
+// reserved in vm.nr_hugepages, and falls back to small pages without.
+// Built with MPC_PERF_COUNTERS for the misses.
+//
+// Usage: huge_pages [sessions] [rounds] [waypoints.csv]
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Controller.h"
+#include "HugePages.h"
+#include "LakeFrames.h"
+#include "Measure.h"
+#include "PerfCounters.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+
+static const size_t WARMUP_ROUNDS = 3;
+static const double LATENCY = 0.1;
+
+// Time the sessions in the heap mode this process was started with.
+static int Run(size_t sessions, size_t rounds, const char* path) {
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  std::vector<std::string> texts = MakeFrames(wx, wy);
+  std::vector<Telemetry> frames(texts.size());
+  for (size_t i = 0; i < texts.size(); i++) {
+    ParseTelemetry(texts[i].data(), texts[i].data() + texts[i].size(),
+                   frames[i]);
+    frames[i].latency = LATENCY;
+  }
+  std::vector<std::unique_ptr<Controller> > controllers;
+  for (size_t s = 0; s < sessions; s++) {
+    controllers.emplace_back(new Controller());
+  }
+
+  // Each session a stretch of the track of its own.
+  size_t stride = std::max<size_t>(frames.size() / sessions, 1);
+  Controller::Output out;
+  std::vector<double> us;
+  us.reserve(sessions * rounds);
+  PerfCounts before;
+  for (size_t round = 0; round < WARMUP_ROUNDS + rounds; round++) {
+    if (round == WARMUP_ROUNDS) {
+      ReadPerfStage(STAGE_SOLVE, before);
+    }
+    for (size_t s = 0; s < sessions; s++) {
+      const Telemetry& frame = frames[(s * stride + round) % frames.size()];
+      auto begin = std::chrono::steady_clock::now();
+      controllers[s]->Step(frame, std::chrono::steady_clock::time_point::max(),
+                           out);
+      if (round >= WARMUP_ROUNDS) {
+        us.push_back(std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - begin).count());
+      }
+    }
+  }
+  PerfCounts after;
+  ReadPerfStage(STAGE_SOLVE, after);
+  double misses = double(after.events[PERF_DTLB_MISSES] -
+                         before.events[PERF_DTLB_MISSES]) / us.size();
+  HugePageUsage huge = {0, 0};
+  ReadHugePageUsage(huge);
+  std::sort(us.begin(), us.end());
+  printf("%-12s %10.1f %10.1f %10.1f %12.0f %10.1f %10.1f\n",
+         HugePageModeName(HeapHugePages()), Percentile(us, 0.5),
+         Percentile(us, 0.99), us.back(), misses,
+         huge.transparentBytes / 1048576.0, huge.explicitBytes / 1048576.0);
+  fflush(stdout);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  // A mode's process: huge_pages --mode <mode> sessions rounds path.
+  if (argc == 6 && strcmp(argv[1], "--mode") == 0) {
+    if (!UseHugePages(HugePageMode(atoi(argv[2])), argv)) {
+      fprintf(stderr, "no huge pages for the heap in this glibc\n");
+      return 1;
+    }
+    return Run(atoi(argv[3]), atoi(argv[4]), argv[5]);
+  }
+  std::string sessions = argc > 1 ? argv[1] : "256";
+  std::string rounds = argc > 2 ? argv[2] : "20";
+  std::string path = argc > 3 ? argv[3] : "../lake_track_waypoints.csv";
+  if (!CountingPerf()) {
+    fprintf(stderr, "built without MPC_PERF_COUNTERS: no TLB misses\n");
+  }
+  printf("%s sessions, %s rounds\n", sessions.c_str(), rounds.c_str());
+  printf("%-12s %10s %10s %10s %12s %10s %10s\n", "heap", "p50 us", "p99 us",
+         "max us", "dtlb/step", "thp MB", "hugetlb MB");
+  fflush(stdout);
+  const HugePageMode modes[] = {NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES,
+                                EXPLICIT_HUGE_PAGES};
+  for (HugePageMode mode : modes) {
+    std::string number = std::to_string(int(mode));
+    const char* args[] = {argv[0],          "--mode",
+                          number.c_str(),   sessions.c_str(),
+                          rounds.c_str(),   path.c_str(),
+                          nullptr};
+    pid_t child = fork();
+    if (child == 0) {
+      execv("/proc/self/exe", const_cast<char* const*>(args));
+      _exit(127);
+    }
+    int status = 0;
+    if (child < 0 || waitpid(child, &status, 0) < 0 ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s failed\n", HugePageModeName(mode));
+    }
+  }
+  return 0;
+}
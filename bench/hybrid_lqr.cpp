@@ -0,0 +1,105 @@
+// The hybrid LQR fast path (see MPC::hybridLqr and SegmentDetector): a lap
+// of the lake track and one of a highway-like oval, two 2 km straights
+// joined by 300 m bends, driven in closed loop by a car of SimEnvironments
+// with the IPOPT controller alone and with the fast path on its straights.
+// Prints the frames the fast path took, the straights it entered, the time
+// per frame and the cross track error of each.
+//
+// Usage: hybrid_lqr [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "Controller.h"
+#include "Measure.h"
+#include "SimEnvironments.h"
+#include "Telemetry.h"
+#include "TrackMap.h"
+
+// Laps given up on after this many frames.
+static const size_t MAX_FRAMES = 20000;
+
+// The oval, waypoints every 5 m.
+static void Highway(TrackMap& track) {
+  const double straight = 2000;
+  const double radius = 300;
+  const double spacing = 5;
+  std::vector<double> x;
+  std::vector<double> y;
+  for (int side = 0; side < 2; side++) {
+    double sign = side == 0 ? 1 : -1;
+    for (double s = 0; s < straight; s += spacing) {
+      x.push_back(sign * (s - straight / 2));
+      y.push_back(-sign * radius);
+    }
+    size_t steps = size_t(M_PI * radius / spacing);
+    for (size_t k = 0; k < steps; k++) {
+      double a = -M_PI / 2 + M_PI * k / steps;
+      x.push_back(sign * (straight / 2 + radius * cos(a)));
+      y.push_back(sign * radius * sin(a));
+    }
+  }
+  track.Assign(x, y);
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  TrackMap lake;
+  if (!lake.Load(path) || lake.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  TrackMap highway;
+  Highway(highway);
+  struct Course {
+    const char* name;
+    const TrackMap* track;
+  };
+  const Course courses[] = {{"lake", &lake}, {"highway", &highway}};
+
+  printf("%-8s %-7s %7s %9s %9s %9s %9s %9s %9s\n", "track", "mode",
+         "frames", "fast %", "straights", "p50 ms", "p99 ms", "cte mean",
+         "cte max");
+  for (const Course& course : courses) {
+    for (int hybrid = 0; hybrid < 2; hybrid++) {
+      Controller controller;
+      controller.mpc().hybridLqr = hybrid;
+      SimEnvironments car(*course.track, 1, controller.mpc().config().Lf);
+      Controller::Output out;
+      std::vector<double> frame_ms;
+      size_t fast = 0;
+      double cte_sum = 0;
+      double cte_max = 0;
+      bool off = false;
+      while (car.progress(0) < course.track->length() &&
+             frame_ms.size() < MAX_FRAMES) {
+        Telemetry t;
+        car.Observe(&t);
+        auto begin = std::chrono::steady_clock::now();
+        controller.Step(t, std::chrono::steady_clock::time_point::max(), out);
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count());
+        fast += controller.mpc().usedFastPath;
+        SimEnvironments::Action action = {out.steering, out.throttle};
+        car.Step(&action);
+        cte_sum += car.cte(0);
+        cte_max = std::max(cte_max, car.cte(0));
+        if (car.off(0)) {
+          off = true;
+          break;
+        }
+      }
+      size_t frames = frame_ms.size();
+      std::sort(frame_ms.begin(), frame_ms.end());
+      printf("%-8s %-7s %7zu %9.1f %9zu %9.3f %9.3f %9.3f %9.3f%s\n",
+             course.name, hybrid ? "hybrid" : "ipopt", frames,
+             100. * fast / frames, controller.mpc().segments.straights(),
+             Percentile(frame_ms, 0.5), Percentile(frame_ms, 0.99),
+             cte_sum / frames, cte_max, off ? "  off the track" : "");
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
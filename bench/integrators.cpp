@@ -0,0 +1,98 @@
+// The integrators of the taped dynamics (see MpcConfig::integrator) at a
+// few steps over about the same lookahead. Solves the same frames with each
+// and prints the solve time, the iterations, the model error, the distance
+// from the predicted first stage to where the first actuations actually
+// take the car over dt, and the mean |cte| after applying them for one
+// control period.
+//
+// Usage: integrators [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+static const double CONTROL_PERIOD = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  const char* const names[] = {"euler", "midpoint", "rk4", "exact"};
+  const Horizon grids[] = {{21, 0.05}, {11, 0.1}, {6, 0.2}};
+  printf("%-9s %4s %5s %7s %12s %12s %12s %10s\n", "integr", "N", "dt",
+         "failed", "solve p50", "iterations", "model err", "|cte|");
+  for (const Horizon& grid : grids) {
+    for (int integrator = MpcConfig::EULER; integrator <= MpcConfig::EXACT;
+         integrator++) {
+      MpcConfig config = base;
+      config.N = grid.N;
+      config.dt = grid.dt;
+      config.horizons.assign(1, grid);
+      config.integrator = MpcConfig::Integrator(integrator);
+      MPC mpc(config);
+
+      std::vector<double> solve_ms;
+      double iterations = 0;
+      double model_error = 0;
+      double cte = 0;
+      size_t failed = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        const MPC::SolveStats& stats = mpc.stats();
+        solve_ms.push_back(stats.seconds * 1e3);
+        iterations += stats.iterations;
+        failed += stats.status != MPC::CONVERGED;
+
+        // The actual first stage: the arc the held actuations drive.
+        const State& s0 = states[i];
+        double S = s0[3] * grid.dt + u[1] * grid.dt * grid.dt / 2;
+        double h = S * u[0] / (2 * base.Lf);
+        double chord = std::fabs(h) < 1e-9 ? S : S * sin(h) / h;
+        double x1 = s0[0] + chord * cos(s0[2] + h);
+        double y1 = s0[1] + chord * sin(s0[2] + h);
+        if (!mpc_x.empty()) {
+          model_error += std::hypot(mpc_x[0] - x1, mpc_y[0] - y1);
+        }
+
+        State s = s0;
+        const int substeps = 10;
+        for (int k = 0; k < substeps; k++) {
+          s = BicycleStep(s, Input(u[0], u[1]), coeffs[i],
+                          CONTROL_PERIOD / substeps, base.Lf);
+        }
+        cte += std::fabs(s[4]);
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      printf("%-9s %4zu %5.2f %7zu %12.3f %12.1f %12.3g %10.4f\n",
+             names[integrator], grid.N, grid.dt, failed, solve_ms[n / 2],
+             iterations / n, model_error / n, cte / n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+// Times the sparse, condensed, Riccati and active-set LTV-MPC formulations
+// over a sweep of horizons, and reports where the sparse QP overtakes the
+// condensed one. The active set's iterations are its working-set changes.
+//
+// Usage: ltv_formulations [frames]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "LTV.h"
+#include "MpcConfig.h"
+
+// Mean solve time in microseconds over `frames` frames of a vehicle weaving
+// around a gently curving path.
+static double TimeFormulation(size_t N, LTVMPC::Formulation formulation,
+                              int frames, double& mean_iterations) {
+  // The controller's tuning, apart from N.
+  MpcConfig config;
+  LTVMPC ltv(N, std::make_shared<ProblemIR>(config, config.dt));
+  ltv.formulation = formulation;
+  Eigen::VectorXd state(6);
+  Eigen::VectorXd coeffs(4);
+  double total = 0;
+  long iterations = 0;
+  for (int i = 0; i < frames; i++) {
+    double phase = 0.05 * i;
+    coeffs << 0.5 * sin(phase), 0.05 * cos(phase), -0.005, 0.0002;
+    state << 0, 0, 0, 30 + 10 * sin(0.3 * phase), coeffs[0], -atan(coeffs[1]);
+    std::vector<double> x_vals;
+    std::vector<double> y_vals;
+    auto start = std::chrono::steady_clock::now();
+    ltv.Solve(state, coeffs, x_vals, y_vals);
+    auto end = std::chrono::steady_clock::now();
+    total += std::chrono::duration<double, std::micro>(end - start).count();
+    iterations += ltv.lastIterations;
+  }
+  mean_iterations = double(iterations) / frames;
+  return total / frames;
+}
+
+int main(int argc, char* argv[]) {
+  int frames = argc > 1 ? atoi(argv[1]) : 200;
+  const size_t horizons[] = {5, 8, 10, 15, 20, 30, 40, 60, 80};
+
+  printf("%4s %12s %8s %12s %8s %12s %8s %12s %8s\n", "N", "sparse_us",
+         "iters", "condensed_us", "iters", "riccati_us", "iters",
+         "active_us", "changes");
+  size_t crossover = 0;
+  for (size_t N : horizons) {
+    double sparse_iters;
+    double condensed_iters;
+    double riccati_iters;
+    double active_changes;
+    double sparse = TimeFormulation(N, LTVMPC::SPARSE, frames, sparse_iters);
+    double condensed =
+        TimeFormulation(N, LTVMPC::CONDENSED, frames, condensed_iters);
+    double riccati =
+        TimeFormulation(N, LTVMPC::RICCATI, frames, riccati_iters);
+    double active =
+        TimeFormulation(N, LTVMPC::ACTIVE_SET, frames, active_changes);
+    if (crossover == 0 && sparse < condensed) {
+      crossover = N;
+    }
+    printf("%4zu %12.1f %8.1f %12.1f %8.1f %12.1f %8.1f %12.1f %8.1f\n", N,
+           sparse, sparse_iters, condensed, condensed_iters, riccati,
+           riccati_iters, active, active_changes);
+  }
+  if (crossover != 0) {
+    printf("sparse overtakes condensed at N = %zu\n", crossover);
+  } else {
+    printf("condensed beats sparse at every N\n");
+  }
+  return 0;
+}
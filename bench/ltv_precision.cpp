@@ -0,0 +1,162 @@
+// LTV-MPC in single precision against double on recorded frames (see
+// FrameLog.h and Precision.h): replays them through a BasicLTVMPC<double>
+// and a BasicLTVMPC<float> per connection, for each formulation, and prints
+// the solve times of both and how far the float actuations are from the
+// double ones.
+//
+// The float QPs refine their solves in double where the factorizations call
+// for it, so their answers stay within the ADMM tolerances of double's; the
+// sparse formulation's QP is double in both (see LTV.h), so its row only
+// shows the trajectory and its linearization rounded to float. The speedup
+// is the target's float SIMD against its double arithmetic, which on x86 is
+// mostly the halved memory traffic.
+//
+// Usage: ltv_precision frames.rec [N]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Arena.h"
+#include "BinaryProtocol.h"
+#include "FrameLog.h"
+#include "LTV.h"
+#include "Measure.h"
+#include "MpcConfig.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+
+static const char* const FORMULATION_NAMES[] = {"sparse", "condensed",
+                                                "riccati", "active-set"};
+
+struct Connection {
+  Connection(const MpcConfig& config, LTVFormulations::Formulation formulation)
+      : exact(config.N, std::make_shared<ProblemIR>(config, config.dt)),
+        single(config.N, std::make_shared<ProblemIR>(config, config.dt)) {
+    exact.formulation = formulation;
+    single.formulation = formulation;
+  }
+  BasicLTVMPC<double> exact;
+  BasicLTVMPC<float> single;
+  WaypointFit fit;
+  Arena arena;
+  Telemetry t;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s frames.rec [N]\n", argv[0]);
+    return 1;
+  }
+  MappedFrames frames;
+  if (!frames.Open(argv[1])) {
+    fprintf(stderr, "can't read %s\n", argv[1]);
+    return 1;
+  }
+  MpcConfig config;
+  if (argc > 2) {
+    config.N = atoi(argv[2]);
+  }
+
+  printf("%-11s %7s %10s %10s %10s %10s %8s %12s %12s %10s %8s %8s\n",
+         "formulation", "frames", "double p50", "double p99", "float p50",
+         "float p99", "speedup", "max ddelta", "mean ddelta", "max da",
+         "failed", "failed f");
+  for (int f = 0; f < 4; f++) {
+    LTVFormulations::Formulation formulation =
+        LTVFormulations::Formulation(f);
+    std::map<unsigned, std::unique_ptr<Connection> > connections;
+    std::vector<double> exact_us;
+    std::vector<double> single_us;
+    double max_delta = 0;
+    double sum_delta = 0;
+    double max_a = 0;
+    size_t failed = 0;
+    size_t failed_single = 0;
+    std::vector<double> x_vals;
+    std::vector<double> y_vals;
+    double vehicle_x[MAX_WAYPOINTS];
+    double vehicle_y[MAX_WAYPOINTS];
+    for (size_t i = 0; i < frames.size(); i++) {
+      MappedFrames::Frame frame = frames[i];
+      std::unique_ptr<Connection>& c = connections[frame.connection];
+      if (!c) {
+        c.reset(new Connection(config, formulation));
+      }
+      Telemetry& t = c->t;
+      bool parsed = false;
+      const char* begin;
+      const char* end;
+      if (frame.binary) {
+        parsed = ParseBinaryTelemetry(frame.data, frame.data + frame.length,
+                                      t);
+      } else if (hasData(frame.data, frame.length, begin, end) &&
+                 begin != end) {
+        try {
+          parsed = ParseTelemetry(begin, end, t) ||
+                   ParseTelemetryJson(begin, end, t, c->arena);
+        } catch (const std::exception&) {
+          parsed = false;
+        }
+      }
+      if (!parsed) {
+        continue;
+      }
+      ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints,
+                     vehicle_x, vehicle_y);
+      Cubic coeffs = c->fit.Fit(vehicle_x, vehicle_y, t.n_waypoints);
+      double cte = polyeval(coeffs, 0);
+      double epsi = -atan(coeffs[1]);
+      State state =
+          PredictState(t.v, t.delta, t.a, cte, epsi, config.Lf, LATENCY);
+
+      x_vals.clear();
+      y_vals.clear();
+      auto t0 = std::chrono::steady_clock::now();
+      Input exact = c->exact.Solve(state, coeffs, x_vals, y_vals);
+      auto t1 = std::chrono::steady_clock::now();
+      x_vals.clear();
+      y_vals.clear();
+      Input single = c->single.Solve(state, coeffs, x_vals, y_vals);
+      auto t2 = std::chrono::steady_clock::now();
+      exact_us.push_back(
+          std::chrono::duration<double, std::micro>(t1 - t0).count());
+      single_us.push_back(
+          std::chrono::duration<double, std::micro>(t2 - t1).count());
+      failed += !c->exact.lastConverged;
+      failed_single += !c->single.lastConverged;
+
+      double delta = std::fabs(exact[0] - single[0]) * 180 / M_PI;
+      max_delta = std::max(max_delta, delta);
+      sum_delta += delta;
+      max_a = std::max(max_a, std::fabs(exact[1] - single[1]));
+    }
+    size_t n = exact_us.size();
+    if (n == 0) {
+      fprintf(stderr, "no telemetry in %s\n", argv[1]);
+      return 1;
+    }
+    double exact_p50 = Percentile(exact_us, 0.5);
+    double single_p50 = Percentile(single_us, 0.5);
+    printf("%-11s %7zu %10.1f %10.1f %10.1f %10.1f %8.2f %12.2e %12.2e "
+           "%10.2e %8zu %8zu\n",
+           FORMULATION_NAMES[f], n, exact_p50, Percentile(exact_us, 0.99),
+           single_p50, Percentile(single_us, 0.99), exact_p50 / single_p50,
+           max_delta, sum_delta / n, max_a, failed, failed_single);
+    fflush(stdout);
+  }
+  return 0;
+}
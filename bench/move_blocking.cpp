@@ -0,0 +1,98 @@
+// Move blocking (see MpcConfig::moveBlocks) over a 2 s lookahead. Solves the
+// same frames with the default horizon, the 2 s one with an actuation pair
+// each stage, and the 2 s one with a few blockings, and prints the actuation
+// variables, the solve time, the iterations, and how far the first
+// actuations are from those of the unblocked 2 s horizon.
+//
+// Usage: move_blocking [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  struct Case {
+    const char* name;
+    size_t N;
+    std::vector<size_t> blocks;
+  };
+  const size_t N = static_cast<size_t>(2 / base.dt + 0.5);
+  const Case cases[] = {
+      {"default", base.N, {}},
+      {"2s", N, {}},
+      {"1,1,2,2,4", N, {1, 1, 2, 2, 4}},
+      {"1,2,4,8", N, {1, 2, 4, 8}},
+      {"2,4,8", N, {2, 4, 8}},
+  };
+  printf("%-12s %4s %8s %7s %12s %12s %12s\n", "blocks", "N", "controls",
+         "failed", "solve p50", "iterations", "max |du|");
+  std::vector<double> first_delta(n);
+  std::vector<double> first_a(n);
+  for (const Case& c : cases) {
+    MpcConfig config = base;
+    config.N = c.N;
+    config.horizons.assign(1, Horizon{c.N, config.dt});
+    config.moveBlocks = c.blocks;
+    MPC mpc(config);
+
+    std::vector<double> solve_ms;
+    double iterations = 0;
+    double max_du = 0;
+    size_t failed = 0;
+    std::vector<double> mpc_x;
+    std::vector<double> mpc_y;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      const MPC::SolveStats& stats = mpc.stats();
+      solve_ms.push_back(stats.seconds * 1e3);
+      iterations += stats.iterations;
+      failed += stats.status != MPC::CONVERGED;
+      if (c.N == N && c.blocks.empty()) {
+        first_delta[i] = u[0];
+        first_a[i] = u[1];
+      } else if (c.N == N) {
+        max_du = std::max(max_du, std::max(std::fabs(u[0] - first_delta[i]),
+                                           std::fabs(u[1] - first_a[i])));
+      }
+    }
+    size_t blocks = 0;
+    for (size_t stages = 0; stages + 1 < c.N; blocks++) {
+      size_t length = c.blocks.empty()
+                          ? 1
+                          : c.blocks[std::min(blocks, c.blocks.size() - 1)];
+      stages += std::max<size_t>(length, 1);
+    }
+    std::sort(solve_ms.begin(), solve_ms.end());
+    printf("%-12s %4zu %8zu %7zu %12.3f %12.1f %12.3g\n", c.name, c.N,
+           2 * blocks, failed, solve_ms[n / 2], iterations / n, max_du);
+    fflush(stdout);
+  }
+  return 0;
+}
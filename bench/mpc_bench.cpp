@@ -0,0 +1,254 @@
+// Micro-benchmarks of the controller's hot path, each on the same inputs
+// every run: hasData, both telemetry parsers, the transform to vehicle
+// coordinates, the fits, polyeval, recording the FG_eval tape and
+// MPC::Solve at N = 10, 20 and 40. Reports the min, median and p99 per call,
+// and in builds with MPC_COUNT_ALLOCATIONS the heap allocations per solve.
+//
+// The inputs are the frames of LakeFrames.h, or those of a recording (see
+// FrameLog.h) when one is given. Calls quicker than the clock are timed in
+// batches of one pass over the frames, and each batch counts as one sample
+// of its mean.
+//
+// Those are the latencies with hot caches, of a call right after the same
+// call on the next frame. --cold times each call on its own after emptying
+// the caches and the TLB, as a frame finds them after the server's I/O and
+// other sessions ran, and --neighbor MiB runs a thread streaming through
+// that much memory throughout; see Interference.h.
+//
+// Usage: mpc_bench [--cold] [--neighbor MiB] [waypoints.csv] [frames.rec]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "AllocationCounter.h"
+#include "Arena.h"
+#include "FrameLog.h"
+#include "Interference.h"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "Polyfit.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+// Samples of each quick benchmark, and the frames solved per horizon.
+static const int BATCHES = 200;
+static const size_t SOLVE_FRAMES = 200;
+static const double LATENCY = 0.1;
+// At most this many samples of each benchmark with --cold, whose evictions
+// take milliseconds each.
+static const size_t COLD_SAMPLES = 1000;
+
+// Set with --cold.
+static CacheEvictor* evictor = nullptr;
+
+// Measure f, or with --cold each call after an eviction.
+template <class F>
+static Stats Time(F f, size_t calls, int batches) {
+  if (!evictor) {
+    return Measure(f, calls, batches);
+  }
+  return MeasureEach([&](size_t i) { f(i % calls); },
+                     [] { evictor->Evict(); },
+                     std::min(calls * batches, COLD_SAMPLES));
+}
+
+static void Report(const char* name, const Stats& s) {
+  printf("%-22s %12.3f %12.3f %12.3f\n", name, s.min * 1e6, s.median * 1e6,
+         s.p99 * 1e6);
+}
+
+int main(int argc, char* argv[]) {
+  int arg = 1;
+  bool cold = false;
+  size_t neighbor_mib = 0;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--cold") == 0) {
+      cold = true;
+    } else if (strcmp(argv[arg], "--neighbor") == 0 && arg + 1 < argc) {
+      neighbor_mib = strtoul(argv[++arg], nullptr, 10);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--cold] [--neighbor MiB] [waypoints.csv] "
+              "[frames.rec]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  const char* path = argc > arg ? argv[arg] : "../lake_track_waypoints.csv";
+  std::vector<std::string> messages;
+  if (argc > arg + 1) {
+    std::vector<RecordedFrame> recorded;
+    if (!ReadFrames(argv[arg + 1], recorded)) {
+      fprintf(stderr, "can't read %s\n", argv[arg + 1]);
+      return 1;
+    }
+    for (const RecordedFrame& frame : recorded) {
+      if (!frame.binary) {
+        messages.push_back(frame.data);
+      }
+    }
+  } else {
+    std::vector<double> x;
+    std::vector<double> y;
+    if (!ReadWaypoints(path, x, y) || x.size() < 6) {
+      fprintf(stderr, "no waypoints in %s\n", path);
+      return 1;
+    }
+    for (const std::string& frame : MakeFrames(x, y)) {
+      messages.push_back("42" + frame);
+    }
+  }
+
+  // The payloads and frames the later stages start from.
+  std::vector<std::string> payloads;
+  std::vector<Telemetry> frames;
+  Arena arena;
+  for (const std::string& message : messages) {
+    const char* begin;
+    const char* end;
+    Telemetry t;
+    if (hasData(message.data(), message.size(), begin, end) &&
+        begin != end &&
+        (ParseTelemetry(begin, end, t) ||
+         ParseTelemetryJson(begin, end, t, arena))) {
+      payloads.push_back(std::string(begin, end));
+      frames.push_back(t);
+    }
+  }
+  if (frames.empty()) {
+    fprintf(stderr, "no telemetry frames\n");
+    return 1;
+  }
+  size_t n = frames.size();
+  printf("%zu frames\n", n);
+  CacheEvictor cache_evictor;
+  if (cold) {
+    evictor = &cache_evictor;
+    printf("cold: %zu MiB evicted before each call\n",
+           cache_evictor.bytes() >> 20);
+  }
+  std::unique_ptr<MemoryNeighbor> neighbor;
+  if (neighbor_mib > 0) {
+    neighbor.reset(new MemoryNeighbor(neighbor_mib << 20));
+    printf("neighbor streaming through %zu MiB\n", neighbor_mib);
+  }
+  printf("%-22s %12s %12s %12s\n", "us per call", "min", "median", "p99");
+
+  double sink = 0;
+  Report("hasData", Time([&](size_t i) {
+    const char* begin;
+    const char* end;
+    hasData(messages[i].data(), messages[i].size(), begin, end);
+    sink += end - begin;
+  }, n, BATCHES));
+  Telemetry t;
+  Report("ParseTelemetry", Time([&](size_t i) {
+    const std::string& p = payloads[i];
+    ParseTelemetry(p.data(), p.data() + p.size(), t);
+    sink += t.px;
+  }, n, BATCHES));
+  Report("ParseTelemetryJson", Time([&](size_t i) {
+    const std::string& p = payloads[i];
+    ParseTelemetryJson(p.data(), p.data() + p.size(), t, arena);
+    sink += t.px;
+  }, n, BATCHES / 10));
+
+  // Every frame in vehicle coordinates, for the fits.
+  std::vector<Eigen::VectorXd> vehicle_x(n);
+  std::vector<Eigen::VectorXd> vehicle_y(n);
+  for (size_t i = 0; i < n; i++) {
+    const Telemetry& f = frames[i];
+    vehicle_x[i].resize(f.n_waypoints);
+    vehicle_y[i].resize(f.n_waypoints);
+    ToVehicleFrame(f.px, f.py, f.psi, f.ptsx, f.ptsy, f.n_waypoints,
+                   vehicle_x[i].data(), vehicle_y[i].data());
+  }
+  double out_x[MAX_WAYPOINTS];
+  double out_y[MAX_WAYPOINTS];
+  Report("ToVehicleFrame", Time([&](size_t i) {
+    const Telemetry& f = frames[i];
+    ToVehicleFrame(f.px, f.py, f.psi, f.ptsx, f.ptsy, f.n_waypoints, out_x,
+                   out_y);
+    sink += out_y[0];
+  }, n, BATCHES));
+  Report("polyfit (QR)", Time([&](size_t i) {
+    sink += polyfit(vehicle_x[i], vehicle_y[i], 3)[0];
+  }, n, BATCHES));
+  WaypointFit fit;
+  Report("WaypointFit::Fit", Time([&](size_t i) {
+    sink += fit.Fit(vehicle_x[i].data(), vehicle_y[i].data(),
+                    vehicle_x[i].size())[0];
+  }, n, BATCHES));
+
+  Cubics coeffs(n);
+  for (size_t i = 0; i < n; i++) {
+    coeffs[i] = fit.Fit(vehicle_x[i].data(), vehicle_y[i].data(),
+                        vehicle_x[i].size());
+  }
+  const int num_points = 24;
+  double next_x[num_points];
+  double next_y[num_points];
+  for (int k = 0; k < num_points; k++) {
+    next_x[k] = 2.5 * (k + 1);
+  }
+  Report("polyeval x24", Time([&](size_t i) {
+    polyeval(coeffs[i], next_x, next_y, num_points);
+    sink += next_y[0];
+  }, n, BATCHES));
+
+  // The states as Control() predicts them over the latency.
+  MpcConfig base;
+  States states(n);
+  for (size_t i = 0; i < n; i++) {
+    const Telemetry& f = frames[i];
+    double cte = polyeval(coeffs[i], 0);
+    double epsi = -atan(coeffs[i][1]);
+    states[i] = PredictState(f.v, f.delta, f.a, cte, epsi, base.Lf, LATENCY);
+  }
+
+  const size_t horizons[] = {10, 20, 40};
+  for (size_t N : horizons) {
+    char name[32];
+    snprintf(name, sizeof(name), "FG_eval tape N=%zu", N);
+    Report(name, Time([&](size_t) {
+      MPC::RecordTape(base, N, base.dt);
+    }, 1, 20));
+
+    // A controller of that single horizon, solving consecutive frames as it
+    // would in the server, warm starts included.
+    MpcConfig config = base;
+    config.N = N;
+    config.horizons.assign(1, Horizon{N, config.dt});
+    MPC mpc(config);
+    double mpc_x[128];
+    double mpc_y[128];
+    MPC::Result result = {0, 0, mpc_x, mpc_y, 128, 0};
+    size_t frame = 0;
+    snprintf(name, sizeof(name), "MPC::Solve N=%zu", N);
+    uint64_t allocations = ThreadAllocations();
+    int solves = int(std::min(n, SOLVE_FRAMES));
+    Report(name, Time([&](size_t) {
+      mpc.Solve(states[frame], coeffs[frame], result);
+      sink += result.delta;
+      frame = (frame + 1) % n;
+    }, 1, solves));
+    if (CountingAllocations()) {
+      printf("%-22s %12.2f\n", "  allocations / solve",
+             double(ThreadAllocations() - allocations) / solves);
+    }
+  }
+  if (sink == 42) {
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,268 @@
+// Replays frames recorded by the server (see record_path in main.cpp and
+// FrameLog.h) through the controller as fast as it goes, and reports the
+// frames per second and the latency of each stage: parsing, the transform
+// to vehicle coordinates, the fit, the solve and writing the reply.
+//
+// Each recorded connection gets a controller of its own, as in the server,
+// with the latency compensated as the emulated 100 ms. The server's
+// FitWorld() is split here into its transform and fit, which are always
+// run, to time them apart.
+//
+// Given a linear solver, Ipopt uses it instead of MUMPS (see
+// MpcConfig::linearSolver); given "all", the frames are replayed with each
+// of them in turn, skipping those this Ipopt wasn't built with, to compare
+// their latencies on this host.
+//
+// Given a samples path, each solve is also written there as a CSV row of
+// the compensated state, the cubic and the actuations, the data PolicyNet
+// is trained on.
+//
+// The recording is mapped rather than read, see MappedFrames; given as
+// frames.rec@from or frames.rec@from-to, in seconds since it started, only
+// the frames received in that span are replayed, found through its index.
+//
+// Usage: mpc_replay frames.rec[@from[-to]] [passes] [linear solver | all]
+//                   [samples.csv]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Arena.h"
+#include "BinaryProtocol.h"
+#include "FrameLog.h"
+#include "LatencyEstimator.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+static const double MAX_STEERING = 25 * M_PI / 180;
+
+enum Stage { PARSE, TRANSFORM, FIT, SOLVE, REPLY, STAGES };
+static const char* const STAGE_NAMES[STAGES] = {"parse", "transform", "fit",
+                                                "solve", "reply"};
+
+struct Controller {
+  explicit Controller(const MpcConfig& config) : mpc(config) {}
+  MPC mpc;
+  WaypointFit fit;
+  Arena arena;
+  Telemetry t;
+  std::string msg;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+static double Seconds(std::chrono::steady_clock::time_point from,
+                      std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<double>(to - from).count();
+}
+
+// Replay frames `first` up to `last` through controllers with `config` and
+// print the report, writing the converged solves to `rows` if not null.
+// False, with nothing printed, if the first solve fails without an
+// iteration, as Ipopt does without the linear solver.
+static bool Replay(const MappedFrames& frames, size_t first, size_t last,
+                   int passes, const MpcConfig& config, FILE* rows) {
+  size_t samples = (last - first) * passes;
+  std::vector<LatencyEstimator> stages(STAGES, LatencyEstimator(samples));
+  LatencyEstimator total(samples);
+  size_t solved = 0;
+  size_t skipped = 0;
+  double vehicle_x[MAX_WAYPOINTS];
+  double vehicle_y[MAX_WAYPOINTS];
+  double mpc_x[128];
+  double mpc_y[128];
+  MPC::Result solution = {0, 0, mpc_x, mpc_y, 128, 0};
+  const int num_points = 24;
+  double next_x[num_points];
+  double next_y[num_points];
+  for (int i = 0; i < num_points; i++) {
+    next_x[i] = 2.5 * (i + 1);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; pass++) {
+    // Fresh controllers each pass, as for new connections.
+    std::map<unsigned, std::unique_ptr<Controller> > controllers;
+    for (size_t i = first; i < last; i++) {
+      MappedFrames::Frame frame = frames[i];
+      std::unique_ptr<Controller>& c = controllers[frame.connection];
+      if (!c) {
+        c.reset(new Controller(config));
+      }
+      Telemetry& t = c->t;
+      const char* data = frame.data;
+      size_t length = frame.length;
+
+      auto t0 = std::chrono::steady_clock::now();
+      bool parsed = false;
+      const char* begin;
+      const char* end;
+      if (frame.binary) {
+        parsed = ParseBinaryTelemetry(data, data + length, t);
+      } else if (hasData(data, length, begin, end) && begin != end) {
+        try {
+          parsed = ParseTelemetry(begin, end, t) ||
+                   ParseTelemetryJson(begin, end, t, c->arena);
+        } catch (const std::exception&) {
+          parsed = false;
+        }
+      }
+      if (!parsed) {
+        skipped++;
+        continue;
+      }
+
+      auto t1 = std::chrono::steady_clock::now();
+      ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints,
+                     vehicle_x, vehicle_y);
+      auto t2 = std::chrono::steady_clock::now();
+      Cubic coeffs = c->fit.Fit(vehicle_x, vehicle_y, t.n_waypoints);
+      auto t3 = std::chrono::steady_clock::now();
+
+      // The state as Control() predicts it over the latency.
+      double Lf = c->mpc.config().Lf;
+      double cte = polyeval(coeffs, 0);
+      double epsi = -atan(coeffs[1]);
+      State state = PredictState(t.v, t.delta, t.a, cte, epsi, Lf, LATENCY);
+      c->mpc.Solve(state, coeffs, solution);
+      auto t4 = std::chrono::steady_clock::now();
+      if (solved == 0 && c->mpc.stats().status == MPC::FAILED &&
+          c->mpc.stats().iterations == 0) {
+        return false;
+      }
+      if (rows && c->mpc.stats().status == MPC::CONVERGED) {
+        for (int i = 0; i < 6; i++) {
+          fprintf(rows, "%.9g,", state[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+          fprintf(rows, "%.9g,", coeffs[i]);
+        }
+        fprintf(rows, "%.9g,%.9g\n", solution.delta, solution.a);
+      }
+
+      double steer_value = -solution.delta / MAX_STEERING;
+      double throttle_value = solution.a;
+      polyeval(coeffs, next_x, next_y, num_points);
+      if (t.binary) {
+        WriteBinarySteer(c->msg, steer_value, throttle_value, mpc_x, mpc_y,
+                         solution.size, next_x, next_y, num_points);
+      } else {
+        WriteSteer(c->msg, steer_value, throttle_value, mpc_x, mpc_y,
+                   solution.size, next_x, next_y, num_points);
+      }
+      auto t5 = std::chrono::steady_clock::now();
+
+      stages[PARSE].Record(Seconds(t0, t1));
+      stages[TRANSFORM].Record(Seconds(t1, t2));
+      stages[FIT].Record(Seconds(t2, t3));
+      stages[SOLVE].Record(Seconds(t3, t4));
+      stages[REPLY].Record(Seconds(t4, t5));
+      total.Record(Seconds(t0, t5));
+      solved++;
+    }
+  }
+  double elapsed = Seconds(start, std::chrono::steady_clock::now());
+
+  printf("%zu frames solved, %zu skipped, in %.3f s: %.1f frames/s\n", solved,
+         skipped, elapsed, solved / elapsed);
+  printf("%-10s %12s %12s %12s %12s\n", "stage", "p50 us", "p90 us",
+         "p99 us", "max us");
+  for (int s = 0; s <= STAGES; s++) {
+    const LatencyEstimator& e = s < STAGES ? stages[s] : total;
+    printf("%-10s %12.2f %12.2f %12.2f %12.2f\n",
+           s < STAGES ? STAGE_NAMES[s] : "total", e.Percentile(0.5) * 1e6,
+           e.Percentile(0.9) * 1e6, e.Percentile(0.99) * 1e6,
+           e.Percentile(1) * 1e6);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "usage: %s frames.rec[@from[-to]] [passes] "
+            "[linear solver | all] [samples.csv]\n",
+            argv[0]);
+    return 1;
+  }
+  int passes = argc > 2 ? atoi(argv[2]) : 1;
+  const char* solver = argc > 3 ? argv[3] : "mumps";
+  std::string path = argv[1];
+  double from = 0;
+  double to = -1;
+  size_t at = path.rfind('@');
+  if (at != std::string::npos) {
+    const char* span = path.c_str() + at + 1;
+    char* end;
+    from = strtod(span, &end);
+    if (*end == '-') {
+      to = strtod(end + 1, &end);
+    }
+    path.erase(at);
+  }
+  MappedFrames frames;
+  if (!frames.Open(path)) {
+    fprintf(stderr, "can't read %s\n", path.c_str());
+    return 1;
+  }
+  size_t first = frames.Seek(from);
+  size_t last = to < 0 ? frames.size() : frames.Seek(to);
+  if (first >= last) {
+    fprintf(stderr, "no frames in %s\n", argv[1]);
+    return 1;
+  }
+
+  FILE* samples = nullptr;
+  if (argc > 4) {
+    samples = fopen(argv[4], "w");
+    if (!samples) {
+      fprintf(stderr, "failed to write %s\n", argv[4]);
+      return 1;
+    }
+    fprintf(samples, "x,y,psi,v,cte,epsi,c0,c1,c2,c3,delta,a\n");
+  }
+
+  MpcConfig config;
+  if (strcmp(solver, "all") != 0) {
+    config.linearSolver = LinearSolverNamed(solver);
+    if (config.linearSolver == MpcConfig::LINEAR_SOLVERS) {
+      fprintf(stderr, "unknown linear solver %s\n", solver);
+      return 1;
+    }
+    bool replayed = Replay(frames, first, last, passes, config, samples);
+    if (samples) {
+      fclose(samples);
+    }
+    if (!replayed) {
+      fprintf(stderr, "Ipopt can't solve with %s\n", solver);
+      return 1;
+    }
+    return 0;
+  }
+  for (int i = 0; i < MpcConfig::LINEAR_SOLVERS; i++) {
+    config.linearSolver = MpcConfig::LinearSolver(i);
+    printf("%s%s\n", i > 0 ? "\n" : "", LinearSolverName(config.linearSolver));
+    // One solver's samples are enough.
+    if (!Replay(frames, first, last, passes, config,
+                i == 0 ? samples : nullptr)) {
+      printf("not available\n");
+    }
+  }
+  if (samples) {
+    fclose(samples);
+  }
+  return 0;
+}
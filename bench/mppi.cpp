@@ -0,0 +1,103 @@
+// The MPPI controller against Ipopt over the frames of a lap, for a sweep
+// of engines, rollouts per frame and threads: the time per frame, its
+// worst, and how far MPPI's steering and throttle are from Ipopt's on
+// average. The CUDA engine is only swept in builds with MPC_CUDA, where it
+// goes up to 131072 rollouts.
+//
+// Usage: mppi [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+static const size_t STRIDE = 4;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs,
+                           size_t(-1), STRIDE);
+
+  // Ipopt's answers, as the reference.
+  std::vector<Input, Eigen::aligned_allocator<Input> > reference(n);
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  double ipopt_ms = 0;
+  {
+    MPC mpc(base);
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      reference[i] = Input(u[0], u[1]);
+      ipopt_ms += mpc.stats().seconds * 1e3;
+    }
+  }
+  printf("ipopt: %.3f ms per frame\n", ipopt_ms / n);
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  const char* const names[] = {"arrays", "threads", "cuda"};
+  std::vector<MPPI::Engine> engines = {MPPI::ARRAYS, MPPI::TENSOR_THREADS};
+#ifdef MPC_CUDA
+  engines.push_back(MPPI::TENSOR_CUDA);
+#endif
+  printf("%-8s %8s %8s %10s %10s %12s %10s\n", "engine", "samples",
+         "threads", "ms", "max ms", "|d delta|", "|d a|");
+  for (MPPI::Engine engine : engines) {
+    std::vector<size_t> counts = {256, 1024, 4096, 16384};
+    if (engine == MPPI::TENSOR_CUDA) {
+      counts = {4096, 16384, 65536, 131072};
+    }
+    for (size_t samples : counts) {
+      for (size_t threads : {size_t(1), cores}) {
+        if (engine == MPPI::TENSOR_CUDA && threads > 1) {
+          continue;
+        }
+        MpcConfig config = base;
+        config.mppiEngine = engine;
+        config.mppiSamples = samples;
+        config.mppiThreads = threads;
+        MPC mpc(config);
+        mpc.method = MPC::PATH_INTEGRAL;
+        double ms = 0;
+        double worst = 0;
+        double delta_error = 0;
+        double a_error = 0;
+        for (size_t i = 0; i < n; i++) {
+          mpc_x.clear();
+          mpc_y.clear();
+          std::vector<double> u =
+              mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+          ms += mpc.stats().seconds * 1e3;
+          worst = std::max(worst, mpc.stats().seconds * 1e3);
+          delta_error += std::abs(u[0] - reference[i][0]);
+          a_error += std::abs(u[1] - reference[i][1]);
+        }
+        printf("%-8s %8zu %8zu %10.3f %10.3f %12.5f %10.4f\n",
+               names[engine], samples, threads, ms / n, worst,
+               delta_error / n, a_error / n);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
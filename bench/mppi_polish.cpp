@@ -0,0 +1,105 @@
+// Ipopt polishing a pass of MPPI, see MPC::MPPI_START, against its other
+// starts over the frames of a lap: from zeros, the curvature rollout, the
+// shifted last solution, and MPPI's nominal with and without the cap on
+// the iterations. The frames are split into the sharpest quarter of the
+// path's curvature, the turns, and the rest; each prints the mean
+// iterations, the median and 99th percentile solve time, MPPI's pass
+// included, the mean cost and the frames that didn't converge.
+//
+// Usage: mppi_polish [waypoints.csv] [polish iterations]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "Polynomial.h"
+
+static const size_t FRAMES = 400;
+static const double LATENCY = 0.1;
+
+struct Totals {
+  std::vector<double> ms;
+  double iterations = 0;
+  double cost = 0;
+  size_t failed = 0;
+};
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  int polish = argc > 2 ? atoi(argv[2]) : 10;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+  std::vector<double> curvature(n);
+  for (size_t i = 0; i < n; i++) {
+    curvature[i] = std::fabs(2 * coeffs[i][2]);
+  }
+  double turn = Percentile(curvature, 0.75);
+
+  struct Mode {
+    const char* name;
+    MPC::Start start;
+    int polish;
+  };
+  const Mode modes[] = {
+      {"zero", MPC::ZERO_START, 0},
+      {"curvature", MPC::CURVATURE_START, 0},
+      {"warm", MPC::WARM_START, 0},
+      {"mppi", MPC::MPPI_START, 0},
+      {"mppi+cap", MPC::MPPI_START, polish},
+  };
+  printf("turns: curvature above %.4f 1/m; cap %d iterations\n", turn,
+         polish);
+  printf("%-10s %-9s %9s %9s %9s %10s %7s\n", "start", "frames", "iter",
+         "p50 ms", "p99 ms", "cost", "failed");
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  for (const Mode& mode : modes) {
+    MPC mpc(base);
+    mpc.fallback = false;
+    mpc.start = mode.start;
+    mpc.polishIterations = mode.polish;
+    Totals totals[2];
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      const MPC::SolveStats& stats = mpc.stats();
+      Totals& t = totals[curvature[i] > turn];
+      t.ms.push_back(stats.seconds * 1e3);
+      t.iterations += stats.iterations;
+      if (stats.status == MPC::FAILED ||
+          stats.status == MPC::DEADLINE_EXCEEDED) {
+        t.failed++;
+      } else {
+        t.cost += stats.cost;
+      }
+    }
+    const char* const parts[2] = {"straights", "turns"};
+    for (int k = 1; k >= 0; k--) {
+      const Totals& t = totals[k];
+      size_t frames = t.ms.size();
+      printf("%-10s %-9s %9.1f %9.3f %9.3f %10.4f %7zu\n", mode.name,
+             parts[k], t.iterations / std::max<size_t>(frames, 1),
+             Percentile(t.ms, 0.5), Percentile(t.ms, 0.99),
+             t.cost / std::max<size_t>(frames - t.failed, 1), t.failed);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
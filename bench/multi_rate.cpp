@@ -0,0 +1,79 @@
+// The multi-rate mode of MPC::solveEvery: the same sequence of frames
+// controlled with a full solve every 1, 2, 3, 5 and 10 frames, tracking the
+// last plan in between. Prints the CPU per frame, its tail, and how far the
+// actuations are from those of a full solve every frame.
+//
+// Usage: multi_rate [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames controlled with each rate, from the start of the lap, and the
+// time between them.
+static const size_t FRAMES = 400;
+static const double PERIOD = 0.1;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  const size_t rates[] = {1, 2, 3, 5, 10};
+  std::vector<double> full_delta;
+  std::vector<double> full_a;
+  printf("%-6s %9s %12s %12s %14s %14s\n", "every", "planned", "cpu mean",
+         "cpu p99", "|ddelta| mean", "|da| mean");
+  for (size_t every : rates) {
+    MPC mpc(base);
+    mpc.solveEvery = every;
+    mpc.framePeriod = PERIOD;
+
+    std::vector<double> frame_ms;
+    double total_ms = 0;
+    double delta_error = 0;
+    double a_error = 0;
+    size_t planned = 0;
+    std::vector<double> mpc_x;
+    std::vector<double> mpc_y;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      double ms = mpc.stats().seconds * 1e3;
+      frame_ms.push_back(ms);
+      total_ms += ms;
+      planned += mpc.usedPlan;
+      if (every == 1) {
+        full_delta.push_back(u[0]);
+        full_a.push_back(u[1]);
+      }
+      delta_error += fabs(u[0] - full_delta[i]);
+      a_error += fabs(u[1] - full_a[i]);
+    }
+    std::sort(frame_ms.begin(), frame_ms.end());
+    size_t p99 = std::min(n - 1, size_t(0.99 * (n - 1) + 0.5));
+    printf("%-6zu %9zu %12.3f %12.3f %14.5f %14.5f\n", every, planned,
+           total_ms / n, frame_ms[p99], delta_error / n, a_error / n);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Ipopt against InteriorPoint on the same problems (see
+// MpcConfig::nlpSolver). Solves the same frames with each at a few horizons,
+// with a controller set up as the server's, and prints the iterations, the
+// solve time and the parts of it spent evaluating the problem and in the
+// linear solver.
+//
+// Both take the same Newton steps on the same KKT systems; what differs is
+// the overhead around them, which at short horizons is most of Ipopt's time.
+//
+// Usage: nlp_solvers [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each solver, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+static const char* const SOLVER_NAMES[] = {"ipopt", "interior-point"};
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-4s %-15s %7s %10s %12s %12s %12s %12s %12s\n", "N", "solver",
+         "failed", "iters", "solve p50", "solve p99", "eval ms", "linear ms",
+         "cost");
+  const size_t horizons[] = {10, 20, 30};
+  for (size_t N : horizons) {
+    for (int solver = 0; solver < 2; solver++) {
+      MpcConfig config = base;
+      config.N = N;
+      config.horizons.assign(1, Horizon{N, config.dt});
+      config.nlpSolver = MpcConfig::NlpSolver(solver);
+      MPC mpc(config);
+
+      std::vector<double> solve_ms;
+      double iterations = 0;
+      double eval_ms = 0;
+      double linear_ms = 0;
+      double cost = 0;
+      size_t failed = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        const MPC::SolveStats& stats = mpc.stats();
+        solve_ms.push_back(stats.seconds * 1e3);
+        iterations += stats.iterations;
+        eval_ms += stats.evalSeconds * 1e3;
+        linear_ms += stats.linearSolveSeconds * 1e3;
+        cost += stats.cost;
+        failed += stats.status != MPC::CONVERGED;
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      printf("%-4zu %-15s %7zu %10.1f %12.3f %12.3f %12.3f %12.3f %12.4g\n",
+             N, SOLVER_NAMES[solver], failed, iterations / n, solve_ms[n / 2],
+             solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))],
+             eval_ms / n, linear_ms / n, cost / n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Obstacle constraints pruned by the BVH (see ObstacleMap and
+// MpcConfig::obstacleSlots): the lake track's road edges as walls of discs,
+// and maps of more and more obstacles scattered off the road around it.
+// For each map a Controller drives the frames of a lap with the obstacle
+// slots, and the time of ObstacleMap::Near over the frames' trajectories,
+// the slots filled, the solve times and the failed solves are printed next
+// to the constraints that constraining every stage by every disc would
+// take.
+//
+// Usage: obstacles [waypoints.csv] [slots]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "Controller.h"
+#include "LakeFrames.h"
+#include "Obstacles.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "TrackMap.h"
+
+static const size_t FRAMES = 1000;
+static const double LATENCY = 0.1;
+// Half the road's width, and the radius of the discs of its edges.
+static const double HALF_WIDTH = 5;
+static const double EDGE_RADIUS = 0.5;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t slots = argc > 2 ? atoi(argv[2]) : 2;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  TrackMap track;
+  track.Assign(wx, wy);
+  std::vector<std::string> texts = MakeFrames(wx, wy);
+  size_t n = std::min(texts.size(), FRAMES);
+  std::vector<Telemetry> frames(n);
+  for (size_t i = 0; i < n; i++) {
+    ParseTelemetry(texts[i].data(), texts[i].data() + texts[i].size(),
+                   frames[i]);
+    frames[i].latency = LATENCY;
+  }
+  double min_x = *std::min_element(wx.begin(), wx.end()) - 50;
+  double max_x = *std::max_element(wx.begin(), wx.end()) + 50;
+  double min_y = *std::min_element(wy.begin(), wy.end()) - 50;
+  double max_y = *std::max_element(wy.begin(), wy.end()) + 50;
+
+  printf("%8s %8s %12s %10s %10s %10s %10s %10s %8s\n", "scatter", "discs",
+         "naive cons", "slot cons", "near us", "filled", "solve p50",
+         "solve p99", "failed");
+  const size_t scattered[] = {0, 1000, 10000, 100000};
+  for (size_t count : scattered) {
+    ObstacleMap map;
+    map.AddRoadEdges(track, HALF_WIDTH, EDGE_RADIUS);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> ux(min_x, max_x);
+    std::uniform_real_distribution<double> uy(min_y, max_y);
+    std::uniform_real_distribution<double> radius(0.5, 2);
+    for (size_t added = 0; added < count;) {
+      double x = ux(rng);
+      double y = uy(rng);
+      double r = radius(rng);
+      double cx;
+      double cy;
+      double dx;
+      double dy;
+      track.Evaluate(track.Project(x, y), cx, cy, dx, dy);
+      if (std::hypot(x - cx, y - cy) > HALF_WIDTH + r) {
+        map.Add(x, y, r);
+        added++;
+      }
+    }
+    map.Build();
+
+    MpcConfig config;
+    config.obstacleSlots = slots;
+    config.softConstraints = true;
+    Controller controller(config);
+    controller.mpc().obstacles = &map;
+    Controller::Output out;
+    std::vector<double> solve_ms;
+    size_t failed = 0;
+    for (size_t i = 0; i < n; i++) {
+      controller.Step(frames[i], std::chrono::steady_clock::time_point::max(),
+                      out);
+      const MPC::SolveStats& stats = controller.mpc().stats();
+      solve_ms.push_back(stats.seconds * 1e3);
+      failed += stats.status != MPC::CONVERGED;
+    }
+
+    // The queries alone, over a straight run ahead of each frame's car, as
+    // a cold solve has it.
+    const size_t stages = config.N - 1;
+    std::vector<double> x(stages);
+    std::vector<double> y(stages);
+    std::vector<uint32_t> near(stages * slots);
+    std::vector<double> clearance(stages * slots);
+    std::vector<size_t> found(stages);
+    size_t filled = 0;
+    double near_us = 0;
+    for (size_t i = 0; i < n; i++) {
+      const Telemetry& t = frames[i];
+      double c = cos(t.psi);
+      double s = sin(t.psi);
+      for (size_t k = 0; k < stages; k++) {
+        double along = std::max(t.v, 1.) * config.dt * (k + 1);
+        x[k] = t.px + c * along;
+        y[k] = t.py + s * along;
+      }
+      auto begin = std::chrono::steady_clock::now();
+      map.Near(x.data(), y.data(), stages, config.obstacleReach, slots,
+               near.data(), clearance.data(), found.data());
+      near_us += std::chrono::duration<double, std::micro>(
+                     std::chrono::steady_clock::now() - begin).count();
+      for (size_t k = 0; k < stages; k++) {
+        filled += found[k];
+      }
+    }
+
+    std::sort(solve_ms.begin(), solve_ms.end());
+    printf("%8zu %8zu %12zu %10zu %10.2f %10.2f %10.3f %10.3f %8zu\n", count,
+           map.size(), map.size() * stages, slots * stages, near_us / n,
+           double(filled) / (n * stages), solve_ms[n / 2],
+           solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))], failed);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+// A stress test of CppAD's multi-threaded setup: controllers solving the
+// frames of a lap on 1, 2, 4, ... threads at once, each built on its own
+// thread, every thread running the lap several times. Each thread must get
+// the actuations a single controller gets on the main thread, bit for bit;
+// the throughput shows how far the solves scale. With MUMPS the Ipopt
+// solves themselves take turns, see MPC::serializeIpopt, so pass a
+// thread-safe linear solver to see them scale.
+//
+// Usage: parallel_solves [waypoints.csv] [laps] [mumps|ma27|ma57|ma86|ma97]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+static const double LATENCY = 0.1;
+
+// The first actuations of each frame of `laps` laps.
+static void SolveLaps(const MpcConfig& config, const States& states,
+                      const Cubics& coeffs, size_t laps,
+                      std::vector<double>& u) {
+  MPC mpc(config);
+  mpc.fallback = false;
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  u.clear();
+  for (size_t lap = 0; lap < laps; lap++) {
+    for (size_t i = 0; i < states.size(); i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      std::vector<double> v = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      u.insert(u.end(), v.begin(), v.end());
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t laps = argc > 2 ? atoi(argv[2]) : 3;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  MpcConfig config;
+  if (argc > 3) {
+    const char* names[] = {"mumps", "ma27", "ma57", "ma86", "ma97",
+                           "pardiso"};
+    int i = 0;
+    while (i < MpcConfig::LINEAR_SOLVERS && strcmp(argv[3], names[i]) != 0) {
+      i++;
+    }
+    if (i == MpcConfig::LINEAR_SOLVERS) {
+      fprintf(stderr, "unknown linear solver %s\n", argv[3]);
+      return 1;
+    }
+    config.linearSolver = MpcConfig::LinearSolver(i);
+  }
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  MPC::SetupThreads(cores + 1);
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, config.Lf, LATENCY, states, coeffs);
+
+  std::vector<double> reference;
+  SolveLaps(config, states, coeffs, laps, reference);
+
+  printf("%8s %12s %10s %11s\n", "threads", "solves/s", "speedup",
+         "mismatches");
+  double serial = 0;
+  bool failed = false;
+  for (size_t threads = 1; threads <= cores; threads *= 2) {
+    std::vector<std::vector<double> > u(threads);
+    std::vector<std::thread> running;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < threads; k++) {
+      running.emplace_back(SolveLaps, std::cref(config), std::cref(states),
+                           std::cref(coeffs), laps, std::ref(u[k]));
+    }
+    for (std::thread& thread : running) {
+      thread.join();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    size_t mismatches = 0;
+    for (size_t k = 0; k < threads; k++) {
+      mismatches += u[k] != reference;
+    }
+    failed |= mismatches > 0;
+    double rate = threads * laps * n / seconds;
+    if (threads == 1) {
+      serial = rate;
+    }
+    printf("%8zu %12.1f %10.2f %11zu\n", threads, rate, rate / serial,
+           mismatches);
+    fflush(stdout);
+  }
+  return failed ? 1 : 0;
+}
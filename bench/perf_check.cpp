@@ -0,0 +1,358 @@
+// The performance gate: times the hot path as mpc_bench does and the frames
+// stage by stage as mpc_replay does, then compares the median and p99 of
+// each against a baseline file and prints them side by side. Exits with 1
+// if any is slower than the baseline allows, so that a build can fail on
+// it; the mpc_perf_check target runs it against bench/perf_baseline.txt.
+//
+// The baseline has a line per measurement, its name and its median and p99
+// in microseconds, and a tolerance line, the fractions the median and p99
+// may grow by and microseconds of slack on top for the quickest calls:
+//
+//   tolerance 0.15 0.3 0.05
+//   ParseTelemetry 0.41 0.52
+//
+// With --update the baseline's measurements are replaced by this run's,
+// keeping its tolerance. Baselines only compare on the host, build type and
+// linear solver they were taken with.
+//
+// Usage: perf_check [--update] baseline.txt [waypoints.csv] [frames.rec]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FrameLog.h"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "Polynomial.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const int BATCHES = 200;
+static const size_t SOLVE_FRAMES = 200;
+static const double LATENCY = 0.1;
+static const double MAX_STEERING = 25 * M_PI / 180;
+
+struct Tolerance {
+  double median;
+  double p99;
+  double slack;
+};
+
+struct Measurement {
+  std::string name;
+  double median;
+  double p99;
+};
+
+static void Add(std::vector<Measurement>& results, const char* name,
+                const Stats& s) {
+  Measurement r = {name, s.median * 1e6, s.p99 * 1e6};
+  results.push_back(r);
+  fprintf(stderr, "%-20s %10.3f %10.3f\n", name, r.median, r.p99);
+}
+
+// The telemetry frames of the hot path: their messages, and the connection
+// each came on.
+static bool ReadMessages(const char* waypoints, const char* recording,
+                         std::vector<std::string>& messages,
+                         std::vector<unsigned>& connections) {
+  if (recording) {
+    std::vector<RecordedFrame> recorded;
+    if (!ReadFrames(recording, recorded)) {
+      fprintf(stderr, "can't read %s\n", recording);
+      return false;
+    }
+    for (const RecordedFrame& frame : recorded) {
+      if (!frame.binary) {
+        messages.push_back(frame.data);
+        connections.push_back(frame.connection);
+      }
+    }
+  } else {
+    std::vector<double> x;
+    std::vector<double> y;
+    if (!ReadWaypoints(waypoints, x, y) || x.size() < 6) {
+      fprintf(stderr, "no waypoints in %s\n", waypoints);
+      return false;
+    }
+    for (const std::string& frame : MakeFrames(x, y)) {
+      messages.push_back("42" + frame);
+      connections.push_back(0);
+    }
+  }
+  return true;
+}
+
+// The calls of mpc_bench, each on every frame.
+static void MeasureCalls(const std::vector<std::string>& messages,
+                         std::vector<Measurement>& results) {
+  std::vector<std::string> payloads;
+  std::vector<Telemetry> frames;
+  for (const std::string& message : messages) {
+    const char* begin;
+    const char* end;
+    Telemetry t;
+    if (hasData(message.data(), message.size(), begin, end) &&
+        begin != end && ParseTelemetry(begin, end, t)) {
+      payloads.push_back(std::string(begin, end));
+      frames.push_back(t);
+    }
+  }
+  size_t n = frames.size();
+  if (n == 0) {
+    return;
+  }
+
+  double sink = 0;
+  Add(results, "hasData", Measure([&](size_t i) {
+    const char* begin;
+    const char* end;
+    hasData(messages[i].data(), messages[i].size(), begin, end);
+    sink += end - begin;
+  }, n, BATCHES));
+  Telemetry t;
+  Add(results, "ParseTelemetry", Measure([&](size_t i) {
+    const std::string& p = payloads[i];
+    ParseTelemetry(p.data(), p.data() + p.size(), t);
+    sink += t.px;
+  }, n, BATCHES));
+  double vx[MAX_WAYPOINTS];
+  double vy[MAX_WAYPOINTS];
+  Add(results, "ToVehicleFrame", Measure([&](size_t i) {
+    const Telemetry& f = frames[i];
+    ToVehicleFrame(f.px, f.py, f.psi, f.ptsx, f.ptsy, f.n_waypoints, vx, vy);
+    sink += vy[0];
+  }, n, BATCHES));
+
+  WaypointFit fit;
+  Cubics coeffs(n);
+  MpcConfig base;
+  States states(n);
+  for (size_t i = 0; i < n; i++) {
+    const Telemetry& f = frames[i];
+    ToVehicleFrame(f.px, f.py, f.psi, f.ptsx, f.ptsy, f.n_waypoints, vx, vy);
+    coeffs[i] = fit.Fit(vx, vy, f.n_waypoints);
+    states[i] = PredictState(f.v, f.delta, f.a, polyeval(coeffs[i], 0),
+                             -atan(coeffs[i][1]), base.Lf, LATENCY);
+  }
+  Add(results, "WaypointFit::Fit", Measure([&](size_t i) {
+    const Telemetry& f = frames[i];
+    ToVehicleFrame(f.px, f.py, f.psi, f.ptsx, f.ptsy, f.n_waypoints, vx, vy);
+    sink += fit.Fit(vx, vy, f.n_waypoints)[0];
+  }, n, BATCHES));
+  const int num_points = 24;
+  double next_x[num_points];
+  double next_y[num_points];
+  for (int k = 0; k < num_points; k++) {
+    next_x[k] = 2.5 * (k + 1);
+  }
+  Add(results, "polyeval_x24", Measure([&](size_t i) {
+    polyeval(coeffs[i], next_x, next_y, num_points);
+    sink += next_y[0];
+  }, n, BATCHES));
+
+  const size_t horizons[] = {10, 20};
+  for (size_t N : horizons) {
+    MpcConfig config = base;
+    config.N = N;
+    config.horizons.assign(1, Horizon{N, config.dt});
+    MPC mpc(config);
+    double mpc_x[128];
+    double mpc_y[128];
+    MPC::Result result = {0, 0, mpc_x, mpc_y, 128, 0};
+    size_t frame = 0;
+    char name[32];
+    snprintf(name, sizeof(name), "MPC::Solve_N%zu", N);
+    Add(results, name, Measure([&](size_t) {
+      mpc.Solve(states[frame], coeffs[frame], result);
+      sink += result.delta;
+      frame = (frame + 1) % n;
+    }, 1, int(std::min(n, SOLVE_FRAMES))));
+  }
+  if (sink == 42) {
+    fprintf(stderr, "\n");
+  }
+}
+
+// A connection's controller in MeasureReplay.
+struct Replayer {
+  explicit Replayer(const MpcConfig& config) : mpc(config) {}
+  MPC mpc;
+  WaypointFit fit;
+  std::string msg;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// The stages of mpc_replay, frame by frame through a controller per
+// connection.
+static void MeasureReplay(const std::vector<std::string>& messages,
+                          const std::vector<unsigned>& connections,
+                          std::vector<Measurement>& results) {
+  enum { PARSE, TRANSFORM, FIT, SOLVE, REPLY, TOTAL, STAGES };
+  static const char* const names[STAGES] = {
+      "replay_parse", "replay_transform", "replay_fit",
+      "replay_solve", "replay_reply",     "replay_total"};
+  std::map<unsigned, std::unique_ptr<Replayer> > replayers;
+  std::vector<std::vector<double> > samples(STAGES);
+  MpcConfig config;
+  double vx[MAX_WAYPOINTS];
+  double vy[MAX_WAYPOINTS];
+  double mpc_x[128];
+  double mpc_y[128];
+  MPC::Result solution = {0, 0, mpc_x, mpc_y, 128, 0};
+  const int num_points = 24;
+  double next_x[num_points];
+  double next_y[num_points];
+  for (int i = 0; i < num_points; i++) {
+    next_x[i] = 2.5 * (i + 1);
+  }
+  auto seconds = [](std::chrono::steady_clock::time_point from,
+                    std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+  };
+  for (size_t i = 0; i < messages.size(); i++) {
+    std::unique_ptr<Replayer>& r = replayers[connections[i]];
+    if (!r) {
+      r.reset(new Replayer(config));
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    Telemetry t;
+    const char* begin;
+    const char* end;
+    if (!hasData(messages[i].data(), messages[i].size(), begin, end) ||
+        begin == end || !ParseTelemetry(begin, end, t)) {
+      continue;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints, vx, vy);
+    auto t2 = std::chrono::steady_clock::now();
+    Cubic coeffs = r->fit.Fit(vx, vy, t.n_waypoints);
+    auto t3 = std::chrono::steady_clock::now();
+    State state = PredictState(t.v, t.delta, t.a, polyeval(coeffs, 0),
+                               -atan(coeffs[1]), config.Lf, LATENCY);
+    r->mpc.Solve(state, coeffs, solution);
+    auto t4 = std::chrono::steady_clock::now();
+    polyeval(coeffs, next_x, next_y, num_points);
+    WriteSteer(r->msg, -solution.delta / MAX_STEERING, solution.a, mpc_x,
+               mpc_y, solution.size, next_x, next_y, num_points);
+    auto t5 = std::chrono::steady_clock::now();
+    samples[PARSE].push_back(seconds(t0, t1));
+    samples[TRANSFORM].push_back(seconds(t1, t2));
+    samples[FIT].push_back(seconds(t2, t3));
+    samples[SOLVE].push_back(seconds(t3, t4));
+    samples[REPLY].push_back(seconds(t4, t5));
+    samples[TOTAL].push_back(seconds(t0, t5));
+  }
+  if (samples[TOTAL].empty()) {
+    return;
+  }
+  for (int s = 0; s < STAGES; s++) {
+    Add(results, names[s], Summarize(samples[s]));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+  int arg = update ? 2 : 1;
+  if (argc <= arg) {
+    fprintf(stderr,
+            "usage: %s [--update] baseline.txt [waypoints.csv] "
+            "[frames.rec]\n",
+            argv[0]);
+    return 2;
+  }
+  const char* baseline_path = argv[arg];
+  const char* waypoints =
+      argc > arg + 1 ? argv[arg + 1] : "../lake_track_waypoints.csv";
+  const char* recording = argc > arg + 2 ? argv[arg + 2] : nullptr;
+
+  Tolerance tolerance = {0.15, 0.3, 0.05};
+  std::map<std::string, Measurement> baseline;
+  std::ifstream in(baseline_path);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    Measurement r;
+    if (!(fields >> r.name) || r.name[0] == '#') {
+      continue;
+    }
+    if (r.name == "tolerance") {
+      fields >> tolerance.median >> tolerance.p99 >> tolerance.slack;
+    } else if (fields >> r.median >> r.p99) {
+      baseline[r.name] = r;
+    }
+  }
+  in.close();
+
+  std::vector<std::string> messages;
+  std::vector<unsigned> connections;
+  if (!ReadMessages(waypoints, recording, messages, connections)) {
+    return 2;
+  }
+  std::vector<Measurement> results;
+  MeasureCalls(messages, results);
+  MeasureReplay(messages, connections, results);
+  if (results.empty()) {
+    fprintf(stderr, "no telemetry frames\n");
+    return 2;
+  }
+
+  if (update) {
+    std::ofstream out(baseline_path);
+    out << "# Medians and p99s in microseconds, see bench/perf_check.cpp.\n"
+        << "tolerance " << tolerance.median << " " << tolerance.p99 << " "
+        << tolerance.slack << "\n";
+    for (const Measurement& r : results) {
+      out << r.name << " " << r.median << " " << r.p99 << "\n";
+    }
+    if (!out) {
+      fprintf(stderr, "can't write %s\n", baseline_path);
+      return 2;
+    }
+    printf("%zu measurements written to %s\n", results.size(),
+           baseline_path);
+    return 0;
+  }
+
+  printf("%-20s %10s %10s %8s %10s %10s %8s\n", "us", "median", "was",
+         "change", "p99", "was", "change");
+  size_t regressed = 0;
+  for (const Measurement& r : results) {
+    auto b = baseline.find(r.name);
+    if (b == baseline.end()) {
+      printf("%-20s %10.3f %10s %8s %10.3f %10s %8s  new\n", r.name.c_str(),
+             r.median, "-", "-", r.p99, "-", "-");
+      continue;
+    }
+    const Measurement& was = b->second;
+    bool slower =
+        r.median > was.median * (1 + tolerance.median) + tolerance.slack ||
+        r.p99 > was.p99 * (1 + tolerance.p99) + tolerance.slack;
+    regressed += slower;
+    printf("%-20s %10.3f %10.3f %+7.1f%% %10.3f %10.3f %+7.1f%%  %s\n",
+           r.name.c_str(), r.median, was.median,
+           100 * (r.median / was.median - 1), r.p99, was.p99,
+           100 * (r.p99 / was.p99 - 1), slower ? "REGRESSED" : "ok");
+  }
+  if (baseline.empty()) {
+    printf("\nno baseline in %s; take one with --update\n", baseline_path);
+  } else if (regressed) {
+    printf("\n%zu of %zu slower than the baseline allows\n", regressed,
+           results.size());
+    return 1;
+  }
+  return 0;
+}
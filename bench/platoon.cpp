@@ -0,0 +1,85 @@
+// The distributed platoon MPC (see PlatoonMPC) in closed loop on a straight
+// road, for platoons of 1 to 128 cars on one thread and on every core. The
+// cars start 12 m apart, at 0.6 of the reference speed and off the lane;
+// after 5 s the leader slows to half that, and the cars behind, which would
+// keep their speed, have to brake to hold their 10 m gaps. A horizon of 2 s,
+// N = 20 at dt = 0.1, since the configuration's 0.5 s is too short to see
+// the leader's braking coming in time. Prints the time per frame, the
+// consensus iterations, the frames that converged, the closest any car came
+// to the one ahead, and the time per car.
+//
+// Usage: platoon
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "MpcConfig.h"
+#include "PlatoonMPC.h"
+
+static const size_t FRAMES = 200;
+static const double PERIOD = 0.1;
+static const double START_GAP = 12;
+static const size_t SLOW_FRAME = 50;
+
+int main() {
+  MpcConfig config;
+  config.N = 20;
+  config.dt = 0.1;
+  double speed = 0.6 * config.refV;
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  printf("%5s %8s %10s %10s %8s %10s %10s %10s\n", "cars", "threads", "ms",
+         "max ms", "iter", "converged", "min gap", "us/car");
+  for (size_t count : {1, 2, 4, 8, 16, 32, 64, 128}) {
+    for (size_t threads : {size_t(1), cores}) {
+      PlatoonMPC platoon(config.N, config.dt, config.Lf, config.weights,
+                         count, threads);
+      // On the road's own frame, the path y = 0: x along it is the arc
+      // length.
+      std::vector<PlatoonCar> cars(count);
+      for (size_t i = 0; i < count; i++) {
+        PlatoonCar& car = cars[i];
+        double y = 0.5 * ((i % 3) - 1.0);
+        double psi = 0.02 * ((i % 5) - 2.0);
+        car.state << -START_GAP * i, y, psi, speed, -y, psi;
+        car.coeffs.setZero();
+        car.refV = speed;
+      }
+      std::vector<Input> inputs(count);
+      double total = 0;
+      double worst = 0;
+      double iterations = 0;
+      size_t converged = 0;
+      double min_gap = INFINITY;
+      for (size_t f = 0; f < FRAMES; f++) {
+        cars[0].refV = f < SLOW_FRAME ? speed : speed / 2;
+        for (PlatoonCar& car : cars) {
+          car.s = car.state[0];
+        }
+        auto begin = std::chrono::steady_clock::now();
+        platoon.Solve(cars.data(), inputs.data());
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - begin)
+                        .count();
+        total += ms;
+        worst = std::max(worst, ms);
+        iterations += platoon.lastIterations;
+        converged += platoon.lastConverged;
+        for (size_t i = 0; i < count; i++) {
+          cars[i].state = BicycleStep(cars[i].state, inputs[i], cars[i].coeffs,
+                                      PERIOD, config.Lf);
+        }
+        for (size_t i = 1; i < count; i++) {
+          min_gap =
+              std::min(min_gap, cars[i - 1].state[0] - cars[i].state[0]);
+        }
+      }
+      printf("%5zu %8zu %10.3f %10.3f %8.1f %10zu %10.2f %10.1f\n", count,
+             threads, total / FRAMES, worst, iterations / FRAMES, converged,
+             count > 1 ? min_gap : 0.0, total / FRAMES / count * 1e3);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+// Times the fixed-size cubic fit of 6 waypoints against the dynamic QR fit,
+// on waypoints of the lake track in vehicle coordinates, and reports how far
+// apart the two fits are.
+//
+// Usage: polyfit [waypoints.csv]
+#include <bench/BenchTimer.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Polyfit.h"
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::ifstream in(path);
+  std::string line;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    size_t comma = line.find(',');
+    if (comma != std::string::npos) {
+      x.push_back(atof(line.c_str()));
+      y.push_back(atof(line.c_str() + comma + 1));
+    }
+  }
+  if (x.size() < 7) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // Each frame: 6 waypoints seen from the one before them, heading along
+  // the track.
+  size_t n = x.size();
+  typedef Eigen::Matrix<double, 6, 1> Vector6d;
+  std::vector<Vector6d, Eigen::aligned_allocator<Vector6d> > xs(n);
+  std::vector<Vector6d, Eigen::aligned_allocator<Vector6d> > ys(n);
+  for (size_t i = 0; i < n; i++) {
+    size_t next = (i + 1) % n;
+    double psi = atan2(y[next] - y[i], x[next] - x[i]);
+    for (size_t k = 0; k < 6; k++) {
+      double dx = x[(i + 1 + k) % n] - x[i];
+      double dy = y[(i + 1 + k) % n] - y[i];
+      xs[i][k] = dx * cos(psi) + dy * sin(psi);
+      ys[i][k] = -dx * sin(psi) + dy * cos(psi);
+    }
+  }
+
+  // Worst difference in the fitted lines over the span of the waypoints,
+  // relative to that span.
+  double worst = 0;
+  for (size_t i = 0; i < n; i++) {
+    Eigen::Vector4d fixed = polyfit<3>(xs[i], ys[i]);
+    Eigen::VectorXd dynamic = polyfit(xs[i], ys[i], 3);
+    for (size_t k = 0; k < 6; k++) {
+      double xk = xs[i][k];
+      double a = fixed[0] + xk * (fixed[1] + xk * (fixed[2] + xk * fixed[3]));
+      double b =
+          dynamic[0] + xk * (dynamic[1] + xk * (dynamic[2] + xk * dynamic[3]));
+      worst = std::max(worst, std::fabs(a - b) / xs[i].cwiseAbs().maxCoeff());
+    }
+  }
+
+  const int tries = 10;
+  const int passes = 100;
+  Eigen::BenchTimer fixed_timer;
+  Eigen::BenchTimer dynamic_timer;
+  double sink = 0;
+  BENCH(fixed_timer, tries, passes, {
+    for (size_t i = 0; i < n; i++) {
+      sink += polyfit<3>(xs[i], ys[i])[3];
+    }
+  });
+  BENCH(dynamic_timer, tries, passes, {
+    for (size_t i = 0; i < n; i++) {
+      sink += polyfit(xs[i], ys[i], 3)[3];
+    }
+  });
+  printf("%zu fits, largest difference %.3g of the span (%g)\n", n, worst,
+         sink);
+  double fits = double(n) * passes;
+  printf("%-10s %8.1f ns/fit\n", "fixed", 1e9 * fixed_timer.best() / fits);
+  printf("%-10s %8.1f ns/fit\n", "dynamic", 1e9 * dynamic_timer.best() / fits);
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Ipopt's gradient-based scaling against the user scaling from physical
+// units (see MpcConfig::userScaling), on frames recorded by the server (see
+// record_path in main.cpp and FrameLog.h). Replays the frames through a
+// controller per connection with each, and prints the failed solves and the
+// median, p99 and largest iterations and solve times.
+//
+// Usage: problem_scaling frames.rec
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Arena.h"
+#include "BinaryProtocol.h"
+#include "FrameLog.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+
+struct Controller {
+  explicit Controller(const MpcConfig& config) : mpc(config) {}
+  MPC mpc;
+  WaypointFit fit;
+  Arena arena;
+  Telemetry t;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Parse a recorded frame as the server does.
+static bool Parse(const RecordedFrame& frame, Controller& c) {
+  const char* data = frame.data.data();
+  size_t length = frame.data.size();
+  if (frame.binary) {
+    return ParseBinaryTelemetry(data, data + length, c.t);
+  }
+  const char* begin;
+  const char* end;
+  if (!hasData(data, length, begin, end) || begin == end) {
+    return false;
+  }
+  try {
+    return ParseTelemetry(begin, end, c.t) ||
+           ParseTelemetryJson(begin, end, c.t, c.arena);
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+template <class T>
+static T Percentile(std::vector<T> values, double p) {
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1,
+                         size_t(p * (values.size() - 1) + 0.5))];
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s frames.rec\n", argv[0]);
+    return 1;
+  }
+  std::vector<RecordedFrame> frames;
+  if (!ReadFrames(argv[1], frames) || frames.empty()) {
+    fprintf(stderr, "no frames in %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%-9s %7s %7s %9s %9s %9s %12s %12s %12s\n", "scaling", "solved",
+         "failed", "iter p50", "iter p99", "iter max", "solve p50",
+         "solve p99", "solve max");
+  for (int user = 0; user < 2; user++) {
+    MpcConfig config;
+    config.userScaling = user;
+    std::map<unsigned, std::unique_ptr<Controller> > controllers;
+    std::vector<int> iterations;
+    std::vector<double> solve_ms;
+    size_t failed = 0;
+    double vehicle_x[MAX_WAYPOINTS];
+    double vehicle_y[MAX_WAYPOINTS];
+    double mpc_x[128];
+    double mpc_y[128];
+    MPC::Result solution = {0, 0, mpc_x, mpc_y, 128, 0};
+    for (const RecordedFrame& frame : frames) {
+      std::unique_ptr<Controller>& c = controllers[frame.connection];
+      if (!c) {
+        c.reset(new Controller(config));
+      }
+      if (!Parse(frame, *c)) {
+        continue;
+      }
+      const Telemetry& t = c->t;
+      ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints,
+                     vehicle_x, vehicle_y);
+      Cubic coeffs = c->fit.Fit(vehicle_x, vehicle_y, t.n_waypoints);
+      double cte = polyeval(coeffs, 0);
+      double epsi = -atan(coeffs[1]);
+      State state =
+          PredictState(t.v, t.delta, t.a, cte, epsi, config.Lf, LATENCY);
+      c->mpc.Solve(state, coeffs, solution);
+      const MPC::SolveStats& stats = c->mpc.stats();
+      iterations.push_back(stats.iterations);
+      solve_ms.push_back(stats.seconds * 1e3);
+      failed += stats.status != MPC::CONVERGED;
+    }
+    if (iterations.empty()) {
+      fprintf(stderr, "no telemetry in %s\n", argv[1]);
+      return 1;
+    }
+    printf("%-9s %7zu %7zu %9d %9d %9d %12.3f %12.3f %12.3f\n",
+           user ? "user" : "gradient", iterations.size(), failed,
+           Percentile(iterations, 0.5), Percentile(iterations, 0.99),
+           Percentile(iterations, 1.), Percentile(solve_ms, 0.5),
+           Percentile(solve_ms, 0.99), Percentile(solve_ms, 1.));
+    fflush(stdout);
+  }
+  return 0;
+}
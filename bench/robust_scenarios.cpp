@@ -0,0 +1,85 @@
+// The scenario-based robust MPC over the frames of a lap, for growing
+// numbers of scenarios on one thread and on every core: the time per
+// frame, the consensus iterations, and how far the shared first move is
+// from the nominal model's alone. Scenarios beyond the configured ones
+// spread Lf, the extra latency and the grip evenly over their ranges.
+//
+// Usage: robust_scenarios [waypoints.csv]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+static const size_t STRIDE = 4;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs,
+                           size_t(-1), STRIDE);
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  printf("%9s %8s %10s %10s %10s %12s\n", "scenarios", "threads", "ms",
+         "max ms", "iter", "|d delta|");
+  for (size_t count : {1, 5, 8, 16, 32}) {
+    std::vector<Scenario> scenarios(base.scenarios);
+    scenarios.resize(std::min(count, scenarios.size()));
+    for (size_t i = scenarios.size(); i < count; i++) {
+      double f = double(i) / (count - 1);
+      scenarios.push_back({base.Lf * (0.85 + 0.3 * f), 0.05 * f,
+                           1 - 0.3 * f});
+    }
+    for (size_t threads : {size_t(1), cores}) {
+      MpcConfig config = base;
+      config.scenarios = scenarios;
+      config.scenarioThreads = threads;
+      MPC robust(config);
+      robust.method = MPC::ROBUST;
+      MPC nominal(base);
+      nominal.method = MPC::LINEAR_TIME_VARYING;
+      nominal.ltvFormulation = LTVMPC::CONDENSED;
+      double ms = 0;
+      double worst = 0;
+      double iterations = 0;
+      double delta_error = 0;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> u =
+            robust.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        ms += robust.stats().seconds * 1e3;
+        worst = std::max(worst, robust.stats().seconds * 1e3);
+        iterations += robust.stats().iterations;
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> v =
+            nominal.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        delta_error += std::abs(u[0] - v[0]);
+      }
+      printf("%9zu %8zu %10.3f %10.3f %10.1f %12.5f\n", count, threads,
+             ms / n, worst, iterations / n, delta_error / n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
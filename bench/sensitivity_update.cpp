@@ -0,0 +1,100 @@
+// The sensitivity update of MPC::Predict against full solves: each frame is
+// solved, its KKT matrix factored, and the next frame predicted from it and
+// then solved. Prints the time to factor and to predict, and how far the
+// predicted actuations are from the solved ones, next to how far the
+// previous frame's actuations are, which is what the car would otherwise
+// hold until the solve finished.
+//
+// Usage: sensitivity_update [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+
+// Frames solved, from the start of the lap.
+static const size_t FRAMES = 400;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  MPC mpc(base);
+  mpc.sensitivity = true;
+  double x[MAX_WAYPOINTS];
+  double y[MAX_WAYPOINTS];
+  std::vector<double> factor_ms;
+  std::vector<double> predict_ms;
+  std::vector<double> predicted_error;
+  std::vector<double> held_error;
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  size_t missed = 0;
+  std::vector<double> last = mpc.Solve(states[0], coeffs[0], mpc_x, mpc_y);
+  for (size_t i = 1; i < n; i++) {
+    auto start = std::chrono::steady_clock::now();
+    mpc.Prepare();
+    auto factored = std::chrono::steady_clock::now();
+    MPC::Result predicted = {0, 0, x, y, MAX_WAYPOINTS, 0};
+    bool ok = mpc.Predict(states[i], coeffs[i], predicted);
+    auto end = std::chrono::steady_clock::now();
+
+    mpc_x.clear();
+    mpc_y.clear();
+    std::vector<double> solved = mpc.Solve(states[i], coeffs[i], mpc_x,
+                                           mpc_y);
+    if (!ok || mpc.stats().status != MPC::CONVERGED) {
+      missed++;
+      last = solved;
+      continue;
+    }
+    factor_ms.push_back(
+        std::chrono::duration<double, std::milli>(factored - start).count());
+    predict_ms.push_back(
+        std::chrono::duration<double, std::milli>(end - factored).count());
+    predicted_error.push_back(std::max(fabs(predicted.delta - solved[0]),
+                                       fabs(predicted.a - solved[1])));
+    held_error.push_back(std::max(fabs(last[0] - solved[0]),
+                                  fabs(last[1] - solved[1])));
+    last = solved;
+  }
+
+  size_t m = predict_ms.size();
+  printf("%zu frames, %zu without a prediction or a converged solve\n", n - 1,
+         missed);
+  if (m == 0) {
+    return 1;
+  }
+  std::vector<double>* columns[] = {&factor_ms, &predict_ms, &predicted_error,
+                                    &held_error};
+  const char* names[] = {"factor ms", "predict ms", "|du| predicted",
+                         "|du| held"};
+  size_t p99 = std::min(m - 1, size_t(0.99 * (m - 1) + 0.5));
+  printf("%-15s %12s %12s %12s\n", "", "p50", "p99", "max");
+  for (size_t c = 0; c < 4; c++) {
+    std::vector<double>& v = *columns[c];
+    std::sort(v.begin(), v.end());
+    printf("%-15s %12.5f %12.5f %12.5f\n", names[c], v[m / 2], v[p99],
+           v[m - 1]);
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+// What a controller costs in memory with its tapes shared among controllers
+// of the same shape, see MpcConfig::shareTapes, or with its own: builds
+// a number of controllers spread over a few threads, each solving the
+// first frames of the lap, and prints per controller the growth of the
+// resident set, the time to build it, its share of the tapes and of the
+// workspace, and the median solve. Every controller must get the
+// actuations of a controller with its own tapes on the main thread, bit
+// for bit. Run it once a mode: freed memory stays with CppAD's allocator,
+// so a second mode in the same process would be measured on the first's.
+//
+// Usage: shared_tapes [waypoints.csv] [controllers] [shared|private]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+static const double LATENCY = 0.1;
+// Frames each controller solves.
+static const size_t FRAMES = 20;
+
+// Resident set size in kB; 0 where /proc isn't available.
+static long ResidentKB() {
+  std::ifstream statm("/proc/self/statm");
+  long pages = 0;
+  long resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// The first actuations of each frame.
+static std::vector<double> SolveFrames(MPC& mpc, const States& states,
+                                       const Cubics& coeffs,
+                                       std::vector<double>* solve_ms) {
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  std::vector<double> u;
+  for (size_t i = 0; i < states.size(); i++) {
+    mpc_x.clear();
+    mpc_y.clear();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> v = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+    if (solve_ms) {
+      solve_ms->push_back(std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+    }
+    u.insert(u.end(), v.begin(), v.end());
+  }
+  return u;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t count = argc > 2 ? std::max(atoi(argv[2]), 1) : 100;
+  bool shared = argc <= 3 || strcmp(argv[3], "private") != 0;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, count);
+  MPC::SetupThreads(threads + 1);
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig config;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, config.Lf, LATENCY, states, coeffs, FRAMES);
+
+  std::vector<double> reference;
+  {
+    MpcConfig own = config;
+    own.shareTapes = false;
+    MPC mpc(own);
+    mpc.fallback = false;
+    reference = SolveFrames(mpc, states, coeffs, nullptr);
+  }
+  config.shareTapes = shared;
+
+  // Each thread builds and solves its controllers, then holds them until
+  // the resident set has been read.
+  long rss_before = ResidentKB();
+  std::atomic<size_t> built(0);
+  std::atomic<bool> release(false);
+  std::vector<double> build_ms(threads, 0);
+  std::vector<size_t> tape_bytes(threads, 0);
+  std::vector<size_t> workspace_bytes(threads, 0);
+  std::vector<size_t> mismatches(threads, 0);
+  std::vector<std::vector<double> > solve_ms(threads);
+  std::vector<std::thread> running;
+  for (size_t k = 0; k < threads; k++) {
+    running.emplace_back([&, k]() {
+      std::vector<std::unique_ptr<MPC> > controllers;
+      for (size_t c = k; c < count; c += threads) {
+        auto start = std::chrono::steady_clock::now();
+        controllers.emplace_back(new MPC(config));
+        build_ms[k] += std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+        MPC& mpc = *controllers.back();
+        mpc.fallback = false;
+        mismatches[k] +=
+            SolveFrames(mpc, states, coeffs, &solve_ms[k]) != reference;
+      }
+      for (const std::unique_ptr<MPC>& mpc : controllers) {
+        tape_bytes[k] += mpc->tapeBytes();
+        workspace_bytes[k] += mpc->workspaceBytes();
+      }
+      built++;
+      while (!release) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+  while (built < threads) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  long rss_growth = ResidentKB() - rss_before;
+  release = true;
+  for (std::thread& thread : running) {
+    thread.join();
+  }
+
+  double build = 0;
+  size_t tapes = 0;
+  size_t workspace = 0;
+  size_t failed = 0;
+  std::vector<double> solves;
+  for (size_t k = 0; k < threads; k++) {
+    build += build_ms[k];
+    tapes += tape_bytes[k];
+    workspace += workspace_bytes[k];
+    failed += mismatches[k];
+    solves.insert(solves.end(), solve_ms[k].begin(), solve_ms[k].end());
+  }
+  std::sort(solves.begin(), solves.end());
+  printf("%-8s %11s %8s %9s %9s %9s %9s %9s %10s\n", "tapes", "controllers",
+         "threads", "rss kB", "build ms", "tape kB", "work kB", "solve ms",
+         "mismatches");
+  printf("%-8s %11zu %8zu %9.1f %9.2f %9.1f %9.1f %9.3f %10zu\n",
+         shared ? "shared" : "private", count, threads,
+         double(rss_growth) / count, build / count, tapes / 1024. / count,
+         workspace / 1024. / count, solves[solves.size() / 2], failed);
+  return failed > 0 ? 1 : 0;
+}
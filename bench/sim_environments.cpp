@@ -0,0 +1,100 @@
+// SimEnvironments stepped at growing car counts: car periods per second of
+// Step alone, and of Step and Observe together. Then cars spread along the
+// track, driven by SimEnvironments::Control on 1, 2, 4, ... batch threads,
+// with the frames answered per second and how far they strayed.
+//
+// Usage: sim_environments [waypoints.csv] [controlled cars]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+#include "SimEnvironments.h"
+#include "Telemetry.h"
+#include "TrackMap.h"
+
+// Periods stepped at each count, and controlled.
+static const size_t STEPS = 200;
+static const size_t CONTROLLED_STEPS = 50;
+
+static double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t controlled = argc > 2 ? atoi(argv[2]) : 64;
+  TrackMap track;
+  if (!track.Load(path) || track.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  MpcConfig config;
+
+  printf("%8s %14s %14s\n", "cars", "steps/s", "observed/s");
+  for (size_t cars = 1; cars <= 16384; cars *= 8) {
+    SimEnvironments envs(track, cars, config.Lf);
+    std::vector<SimEnvironments::Action> actions(cars);
+    std::vector<Telemetry> observations(cars);
+    for (size_t i = 0; i < cars; i++) {
+      envs.Reset(i, track.length() * i / cars, 30);
+      actions[i].steering = 0.01 * (i % 7);
+      actions[i].throttle = 0.3;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < STEPS; k++) {
+      envs.Step(actions.data());
+    }
+    double stepped = cars * STEPS / Since(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < STEPS; k++) {
+      envs.Step(actions.data());
+      envs.Observe(observations.data());
+    }
+    printf("%8zu %14.0f %14.0f\n", cars, stepped, cars * STEPS / Since(start));
+    fflush(stdout);
+  }
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  // The main thread, and the batch threads of every count tried at once,
+  // as the old ones exit while the new ones start.
+  MPC::SetupThreads(1 + 2 * cores);
+  MPC mpc(config);
+  std::vector<SimEnvironments::Action> actions(controlled);
+  std::vector<Telemetry> observations(controlled);
+  printf("\n%8s %12s %10s %10s %6s\n", "threads", "frames/s", "cte mean",
+         "cte max", "off");
+  for (size_t threads = 1; threads <= cores; threads *= 2) {
+    mpc.batchThreads = threads;
+    SimEnvironments envs(track, controlled, config.Lf);
+    for (size_t i = 0; i < controlled; i++) {
+      envs.Reset(i, track.length() * i / controlled, 30);
+    }
+    double cte_sum = 0;
+    double cte_max = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < CONTROLLED_STEPS; k++) {
+      envs.Observe(observations.data());
+      envs.Control(mpc, observations.data(), actions.data());
+      envs.Step(actions.data());
+      for (size_t i = 0; i < controlled; i++) {
+        cte_sum += envs.cte(i);
+        cte_max = std::max(cte_max, envs.cte(i));
+      }
+    }
+    double seconds = Since(start);
+    size_t off = 0;
+    for (size_t i = 0; i < controlled; i++) {
+      off += envs.off(i);
+    }
+    printf("%8zu %12.1f %10.3f %10.3f %6zu\n", threads,
+           controlled * CONTROLLED_STEPS / seconds,
+           cte_sum / (controlled * CONTROLLED_STEPS), cte_max, off);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+// WaypointFit::FitWorld with its fits slid along with their waypoints (see
+// WaypointFit::slide) against fitting every new set afresh, on windows of
+// waypoints 2 m apart moving along a gently winding road, a waypoint every
+// third frame. Prints, for each window size, the frames answered by each
+// path, the time per frame and per frame whose set changed, and the most
+// the two cubics differ over the window.
+//
+// Usage: sliding_fit
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "Polynomial.h"
+#include "WaypointFit.h"
+
+static const size_t WAYPOINTS = 4000;
+static const double SPACING = 2;
+static const size_t FRAMES_PER_WAYPOINT = 3;
+
+static double Road(double x) { return 30 * sin(x / 400) + 0.05 * sin(x / 7); }
+
+int main() {
+  std::vector<double> x;
+  std::vector<double> y;
+  for (size_t i = 0; i < WAYPOINTS; i++) {
+    x.push_back(SPACING * i);
+    y.push_back(Road(x.back()));
+  }
+
+  printf("%6s %7s %7s %7s %9s %11s %10s %11s %10s\n", "window", "slid",
+         "reused", "refit", "slide us", "slide new", "fresh us",
+         "fresh new", "max diff");
+  for (size_t n : {16, 40, 64, 128, 256}) {
+    WaypointFit sliding;
+    WaypointFit fresh;
+    fresh.slide = false;
+    double seconds[2] = {0, 0};
+    double changed[2] = {0, 0};
+    size_t frames = 0;
+    size_t changes = 0;
+    double diff = 0;
+    for (size_t first = 0; first + n < WAYPOINTS; first++) {
+      for (size_t f = 0; f < FRAMES_PER_WAYPOINT; f++, frames++) {
+        double px = x[first] + 1 + 0.5 * f;
+        double py = Road(px);
+        double psi = atan(30. / 400 * cos(px / 400));
+        WaypointFit* fits[2] = {&sliding, &fresh};
+        Eigen::Vector4d coeffs[2];
+        for (int k = 0; k < 2; k++) {
+          auto begin = std::chrono::steady_clock::now();
+          coeffs[k] = fits[k]->FitWorld(px, py, psi, &x[first], &y[first], n);
+          double s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+          seconds[k] += s;
+          if (f == 0) {
+            changed[k] += s;
+          }
+        }
+        changes += f == 0;
+        for (double u = 0; u <= SPACING * n; u += 1) {
+          diff = std::max(diff, std::fabs(polyeval(coeffs[0], u) -
+                                          polyeval(coeffs[1], u)));
+        }
+      }
+    }
+    printf("%6zu %7lu %7lu %7lu %9.3f %11.3f %10.3f %11.3f %10.2g\n", n,
+           sliding.slid(), sliding.reused(), sliding.refitted(),
+           seconds[0] / frames * 1e6, changed[0] / changes * 1e6,
+           seconds[1] / frames * 1e6, changed[1] / changes * 1e6, diff);
+    fflush(stdout);
+  }
+  return 0;
+}
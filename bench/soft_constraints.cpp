@@ -0,0 +1,78 @@
+// Hard state constraints against soft ones (see
+// MpcConfig::softConstraints). Solves the same frames with a corridor on cte
+// and a speed limit, tight enough to be out of reach of some frames, and
+// prints the failed solves, the restorations and the tails of the solve time
+// and of the iterations.
+//
+// Usage: soft_constraints [waypoints.csv] [cte limit] [speed limit]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 1000;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  double cte_limit = argc > 2 ? atof(argv[2]) : 0.5;
+  double speed_limit = argc > 3 ? atof(argv[3]) : 40;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-6s %7s %12s %12s %12s %12s %12s %8s\n", "", "failed",
+         "restorations", "solve p50", "solve p99", "solve p99.9",
+         "iter p99.9", "iter max");
+  for (int soft = 0; soft < 2; soft++) {
+    MpcConfig config = base;
+    config.cteLimit = cte_limit;
+    config.speedLimit = speed_limit;
+    config.softConstraints = soft;
+    MPC mpc(config);
+
+    std::vector<double> solve_ms;
+    std::vector<int> iterations;
+    size_t restorations = 0;
+    size_t failed = 0;
+    std::vector<double> mpc_x;
+    std::vector<double> mpc_y;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      const MPC::SolveStats& stats = mpc.stats();
+      solve_ms.push_back(stats.seconds * 1e3);
+      iterations.push_back(stats.iterations);
+      restorations += stats.restorations;
+      failed += stats.status != MPC::CONVERGED;
+    }
+    std::sort(solve_ms.begin(), solve_ms.end());
+    std::sort(iterations.begin(), iterations.end());
+    size_t p99 = std::min(n - 1, size_t(0.99 * (n - 1) + 0.5));
+    size_t p999 = std::min(n - 1, size_t(0.999 * (n - 1) + 0.5));
+    printf("%-6s %7zu %12zu %12.3f %12.3f %12.3f %12d %8d\n",
+           soft ? "soft" : "hard", failed, restorations, solve_ms[n / 2],
+           solve_ms[p99], solve_ms[p999], iterations[p999], iterations.back());
+    fflush(stdout);
+  }
+  return 0;
+}
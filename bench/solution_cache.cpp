@@ -0,0 +1,83 @@
+// The solution cache of MpcConfig::cacheEntries over several laps of a
+// track, each lap's states a little off the last's as a driven lap would
+// be. Prints, per lap, the share of solves answered from the cache and
+// warm started by it, and the mean iterations and time per frame against
+// the same laps without the cache; whether the cache pays off on a track.
+//
+// Usage: solution_cache [waypoints.csv] [entries]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Laps driven, every STRIDE-th frame of each, and how far the states of a
+// lap stray from the first's.
+static const size_t LAPS = 4;
+static const size_t STRIDE = 4;
+static const double SPREAD = 0.02;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  size_t entries = argc > 2 ? atoi(argv[2]) : 4096;
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs,
+                           size_t(-1), STRIDE);
+
+  printf("%-4s %8s %9s %9s %12s %12s %12s\n", "lap", "answered", "seeded",
+         "iter", "iter cold", "ms", "ms cold");
+  MpcConfig cached = base;
+  cached.cacheEntries = entries;
+  MPC mpc(cached);
+  MPC reference(base);
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  for (size_t lap = 0; lap < LAPS; lap++) {
+    size_t answered = 0;
+    size_t seeded = 0;
+    double iterations[2] = {0, 0};
+    double ms[2] = {0, 0};
+    for (size_t i = 0; i < n; i++) {
+      // The same small offsets for both controllers, different each lap.
+      State state = states[i];
+      double wobble = lap == 0 ? 0 : SPREAD * sin(7.1 * lap + 0.37 * i);
+      state[3] += 10 * wobble;
+      state[4] += wobble;
+      state[5] += 0.2 * wobble;
+      MPC* controllers[] = {&mpc, &reference};
+      for (int c = 0; c < 2; c++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        controllers[c]->Solve(state, coeffs[i], mpc_x, mpc_y);
+        iterations[c] += controllers[c]->stats().iterations;
+        ms[c] += controllers[c]->stats().seconds * 1e3;
+      }
+      answered += mpc.usedCache;
+      seeded += mpc.cacheSeeded;
+    }
+    printf("%-4zu %7.1f%% %8.1f%% %9.2f %12.2f %12.3f %12.3f\n", lap + 1,
+           100. * answered / n, 100. * seeded / n, iterations[0] / n,
+           iterations[1] / n, ms[0] / n, ms[1] / n);
+    fflush(stdout);
+  }
+  printf("%zu entries of %zu\n", mpc.cache()->size(), entries);
+  return 0;
+}
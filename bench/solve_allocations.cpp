@@ -0,0 +1,84 @@
+// Heap allocations per MPC::Solve in steady state, for each method: every
+// operator new is counted over a run of frames after a warm-up, solving into
+// an MPC::Result on the stack as the server does. Built with
+// MPC_COUNT_ALLOCATIONS, see AllocationCounter.h.
+//
+// MPC's own part of a solve allocates nothing per frame: the problem data,
+// bounds, tape parameters and trajectory buffers are sized at construction,
+// and CppAD's vectors come from its thread_alloc pool. What remains is
+// Ipopt's own iterate vectors, and any temporaries of the other methods'
+// solvers.
+//
+// Usage: solve_allocations [waypoints.csv]
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "AllocationCounter.h"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const size_t WARMUP = 50;
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  size_t n = std::min(frames.size(), WARMUP + FRAMES);
+  MpcConfig config;
+  WaypointFit fit;
+  Cubics coeffs(n);
+  States states(n);
+  for (size_t i = 0; i < n; i++) {
+    Telemetry t;
+    ParseTelemetry(frames[i].data(), frames[i].data() + frames[i].size(), t);
+    double vx[MAX_WAYPOINTS];
+    double vy[MAX_WAYPOINTS];
+    ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints, vx, vy);
+    coeffs[i] = fit.Fit(vx, vy, t.n_waypoints);
+    double cte = polyeval(coeffs[i], 0);
+    double epsi = -atan(coeffs[i][1]);
+    states[i] =
+        PredictState(t.v, t.delta, t.a, cte, epsi, config.Lf, LATENCY);
+  }
+  if (n <= WARMUP) {
+    fprintf(stderr, "too few frames\n");
+    return 1;
+  }
+
+  const MPC::Method methods[] = {MPC::IPOPT, MPC::REAL_TIME_ITERATION,
+                                 MPC::LINEAR_TIME_VARYING, MPC::LQR};
+  const char* const names[] = {"ipopt", "rti", "ltv", "lqr"};
+  printf("%-6s %16s\n", "method", "allocs/solve");
+  for (int m = 0; m < 4; m++) {
+    MPC mpc(config);
+    mpc.method = methods[m];
+    double mpc_x[64];
+    double mpc_y[64];
+    MPC::Result result = {0, 0, mpc_x, mpc_y, 64, 0};
+    uint64_t before = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (i == WARMUP) {
+        before = ThreadAllocations();
+      }
+      mpc.Solve(states[i], coeffs[i], result);
+    }
+    printf("%-6s %16.2f\n", names[m],
+           double(ThreadAllocations() - before) / (n - WARMUP));
+  }
+  return 0;
+}
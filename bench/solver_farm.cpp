@@ -0,0 +1,134 @@
+// A SolverFarm on the loopback interface, serving 1 to 64 vehicles at once,
+// each a FarmClient on a thread of its own sending the frames of a lap,
+// prepared as batch_solves prepares them, every PERIOD with DEADLINE to
+// answer. Prints, for each fleet size, the frames answered by the farm and
+// by the vehicles' fallbacks, the problems the farm dropped as expired, the
+// mean batch, and the mean time a vehicle waited for the farm's answers.
+//
+// Usage: solver_farm [waypoints.csv] [port]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FarmClient.h"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "SolverFarm.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "UdpChannel.h"
+#include "VehicleFrame.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+static const double PERIOD = 0.05;
+static const double DEADLINE = 0.03;
+static const size_t FRAMES = 100;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  int port = argc > 2 ? atoi(argv[2]) : 4568;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  MpcConfig config;
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  MPC::SetupThreads(1 + 2 * cores);
+
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  WaypointFit fit;
+  std::vector<MPC::BatchProblem> problems;
+  for (const std::string& frame : frames) {
+    Telemetry t;
+    ParseTelemetry(frame.data(), frame.data() + frame.size(), t);
+    double vx[MAX_WAYPOINTS];
+    double vy[MAX_WAYPOINTS];
+    ToVehicleFrame(t.px, t.py, t.psi, t.ptsx, t.ptsy, t.n_waypoints, vx, vy);
+    MPC::BatchProblem problem;
+    problem.coeffs = fit.Fit(vx, vy, t.n_waypoints);
+    double cte = polyeval(problem.coeffs, 0);
+    double epsi = -atan(problem.coeffs[1]);
+    problem.state =
+        PredictState(t.v, t.delta, t.a, cte, epsi, config.Lf, LATENCY);
+    problems.push_back(problem);
+  }
+
+  SolverFarm farm(config, 0);
+  auto period =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(PERIOD));
+  auto deadline =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(DEADLINE));
+  printf("%8s %8s %8s %10s %8s %8s %10s\n", "vehicles", "frames", "farm",
+         "fallback", "expired", "batch", "wait ms");
+  for (size_t vehicles : {1, 4, 16, 64}) {
+    // A channel for each fleet, since one keeps every vehicle it heard.
+    UdpChannel channel;
+    if (!channel.Bind(port)) {
+      fprintf(stderr, "can't bind UDP port %d\n", port);
+      return 1;
+    }
+    std::atomic<bool> stop(false);
+    std::thread server([&] {
+      while (!stop) {
+        farm.Serve(channel, std::chrono::milliseconds(10));
+      }
+    });
+    uint64_t answered = farm.answered();
+    uint64_t expired = farm.expired();
+    uint64_t batches = farm.batches();
+    std::atomic<uint64_t> remote(0);
+    std::atomic<uint64_t> fallbacks(0);
+    std::atomic<uint64_t> waited_us(0);
+    std::vector<std::thread> fleet;
+    for (size_t v = 0; v < vehicles; v++) {
+      fleet.emplace_back([&, v] {
+        FarmClient client(config);
+        if (!client.Connect("127.0.0.1", port)) {
+          return;
+        }
+        auto next = std::chrono::steady_clock::now();
+        for (size_t f = 0; f < FRAMES; f++) {
+          std::this_thread::sleep_until(next);
+          next += period;
+          const MPC::BatchProblem& problem =
+              problems[(v * 37 + f) % problems.size()];
+          auto begin = std::chrono::steady_clock::now();
+          client.Solve(problem.state, problem.coeffs, begin + deadline);
+          if (client.lastRemote()) {
+            waited_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+          }
+        }
+        remote += client.remote();
+        fallbacks += client.fallbacks();
+      });
+    }
+    for (std::thread& vehicle : fleet) {
+      vehicle.join();
+    }
+    stop = true;
+    server.join();
+    uint64_t solved = farm.answered() - answered;
+    uint64_t batched = farm.batches() - batches;
+    printf("%8zu %8zu %8lu %10lu %8lu %8.1f %10.3f\n", vehicles,
+           vehicles * FRAMES, remote.load(), fallbacks.load(),
+           farm.expired() - expired,
+           batched > 0 ? double(solved) / batched : 0.0,
+           remote > 0 ? waited_us / 1e3 / remote : 0.0);
+    fflush(stdout);
+  }
+  return 0;
+}
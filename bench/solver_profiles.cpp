@@ -0,0 +1,153 @@
+// The named solver profiles (see ApplySolverProfile) on recorded frames:
+// each replays the frames through controllers of its own, one per recorded
+// connection as in the server, and prints the latency distribution of its
+// solves, its iterations, the solves without a usable answer (an iterate
+// Ipopt accepted early counts as converged, see MPC_NLP::Usable), and the
+// tracking cost of its answers, the mean cost of the solved problems and
+// its excess over offline-accurate's on the same frames. A profile whose
+// first solve fails without an iteration, as when Ipopt wasn't built with
+// its linear solver, is skipped.
+//
+// Usage: solver_profiles frames.rec [profile...]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "BinaryProtocol.h"
+#include "Controller.h"
+#include "FrameLog.h"
+#include "Measure.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+
+static const double LATENCY = 0.1;
+
+struct Connection {
+  explicit Connection(const MpcConfig& config) : controller(config) {}
+  Controller controller;
+  Arena arena;
+};
+
+// Replay `frames` with `profile`, the cost of each frame solved into costs,
+// NaN for frames not solved. False if the profile can't solve.
+static bool Replay(const MappedFrames& frames, const std::string& profile,
+                   std::vector<double>& costs,
+                   const std::vector<double>& reference) {
+  MpcConfig config;
+  ApplySolverProfile(config, profile);
+  std::map<unsigned, std::unique_ptr<Connection> > connections;
+  std::vector<double> solve_ms;
+  Controller::Output out;
+  Telemetry t;
+  size_t failed = 0;
+  double iterations = 0;
+  double cost = 0;
+  double excess = 0;
+  size_t compared = 0;
+  costs.assign(frames.size(), NAN);
+  for (size_t i = 0; i < frames.size(); i++) {
+    MappedFrames::Frame frame = frames[i];
+    std::unique_ptr<Connection>& c = connections[frame.connection];
+    if (!c) {
+      c.reset(new Connection(config));
+      c->controller.mpc().fallback = false;
+    }
+    bool parsed = false;
+    const char* begin;
+    const char* end;
+    if (frame.binary) {
+      parsed = ParseBinaryTelemetry(frame.data, frame.data + frame.length, t);
+    } else if (hasData(frame.data, frame.length, begin, end) &&
+               begin != end) {
+      try {
+        parsed = ParseTelemetry(begin, end, t) ||
+                 ParseTelemetryJson(begin, end, t, c->arena);
+      } catch (const std::exception&) {
+        parsed = false;
+      }
+    }
+    if (!parsed) {
+      continue;
+    }
+    t.latency = LATENCY;
+    t.prepared = false;
+    c->controller.Step(t, std::chrono::steady_clock::time_point::max(), out);
+    const MPC::SolveStats& stats = c->controller.mpc().stats();
+    if (solve_ms.empty() && stats.status == MPC::FAILED &&
+        stats.iterations == 0) {
+      return false;
+    }
+    solve_ms.push_back(stats.seconds * 1e3);
+    iterations += stats.iterations;
+    if (stats.status != MPC::CONVERGED) {
+      failed++;
+      continue;
+    }
+    costs[i] = stats.cost;
+    cost += stats.cost;
+    if (!reference.empty() && reference[i] == reference[i]) {
+      excess += (stats.cost - reference[i]) /
+                std::max(std::fabs(reference[i]), 1e-9);
+      compared++;
+    }
+  }
+  if (solve_ms.empty()) {
+    return false;
+  }
+  size_t n = solve_ms.size();
+  std::sort(solve_ms.begin(), solve_ms.end());
+  printf("%-17s %7zu %9.3f %9.3f %9.3f %9.3f %7.1f %7zu %12.4g %9.3f%%\n",
+         profile.c_str(), n, Percentile(solve_ms, 0.5),
+         Percentile(solve_ms, 0.9), Percentile(solve_ms, 0.99),
+         solve_ms.back(), iterations / n, failed,
+         cost / std::max<size_t>(n - failed, 1),
+         compared ? 100 * excess / compared : 0.);
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s frames.rec [profile...]\n", argv[0]);
+    return 1;
+  }
+  MappedFrames frames;
+  if (!frames.Open(argv[1]) || frames.size() == 0) {
+    fprintf(stderr, "no frames in %s\n", argv[1]);
+    return 1;
+  }
+  // offline-accurate first, as the reference of the others' costs.
+  std::vector<std::string> profiles = {"offline-accurate", "balanced",
+                                       "realtime"};
+  if (argc > 2) {
+    profiles.assign(argv + 2, argv + argc);
+  }
+  for (const std::string& profile : profiles) {
+    MpcConfig config;
+    if (!ApplySolverProfile(config, profile)) {
+      fprintf(stderr, "no solver profile %s\n", profile.c_str());
+      return 1;
+    }
+  }
+
+  printf("%-17s %7s %9s %9s %9s %9s %7s %7s %12s %10s\n", "profile",
+         "frames", "p50 ms", "p90 ms", "p99 ms", "max ms", "iters", "failed",
+         "mean cost", "excess");
+  std::vector<double> reference;
+  for (const std::string& profile : profiles) {
+    std::vector<double> costs;
+    if (!Replay(frames, profile, costs, reference)) {
+      printf("%-17s can't solve with this Ipopt\n", profile.c_str());
+      continue;
+    }
+    if (profile == "offline-accurate") {
+      reference.swap(costs);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+// A single Ipopt solver against races of it with rivals, over the frames of
+// a lap: the wall time per frame at the median and the 99th percentile,
+// the mean cost, the frames none converged, and who won how often. The
+// rivals are a cold started solver, one with a limited memory Hessian, and
+// one with the Gauss-Newton Hessian; then the multi-start of MPC::AddStart,
+// from zeros and from the curvature and LQR rollouts, at the lowest cost.
+// With MUMPS the solves take turns, so pass a thread-safe linear solver to
+// see them race, see MPC::serializeIpopt.
+//
+// Usage: solver_race [waypoints.csv] [mumps|ma27|ma57|ma86|ma97|pardiso]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "Polynomial.h"
+
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  // The controller and its three rivals, each on a thread of its own.
+  MPC::SetupThreads(4);
+  MpcConfig base;
+  if (argc > 2) {
+    const char* names[] = {"mumps", "ma27", "ma57", "ma86", "ma97",
+                           "pardiso"};
+    int i = 0;
+    while (i < MpcConfig::LINEAR_SOLVERS && strcmp(argv[2], names[i]) != 0) {
+      i++;
+    }
+    if (i == MpcConfig::LINEAR_SOLVERS) {
+      fprintf(stderr, "unknown linear solver %s\n", argv[2]);
+      return 1;
+    }
+    base.linearSolver = MpcConfig::LinearSolver(i);
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs);
+
+  MpcConfig limited_memory = base;
+  limited_memory.hessian = MpcConfig::LIMITED_MEMORY;
+  MpcConfig gauss_newton = base;
+  gauss_newton.hessian = MpcConfig::GAUSS_NEWTON;
+
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  printf("%7s %10s %10s %12s %8s  %s\n", "rivals", "p50 ms", "p99 ms",
+         "cost", "failed", "wins");
+  for (size_t rivals = 0; rivals <= 4; rivals++) {
+    MPC mpc(base);
+    mpc.fallback = false;
+    const char* name = "";
+    if (rivals == 4) {
+      mpc.AddStart(MPC::ZERO_START);
+      mpc.AddStart(MPC::CURVATURE_START);
+      mpc.AddStart(MPC::FALLBACK_START);
+      mpc.lowestCost = true;
+      name = "starts";
+    } else {
+      if (rivals > 0) {
+        mpc.AddRival(base, false);
+      }
+      if (rivals > 1) {
+        mpc.AddRival(limited_memory, true);
+      }
+      if (rivals > 2) {
+        mpc.AddRival(gauss_newton, true);
+      }
+    }
+    std::vector<double> ms(n);
+    std::vector<size_t> wins(1 + mpc.rivals());
+    double cost = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      auto start = std::chrono::steady_clock::now();
+      mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      ms[i] = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+      if (mpc.stats().status != MPC::CONVERGED) {
+        failed++;
+      } else {
+        cost += mpc.stats().cost;
+      }
+      wins[std::max(mpc.raceWinner, 0)]++;
+    }
+    if (*name) {
+      printf("%7s", name);
+    } else {
+      printf("%7zu", rivals);
+    }
+    printf(" %10.3f %10.3f %12.4f %8zu ", Percentile(ms, 0.5),
+           Percentile(ms, 0.99), cost / std::max<size_t>(n - failed, 1),
+           failed);
+    for (size_t w : wins) {
+      printf(" %zu", w);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+// The analytic derivatives with their stages split across threads (see
+// MpcConfig::stageThreads) against the serial evaluation. At the long
+// horizons KinematicNLP is instantiated for, solves the same frames with 1,
+// 2 and 4 threads, prints the solve and evaluation times, and checks that
+// every actuation and predicted point matches the serial solve's bit for
+// bit.
+//
+// Usage: stage_threads [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-4s %-8s %12s %12s %12s %10s\n", "N", "threads", "solve p50",
+         "solve p99", "eval ms", "identical");
+  const size_t horizons[] = {30, 50};
+  const size_t threads[] = {1, 2, 4};
+  bool all_identical = true;
+  for (size_t N : horizons) {
+    std::vector<std::vector<double> > serial(n);
+    for (size_t k : threads) {
+      MpcConfig config = base;
+      config.N = N;
+      config.horizons.assign(1, Horizon{N, config.dt});
+      config.stageThreads = k;
+      config.parallelStagesFrom = 0;
+      MPC mpc(config, true);
+
+      std::vector<double> solve_ms;
+      double eval_ms = 0;
+      bool identical = true;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        const MPC::SolveStats& stats = mpc.stats();
+        solve_ms.push_back(stats.seconds * 1e3);
+        eval_ms += stats.evalSeconds * 1e3;
+        u.insert(u.end(), mpc_x.begin(), mpc_x.end());
+        u.insert(u.end(), mpc_y.begin(), mpc_y.end());
+        if (k == 1) {
+          serial[i] = u;
+        } else {
+          identical = identical && u.size() == serial[i].size() &&
+                      memcmp(u.data(), serial[i].data(),
+                             u.size() * sizeof(double)) == 0;
+        }
+      }
+      all_identical = all_identical && identical;
+      std::sort(solve_ms.begin(), solve_ms.end());
+      printf("%-4zu %-8zu %12.3f %12.3f %12.3f %10s\n", N, k,
+             solve_ms[n / 2],
+             solve_ms[std::min(n - 1, size_t(0.99 * (n - 1) + 0.5))],
+             eval_ms / n, identical ? "yes" : "NO");
+      fflush(stdout);
+    }
+  }
+  return all_identical ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+// The static-memory profile in steady state: for each tuning that
+// MPC::StaticMemory allows, a Controller answers a run of frames after a
+// warm-up with the heap sealed, see HeapGuard.h, and the time per frame is
+// printed. Any heap call in Controller::Step aborts the run, naming it.
+// Built with MPC_STATIC_MEMORY.
+//
+// Usage: static_memory [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Controller.h"
+#include "HeapGuard.h"
+#include "LakeFrames.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+
+static const size_t WARMUP = 50;
+static const size_t FRAMES = 500;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  if (!GuardingHeap()) {
+    fprintf(stderr, "built without MPC_STATIC_MEMORY\n");
+    return 1;
+  }
+  std::vector<std::string> texts = MakeFrames(wx, wy);
+  size_t n = std::min(texts.size(), WARMUP + FRAMES);
+  if (n <= WARMUP) {
+    fprintf(stderr, "too few frames\n");
+    return 1;
+  }
+  std::vector<Telemetry> frames(n);
+  for (size_t i = 0; i < n; i++) {
+    ParseTelemetry(texts[i].data(), texts[i].data() + texts[i].size(),
+                   frames[i]);
+    frames[i].latency = LATENCY;
+  }
+
+  struct Tuning {
+    const char* name;
+    MPC::Method method;
+    LTVMPC::Formulation formulation;
+  };
+  const Tuning tunings[] = {
+      {"ltv condensed", MPC::LINEAR_TIME_VARYING, LTVMPC::CONDENSED},
+      {"ltv riccati", MPC::LINEAR_TIME_VARYING, LTVMPC::RICCATI},
+      {"ltv active-set", MPC::LINEAR_TIME_VARYING, LTVMPC::ACTIVE_SET},
+      {"lqr", MPC::LQR, LTVMPC::SPARSE}};
+  printf("%-15s %8s %10s %10s\n", "tuning", "frames", "p50 us", "p99 us");
+  for (const Tuning& tuning : tunings) {
+    Controller controller;
+    controller.mpc().method = tuning.method;
+    controller.mpc().ltvFormulation = tuning.formulation;
+    if (!controller.mpc().StaticMemory()) {
+      fprintf(stderr, "%s isn't static\n", tuning.name);
+      return 1;
+    }
+    Controller::Output out;
+    std::vector<double> us;
+    us.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      if (i == WARMUP) {
+        SealHeap();
+      }
+      auto begin = std::chrono::steady_clock::now();
+      controller.Step(frames[i], std::chrono::steady_clock::time_point::max(),
+                      out);
+      if (i >= WARMUP) {
+        us.push_back(std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - begin).count());
+      }
+    }
+    UnsealHeap();
+    std::sort(us.begin(), us.end());
+    printf("%-15s %8zu %10.1f %10.1f\n", tuning.name, us.size(),
+           us[us.size() / 2], us[std::min(us.size() - 1,
+                                          size_t(0.99 * us.size()))]);
+  }
+  return 0;
+}
@@ -0,0 +1,232 @@
+// Frames synthesized across the extremes of what the car may meet: the
+// path's curvature, the speed, the car's cross track and orientation errors
+// and the spacing of the waypoints, each over a few levels, with every
+// combination a region of a few frames jittered about its levels. Each
+// frame is fitted and predicted as the server does, then solved cold with
+// MPC::Solve. Prints the solve time and Ipopt iterations overall, by level
+// of each dimension, the regions of the slowest tails, and the regions the
+// solves past the overall 99.9th percentile came from.
+//
+// Usage: stress_scenarios [frames per region] [seed]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Controller.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "Telemetry.h"
+#include "WaypointFit.h"
+
+static const double LATENCY = 0.1;
+// Levels of each dimension: curvature in 1/m, speed in mph, cross track
+// error in m, orientation error in radians and waypoint spacing in m. The
+// frames of a region are within JITTER of its levels, of either sign where
+// it matters.
+static const double CURVATURES[] = {0, 0.01, 0.03, 0.06};
+static const double SPEEDS[] = {10, 40, 70, 100};
+static const double CTES[] = {0, 1.5, 4};
+static const double EPSIS[] = {0, 0.2, 0.5};
+static const double SPACINGS[] = {3, 8, 20};
+static const double JITTER = 0.15;
+static const size_t TOP_REGIONS = 10;
+
+enum Dimension { CURVATURE, SPEED, CTE, EPSI, SPACING, DIMENSIONS };
+static const char* const DIMENSION_NAMES[DIMENSIONS] = {
+    "curvature", "speed", "cte", "epsi", "spacing"};
+static const double* const LEVELS[DIMENSIONS] = {CURVATURES, SPEEDS, CTES,
+                                                 EPSIS, SPACINGS};
+static const size_t COUNTS[DIMENSIONS] = {4, 4, 3, 3, 3};
+
+struct Sample {
+  size_t region;
+  double ms;
+  int iterations;
+  bool converged;
+};
+
+// The level of each dimension of `region`.
+static void Levels(size_t region, size_t level[DIMENSIONS]) {
+  for (int d = 0; d < DIMENSIONS; d++) {
+    level[d] = region % COUNTS[d];
+    region /= COUNTS[d];
+  }
+}
+
+static void PrintRegion(size_t region) {
+  size_t level[DIMENSIONS];
+  Levels(region, level);
+  printf("k %-5g v %-4g cte %-4g epsi %-4g spacing %-3g",
+         CURVATURES[level[CURVATURE]], SPEEDS[level[SPEED]], CTES[level[CTE]],
+         EPSIS[level[EPSI]], SPACINGS[level[SPACING]]);
+}
+
+// The frame of a car `cte` to the right of an arc of curvature `k`,
+// turning left for positive k, and `epsi` to the left of its heading, with
+// waypoints `spacing` apart from one behind the car, placed and turned
+// anywhere in the world as the simulator's are.
+static Telemetry MakeFrame(double k, double v, double cte, double epsi,
+                           double spacing, std::mt19937& random) {
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  double angle = M_PI * uniform(random);
+  double ox = 200 * uniform(random);
+  double oy = 200 * uniform(random);
+  auto place = [&](double x, double y, double& wx, double& wy) {
+    wx = ox + x * cos(angle) - y * sin(angle);
+    wy = oy + x * sin(angle) + y * cos(angle);
+  };
+  Telemetry t;
+  t.n_waypoints = 6;
+  for (size_t i = 0; i < t.n_waypoints; i++) {
+    double s = (double(i) - 1) * spacing;
+    double x = fabs(k) < 1e-9 ? s : sin(k * s) / k;
+    double y = fabs(k) < 1e-9 ? 0 : (1 - cos(k * s)) / k;
+    place(x, y, t.ptsx[i], t.ptsy[i]);
+  }
+  place(0, -cte, t.px, t.py);
+  t.psi = angle + epsi;
+  t.v = v;
+  t.delta = 0.1 * uniform(random);
+  t.a = uniform(random);
+  t.latency = LATENCY;
+  t.binary = false;
+  t.prepared = false;
+  return t;
+}
+
+// The time and iteration distribution of `samples`, on one line.
+static void PrintStats(const std::vector<const Sample*>& samples) {
+  std::vector<double> ms;
+  std::vector<double> iterations;
+  size_t failed = 0;
+  for (const Sample* s : samples) {
+    ms.push_back(s->ms);
+    iterations.push_back(s->iterations);
+    failed += !s->converged;
+  }
+  std::sort(ms.begin(), ms.end());
+  std::sort(iterations.begin(), iterations.end());
+  printf("%6zu %8.2f %8.2f %8.2f %8.2f %6.0f %6.0f %6.0f %6zu\n", ms.size(),
+         Percentile(ms, 0.5), Percentile(ms, 0.99), Percentile(ms, 0.999),
+         ms.back(), Percentile(iterations, 0.5), Percentile(iterations, 0.99),
+         iterations.back(), failed);
+}
+
+static void PrintStatsHeader(const char* first) {
+  printf("%-45s %6s %8s %8s %8s %8s %6s %6s %6s %6s\n", first, "frames",
+         "ms p50", "p99", "p99.9", "max", "it p50", "p99", "max", "failed");
+}
+
+int main(int argc, char* argv[]) {
+  size_t per_region = argc > 1 ? atoi(argv[1]) : 5;
+  std::mt19937 random(argc > 2 ? atoi(argv[2]) : 1);
+  std::uniform_real_distribution<double> jitter(1 - JITTER, 1 + JITTER);
+  std::bernoulli_distribution sign(0.5);
+
+  MpcConfig config;
+  MPC mpc(config);
+  mpc.warmStart = false;
+  mpc.fallback = false;
+  WaypointFit fit;
+  double x[Controller::MAX_TRAJECTORY];
+  double y[Controller::MAX_TRAJECTORY];
+
+  size_t regions = 1;
+  for (int d = 0; d < DIMENSIONS; d++) {
+    regions *= COUNTS[d];
+  }
+  std::vector<Sample> samples;
+  for (size_t region = 0; region < regions; region++) {
+    size_t level[DIMENSIONS];
+    Levels(region, level);
+    for (size_t i = 0; i < per_region; i++) {
+      double side[3];
+      for (double& s : side) {
+        s = sign(random) ? 1 : -1;
+      }
+      Telemetry t = MakeFrame(
+          side[0] * CURVATURES[level[CURVATURE]] * jitter(random),
+          SPEEDS[level[SPEED]] * jitter(random),
+          side[1] * CTES[level[CTE]] * jitter(random),
+          side[2] * EPSIS[level[EPSI]] * jitter(random),
+          SPACINGS[level[SPACING]] * jitter(random), random);
+      Cubic coeffs = FitReference(fit, t, ReferenceSource());
+      State state = PredictFrameState(t, coeffs, config.Lf);
+      MPC::Result result = {0, 0, x, y, Controller::MAX_TRAJECTORY, 0};
+      mpc.Solve(state, coeffs, result);
+      const MPC::SolveStats& stats = mpc.stats();
+      Sample sample = {region, stats.seconds * 1e3, stats.iterations,
+                       stats.status == MPC::CONVERGED};
+      samples.push_back(sample);
+    }
+    fprintf(stderr, "\r%zu of %zu regions", region + 1, regions);
+  }
+  fprintf(stderr, "\n");
+
+  std::vector<const Sample*> all;
+  for (const Sample& s : samples) {
+    all.push_back(&s);
+  }
+  PrintStatsHeader("");
+  printf("%-45s ", "all");
+  PrintStats(all);
+
+  for (int d = 0; d < DIMENSIONS; d++) {
+    printf("\n");
+    PrintStatsHeader(DIMENSION_NAMES[d]);
+    for (size_t l = 0; l < COUNTS[d]; l++) {
+      std::vector<const Sample*> at;
+      for (const Sample& s : samples) {
+        size_t level[DIMENSIONS];
+        Levels(s.region, level);
+        if (level[d] == l) {
+          at.push_back(&s);
+        }
+      }
+      printf("%-45g ", LEVELS[d][l]);
+      PrintStats(at);
+    }
+  }
+
+  // The regions by their slowest solve.
+  std::vector<std::pair<double, size_t> > slowest(regions);
+  for (size_t r = 0; r < regions; r++) {
+    slowest[r] = std::make_pair(0., r);
+  }
+  for (const Sample& s : samples) {
+    slowest[s.region].first = std::max(slowest[s.region].first, s.ms);
+  }
+  std::sort(slowest.rbegin(), slowest.rend());
+  printf("\nslowest regions\n");
+  PrintStatsHeader("");
+  for (size_t i = 0; i < std::min(TOP_REGIONS, regions); i++) {
+    std::vector<const Sample*> in;
+    for (const Sample& s : samples) {
+      if (s.region == slowest[i].second) {
+        in.push_back(&s);
+      }
+    }
+    PrintRegion(slowest[i].second);
+    printf(" ");
+    PrintStats(in);
+  }
+
+  // Where the solves past the 99.9th percentile came from.
+  std::vector<double> ms;
+  for (const Sample& s : samples) {
+    ms.push_back(s.ms);
+  }
+  std::sort(ms.begin(), ms.end());
+  double tail = Percentile(ms, 0.999);
+  printf("\nsolves over the p99.9 of %.2f ms\n", tail);
+  for (const Sample& s : samples) {
+    if (s.ms > tail) {
+      PrintRegion(s.region);
+      printf(" %8.2f ms %4d iterations%s\n", s.ms, s.iterations,
+             s.converged ? "" : ", not converged");
+    }
+  }
+  return 0;
+}
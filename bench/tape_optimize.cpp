@@ -0,0 +1,81 @@
+// Tapes optimized once after recording against the tapes as recorded (see
+// MpcConfig::optimizeTape), with the stage dynamics as their operations and
+// as BicycleAtomic calls. At a few horizons, times setting up a controller
+// as the server's, then solves the same frames with it and prints the time
+// spent evaluating the problem per solve and per Ipopt iteration, which is
+// the forward and reverse sweeps on the tapes.
+//
+// Usage: tape_optimize [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-4s %-10s %-9s %10s %7s %12s %12s %12s\n", "N", "dynamics",
+         "tape", "setup ms", "failed", "solve p50", "eval ms", "eval us/it");
+  const size_t horizons[] = {10, 20, 40};
+  for (size_t N : horizons) {
+    for (int atomic = 0; atomic < 2; atomic++) {
+      for (int optimize = 0; optimize < 2; optimize++) {
+        MpcConfig config = base;
+        config.N = N;
+        config.horizons.assign(1, Horizon{N, config.dt});
+        config.atomicDynamics = atomic;
+        config.optimizeTape = optimize;
+        auto start = std::chrono::steady_clock::now();
+        MPC mpc(config);
+        double setup_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> solve_ms;
+        double eval_ms = 0;
+        double iterations = 0;
+        size_t failed = 0;
+        std::vector<double> mpc_x;
+        std::vector<double> mpc_y;
+        for (size_t i = 0; i < n; i++) {
+          mpc_x.clear();
+          mpc_y.clear();
+          mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+          const MPC::SolveStats& stats = mpc.stats();
+          solve_ms.push_back(stats.seconds * 1e3);
+          eval_ms += stats.evalSeconds * 1e3;
+          iterations += stats.iterations;
+          failed += stats.status != MPC::CONVERGED;
+        }
+        std::sort(solve_ms.begin(), solve_ms.end());
+        printf("%-4zu %-10s %-9s %10.1f %7zu %12.3f %12.3f %12.2f\n", N,
+               atomic ? "atomic" : "taped", optimize ? "optimized" : "recorded",
+               setup_ms, failed, solve_ms[n / 2], eval_ms / n,
+               iterations > 0 ? eval_ms * 1e3 / iterations : 0.);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
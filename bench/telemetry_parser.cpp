@@ -0,0 +1,110 @@
+// Times ParseTelemetry against json::parse on telemetry frames, and checks
+// that both read the same values. The same frames in the binary framing are
+// timed too.
+//
+// No recording ships with the repo, so the frames are synthesized in the
+// simulator's format (see DATA.md) from the lake track waypoints: a car
+// driving along the track, with the next 6 waypoints of each frame.
+//
+// Usage: telemetry_parser [waypoints.csv] [passes]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "BinaryProtocol.h"
+#include "LakeFrames.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+
+static bool Same(const Telemetry& a, const Telemetry& b) {
+  if (a.n_waypoints != b.n_waypoints) {
+    return false;
+  }
+  for (size_t i = 0; i < a.n_waypoints; i++) {
+    if (a.ptsx[i] != b.ptsx[i] || a.ptsy[i] != b.ptsy[i]) {
+      return false;
+    }
+  }
+  return a.px == b.px && a.py == b.py && a.psi == b.psi && a.v == b.v &&
+         a.delta == b.delta && a.a == b.a;
+}
+
+// Mean time per frame in nanoseconds over `passes` passes.
+template <class Parse>
+static double TimeParser(const std::vector<std::string>& frames, int passes,
+                         Parse parse) {
+  Telemetry t;
+  double sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int p = 0; p < passes; p++) {
+    for (const std::string& frame : frames) {
+      parse(frame.data(), frame.data() + frame.size(), t);
+      sink += t.px;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  if (sink == 42) {
+    printf("\n");
+  }
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         (double(passes) * frames.size());
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  int passes = argc > 2 ? atoi(argv[2]) : 100;
+
+  std::vector<double> x;
+  std::vector<double> y;
+  if (!ReadWaypoints(path, x, y) || x.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+  std::vector<std::string> frames = MakeFrames(x, y);
+
+  Arena arena;
+  size_t mismatches = 0;
+  for (const std::string& frame : frames) {
+    const char* begin = frame.data();
+    const char* end = begin + frame.size();
+    Telemetry fast;
+    Telemetry generic;
+    if (!ParseTelemetry(begin, end, fast) ||
+        !ParseTelemetryJson(begin, end, generic, arena) ||
+        !Same(fast, generic)) {
+      mismatches++;
+    }
+  }
+
+  double dedicated = TimeParser(frames, passes, ParseTelemetry);
+  double generic = TimeParser(
+      frames, passes, [&arena](const char* begin, const char* end,
+                               Telemetry& t) {
+        return ParseTelemetryJson(begin, end, t, arena);
+      });
+  std::vector<std::string> binary_frames(frames.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    Telemetry t;
+    ParseTelemetry(frames[i].data(), frames[i].data() + frames[i].size(), t);
+    WriteBinaryTelemetry(binary_frames[i], t);
+    Telemetry back;
+    if (!ParseBinaryTelemetry(binary_frames[i].data(),
+                              binary_frames[i].data() + binary_frames[i].size(),
+                              back) ||
+        !Same(t, back)) {
+      mismatches++;
+    }
+  }
+  double binary = TimeParser(binary_frames, passes, ParseBinaryTelemetry);
+
+  printf("%zu frames of about %zu bytes (%zu binary), %zu mismatches\n",
+         frames.size(), frames[0].size(), binary_frames[0].size(),
+         mismatches);
+  printf("%-16s %10.1f ns/frame\n", "ParseTelemetry", dedicated);
+  printf("%-16s %10.1f ns/frame\n", "json::parse", generic);
+  printf("%-16s %10.1f ns/frame\n", "binary", binary);
+  printf("speedup %.1fx\n", generic / dedicated);
+  return mismatches ? 1 : 0;
+}
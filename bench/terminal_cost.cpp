@@ -0,0 +1,96 @@
+// Short horizons with the terminal ingredients (see MpcConfig::terminalCost
+// and terminalRegion) against longer ones without. Solves the same frames
+// with each and prints the solve time, the iterations and the tracking
+// error: the mean |cte| and |epsi| after applying each frame's first
+// actuations for one control period of the model.
+//
+// Usage: terminal_cost [waypoints.csv] [terminal region]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+static const double CONTROL_PERIOD = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  double region = argc > 2 ? atof(argv[2]) : 5;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  struct Case {
+    const char* name;
+    size_t N;
+    bool cost;
+    double region;
+  };
+  const Case cases[] = {
+      {"none", 5, false, 0},
+      {"cost", 5, true, 0},
+      {"region", 5, true, region},
+      {"none", 10, false, 0},
+      {"none", 20, false, 0},
+  };
+  printf("%-8s %4s %7s %12s %12s %10s %10s\n", "terminal", "N", "failed",
+         "solve p50", "iterations", "|cte|", "|epsi|");
+  for (const Case& c : cases) {
+    MpcConfig config = base;
+    config.N = c.N;
+    config.horizons.assign(1, Horizon{c.N, config.dt});
+    config.terminalCost = c.cost;
+    config.terminalRegion = c.region;
+    MPC mpc(config);
+
+    std::vector<double> solve_ms;
+    double iterations = 0;
+    double cte = 0;
+    double epsi = 0;
+    size_t failed = 0;
+    std::vector<double> mpc_x;
+    std::vector<double> mpc_y;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      const MPC::SolveStats& stats = mpc.stats();
+      solve_ms.push_back(stats.seconds * 1e3);
+      iterations += stats.iterations;
+      failed += stats.status != MPC::CONVERGED;
+
+      State s = states[i];
+      const int substeps = 10;
+      for (int k = 0; k < substeps; k++) {
+        s = BicycleStep(s, Input(u[0], u[1]), coeffs[i],
+                        CONTROL_PERIOD / substeps, base.Lf);
+      }
+      cte += std::fabs(s[4]);
+      epsi += std::fabs(s[5]);
+    }
+    std::sort(solve_ms.begin(), solve_ms.end());
+    printf("%-8s %4zu %7zu %12.3f %12.1f %10.4f %10.4f\n", c.name, c.N,
+           failed, solve_ms[n / 2], iterations / n, cte / n, epsi / n);
+    fflush(stdout);
+  }
+  return 0;
+}
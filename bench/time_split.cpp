@@ -0,0 +1,85 @@
+// The parallel-in-time LTV-MPC (see TimeSplitMPC) on long horizons, N of
+// 100 to 400 stages at dt = 0.05, cut into 1 to 16 segments, each count on
+// as many threads as it has segments, up to the cores. A single segment is
+// the serial condensed LTV QP. Each horizon first drives a car onto a
+// gently curving path from off it with the single segment; every count of
+// segments then solves the frames at the states that run visited, and
+// prints the time per frame, the ADMM iterations, the frames that
+// converged, the worst defect between segments, and how far its first
+// actuations were from the single segment's on average.
+//
+// Usage: time_split [frames]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "MpcConfig.h"
+#include "TimeSplitMPC.h"
+
+static const double PERIOD = 0.1;
+
+int main(int argc, char* argv[]) {
+  size_t frames = argc > 1 ? std::max(atoi(argv[1]), 1) : 50;
+  MpcConfig config;
+  config.dt = 0.05;
+  Cubic coeffs;
+  coeffs << -2, 0.05, 5e-4, 0;
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  printf("%5s %8s %8s %10s %10s %8s %10s %10s %10s %10s\n", "N",
+         "segments", "threads", "ms", "max ms", "iter", "converged",
+         "defect", "d delta", "d a");
+  for (size_t N : {100, 200, 400}) {
+    std::vector<State> states;
+    std::vector<Input> serial;
+    for (size_t segments : {1, 2, 4, 8, 16}) {
+      size_t threads = std::min(segments, cores);
+      TimeSplitMPC mpc(N, config.dt, config.Lf, config.weights, config.refV,
+                       segments, threads);
+      State state;
+      state << 0, 0, 0, 0.5 * config.refV, coeffs[0], -atan(coeffs[1]);
+      double total = 0;
+      double worst = 0;
+      double iterations = 0;
+      size_t converged = 0;
+      double defect = 0;
+      double d_delta = 0;
+      double d_a = 0;
+      for (size_t f = 0; f < frames; f++) {
+        if (segments > 1) {
+          state = states[f];
+        }
+        auto begin = std::chrono::steady_clock::now();
+        Input u = mpc.Solve(state, coeffs);
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - begin)
+                        .count();
+        total += ms;
+        worst = std::max(worst, ms);
+        iterations += mpc.lastIterations;
+        converged += mpc.lastConverged;
+        defect = std::max(defect, mpc.lastDefect);
+        if (segments == 1) {
+          states.push_back(state);
+          serial.push_back(u);
+          // The path stays put in the car's frame: the car moves along it,
+          // and its errors with it.
+          State next = BicycleStep(state, u, coeffs, PERIOD, config.Lf);
+          state << 0, 0, 0, next[3], next[4], next[5];
+        } else {
+          d_delta += std::fabs(u[0] - serial[f][0]);
+          d_a += std::fabs(u[1] - serial[f][1]);
+        }
+      }
+      printf("%5zu %8zu %8zu %10.3f %10.3f %8.1f %10zu %10.4f %10.5f "
+             "%10.5f\n",
+             N, mpc.segments(), threads, total / frames, worst,
+             iterations / frames, converged, defect, d_delta / frames,
+             d_a / frames);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+// TrackLocalizer against TrackMap::Project searching the 2-d tree afresh,
+// for a car lapping tracks of a thousand to a few million waypoints: a
+// winding loop of 4 km, the car weaving a few meters about it at 20 m/s,
+// projected 10 times a second, with a jump to the far side of the loop every
+// 500 frames. Prints the time per projection each way, the calls the
+// localizer answered locally and by the tree, and the most the two arc
+// lengths differ.
+//
+// Usage: track_localizer
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "TrackLocalizer.h"
+#include "TrackMap.h"
+
+static const double RADIUS = 640;
+static const size_t FRAMES = 20000;
+static const double STEP = 2;
+static const size_t JUMP_EVERY = 500;
+
+static void Loop(double u, double& x, double& y) {
+  double r = RADIUS * (1 + 0.15 * sin(5 * u) + 0.05 * sin(17 * u));
+  x = r * cos(u);
+  y = r * sin(u);
+}
+
+int main() {
+  printf("%10s %10s %10s %10s %10s %10s\n", "waypoints", "tree us",
+         "local us", "local", "searched", "max diff");
+  for (size_t n : {1000, 10000, 100000, 1000000, 4000000}) {
+    std::vector<double> wx(n);
+    std::vector<double> wy(n);
+    for (size_t i = 0; i < n; i++) {
+      Loop(2 * M_PI * i / n, wx[i], wy[i]);
+    }
+    TrackMap track;
+    track.Assign(wx, wy);
+
+    // The car's path, along the loop by STEP meters of arc length a frame.
+    std::vector<double> px(FRAMES);
+    std::vector<double> py(FRAMES);
+    double s = 0;
+    for (size_t f = 0; f < FRAMES; f++) {
+      s += f % JUMP_EVERY == 0 ? track.length() / 2 : STEP;
+      double x, y, dx, dy;
+      track.Evaluate(s, x, y, dx, dy);
+      double offset = 3 * sin(f * 0.05) / std::hypot(dx, dy);
+      px[f] = x - dy * offset;
+      py[f] = y + dx * offset;
+    }
+
+    std::vector<double> tree(FRAMES);
+    std::vector<double> local(FRAMES);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < FRAMES; f++) {
+      tree[f] = track.Project(px[f], py[f]);
+    }
+    double tree_seconds = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - begin)
+                              .count();
+    TrackLocalizer localizer;
+    begin = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < FRAMES; f++) {
+      local[f] = localizer.Project(track, px[f], py[f]);
+    }
+    double local_seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count();
+    double diff = 0;
+    for (size_t f = 0; f < FRAMES; f++) {
+      double d = std::fabs(tree[f] - local[f]);
+      diff = std::max(diff, std::min(d, track.length() - d));
+    }
+    printf("%10zu %10.3f %10.3f %10lu %10lu %10.2g\n", n,
+           tree_seconds / FRAMES * 1e6, local_seconds / FRAMES * 1e6,
+           localizer.local(), localizer.searched(), diff);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Warm starts by track position (see MPC::LoadWarmStarts): a lap is driven
+// to fill them and they are saved, then a new controller loads them and
+// drives the start of the lap again, next to one starting cold. Prints the
+// iterations and times of the first frames of both, and the size of the
+// file.
+//
+// Usage: track_warm_starts [waypoints.csv] [warm_starts.bin]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "TrackMap.h"
+
+// Every STRIDE-th frame of the lap, the first FIRST of them compared, and
+// the bins of the warm starts in meters.
+static const size_t STRIDE = 4;
+static const size_t FIRST = 40;
+static const double BIN = 2;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  const char* file = argc > 2 ? argv[2] : "/tmp/track_warm_starts.bin";
+  TrackMap track;
+  track.Assign(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs,
+                           size_t(-1), STRIDE);
+  std::vector<double> positions(n);
+  for (size_t i = 0; i < n; i++) {
+    const std::string& frame = frames[i * STRIDE];
+    Telemetry t;
+    ParseTelemetry(frame.data(), frame.data() + frame.size(), t);
+    positions[i] = track.Project(t.px, t.py);
+  }
+
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  {
+    MPC mpc(base);
+    mpc.LoadWarmStarts(file, track.length(), BIN);
+    for (size_t i = 0; i < n; i++) {
+      mpc.trackPosition = positions[i];
+      mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+    }
+    if (!mpc.SaveWarmStarts(file)) {
+      fprintf(stderr, "failed to write %s\n", file);
+      return 1;
+    }
+    printf("%zu of %zu bins filled\n", mpc.warmStarts()->filled(),
+           mpc.warmStarts()->bins());
+  }
+  std::ifstream saved(file, std::ios::binary | std::ios::ate);
+  printf("%s: %lld bytes\n", file, (long long)saved.tellg());
+
+  MPC warm(base);
+  MPC cold(base);
+  if (!warm.LoadWarmStarts(file, track.length(), BIN)) {
+    fprintf(stderr, "failed to load %s\n", file);
+    return 1;
+  }
+  printf("%-6s %10s %10s %10s %10s\n", "frame", "iter", "iter cold", "ms",
+         "ms cold");
+  double total[2][2] = {{0, 0}, {0, 0}};
+  size_t first = std::min(n, FIRST);
+  for (size_t i = 0; i < first; i++) {
+    warm.trackPosition = positions[i];
+    MPC* controllers[] = {&warm, &cold};
+    int iterations[2];
+    double ms[2];
+    for (int c = 0; c < 2; c++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      controllers[c]->Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      iterations[c] = controllers[c]->stats().iterations;
+      ms[c] = controllers[c]->stats().seconds * 1e3;
+      total[c][0] += iterations[c];
+      total[c][1] += ms[c];
+    }
+    printf("%-6zu %9d%s %10d %10.3f %10.3f\n", i, iterations[0],
+           warm.trackSeeded ? "*" : " ", iterations[1], ms[0], ms[1]);
+  }
+  printf("%-6s %10.2f %10.2f %10.3f %10.3f\n", "mean", total[0][0] / first,
+         total[1][0] / first, total[0][1] / first, total[1][1] / first);
+  return 0;
+}
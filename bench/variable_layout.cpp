@@ -0,0 +1,84 @@
+// The variables laid out variable by variable against stage by stage (see
+// MpcConfig::stageMajor). At a few horizons, solves the same frames with
+// each layout and prints the solve time, the parts of it spent evaluating
+// the problem and in the linear solver, and how far the first actuations
+// are from those of the variable-major layout.
+//
+// Usage: variable_layout [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 200;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-4s %-8s %7s %12s %12s %12s %12s\n", "N", "layout", "failed",
+         "solve p50", "eval ms", "linear ms", "max |du|");
+  const size_t horizons[] = {10, 20, 40, 80};
+  for (size_t N : horizons) {
+    std::vector<double> first_delta(n);
+    std::vector<double> first_a(n);
+    for (int stage_major = 0; stage_major < 2; stage_major++) {
+      MpcConfig config = base;
+      config.N = N;
+      config.horizons.assign(1, Horizon{N, config.dt});
+      config.stageMajor = stage_major;
+      MPC mpc(config);
+
+      std::vector<double> solve_ms;
+      double eval_ms = 0;
+      double linear_ms = 0;
+      double max_du = 0;
+      size_t failed = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (size_t i = 0; i < n; i++) {
+        mpc_x.clear();
+        mpc_y.clear();
+        std::vector<double> u = mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+        const MPC::SolveStats& stats = mpc.stats();
+        solve_ms.push_back(stats.seconds * 1e3);
+        eval_ms += stats.evalSeconds * 1e3;
+        linear_ms += stats.linearSolveSeconds * 1e3;
+        failed += stats.status != MPC::CONVERGED;
+        if (stage_major) {
+          max_du = std::max(max_du, std::max(std::fabs(u[0] - first_delta[i]),
+                                             std::fabs(u[1] - first_a[i])));
+        } else {
+          first_delta[i] = u[0];
+          first_a[i] = u[1];
+        }
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      printf("%-4zu %-8s %7zu %12.3f %12.3f %12.3f %12.3g\n", N,
+             stage_major ? "stage" : "variable", failed, solve_ms[n / 2],
+             eval_ms / n, linear_ms / n, max_du);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Warm starts of Ipopt (see MPC::warmStart, warmStartDuals and
+// warmStartMu): cold, the primal solution shifted a stage, with the
+// multipliers shifted too, and with them and a small initial barrier
+// parameter. Solves the same sequence of frames with each and prints the
+// failed solves and the mean and tail of the iterations and solve time.
+//
+// Usage: warm_start [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+// Frames solved with each mode, from the start of the lap.
+static const size_t FRAMES = 400;
+static const double LATENCY = 0.1;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  struct Mode {
+    const char* name;
+    bool primal;
+    bool duals;
+    double mu;
+  };
+  const Mode modes[] = {
+      {"cold", false, false, 0},
+      {"primal", true, false, 0},
+      {"duals", true, true, 0},
+      {"duals+mu", true, true, 1e-4},
+  };
+  printf("%-9s %7s %10s %9s %12s %12s\n", "warm", "failed", "iter mean",
+         "iter p99", "solve p50", "solve p99");
+  for (const Mode& mode : modes) {
+    MPC mpc(base);
+    mpc.warmStart = mode.primal;
+    mpc.warmStartDuals = mode.duals;
+    mpc.warmStartMu = mode.mu;
+
+    std::vector<double> solve_ms;
+    std::vector<int> iterations;
+    double total_iterations = 0;
+    size_t failed = 0;
+    std::vector<double> mpc_x;
+    std::vector<double> mpc_y;
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      const MPC::SolveStats& stats = mpc.stats();
+      solve_ms.push_back(stats.seconds * 1e3);
+      iterations.push_back(stats.iterations);
+      total_iterations += stats.iterations;
+      failed += stats.status != MPC::CONVERGED;
+    }
+    std::sort(solve_ms.begin(), solve_ms.end());
+    std::sort(iterations.begin(), iterations.end());
+    size_t p99 = std::min(n - 1, size_t(0.99 * (n - 1) + 0.5));
+    printf("%-9s %7zu %10.1f %9d %12.3f %12.3f\n", mode.name, failed,
+           total_iterations / n, iterations[p99], solve_ms[n / 2],
+           solve_ms[p99]);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,74 @@
+// The first frames of a fresh controller against its steady state, with and
+// without MPC::WarmUp: the solve times of frames 1 to 5 of a lap, and the
+// median of the rest, with the time the warm-up itself took.
+//
+// Usage: warm_up [waypoints.csv] [warm-up solves]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Polynomial.h"
+
+static const double LATENCY = 0.1;
+static const size_t FIRST = 5;
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  size_t solves = argc > 2 ? atoi(argv[2]) : 3;
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig config;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, config.Lf, LATENCY, states, coeffs);
+
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  printf("%8s %10s", "warm-up", "ms");
+  for (size_t k = 0; k < FIRST; k++) {
+    printf(" %7s%zu", "frame ", k + 1);
+  }
+  printf(" %10s\n", "median");
+  // Cold first, so that nothing is warmed up in the process yet.
+  for (size_t warm : {size_t(0), solves}) {
+    auto start = std::chrono::steady_clock::now();
+    MPC mpc(config);
+    mpc.fallback = false;
+    mpc.WarmUp(warm);
+    double setup = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    std::vector<double> ms(n);
+    for (size_t i = 0; i < n; i++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      start = std::chrono::steady_clock::now();
+      mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+      ms[i] = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    }
+    printf("%8zu %10.1f", warm, setup);
+    for (size_t k = 0; k < FIRST && k < n; k++) {
+      printf(" %8.3f", ms[k]);
+    }
+    std::vector<double> rest(ms.begin() + std::min(n, FIRST), ms.end());
+    std::sort(rest.begin(), rest.end());
+    printf(" %10.3f\n", rest.empty() ? 0 : rest[rest.size() / 2]);
+    fflush(stdout);
+  }
+  return 0;
+}
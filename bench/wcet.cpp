@@ -0,0 +1,123 @@
+// The worst-case execution time of each solver with a fixed iteration count
+// (see MpcConfig::fixedIterations) against the same solver run to its
+// tolerances. Solves the frames of a lap several times over, with a
+// controller set up as the server's, and prints each one's mean, p99, p99.9
+// and largest solve time, the largest over the mean, and how far its first
+// steering angle lands from that of the solver run to its tolerances.
+//
+// With a fixed count the work of a frame doesn't depend on the frame, so
+// the largest time sits near the mean, and what is left of the spread is
+// the machine's: caches, interrupts and the scheduler. The largest time
+// here is a measurement, for the margin over it, not itself a bound.
+//
+// Usage: wcet [waypoints.csv]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "LakeFrames.h"
+#include "MPC.h"
+#include "Measure.h"
+#include "Polynomial.h"
+
+// Frames of the lap, each solved REPEATS times after a pass to warm up.
+static const size_t FRAMES = 200;
+static const int REPEATS = 10;
+static const double LATENCY = 0.1;
+
+struct Backend {
+  const char* name;
+  MPC::Method method;
+  LTVMPC::Formulation formulation;
+  MpcConfig::NlpSolver nlpSolver;
+  // The fixed counts to run, after 0 for the tolerances.
+  int counts[3];
+};
+
+static const Backend BACKENDS[] = {
+    {"rti", MPC::REAL_TIME_ITERATION, LTVMPC::SPARSE, MpcConfig::IPOPT,
+     {10, 30, 100}},
+    {"ltv-sparse", MPC::LINEAR_TIME_VARYING, LTVMPC::SPARSE,
+     MpcConfig::IPOPT, {25, 100, 400}},
+    {"ltv-condensed", MPC::LINEAR_TIME_VARYING, LTVMPC::CONDENSED,
+     MpcConfig::IPOPT, {25, 100, 400}},
+    {"ltv-riccati", MPC::LINEAR_TIME_VARYING, LTVMPC::RICCATI,
+     MpcConfig::IPOPT, {25, 100, 400}},
+    {"interior-point", MPC::IPOPT, LTVMPC::SPARSE, MpcConfig::INTERIOR_POINT,
+     {5, 10, 20}},
+};
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  std::vector<double> wx;
+  std::vector<double> wy;
+  if (!ReadWaypoints(path, wx, wy) || wx.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  // The fit and predicted state of each frame, as Control() computes them.
+  std::vector<std::string> frames = MakeFrames(wx, wy);
+  MpcConfig base;
+  States states;
+  Cubics coeffs;
+  size_t n = PrepareFrames(frames, base.Lf, LATENCY, states, coeffs, FRAMES);
+
+  printf("%-15s %6s %7s %10s %10s %10s %10s %8s %12s\n", "solver", "K",
+         "failed", "mean ms", "p99 ms", "p99.9 ms", "max ms", "max/mean",
+         "delta err");
+  for (const Backend& backend : BACKENDS) {
+    // The steering of the run to the tolerances, frame by frame.
+    std::vector<double> reference(n);
+    for (int c = -1; c < 3; c++) {
+      int K = c < 0 ? 0 : backend.counts[c];
+      MpcConfig config = base;
+      config.nlpSolver = backend.nlpSolver;
+      config.fixedIterations = K;
+      MPC mpc(config);
+      mpc.method = backend.method;
+      mpc.ltvFormulation = backend.formulation;
+
+      std::vector<double> solve_ms;
+      size_t failed = 0;
+      double delta_error = 0;
+      std::vector<double> mpc_x;
+      std::vector<double> mpc_y;
+      for (int pass = 0; pass <= REPEATS; pass++) {
+        for (size_t i = 0; i < n; i++) {
+          mpc_x.clear();
+          mpc_y.clear();
+          auto start = std::chrono::steady_clock::now();
+          std::vector<double> u =
+              mpc.Solve(states[i], coeffs[i], mpc_x, mpc_y);
+          std::chrono::duration<double, std::milli> elapsed =
+              std::chrono::steady_clock::now() - start;
+          if (pass == 0) {
+            if (K == 0) {
+              reference[i] = u[0];
+            }
+            delta_error += std::fabs(u[0] - reference[i]);
+            failed += mpc.stats().status != MPC::CONVERGED;
+            continue;
+          }
+          solve_ms.push_back(elapsed.count());
+        }
+      }
+      std::sort(solve_ms.begin(), solve_ms.end());
+      double mean = 0;
+      for (double ms : solve_ms) {
+        mean += ms;
+      }
+      mean /= solve_ms.size();
+      printf("%-15s %6d %7zu %10.4f %10.4f %10.4f %10.4f %8.2f %12.3g\n",
+             backend.name, K, failed, mean, Percentile(solve_ms, 0.99),
+             Percentile(solve_ms, 0.999), solve_ms.back(),
+             solve_ms.back() / mean, delta_error / n);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
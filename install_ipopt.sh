@@ -35,11 +35,27 @@ cd $srcdir/ThirdParty/ASL
 cd $srcdir/ThirdParty/Mumps
 ./get.Mumps
 
+# HSL (MA27, MA57, MA86, MA97), optional: they can't be downloaded here.
+# Unpack the coinhsl sources from http://www.hsl.rl.ac.uk/ipopt/ into
+# ThirdParty/HSL/coinhsl before running this, and the build picks them up.
+if [ -d $srcdir/ThirdParty/HSL/coinhsl ]
+then
+    echo "Building with HSL"
+fi
+
+# Pardiso, optional: set PARDISO_LIBS to its libraries, e.g.
+# PARDISO_LIBS="-L/opt/pardiso -lpardiso600-GNU720-X86-64 -lgomp"
+pardiso=
+if [ -n "$PARDISO_LIBS" ]
+then
+    pardiso="--with-pardiso=$PARDISO_LIBS"
+fi
+
 # build everything
 cd $srcdir
 ./configure --prefix=$prefix coin_skip_warn_cxxflags=yes \
     --with-blas="$prefix/lib/libcoinblas.a -lgfortran" \
-    --with-lapack=$prefix/lib/libcoinlapack.a
+    --with-lapack=$prefix/lib/libcoinlapack.a ${pardiso:+"$pardiso"}
 make
 make test
 make -j1 install
@@ -0,0 +1,167 @@
+#include "ActiveSetQP.h"
+#include <algorithm>
+#include <cmath>
+#include "Precision.h"
+
+// Step components below this are taken as none.
+static const double MIN_STEP = 1e-12;
+
+template <class Scalar>
+BasicActiveSetQP<Scalar>::BasicActiveSetQP()
+    : maxIterations(1000), tolerance(1e-9), n_(0), converged_(false) {}
+
+template <class Scalar>
+void BasicActiveSetQP<Scalar>::Resize(int n) {
+  n_ = n;
+  bound_.assign(n, 0);
+  free_.assign(n, 0);
+  M_ = Matrix::Zero(n, n);
+  x_ = Vector::Zero(n);
+  grad_ = Vector::Zero(n);
+  step_ = Vector::Zero(n);
+  refined_ = Eigen::VectorXd::Zero(n);
+  residual_ = Eigen::VectorXd::Zero(n);
+}
+
+template <class Scalar>
+void BasicActiveSetQP<Scalar>::WarmStart(const Vector& x) {
+  x_ = x;
+}
+
+template <class Scalar>
+void BasicActiveSetQP<Scalar>::Shift(int by) {
+  for (int i = 0; i + by < n_; i++) {
+    bound_[i] = bound_[i + by];
+  }
+  for (int i = std::max(n_ - by, by); i < n_; i++) {
+    bound_[i] = bound_[i - by];
+  }
+}
+
+template <class Scalar>
+void BasicActiveSetQP<Scalar>::ColdStart() {
+  std::fill(bound_.begin(), bound_.end(), 0);
+}
+
+template <class Scalar>
+int BasicActiveSetQP<Scalar>::Solve(const Matrix& H, const Vector& g,
+                                    const Vector& lb, const Vector& ub) {
+  // A feasible start on the working set.
+  for (int i = 0; i < n_; i++) {
+    x_[i] = bound_[i] < 0   ? lb[i]
+            : bound_[i] > 0 ? ub[i]
+                            : std::min(std::max(x_[i], lb[i]), ub[i]);
+  }
+
+  converged_ = false;
+  int changes = 0;
+  while (changes <= maxIterations) {
+    int n_free = 0;
+    for (int i = 0; i < n_; i++) {
+      if (bound_[i] == 0) {
+        free_[n_free++] = i;
+      }
+    }
+
+    // The Newton step of the free variables, the others held.
+    if (n_free > 0) {
+      grad_.noalias() = H * x_;
+      grad_ += g;
+      for (int a = 0; a < n_free; a++) {
+        step_[a] = -grad_[free_[a]];
+        for (int b = 0; b <= a; b++) {
+          M_(a, b) = H(free_[a], free_[b]);
+        }
+      }
+      Eigen::Ref<Matrix> block(M_.topLeftCorner(n_free, n_free));
+      FreeLLT llt(block);
+      if (llt.info() != Eigen::Success) {
+        return changes;
+      }
+      Eigen::VectorBlock<Vector> step = step_.head(n_free);
+      llt.solveInPlace(step);
+      // The diagonal of L is the square root of the pivots.
+      double ratio = block.diagonal().maxCoeff() / block.diagonal().minCoeff();
+      if (NeedsRefinement<Scalar>(ratio * ratio)) {
+        Refine(H, llt, n_free);
+      }
+    }
+
+    // As far along it as the bounds allow.
+    Scalar alpha = 1;
+    int blocking = -1;
+    int side = 0;
+    for (int a = 0; a < n_free; a++) {
+      int i = free_[a];
+      if (step_[a] < -MIN_STEP && lb[i] - x_[i] > alpha * step_[a]) {
+        alpha = (lb[i] - x_[i]) / step_[a];
+        blocking = i;
+        side = -1;
+      } else if (step_[a] > MIN_STEP && ub[i] - x_[i] < alpha * step_[a]) {
+        alpha = (ub[i] - x_[i]) / step_[a];
+        blocking = i;
+        side = 1;
+      }
+    }
+    for (int a = 0; a < n_free; a++) {
+      x_[free_[a]] += alpha * step_[a];
+    }
+    if (blocking >= 0) {
+      bound_[blocking] = side;
+      x_[blocking] = side < 0 ? lb[blocking] : ub[blocking];
+      changes++;
+      continue;
+    }
+
+    // The minimum on the working set: free the bound whose multiplier is
+    // the most negative, if any is.
+    grad_.noalias() = H * x_;
+    grad_ += g;
+    int release = -1;
+    Scalar worst = -tolerance;
+    for (int i = 0; i < n_; i++) {
+      Scalar multiplier = bound_[i] * -grad_[i];
+      if (bound_[i] != 0 && lb[i] < ub[i] && multiplier < worst) {
+        worst = multiplier;
+        release = i;
+      }
+    }
+    if (release < 0) {
+      converged_ = true;
+      break;
+    }
+    bound_[release] = 0;
+    changes++;
+  }
+  return changes;
+}
+
+template <class Scalar>
+void BasicActiveSetQP<Scalar>::Refine(const Matrix& H, const FreeLLT& llt,
+                                      int n_free) {
+  // The step solves H_ff step = -grad_f.
+  for (int a = 0; a < n_free; a++) {
+    refined_[a] = step_[a];
+  }
+  for (int pass = 0; pass < REFINEMENT_STEPS; pass++) {
+    for (int a = 0; a < n_free; a++) {
+      double r = -double(grad_[free_[a]]);
+      for (int b = 0; b < n_free; b++) {
+        r -= double(H(free_[a], free_[b])) * refined_[b];
+      }
+      residual_[a] = r;
+    }
+    Eigen::VectorBlock<Vector> correction = step_.head(n_free);
+    correction = residual_.head(n_free).cast<Scalar>();
+    llt.solveInPlace(correction);
+    for (int a = 0; a < n_free; a++) {
+      refined_[a] += correction[a];
+    }
+  }
+  for (int a = 0; a < n_free; a++) {
+    step_[a] = refined_[a];
+  }
+}
+
+template class BasicActiveSetQP<double>;
+template class BasicActiveSetQP<float>;
@@ -0,0 +1,84 @@
+#ifndef ACTIVE_SET_QP_H
+#define ACTIVE_SET_QP_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// Box-constrained dense QP solver, as DenseQP's problem:
+//
+//   minimize    1/2 x' H x + g' x
+//   subject to  lb <= x <= ub
+//
+// by a primal active-set method in the style of qpOASES. The working set
+// holds the variables fixed at a bound; each iteration takes the Newton
+// step of the free ones, with a dense Cholesky (LLT) of H over them in
+// place in storage sized by Resize(), and either stops at the first bound
+// it reaches, fixing that variable, or frees the fixed variable whose
+// multiplier has the wrong sign. H must be positive definite.
+//
+// The working set is kept from one Solve() to the next: it is the hot start.
+// In a receding horizon the bounds that were active last frame mostly still
+// are, so a Solve() typically ends after zero to two changes of the working
+// set, at one factorization each.
+//
+// ActiveSetQP.cpp instantiates the scalar double, ActiveSetQP, and float, in
+// which badly conditioned Newton steps are refined in double as DenseQP's
+// solves.
+template <class Scalar>
+class BasicActiveSetQP {
+ public:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+  BasicActiveSetQP();
+
+  // Changes of the working set allowed per Solve(), and how negative a
+  // multiplier may be and still count as optimal.
+  int maxIterations;
+  double tolerance;
+
+  // Allocate for n variables, all free, and reset the iterate.
+  void Resize(int n);
+
+  // Start the next Solve() from x, on the working set kept.
+  void WarmStart(const Vector& x);
+  // Move the working set `by` variables toward the start, the last `by`
+  // taking that of the one before them: the bounds of the next frame's
+  // stages when each stage is `by` variables.
+  void Shift(int by);
+  // Free all variables.
+  void ColdStart();
+
+  // Solve from the current iterate and working set, and return how many
+  // times the working set changed.
+  int Solve(const Matrix& H, const Vector& g, const Vector& lb,
+            const Vector& ub);
+
+  // Whether the last Solve() reached the optimum within maxIterations.
+  bool converged() const { return converged_; }
+  const Vector& solution() const { return x_; }
+
+ private:
+  typedef Eigen::LLT<Eigen::Ref<Matrix> > FreeLLT;
+  // Refine the Newton step of the n_free free variables, llt their block of
+  // H, with residuals in double.
+  void Refine(const Matrix& H, const FreeLLT& llt, int n_free);
+
+  int n_;
+  bool converged_;
+  // -1 at the lower bound, 1 at the upper, 0 free.
+  std::vector<int> bound_;
+  // The free variables of the current working set.
+  std::vector<int> free_;
+  Matrix M_;
+  Vector x_;
+  Vector grad_;
+  Vector step_;
+  Eigen::VectorXd refined_;
+  Eigen::VectorXd residual_;
+};
+
+typedef BasicActiveSetQP<double> ActiveSetQP;
+
+#endif /* ACTIVE_SET_QP_H */
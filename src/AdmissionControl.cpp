@@ -0,0 +1,52 @@
+#include "AdmissionControl.h"
+#include <algorithm>
+#include "Metrics.h"
+
+AdmissionControl::AdmissionControl(size_t workers, const Options& options)
+    : workers_(std::max<size_t>(workers, 1)), options_(options),
+      sampled_(false), last_cpu_(0), utilization_(0), cost_(0),
+      admitted_(0), lift_(false) {}
+
+void AdmissionControl::Sample(std::chrono::steady_clock::time_point now,
+                              size_t sessions) {
+  uint64_t cpu = metrics.sessionCpu.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(mutex_);
+  double wall = std::chrono::duration<double>(now - last_).count();
+  if (sampled_ && wall > 0) {
+    double sample = 1e-9 * (cpu - last_cpu_) / (wall * workers_);
+    utilization_ += options_.weight * (sample - utilization_);
+  }
+  sampled_ = true;
+  last_ = now;
+  last_cpu_ = cpu;
+  if (sessions > 0) {
+    cost_ = utilization_ / sessions;
+  }
+  admitted_ = 0;
+  lift_ = utilization_ < options_.liftBelow;
+  metrics.utilization.store(int64_t(utilization_ * 1e6),
+                            std::memory_order_relaxed);
+}
+
+double AdmissionControl::utilization() const {
+  return double(metrics.utilization.load(std::memory_order_relaxed)) * 1e-6;
+}
+
+AdmissionControl::Decision AdmissionControl::Admit() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double expected = utilization_ + cost_ * (admitted_ + 1);
+  if (expected > options_.refuseAbove) {
+    metrics.sessionsRefused.fetch_add(1, std::memory_order_relaxed);
+    return REFUSE;
+  }
+  admitted_++;
+  if (expected > options_.degradeAbove) {
+    metrics.sessionsDegraded.fetch_add(1, std::memory_order_relaxed);
+    return DEGRADE;
+  }
+  return ADMIT;
+}
+
+bool AdmissionControl::Lift() {
+  return lift_.load(std::memory_order_relaxed) && lift_.exchange(false);
+}
@@ -0,0 +1,72 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "DegradationLadder.h"
+
+// Whether a node takes one more session, from how much of its workers' CPU
+// the sessions it has take already, so that a vehicle too many is turned
+// away, or run cheaply, instead of pushing every session past its deadline.
+//
+// Sample() reads the sessions' CPU time from the metrics, see
+// Session::cpuSeconds, and smooths its share of the workers' time, the
+// utilization, from sample to sample. A newcomer is expected to cost what
+// a session did at the last sample, on top of those admitted since: if
+// that would take the utilization over refuseAbove it is refused, and over
+// degradeAbove it is admitted held to `tier`, see
+// DegradationLadder::SetFloor. The sessions already running are never
+// touched, so their deadlines stay as they were. Once the utilization is
+// under liftBelow, the held sessions go back to the full tier, one a
+// sample.
+class AdmissionControl {
+ public:
+  enum Decision { ADMIT, DEGRADE, REFUSE };
+
+  struct Options {
+    Options()
+        : degradeAbove(0.7), refuseAbove(0.9), liftBelow(0.5),
+          tier(DegradationLadder::RTI_STEP), weight(0.3) {}
+    double degradeAbove;
+    double refuseAbove;
+    double liftBelow;
+    DegradationLadder::Tier tier;
+    // Of a new sample in the smoothed utilization.
+    double weight;
+  };
+
+  AdmissionControl(size_t workers, const Options& options);
+
+  // Sample the utilization, with `sessions` open; at a steady interval,
+  // from one thread.
+  void Sample(std::chrono::steady_clock::time_point now, size_t sessions);
+  // The smoothed utilization, 1 when the workers do nothing but solve.
+  double utilization() const;
+
+  // What to do with a new session; any thread.
+  Decision Admit();
+  // Whether a held session may go back to the full tier: true for one
+  // caller a sample while the utilization is under liftBelow. Any thread.
+  bool Lift();
+
+  const Options& options() const { return options_; }
+
+ private:
+  size_t workers_;
+  Options options_;
+  std::mutex mutex_;
+  bool sampled_;
+  std::chrono::steady_clock::time_point last_;
+  uint64_t last_cpu_;
+  double utilization_;
+  // The utilization a session took at the last sample that had any, and
+  // the sessions admitted since the last sample.
+  double cost_;
+  size_t admitted_;
+  std::atomic<bool> lift_;
+};
+
+#endif /* ADMISSION_CONTROL_H */
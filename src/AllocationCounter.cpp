@@ -0,0 +1,33 @@
+#include "AllocationCounter.h"
+
+#ifdef MPC_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+// Zero-initialized, so reading it costs no thread_local guard.
+static thread_local uint64_t thread_allocations;
+
+void* operator new(size_t size) {
+  thread_allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+bool CountingAllocations() { return true; }
+uint64_t ThreadAllocations() { return thread_allocations; }
+
+#else
+
+bool CountingAllocations() { return false; }
+uint64_t ThreadAllocations() { return 0; }
+
+#endif
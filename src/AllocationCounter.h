@@ -0,0 +1,18 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Counts of global operator new calls, for catching allocations on the hot
+// path. Built with MPC_COUNT_ALLOCATIONS, AllocationCounter.cpp replaces
+// the global operator new and delete with malloc and free plus a per-thread
+// count; without it nothing is replaced and nothing is counted. The server
+// takes it with the MPC_COUNT_ALLOCATIONS CMake option, and
+// bench/solve_allocations.cpp always.
+
+// Whether this build counts.
+bool CountingAllocations();
+// operator new calls on the calling thread so far; 0 when not counting.
+uint64_t ThreadAllocations();
+
+#endif /* ALLOCATION_COUNTER_H */
@@ -0,0 +1,70 @@
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+
+static thread_local Arena* current_arena = nullptr;
+
+Arena::Arena(size_t block_size)
+    : block_size_(block_size), block_(0), offset_(0), used_(0) {}
+
+Arena::~Arena() {
+  for (const Block& block : blocks_) {
+    ::operator delete(block.begin);
+  }
+}
+
+void* Arena::Allocate(size_t bytes, size_t align) {
+  for (; block_ < blocks_.size(); block_++, offset_ = 0) {
+    const Block& block = blocks_[block_];
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.begin);
+    size_t start =
+        ((base + offset_ + align - 1) & ~uintptr_t(align - 1)) - base;
+    if (start + bytes <= block.size) {
+      offset_ = start + bytes;
+      used_ += bytes;
+      return block.begin + start;
+    }
+  }
+  // Out of blocks: add one big enough, which later frames keep using.
+  Block block;
+  block.size = std::max(block_size_, bytes + align);
+  block.begin = static_cast<char*>(::operator new(block.size));
+  blocks_.push_back(block);
+  offset_ = 0;
+  return Allocate(bytes, align);
+}
+
+bool Arena::Owns(const void* p) const {
+  const char* c = static_cast<const char*>(p);
+  for (const Block& block : blocks_) {
+    if (c >= block.begin && c < block.begin + block.size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t Arena::capacity() const {
+  size_t bytes = 0;
+  for (const Block& block : blocks_) {
+    bytes += block.size;
+  }
+  return bytes;
+}
+
+void Arena::Reset() {
+  block_ = 0;
+  offset_ = 0;
+  used_ = 0;
+}
+
+Arena* Arena::current() { return current_arena; }
+
+Arena::Scope::Scope(Arena& arena) : arena_(arena), previous_(current_arena) {
+  current_arena = &arena;
+}
+
+Arena::Scope::~Scope() {
+  current_arena = previous_;
+  arena_.Reset();
+}
@@ -0,0 +1,126 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Monotonic allocator for memory that dies all at once, like the json DOM
+// of one frame: allocation bumps a pointer through blocks that are kept,
+// freeing is a no-op, and Reset() rewinds. Once its blocks have grown to
+// the size of a frame, an arena doesn't touch the heap again.
+class Arena {
+ public:
+  explicit Arena(size_t block_size = 16384);
+  ~Arena();
+
+  void* Allocate(size_t bytes, size_t align);
+  // Whether `p` came from this arena.
+  bool Owns(const void* p) const;
+  // Release everything allocated, keeping the blocks.
+  void Reset();
+
+  // Bytes handed out since the last Reset().
+  size_t used() const { return used_; }
+  // Bytes in its blocks.
+  size_t capacity() const;
+
+  // The arena ArenaAllocator draws from on this thread, or nullptr for the
+  // heap.
+  static Arena* current();
+
+  // Makes `arena` current for its lifetime, and resets it on the way out;
+  // whatever was allocated in it must be gone by then.
+  class Scope {
+   public:
+    explicit Scope(Arena& arena);
+    ~Scope();
+
+   private:
+    Scope(const Scope&);
+    Scope& operator=(const Scope&);
+
+    Arena& arena_;
+    Arena* previous_;
+  };
+
+ private:
+  Arena(const Arena&);
+  Arena& operator=(const Arena&);
+
+  struct Block {
+    char* begin;
+    size_t size;
+  };
+
+  size_t block_size_;
+  std::vector<Block> blocks_;
+  // The block being allocated from, and the offset into it.
+  size_t block_;
+  size_t offset_;
+  size_t used_;
+};
+
+// Standard allocator over Arena::current(), falling back to the heap when
+// there is none. It is stateless, as basic_json's AllocatorType has to be,
+// so containers using it must not outlive the Scope they were filled in.
+template <class T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  template <class U>
+  struct rebind {
+    typedef ArenaAllocator<U> other;
+  };
+
+  ArenaAllocator() {}
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    Arena* arena = Arena::current();
+    if (arena) {
+      return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t) {
+    Arena* arena = Arena::current();
+    if (!(arena && arena->Owns(p))) {
+      ::operator delete(p);
+    }
+  }
+
+  template <class U, class... Args>
+  void construct(U* p, Args&&... args) {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <class U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  size_t max_size() const { return size_t(-1) / sizeof(T); }
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+  return false;
+}
+
+#endif /* ARENA_H */
@@ -0,0 +1,554 @@
+#include "AutoDiffNLP.h"
+#include <algorithm>
+#include <cmath>
+#include "GeneratedStages.h"
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+template <class Model>
+AutoDiffNLP<Model>::AutoDiffNLP(size_t N, double dt, const MpcConfig& config,
+                                const Model& model)
+    : N_(N),
+      n_vars_(Model::STATES * N + Model::INPUTS * (N - 1)),
+      n_constraints_(Model::STATES * N),
+      dt_(dt),
+      model_(model),
+      cost_(config.weights, config.refV),
+      slopes_(config.integrator == MpcConfig::EULER      ? 1
+              : config.integrator == MpcConfig::MIDPOINT ? 2
+                                                         : 4),
+      exact_hessian_(config.hessian != MpcConfig::GAUSS_NEWTON),
+      jac_offset_(N),
+      hes_offset_(N),
+      generated_(config.generatedStages ? FindGeneratedStage(config, dt)
+                                        : NULL) {
+  Probe();
+  for (size_t i = 0; i < n_params; i++) {
+    params_[i] = 0;
+  }
+}
+
+template <class Model>
+AutoDiffNLP<Model>::~AutoDiffNLP() {}
+
+template <class Model>
+void AutoDiffNLP<Model>::SetParameters(const Dvector& params) {
+  // Keep the tape in sync so that CheckDerivatives compares like with like.
+  MPC_NLP::SetParameters(params);
+  for (size_t i = 0; i < n_params; i++) {
+    params_[i] = params[i];
+  }
+}
+
+template <class Model>
+size_t AutoDiffNLP<Model>::Var(int i, size_t t) const {
+  if (i < int(Model::STATES)) {
+    return i * N_ + t;
+  }
+  return Model::STATES * N_ + (i - Model::STATES) * (N_ - 1) + t;
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::Gather(const Number* x, size_t t, double* w) const {
+  for (int i = 0; i < STAGE_VARS; i++) {
+    w[i] = i < int(Model::STATES) || t + 1 < N_ ? x[Var(i, t)] : 0;
+  }
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::Seed(const Number* x, size_t t, Active* w) const {
+  double values[STAGE_VARS];
+  Gather(x, t, values);
+  for (int i = 0; i < STAGE_VARS; i++) {
+    w[i] = Active(values[i], STAGE_VARS, i);
+  }
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::Seed(const Number* x, size_t t, Active2* w) const {
+  double values[STAGE_VARS];
+  Gather(x, t, values);
+  for (int i = 0; i < STAGE_VARS; i++) {
+    w[i].value() = Active(values[i], STAGE_VARS, i);
+    w[i].derivatives() =
+        Eigen::Matrix<Active, STAGE_VARS, 1>::Unit(STAGE_VARS, i);
+  }
+}
+
+template <class Model>
+template <class Scalar>
+void AutoDiffNLP<Model>::StageResiduals(const Scalar* w, bool inputs,
+                                        Scalar* r) const {
+  cost_.StateResiduals(w[4], w[5], w[3], r);
+  if (inputs) {
+    cost_.InputResiduals(w[6], w[7], r + TrackingCost::STATE_TERMS);
+  }
+}
+
+template <class Model>
+template <class Scalar>
+void AutoDiffNLP<Model>::RateResiduals(const Scalar* q, Scalar* r) const {
+  cost_.RateResiduals(Scalar(q[2] - q[0]), Scalar(q[3] - q[1]), r);
+}
+
+template <class Model>
+bool AutoDiffNLP<Model>::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
+                                      Index& nnz_h_lag,
+                                      IndexStyleEnum& index_style) {
+  n = n_vars_;
+  m = n_constraints_;
+  nnz_jac_g = nnz_jac_;
+  nnz_h_lag = nnz_hes_;
+  index_style = C_STYLE;
+  return true;
+}
+
+template <class Model>
+bool AutoDiffNLP<Model>::eval_f(Index n, const Number* x, bool new_x,
+                                Number& obj_value) {
+  const size_t terms = TrackingCost::STATE_TERMS + TrackingCost::INPUT_TERMS;
+  double w[STAGE_VARS];
+  double r[terms];
+  obj_value = 0;
+  for (size_t t = 0; t < N_; t++) {
+    Gather(x, t, w);
+    bool inputs = t + 1 < N_;
+    StageResiduals(w, inputs, r);
+    for (size_t i = 0; i < (inputs ? terms : TrackingCost::STATE_TERMS);
+         i++) {
+      obj_value += r[i] * r[i];
+    }
+  }
+  for (size_t t = 1; t + 1 < N_; t++) {
+    double q[4] = {x[Var(6, t - 1)], x[Var(7, t - 1)], x[Var(6, t)],
+                   x[Var(7, t)]};
+    RateResiduals(q, r);
+    for (size_t i = 0; i < TrackingCost::RATE_TERMS; i++) {
+      obj_value += r[i] * r[i];
+    }
+  }
+  return true;
+}
+
+template <class Model>
+bool AutoDiffNLP<Model>::eval_grad_f(Index n, const Number* x, bool new_x,
+                                     Number* grad_f) {
+  typedef Eigen::AutoDiffScalar<Eigen::Vector4d> Active4;
+  const size_t terms = TrackingCost::STATE_TERMS + TrackingCost::INPUT_TERMS;
+  for (Index i = 0; i < n; i++) {
+    grad_f[i] = 0;
+  }
+  // 2 J_r' r, a stage at a time.
+  Active w[STAGE_VARS];
+  Active r[terms];
+  for (size_t t = 0; t < N_; t++) {
+    Seed(x, t, w);
+    bool inputs = t + 1 < N_;
+    StageResiduals(w, inputs, r);
+    Derivatives g = Derivatives::Zero();
+    for (size_t i = 0; i < (inputs ? terms : TrackingCost::STATE_TERMS);
+         i++) {
+      g += 2 * r[i].value() * r[i].derivatives();
+    }
+    for (int i = 0; i < (inputs ? STAGE_VARS : int(Model::STATES)); i++) {
+      grad_f[Var(i, t)] += g[i];
+    }
+  }
+  Active4 q[4];
+  Active4 rr[TrackingCost::RATE_TERMS];
+  for (size_t t = 1; t + 1 < N_; t++) {
+    const size_t index[4] = {Var(6, t - 1), Var(7, t - 1), Var(6, t),
+                             Var(7, t)};
+    for (int i = 0; i < 4; i++) {
+      q[i] = Active4(x[index[i]], 4, i);
+    }
+    RateResiduals(q, rr);
+    for (size_t i = 0; i < TrackingCost::RATE_TERMS; i++) {
+      for (int j = 0; j < 4; j++) {
+        grad_f[index[j]] += 2 * rr[i].value() * rr[i].derivatives()[j];
+      }
+    }
+  }
+  return true;
+}
+
+template <class Model>
+bool AutoDiffNLP<Model>::eval_g(Index n, const Number* x, bool new_x,
+                                Index m, Number* g) {
+  NotePoint(x);
+  const double* x_init = params_ + n_coeffs;
+  for (size_t i = 0; i < Model::STATES; i++) {
+    g[Var(i, 0)] = x[Var(i, 0)] - x_init[i];
+  }
+  auto stages = [this, x, g](size_t begin, size_t end) {
+    double w[STAGE_VARS];
+    double next[Model::STATES];
+    for (size_t t = begin; t < end; t++) {
+      Gather(x, t - 1, w);
+      if (generated_ != NULL) {
+        generated_->step(params_, w, next);
+      } else {
+        StageStep(model_, slopes_, dt_, params_, w, next);
+      }
+      for (size_t i = 0; i < Model::STATES; i++) {
+        g[Var(i, t)] = x[Var(i, t)] - next[i];
+      }
+    }
+  };
+  if (pool_) {
+    pool_->Run(1, N_, stages);
+  } else {
+    stages(1, N_);
+  }
+  return true;
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::StageJacobian(
+    const Number* x, size_t t, double J[Model::STATES][STAGE_VARS]) const {
+  if (generated_ != NULL) {
+    double w[STAGE_VARS];
+    Gather(x, t, w);
+    generated_->jacobian(params_, w, &J[0][0]);
+    return;
+  }
+  Active w[STAGE_VARS];
+  Active next[Model::STATES];
+  Seed(x, t, w);
+  StageStep(model_, slopes_, dt_, params_, w, next);
+  for (size_t i = 0; i < Model::STATES; i++) {
+    for (int j = 0; j < STAGE_VARS; j++) {
+      J[i][j] = next[i].derivatives()[j];
+    }
+  }
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::StageHessian(const Number* x, size_t t,
+                                      double obj_factor, const Number* lambda,
+                                      double H[STAGE_VARS][STAGE_VARS]) const {
+  const size_t terms = TrackingCost::STATE_TERMS + TrackingCost::INPUT_TERMS;
+  bool dynamics = t + 1 < N_;
+  for (int i = 0; i < STAGE_VARS; i++) {
+    for (int j = 0; j < STAGE_VARS; j++) {
+      H[i][j] = 0;
+    }
+  }
+  // The constraints of stage t + 1 are its state less StageStep's: their
+  // curvature is -lambda' StageStep''.
+  if (dynamics && exact_hessian_ && generated_ != NULL) {
+    double w[STAGE_VARS];
+    double l[Model::STATES];
+    double lower[STAGE_VARS * (STAGE_VARS + 1) / 2];
+    Gather(x, t, w);
+    for (size_t i = 0; i < Model::STATES; i++) {
+      l[i] = lambda[Var(i, t + 1)];
+    }
+    generated_->hessian(params_, w, l, lower);
+    size_t k = 0;
+    for (int i = 0; i < STAGE_VARS; i++) {
+      for (int j = 0; j <= i; j++) {
+        H[i][j] = -lower[k++];
+      }
+    }
+  } else if (dynamics && exact_hessian_) {
+    Active2 w[STAGE_VARS];
+    Active2 next[Model::STATES];
+    Seed(x, t, w);
+    StageStep(model_, slopes_, dt_, params_, w, next);
+    Active2 sum = Active2(0.);
+    for (size_t i = 0; i < Model::STATES; i++) {
+      sum += lambda[Var(i, t + 1)] * next[i];
+    }
+    for (int i = 0; i < STAGE_VARS; i++) {
+      for (int j = 0; j <= i; j++) {
+        H[i][j] = -sum.derivatives()[i].derivatives()[j];
+      }
+    }
+  }
+  // The cost's residuals are linear, so 2 J_r' J_r is its Hessian.
+  Active w[STAGE_VARS];
+  Active r[terms];
+  Seed(x, t, w);
+  StageResiduals(w, dynamics, r);
+  for (size_t k = 0; k < (dynamics ? terms : TrackingCost::STATE_TERMS);
+       k++) {
+    const Derivatives& d = r[k].derivatives();
+    for (int i = 0; i < STAGE_VARS; i++) {
+      for (int j = 0; j <= i; j++) {
+        H[i][j] += obj_factor * 2 * d[i] * d[j];
+      }
+    }
+  }
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::RateHessian(const Number* x, size_t t,
+                                     double obj_factor, double R[4][4]) const {
+  typedef Eigen::AutoDiffScalar<Eigen::Vector4d> Active4;
+  const size_t index[4] = {Var(6, t - 1), Var(7, t - 1), Var(6, t),
+                           Var(7, t)};
+  Active4 q[4];
+  for (int i = 0; i < 4; i++) {
+    q[i] = Active4(x[index[i]], 4, i);
+  }
+  Active4 r[TrackingCost::RATE_TERMS];
+  RateResiduals(q, r);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      R[i][j] = 0;
+      for (size_t k = 0; k < TrackingCost::RATE_TERMS; k++) {
+        R[i][j] += obj_factor * 2 * r[k].derivatives()[i] *
+                   r[k].derivatives()[j];
+      }
+    }
+  }
+}
+
+template <class Model>
+bool AutoDiffNLP<Model>::eval_jac_g(Index n, const Number* x, bool new_x,
+                                    Index m, Index nele_jac, Index* iRow,
+                                    Index* jCol, Number* values) {
+  size_t k = 0;
+  for (size_t i = 0; i < Model::STATES; i++, k++) {
+    if (values != NULL) {
+      values[k] = 1;
+    } else {
+      iRow[k] = Var(i, 0);
+      jCol[k] = Var(i, 0);
+    }
+  }
+  if (values != NULL && pool_) {
+    pool_->Run(1, N_, [this, x, values](size_t begin, size_t end) {
+      for (size_t t = begin; t < end; t++) {
+        JacobianStage(t, x, jac_offset_[t], NULL, NULL, values);
+      }
+    });
+    return true;
+  }
+  for (size_t t = 1; t < N_; t++) {
+    k = JacobianStage(t, x, k, iRow, jCol, values);
+  }
+  return true;
+}
+
+template <class Model>
+size_t AutoDiffNLP<Model>::JacobianStage(size_t t, const Number* x, size_t k,
+                                         Index* iRow, Index* jCol,
+                                         Number* values) const {
+  double J[Model::STATES][STAGE_VARS];
+  if (values != NULL) {
+    StageJacobian(x, t - 1, J);
+  }
+  for (size_t i = 0; i < Model::STATES; i++, k++) {
+    if (values != NULL) {
+      values[k] = 1;
+    } else {
+      iRow[k] = Var(i, t);
+      jCol[k] = Var(i, t);
+    }
+  }
+  for (const auto& e : jac_entries_) {
+    if (values != NULL) {
+      values[k] = -J[e.first][e.second];
+    } else {
+      iRow[k] = Var(e.first, t);
+      jCol[k] = Var(e.second, t - 1);
+    }
+    k++;
+  }
+  return k;
+}
+
+template <class Model>
+bool AutoDiffNLP<Model>::eval_h(Index n, const Number* x, bool new_x,
+                                Number obj_factor, Index m,
+                                const Number* lambda, bool new_lambda,
+                                Index nele_hess, Index* iRow, Index* jCol,
+                                Number* values) {
+  if (values != NULL && pool_) {
+    pool_->Run(0, N_, [this, x, obj_factor, lambda, values](size_t begin,
+                                                           size_t end) {
+      for (size_t t = begin; t < end; t++) {
+        HessianStage(t, x, obj_factor, lambda, hes_offset_[t], NULL, NULL,
+                     values);
+      }
+    });
+    return true;
+  }
+  size_t k = 0;
+  for (size_t t = 0; t < N_; t++) {
+    k = HessianStage(t, x, obj_factor, lambda, k, iRow, jCol, values);
+  }
+  return true;
+}
+
+template <class Model>
+size_t AutoDiffNLP<Model>::HessianStage(size_t t, const Number* x,
+                                        Number obj_factor,
+                                        const Number* lambda, size_t k,
+                                        Index* iRow, Index* jCol,
+                                        Number* values) const {
+  double H[STAGE_VARS][STAGE_VARS];
+  if (values != NULL) {
+    StageHessian(x, t, obj_factor, lambda, H);
+  }
+  // Variable-major, so stage t's variables are in the order of w and its
+  // block's lower triangle is the Hessian's.
+  for (const auto& e : t + 1 < N_ ? hes_entries_ : last_entries_) {
+    if (values != NULL) {
+      values[k] = H[e.first][e.second];
+    } else {
+      iRow[k] = Var(e.first, t);
+      jCol[k] = Var(e.second, t);
+    }
+    k++;
+  }
+  if (t == 0 || t + 1 >= N_) {
+    return k;
+  }
+  // Duplicates of the stage's entries are summed by Ipopt.
+  double R[4][4];
+  if (values != NULL) {
+    RateHessian(x, t, obj_factor, R);
+  }
+  const size_t index[4] = {Var(6, t - 1), Var(7, t - 1), Var(6, t),
+                           Var(7, t)};
+  for (const auto& e : rate_entries_) {
+    if (values != NULL) {
+      values[k] = R[e.first][e.second];
+    } else {
+      iRow[k] = std::max(index[e.first], index[e.second]);
+      jCol[k] = std::min(index[e.first], index[e.second]);
+    }
+    k++;
+  }
+  return k;
+}
+
+template <class Model>
+void AutoDiffNLP<Model>::Probe() {
+  // Two points where no entry vanishes by chance, in variables, path,
+  // multipliers and stages.
+  std::vector<double> x(n_vars_);
+  std::vector<double> lambda(n_constraints_);
+  bool jac[Model::STATES][STAGE_VARS] = {};
+  bool hes[STAGE_VARS][STAGE_VARS] = {};
+  bool last[STAGE_VARS][STAGE_VARS] = {};
+  bool rate[4][4] = {};
+  for (int point = 0; point < 2; point++) {
+    for (size_t i = 0; i < n_vars_; i++) {
+      x[i] = 1 + 0.5 * sin(double(i) + point);
+    }
+    for (size_t i = 0; i < n_constraints_; i++) {
+      lambda[i] = cos(double(i) + point);
+    }
+    for (size_t i = 0; i < n_params; i++) {
+      params_[i] = 0.3 - 0.1 * i + 0.05 * point;
+    }
+    size_t t = N_ > 2 ? 1 : 0;
+    double J[Model::STATES][STAGE_VARS];
+    double H[STAGE_VARS][STAGE_VARS];
+    double R[4][4];
+    StageJacobian(x.data(), t, J);
+    for (size_t i = 0; i < Model::STATES; i++) {
+      for (int j = 0; j < STAGE_VARS; j++) {
+        jac[i][j] = jac[i][j] || J[i][j] != 0;
+      }
+    }
+    StageHessian(x.data(), t, 1, lambda.data(), H);
+    for (int i = 0; i < STAGE_VARS; i++) {
+      for (int j = 0; j <= i; j++) {
+        hes[i][j] = hes[i][j] || H[i][j] != 0;
+      }
+    }
+    StageHessian(x.data(), N_ - 1, 1, lambda.data(), H);
+    for (int i = 0; i < STAGE_VARS; i++) {
+      for (int j = 0; j <= i; j++) {
+        last[i][j] = last[i][j] || H[i][j] != 0;
+      }
+    }
+    if (N_ > 2) {
+      RateHessian(x.data(), 1, 1, R);
+      for (int i = 0; i < 4; i++) {
+        for (int j = 0; j <= i; j++) {
+          rate[i][j] = rate[i][j] || R[i][j] != 0;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < Model::STATES; i++) {
+    for (int j = 0; j < STAGE_VARS; j++) {
+      if (jac[i][j]) {
+        jac_entries_.push_back(std::make_pair(int(i), j));
+      }
+    }
+  }
+  for (int i = 0; i < STAGE_VARS; i++) {
+    for (int j = 0; j <= i; j++) {
+      if (hes[i][j]) {
+        hes_entries_.push_back(std::make_pair(i, j));
+      }
+      if (last[i][j]) {
+        last_entries_.push_back(std::make_pair(i, j));
+      }
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j <= i; j++) {
+      if (rate[i][j]) {
+        rate_entries_.push_back(std::make_pair(i, j));
+      }
+    }
+  }
+
+  size_t k = Model::STATES;
+  for (size_t t = 1; t < N_; t++) {
+    jac_offset_[t] = k;
+    k += Model::STATES + jac_entries_.size();
+  }
+  nnz_jac_ = k;
+  k = 0;
+  for (size_t t = 0; t < N_; t++) {
+    hes_offset_[t] = k;
+    k += t + 1 < N_ ? hes_entries_.size() : last_entries_.size();
+    if (t > 0 && t + 1 < N_) {
+      k += rate_entries_.size();
+    }
+  }
+  nnz_hes_ = k;
+}
+
+const GeneratedStage* FindGeneratedStage(const MpcConfig& config, double dt) {
+  for (size_t i = 0; i < GENERATED_STAGE_COUNT; i++) {
+    const GeneratedStage& stage = GENERATED_STAGES[i];
+    const Tires& tires = stage.tires;
+    if (stage.model == config.model && stage.integrator == config.integrator &&
+        stage.dt == dt && stage.Lf == config.Lf &&
+        (stage.model != MpcConfig::DYNAMIC ||
+         (tires.mass == config.tires.mass && tires.lr == config.tires.lr &&
+          tires.frontStiffness == config.tires.frontStiffness &&
+          tires.rearStiffness == config.tires.rearStiffness))) {
+      return &stage;
+    }
+  }
+  return NULL;
+}
+
+template class AutoDiffNLP<KinematicModel>;
+template class AutoDiffNLP<DynamicModel>;
+
+KinematicNLPBase* NewAutoDiffNLP(const MpcConfig& config, size_t N,
+                                 double dt) {
+  if (config.integrator == MpcConfig::EXACT) {
+    return NULL;
+  }
+  if (config.model == MpcConfig::DYNAMIC) {
+    return new AutoDiffNLP<DynamicModel>(
+        N, dt, config, DynamicModel(config.Lf, config.tires));
+  }
+  return new AutoDiffNLP<KinematicModel>(N, dt, config,
+                                         KinematicModel(config.Lf));
+}
@@ -0,0 +1,147 @@
+#ifndef AUTODIFF_NLP_H
+#define AUTODIFF_NLP_H
+
+#include <utility>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/AutoDiff"
+#include "GeneratedStages.h"
+#include "KinematicNLP.h"
+#include "MpcConfig.h"
+#include "ProblemPolicies.h"
+
+// The MPC problem of FG_eval with each stage's derivatives taken by Eigen's
+// forward-mode AutoDiffScalar, with no tape.
+//
+// A stage is small: its 8 variables, the state and the actuations, go into
+// the 6 of the next state. With a fixed vector of 8 derivatives, one pass
+// of the model on AutoDiffScalar gives the stage's whole Jacobian block,
+// on the stack and without a sweep or an allocation. The Lagrangian Hessian
+// nests one AutoDiffScalar in another for the stage's 8 x 8 block of
+// lambda' F'', and adds the cost's, 2 J_r' J_r of TrackingCost's residuals,
+// which are linear; with MpcConfig::GAUSS_NEWTON it is the cost's alone.
+//
+// Any Model of ProblemPolicies.h fits, on the EULER, MIDPOINT or RK4
+// integrator. Like KinematicNLP it has the full formulation only, and
+// records the tape as usual, as the reference for CheckDerivatives(). The
+// sparsity patterns are the entries that come out nonzero at two arbitrary
+// points, taken once at construction: every stage has the same ones.
+//
+// With MpcConfig::generatedStages, a stage whose model, integrator and
+// length were generated at build time, see GeneratedStages.h, is evaluated
+// by that straight-line code instead, the cost's terms still by
+// AutoDiffScalar.
+template <class Model>
+class AutoDiffNLP : public KinematicNLPBase {
+ public:
+  // A stage's variables, in their order in the decision vector.
+  static const int STAGE_VARS = Model::STATES + Model::INPUTS;
+  // Path coefficients followed by the initial state.
+  static const size_t n_coeffs = 4;
+  static const size_t n_params = n_coeffs + 6;
+
+  // The first derivatives of a stage, and the second.
+  typedef Eigen::Matrix<double, STAGE_VARS, 1> Derivatives;
+  typedef Eigen::AutoDiffScalar<Derivatives> Active;
+  typedef Eigen::AutoDiffScalar<Eigen::Matrix<Active, STAGE_VARS, 1> >
+      Active2;
+
+  AutoDiffNLP(size_t N, double dt, const MpcConfig& config,
+              const Model& model);
+  virtual ~AutoDiffNLP();
+
+  void SetParameters(const Dvector& params);
+
+  bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                    Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+  bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number& obj_value);
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                   Ipopt::Number* grad_f);
+  bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Index m, Ipopt::Number* g);
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index* iRow,
+                  Ipopt::Index* jCol, Ipopt::Number* values);
+  bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m,
+              const Ipopt::Number* lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol,
+              Ipopt::Number* values);
+
+ private:
+  typedef std::vector<std::pair<int, int> > Entries;
+
+  // The decision vector's index of stage variable i of stage t.
+  size_t Var(int i, size_t t) const;
+  // Stage t's variables from x, its actuations 0 for the last stage.
+  void Gather(const Ipopt::Number* x, size_t t, double* w) const;
+  // The same, seeded as the independent variables of each pass.
+  void Seed(const Ipopt::Number* x, size_t t, Active* w) const;
+  void Seed(const Ipopt::Number* x, size_t t, Active2* w) const;
+
+  // The cost's residuals of stage t's state and actuations, and of the
+  // change of the actuations from stage t - 1's, q being both stages'
+  // [delta, a].
+  template <class Scalar>
+  void StageResiduals(const Scalar* w, bool inputs, Scalar* r) const;
+  template <class Scalar>
+  void RateResiduals(const Scalar* q, Scalar* r) const;
+
+  // Stage t's dense blocks: the Jacobian of StageStep at its variables, the
+  // lower triangle of its Hessian, and that of its rate residuals' over
+  // [delta, a] of stages t - 1 and t.
+  void StageJacobian(const Ipopt::Number* x, size_t t,
+                     double J[Model::STATES][STAGE_VARS]) const;
+  void StageHessian(const Ipopt::Number* x, size_t t, double obj_factor,
+                    const Ipopt::Number* lambda,
+                    double H[STAGE_VARS][STAGE_VARS]) const;
+  void RateHessian(const Ipopt::Number* x, size_t t, double obj_factor,
+                   double R[4][4]) const;
+  // The entries of stage t from the k-th on, the values when given and
+  // else the structure; returns the index past them.
+  size_t JacobianStage(size_t t, const Ipopt::Number* x, size_t k,
+                       Ipopt::Index* iRow, Ipopt::Index* jCol,
+                       Ipopt::Number* values) const;
+  size_t HessianStage(size_t t, const Ipopt::Number* x,
+                      Ipopt::Number obj_factor, const Ipopt::Number* lambda,
+                      size_t k, Ipopt::Index* iRow, Ipopt::Index* jCol,
+                      Ipopt::Number* values) const;
+  // The patterns of the blocks, and the offsets and counts of the entries.
+  void Probe();
+
+  size_t N_;
+  size_t n_vars_;
+  size_t n_constraints_;
+  double dt_;
+  Model model_;
+  TrackingCost cost_;
+  // The integrator's, see StageStep.
+  size_t slopes_;
+  // Whether the Hessian has the constraints' curvature.
+  bool exact_hessian_;
+
+  double params_[n_params];
+  // The (row, column) entries kept of each block: of StageJacobian, of
+  // StageHessian for the stages with dynamics and for the last, and of
+  // RateHessian.
+  Entries jac_entries_;
+  Entries hes_entries_;
+  Entries last_entries_;
+  Entries rate_entries_;
+  size_t nnz_jac_;
+  size_t nnz_hes_;
+  // Index of the first entry of each stage's Jacobian rows (from stage 1)
+  // and Hessian entries.
+  std::vector<size_t> jac_offset_;
+  std::vector<size_t> hes_offset_;
+  // The stage's straight-line code, or NULL for AutoDiffScalar.
+  const GeneratedStage* generated_;
+};
+
+// The AutoDiffNLP of config's model over N stages of dt, or NULL for an
+// integrator it doesn't have.
+KinematicNLPBase* NewAutoDiffNLP(const MpcConfig& config, size_t N,
+                                 double dt);
+
+#endif /* AUTODIFF_NLP_H */
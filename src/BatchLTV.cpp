@@ -0,0 +1,224 @@
+#include "BatchLTV.h"
+#include <algorithm>
+#include <cmath>
+
+// The ADMM settings of LTV.cpp's RICCATI formulation.
+static const double RICCATI_RHO = 0.1;
+static const double RICCATI_ALPHA = 1.6;
+static const double RICCATI_EPS = 1e-4;
+static const int RICCATI_MAX_ITERATIONS = 4000;
+static const int RICCATI_CHECK_INTERVAL = 5;
+static const double RICCATI_RHO_ADAPT_FACTOR = 5;
+
+template <class Scalar, int Lanes>
+BatchLTV<Scalar, Lanes>::BatchLTV(size_t N, double dt, double Lf,
+                                  double ref_v,
+                                  const KinematicWeights& weights)
+    : fixedIterations(0), N_(N), dt_(dt), Lf_(Lf), ref_v_(ref_v),
+      w_(weights), xbar_(Lanes, Matrix::Zero(6, N)),
+      ubar_(Lanes, Matrix::Zero(2, N - 1)), riccati_(N - 1) {
+  std::fill(lastIterations, lastIterations + Lanes, 0);
+  std::fill(lastConverged, lastConverged + Lanes, false);
+  rho_.setConstant(Scalar(RICCATI_RHO));
+  size_t n_u = 2 * (N - 1);
+  lb_ = Controls::Zero(Lanes, n_u);
+  ub_ = Controls::Zero(Lanes, n_u);
+  r_base_ = Controls::Zero(Lanes, n_u);
+  box_ = Controls::Zero(Lanes, n_u);
+  box_dual_ = Controls::Zero(Lanes, n_u);
+
+  // What every lane shares, as LTVMPC::SolveRiccati sets it: the state
+  // costs, the previous control carried in the state, and the rate terms.
+  size_t T = N - 1;
+  const Scalar rate[2] = {Scalar(w_.delta_diff), Scalar(w_.a_diff)};
+  for (size_t k = 1; k <= T; k++) {
+    riccati_.Q[k].col(3 + 8 * 3).setConstant(Scalar(2 * w_.v));
+    riccati_.Q[k].col(4 + 8 * 4).setConstant(Scalar(2 * w_.cte));
+    riccati_.Q[k].col(5 + 8 * 5).setConstant(Scalar(2 * w_.epsi));
+  }
+  for (size_t k = 0; k < T; k++) {
+    for (size_t i = 0; i < 2; i++) {
+      riccati_.B[k].col(6 + i + 8 * i).setOnes();
+      if (k > 0) {
+        riccati_.Q[k].col(6 + i + 8 * (6 + i)).setConstant(2 * rate[i]);
+        riccati_.S[k].col(6 + i + 8 * i).setConstant(-2 * rate[i]);
+      }
+    }
+  }
+}
+
+template <class Scalar, int Lanes>
+void BatchLTV<Scalar, Lanes>::Solve(const State* states, const Cubic* coeffs,
+                                    size_t count) {
+  typedef typename Types::State StateT;
+  typedef typename Types::Input InputT;
+  typedef typename Types::Cubic CubicT;
+  const Scalar magnitude[2] = {Scalar(w_.delta), Scalar(w_.a)};
+  const Scalar rate[2] = {Scalar(w_.delta_diff), Scalar(w_.a_diff)};
+  size_t T = N_ - 1;
+  rho_.setConstant(Scalar(RICCATI_RHO));
+  for (int lane = 0; lane < Lanes; lane++) {
+    size_t problem = std::min(size_t(lane), count - 1);
+    const CubicT c = coeffs[problem].cast<Scalar>();
+    Matrix& xbar = xbar_[lane];
+    Matrix& ubar = ubar_[lane];
+    ubar.setZero();
+    BicycleRollout(StateT(states[problem].cast<Scalar>()), ubar, c, dt_, Lf_,
+                   xbar);
+    typename Types::StateJacobian A;
+    typename Types::InputJacobian B;
+    for (size_t k = 0; k <= T; k++) {
+      if (k > 0) {
+        riccati_.q[k](lane, 3) = 2 * w_.v * (xbar(3, k) - ref_v_);
+        riccati_.q[k](lane, 4) = 2 * w_.cte * xbar(4, k);
+        riccati_.q[k](lane, 5) = 2 * w_.epsi * xbar(5, k);
+      }
+      if (k == T) {
+        break;
+      }
+      StateT s = xbar.col(k);
+      InputT u = ubar.col(k);
+      BicycleLinearize(s, u, c, dt_, Lf_, A, B);
+      // The 6 x 6 and 6 x 2 blocks of the augmented 8 x 8 and 8 x 2.
+      for (int j = 0; j < 6; j++) {
+        for (int i = 0; i < 6; i++) {
+          riccati_.A[k](lane, i + 8 * j) = A(i, j);
+        }
+      }
+      for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 6; i++) {
+          riccati_.B[k](lane, i + 8 * j) = B(i, j);
+        }
+      }
+      for (size_t i = 0; i < 2; i++) {
+        size_t j = 2 * k + i;
+        riccati_.R[k](lane, i + 2 * i) = 2 * magnitude[i] + rho_[lane];
+        r_base_(lane, j) = 2 * magnitude[i] * ubar(i, k);
+        riccati_.q[k](lane, 6 + i) = 0;
+        if (k > 0) {
+          Scalar d = ubar(i, k) - ubar(i, k - 1);
+          riccati_.R[k](lane, i + 2 * i) += 2 * rate[i];
+          r_base_(lane, j) += 2 * rate[i] * d;
+          riccati_.q[k](lane, 6 + i) = -2 * rate[i] * d;
+        }
+        Scalar bound = i == 0 ? Scalar(MAX_DELTA) : Scalar(MAX_A);
+        lb_(lane, j) = -bound - ubar(i, k);
+        ub_(lane, j) = bound - ubar(i, k);
+      }
+    }
+  }
+  riccati_.x0.setZero();
+  uint32_t failed = riccati_.Factorize();
+
+  // ADMM on du = box, as LTVMPC::SolveRiccati's, a lane each. Live lanes
+  // iterate; the others keep their box and multipliers.
+  box_.setZero();
+  box_dual_.setZero();
+  Lane live;
+  for (int lane = 0; lane < Lanes; lane++) {
+    live[lane] = (failed >> lane) & 1 ? 0 : 1;
+    lastIterations[lane] = 0;
+    lastConverged[lane] = false;
+  }
+  int limit = fixedIterations > 0 ? fixedIterations : RICCATI_MAX_ITERATIONS;
+  const Scalar alpha = Scalar(RICCATI_ALPHA);
+  for (int iteration = 1; iteration <= limit && (live > 0).any();
+       iteration++) {
+    for (size_t k = 0; k < T; k++) {
+      for (size_t i = 0; i < 2; i++) {
+        size_t j = 2 * k + i;
+        riccati_.r[k].col(i) =
+            r_base_.col(j) - rho_ * box_.col(j) + box_dual_.col(j);
+      }
+    }
+    riccati_.Solve();
+
+    Lane prim = Lane::Zero();
+    Lane dual = Lane::Zero();
+    Lane prim_scale = Lane::Zero();
+    Lane dual_scale = Lane::Zero();
+    for (size_t k = 0; k < T; k++) {
+      for (size_t i = 0; i < 2; i++) {
+        size_t j = 2 * k + i;
+        Lane u = riccati_.u[k].col(i);
+        Lane relaxed = alpha * u + (1 - alpha) * box_.col(j);
+        Lane next = (relaxed + box_dual_.col(j) / rho_)
+                        .max(lb_.col(j))
+                        .min(ub_.col(j));
+        Lane next_dual = box_dual_.col(j) + rho_ * (relaxed - next);
+        prim = prim.max((u - next).abs());
+        dual = dual.max(rho_ * (next - box_.col(j)).abs());
+        prim_scale = prim_scale.max(u.abs().max(next.abs()));
+        dual_scale = dual_scale.max(next_dual.abs());
+        box_.col(j) = (live > 0).select(next, box_.col(j));
+        box_dual_.col(j) = (live > 0).select(next_dual, box_dual_.col(j));
+      }
+    }
+    bool refactor = false;
+    for (int lane = 0; lane < Lanes; lane++) {
+      if (!(live[lane] > 0)) {
+        continue;
+      }
+      lastIterations[lane] = iteration;
+      lastConverged[lane] =
+          prim[lane] <= RICCATI_EPS + RICCATI_EPS * prim_scale[lane] &&
+          dual[lane] <= RICCATI_EPS + RICCATI_EPS * dual_scale[lane];
+      if (lastConverged[lane] && fixedIterations == 0) {
+        live[lane] = 0;
+        continue;
+      }
+      if (fixedIterations > 0 || iteration % RICCATI_CHECK_INTERVAL != 0) {
+        continue;
+      }
+      double rho = rho_[lane];
+      double ratio = std::sqrt((prim[lane] / (prim_scale[lane] + 1e-10)) /
+                               (dual[lane] / (dual_scale[lane] + 1e-10) +
+                                1e-10));
+      double next = std::min(std::max(rho * ratio, 1e-6), 1e6);
+      if (next > RICCATI_RHO_ADAPT_FACTOR * rho ||
+          next < rho / RICCATI_RHO_ADAPT_FACTOR) {
+        for (size_t k = 0; k < T; k++) {
+          riccati_.R[k](lane, 0) += Scalar(next - rho);
+          riccati_.R[k](lane, 3) += Scalar(next - rho);
+        }
+        rho_[lane] = Scalar(next);
+        refactor = true;
+      }
+    }
+    if (refactor) {
+      riccati_.Factorize();
+    }
+  }
+
+  for (int lane = 0; lane < Lanes; lane++) {
+    Matrix& ubar = ubar_[lane];
+    for (size_t j = 0; j < 2 * T; j++) {
+      ubar(j) += box_(lane, j);
+    }
+    size_t problem = std::min(size_t(lane), count - 1);
+    const CubicT c = coeffs[problem].cast<Scalar>();
+    BicycleRollout(StateT(xbar_[lane].col(0)), ubar, c, dt_, Lf_,
+                   xbar_[lane]);
+  }
+}
+
+template <class Scalar, int Lanes>
+Input BatchLTV<Scalar, Lanes>::First(int lane) const {
+  return ubar_[lane].col(0).template cast<double>();
+}
+
+template <class Scalar, int Lanes>
+size_t BatchLTV<Scalar, Lanes>::Predicted(int lane, double* x, double* y,
+                                          size_t capacity) const {
+  size_t points = std::min(capacity, N_ - 1);
+  for (size_t k = 0; k < points; k++) {
+    x[k] = xbar_[lane](0, k + 1);
+    y[k] = xbar_[lane](1, k + 1);
+  }
+  return points;
+}
+
+template class BatchLTV<double, 4>;
+template class BatchLTV<double, 8>;
+template class BatchLTV<float, 8>;
+template class BatchLTV<float, 16>;
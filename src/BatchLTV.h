@@ -0,0 +1,76 @@
+#ifndef BATCH_LTV_H
+#define BATCH_LTV_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "BatchRiccati.h"
+#include "BicycleModel.h"
+
+// LTVMPC's RICCATI formulation for Lanes vehicles at once, on BatchRiccati:
+// the batch's problems, one a lane, go through the ADMM iterations in
+// lockstep, each iteration one Riccati solve for all of them. A lane that
+// meets the tolerances is frozen, its iterate and multipliers kept, while
+// the others go on; rho is adapted per lane, and a change of any lane's
+// refactorizes the batch. The bounds, their multipliers and the stage costs
+// are lane-interleaved like BatchRiccati's data, so that ADMM's updates are
+// vector operations too; the rollouts and linearizations, trigonometry a
+// lane at a time, are not.
+//
+// Every problem starts cold, from zero controls and multipliers, so that its
+// answer is that of a new LTVMPC's first solve, whichever problems share
+// its batch, up to rounding. Instantiated in BatchLTV.cpp for the lanes of
+// BatchRiccati.
+template <class Scalar, int Lanes>
+class BatchLTV {
+ public:
+  static const int LANES = Lanes;
+
+  BatchLTV(size_t N, double dt, double Lf, double ref_v,
+           const KinematicWeights& weights);
+
+  // As LTVMPC's.
+  int fixedIterations;
+
+  // Solve `count` problems, at most Lanes, problem i in lane i. Spare lanes
+  // repeat the last problem.
+  void Solve(const State* states, const Cubic* coeffs, size_t count);
+
+  // Lane `lane`'s first actuations {delta, a}, and its predicted
+  // trajectory, at most `capacity` points into x and y; returns the points.
+  Input First(int lane) const;
+  size_t Predicted(int lane, double* x, double* y, size_t capacity) const;
+
+  // Each lane's ADMM iterations in the last Solve, and whether it met the
+  // tolerances.
+  int lastIterations[Lanes];
+  bool lastConverged[Lanes];
+
+ private:
+  typedef BatchRiccati<8, 2, Scalar, Lanes> Riccati;
+  typedef typename Riccati::Lane Lane;
+  typedef BicycleTypes<Scalar> Types;
+  typedef typename Types::Matrix Matrix;
+  // Lanes x 2 (N - 1): one column a control, stacked by stage.
+  typedef Eigen::Array<Scalar, Lanes, Eigen::Dynamic> Controls;
+
+  size_t N_;
+  Scalar dt_;
+  Scalar Lf_;
+  Scalar ref_v_;
+  KinematicWeights w_;
+  std::vector<Matrix> xbar_;
+  std::vector<Matrix> ubar_;
+  Riccati riccati_;
+  Lane rho_;
+  // As LTVMPC's, a row a lane.
+  Controls lb_;
+  Controls ub_;
+  Controls r_base_;
+  Controls box_;
+  Controls box_dual_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* BATCH_LTV_H */
@@ -0,0 +1,68 @@
+#include "BatchRiccati.h"
+#include "SimdKernels.h"
+
+template <int NX, int NU, class Scalar, int Lanes>
+BatchRiccati<NX, NU, Scalar, Lanes>::BatchRiccati(size_t stages) : T_(0) {
+  Resize(stages);
+}
+
+template <int NX, int NU, class Scalar, int Lanes>
+void BatchRiccati<NX, NU, Scalar, Lanes>::Resize(size_t stages) {
+  T_ = stages;
+  A.assign(T_, StateBlock::Zero());
+  B.assign(T_, CrossBlock::Zero());
+  Q.assign(T_ + 1, StateBlock::Zero());
+  S.assign(T_, CrossBlock::Zero());
+  R.assign(T_, InputBlock::Zero());
+  q.assign(T_ + 1, StateLanes::Zero());
+  r.assign(T_, InputLanes::Zero());
+  x0.setZero();
+  x.assign(T_ + 1, StateLanes::Zero());
+  u.assign(T_, InputLanes::Zero());
+  P_.assign(T_ + 1, StateBlock::Zero());
+  K_.assign(T_, GainBlock::Zero());
+  L_.assign(T_, InputBlock::Zero());
+  p_.assign(T_ + 1, StateLanes::Zero());
+  k_.assign(T_, InputLanes::Zero());
+}
+
+// The kernels of the instruction set chosen, by scalar and lanes.
+static uint32_t Factorize(BatchRiccati<8, 2, double, 4>& riccati) {
+  return Kernels().batchRiccatiFactorize4(riccati);
+}
+static uint32_t Factorize(BatchRiccati<8, 2, double, 8>& riccati) {
+  return Kernels().batchRiccatiFactorize8(riccati);
+}
+static uint32_t Factorize(BatchRiccati<8, 2, float, 8>& riccati) {
+  return Kernels().batchRiccatiFactorizeFloat8(riccati);
+}
+static uint32_t Factorize(BatchRiccati<8, 2, float, 16>& riccati) {
+  return Kernels().batchRiccatiFactorizeFloat16(riccati);
+}
+static void Solve(BatchRiccati<8, 2, double, 4>& riccati) {
+  Kernels().batchRiccatiSolve4(riccati);
+}
+static void Solve(BatchRiccati<8, 2, double, 8>& riccati) {
+  Kernels().batchRiccatiSolve8(riccati);
+}
+static void Solve(BatchRiccati<8, 2, float, 8>& riccati) {
+  Kernels().batchRiccatiSolveFloat8(riccati);
+}
+static void Solve(BatchRiccati<8, 2, float, 16>& riccati) {
+  Kernels().batchRiccatiSolveFloat16(riccati);
+}
+
+template <int NX, int NU, class Scalar, int Lanes>
+uint32_t BatchRiccati<NX, NU, Scalar, Lanes>::Factorize() {
+  return ::Factorize(*this);
+}
+
+template <int NX, int NU, class Scalar, int Lanes>
+void BatchRiccati<NX, NU, Scalar, Lanes>::Solve() {
+  ::Solve(*this);
+}
+
+template class BatchRiccati<8, 2, double, 4>;
+template class BatchRiccati<8, 2, double, 8>;
+template class BatchRiccati<8, 2, float, 8>;
+template class BatchRiccati<8, 2, float, 16>;
@@ -0,0 +1,106 @@
+#ifndef BATCH_RICCATI_H
+#define BATCH_RICCATI_H
+
+#include <cstdint>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+// The recursions of BatchRiccati::Factorize and Solve, built for each
+// instruction set in SimdKernels.cpp.
+template <int Isa, class R>
+uint32_t BatchRiccatiFactorize(R& riccati);
+template <int Isa, class R>
+void BatchRiccatiSolve(R& riccati);
+
+// Riccati's LQ problem for Lanes vehicles at once, all of the same shape:
+// the problems are interleaved across SIMD lanes, so that every operation of
+// the recursions is one vector instruction over the batch where Riccati's,
+// on 8 x 8 and 8 x 2 blocks, leave most of each vector idle.
+//
+// The storage is a structure of arrays: a block is a Lanes x (rows * cols)
+// array whose column i + rows * j holds entry (i, j) of every lane, and a
+// vector a Lanes x size array, so that each entry of the batch is a
+// contiguous, aligned run of Lanes scalars. Put and Get move one lane's
+// block or vector in and out.
+//
+// BatchRiccati.cpp instantiates NX = 8, NU = 2 with 4 and 8 lanes of double
+// and 8 and 16 of float: a vector of AVX2 and of AVX-512, and two of
+// either. The recursions run in the widest instruction set the CPU has, see
+// SimdKernels.h; narrower vectors take a lane group in several. A lane whose
+// R_k + B_k' P_{k+1} B_k isn't positive definite gets NaNs, in its lane
+// only.
+template <int NX, int NU, class Scalar, int Lanes>
+class BatchRiccati {
+ public:
+  typedef Eigen::Array<Scalar, Lanes, NX * NX> StateBlock;
+  typedef Eigen::Array<Scalar, Lanes, NX * NU> CrossBlock;
+  typedef Eigen::Array<Scalar, Lanes, NU * NU> InputBlock;
+  typedef Eigen::Array<Scalar, Lanes, NU * NX> GainBlock;
+  typedef Eigen::Array<Scalar, Lanes, NX> StateLanes;
+  typedef Eigen::Array<Scalar, Lanes, NU> InputLanes;
+  // An entry of every lane.
+  typedef Eigen::Array<Scalar, Lanes, 1> Lane;
+  static const int LANES = Lanes;
+
+  explicit BatchRiccati(size_t stages = 0);
+
+  // Size for T = `stages` controls, zeroing the problem data.
+  void Resize(size_t stages);
+
+  // Problem data, as Riccati's: A, B, S, R, r have T entries; Q and q have
+  // T + 1.
+  std::vector<StateBlock, Eigen::aligned_allocator<StateBlock> > A;
+  std::vector<CrossBlock, Eigen::aligned_allocator<CrossBlock> > B;
+  std::vector<StateBlock, Eigen::aligned_allocator<StateBlock> > Q;
+  std::vector<CrossBlock, Eigen::aligned_allocator<CrossBlock> > S;
+  std::vector<InputBlock, Eigen::aligned_allocator<InputBlock> > R;
+  std::vector<StateLanes, Eigen::aligned_allocator<StateLanes> > q;
+  std::vector<InputLanes, Eigen::aligned_allocator<InputLanes> > r;
+  StateLanes x0;
+
+  // Lane `lane` of a block or vector from a matrix of its shape, and back.
+  template <class Block, class Matrix>
+  static void Put(Block& block, int lane, const Matrix& m) {
+    for (int j = 0; j < m.cols(); j++) {
+      for (int i = 0; i < m.rows(); i++) {
+        block(lane, i + m.rows() * j) = m(i, j);
+      }
+    }
+  }
+  template <class Block, class Matrix>
+  static void Get(const Block& block, int lane, Matrix& m) {
+    for (int j = 0; j < m.cols(); j++) {
+      for (int i = 0; i < m.rows(); i++) {
+        m(i, j) = block(lane, i + m.rows() * j);
+      }
+    }
+  }
+
+  // Backward recursion on the matrices. Returns the lanes, a bit each,
+  // whose R_k + B_k' P_{k+1} B_k isn't positive definite: 0 if all are.
+  uint32_t Factorize();
+
+  // Backward recursion on the linear terms and forward rollout into x and u.
+  void Solve();
+
+  // Solution: T + 1 states and T controls.
+  std::vector<StateLanes, Eigen::aligned_allocator<StateLanes> > x;
+  std::vector<InputLanes, Eigen::aligned_allocator<InputLanes> > u;
+
+ private:
+  template <int Isa, class R>
+  friend uint32_t BatchRiccatiFactorize(R& riccati);
+  template <int Isa, class R>
+  friend void BatchRiccatiSolve(R& riccati);
+
+  size_t T_;
+  std::vector<StateBlock, Eigen::aligned_allocator<StateBlock> > P_;
+  std::vector<GainBlock, Eigen::aligned_allocator<GainBlock> > K_;
+  // The Cholesky factor of R_k + B_k' P_{k+1} B_k, lower, with the
+  // reciprocals of its pivots on the diagonal.
+  std::vector<InputBlock, Eigen::aligned_allocator<InputBlock> > L_;
+  std::vector<StateLanes, Eigen::aligned_allocator<StateLanes> > p_;
+  std::vector<InputLanes, Eigen::aligned_allocator<InputLanes> > k_;
+};
+
+#endif /* BATCH_RICCATI_H */
@@ -0,0 +1,323 @@
+#include "BicycleAtomic.h"
+#include <algorithm>
+#include <cmath>
+
+typedef BicycleAtomic B;
+
+// The nonzero first derivatives of the step, {result, argument}: BicycleStep
+// through the path coefficients as well, for they may be dynamic parameters.
+// dt and Lf enter every result but are constants.
+static const int JACOBIAN[][2] = {
+    {0, B::X}, {0, B::PSI}, {0, B::V},
+    {1, B::Y}, {1, B::PSI}, {1, B::V},
+    {2, B::PSI}, {2, B::V}, {2, B::DELTA},
+    {3, B::V}, {3, B::A},
+    {4, B::X}, {4, B::Y}, {4, B::V}, {4, B::EPSI},
+    {4, B::C0}, {4, B::C1}, {4, B::C2}, {4, B::C3},
+    {5, B::X}, {5, B::PSI}, {5, B::V}, {5, B::DELTA},
+    {5, B::C1}, {5, B::C2}, {5, B::C3}};
+static const size_t JACOBIAN_SIZE = sizeof(JACOBIAN) / sizeof(JACOBIAN[0]);
+
+// Every result depends on dt, the turning ones on Lf too.
+static const int CONSTANTS[][2] = {{0, B::DT}, {1, B::DT}, {2, B::DT},
+                                   {2, B::LF}, {3, B::DT}, {4, B::DT},
+                                   {5, B::DT}, {5, B::LF}};
+static const size_t CONSTANTS_SIZE = sizeof(CONSTANTS) / sizeof(CONSTANTS[0]);
+
+// The nonzero second derivatives, {result, argument, argument} with the
+// first argument no later than the second.
+static const int HESSIAN[][3] = {
+    {0, B::PSI, B::PSI}, {0, B::PSI, B::V},
+    {1, B::PSI, B::PSI}, {1, B::PSI, B::V},
+    {2, B::V, B::DELTA},
+    {4, B::X, B::X}, {4, B::X, B::C1}, {4, B::X, B::C2}, {4, B::X, B::C3},
+    {4, B::V, B::EPSI}, {4, B::EPSI, B::EPSI},
+    {5, B::X, B::X}, {5, B::X, B::C1}, {5, B::X, B::C2}, {5, B::X, B::C3},
+    {5, B::C1, B::C1}, {5, B::C1, B::C2}, {5, B::C1, B::C3},
+    {5, B::C2, B::C2}, {5, B::C2, B::C3}, {5, B::C3, B::C3},
+    {5, B::V, B::DELTA}};
+static const size_t HESSIAN_SIZE = sizeof(HESSIAN) / sizeof(HESSIAN[0]);
+
+// The path and the derivatives of its slope in (x, c1, c2, c3), which
+// cte and epsi go through.
+struct Path {
+  explicit Path(const double* u) {
+    double x = u[B::X];
+    f = u[B::C0] + x * (u[B::C1] + x * (u[B::C2] + x * u[B::C3]));
+    df = u[B::C1] + x * (2 * u[B::C2] + x * 3 * u[B::C3]);
+    d2f = 2 * u[B::C2] + 6 * u[B::C3] * x;
+    slope[0] = d2f;
+    slope[1] = 1;
+    slope[2] = 2 * x;
+    slope[3] = 3 * x * x;
+    q = 1 + df * df;
+  }
+
+  double f;
+  double df;
+  double d2f;
+  // d df / d(x, c1, c2, c3).
+  double slope[4];
+  double q;
+};
+
+static const int SLOPE_ARGUMENTS[4] = {B::X, B::C1, B::C2, B::C3};
+
+static void Step(const double* u, double* y) {
+  Path p(u);
+  double dt = u[B::DT];
+  double turn = u[B::V] * u[B::DELTA] / u[B::LF] * dt;
+  y[0] = u[B::X] + u[B::V] * cos(u[B::PSI]) * dt;
+  y[1] = u[B::Y] + u[B::V] * sin(u[B::PSI]) * dt;
+  y[2] = u[B::PSI] + turn;
+  y[3] = u[B::V] + u[B::A] * dt;
+  y[4] = (p.f - u[B::Y]) + u[B::V] * sin(u[B::EPSI]) * dt;
+  y[5] = (u[B::PSI] - atan(p.df)) + turn;
+}
+
+// J[i][j] = d y_i / d u_j, but for dt and Lf.
+static void Jacobian(const double* u, double J[B::RESULTS][B::ARGUMENTS]) {
+  Path p(u);
+  double dt = u[B::DT];
+  double v = u[B::V];
+  std::fill(&J[0][0], &J[0][0] + B::RESULTS * B::ARGUMENTS, 0.);
+  J[0][B::X] = 1;
+  J[0][B::PSI] = -v * sin(u[B::PSI]) * dt;
+  J[0][B::V] = cos(u[B::PSI]) * dt;
+
+  J[1][B::Y] = 1;
+  J[1][B::PSI] = v * cos(u[B::PSI]) * dt;
+  J[1][B::V] = sin(u[B::PSI]) * dt;
+
+  J[2][B::PSI] = 1;
+  J[2][B::V] = u[B::DELTA] / u[B::LF] * dt;
+  J[2][B::DELTA] = v / u[B::LF] * dt;
+
+  J[3][B::V] = 1;
+  J[3][B::A] = dt;
+
+  double x = u[B::X];
+  J[4][B::X] = p.df;
+  J[4][B::Y] = -1;
+  J[4][B::V] = sin(u[B::EPSI]) * dt;
+  J[4][B::EPSI] = v * cos(u[B::EPSI]) * dt;
+  J[4][B::C0] = 1;
+  J[4][B::C1] = x;
+  J[4][B::C2] = x * x;
+  J[4][B::C3] = x * x * x;
+
+  J[5][B::PSI] = 1;
+  J[5][B::V] = J[2][B::V];
+  J[5][B::DELTA] = J[2][B::DELTA];
+  for (int k = 0; k < 4; k++) {
+    J[5][SLOPE_ARGUMENTS[k]] = -p.slope[k] / p.q;
+  }
+}
+
+// H = sum_i w_i d^2 y_i / du^2, but for dt and Lf.
+static void Hessian(const double* u, const double* w,
+                    double H[B::ARGUMENTS][B::ARGUMENTS]) {
+  Path p(u);
+  double dt = u[B::DT];
+  double v = u[B::V];
+  double c = cos(u[B::PSI]);
+  double s = sin(u[B::PSI]);
+  std::fill(&H[0][0], &H[0][0] + B::ARGUMENTS * B::ARGUMENTS, 0.);
+  H[B::PSI][B::PSI] = -(w[0] * c + w[1] * s) * v * dt;
+  H[B::PSI][B::V] = (-w[0] * s + w[1] * c) * dt;
+  H[B::V][B::DELTA] = (w[2] + w[5]) / u[B::LF] * dt;
+
+  H[B::X][B::X] = w[4] * p.d2f;
+  H[B::X][B::C1] = w[4];
+  H[B::X][B::C2] = w[4] * 2 * u[B::X];
+  H[B::X][B::C3] = w[4] * 3 * u[B::X] * u[B::X];
+  H[B::V][B::EPSI] = w[4] * cos(u[B::EPSI]) * dt;
+  H[B::EPSI][B::EPSI] = -w[4] * v * sin(u[B::EPSI]) * dt;
+
+  // -atan(df): d2 = -(d slope_j / d u_k) / q + 2 df slope_j slope_k / q^2,
+  // where the slope's own derivatives are 6 c3, 2 and 6 x, all along x.
+  double curve[4][4] = {{6 * u[B::C3], 0, 2, 6 * u[B::X]},
+                        {0, 0, 0, 0},
+                        {2, 0, 0, 0},
+                        {6 * u[B::X], 0, 0, 0}};
+  for (int j = 0; j < 4; j++) {
+    for (int k = j; k < 4; k++) {
+      H[SLOPE_ARGUMENTS[j]][SLOPE_ARGUMENTS[k]] +=
+          w[5] * (-curve[j][k] / p.q +
+                  2 * p.df * p.slope[j] * p.slope[k] / (p.q * p.q));
+    }
+  }
+
+  for (int j = 0; j < B::ARGUMENTS; j++) {
+    for (int k = 0; k < j; k++) {
+      H[j][k] = H[k][j];
+    }
+  }
+}
+
+BicycleAtomic::BicycleAtomic() : CppAD::atomic_three<double>("bicycle_step") {}
+
+static BicycleAtomic instance;
+
+BicycleAtomic& BicycleAtomic::Instance() { return instance; }
+
+bool BicycleAtomic::for_type(const Dvector& parameter_x,
+                             const Tvector& type_x, Tvector& type_y) {
+  if (type_x[DT] != CppAD::constant_enum ||
+      type_x[LF] != CppAD::constant_enum) {
+    return false;
+  }
+  for (size_t i = 0; i < RESULTS; i++) {
+    type_y[i] = CppAD::constant_enum;
+  }
+  for (size_t k = 0; k < JACOBIAN_SIZE; k++) {
+    size_t i = JACOBIAN[k][0];
+    type_y[i] = std::max(type_y[i], type_x[JACOBIAN[k][1]]);
+  }
+  return true;
+}
+
+bool BicycleAtomic::forward(const Dvector& parameter_x,
+                            const Tvector& type_x, size_t need_y,
+                            size_t order_low, size_t order_up,
+                            const Dvector& taylor_x, Dvector& taylor_y) {
+  if (order_up > 1) {
+    return false;
+  }
+  size_t q = order_up + 1;
+  double u[ARGUMENTS];
+  for (size_t j = 0; j < ARGUMENTS; j++) {
+    u[j] = taylor_x[j * q];
+  }
+  if (order_low == 0) {
+    double y[RESULTS];
+    Step(u, y);
+    for (size_t i = 0; i < RESULTS; i++) {
+      taylor_y[i * q] = y[i];
+    }
+  }
+  if (order_up == 1) {
+    double J[RESULTS][ARGUMENTS];
+    Jacobian(u, J);
+    for (size_t i = 0; i < RESULTS; i++) {
+      double dy = 0;
+      for (size_t j = 0; j < ARGUMENTS; j++) {
+        dy += J[i][j] * taylor_x[j * q + 1];
+      }
+      taylor_y[i * q + 1] = dy;
+    }
+  }
+  return true;
+}
+
+// The first order coefficients are y' = J u', whose partials are J^T for u'
+// and the Hessian weighted by the partials of y' along u' for u.
+bool BicycleAtomic::reverse(const Dvector& parameter_x,
+                            const Tvector& type_x, size_t order_up,
+                            const Dvector& taylor_x, const Dvector& taylor_y,
+                            Dvector& partial_x, const Dvector& partial_y) {
+  if (order_up > 1) {
+    return false;
+  }
+  size_t q = order_up + 1;
+  double u[ARGUMENTS];
+  for (size_t j = 0; j < ARGUMENTS; j++) {
+    u[j] = taylor_x[j * q];
+  }
+  double J[RESULTS][ARGUMENTS];
+  Jacobian(u, J);
+  for (size_t j = 0; j < ARGUMENTS; j++) {
+    for (size_t k = 0; k < q; k++) {
+      double px = 0;
+      for (size_t i = 0; i < RESULTS; i++) {
+        px += J[i][j] * partial_y[i * q + k];
+      }
+      partial_x[j * q + k] = px;
+    }
+  }
+  if (order_up == 1) {
+    double w[RESULTS];
+    for (size_t i = 0; i < RESULTS; i++) {
+      w[i] = partial_y[i * q + 1];
+    }
+    double H[ARGUMENTS][ARGUMENTS];
+    Hessian(u, w, H);
+    for (size_t j = 0; j < ARGUMENTS; j++) {
+      for (size_t k = 0; k < ARGUMENTS; k++) {
+        partial_x[j * q] += H[j][k] * taylor_x[k * q + 1];
+      }
+    }
+  }
+  return true;
+}
+
+bool BicycleAtomic::jac_sparsity(const Dvector& parameter_x,
+                                 const Tvector& type_x, bool dependency,
+                                 const Bvector& select_x,
+                                 const Bvector& select_y,
+                                 Pattern& pattern_out) {
+  size_t n_constants = dependency ? CONSTANTS_SIZE : 0;
+  for (int pass = 0; pass < 2; pass++) {
+    size_t nnz = 0;
+    for (size_t k = 0; k < JACOBIAN_SIZE + n_constants; k++) {
+      const int* entry =
+          k < JACOBIAN_SIZE ? JACOBIAN[k] : CONSTANTS[k - JACOBIAN_SIZE];
+      if (select_y[entry[0]] && select_x[entry[1]]) {
+        if (pass == 1) {
+          pattern_out.set(nnz, entry[0], entry[1]);
+        }
+        nnz++;
+      }
+    }
+    if (pass == 0) {
+      pattern_out.resize(RESULTS, ARGUMENTS, nnz);
+    }
+  }
+  return true;
+}
+
+bool BicycleAtomic::hes_sparsity(const Dvector& parameter_x,
+                                 const Tvector& type_x,
+                                 const Bvector& select_x,
+                                 const Bvector& select_y,
+                                 Pattern& pattern_out) {
+  // The union over the selected results, in both triangles.
+  bool nonzero[ARGUMENTS][ARGUMENTS] = {};
+  for (size_t k = 0; k < HESSIAN_SIZE; k++) {
+    int j = HESSIAN[k][1];
+    int l = HESSIAN[k][2];
+    if (select_y[HESSIAN[k][0]] && select_x[j] && select_x[l]) {
+      nonzero[j][l] = nonzero[l][j] = true;
+    }
+  }
+  size_t nnz = 0;
+  for (size_t j = 0; j < ARGUMENTS; j++) {
+    nnz += std::count(nonzero[j], nonzero[j] + ARGUMENTS, true);
+  }
+  pattern_out.resize(ARGUMENTS, ARGUMENTS, nnz);
+  size_t k = 0;
+  for (size_t j = 0; j < ARGUMENTS; j++) {
+    for (size_t l = 0; l < ARGUMENTS; l++) {
+      if (nonzero[j][l]) {
+        pattern_out.set(k++, j, l);
+      }
+    }
+  }
+  return true;
+}
+
+bool BicycleAtomic::rev_depend(const Dvector& parameter_x,
+                               const Tvector& type_x, Bvector& depend_x,
+                               const Bvector& depend_y) {
+  for (size_t j = 0; j < ARGUMENTS; j++) {
+    depend_x[j] = false;
+  }
+  for (size_t k = 0; k < JACOBIAN_SIZE + CONSTANTS_SIZE; k++) {
+    const int* entry =
+        k < JACOBIAN_SIZE ? JACOBIAN[k] : CONSTANTS[k - JACOBIAN_SIZE];
+    if (depend_y[entry[0]]) {
+      depend_x[entry[1]] = true;
+    }
+  }
+  return true;
+}
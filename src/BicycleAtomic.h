@@ -0,0 +1,59 @@
+#ifndef BICYCLE_ATOMIC_H
+#define BICYCLE_ATOMIC_H
+
+#include <cppad/cppad.hpp>
+
+// One Euler step of the bicycle model as a CppAD atomic function, so that
+// FG_eval can tape each stage's dynamics as a single operation instead of the
+// two dozen the six-line update takes.
+//
+// The tape then no longer grows with the model's operations, and sparsity
+// detection starts from the stage pattern written out in BicycleAtomic.cpp
+// instead of rediscovering it N - 1 times. The derivatives are the closed
+// forms of BicycleStep, up to the first order forward and the second order
+// reverse sweeps that sparse_jac_for and sparse_hes use.
+//
+// ax is [x, y, psi, v, epsi, delta, a, c0, c1, c2, c3, dt, Lf], the state
+// of the stage (cte does not enter the update), its actuations, the path
+// coefficients and the model constants, and ay the next state but cte's
+// [x, y, psi, v, cte, epsi]. dt and Lf must be constants; the coefficients
+// may be dynamic parameters.
+class BicycleAtomic : public CppAD::atomic_three<double> {
+ public:
+  enum Argument { X, Y, PSI, V, EPSI, DELTA, A, C0, C1, C2, C3, DT, LF,
+                  ARGUMENTS };
+  static const size_t RESULTS = 6;
+
+  BicycleAtomic();
+
+  // The one instance, constructed before main() as CppAD requires of atomic
+  // functions used in parallel. It keeps no state between calls.
+  static BicycleAtomic& Instance();
+
+ private:
+  typedef CppAD::vector<double> Dvector;
+  typedef CppAD::vector<CppAD::ad_type_enum> Tvector;
+  typedef CppAD::vector<bool> Bvector;
+  typedef CppAD::sparse_rc<CppAD::vector<size_t> > Pattern;
+
+  bool for_type(const Dvector& parameter_x, const Tvector& type_x,
+                Tvector& type_y);
+  bool forward(const Dvector& parameter_x, const Tvector& type_x,
+               size_t need_y, size_t order_low, size_t order_up,
+               const Dvector& taylor_x, Dvector& taylor_y);
+  bool reverse(const Dvector& parameter_x, const Tvector& type_x,
+               size_t order_up, const Dvector& taylor_x,
+               const Dvector& taylor_y, Dvector& partial_x,
+               const Dvector& partial_y);
+  bool jac_sparsity(const Dvector& parameter_x, const Tvector& type_x,
+                    bool dependency, const Bvector& select_x,
+                    const Bvector& select_y, Pattern& pattern_out);
+  bool hes_sparsity(const Dvector& parameter_x, const Tvector& type_x,
+                    const Bvector& select_x, const Bvector& select_y,
+                    Pattern& pattern_out);
+  // For optimize(): which arguments the used results depend on.
+  bool rev_depend(const Dvector& parameter_x, const Tvector& type_x,
+                  Bvector& depend_x, const Bvector& depend_y);
+};
+
+#endif /* BICYCLE_ATOMIC_H */
@@ -0,0 +1,204 @@
+#ifndef BICYCLE_MODEL_H
+#define BICYCLE_MODEL_H
+
+#include <cmath>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Polynomial.h"
+
+// The kinematic bicycle model of FG_eval, for the solvers that work on
+// numbers rather than on a CppAD tape.
+//
+// State: [x, y, psi, v, cte, epsi], input: [delta, a]. The path is the cubic
+// y = coeffs[0] + coeffs[1] * x + coeffs[2] * x^2 + coeffs[3] * x^3.
+//
+// These are fixed-size vectorizable types: members of them need
+// EIGEN_MAKE_ALIGNED_OPERATOR_NEW in the class, and containers of them
+// Eigen::aligned_allocator, as in States and Cubics.
+//
+// The functions on them are templates on the scalar, for LTVMPC in single
+// precision (see Precision.h); the typedefs below are double's.
+template <class Scalar>
+struct BicycleTypes {
+  // Scalar, for the arguments it isn't deduced from.
+  typedef Scalar Real;
+  typedef Eigen::Matrix<Scalar, 6, 1> State;
+  typedef Eigen::Matrix<Scalar, 2, 1> Input;
+  typedef Eigen::Matrix<Scalar, 4, 1> Cubic;
+  typedef Eigen::Matrix<Scalar, 6, 6> StateJacobian;
+  typedef Eigen::Matrix<Scalar, 6, 2> InputJacobian;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+};
+typedef BicycleTypes<double>::State State;
+typedef BicycleTypes<double>::Input Input;
+typedef BicycleTypes<double>::Cubic Cubic;
+typedef BicycleTypes<double>::StateJacobian StateJacobian;
+typedef BicycleTypes<double>::InputJacobian InputJacobian;
+typedef std::vector<State, Eigen::aligned_allocator<State> > States;
+typedef std::vector<Cubic, Eigen::aligned_allocator<Cubic> > Cubics;
+
+// Cost coefficients, in the order of the terms in FG_eval.
+struct KinematicWeights {
+  double cte;
+  double epsi;
+  double v;
+  double delta;
+  double a;
+  double delta_diff;
+  double a_diff;
+};
+
+// The tires of DynamicModel, see ProblemPolicies.h: the car's mass in kg,
+// its center of gravity lr meters ahead of the rear axle, and the cornering
+// stiffness of the front and rear axles in N/rad.
+struct Tires {
+  double mass;
+  double lr;
+  double frontStiffness;
+  double rearStiffness;
+};
+
+// Actuator limits: steering in radians, and normalized throttle.
+static const double MAX_DELTA = 25. / 180 * M_PI;
+static const double MAX_A = 1.;
+
+// The state Solve starts from: the car's, in its own frame and on the path
+// with cross track error cte and orientation error epsi, moved on by
+// `latency` seconds of the model holding the last actuations delta and a.
+inline State PredictState(double v, double delta, double a, double cte,
+                          double epsi, double Lf, double latency) {
+  State s;
+  s << v * latency, 0, -v * delta / Lf * latency, v + a * latency,
+      cte + v * sin(epsi) * latency, epsi - v * delta / Lf * latency;
+  return s;
+}
+
+// One Euler step of length dt. The scalar is the state's; the other
+// arguments convert to it.
+template <class Scalar>
+inline typename BicycleTypes<Scalar>::State BicycleStep(
+    const Eigen::Matrix<Scalar, 6, 1>& s,
+    const typename BicycleTypes<Scalar>::Input& u,
+    const typename BicycleTypes<Scalar>::Cubic& coeffs,
+    typename BicycleTypes<Scalar>::Real dt,
+    typename BicycleTypes<Scalar>::Real Lf) {
+  using std::atan;
+  using std::cos;
+  using std::sin;
+  Scalar x = s[0];
+  Scalar f = PolyEval<3>(coeffs, x);
+  Scalar df = PolyEval<3, 1>(coeffs, x);
+  typename BicycleTypes<Scalar>::State next;
+  next[0] = s[0] + s[3] * cos(s[2]) * dt;
+  next[1] = s[1] + s[3] * sin(s[2]) * dt;
+  next[2] = s[2] + s[3] * u[0] / Lf * dt;
+  next[3] = s[3] + u[1] * dt;
+  next[4] = (f - s[1]) + s[3] * sin(s[5]) * dt;
+  next[5] = (s[2] - atan(df)) + s[3] * u[0] / Lf * dt;
+  return next;
+}
+
+// Jacobians of BicycleStep with respect to the state (A) and input (B).
+template <class Scalar>
+inline void BicycleLinearize(
+    const Eigen::Matrix<Scalar, 6, 1>& s,
+    const typename BicycleTypes<Scalar>::Input& u,
+    const typename BicycleTypes<Scalar>::Cubic& coeffs,
+    typename BicycleTypes<Scalar>::Real dt,
+    typename BicycleTypes<Scalar>::Real Lf,
+    typename BicycleTypes<Scalar>::StateJacobian& A,
+    typename BicycleTypes<Scalar>::InputJacobian& B) {
+  using std::cos;
+  using std::sin;
+  Scalar x = s[0];
+  Scalar df = PolyEval<3, 1>(coeffs, x);
+  Scalar d2f = PolyEval<3, 2>(coeffs, x);
+  A.setZero();
+  B.setZero();
+
+  A(0, 0) = 1;
+  A(0, 2) = -s[3] * sin(s[2]) * dt;
+  A(0, 3) = cos(s[2]) * dt;
+
+  A(1, 1) = 1;
+  A(1, 2) = s[3] * cos(s[2]) * dt;
+  A(1, 3) = sin(s[2]) * dt;
+
+  A(2, 2) = 1;
+  A(2, 3) = u[0] / Lf * dt;
+  B(2, 0) = s[3] / Lf * dt;
+
+  A(3, 3) = 1;
+  B(3, 1) = dt;
+
+  A(4, 0) = df;
+  A(4, 1) = -1;
+  A(4, 3) = sin(s[5]) * dt;
+  A(4, 5) = s[3] * cos(s[5]) * dt;
+
+  A(5, 0) = -d2f / (1 + df * df);
+  A(5, 2) = 1;
+  A(5, 3) = u[0] / Lf * dt;
+  B(5, 0) = s[3] / Lf * dt;
+}
+
+// Roll the controls `u` (2 x (N - 1)) out from `x0` into the states `x`
+// (6 x N).
+template <class Scalar>
+inline void BicycleRollout(const Eigen::Matrix<Scalar, 6, 1>& x0,
+                           const typename BicycleTypes<Scalar>::Matrix& u,
+                           const typename BicycleTypes<Scalar>::Cubic& coeffs,
+                           typename BicycleTypes<Scalar>::Real dt,
+                           typename BicycleTypes<Scalar>::Real Lf,
+                           typename BicycleTypes<Scalar>::Matrix& x) {
+  typedef typename BicycleTypes<Scalar>::State StateT;
+  typedef typename BicycleTypes<Scalar>::Input InputT;
+  x.col(0) = x0;
+  for (Eigen::Index k = 0; k < u.cols(); k++) {
+    StateT s = x.col(k);
+    InputT uk = u.col(k);
+    x.col(k + 1) = BicycleStep(s, uk, coeffs, dt, Lf);
+  }
+}
+
+// Row block k of the condensed sensitivities `gamma` (6 (N - 1) x 2 (N - 1)):
+// how state k + 1 responds to each stacked control, given the Jacobians A, B
+// of stage k. Blocks must be filled in stage order.
+template <class Scalar>
+inline void CondenseStage(size_t k, const Eigen::Matrix<Scalar, 6, 6>& A,
+                          const typename BicycleTypes<Scalar>::InputJacobian& B,
+                          typename BicycleTypes<Scalar>::Matrix& gamma) {
+  for (size_t j = 0; j < k; j++) {
+    gamma.template block<6, 2>(6 * k, 2 * j).noalias() =
+        A * gamma.template block<6, 2>(6 * (k - 1), 2 * j);
+  }
+  gamma.template block<6, 2>(6 * k, 2 * k) = B;
+}
+
+// Hessian of the actuator terms of the cost over the controls stacked stage
+// by stage, [delta0, a0, delta1, a1, ...]: the cost is u' R u.
+template <class Scalar = double>
+inline typename BicycleTypes<Scalar>::Matrix ControlCost(
+    size_t N, const KinematicWeights& w) {
+  size_t n_u = 2 * (N - 1);
+  typename BicycleTypes<Scalar>::Matrix R =
+      BicycleTypes<Scalar>::Matrix::Zero(n_u, n_u);
+  for (size_t k = 0; k + 1 < N; k++) {
+    R(2 * k, 2 * k) += w.delta;
+    R(2 * k + 1, 2 * k + 1) += w.a;
+  }
+  for (size_t k = 0; k + 2 < N; k++) {
+    for (size_t i = 0; i < 2; i++) {
+      Scalar wd = i == 0 ? w.delta_diff : w.a_diff;
+      size_t j0 = 2 * k + i;
+      size_t j1 = 2 * (k + 1) + i;
+      R(j0, j0) += wd;
+      R(j1, j1) += wd;
+      R(j0, j1) -= wd;
+      R(j1, j0) -= wd;
+    }
+  }
+  return R;
+}
+
+#endif /* BICYCLE_MODEL_H */
@@ -0,0 +1,180 @@
+#include "BinaryProtocol.h"
+#include <algorithm>
+#include <cstring>
+
+// The counts are 16 bit.
+static const size_t MAX_COUNT = 0xffff;
+
+// Little-endian regardless of the host, through the bit pattern, which
+// compilers turn into a plain load or store on little-endian machines.
+static void AppendDouble(std::string& out, double x) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  char bytes[8];
+  for (int i = 0; i < 8; i++) {
+    bytes[i] = char(bits >> (8 * i));
+  }
+  out.append(bytes, 8);
+}
+
+static void AppendDoubles(std::string& out, const double* x, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    AppendDouble(out, x[i]);
+  }
+}
+
+static double ReadDouble(const char* p) {
+  uint64_t bits = 0;
+  for (int i = 0; i < 8; i++) {
+    bits |= uint64_t(uint8_t(p[i])) << (8 * i);
+  }
+  double x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+static void AppendHeader(std::string& out, BinaryMessageType type,
+                         size_t count0, size_t count1) {
+  char header[BINARY_HEADER_SIZE] = {
+      'M',
+      'B',
+      char(BINARY_PROTOCOL_VERSION),
+      char(type),
+      char(count0 & 0xff),
+      char(count0 >> 8),
+      char(count1 & 0xff),
+      char(count1 >> 8)};
+  out.append(header, BINARY_HEADER_SIZE);
+}
+
+// Whether [begin, end) is a message of `type` with no counts and `doubles`
+// doubles.
+static bool IsFixed(const char* begin, const char* end, BinaryMessageType type,
+                    size_t doubles) {
+  return size_t(end - begin) == BINARY_HEADER_SIZE + 8 * doubles &&
+         begin[0] == 'M' && begin[1] == 'B' &&
+         uint8_t(begin[2]) == BINARY_PROTOCOL_VERSION &&
+         uint8_t(begin[3]) == type;
+}
+
+bool ParseBinaryTelemetry(const char* begin, const char* end, Telemetry& t) {
+  size_t length = end - begin;
+  if (length < BINARY_HEADER_SIZE || begin[0] != 'M' || begin[1] != 'B' ||
+      uint8_t(begin[2]) != BINARY_PROTOCOL_VERSION ||
+      uint8_t(begin[3]) != BINARY_TELEMETRY) {
+    return false;
+  }
+  size_t n = uint8_t(begin[4]) | size_t(uint8_t(begin[5])) << 8;
+  if (n > MAX_WAYPOINTS ||
+      length != BINARY_HEADER_SIZE + 8 * (6 + 2 * n)) {
+    return false;
+  }
+  const char* p = begin + BINARY_HEADER_SIZE;
+  t.px = ReadDouble(p);
+  t.py = ReadDouble(p + 8);
+  t.psi = ReadDouble(p + 16);
+  t.v = ReadDouble(p + 24);
+  t.delta = ReadDouble(p + 32);
+  t.a = ReadDouble(p + 40);
+  p += 48;
+  for (size_t i = 0; i < n; i++) {
+    t.ptsx[i] = ReadDouble(p + 8 * i);
+    t.ptsy[i] = ReadDouble(p + 8 * (n + i));
+  }
+  t.n_waypoints = n;
+  t.binary = true;
+  return true;
+}
+
+void WriteBinarySteer(std::string& out, double steering, double throttle,
+                      const double* mpc_x, const double* mpc_y, size_t n_mpc,
+                      const double* next_x, const double* next_y,
+                      size_t n_next) {
+  n_mpc = std::min(n_mpc, MAX_COUNT);
+  n_next = std::min(n_next, MAX_COUNT);
+  out.clear();
+  AppendHeader(out, BINARY_STEER, n_mpc, n_next);
+  AppendDouble(out, steering);
+  AppendDouble(out, throttle);
+  AppendDoubles(out, mpc_x, n_mpc);
+  AppendDoubles(out, mpc_y, n_mpc);
+  AppendDoubles(out, next_x, n_next);
+  AppendDoubles(out, next_y, n_next);
+}
+
+void AppendBinaryControls(std::string& out, const double* t,
+                          const double* steering, const double* throttle,
+                          size_t n) {
+  n = std::min(n, MAX_COUNT);
+  AppendHeader(out, BINARY_CONTROLS, n, 0);
+  AppendDoubles(out, t, n);
+  AppendDoubles(out, steering, n);
+  AppendDoubles(out, throttle, n);
+}
+
+void AppendBinaryApply(std::string& out, double apply_after) {
+  AppendHeader(out, BINARY_APPLY, 0, 0);
+  AppendDouble(out, apply_after);
+}
+
+void WriteBinaryTelemetry(std::string& out, const Telemetry& t) {
+  out.clear();
+  AppendHeader(out, BINARY_TELEMETRY, t.n_waypoints, 0);
+  AppendDouble(out, t.px);
+  AppendDouble(out, t.py);
+  AppendDouble(out, t.psi);
+  AppendDouble(out, t.v);
+  AppendDouble(out, t.delta);
+  AppendDouble(out, t.a);
+  AppendDoubles(out, t.ptsx, t.n_waypoints);
+  AppendDoubles(out, t.ptsy, t.n_waypoints);
+}
+
+void WriteBinaryProblem(std::string& out, const BinaryProblem& problem) {
+  out.clear();
+  AppendHeader(out, BINARY_PROBLEM, 0, 0);
+  AppendDouble(out, problem.deadline);
+  AppendDouble(out, problem.budget);
+  AppendDoubles(out, problem.state, 6);
+  AppendDoubles(out, problem.coeffs, 4);
+}
+
+bool ParseBinaryProblem(const char* begin, const char* end,
+                        BinaryProblem& problem) {
+  if (!IsFixed(begin, end, BINARY_PROBLEM, 12)) {
+    return false;
+  }
+  const char* p = begin + BINARY_HEADER_SIZE;
+  problem.deadline = ReadDouble(p);
+  problem.budget = ReadDouble(p + 8);
+  for (int i = 0; i < 6; i++) {
+    problem.state[i] = ReadDouble(p + 16 + 8 * i);
+  }
+  for (int i = 0; i < 4; i++) {
+    problem.coeffs[i] = ReadDouble(p + 64 + 8 * i);
+  }
+  return true;
+}
+
+void WriteBinaryActuation(std::string& out,
+                          const BinaryActuation& actuation) {
+  out.clear();
+  AppendHeader(out, BINARY_ACTUATION, 0, 0);
+  AppendDouble(out, actuation.deadline);
+  AppendDouble(out, actuation.delta);
+  AppendDouble(out, actuation.a);
+  AppendDouble(out, actuation.status);
+}
+
+bool ParseBinaryActuation(const char* begin, const char* end,
+                          BinaryActuation& actuation) {
+  if (!IsFixed(begin, end, BINARY_ACTUATION, 4)) {
+    return false;
+  }
+  const char* p = begin + BINARY_HEADER_SIZE;
+  actuation.deadline = ReadDouble(p);
+  actuation.delta = ReadDouble(p + 8);
+  actuation.a = ReadDouble(p + 16);
+  actuation.status = int(ReadDouble(p + 24));
+  return true;
+}
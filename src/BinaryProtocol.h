@@ -0,0 +1,100 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Telemetry.h"
+
+// Binary framing for the telemetry and steer messages, for clients that
+// would rather not format and parse text; see DATA.md. A connection uses it
+// by sending its telemetry in binary websocket frames, and each reply goes
+// out in the framing of the frame it answers, so the simulator's JSON keeps
+// working alongside.
+//
+// Every message starts with an 8 byte header,
+//
+//   'M' 'B' version type count0 count1
+//
+// with version and type one byte each and the counts little-endian uint16,
+// followed by little-endian IEEE doubles:
+//
+//   TELEMETRY  x y psi speed steering_angle throttle ptsx[count0] ptsy[count0]
+//   STEER      steering_angle throttle mpc_x[count0] mpc_y[count0]
+//              next_x[count1] next_y[count1]
+//   CONTROLS   t[count0] steering_angle[count0] throttle[count0]
+//   APPLY      apply_after
+//   PROBLEM    deadline budget state[6] coeffs[4]
+//   ACTUATION  deadline delta a status
+//
+// in the units of the JSON fields, but for a solver farm's PROBLEM and
+// ACTUATION, see SolverFarm, which are in the model's, as MPC::Solve takes
+// and answers them.
+static const uint8_t BINARY_PROTOCOL_VERSION = 1;
+static const size_t BINARY_HEADER_SIZE = 8;
+
+enum BinaryMessageType {
+  BINARY_TELEMETRY = 1,
+  BINARY_STEER = 2,
+  BINARY_CONTROLS = 3,
+  BINARY_APPLY = 4,
+  BINARY_PROBLEM = 5,
+  BINARY_ACTUATION = 6
+};
+
+// A frame prepared on the edge for a solver farm: the state and cubic to
+// solve from, the seconds from its arrival that the farm has to answer,
+// and the deadline in the edge's own clock, which the farm only echoes.
+struct BinaryProblem {
+  double deadline;
+  double budget;
+  double state[6];
+  double coeffs[4];
+};
+
+// The farm's answer to a BinaryProblem: its deadline, the first
+// actuations, and the solve's outcome, as MPC::Status.
+struct BinaryActuation {
+  double deadline;
+  double delta;
+  double a;
+  int status;
+};
+
+// Read a TELEMETRY message into `t`, filling everything but `received` and
+// `latency`. False if it isn't one, is of another version, is truncated or
+// has more than MAX_WAYPOINTS waypoints.
+bool ParseBinaryTelemetry(const char* begin, const char* end, Telemetry& t);
+
+// Write a STEER message into `out`, replacing what was there, like
+// WriteSteer.
+void WriteBinarySteer(std::string& out, double steering, double throttle,
+                      const double* mpc_x, const double* mpc_y, size_t n_mpc,
+                      const double* next_x, const double* next_y,
+                      size_t n_next);
+
+// Append a CONTROLS message, the inputs over the whole horizon, each applied
+// from t seconds after the STEER message's, to follow it in the same frame.
+void AppendBinaryControls(std::string& out, const double* t,
+                          const double* steering, const double* throttle,
+                          size_t n);
+
+// Append an APPLY message, the seconds of simulated time after the frame it
+// answers that the STEER message it follows in the same frame takes effect,
+// see WriteSteer.
+void AppendBinaryApply(std::string& out, double apply_after);
+
+// Write a TELEMETRY message for `t`, as a client would.
+void WriteBinaryTelemetry(std::string& out, const Telemetry& t);
+
+// Write a PROBLEM or ACTUATION message into `out`, replacing what was
+// there, and read one; false if it isn't one, is of another version or is
+// truncated.
+void WriteBinaryProblem(std::string& out, const BinaryProblem& problem);
+bool ParseBinaryProblem(const char* begin, const char* end,
+                        BinaryProblem& problem);
+void WriteBinaryActuation(std::string& out, const BinaryActuation& actuation);
+bool ParseBinaryActuation(const char* begin, const char* end,
+                          BinaryActuation& actuation);
+
+#endif /* BINARY_PROTOCOL_H */
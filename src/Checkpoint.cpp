@@ -0,0 +1,65 @@
+#include "Checkpoint.h"
+#include <cstring>
+
+void CheckpointWriter::Header() {
+  const char header[CHECKPOINT_HEADER_SIZE] = {'M', 'K',
+                                               char(CHECKPOINT_VERSION)};
+  out_.append(header, CHECKPOINT_HEADER_SIZE);
+}
+
+void CheckpointWriter::Count(size_t n) {
+  char bytes[4];
+  for (int i = 0; i < 4; i++) {
+    bytes[i] = char(uint32_t(n) >> (8 * i));
+  }
+  out_.append(bytes, 4);
+}
+
+// Little-endian regardless of the host, through the bit pattern, as in
+// BinaryProtocol.cpp.
+void CheckpointWriter::Double(double x) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  char bytes[8];
+  for (int i = 0; i < 8; i++) {
+    bytes[i] = char(bits >> (8 * i));
+  }
+  out_.append(bytes, 8);
+}
+
+bool CheckpointReader::Header() {
+  ok_ = ok_ && size_t(end_ - p_) >= CHECKPOINT_HEADER_SIZE && p_[0] == 'M' &&
+        p_[1] == 'K' && uint8_t(p_[2]) == CHECKPOINT_VERSION;
+  if (ok_) {
+    p_ += CHECKPOINT_HEADER_SIZE;
+  }
+  return ok_;
+}
+
+bool CheckpointReader::Count(size_t& n) {
+  if (!ok_ || end_ - p_ < 4) {
+    ok_ = false;
+    return false;
+  }
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= uint32_t(uint8_t(p_[i])) << (8 * i);
+  }
+  p_ += 4;
+  n = value;
+  return true;
+}
+
+bool CheckpointReader::Double(double& x) {
+  if (!ok_ || end_ - p_ < 8) {
+    ok_ = false;
+    return false;
+  }
+  uint64_t bits = 0;
+  for (int i = 0; i < 8; i++) {
+    bits |= uint64_t(uint8_t(p_[i])) << (8 * i);
+  }
+  p_ += 8;
+  memcpy(&x, &bits, sizeof(x));
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A session's state in a compact binary form, for it to go on from another
+// server where it left off instead of from cold; see Handoff.h for how it
+// gets there. The parts of the state write themselves through a
+// CheckpointWriter and read themselves back through a CheckpointReader, in
+// the same order: Controller::Checkpoint has the order of the controller's.
+//
+// A checkpoint starts with 'M' 'K' and a version byte, and the rest is
+// little-endian uint32 counts and IEEE doubles; a run of doubles is its
+// count and then them. The version goes up whenever any part changes what
+// it writes.
+static const uint8_t CHECKPOINT_VERSION = 1;
+static const size_t CHECKPOINT_HEADER_SIZE = 3;
+
+// Appends to `out`.
+class CheckpointWriter {
+ public:
+  explicit CheckpointWriter(std::string& out) : out_(out) {}
+
+  // The header, first.
+  void Header();
+  void Count(size_t n);
+  void Double(double x);
+  // A count and then the first n of x.
+  template <class Vector>
+  void Doubles(const Vector& x, size_t n) {
+    Count(n);
+    for (size_t i = 0; i < n; i++) {
+      Double(x[i]);
+    }
+  }
+
+ private:
+  std::string& out_;
+};
+
+// Reads [begin, end). Each read is false once the checkpoint has turned
+// out truncated, of another version or not one at all, and leaves its
+// output as it was then.
+class CheckpointReader {
+ public:
+  CheckpointReader(const char* begin, const char* end)
+      : p_(begin), end_(end), ok_(true) {}
+
+  bool Header();
+  bool Count(size_t& n);
+  bool Double(double& x);
+  // A run of doubles into x, resized to it.
+  template <class Vector>
+  bool Doubles(Vector& x) {
+    size_t n;
+    if (!Count(n) || size_t(end_ - p_) / 8 < n) {
+      ok_ = false;
+      return false;
+    }
+    x.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      Double(x[i]);
+    }
+    return true;
+  }
+
+  bool ok() const { return ok_; }
+  // Where the next read starts.
+  const char* position() const { return p_; }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool ok_;
+};
+
+#endif /* CHECKPOINT_H */
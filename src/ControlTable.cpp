@@ -0,0 +1,156 @@
+#include "ControlTable.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+static const char TABLE_MAGIC[4] = {'M', 'C', 'T', 'B'};
+static const uint32_t TABLE_VERSION = 1;
+
+namespace {
+
+struct TableHeader {
+  char magic[4];
+  uint32_t version;
+  ControlTable::Axis axes[ControlTable::DIMENSIONS];
+  ControlTable::Model model;
+};
+
+}  // namespace
+
+ControlTable::ControlTable() : axes_(), model_() { Layout(); }
+
+ControlTable::ControlTable(const Axis axes[DIMENSIONS], const Model& model)
+    : model_(model) {
+  for (int d = 0; d < DIMENSIONS; d++) {
+    axes_[d] = axes[d];
+  }
+  Layout();
+}
+
+void ControlTable::Layout() {
+  size_t points = 1;
+  for (int d = DIMENSIONS - 1; d >= 0; d--) {
+    strides_[d] = points;
+    points *= axes_[d].n;
+  }
+  values_.assign(2 * points, std::numeric_limits<float>::quiet_NaN());
+}
+
+void ControlTable::Point(size_t index, double* q) const {
+  for (int d = 0; d < DIMENSIONS; d++) {
+    const Axis& axis = axes_[d];
+    size_t i = index / strides_[d] % axis.n;
+    q[d] = axis.lo + (axis.hi - axis.lo) * i / (axis.n - 1);
+  }
+}
+
+void ControlTable::Set(size_t index, const Input& u) {
+  values_[2 * index] = u[0];
+  values_[2 * index + 1] = u[1];
+}
+
+void ControlTable::Query(const State& state, const Cubic& coeffs, double* q) {
+  double df = coeffs[1];
+  q[V] = state[3];
+  q[CTE] = state[4];
+  q[EPSI] = state[5];
+  q[CURVATURE] = 2 * coeffs[2] / std::pow(1 + df * df, 1.5);
+}
+
+void ControlTable::Sample(const double* q, State& state, Cubic& coeffs) {
+  // cte = f(0) and epsi = -atan(f'(0)), as Control() computes them, with
+  // the curvature held to the second order.
+  double df = -std::tan(q[EPSI]);
+  coeffs << q[CTE], df, 0.5 * q[CURVATURE] * std::pow(1 + df * df, 1.5), 0;
+  state << 0, 0, 0, q[V], q[CTE], q[EPSI];
+}
+
+bool ControlTable::Lookup(const double* q, Input& u) const {
+  if (values_.empty()) {
+    return false;
+  }
+  size_t base = 0;
+  double frac[DIMENSIONS];
+  for (int d = 0; d < DIMENSIONS; d++) {
+    const Axis& axis = axes_[d];
+    double t = (q[d] - axis.lo) / (axis.hi - axis.lo) * (axis.n - 1);
+    if (!(t >= 0 && t <= axis.n - 1)) {
+      return false;
+    }
+    size_t i = std::min(size_t(t), size_t(axis.n - 2));
+    frac[d] = t - i;
+    base += i * strides_[d];
+  }
+  // The 16 corners of the cell, weighted by the product of their fractions.
+  double delta = 0;
+  double a = 0;
+  for (int corner = 0; corner < 1 << DIMENSIONS; corner++) {
+    size_t index = base;
+    double weight = 1;
+    for (int d = 0; d < DIMENSIONS; d++) {
+      bool up = corner >> d & 1;
+      index += up * strides_[d];
+      weight *= up ? frac[d] : 1 - frac[d];
+    }
+    delta += weight * values_[2 * index];
+    a += weight * values_[2 * index + 1];
+  }
+  // NaN from a failed point poisons the sum.
+  if (!(std::isfinite(delta) && std::isfinite(a))) {
+    return false;
+  }
+  u << delta, a;
+  return true;
+}
+
+bool ControlTable::Load(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  TableHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, TABLE_MAGIC, sizeof(header.magic)) == 0 &&
+               header.version == TABLE_VERSION;
+  for (int d = 0; valid && d < DIMENSIONS; d++) {
+    const Axis& axis = header.axes[d];
+    valid = axis.n >= 2 && axis.n <= 1 << 16 && axis.hi > axis.lo;
+  }
+  if (valid) {
+    for (int d = 0; d < DIMENSIONS; d++) {
+      axes_[d] = header.axes[d];
+    }
+    model_ = header.model;
+    Layout();
+    valid = fread(values_.data(), sizeof(float), values_.size(), file) ==
+            values_.size();
+  }
+  fclose(file);
+  if (!valid) {
+    memset(axes_, 0, sizeof(axes_));
+    Layout();
+  }
+  return valid;
+}
+
+bool ControlTable::Save(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  TableHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+  header.version = TABLE_VERSION;
+  for (int d = 0; d < DIMENSIONS; d++) {
+    header.axes[d] = axes_[d];
+  }
+  header.model = model_;
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(values_.data(), sizeof(float), values_.size(), file) ==
+          values_.size();
+  return fclose(file) == 0 && written;
+}
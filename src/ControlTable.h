@@ -0,0 +1,78 @@
+#ifndef CONTROL_TABLE_H
+#define CONTROL_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BicycleModel.h"
+
+// Explicit MPC: the actuations of the NMPC over a grid of (v, cte, epsi,
+// curvature), solved offline by tools/build_control_table.cpp, and
+// interpolated multilinearly online, at a constant 16 grid points whatever
+// the horizon.
+//
+// A grid point stands for the car at the origin of its frame with the given
+// speed and errors, on a path of constant curvature, so that a frame is
+// looked up by its state's v, cte and epsi and its fit's curvature at the
+// car. The path's change in curvature and the latency's move of the car are
+// left out; the table is as good as that approximation, which the builder
+// checks between the grid points against MPC::Solve. Points whose solve
+// failed hold NaN, and a lookup touching one misses like one outside the
+// grid, for the solver to answer instead.
+//
+// The file is a header, with the horizon and model the table was solved
+// for, and then (delta, a) as float pairs in grid order, the last axis
+// fastest, in native byte order.
+class ControlTable {
+ public:
+  enum Dimension { V, CTE, EPSI, CURVATURE, DIMENSIONS };
+  struct Axis {
+    double lo;
+    double hi;
+    uint32_t n;
+  };
+  // What the table was solved for, to be checked against the controller
+  // loading it.
+  struct Model {
+    double N;
+    double dt;
+    double Lf;
+    double refV;
+  };
+
+  ControlTable();
+  // An empty table over `axes`, n >= 2 points each, for Set().
+  ControlTable(const Axis axes[DIMENSIONS], const Model& model);
+
+  bool Load(const std::string& path);
+  bool Save(const std::string& path) const;
+
+  size_t size() const { return values_.size() / 2; }
+  const Axis& axis(Dimension d) const { return axes_[d]; }
+  const Model& model() const { return model_; }
+
+  // The coordinates of grid point `index`.
+  void Point(size_t index, double* q) const;
+  void Set(size_t index, const Input& u);
+
+  // The coordinates of a frame, and the state and path of coordinates q
+  // for the solver.
+  static void Query(const State& state, const Cubic& coeffs, double* q);
+  static void Sample(const double* q, State& state, Cubic& coeffs);
+
+  // The interpolated actuations at q; false outside the grid or next to a
+  // failed point.
+  bool Lookup(const double* q, Input& u) const;
+
+ private:
+  Axis axes_[DIMENSIONS];
+  Model model_;
+  // How far apart in grid order consecutive points of each axis are.
+  size_t strides_[DIMENSIONS];
+  std::vector<float> values_;
+
+  void Layout();
+};
+
+#endif /* CONTROL_TABLE_H */
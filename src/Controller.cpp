@@ -0,0 +1,168 @@
+#include "Controller.h"
+#include <algorithm>
+#include <cmath>
+#include "Checkpoint.h"
+#include "Metrics.h"
+#include "PerfCounters.h"
+#include "Polynomial.h"
+#include "Stages.h"
+#include "TrackMap.h"
+
+Cubic FitReference(WaypointFit& fit, const Telemetry& t,
+                   const ReferenceSource& source) {
+  const TrackMap* track = source.track;
+  if (track && fit.FitTrack(*track, t.px, t.py, t.psi, source.behind,
+                            source.ahead)) {
+    return fit.coeffs();
+  }
+  const double* ptsx = t.ptsx;
+  const double* ptsy = t.ptsy;
+  size_t n_waypoints = t.n_waypoints;
+  double track_x[MAX_WAYPOINTS];
+  double track_y[MAX_WAYPOINTS];
+  if (track) {
+    n_waypoints = track->Ahead(fit.localizer().Nearest(*track, t.px, t.py),
+                               t.px, t.py, t.psi,
+                               std::min(source.lookahead, MAX_WAYPOINTS),
+                               track_x, track_y);
+    ptsx = track_x;
+    ptsy = track_y;
+  }
+  return fit.FitWorld(t.px, t.py, t.psi, ptsx, ptsy, n_waypoints);
+}
+
+State PredictFrameState(const Telemetry& t, const Cubic& coeffs, double Lf) {
+  // The cross track error is calculated by evaluating at polynomial at x, f(x)
+  // and subtracting y.
+  double cte = polyeval(coeffs, 0);
+  // Due to the sign starting at 0, the orientation error is -f'(x).
+  // derivative of coeffs[0] + coeffs[1] * x -> coeffs[1]
+  double epsi = -atan(coeffs[1]);
+  return PredictState(t.v, t.delta, t.a, cte, epsi, Lf, t.latency);
+}
+
+void PrepareFrame(WaypointFit& fit, Telemetry& t,
+                  const ReferenceSource& source, double Lf) {
+  Cubic coeffs = FitReference(fit, t, source);
+  Eigen::Map<Cubic>(t.coeffs) = coeffs;
+  Eigen::Map<State>(t.state) = PredictFrameState(t, coeffs, Lf);
+  t.prepared = true;
+}
+
+Controller::Controller(const MpcConfig& config, const ReferenceSource& source)
+    : mpc_(config), source_(source), counted_(true) {}
+
+void Controller::Step(const Telemetry& t,
+                      std::chrono::steady_clock::time_point deadline,
+                      Output& out) {
+  // Unless the frame was prepared ahead.
+  Cubic coeffs;
+  State state;
+  if (t.prepared) {
+    coeffs = Eigen::Map<const Cubic>(t.coeffs);
+    state = Eigen::Map<const State>(t.state);
+  } else {
+    coeffs = FitReference(fit_, t, source_);
+    state = PredictFrameState(t, coeffs, mpc_.config().Lf);
+  }
+  if (mpc_.warmStarts() && source_.track) {
+    mpc_.trackPosition = localizer_.Project(*source_.track, t.px, t.py);
+  }
+  mpc_.worldX = t.px;
+  mpc_.worldY = t.py;
+  mpc_.worldPsi = t.psi;
+
+  MPC::Result solution = {0, 0, out.x, out.y, MAX_TRAJECTORY, 0};
+  auto solve = std::chrono::steady_clock::now();
+  PerfScope solve_counts(STAGE_SOLVE);
+  mpc_.hostLoad = 1e-6 * metrics.utilization.load(std::memory_order_relaxed);
+  mpc_.Solve(state, coeffs, solution, deadline);
+  solve_counts.Stop();
+  if (counted_) {
+    RecordStage(STAGE_SOLVE, solve);
+    CountSolve();
+  }
+
+  // The model steers positive to the left.
+  out.steering = -solution.delta;
+  out.throttle = solution.a;
+  out.points = solution.size;
+  Eigen::Map<State>(out.state) = state;
+  Eigen::Map<Cubic>(out.reference) = coeffs;
+  out.controls = mpc_.controls(out.controlT, out.controlSteering,
+                               out.controlThrottle, MAX_TRAJECTORY);
+  for (size_t i = 0; i < out.controls; i++) {
+    out.controlSteering[i] = -out.controlSteering[i];
+  }
+}
+
+void Controller::CountSolve() {
+  const MPC::SolveStats& stats = mpc_.stats();
+  metrics.solves[stats.status].fetch_add(1, std::memory_order_relaxed);
+  if (mpc_.usedPlan) {
+    metrics.planFrames.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (mpc_.forcedSolve) {
+    metrics.forcedSolves.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (mpc_.usedFastPath) {
+    metrics.fastPathFrames.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (mpc_.predictedSeconds() >= 0) {
+    double error = stats.seconds - mpc_.predictedSeconds();
+    metrics.predictedSolves.fetch_add(1, std::memory_order_relaxed);
+    metrics.predictionError.fetch_add(uint64_t(std::fabs(error) * 1e9),
+                                      std::memory_order_relaxed);
+    if (error > 0) {
+      metrics.underpredictedSolves.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (stats.aborted != MPC_NLP::NOT_ABORTED) {
+    metrics.abortedSolves[stats.aborted - 1].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+  if (mpc_.cache() && mpc_.active() == MPC::IPOPT && !mpc_.usedPlan &&
+      !mpc_.usedTable) {
+    metrics.cacheLookups.fetch_add(1, std::memory_order_relaxed);
+    if (mpc_.usedCache) {
+      metrics.cacheAnswers.fetch_add(1, std::memory_order_relaxed);
+    } else if (mpc_.cacheSeeded) {
+      metrics.cacheSeeds.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (mpc_.primitiveSeeded) {
+    metrics.primitiveSeeds.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (mpc_.energyMeter) {
+    metrics.meteredSolves.fetch_add(1, std::memory_order_relaxed);
+    metrics.solveEnergy.fetch_add(uint64_t(std::max(stats.joules, 0.) * 1e6),
+                                  std::memory_order_relaxed);
+  }
+  if (mpc_.active() == MPC::IPOPT && !mpc_.usedPlan && !mpc_.usedCache &&
+      !mpc_.usedTable) {
+    RecordStage(STAGE_EVAL, stats.evalSeconds);
+    RecordStage(STAGE_LINEAR_ALGEBRA, stats.linearSolveSeconds);
+    metrics.ipoptSolves.fetch_add(1, std::memory_order_relaxed);
+    metrics.ipoptIterations.fetch_add(stats.iterations,
+                                      std::memory_order_relaxed);
+  }
+}
+
+void Controller::Checkpoint(CheckpointWriter& out) const {
+  mpc_.Checkpoint(out);
+  localizer_.Checkpoint(out);
+  fit_.localizer().Checkpoint(out);
+}
+
+bool Controller::Restore(CheckpointReader& in) {
+  return mpc_.Restore(in) && localizer_.Restore(in, source_.track) &&
+         fit_.localizer().Restore(in, source_.track);
+}
+
+void Controller::DrawReference(Output& out) {
+  for (size_t i = 0; i < REFERENCE_POINTS; i++) {
+    out.referenceX[i] = REFERENCE_SPACING * (i + 1);
+  }
+  polyeval(Eigen::Map<const Cubic>(out.reference), out.referenceX,
+           out.referenceY, REFERENCE_POINTS);
+}
@@ -0,0 +1,129 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <chrono>
+#include <cstddef>
+#include "BicycleModel.h"
+#include "MPC.h"
+#include "MpcConfig.h"
+#include "Telemetry.h"
+#include "TrackLocalizer.h"
+#include "WaypointFit.h"
+
+class CheckpointReader;
+class CheckpointWriter;
+class TrackMap;
+
+// Where the reference of a frame comes from: its waypoints, or a track the
+// car follows, see TrackMap.
+struct ReferenceSource {
+  ReferenceSource() : track(nullptr), behind(10), ahead(40), lookahead(6) {}
+  // The track's spline from `behind` meters of arc length behind the car to
+  // `ahead` ahead of it, see WaypointFit::FitTrack; where the track folds
+  // back over that span, its `lookahead` waypoints ahead of the car. Null
+  // fits the frame's waypoints.
+  const TrackMap* track;
+  double behind;
+  double ahead;
+  size_t lookahead;
+};
+
+// The reference for frame `t` in car coordinates, fitted by `fit`.
+Cubic FitReference(WaypointFit& fit, const Telemetry& t,
+                   const ReferenceSource& source);
+
+// Where the car will be once the actuations for frame `t` land, following
+// `coeffs`, with Lf from the front axle to the center of gravity.
+State PredictFrameState(const Telemetry& t, const Cubic& coeffs, double Lf);
+
+// Both into `t`, and mark it prepared, so that Controller::Step takes them
+// from it instead.
+void PrepareFrame(WaypointFit& fit, Telemetry& t,
+                  const ReferenceSource& source, double Lf);
+
+// The controller core, for use in process: a frame of telemetry in, the
+// actuations and the predicted trajectory out, with no serialization. It
+// fits the reference, predicts the state over the frame's latency and
+// solves; the websocket server in main.cpp is a frontend over it.
+//
+// Step counts each solve in the metrics and its stages in the stage
+// histograms. Not thread-safe: one thread at a time, as for MPC.
+class Controller {
+ public:
+  // Most points of the predicted trajectory kept, more than any horizon has
+  // stages, and the points of the reference line.
+  static const size_t MAX_TRAJECTORY = 128;
+  static const size_t REFERENCE_POINTS = 24;
+  // Meters between the points of the reference line.
+  static constexpr double REFERENCE_SPACING = 2.5;
+
+  struct Output {
+    // The steering angle in radians, positive to the right as the
+    // simulator has it, and the throttle, in [-1, 1].
+    double steering;
+    double throttle;
+    // The state solved from, predicted over the frame's latency.
+    double state[6];
+    // The predicted trajectory in car coordinates, and the coefficients of
+    // the reference polynomial; the reference line, for drawing only, is
+    // left to DrawReference.
+    size_t points;
+    double x[MAX_TRAJECTORY];
+    double y[MAX_TRAJECTORY];
+    double reference[4];
+    double referenceX[REFERENCE_POINTS];
+    double referenceY[REFERENCE_POINTS];
+    // The inputs of the whole horizon, as steering and throttle are, each
+    // applied from controlT seconds after the first, with MPC::keepControls;
+    // 0 of them otherwise, or when the solve kept none.
+    size_t controls;
+    double controlT[MAX_TRAJECTORY];
+    double controlSteering[MAX_TRAJECTORY];
+    double controlThrottle[MAX_TRAJECTORY];
+  };
+
+  explicit Controller(const MpcConfig& config = MpcConfig(),
+                      const ReferenceSource& source = ReferenceSource());
+
+  Controller(const Controller&) = delete;
+  Controller& operator=(const Controller&) = delete;
+
+  // The solver, tuned through its fields before the first Step; the
+  // outcome of the last solve is in mpc().stats().
+  MPC& mpc() { return mpc_; }
+  const MPC& mpc() const { return mpc_; }
+  WaypointFit& fit() { return fit_; }
+  const ReferenceSource& source() const { return source_; }
+
+  // Whether Step counts its solves in the metrics and the stage histograms;
+  // off for a controller whose answers aren't sent, see ShadowEvaluator.
+  void SetCounted(bool counted) { counted_ = counted; }
+
+  // Answer frame `t`, stopping the solve at `deadline`.
+  void Step(const Telemetry& t, std::chrono::steady_clock::time_point deadline,
+            Output& out);
+
+  // Write the state the next Step goes on from into a checkpoint: the
+  // solver's, see MPC::Checkpoint, and where the car is on the track, for
+  // the fit and for MPC::trackPosition; and read it back into a controller
+  // of the same tuning, on the same track. See Handoff.h.
+  void Checkpoint(CheckpointWriter& out) const;
+  bool Restore(CheckpointReader& in);
+
+  // Evaluate the reference line of `out`, REFERENCE_SPACING apart, into its
+  // referenceX and referenceY.
+  static void DrawReference(Output& out);
+
+ private:
+  // The last solve into the metrics and the stage histograms.
+  void CountSolve();
+
+  MPC mpc_;
+  WaypointFit fit_;
+  ReferenceSource source_;
+  // The car's place on source_.track, for MPC::trackPosition.
+  TrackLocalizer localizer_;
+  bool counted_;
+};
+
+#endif /* CONTROLLER_H */
@@ -0,0 +1,57 @@
+#include "ControllerC.h"
+#include <algorithm>
+#include <new>
+#include "Controller.h"
+#include "HeapGuard.h"
+
+static_assert(MPC_MAX_TRAJECTORY == Controller::MAX_TRAJECTORY,
+              "the C trajectory holds as many points as the controller's");
+
+struct mpc_controller {
+  Controller controller;
+  Controller::Output out;
+  Telemetry frame;
+};
+
+mpc_controller* mpc_controller_create(void) {
+  return new (std::nothrow) mpc_controller();
+}
+
+void mpc_controller_destroy(mpc_controller* controller) { delete controller; }
+
+int mpc_controller_step(mpc_controller* controller,
+                        const mpc_telemetry* telemetry, double budget,
+                        mpc_command* command) {
+  Telemetry& t = controller->frame;
+  t.received = std::chrono::steady_clock::now();
+  t.n_waypoints = std::min(telemetry->n_waypoints, MAX_WAYPOINTS);
+  std::copy(telemetry->ptsx, telemetry->ptsx + t.n_waypoints, t.ptsx);
+  std::copy(telemetry->ptsy, telemetry->ptsy + t.n_waypoints, t.ptsy);
+  t.px = telemetry->px;
+  t.py = telemetry->py;
+  t.psi = telemetry->psi;
+  t.v = telemetry->v;
+  t.delta = telemetry->delta;
+  t.a = telemetry->a;
+  t.latency = telemetry->latency;
+  t.binary = true;
+  t.prepared = false;
+
+  Controller::Output& out = controller->out;
+  controller->controller.Step(
+      t, t.received + std::chrono::duration_cast<
+                          std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(budget)),
+      out);
+  command->steering = out.steering;
+  command->throttle = out.throttle;
+  command->points = out.points;
+  std::copy(out.x, out.x + out.points, command->x);
+  std::copy(out.y, out.y + out.points, command->y);
+  return controller->controller.mpc().stats().status;
+}
+
+int mpc_heap_seal(void) {
+  SealHeap();
+  return GuardingHeap();
+}
@@ -0,0 +1,65 @@
+#ifndef CONTROLLER_C_H
+#define CONTROLLER_C_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The controller core of Controller.h for C callers, in process: a frame
+ * of telemetry in, the actuations and the predicted trajectory out. Each
+ * controller is used by one thread at a time. */
+typedef struct mpc_controller mpc_controller;
+
+/* A frame in the simulator's units: the car's world position and heading
+ * in radians, its speed in mph, the steering angle in radians and the
+ * throttle it last applied, the delay in seconds until the reply takes
+ * effect, and the waypoints ahead, in world coordinates. */
+typedef struct {
+  double px;
+  double py;
+  double psi;
+  double v;
+  double delta;
+  double a;
+  double latency;
+  size_t n_waypoints;
+  const double* ptsx;
+  const double* ptsy;
+} mpc_telemetry;
+
+#define MPC_MAX_TRAJECTORY 128
+
+/* The steering angle in radians and the throttle to apply, and the
+ * predicted trajectory in car coordinates. */
+typedef struct {
+  double steering;
+  double throttle;
+  size_t points;
+  double x[MPC_MAX_TRAJECTORY];
+  double y[MPC_MAX_TRAJECTORY];
+} mpc_command;
+
+/* A controller of the default tuning, MpcConfig's; null if out of memory. */
+mpc_controller* mpc_controller_create(void);
+void mpc_controller_destroy(mpc_controller* controller);
+
+/* Answer `telemetry` into `command`, solving for at most `budget` seconds.
+ * Returns the outcome, as MPC::Status: 0 converged, 1 stopped at the
+ * deadline, 2 the best feasible iterate, 3 failed. Waypoints past the
+ * 64th are ignored. */
+int mpc_controller_step(mpc_controller* controller,
+                        const mpc_telemetry* telemetry, double budget,
+                        mpc_command* command);
+
+/* Abort on any heap use from now on, in builds with MPC_STATIC_MEMORY (see
+ * HeapGuard.h); a no-op otherwise. Call it once the controllers are
+ * created. Returns whether the heap is guarded. */
+int mpc_heap_seal(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONTROLLER_C_H */
@@ -0,0 +1,35 @@
+#include "Coroutine.h"
+
+LoopExecutor& LoopExecutor::Current(uv_loop_t* loop) {
+  // Never freed: its handle lives as long as the loop, which the thread
+  // runs to its end.
+  static thread_local LoopExecutor* executor = new LoopExecutor(loop);
+  return *executor;
+}
+
+LoopExecutor::LoopExecutor(uv_loop_t* loop) {
+  uv_async_init(loop, &async_, OnAsync);
+  async_.data = this;
+  // Not a reason for the loop to go on by itself.
+  uv_unref(reinterpret_cast<uv_handle_t*>(&async_));
+}
+
+void LoopExecutor::Post(std::coroutine_handle<> coroutine) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    posted_.push_back(coroutine);
+  }
+  uv_async_send(&async_);
+}
+
+void LoopExecutor::OnAsync(uv_async_t* handle) {
+  LoopExecutor* self = static_cast<LoopExecutor*>(handle->data);
+  {
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    self->resuming_.swap(self->posted_);
+  }
+  for (std::coroutine_handle<> coroutine : self->resuming_) {
+    coroutine.resume();
+  }
+  self->resuming_.clear();
+}
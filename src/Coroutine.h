@@ -0,0 +1,193 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+// C++20 coroutines on a libuv loop, for the MPC_COROUTINES build, in which
+// each session's frames are a coroutine, see Session, instead of a chain of
+// callbacks: the coroutine runs on the event loop and suspends to wait for
+// its next frame, for a step of work on a FrameScheduler worker, or for a
+// timer. A session waiting costs its suspended frame, a few hundred bytes,
+// and no thread.
+//
+// Coroutines resume on their loop's thread: a worker that finishes a step
+// hands the coroutine to the loop's LoopExecutor, which resumes it from a
+// uv_async_t, so that what the coroutine touches between its awaits is
+// only ever touched by the loop.
+#include <uv.h>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "FrameScheduler.h"
+
+// A coroutine started by calling it and left to run to its end, which then
+// frees its frame; whatever it needs past its first suspension it holds
+// itself, as a shared_ptr to its session.
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return Task(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Resumes coroutines on a loop's thread, posted from any thread.
+class LoopExecutor {
+ public:
+  // The executor of `loop`, run by the calling thread; made on first use,
+  // and kept for the thread's life.
+  static LoopExecutor& Current(uv_loop_t* loop);
+
+  LoopExecutor(const LoopExecutor&) = delete;
+  LoopExecutor& operator=(const LoopExecutor&) = delete;
+
+  // Resume `coroutine` on the loop, soon; any thread.
+  void Post(std::coroutine_handle<> coroutine);
+
+ private:
+  explicit LoopExecutor(uv_loop_t* loop);
+  static void OnAsync(uv_async_t* handle);
+
+  uv_async_t async_;
+  std::mutex mutex_;
+  std::vector<std::coroutine_handle<> > posted_;
+  // posted_'s, swapped out to be resumed without the mutex.
+  std::vector<std::coroutine_handle<> > resuming_;
+};
+
+// Run `step` on `worker` of `scheduler`, due by `deadline` like any of its
+// tasks, and resume on the loop once it has run: co_await OnWorker(...).
+// The step may use the coroutine's locals, which outlive it.
+template <class Step>
+class OnWorker {
+ public:
+  OnWorker(FrameScheduler& scheduler, size_t worker,
+           FrameScheduler::Clock::time_point deadline, LoopExecutor& executor,
+           Step step)
+      : scheduler_(scheduler), worker_(worker), deadline_(deadline),
+        executor_(executor), step_(std::move(step)) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    scheduler_.Submit(worker_, deadline_, [this, coroutine] {
+      step_();
+      executor_.Post(coroutine);
+    });
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  FrameScheduler& scheduler_;
+  size_t worker_;
+  FrameScheduler::Clock::time_point deadline_;
+  LoopExecutor& executor_;
+  Step step_;
+};
+
+// Resume after `delay` on `loop`, on its thread: co_await Sleep(...). The
+// timer is closed before the coroutine goes on.
+class Sleep {
+ public:
+  Sleep(uv_loop_t* loop, std::chrono::duration<double> delay)
+      : loop_(loop), delay_(delay) {}
+
+  bool await_ready() const noexcept { return delay_.count() <= 0; }
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    coroutine_ = coroutine;
+    uv_timer_init(loop_, &timer_);
+    timer_.data = this;
+    uv_timer_start(&timer_, OnTimer,
+                   uint64_t(std::chrono::duration<double, std::milli>(delay_)
+                                .count() +
+                            0.5),
+                   0);
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  static void OnTimer(uv_timer_t* timer) {
+    uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+      static_cast<Sleep*>(handle->data)->coroutine_.resume();
+    });
+  }
+
+  uv_loop_t* loop_;
+  std::chrono::duration<double> delay_;
+  uv_timer_t timer_;
+  std::coroutine_handle<> coroutine_;
+};
+
+// A latest-wins slot between two coroutines, or a callback and a coroutine,
+// on one loop, like Mailbox between threads: Post replaces whatever wasn't
+// taken yet, and co_await Next() waits for the newest item, or null once
+// the channel is closed.
+template <class T>
+class Channel {
+ public:
+  Channel() : closed_(false), dropped_(0) {}
+
+  Channel(const Channel&) = delete;
+  Channel& operator=(const Channel&) = delete;
+
+  // Leave `item` for the coroutine, resuming it if it waits. Returns false
+  // if it replaced one that was never taken.
+  bool Post(std::unique_ptr<T> item) {
+    bool fresh = !item_;
+    if (!fresh) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    item_ = std::move(item);
+    Wake();
+    return fresh;
+  }
+
+  // Wake the coroutine with null, now and from now on; what is waiting is
+  // dropped.
+  void Close() {
+    closed_ = true;
+    item_.reset();
+    Wake();
+  }
+
+  class Awaiter {
+   public:
+    explicit Awaiter(Channel& channel) : channel_(channel) {}
+    bool await_ready() const noexcept {
+      return channel_.closed_ || channel_.item_ != nullptr;
+    }
+    void await_suspend(std::coroutine_handle<> coroutine) {
+      channel_.waiting_ = coroutine;
+    }
+    std::unique_ptr<T> await_resume() { return std::move(channel_.item_); }
+
+   private:
+    Channel& channel_;
+  };
+  Awaiter Next() { return Awaiter(*this); }
+
+  bool empty() const { return !item_; }
+  unsigned long dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void Wake() {
+    std::coroutine_handle<> waiting = waiting_;
+    waiting_ = nullptr;
+    if (waiting) {
+      waiting.resume();
+    }
+  }
+
+  std::unique_ptr<T> item_;
+  bool closed_;
+  std::coroutine_handle<> waiting_;
+  std::atomic<unsigned long> dropped_;
+};
+
+#endif /* COROUTINE_H */
@@ -0,0 +1,210 @@
+#include "Dashboard.h"
+#include <algorithm>
+#include "Session.h"
+#include "SocketOptions.h"
+#include "SteerMessage.h"
+
+std::mutex Dashboard::registry_mutex_;
+std::vector<Dashboard*> Dashboard::registry_;
+std::atomic<size_t> Dashboard::watchers_(0);
+std::atomic<size_t> Dashboard::compact_watchers_(0);
+
+Dashboard::Dashboard(uv_loop_t* loop, bool cork)
+    : cork_(cork), watching_(0) {
+  uv_async_init(loop, &async_, [](uv_async_t* handle) {
+    static_cast<Dashboard*>(handle->data)->Flush();
+  });
+  async_.data = this;
+  uv_unref(reinterpret_cast<uv_handle_t*>(&async_));
+  std::lock_guard<std::mutex> lock(registry_mutex_);
+  registry_.push_back(this);
+}
+
+// The loop has stopped by then, and its handles with it.
+Dashboard::~Dashboard() {
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    registry_.erase(std::find(registry_.begin(), registry_.end(), this));
+  }
+  watchers_.fetch_sub(subscribers_.size(), std::memory_order_relaxed);
+  for (Subscriber* subscriber : subscribers_) {
+    if (subscriber->compact) {
+      compact_watchers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    delete subscriber;
+  }
+}
+
+void Dashboard::Subscribe(uWS::WebSocket<uWS::SERVER> ws, bool compact) {
+  Subscriber* subscriber = new Subscriber{
+      ws, SocketFd(ws), 0, 0, compact, std::map<unsigned, uint64_t>(), false,
+      false};
+  subscribers_.push_back(subscriber);
+  ws.setUserData(subscriber);
+  watching_.fetch_add(1, std::memory_order_relaxed);
+  watchers_.fetch_add(1, std::memory_order_relaxed);
+  if (compact) {
+    compact_watchers_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool Dashboard::IsSubscriber(const void* user_data) const {
+  return user_data &&
+         std::find(subscribers_.begin(), subscribers_.end(), user_data) !=
+             subscribers_.end();
+}
+
+void Dashboard::Unsubscribe(uWS::WebSocket<uWS::SERVER> ws) {
+  Subscriber* subscriber = static_cast<Subscriber*>(ws.getUserData());
+  ws.setUserData(nullptr);
+  subscribers_.erase(
+      std::find(subscribers_.begin(), subscribers_.end(), subscriber));
+  watching_.fetch_sub(1, std::memory_order_relaxed);
+  watchers_.fetch_sub(1, std::memory_order_relaxed);
+  if (subscriber->compact) {
+    compact_watchers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  subscriber->gone = true;
+  if (subscriber->inFlight == 0) {
+    delete subscriber;
+  }
+}
+
+void Dashboard::Sent(void*, void* data, bool) {
+  Subscriber* subscriber = static_cast<Subscriber*>(data);
+  if (--subscriber->inFlight == 0 && subscriber->gone) {
+    delete subscriber;
+  }
+}
+
+void Dashboard::Publish(unsigned id, TrajectoryEncoder& encoder,
+                        double steering, double throttle, const double* x,
+                        const double* y, size_t points) {
+  size_t watchers = watchers_.load(std::memory_order_relaxed);
+  size_t compact = compact_watchers_.load(std::memory_order_relaxed);
+  if (watchers == 0) {
+    return;
+  }
+  std::shared_ptr<Update> update = std::make_shared<Update>();
+  update->sequence = 0;
+  if (compact > 0) {
+    encoder.Encode(id, steering, throttle, x, y, points, update->key,
+                   update->delta);
+    update->sequence = encoder.sequence();
+  }
+  if (watchers > compact) {
+    std::string& text = update->json;
+    text.reserve(96 + 48 * points);
+    text.append("{\"session\":");
+    text.append(std::to_string(id));
+    text.append(",\"steering_angle\":");
+    AppendDouble(text, steering);
+    text.append(",\"throttle\":");
+    AppendDouble(text, throttle);
+    const double* lines[2] = {x, y};
+    const char* keys[2] = {",\"x\":[", "],\"y\":["};
+    for (int k = 0; k < 2; k++) {
+      text.append(keys[k]);
+      for (size_t i = 0; i < points; i++) {
+        if (i > 0) {
+          text.push_back(',');
+        }
+        AppendDouble(text, lines[k][i]);
+      }
+    }
+    text.append("]}");
+  }
+
+  std::lock_guard<std::mutex> lock(registry_mutex_);
+  for (Dashboard* dashboard : registry_) {
+    if (dashboard->watching_.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> pending_lock(dashboard->mutex_);
+      dashboard->pending_[id] = update;
+    }
+    uv_async_send(&dashboard->async_);
+  }
+}
+
+uWS::WebSocket<uWS::SERVER>::PreparedMessage* Dashboard::Prepare(
+    uWS::WebSocket<uWS::SERVER>::PreparedMessage*& message,
+    const std::string& data, uWS::OpCode opCode) {
+  if (!message) {
+    message = uWS::WebSocket<uWS::SERVER>::prepareMessage(
+        const_cast<char*>(data.data()), data.size(), opCode, false, Sent);
+  }
+  return message;
+}
+
+void Dashboard::Flush() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushing_.swap(pending_);
+  }
+  // Each update is framed once in each encoding, for all the subscribers
+  // that take it.
+  prepared_.clear();
+  for (const auto& update : flushing_) {
+    prepared_.push_back(Prepared{update.first, update.second.get(), nullptr,
+                                 nullptr, nullptr});
+  }
+  // Closing may unsubscribe on the spot, so the slow are closed after.
+  std::vector<Subscriber*> slow;
+  for (Subscriber* subscriber : subscribers_) {
+    if (subscriber->closing) {
+      continue;
+    }
+    bool corked = false;
+    for (Prepared& prepared : prepared_) {
+      if (subscriber->inFlight >= MAX_IN_FLIGHT) {
+        if (++subscriber->missed == MAX_MISSED) {
+          subscriber->closing = true;
+          slow.push_back(subscriber);
+          break;
+        }
+        continue;
+      }
+      // Published before the first subscriber of its kind came.
+      const Update& update = *prepared.update;
+      if ((subscriber->compact ? update.key : update.json).empty()) {
+        continue;
+      }
+      if (cork_ && !corked) {
+        corked = SetCork(subscriber->fd, true);
+      }
+      uWS::WebSocket<uWS::SERVER>::PreparedMessage* message;
+      if (!subscriber->compact) {
+        message = Prepare(prepared.json, update.json, uWS::OpCode::TEXT);
+      } else {
+        uint64_t& sent = subscriber->sequences[prepared.session];
+        bool delta = !update.delta.empty() && sent + 1 == update.sequence;
+        message = delta ? Prepare(prepared.delta, update.delta,
+                                  uWS::OpCode::BINARY)
+                        : Prepare(prepared.key, update.key,
+                                  uWS::OpCode::BINARY);
+        sent = update.sequence;
+      }
+      subscriber->missed = 0;
+      subscriber->inFlight++;
+      subscriber->ws.sendPrepared(message, subscriber);
+    }
+    if (corked) {
+      SetCork(subscriber->fd, false);
+    }
+  }
+  for (Prepared& prepared : prepared_) {
+    uWS::WebSocket<uWS::SERVER>::PreparedMessage* messages[3] = {
+        prepared.json, prepared.key, prepared.delta};
+    for (uWS::WebSocket<uWS::SERVER>::PreparedMessage* message : messages) {
+      if (message) {
+        uWS::WebSocket<uWS::SERVER>::finalizeMessage(message);
+      }
+    }
+  }
+  flushing_.clear();
+  for (Subscriber* subscriber : slow) {
+    subscriber->ws.close(1008);
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <uWS/uWS.h>
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TrajectoryCodec.h"
+
+// The predicted trajectories of every session, streamed to the dashboard
+// websocket clients of one event loop.
+//
+// A session's trajectory is published from its worker between frames, once
+// its reply is on the way, and serialized there once for all the dashboards.
+// Each event loop then frames it once as a prepared message and sends it to
+// its subscribers. Updates waiting for the loop are latest-wins per
+// session, and a subscriber with MAX_IN_FLIGHT messages not yet written out
+// misses updates until it catches up, or is closed once it has missed
+// MAX_MISSED in a row, so a slow dashboard never holds up the loop, let
+// alone a solve. Publishing costs nothing while no dashboard is connected.
+// With `cork`, a subscriber's updates of one flush are written corked, see
+// SetCork, and go out in as few segments as they fit.
+//
+// A compact subscriber is sent the updates as TrajectoryCodec has them
+// instead of JSON: a delta when it was sent the session's update before,
+// and a key frame when it wasn't, having missed it or just subscribed. Each
+// encoding is built only while a subscriber takes it, and framed once for
+// all those that do.
+class Dashboard {
+ public:
+  static const unsigned MAX_IN_FLIGHT = 8;
+  static const unsigned MAX_MISSED = 200;
+
+  // On the thread of `loop`, before it runs; the loop outlives it.
+  Dashboard(uv_loop_t* loop, bool cork);
+  ~Dashboard();
+  Dashboard(const Dashboard&) = delete;
+  Dashboard& operator=(const Dashboard&) = delete;
+
+  // Stream to `ws`, which is given a user data of its own, compact or as
+  // JSON; event loop thread.
+  void Subscribe(uWS::WebSocket<uWS::SERVER> ws, bool compact);
+  // Whether `user_data` is a subscriber's; event loop thread.
+  bool IsSubscriber(const void* user_data) const;
+  // Stop streaming to subscriber `ws` as it disconnects; event loop thread.
+  void Unsubscribe(uWS::WebSocket<uWS::SERVER> ws);
+
+  // Whether any dashboard is connected, on any loop.
+  static bool Watched() {
+    return watchers_.load(std::memory_order_relaxed) > 0;
+  }
+  // Stream `points` of the trajectory of session `id`, in car coordinates,
+  // and its actuations, as
+  //
+  //   {"session":id,"steering_angle":...,"throttle":...,"x":[...],"y":[...]}
+  //
+  // or through the session's `encoder`. Any thread, one at a time for a
+  // session.
+  static void Publish(unsigned id, TrajectoryEncoder& encoder,
+                      double steering, double throttle, const double* x,
+                      const double* y, size_t points);
+
+ private:
+  struct Subscriber {
+    uWS::WebSocket<uWS::SERVER> ws;
+    int fd;
+    // Messages sent but not yet written out, and updates missed in a row.
+    unsigned inFlight;
+    unsigned missed;
+    // Compact, and the number of the update of each session sent last.
+    bool compact;
+    std::map<unsigned, uint64_t> sequences;
+    // Closed for being too slow, and unsubscribed; freed once both
+    // unsubscribed and no message refers to it.
+    bool closing;
+    bool gone;
+  };
+
+  // An update in the encodings watched when it was published.
+  struct Update {
+    std::string json;
+    std::string key;
+    std::string delta;
+    uint64_t sequence;
+  };
+  // Its encodings framed, each once some subscriber takes it.
+  struct Prepared {
+    unsigned session;
+    const Update* update;
+    uWS::WebSocket<uWS::SERVER>::PreparedMessage* json;
+    uWS::WebSocket<uWS::SERVER>::PreparedMessage* key;
+    uWS::WebSocket<uWS::SERVER>::PreparedMessage* delta;
+  };
+
+  void Flush();
+  static uWS::WebSocket<uWS::SERVER>::PreparedMessage* Prepare(
+      uWS::WebSocket<uWS::SERVER>::PreparedMessage*& message,
+      const std::string& data, uWS::OpCode opCode);
+  static void Sent(void* web_socket, void* data, bool cancelled);
+
+  uv_async_t async_;
+  bool cork_;
+  // Under mutex_, from any thread.
+  std::mutex mutex_;
+  std::map<unsigned, std::shared_ptr<const Update>> pending_;
+  // Event loop thread only.
+  std::map<unsigned, std::shared_ptr<const Update>> flushing_;
+  std::vector<Prepared> prepared_;
+  std::vector<Subscriber*> subscribers_;
+  std::atomic<size_t> watching_;
+
+  // The dashboards of all loops, under registry_mutex_.
+  static std::mutex registry_mutex_;
+  static std::vector<Dashboard*> registry_;
+  static std::atomic<size_t> watchers_;
+  static std::atomic<size_t> compact_watchers_;
+};
+
+#endif /* DASHBOARD_H */
@@ -0,0 +1,113 @@
+#include "DegradationLadder.h"
+#include <algorithm>
+#include "Checkpoint.h"
+
+DegradationLadder::DegradationLadder(size_t window)
+    : stepDownRate(0.2), stepUpRate(0), tier_(FULL_NMPC), floor_(FULL_NMPC),
+      history_(window, 0), window_(window), next_(0), count_(0), misses_(0),
+      move_rate_(0), frames_(NUM_TIERS, 0), step_downs_(NUM_TIERS, 0),
+      step_ups_(NUM_TIERS, 0) {}
+
+double DegradationLadder::missRate() const {
+  return count_ == 0 ? 0 : double(misses_) / count_;
+}
+
+bool DegradationLadder::Record(bool missed) {
+  frames_[tier_]++;
+  if (count_ == window_) {
+    misses_ -= history_[next_];
+  } else {
+    count_++;
+  }
+  history_[next_] = missed;
+  misses_ += missed;
+  next_ = (next_ + 1) % window_;
+
+  // A partial window can already be bad enough to step down, but stepping
+  // up needs the full window.
+  if (tier_ + 1 < NUM_TIERS && misses_ >= stepDownRate * window_) {
+    step_downs_[tier_]++;
+    Move(Tier(tier_ + 1));
+    return true;
+  }
+  if (tier_ > floor_ && count_ == window_ && missRate() <= stepUpRate) {
+    step_ups_[tier_]++;
+    Move(Tier(tier_ - 1));
+    return true;
+  }
+  return false;
+}
+
+void DegradationLadder::SetFloor(Tier floor) {
+  floor_ = floor;
+  if (tier_ < floor_) {
+    tier_ = floor_;
+    next_ = 0;
+    count_ = 0;
+    misses_ = 0;
+  }
+}
+
+void DegradationLadder::Move(Tier tier) {
+  move_rate_ = missRate();
+  tier_ = tier;
+  next_ = 0;
+  count_ = 0;
+  misses_ = 0;
+}
+
+const char* DegradationLadder::Name(Tier tier) {
+  switch (tier) {
+    case FULL_NMPC:
+      return "full NMPC";
+    case SHORT_HORIZON:
+      return "short horizon";
+    case RTI_STEP:
+      return "RTI";
+    case LTV_QP:
+      return "LTV QP";
+    case LQR_FALLBACK:
+      return "LQR";
+    default:
+      return "unknown";
+  }
+}
+
+void DegradationLadder::Checkpoint(CheckpointWriter& out) const {
+  out.Count(tier_);
+  out.Double(move_rate_);
+  // The window from its oldest frame.
+  size_t oldest = (next_ + window_ - count_) % window_;
+  out.Count(count_);
+  for (size_t i = 0; i < count_; i++) {
+    out.Count(history_[(oldest + i) % window_]);
+  }
+}
+
+bool DegradationLadder::Restore(CheckpointReader& in) {
+  size_t tier;
+  double move_rate;
+  size_t count;
+  if (!in.Count(tier) || !in.Double(move_rate) || !in.Count(count) ||
+      tier >= NUM_TIERS) {
+    return false;
+  }
+  std::vector<char> window(count);
+  for (size_t i = 0; i < count; i++) {
+    size_t missed;
+    if (!in.Count(missed)) {
+      return false;
+    }
+    window[i] = missed != 0;
+  }
+  tier_ = Tier(tier);
+  move_rate_ = move_rate;
+  count_ = std::min(count, window_);
+  misses_ = 0;
+  for (size_t i = 0; i < count_; i++) {
+    history_[i] = window[count - count_ + i];
+    misses_ += history_[i];
+  }
+  next_ = count_ % window_;
+  return true;
+}
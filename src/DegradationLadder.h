@@ -0,0 +1,80 @@
+#ifndef DEGRADATION_LADDER_H
+#define DEGRADATION_LADDER_H
+
+#include <cstddef>
+#include <vector>
+
+class CheckpointReader;
+class CheckpointWriter;
+
+// Steps the controller down through cheaper modes while solves miss their
+// deadline, and back up once there is headroom again.
+//
+// The rate of misses over the last `window` frames drives the tier: at or
+// above stepDownRate the ladder moves one tier down, and after a full window
+// at or below stepUpRate it moves one tier up. The window restarts on every
+// move, so each tier gets a fair measurement.
+//
+// A floor set from outside, by admission control, holds the ladder at that
+// tier or below whatever the misses say.
+class DegradationLadder {
+ public:
+  enum Tier {
+    FULL_NMPC,
+    SHORT_HORIZON,
+    RTI_STEP,
+    LTV_QP,
+    LQR_FALLBACK,
+    NUM_TIERS
+  };
+
+  explicit DegradationLadder(size_t window = 20);
+
+  double stepDownRate;
+  double stepUpRate;
+
+  Tier tier() const { return tier_; }
+  Tier floor() const { return floor_; }
+  // Hold the ladder at `floor` or below, stepping down to it at once if it
+  // is above; FULL_NMPC lifts the floor. Not a move.
+  void SetFloor(Tier floor);
+  // Fraction of the frames in the current window that missed.
+  double missRate() const;
+
+  // Record whether a frame missed its deadline. Returns true if that moved
+  // the ladder.
+  bool Record(bool missed);
+  // The miss rate that caused the last move.
+  double moveRate() const { return move_rate_; }
+
+  // Counters, by tier: frames run, and moves down from and up from it.
+  size_t frames(Tier tier) const { return frames_[tier]; }
+  size_t stepDowns(Tier tier) const { return step_downs_[tier]; }
+  size_t stepUps(Tier tier) const { return step_ups_[tier]; }
+
+  static const char* Name(Tier tier);
+
+  // Write the tier and the window so far into a checkpoint, and read them
+  // back, the newest that fit if the window is shorter here. The counters
+  // stay with the server that counted them.
+  void Checkpoint(CheckpointWriter& out) const;
+  bool Restore(CheckpointReader& in);
+
+ private:
+  void Move(Tier tier);
+
+  Tier tier_;
+  Tier floor_;
+  // Ring buffer of the last window_ frames, 1 for a miss.
+  std::vector<char> history_;
+  size_t window_;
+  size_t next_;
+  size_t count_;
+  size_t misses_;
+  double move_rate_;
+  std::vector<size_t> frames_;
+  std::vector<size_t> step_downs_;
+  std::vector<size_t> step_ups_;
+};
+
+#endif /* DEGRADATION_LADDER_H */
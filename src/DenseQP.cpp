@@ -0,0 +1,131 @@
+#include "DenseQP.h"
+#include <algorithm>
+#include <cmath>
+#include "Precision.h"
+
+// As in SparseQP.
+static const int CHECK_INTERVAL = 5;
+static const double RHO_ADAPT_FACTOR = 5;
+static const double RHO_MIN = 1e-6;
+static const double RHO_MAX = 1e6;
+
+template <class Scalar>
+BasicDenseQP<Scalar>::BasicDenseQP()
+    : rho(0.1), sigma(1e-6), alpha(1.6), epsAbs(1e-4), epsRel(1e-4),
+      maxIterations(4000), fixedIterations(0), n_(0), rho_(0.1),
+      converged_(false), refine_(false) {}
+
+template <class Scalar>
+void BasicDenseQP<Scalar>::Resize(int n) {
+  n_ = n;
+  rho_ = rho;
+  M_ = Matrix::Zero(n, n);
+  llt_ = Eigen::LLT<Matrix>(n);
+  x_ = Vector::Zero(n);
+  z_ = Vector::Zero(n);
+  y_ = Vector::Zero(n);
+  xt_ = Vector::Zero(n);
+  hx_ = Vector::Zero(n);
+  refined_matrix_ = Eigen::MatrixXd::Zero(n, n);
+  refined_rhs_ = Eigen::VectorXd::Zero(n);
+  refined_ = Eigen::VectorXd::Zero(n);
+  residual_ = Eigen::VectorXd::Zero(n);
+}
+
+template <class Scalar>
+void BasicDenseQP<Scalar>::WarmStart(const Vector& x) {
+  x_ = x;
+  z_ = x;
+}
+
+template <class Scalar>
+int BasicDenseQP<Scalar>::Solve(const Matrix& H, const Vector& g,
+                                const Vector& lb, const Vector& ub) {
+  M_ = H;
+  M_.diagonal().array() += Scalar(sigma + rho_);
+  Factorize();
+
+  const Scalar s = sigma;
+  const Scalar a = alpha;
+  converged_ = false;
+  int limit = fixedIterations > 0 ? fixedIterations : maxIterations;
+  int iter = 0;
+  while (iter < limit) {
+    iter++;
+    Scalar r = rho_;
+    xt_ = s * x_ - g + r * z_ - y_;
+    SolveInPlace();
+
+    // With C = I, z~ = x~; xt_ becomes alpha * x~ + (1 - alpha) * z.
+    x_ = a * xt_ + (1 - a) * x_;
+    xt_ = a * xt_ + (1 - a) * z_;
+    z_ = (xt_ + y_ / r).cwiseMax(lb).cwiseMin(ub);
+    y_ += r * (xt_ - z_);
+
+    if (fixedIterations > 0 ? iter < limit : iter % CHECK_INTERVAL != 0) {
+      continue;
+    }
+    hx_.noalias() = H * x_;
+    double prim = (x_ - z_).template lpNorm<Eigen::Infinity>();
+    double dual = (hx_ + g + y_).template lpNorm<Eigen::Infinity>();
+    double prim_scale =
+        std::max(x_.template lpNorm<Eigen::Infinity>(),
+                 z_.template lpNorm<Eigen::Infinity>());
+    double dual_scale =
+        std::max(std::max(hx_.template lpNorm<Eigen::Infinity>(),
+                          y_.template lpNorm<Eigen::Infinity>()),
+                 g.template lpNorm<Eigen::Infinity>());
+    if (prim <= epsAbs + epsRel * prim_scale &&
+        dual <= epsAbs + epsRel * dual_scale) {
+      converged_ = true;
+      break;
+    }
+    if (fixedIterations > 0) {
+      break;
+    }
+
+    double ratio = std::sqrt((prim / (prim_scale + 1e-10)) /
+                             (dual / (dual_scale + 1e-10) + 1e-10));
+    double next = std::min(std::max(rho_ * ratio, RHO_MIN), RHO_MAX);
+    if (next > RHO_ADAPT_FACTOR * rho_ || next < rho_ / RHO_ADAPT_FACTOR) {
+      M_.diagonal().array() += Scalar(next - rho_);
+      rho_ = next;
+      Factorize();
+    }
+  }
+  return iter;
+}
+
+template <class Scalar>
+void BasicDenseQP<Scalar>::Factorize() {
+  llt_.compute(M_);
+  // The diagonal of L is the square root of the pivots.
+  double ratio = llt_.matrixLLT().diagonal().maxCoeff() /
+                 llt_.matrixLLT().diagonal().minCoeff();
+  refine_ = NeedsRefinement<Scalar>(ratio * ratio);
+  if (refine_) {
+    refined_matrix_ = M_.template cast<double>();
+  }
+}
+
+template <class Scalar>
+void BasicDenseQP<Scalar>::SolveInPlace() {
+  if (!refine_) {
+    llt_.solveInPlace(xt_);
+    return;
+  }
+  refined_rhs_ = xt_.template cast<double>();
+  llt_.solveInPlace(xt_);
+  refined_ = xt_.template cast<double>();
+  for (int step = 0; step < REFINEMENT_STEPS; step++) {
+    residual_ = refined_rhs_;
+    residual_.noalias() -= refined_matrix_ * refined_;
+    xt_ = residual_.cast<Scalar>();
+    llt_.solveInPlace(xt_);
+    refined_ += xt_.template cast<double>();
+  }
+  xt_ = refined_.cast<Scalar>();
+}
+
+template class BasicDenseQP<double>;
+template class BasicDenseQP<float>;
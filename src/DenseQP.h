@@ -0,0 +1,81 @@
+#ifndef DENSE_QP_H
+#define DENSE_QP_H
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// Box-constrained dense QP solver:
+//
+//   minimize    1/2 x' H x + g' x
+//   subject to  lb <= x <= ub
+//
+// by the same ADMM iteration as SparseQP with C = I. The KKT system then
+// reduces to H + (sigma + rho) I, which is factorized once per Solve() with a
+// dense Cholesky (LLT) into storage sized by Resize(); each iteration is a
+// pair of triangular solves.
+//
+// DenseQP.cpp instantiates the scalar double, DenseQP, and float. In float,
+// when the pivots of the factorization say it's too badly conditioned for
+// the tolerances (see Precision.h), each solve is refined with residuals of
+// H + (sigma + rho) I in double.
+template <class Scalar>
+class BasicDenseQP {
+ public:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+  BasicDenseQP();
+
+  // ADMM parameters, read by Solve().
+  double rho;
+  double sigma;
+  double alpha;
+  double epsAbs;
+  double epsRel;
+  int maxIterations;
+  // Run exactly this many iterations, at rho as it stands, checking the
+  // tolerances only after the last; 0 to iterate to the tolerances.
+  int fixedIterations;
+
+  // Allocate for n variables and reset the iterate.
+  void Resize(int n);
+
+  // Start the next Solve() from x. The multipliers are kept.
+  void WarmStart(const Vector& x);
+
+  // Run ADMM from the current iterate and return the number of iterations.
+  int Solve(const Matrix& H, const Vector& g, const Vector& lb,
+            const Vector& ub);
+
+  // Whether the last Solve() met the tolerances before maxIterations.
+  bool converged() const { return converged_; }
+  const Vector& solution() const { return x_; }
+
+ private:
+  // Factorize M_, and decide whether its solves need refining.
+  void Factorize();
+  // xt_ = M_^-1 xt_.
+  void SolveInPlace();
+
+  int n_;
+  // rho as adapted by the last Solve().
+  double rho_;
+  bool converged_;
+  Matrix M_;
+  Eigen::LLT<Matrix> llt_;
+  Vector x_;
+  Vector z_;
+  Vector y_;
+  Vector xt_;
+  Vector hx_;
+  // M_ in double, and the solve being refined, while refine_.
+  bool refine_;
+  Eigen::MatrixXd refined_matrix_;
+  Eigen::VectorXd refined_rhs_;
+  Eigen::VectorXd refined_;
+  Eigen::VectorXd residual_;
+};
+
+typedef BasicDenseQP<double> DenseQP;
+
+#endif /* DENSE_QP_H */
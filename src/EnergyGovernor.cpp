@@ -0,0 +1,77 @@
+#include "EnergyGovernor.h"
+#include <algorithm>
+
+const size_t EnergyGovernor::MAX_BACKOFF;
+
+EnergyGovernor::EnergyGovernor(size_t window)
+    : errorBound(0.5), headroom(0.5), tier_(DegradationLadder::FULL_NMPC),
+      window_(std::max<size_t>(window, 4)), count_(0), error_sum_(0),
+      move_error_(0),
+      backoff_(DegradationLadder::NUM_TIERS, 1),
+      joules_(DegradationLadder::NUM_TIERS, 0),
+      metered_(DegradationLadder::NUM_TIERS, 0),
+      frames_(DegradationLadder::NUM_TIERS, 0),
+      step_downs_(DegradationLadder::NUM_TIERS, 0),
+      step_ups_(DegradationLadder::NUM_TIERS, 0) {}
+
+double EnergyGovernor::meanError() const {
+  return count_ == 0 ? 0 : error_sum_ / count_;
+}
+
+double EnergyGovernor::joules(Tier tier) const {
+  return metered_[tier] == 0 ? -1 : joules_[tier] / metered_[tier];
+}
+
+bool EnergyGovernor::Record(Tier tier, double error, double joules) {
+  frames_[tier]++;
+  if (joules >= 0) {
+    joules_[tier] += joules;
+    metered_[tier]++;
+  }
+  count_++;
+  error_sum_ += error;
+
+  if (tier_ > DegradationLadder::FULL_NMPC && 4 * count_ >= window_ &&
+      meanError() >= errorBound) {
+    step_ups_[tier_]++;
+    Tier up = Tier(tier_ - 1);
+    backoff_[up] = std::min(2 * backoff_[up], MAX_BACKOFF);
+    Move(up);
+    return true;
+  }
+  if (count_ < window_ * backoff_[tier_]) {
+    return false;
+  }
+  if (meanError() >= headroom * errorBound) {
+    // Not worth trying cheaper yet.
+    Restart();
+    return false;
+  }
+  // The next tier down that hasn't cost more than this one.
+  double current = this->joules(tier_);
+  for (int next = tier_ + 1; next < DegradationLadder::NUM_TIERS; next++) {
+    double cost = this->joules(Tier(next));
+    if (current < 0 || cost < 0 || cost < current) {
+      step_downs_[tier_]++;
+      // This tier held, so stepping down to it did too.
+      if (tier_ > DegradationLadder::FULL_NMPC) {
+        backoff_[tier_ - 1] = 1;
+      }
+      Move(Tier(next));
+      return true;
+    }
+  }
+  Restart();
+  return false;
+}
+
+void EnergyGovernor::Move(Tier tier) {
+  move_error_ = meanError();
+  tier_ = tier;
+  Restart();
+}
+
+void EnergyGovernor::Restart() {
+  count_ = 0;
+  error_sum_ = 0;
+}
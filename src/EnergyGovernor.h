@@ -0,0 +1,68 @@
+#ifndef ENERGY_GOVERNOR_H
+#define ENERGY_GOVERNOR_H
+
+#include <cstddef>
+#include <vector>
+#include "DegradationLadder.h"
+
+// Holds the controller at the cheapest tier of the DegradationLadder that
+// keeps the tracking error within a bound, for units on battery, where the
+// energy of a frame's solve counts as much as its time.
+//
+// After a window of frames whose mean error is below `headroom` of the
+// bound, the governor steps to the next cheaper tier, passing over those
+// that have used no less energy per solve than the current one. Once the
+// mean over a quarter window or more reaches the bound, it steps back up a
+// tier, which then waits twice as many windows before stepping down again,
+// up to MAX_BACKOFF, until the tier below it holds. Each tier's mean
+// energy per solve is learned from the solves run at it; without an
+// EnergyMeter, the tiers are taken to cost in their order.
+class EnergyGovernor {
+ public:
+  typedef DegradationLadder::Tier Tier;
+  static const size_t MAX_BACKOFF = 16;
+
+  explicit EnergyGovernor(size_t window = 50);
+
+  // Meters of |cte|.
+  double errorBound;
+  double headroom;
+
+  Tier tier() const { return tier_; }
+  // The mean error of the current window.
+  double meanError() const;
+
+  // Record a frame solved at `tier`, normally tier(), with the car `error`
+  // off the path and `joules` used by the solve, negative if unmetered.
+  // Returns true if that moved the governor.
+  bool Record(Tier tier, double error, double joules);
+  // The mean error that caused the last move.
+  double moveError() const { return move_error_; }
+
+  // By tier: the mean joules per metered solve, negative if none was, and
+  // the frames run and moves down from and up from it.
+  double joules(Tier tier) const;
+  size_t frames(Tier tier) const { return frames_[tier]; }
+  size_t stepDowns(Tier tier) const { return step_downs_[tier]; }
+  size_t stepUps(Tier tier) const { return step_ups_[tier]; }
+
+ private:
+  void Move(Tier tier);
+  // A new window at the same tier.
+  void Restart();
+
+  Tier tier_;
+  size_t window_;
+  size_t count_;
+  double error_sum_;
+  double move_error_;
+  // Windows each tier waits before stepping down from it.
+  std::vector<size_t> backoff_;
+  std::vector<double> joules_;
+  std::vector<size_t> metered_;
+  std::vector<size_t> frames_;
+  std::vector<size_t> step_downs_;
+  std::vector<size_t> step_ups_;
+};
+
+#endif /* ENERGY_GOVERNOR_H */
@@ -0,0 +1,149 @@
+#include "EnergyMeter.h"
+#include <cstdlib>
+#include <fstream>
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char POWERCAP[] = "/sys/class/powercap/";
+const char HWMON[] = "/sys/class/hwmon/";
+
+std::string ReadLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// The entries of `directory` that start with `prefix`.
+std::vector<std::string> List(const std::string& directory,
+                              const std::string& prefix) {
+  std::vector<std::string> names;
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) {
+    return names;
+  }
+  while (dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.compare(0, prefix.size(), prefix) == 0) {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  return names;
+}
+
+}  // namespace
+
+#endif
+
+EnergyMeter::EnergyMeter() : total_(0) {}
+
+EnergyMeter::~EnergyMeter() {
+#ifdef __linux__
+  for (const Counter& counter : counters_) {
+    close(counter.fd);
+  }
+#endif
+}
+
+#ifdef __linux__
+
+bool EnergyMeter::Open() {
+  // The zones of the packages and of the platform, intel-rapl:0 and so on;
+  // their subzones, the cores and dram, count towards the package's.
+  std::vector<std::string> packages;
+  std::string psys;
+  for (const std::string& zone : List(POWERCAP, "intel-rapl:")) {
+    if (zone.find(':', sizeof("intel-rapl")) != std::string::npos) {
+      continue;
+    }
+    std::string name = ReadLine(POWERCAP + zone + "/name");
+    if (name == "psys") {
+      psys = zone;
+    } else if (name.compare(0, 7, "package") == 0) {
+      packages.push_back(zone);
+    }
+  }
+  // The platform's counter covers the packages.
+  if (!psys.empty()) {
+    packages.assign(1, psys);
+  }
+  std::vector<std::string> paths;
+  std::vector<uint64_t> ranges;
+  for (const std::string& zone : packages) {
+    paths.push_back(POWERCAP + zone + "/energy_uj");
+    ranges.push_back(
+        strtoull(ReadLine(POWERCAP + zone + "/max_energy_range_uj").c_str(),
+                 nullptr, 10));
+  }
+  source_ = psys.empty() ? "rapl package" : "rapl psys";
+  if (paths.empty()) {
+    for (const std::string& hwmon : List(HWMON, "hwmon")) {
+      for (const std::string& input : List(HWMON + hwmon, "energy")) {
+        if (input.size() > 6 &&
+            input.compare(input.size() - 6, 6, "_input") == 0) {
+          paths.push_back(HWMON + hwmon + "/" + input);
+          ranges.push_back(0);
+        }
+      }
+    }
+    source_ = "hwmon";
+  }
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    Counter counter = {open(paths[i].c_str(), O_RDONLY | O_CLOEXEC),
+                       ranges[i], 0};
+    if (counter.fd < 0) {
+      continue;
+    }
+    if (!Read(counter, counter.last)) {
+      close(counter.fd);
+      continue;
+    }
+    counters_.push_back(counter);
+  }
+  source_ += " x" + std::to_string(counters_.size());
+  total_ = 0;
+  return available();
+}
+
+bool EnergyMeter::Read(const Counter& counter, uint64_t& microjoules) const {
+  char text[32];
+  ssize_t n = pread(counter.fd, text, sizeof(text) - 1, 0);
+  if (n <= 0) {
+    return false;
+  }
+  text[n] = 0;
+  char* end;
+  microjoules = strtoull(text, &end, 10);
+  return end != text;
+}
+
+double EnergyMeter::Joules() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Counter& counter : counters_) {
+    uint64_t now;
+    if (!Read(counter, now)) {
+      continue;
+    }
+    if (now >= counter.last) {
+      total_ += now - counter.last;
+    } else if (counter.range > counter.last) {
+      total_ += counter.range - counter.last + now;
+    }
+    counter.last = now;
+  }
+  return total_ * 1e-6;
+}
+
+#else
+
+bool EnergyMeter::Open() { return false; }
+bool EnergyMeter::Read(const Counter&, uint64_t&) const { return false; }
+double EnergyMeter::Joules() { return 0; }
+
+#endif
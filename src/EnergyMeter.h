@@ -0,0 +1,54 @@
+#ifndef ENERGY_METER_H
+#define ENERGY_METER_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The energy the CPU has used, from the counters the platform keeps: RAPL
+// through powercap, the platform's psys domain where there is one and the
+// packages' otherwise, or else the energy inputs of hwmon, as on ARM boards
+// and AMD's amd_energy. Linux only. Since 5.10 the RAPL counters are only
+// readable by root, unless their mode is changed.
+//
+// The counters are for the whole package, not a thread, so the joules over
+// a solve are the solve's only while nothing else runs; with several
+// sessions solving at once, each solve is charged the package's energy
+// meanwhile.
+class EnergyMeter {
+ public:
+  EnergyMeter();
+  ~EnergyMeter();
+  EnergyMeter(const EnergyMeter&) = delete;
+  EnergyMeter& operator=(const EnergyMeter&) = delete;
+
+  // Find and open the counters. False if there are none this process can
+  // read.
+  bool Open();
+  bool available() const { return !counters_.empty(); }
+  // "rapl psys", "rapl package" or "hwmon", with the counters' count.
+  const std::string& source() const { return source_; }
+
+  // Joules since Open, over every counter, with their wraps counted as
+  // long as they are read at least once a wrap, minutes apart at the
+  // least. 0 without counters. Thread safe; a pread(2) per counter.
+  double Joules();
+
+ private:
+  struct Counter {
+    int fd;
+    // Microjoules at which the counter wraps to 0; 0 if it doesn't.
+    uint64_t range;
+    uint64_t last;
+  };
+
+  bool Read(const Counter& counter, uint64_t& microjoules) const;
+
+  std::vector<Counter> counters_;
+  std::string source_;
+  std::mutex mutex_;
+  uint64_t total_;
+};
+
+#endif /* ENERGY_METER_H */
@@ -0,0 +1,69 @@
+#include "FarmClient.h"
+#include <cmath>
+#include "BinaryProtocol.h"
+
+// The deadline tag in seconds of the steady clock.
+static double Seconds(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double>(t.time_since_epoch()).count();
+}
+
+// Whether the actuations of an outcome, as MPC::Status numbers them, are
+// worth taking: CONVERGED and BEST_FEASIBLE. Numbered here to keep Ipopt's
+// headers off the vehicle.
+static bool Usable(int status) { return status == 0 || status == 2; }
+
+FarmClient::FarmClient(const MpcConfig& config)
+    : fallbackReserve(0.001),
+      fallback_(config.N, config.dt, config.Lf, config.refV, config.weights),
+      sequence_(0), last_remote_(false), remote_(0), fallbacks_(0) {}
+
+bool FarmClient::Connect(const char* host, int port) {
+  return channel_.Connect(host, port);
+}
+
+Input FarmClient::Solve(const State& state, const Cubic& coeffs,
+                        std::chrono::steady_clock::time_point deadline) {
+  auto now = std::chrono::steady_clock::now();
+  auto wait_until =
+      deadline -
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(fallbackReserve));
+  BinaryProblem problem;
+  problem.deadline = Seconds(deadline);
+  problem.budget = std::chrono::duration<double>(wait_until - now).count();
+  for (int i = 0; i < 6; i++) {
+    problem.state[i] = state[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    problem.coeffs[i] = coeffs[i];
+  }
+  WriteBinaryProblem(msg_, problem);
+  uint32_t sequence = ++sequence_;
+  last_remote_ = false;
+  bool waiting = problem.budget > 0 && channel_.Send(0, sequence, msg_);
+  while (waiting && (now = std::chrono::steady_clock::now()) < wait_until) {
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       wait_until - now) +
+                   std::chrono::milliseconds(1);
+    size_t n = channel_.ReceiveLatest(replies_, timeout);
+    for (size_t i = 0; i < n; i++) {
+      BinaryActuation actuation;
+      const std::string& m = replies_[i].message;
+      // Answers to earlier problems came too late.
+      if (replies_[i].peer != 0 || replies_[i].sequence != sequence ||
+          !ParseBinaryActuation(m.data(), m.data() + m.size(), actuation) ||
+          actuation.deadline != problem.deadline) {
+        continue;
+      }
+      waiting = false;
+      if (Usable(actuation.status) &&
+          std::chrono::steady_clock::now() <= deadline) {
+        last_remote_ = true;
+        remote_++;
+        return Input(actuation.delta, actuation.a);
+      }
+    }
+  }
+  fallbacks_++;
+  return fallback_.Law(state, coeffs);
+}
@@ -0,0 +1,55 @@
+#ifndef FARM_CLIENT_H
+#define FARM_CLIENT_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BicycleModel.h"
+#include "LQR.h"
+#include "MpcConfig.h"
+#include "UdpChannel.h"
+
+// The vehicle's side of a SolverFarm: its frame, fitted and predicted here
+// as PrepareFrame does, goes to the farm as a BinaryProblem, and the farm's
+// actuations are taken if they come back by the deadline. If they don't,
+// or the farm's solve failed, the vehicle answers from a LateralLQR of its
+// own tuning, which costs microseconds, so that a frame is always answered
+// in time. Nothing here needs Ipopt. Not thread-safe.
+class FarmClient {
+ public:
+  explicit FarmClient(const MpcConfig& config = MpcConfig());
+
+  FarmClient(const FarmClient&) = delete;
+  FarmClient& operator=(const FarmClient&) = delete;
+
+  // Talk to the farm at `host`, an IPv4 address, and `port`.
+  bool Connect(const char* host, int port);
+
+  // Seconds before the deadline that the wait for the farm ends, for the
+  // fallback.
+  double fallbackReserve;
+
+  // The actuations {delta, a} for the car at `state` on the path `coeffs`,
+  // in the model's units as MPC::Solve takes them, by `deadline`.
+  Input Solve(const State& state, const Cubic& coeffs,
+              std::chrono::steady_clock::time_point deadline);
+
+  // Whether the farm answered the last Solve, and the frames answered by
+  // the farm and by the fallback.
+  bool lastRemote() const { return last_remote_; }
+  uint64_t remote() const { return remote_; }
+  uint64_t fallbacks() const { return fallbacks_; }
+
+ private:
+  UdpChannel channel_;
+  LateralLQR fallback_;
+  uint32_t sequence_;
+  std::string msg_;
+  std::vector<UdpChannel::Datagram> replies_;
+  bool last_remote_;
+  uint64_t remote_;
+  uint64_t fallbacks_;
+};
+
+#endif /* FARM_CLIENT_H */
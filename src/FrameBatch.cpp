@@ -0,0 +1,174 @@
+#include "FrameBatch.h"
+#include <algorithm>
+#include <chrono>
+#include "Stages.h"
+
+// Room for the last block to be filled out.
+static size_t Padded(size_t capacity) {
+  return (capacity + FrameBatch::BLOCK - 1) / FrameBatch::BLOCK *
+         FrameBatch::BLOCK;
+}
+
+FrameBatch::FrameBatch(size_t capacity)
+    : capacity_(capacity), size_(0), x_(Padded(capacity), WAYPOINTS),
+      y_(Padded(capacity), WAYPOINTS), px_(Padded(capacity)),
+      py_(Padded(capacity)), psi_(Padded(capacity)), v_(Padded(capacity)),
+      delta_(Padded(capacity)), a_(Padded(capacity)),
+      latency_(Padded(capacity)), cos_(Padded(capacity)),
+      sin_(Padded(capacity)), coeffs_(Padded(capacity), 4),
+      state_(Padded(capacity), 6) {}
+
+size_t FrameBatch::Add(const Telemetry& t) {
+  size_t i = size_++;
+  for (int j = 0; j < WAYPOINTS; j++) {
+    x_(i, j) = t.ptsx[j];
+    y_(i, j) = t.ptsy[j];
+  }
+  px_[i] = t.px;
+  py_[i] = t.py;
+  psi_[i] = t.psi;
+  v_[i] = t.v;
+  delta_[i] = t.delta;
+  a_[i] = t.a;
+  latency_[i] = t.latency;
+  return i;
+}
+
+void FrameBatch::Prepare(double Lf) {
+  const size_t n = size_;
+  if (n == 0) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  // The last block is filled out with copies of the first frame.
+  size_t padded = (n + BLOCK - 1) / BLOCK * BLOCK;
+  for (size_t i = n; i < padded; i++) {
+    x_.row(i) = x_.row(0);
+    y_.row(i) = y_.row(0);
+    px_[i] = px_[0];
+    py_[i] = py_[0];
+    psi_[i] = psi_[0];
+    v_[i] = v_[0];
+    delta_[i] = delta_[0];
+    a_[i] = a_[0];
+    latency_[i] = latency_[0];
+  }
+  // sin, cos and atan of doubles aren't vectorized, so they go first over
+  // the whole batch.
+  cos_.head(padded) = psi_.head(padded).cos();
+  sin_.head(padded) = psi_.head(padded).sin();
+
+  for (size_t b = 0; b < padded; b += BLOCK) {
+    // ToVehicleFrame, then the scaled abscissae.
+    Lanes c = cos_.segment<BLOCK>(b);
+    Lanes s = sin_.segment<BLOCK>(b);
+    Lanes u[WAYPOINTS];
+    Lanes y[WAYPOINTS];
+    Lanes scale = Lanes::Zero();
+    for (int j = 0; j < WAYPOINTS; j++) {
+      Lanes dx = x_.col(j).segment<BLOCK>(b) - px_.segment<BLOCK>(b);
+      Lanes dy = y_.col(j).segment<BLOCK>(b) - py_.segment<BLOCK>(b);
+      u[j] = dx * c + dy * s;
+      y[j] = dy * c - dx * s;
+      scale = scale.max(u[j].abs());
+    }
+    scale = (scale == 0).select(1.0, scale);
+    Lanes inverse = scale.inverse();
+
+    // The power sums of the normal equations M(i, j) = sums[i + j], and
+    // their right-hand sides.
+    Lanes sums[7];
+    Lanes z[4];
+    for (int k = 0; k < 7; k++) {
+      sums[k].setZero();
+    }
+    for (int k = 0; k < 4; k++) {
+      z[k].setZero();
+    }
+    for (int j = 0; j < WAYPOINTS; j++) {
+      Lanes uj = u[j] * inverse;
+      Lanes power = Lanes::Ones();
+      for (int k = 0; k < 7; k++) {
+        sums[k] += power;
+        if (k < 4) {
+          z[k] += power * y[j];
+        }
+        power *= uj;
+      }
+    }
+
+    // M = L D L^T, L unit lower triangular, then forward, diagonal and back
+    // substitution.
+    Lanes L[4][4];
+    Lanes D[4];
+    for (int i = 0; i < 4; i++) {
+      D[i] = sums[2 * i];
+      for (int k = 0; k < i; k++) {
+        D[i] -= L[i][k].square() * D[k];
+      }
+      for (int j = i + 1; j < 4; j++) {
+        L[j][i] = sums[i + j];
+        for (int k = 0; k < i; k++) {
+          L[j][i] -= L[j][k] * L[i][k] * D[k];
+        }
+        L[j][i] /= D[i];
+      }
+    }
+    for (int i = 1; i < 4; i++) {
+      for (int k = 0; k < i; k++) {
+        z[i] -= L[i][k] * z[k];
+      }
+    }
+    for (int i = 0; i < 4; i++) {
+      z[i] /= D[i];
+    }
+    for (int i = 2; i >= 0; i--) {
+      for (int k = i + 1; k < 4; k++) {
+        z[i] -= L[k][i] * z[k];
+      }
+    }
+    // Back from the scaled abscissae.
+    Lanes power = Lanes::Ones();
+    for (int i = 0; i < 4; i++) {
+      coeffs_.col(i).segment<BLOCK>(b) = z[i] * power;
+      power *= inverse;
+    }
+  }
+  auto fitted = std::chrono::steady_clock::now();
+
+  // PredictState, with cte and epsi at the car.
+  auto cte = coeffs_.col(0).head(padded);
+  auto epsi = cos_.head(padded);
+  epsi = -coeffs_.col(1).head(padded).atan();
+  auto v = v_.head(padded);
+  auto latency = latency_.head(padded);
+  auto turn = sin_.head(padded);
+  turn = v * delta_.head(padded) / Lf * latency;
+  state_.col(0).head(padded) = v * latency;
+  state_.col(1).head(padded).setZero();
+  state_.col(2).head(padded) = -turn;
+  state_.col(3).head(padded) = v + a_.head(padded) * latency;
+  state_.col(4).head(padded) = cte + v * epsi.sin() * latency;
+  state_.col(5).head(padded) = epsi - turn;
+
+  // Each frame's share, as FitWorld records them one frame at a time; the
+  // prediction goes in with the fit.
+  auto now = std::chrono::steady_clock::now();
+  double fit = std::chrono::duration<double>(fitted - start).count() / n;
+  double predict = std::chrono::duration<double>(now - fitted).count() / n;
+  for (size_t i = 0; i < n; i++) {
+    RecordStage(STAGE_POLYFIT, fit + predict);
+  }
+}
+
+void FrameBatch::Coeffs(size_t i, double coeffs[4]) const {
+  for (int k = 0; k < 4; k++) {
+    coeffs[k] = coeffs_(i, k);
+  }
+}
+
+void FrameBatch::State(size_t i, double state[6]) const {
+  for (int k = 0; k < 6; k++) {
+    state[k] = state_(i, k);
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef FRAME_BATCH_H
+#define FRAME_BATCH_H
+
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+#include "Telemetry.h"
+
+// The preparation of many frames at once, from different connections: the
+// waypoints to each car's frame, the cubic through them, and the state its
+// solve starts from, as Control() does one frame at a time through
+// ToVehicleFrame, WaypointFit::FitWorld and PredictState.
+//
+// The frames are held as structures of arrays, a column of all frames'
+// values per waypoint and per field, and are prepared BLOCK at a time: each
+// step works on a fixed-size array of BLOCK frames, which stays in
+// registers and vectorizes across frames instead of within one frame's six
+// points. The fit is polyfit<3>'s, on abscissae scaled to [-1, 1], with the
+// 4x4 normal equations factored by an LDLT without pivoting, written out
+// entry by entry on the arrays; the cubics agree with polyfit<3>'s to
+// rounding, not bit for bit.
+//
+// Only the simulator's frames of WAYPOINTS waypoints fitted unweighted take
+// this path, which is what FitWorld fits without its reuse cache. Nothing
+// is allocated after construction.
+class FrameBatch {
+ public:
+  static const int WAYPOINTS = 6;
+  static const int BLOCK = 8;
+
+  explicit FrameBatch(size_t capacity);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool full() const { return size_ == capacity_; }
+
+  // Whether `t` can go in a batch.
+  static bool Fits(const Telemetry& t) { return t.n_waypoints == WAYPOINTS; }
+  // Add a frame that Fits; returns its index in the batch.
+  size_t Add(const Telemetry& t);
+  void Clear() { size_ = 0; }
+
+  // Prepare every frame, for a model of front axle distance Lf.
+  void Prepare(double Lf);
+
+  // Frame i's cubic, in increasing order, and the state to solve from.
+  void Coeffs(size_t i, double coeffs[4]) const;
+  void State(size_t i, double state[6]) const;
+
+ private:
+  typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> Columns;
+  typedef Eigen::Array<double, BLOCK, 1> Lanes;
+
+  size_t capacity_;
+  size_t size_;
+  // The waypoints, a column each, and the pose, actuations and latency;
+  // room for a whole number of blocks.
+  Columns x_;
+  Columns y_;
+  Eigen::ArrayXd px_;
+  Eigen::ArrayXd py_;
+  Eigen::ArrayXd psi_;
+  Eigen::ArrayXd v_;
+  Eigen::ArrayXd delta_;
+  Eigen::ArrayXd a_;
+  Eigen::ArrayXd latency_;
+  // cos and sin of psi, and scratch after.
+  Eigen::ArrayXd cos_;
+  Eigen::ArrayXd sin_;
+  Columns coeffs_;
+  Columns state_;
+};
+
+#endif /* FRAME_BATCH_H */
@@ -0,0 +1,490 @@
+#include "FrameJournal.h"
+#include <zlib.h>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+static const char JOURNAL_MAGIC[4] = {'M', 'J', 'N', 'L'};
+static const uint32_t JOURNAL_VERSION = 2;
+// Records, stored bytes and codec.
+static const size_t BLOCK_HEADER = 4 + 4 + 1;
+enum Codec { STORED, DEFLATE };
+// The longest a partial block waits for the rest of its records.
+static const std::chrono::seconds BLOCK_AGE(1);
+
+#define FIELD(name, type, field)                             \
+  {                                                          \
+    name, JournalColumn::type, sizeof(JournalRecord::field), \
+        offsetof(JournalRecord, field)                       \
+  }
+#define ELEMENT(name, field, i) \
+  { name, JournalColumn::DOUBLE, 8, offsetof(JournalRecord, field) + 8 * i }
+
+const JournalColumn JOURNAL_COLUMNS[] = {
+    FIELD("time", UNSIGNED, time),
+    FIELD("sequence", UNSIGNED, sequence),
+    FIELD("connection", UNSIGNED, connection),
+    FIELD("status", UNSIGNED, status),
+    FIELD("flags", UNSIGNED, flags),
+    FIELD("iterations", UNSIGNED, iterations),
+    FIELD("tier", UNSIGNED, tier),
+    FIELD("px", DOUBLE, px),
+    FIELD("py", DOUBLE, py),
+    FIELD("psi", DOUBLE, psi),
+    FIELD("v", DOUBLE, v),
+    FIELD("delta", DOUBLE, delta),
+    FIELD("a", DOUBLE, a),
+    FIELD("latency", DOUBLE, latency),
+    FIELD("load", DOUBLE, load),
+    ELEMENT("state_x", state, 0),
+    ELEMENT("state_y", state, 1),
+    ELEMENT("state_psi", state, 2),
+    ELEMENT("state_v", state, 3),
+    ELEMENT("state_cte", state, 4),
+    ELEMENT("state_epsi", state, 5),
+    ELEMENT("c0", reference, 0),
+    ELEMENT("c1", reference, 1),
+    ELEMENT("c2", reference, 2),
+    ELEMENT("c3", reference, 3),
+    FIELD("steering", DOUBLE, steering),
+    FIELD("throttle", DOUBLE, throttle),
+    FIELD("cost", DOUBLE, cost),
+    FIELD("constraint_violation", DOUBLE, constraintViolation),
+    FIELD("solve_seconds", DOUBLE, solveSeconds),
+    FIELD("policy_error", DOUBLE, policyError),
+    FIELD("seconds", DOUBLE, seconds),
+};
+const size_t JOURNAL_COLUMN_COUNT =
+    sizeof(JOURNAL_COLUMNS) / sizeof(JOURNAL_COLUMNS[0]);
+
+#undef FIELD
+#undef ELEMENT
+
+static void PutLE(unsigned char* out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out[i] = static_cast<unsigned char>(value >> (8 * i));
+  }
+}
+
+static uint64_t GetLE(const unsigned char* in, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= uint64_t(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+// A field of `size` bytes at `p` as its bits, and back.
+static uint64_t Load(const unsigned char* p, size_t size) {
+  switch (size) {
+    case 1:
+      return *p;
+    case 2: {
+      uint16_t v;
+      memcpy(&v, p, 2);
+      return v;
+    }
+    case 4: {
+      uint32_t v;
+      memcpy(&v, p, 4);
+      return v;
+    }
+    default: {
+      uint64_t v;
+      memcpy(&v, p, 8);
+      return v;
+    }
+  }
+}
+
+static void Store(unsigned char* p, size_t size, uint64_t bits) {
+  switch (size) {
+    case 1:
+      *p = static_cast<unsigned char>(bits);
+      break;
+    case 2: {
+      uint16_t v = static_cast<uint16_t>(bits);
+      memcpy(p, &v, 2);
+      break;
+    }
+    case 4: {
+      uint32_t v = static_cast<uint32_t>(bits);
+      memcpy(p, &v, 4);
+      break;
+    }
+    default:
+      memcpy(p, &bits, 8);
+  }
+}
+
+// Bytes of a record's columns.
+static size_t RecordBytes() {
+  size_t bytes = 0;
+  for (size_t c = 0; c < JOURNAL_COLUMN_COUNT; c++) {
+    bytes += JOURNAL_COLUMNS[c].size;
+  }
+  return bytes;
+}
+
+// One writer's queue. The writer owns head and the drain thread tail, each
+// on a cache line of its own so that neither's stores bounce the other's.
+struct FrameJournal::Ring {
+  explicit Ring(size_t capacity)
+      : records(new JournalRecord[capacity]), capacity(capacity), head(0),
+        dropped(0), tail(0) {}
+  std::unique_ptr<JournalRecord[]> records;
+  size_t capacity;
+  char pad0[64];
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> dropped;
+  char pad1[64];
+  std::atomic<uint64_t> tail;
+};
+
+// Opens of any journal so far, and the journal each thread last wrote to,
+// as of which open, with its ring in it.
+static std::atomic<uint64_t> openings(0);
+namespace {
+struct LocalRing {
+  const FrameJournal* journal;
+  uint64_t opening;
+  void* ring;
+};
+}  // namespace
+static thread_local LocalRing local = {nullptr, 0, nullptr};
+
+FrameJournal::FrameJournal()
+    : open_(false), rotateBytes_(0), keep_(0), capacity_(0),
+      blockRecords_(0), compress_(false), interval_(0), opening_(0),
+      file_(nullptr), bytes_(0), written_(0), stopping_(false) {}
+
+FrameJournal::~FrameJournal() {
+  Close();
+  for (Ring* ring : rings_) {
+    delete ring;
+  }
+}
+
+// A new file at `path` with the header written, and its size into `bytes`.
+static FILE* Create(const std::string& path, size_t& bytes) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return nullptr;
+  }
+  std::vector<unsigned char> header(10);
+  memcpy(&header[0], JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  PutLE(&header[4], JOURNAL_VERSION, 4);
+  PutLE(&header[8], JOURNAL_COLUMN_COUNT, 2);
+  for (size_t c = 0; c < JOURNAL_COLUMN_COUNT; c++) {
+    const JournalColumn& column = JOURNAL_COLUMNS[c];
+    size_t length = strlen(column.name);
+    header.push_back(static_cast<unsigned char>(length));
+    header.insert(header.end(), column.name, column.name + length);
+    header.push_back(static_cast<unsigned char>(column.type));
+    header.push_back(static_cast<unsigned char>(column.size));
+  }
+  fwrite(header.data(), 1, header.size(), file);
+  bytes = header.size();
+  return file;
+}
+
+bool FrameJournal::Open(const std::string& path, size_t rotate_bytes,
+                        size_t keep, size_t records_per_thread,
+                        size_t block_records, bool compress,
+                        std::chrono::milliseconds flush_interval) {
+  Close();
+  file_ = Create(path, bytes_);
+  if (!file_) {
+    return false;
+  }
+  path_ = path;
+  rotateBytes_ = rotate_bytes;
+  keep_ = keep;
+  capacity_ = records_per_thread;
+  blockRecords_ = block_records > 0 ? block_records : 1;
+  compress_ = compress;
+  interval_ = flush_interval;
+  start_ = std::chrono::steady_clock::now();
+  block_.clear();
+  block_.reserve(blockRecords_);
+  columns_.resize(blockRecords_ * RecordBytes());
+  deflated_.resize(compressBound(columns_.size()));
+  stopping_ = false;
+  opening_ = openings.fetch_add(1, std::memory_order_relaxed) + 1;
+  drain_ = std::thread([this]() {
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    while (!stopping_) {
+      stop_.wait_for(lock, interval_);
+      lock.unlock();
+      Drain(false);
+      lock.lock();
+    }
+  });
+  open_.store(true, std::memory_order_release);
+  return true;
+}
+
+void FrameJournal::Close() {
+  if (!drain_.joinable()) {
+    return;
+  }
+  open_.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(stopMutex_);
+    stopping_ = true;
+  }
+  stop_.notify_one();
+  drain_.join();
+  Drain(true);
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+uint64_t FrameJournal::Since(
+    std::chrono::steady_clock::time_point received) const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(received -
+                                                              start_)
+      .count();
+}
+
+FrameJournal::Ring* FrameJournal::Local() {
+  if (local.journal != this || local.opening != opening_) {
+    Ring* ring = new Ring(capacity_);
+    {
+      std::lock_guard<std::mutex> lock(ringsMutex_);
+      rings_.push_back(ring);
+    }
+    local.journal = this;
+    local.opening = opening_;
+    local.ring = ring;
+  }
+  return static_cast<Ring*>(local.ring);
+}
+
+void FrameJournal::Write(const JournalRecord& record) {
+  if (!open_.load(std::memory_order_acquire)) {
+    return;
+  }
+  Ring* ring = Local();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= ring->capacity) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring->records[head % ring->capacity] = record;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+uint64_t FrameJournal::dropped() const {
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  uint64_t dropped = 0;
+  for (const Ring* ring : rings_) {
+    dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+void FrameJournal::Drain(bool all) {
+  std::vector<Ring*> rings;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    rings = rings_;
+  }
+  for (Ring* ring : rings) {
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    for (; tail < head; tail++) {
+      if (block_.empty()) {
+        blockStart_ = std::chrono::steady_clock::now();
+      }
+      block_.push_back(ring->records[tail % ring->capacity]);
+      if (block_.size() == blockRecords_) {
+        WriteBlock();
+      }
+    }
+    ring->tail.store(head, std::memory_order_release);
+  }
+  if (!block_.empty() &&
+      (all || std::chrono::steady_clock::now() - blockStart_ >= BLOCK_AGE)) {
+    WriteBlock();
+  }
+  if (file_) {
+    fflush(file_);
+  }
+}
+
+void FrameJournal::WriteBlock() {
+  size_t n = block_.size();
+  unsigned char* out = columns_.data();
+  for (size_t c = 0; c < JOURNAL_COLUMN_COUNT; c++) {
+    const JournalColumn& column = JOURNAL_COLUMNS[c];
+    uint64_t previous = 0;
+    for (size_t r = 0; r < n; r++) {
+      const unsigned char* record =
+          reinterpret_cast<const unsigned char*>(&block_[r]);
+      uint64_t value = Load(record + column.offset, column.size);
+      uint64_t encoded = column.type == JournalColumn::UNSIGNED
+                             ? value - previous
+                             : value ^ previous;
+      previous = value;
+      for (size_t b = 0; b < column.size; b++) {
+        out[b * n + r] = static_cast<unsigned char>(encoded >> (8 * b));
+      }
+    }
+    out += column.size * n;
+  }
+  size_t raw = out - columns_.data();
+  block_.clear();
+
+  const unsigned char* stored = columns_.data();
+  size_t length = raw;
+  Codec codec = STORED;
+  uLongf deflated = deflated_.size();
+  if (compress_ &&
+      compress2(deflated_.data(), &deflated, columns_.data(), raw,
+                Z_DEFAULT_COMPRESSION) == Z_OK &&
+      deflated < raw) {
+    stored = deflated_.data();
+    length = deflated;
+    codec = DEFLATE;
+  }
+  if (!file_) {
+    return;
+  }
+  unsigned char header[BLOCK_HEADER];
+  PutLE(header, n, 4);
+  PutLE(header + 4, length, 4);
+  header[8] = codec;
+  fwrite(header, 1, sizeof(header), file_);
+  fwrite(stored, 1, length, file_);
+  bytes_ += sizeof(header) + length;
+  written_.fetch_add(n, std::memory_order_relaxed);
+  if (rotateBytes_ > 0 && bytes_ >= rotateBytes_) {
+    Rotate();
+  }
+}
+
+bool FrameJournal::Rotate() {
+  fclose(file_);
+  for (size_t i = keep_; i > 1; i--) {
+    rename((path_ + "." + std::to_string(i - 1)).c_str(),
+           (path_ + "." + std::to_string(i)).c_str());
+  }
+  if (keep_ > 0) {
+    rename(path_.c_str(), (path_ + ".1").c_str());
+  }
+  file_ = Create(path_, bytes_);
+  return file_ != nullptr;
+}
+
+namespace {
+// A column of a journal file, and the one of JOURNAL_COLUMNS it fills, or
+// -1 for none.
+struct FileColumn {
+  JournalColumn::Type type;
+  size_t size;
+  int known;
+};
+}  // namespace
+
+static bool ReadColumns(FILE* file, std::vector<FileColumn>& columns) {
+  unsigned char header[10];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+      GetLE(header + 4, 4) != JOURNAL_VERSION) {
+    return false;
+  }
+  size_t count = GetLE(header + 8, 2);
+  for (size_t c = 0; c < count; c++) {
+    int length = fgetc(file);
+    if (length == EOF) {
+      return false;
+    }
+    std::string name(length, '\0');
+    unsigned char description[2];
+    if ((length > 0 && fread(&name[0], 1, length, file) != size_t(length)) ||
+        fread(description, 1, 2, file) != 2) {
+      return false;
+    }
+    FileColumn column = {JournalColumn::Type(description[0]), description[1],
+                         -1};
+    if (column.type > JournalColumn::DOUBLE ||
+        (column.size != 1 && column.size != 2 && column.size != 4 &&
+         column.size != 8)) {
+      return false;
+    }
+    for (size_t k = 0; k < JOURNAL_COLUMN_COUNT; k++) {
+      const JournalColumn& known = JOURNAL_COLUMNS[k];
+      if (name == known.name && column.type == known.type &&
+          column.size == known.size) {
+        column.known = k;
+      }
+    }
+    columns.push_back(column);
+  }
+  return true;
+}
+
+bool ReadJournal(const std::string& path, std::vector<JournalRecord>& records) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  std::vector<FileColumn> columns;
+  bool valid = ReadColumns(file, columns);
+  size_t record_bytes = 0;
+  for (const FileColumn& column : columns) {
+    record_bytes += column.size;
+  }
+  std::vector<unsigned char> stored;
+  std::vector<unsigned char> raw;
+  unsigned char header[BLOCK_HEADER];
+  while (valid && fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    size_t n = GetLE(header, 4);
+    stored.resize(GetLE(header + 4, 4));
+    if (fread(stored.data(), 1, stored.size(), file) != stored.size()) {
+      break;
+    }
+    raw.resize(n * record_bytes);
+    if (header[8] == DEFLATE) {
+      uLongf length = raw.size();
+      if (uncompress(raw.data(), &length, stored.data(), stored.size()) !=
+              Z_OK ||
+          length != raw.size()) {
+        valid = false;
+        break;
+      }
+    } else if (header[8] == STORED && stored.size() == raw.size()) {
+      raw.swap(stored);
+    } else {
+      valid = false;
+      break;
+    }
+    size_t first = records.size();
+    records.resize(first + n, JournalRecord());
+    const unsigned char* in = raw.data();
+    for (const FileColumn& column : columns) {
+      uint64_t previous = 0;
+      for (size_t r = 0; r < n; r++) {
+        uint64_t encoded = 0;
+        for (size_t b = 0; b < column.size; b++) {
+          encoded |= uint64_t(in[b * n + r]) << (8 * b);
+        }
+        previous = column.type == JournalColumn::UNSIGNED
+                       ? previous + encoded
+                       : previous ^ encoded;
+        if (column.known >= 0) {
+          const JournalColumn& known = JOURNAL_COLUMNS[column.known];
+          Store(reinterpret_cast<unsigned char*>(&records[first + r]) +
+                    known.offset,
+                known.size, previous);
+        }
+      }
+      in += column.size * n;
+    }
+  }
+  fclose(file);
+  return valid;
+}
@@ -0,0 +1,182 @@
+#ifndef FRAME_JOURNAL_H
+#define FRAME_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What each frame went in and came out of the controller with, for looking
+// back over whole sessions.
+//
+// Writers never wait and never allocate after their first record: each
+// thread appends to a ring of its own, a single producer and single
+// consumer queue of `records_per_thread` records, and a background thread
+// drains the rings every `flush_interval`. A record that finds its ring
+// full is dropped and counted, rather than held up.
+//
+// The drain thread gathers the records into blocks of `block_records`, and
+// writes a block once it is full, once its first record is a second old,
+// and on Close. The file is columnar, to be small and quick to scan: a
+// header, then the blocks, integers little-endian.
+//
+//   header  'M' 'J' 'N' 'L', the version (uint32), the number of columns
+//           (uint16), and for each its name's length (uint8), its name,
+//           its type (uint8, 0 for unsigned and 1 for double) and its size
+//           in bytes (uint8)
+//   block   its records (uint32), the bytes stored (uint32), its codec
+//           (uint8, 0 for none and 1 for deflate), and the stored bytes
+//
+// Uncompressed, a block is its columns one after another, in the header's
+// order. Each value of a column is taken against the one before it in the
+// block, the first against 0: unsigned values as their difference, doubles
+// as the XOR of their bits, which leaves the high bytes of slowly changing
+// values zero. The column is then stored a byte plane at a time, the
+// lowest byte of every value first, so that the zeros run together for
+// deflate. A block that deflate doesn't shrink is stored as it is.
+//
+// Once a file grows past `rotate_bytes` it is renamed to path.1, the one
+// before to path.2 and so on, keeping `keep` of them, and a new one is
+// started at path. Readers match the columns by name, so columns may be
+// added without breaking them; see tools/mpc_logcat.cpp.
+struct JournalRecord {
+  enum Flags {
+    BINARY = 1,
+    PREPARED = 2,
+    SENSITIVITY_UPDATE = 4,
+    LQR_FALLBACK = 8,
+    CHECKED_POLICY = 16,
+    ENERGY_STEP = 32,
+    LADDER_STEP = 64
+  };
+  // When the frame was received, in nanoseconds since the journal was
+  // opened; its connection, and its number on it.
+  uint64_t time;
+  uint64_t sequence;
+  uint32_t connection;
+  // MPC::Status, the Flags and the solver's iterations, and the
+  // DegradationLadder::Tier it solved at, NUM_TIERS if it didn't solve, see
+  // MPC::tier().
+  uint8_t status;
+  uint8_t flags;
+  uint16_t iterations;
+  uint8_t tier;
+  // The frame's state, as Telemetry has it, the delay it was solved for and
+  // the host's load when it was, see MPC::hostLoad.
+  double px;
+  double py;
+  double psi;
+  double v;
+  double delta;
+  double a;
+  double latency;
+  double load;
+  // The state solved from, compensated for the latency, the reference
+  // polynomial in car coordinates, and the actuations sent, as
+  // Controller::Output has them.
+  double state[6];
+  double reference[4];
+  double steering;
+  double throttle;
+  // The solve's cost, largest violation and seconds, the policy's
+  // difference from Ipopt when checked, and the seconds from receipt until
+  // the reply was ready.
+  double cost;
+  double constraintViolation;
+  double solveSeconds;
+  double policyError;
+  double seconds;
+};
+
+// A column of the journal: a field of JournalRecord, UNSIGNED of `size`
+// bytes or a DOUBLE.
+struct JournalColumn {
+  enum Type { UNSIGNED, DOUBLE };
+  const char* name;
+  Type type;
+  size_t size;
+  size_t offset;
+};
+extern const JournalColumn JOURNAL_COLUMNS[];
+extern const size_t JOURNAL_COLUMN_COUNT;
+
+class FrameJournal {
+ public:
+  FrameJournal();
+  ~FrameJournal();
+  FrameJournal(const FrameJournal&) = delete;
+  FrameJournal& operator=(const FrameJournal&) = delete;
+
+  // Start a new file at `path`, replacing it, and the thread that writes
+  // it. False if it can't be created.
+  bool Open(const std::string& path, size_t rotate_bytes, size_t keep,
+            size_t records_per_thread, size_t block_records = 1024,
+            bool compress = true,
+            std::chrono::milliseconds flush_interval =
+                std::chrono::milliseconds(100));
+  bool isOpen() const { return open_.load(std::memory_order_relaxed); }
+  // Write what the rings hold, and stop.
+  void Close();
+
+  // The time `received` in the journal's clock, for JournalRecord::time.
+  uint64_t Since(std::chrono::steady_clock::time_point received) const;
+
+  // Append `record` from the calling thread, or drop it if its ring is
+  // full. Nothing is done unless the journal is open.
+  void Write(const JournalRecord& record);
+
+  // Records dropped for full rings, and written.
+  uint64_t dropped() const;
+  uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Ring;
+
+  Ring* Local();
+  // Into the block, writing it when it is due or `all` is set.
+  void Drain(bool all);
+  void WriteBlock();
+  bool Rotate();
+
+  std::atomic<bool> open_;
+  std::string path_;
+  size_t rotateBytes_;
+  size_t keep_;
+  size_t capacity_;
+  size_t blockRecords_;
+  bool compress_;
+  std::chrono::milliseconds interval_;
+  std::chrono::steady_clock::time_point start_;
+  // Which Open of any journal this is, to tell the rings of each apart.
+  uint64_t opening_;
+  // Every writer's ring, kept until destruction.
+  mutable std::mutex ringsMutex_;
+  std::vector<Ring*> rings_;
+  // The drain thread's, besides the rings' tails: the block being gathered
+  // and when it was started, and its encoding.
+  FILE* file_;
+  size_t bytes_;
+  std::vector<JournalRecord> block_;
+  std::chrono::steady_clock::time_point blockStart_;
+  std::vector<unsigned char> columns_;
+  std::vector<unsigned char> deflated_;
+  std::atomic<uint64_t> written_;
+  std::mutex stopMutex_;
+  std::condition_variable stop_;
+  bool stopping_;
+  std::thread drain_;
+};
+
+// Read the records of the journal at `path`, one file of it, into
+// `records`, with the columns it doesn't have 0. False if it can't be read
+// or isn't a journal of this version; a block cut short at the end, as by a
+// server that was killed, is dropped.
+bool ReadJournal(const std::string& path, std::vector<JournalRecord>& records);
+
+#endif /* FRAME_JOURNAL_H */
@@ -0,0 +1,226 @@
+#include "FrameLog.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char LOG_MAGIC[4] = {'M', 'R', 'E', 'C'};
+static const uint32_t LOG_VERSION = 1;
+// Time, connection, binary flag and length.
+static const size_t RECORD_HEADER = 8 + 4 + 1 + 4;
+static const char INDEX_MAGIC[4] = {'M', 'I', 'D', 'X'};
+static const uint32_t INDEX_VERSION = 1;
+// Time and offset.
+static const size_t INDEX_ENTRY = 8 + 8;
+
+static void PutLE(unsigned char* out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out[i] = static_cast<unsigned char>(value >> (8 * i));
+  }
+}
+
+static uint64_t GetLE(const unsigned char* in, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= uint64_t(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+FrameRecorder::FrameRecorder()
+    : file_(nullptr), index_(nullptr), offset_(0) {}
+
+FrameRecorder::~FrameRecorder() {
+  if (file_) {
+    fclose(file_);
+  }
+  if (index_) {
+    fclose(index_);
+  }
+}
+
+bool FrameRecorder::Open(const std::string& path) {
+  if (file_) {
+    fclose(file_);
+  }
+  if (index_) {
+    fclose(index_);
+  }
+  file_ = fopen(path.c_str(), "wb");
+  index_ = file_ ? fopen((path + ".idx").c_str(), "wb") : nullptr;
+  if (!index_) {
+    if (file_) {
+      fclose(file_);
+      file_ = nullptr;
+    }
+    return false;
+  }
+  unsigned char header[8];
+  memcpy(header, LOG_MAGIC, sizeof(LOG_MAGIC));
+  PutLE(header + 4, LOG_VERSION, 4);
+  fwrite(header, 1, sizeof(header), file_);
+  memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  PutLE(header + 4, INDEX_VERSION, 4);
+  fwrite(header, 1, sizeof(header), index_);
+  offset_ = sizeof(header);
+  start_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+void FrameRecorder::Write(unsigned connection,
+                          std::chrono::steady_clock::time_point received,
+                          bool binary, const char* data, size_t length) {
+  if (!file_) {
+    return;
+  }
+  unsigned char header[RECORD_HEADER];
+  auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      received - start_);
+  PutLE(header, since.count(), 8);
+  PutLE(header + 8, connection, 4);
+  header[12] = binary ? 1 : 0;
+  PutLE(header + 13, length, 4);
+  fwrite(header, 1, sizeof(header), file_);
+  fwrite(data, 1, length, file_);
+  unsigned char entry[INDEX_ENTRY];
+  PutLE(entry, since.count(), 8);
+  PutLE(entry + 8, offset_, 8);
+  fwrite(entry, 1, sizeof(entry), index_);
+  offset_ += sizeof(header) + length;
+}
+
+bool ReadFrames(const std::string& path, std::vector<RecordedFrame>& frames) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  unsigned char header[RECORD_HEADER];
+  bool valid = fread(header, 1, 8, file) == 8 &&
+               memcmp(header, LOG_MAGIC, sizeof(LOG_MAGIC)) == 0 &&
+               GetLE(header + 4, 4) == LOG_VERSION;
+  while (valid && fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    RecordedFrame frame;
+    frame.time = GetLE(header, 8) * 1e-9;
+    frame.connection = GetLE(header + 8, 4);
+    frame.binary = header[12] != 0;
+    frame.data.resize(GetLE(header + 13, 4));
+    if (fread(&frame.data[0], 1, frame.data.size(), file) !=
+        frame.data.size()) {
+      break;
+    }
+    frames.push_back(std::move(frame));
+  }
+  fclose(file);
+  return valid;
+}
+
+// The file at `path` mapped read-only, with its size into `size`, or null.
+static const unsigned char* Map(const std::string& path, size_t& size) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  void* base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    size = st.st_size;
+    base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  return base == MAP_FAILED ? nullptr
+                            : static_cast<const unsigned char*>(base);
+}
+
+MappedFrames::MappedFrames()
+    : log_(nullptr), logSize_(0), index_(nullptr), indexSize_(0),
+      count_(0) {}
+
+MappedFrames::~MappedFrames() { Unmap(); }
+
+void MappedFrames::Unmap() {
+  if (log_) {
+    munmap(const_cast<unsigned char*>(log_), logSize_);
+  }
+  if (index_ && index_ != built_.data()) {
+    munmap(const_cast<unsigned char*>(index_), indexSize_);
+  }
+  log_ = nullptr;
+  index_ = nullptr;
+  built_.clear();
+  count_ = 0;
+}
+
+bool MappedFrames::Open(const std::string& path) {
+  Unmap();
+  log_ = Map(path, logSize_);
+  if (!log_ || logSize_ < 8 ||
+      memcmp(log_, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+      GetLE(log_ + 4, 4) != LOG_VERSION) {
+    Unmap();
+    return false;
+  }
+  index_ = Map(path + ".idx", indexSize_);
+  if (index_ && (indexSize_ < 8 ||
+                 memcmp(index_, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+                 GetLE(index_ + 4, 4) != INDEX_VERSION)) {
+    munmap(const_cast<unsigned char*>(index_), indexSize_);
+    index_ = nullptr;
+  }
+  if (!index_) {
+    built_.resize(8);
+    memcpy(&built_[0], INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    PutLE(&built_[4], INDEX_VERSION, 4);
+    size_t offset = 8;
+    while (offset + RECORD_HEADER <= logSize_) {
+      size_t end = offset + RECORD_HEADER + GetLE(log_ + offset + 13, 4);
+      if (end > logSize_) {
+        break;
+      }
+      unsigned char entry[INDEX_ENTRY];
+      PutLE(entry, GetLE(log_ + offset, 8), 8);
+      PutLE(entry + 8, offset, 8);
+      built_.insert(built_.end(), entry, entry + sizeof(entry));
+      offset = end;
+    }
+    index_ = built_.data();
+    indexSize_ = built_.size();
+  }
+  count_ = (indexSize_ - 8) / INDEX_ENTRY;
+  // Either file may have been cut short; the log is written first.
+  while (count_ > 0) {
+    uint64_t offset = GetLE(index_ + 8 + (count_ - 1) * INDEX_ENTRY + 8, 8);
+    if (offset + RECORD_HEADER <= logSize_ &&
+        offset + RECORD_HEADER + GetLE(log_ + offset + 13, 4) <= logSize_) {
+      break;
+    }
+    count_--;
+  }
+  return true;
+}
+
+MappedFrames::Frame MappedFrames::operator[](size_t i) const {
+  const unsigned char* entry = index_ + 8 + i * INDEX_ENTRY;
+  const unsigned char* record = log_ + GetLE(entry + 8, 8);
+  Frame frame;
+  frame.time = GetLE(record, 8) * 1e-9;
+  frame.connection = GetLE(record + 8, 4);
+  frame.binary = record[12] != 0;
+  frame.data = reinterpret_cast<const char*>(record + RECORD_HEADER);
+  frame.length = GetLE(record + 13, 4);
+  return frame;
+}
+
+size_t MappedFrames::Seek(double time) const {
+  size_t low = 0;
+  size_t high = count_;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (GetLE(index_ + 8 + middle * INDEX_ENTRY, 8) * 1e-9 < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
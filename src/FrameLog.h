@@ -0,0 +1,108 @@
+#ifndef FRAME_LOG_H
+#define FRAME_LOG_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Websocket frames as they were received, for replaying sessions without the
+// simulator, see bench/mpc_replay.cpp.
+//
+// The file is a header, 'M' 'R' 'E' 'C' and a little-endian uint32 version,
+// then one record per frame: the time it was received in nanoseconds since
+// the recorder was opened (uint64), the connection it came in on (uint32),
+// whether it was a binary frame (uint8), its length (uint32) and its bytes,
+// integers little-endian.
+//
+// Beside it the recorder writes an index, at the log's path with ".idx"
+// appended: 'M' 'I' 'D' 'X' and a little-endian uint32 version, then for
+// each frame the time it was received and the offset of its record in the
+// log (uint64 each), so that MappedFrames can go to any frame or time
+// without reading the ones before.
+struct RecordedFrame {
+  // Seconds since the recorder was opened.
+  double time;
+  unsigned connection;
+  bool binary;
+  std::string data;
+};
+
+class FrameRecorder {
+ public:
+  FrameRecorder();
+  ~FrameRecorder();
+  FrameRecorder(const FrameRecorder&) = delete;
+  FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+  // Start a new file at `path`, and its index, replacing them. False if
+  // either can't be created.
+  bool Open(const std::string& path);
+  bool isOpen() const { return file_ != nullptr; }
+
+  // Append one frame. Frames are buffered, and flushed on destruction.
+  void Write(unsigned connection,
+             std::chrono::steady_clock::time_point received, bool binary,
+             const char* data, size_t length);
+
+ private:
+  FILE* file_;
+  FILE* index_;
+  uint64_t offset_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Read all frames of the file at `path` into `frames`. False if it can't be
+// read or isn't a frame log of this version; a record cut short at the end,
+// as by a server that was killed, is dropped.
+bool ReadFrames(const std::string& path, std::vector<RecordedFrame>& frames);
+
+// A frame log mapped read-only with its index, for replay and analysis to
+// start anywhere in a long session: any frame is found in constant time and
+// read in place, and a time by a binary search of the index, with only the
+// pages touched read from disk.
+class MappedFrames {
+ public:
+  // A frame as RecordedFrame has it, its bytes in the mapping.
+  struct Frame {
+    double time;
+    unsigned connection;
+    bool binary;
+    const char* data;
+    size_t length;
+  };
+
+  MappedFrames();
+  ~MappedFrames();
+  MappedFrames(const MappedFrames&) = delete;
+  MappedFrames& operator=(const MappedFrames&) = delete;
+
+  // Map the log at `path` and its index. A log without one, as recorded
+  // before there were indexes, is indexed by a pass over its record
+  // headers. False if it can't be mapped or isn't a frame log of this
+  // version. Frames past the end of the log, as by a server that was
+  // killed, are left out.
+  bool Open(const std::string& path);
+
+  size_t size() const { return count_; }
+  Frame operator[](size_t i) const;
+
+  // The first frame received at or after `time` seconds, or size() if none
+  // was. The frames are in the order they were written, which is the order
+  // they were received but for frames arriving together on different hubs.
+  size_t Seek(double time) const;
+
+ private:
+  void Unmap();
+
+  const unsigned char* log_;
+  size_t logSize_;
+  const unsigned char* index_;
+  size_t indexSize_;
+  // The index built when there is no file of it, as its file would be.
+  std::vector<unsigned char> built_;
+  size_t count_;
+};
+
+#endif /* FRAME_LOG_H */
@@ -0,0 +1,188 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+#include "Metrics.h"
+#include "StackSampler.h"
+
+// For the heaps: the soonest deadline at the front.
+static bool Later(const FrameScheduler::Clock::time_point& a,
+                  const FrameScheduler::Clock::time_point& b) {
+  return a > b;
+}
+
+FrameScheduler::FrameScheduler(size_t threads,
+                               const std::vector<size_t>& nodes)
+    : stealable_(0), stopping_(false) {
+  for (size_t i = 0; i < threads; i++) {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+    Worker& worker = *workers_.back();
+    worker.node = i < nodes.size() ? nodes[i] : 0;
+    worker.sleeping = false;
+    worker.woken = false;
+  }
+  metrics.workers.store(threads, std::memory_order_relaxed);
+  for (size_t i = 0; i < threads; i++) {
+    workers_[i]->thread = std::thread(&FrameScheduler::Run, this, i);
+  }
+}
+
+FrameScheduler::~FrameScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopping_ = true;
+    for (size_t i = 0; i < workers_.size(); i++) {
+      workers_[i]->wake.notify_one();
+    }
+  }
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->thread.join();
+  }
+}
+
+void FrameScheduler::Submit(size_t worker, Clock::time_point deadline,
+                            std::function<void()> task) {
+  Worker& w = *workers_[worker];
+  {
+    std::lock_guard<std::mutex> lock(w.mutex);
+    w.tasks.push_back(Task{deadline, std::move(task)});
+    std::push_heap(w.tasks.begin(), w.tasks.end(),
+                   [](const Task& a, const Task& b) {
+                     return Later(a.deadline, b.deadline);
+                   });
+    stealable_++;
+  }
+  Wake(worker, true);
+}
+
+void FrameScheduler::Pin(size_t worker, std::function<void()> task) {
+  Worker& w = *workers_[worker];
+  {
+    std::lock_guard<std::mutex> lock(w.mutex);
+    w.pinned.push_back(std::move(task));
+  }
+  Wake(worker, false);
+}
+
+void FrameScheduler::Wake(size_t worker, bool any) {
+  std::lock_guard<std::mutex> lock(sleep_mutex_);
+  Worker& w = *workers_[worker];
+  if (w.sleeping) {
+    w.sleeping = false;
+    w.woken = true;
+    w.wake.notify_one();
+    return;
+  }
+  if (!any) {
+    return;
+  }
+  Worker* thief = nullptr;
+  for (size_t i = 0; i < workers_.size(); i++) {
+    Worker& other = *workers_[i];
+    if (other.sleeping && (!thief || (other.node == w.node &&
+                                      thief->node != w.node))) {
+      thief = &other;
+    }
+  }
+  if (thief) {
+    thief->sleeping = false;
+    thief->woken = true;
+    thief->wake.notify_one();
+  }
+}
+
+bool FrameScheduler::PopSoonest(Worker& worker,
+                                std::function<void()>& task) {
+  if (worker.tasks.empty()) {
+    return false;
+  }
+  std::pop_heap(worker.tasks.begin(), worker.tasks.end(),
+                [](const Task& a, const Task& b) {
+                  return Later(a.deadline, b.deadline);
+                });
+  task = std::move(worker.tasks.back().run);
+  worker.tasks.pop_back();
+  stealable_--;
+  return true;
+}
+
+bool FrameScheduler::Next(size_t worker, std::function<void()>& task,
+                          bool& stolen) {
+  Worker& own = *workers_[worker];
+  stolen = false;
+  {
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.pinned.empty()) {
+      task = std::move(own.pinned.front());
+      own.pinned.pop_front();
+      return true;
+    }
+    if (PopSoonest(own, task)) {
+      return true;
+    }
+  }
+  // The soonest due on this node, and only then on the others.
+  for (int pass = 0; pass < 2 && stealable_ > 0; pass++) {
+    size_t victim = workers_.size();
+    Clock::time_point soonest = Clock::time_point::max();
+    for (size_t i = 0; i < workers_.size(); i++) {
+      Worker& other = *workers_[i];
+      if (i == worker || (other.node == own.node) != (pass == 0)) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(other.mutex);
+      if (!other.tasks.empty() && other.tasks.front().deadline <= soonest) {
+        soonest = other.tasks.front().deadline;
+        victim = i;
+      }
+    }
+    if (victim < workers_.size()) {
+      // It may have been taken since; the caller looks again.
+      std::lock_guard<std::mutex> lock(workers_[victim]->mutex);
+      stolen = PopSoonest(*workers_[victim], task);
+      return stolen;
+    }
+  }
+  return false;
+}
+
+void FrameScheduler::Run(size_t index) {
+  SampleThread("solver");
+  Worker& worker = *workers_[index];
+  for (;;) {
+    std::function<void()> task;
+    bool stolen;
+    if (Next(index, task, stolen)) {
+      Clock::time_point start = Clock::now();
+      task();
+      if (index < size_t(Metrics::THREADS)) {
+        uint64_t busy = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            Clock::now() - start).count();
+        metrics.workerBusy[index].fetch_add(busy, std::memory_order_relaxed);
+        if (stolen) {
+          metrics.workerSteals[index].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      continue;
+    }
+    // A task queued after Next looked wakes the worker only once it
+    // sleeps, so look again under sleep_mutex_ first.
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    {
+      std::lock_guard<std::mutex> own(worker.mutex);
+      if (!worker.pinned.empty() || !worker.tasks.empty()) {
+        continue;
+      }
+    }
+    if (stealable_ > 0) {
+      continue;
+    }
+    if (stopping_) {
+      return;
+    }
+    worker.sleeping = true;
+    worker.woken = false;
+    worker.wake.wait(lock, [&worker, this] {
+      return worker.woken || stopping_;
+    });
+    worker.sleeping = false;
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads for the sessions' frames, earliest deadline first, that
+// take work from each other's queues when they run out of their own.
+//
+// Each task is submitted to a worker, its session's, with the time it is
+// due by, and each worker runs its queue in order of deadline. A worker
+// with nothing queued steals the task due soonest from another worker,
+// looking on its own NUMA node first, so that one slow solve doesn't hold
+// up the frames queued behind it while other cores idle. A stolen task
+// runs on another thread: anything it keeps per thread, like CppAD's
+// allocator, has to go with it, see MPC::Allocator. Tasks that must run on
+// their worker, like pinning it, are pinned; they come before its
+// deadlines and are never stolen.
+//
+// Each worker's time running tasks and its steals go into the metrics.
+class FrameScheduler {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // `nodes` is the NUMA node of each worker, see WorkerPlacement; empty
+  // puts them all on one.
+  explicit FrameScheduler(size_t threads,
+                          const std::vector<size_t>& nodes =
+                              std::vector<size_t>());
+  // Runs the queued tasks, then joins the workers.
+  ~FrameScheduler();
+
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+  size_t size() const { return workers_.size(); }
+
+  // Queue `task` on `worker`, in [0, size()), due by `deadline`; any idle
+  // worker may run it.
+  void Submit(size_t worker, Clock::time_point deadline,
+              std::function<void()> task);
+  // Queue `task` to run on `worker` itself, after the tasks pinned to it
+  // before and ahead of its deadlines.
+  void Pin(size_t worker, std::function<void()> task);
+
+ private:
+  struct Task {
+    Clock::time_point deadline;
+    std::function<void()> run;
+  };
+  struct Worker {
+    std::mutex mutex;
+    // A heap, soonest deadline first; PopSoonest under the mutex.
+    std::vector<Task> tasks;
+    std::deque<std::function<void()> > pinned;
+    size_t node;
+    // Set under sleep_mutex_, and woken through wake.
+    bool sleeping;
+    bool woken;
+    std::condition_variable wake;
+    std::thread thread;
+  };
+
+  void Run(size_t worker);
+  // The next task for `worker`: its pinned ones, then its soonest, then
+  // the soonest of another's. False if there is none.
+  bool Next(size_t worker, std::function<void()>& task, bool& stolen);
+  bool PopSoonest(Worker& worker, std::function<void()>& task);
+  // Wake `worker` if it sleeps, or with `any` another sleeping one, on the
+  // same node if there is one, to steal.
+  void Wake(size_t worker, bool any);
+
+  std::vector<std::unique_ptr<Worker> > workers_;
+  // The tasks in the heaps, counted under their workers' mutexes.
+  std::atomic<size_t> stealable_;
+  std::mutex sleep_mutex_;
+  bool stopping_;
+};
+
+#endif /* FRAME_SCHEDULER_H */
@@ -0,0 +1,342 @@
+#include "FrenetMPC.h"
+#include <algorithm>
+#include <cmath>
+#include <cppad/cppad.hpp>
+#include "Polynomial.h"
+#include "ProblemPolicies.h"
+
+using CppAD::AD;
+
+// Sample spacing of the path, in meters of x, and how far behind the car
+// it starts.
+static const double PATH_STEP = 0.25;
+static const double PATH_BEHIND = 5;
+// How far past the horizon at the reference speed it reaches, as a factor.
+static const double PATH_REACH = 2;
+
+static const double MAX_STEER = 25. / 180 * M_PI;
+
+PathCache::PathCache(size_t points, double step)
+    : step_(step), s_(std::max<size_t>(points, 2)), x_(s_.size()),
+      y_(s_.size()), heading_(s_.size()), curvature_(s_.size()) {}
+
+void PathCache::Build(const Cubic& coeffs, double from) {
+  double stretch = 0;
+  for (size_t i = 0; i < s_.size(); i++) {
+    double x = from + step_ * i;
+    double slope = PolyEval<3, 1>(coeffs, x);
+    double bend = PolyEval<3, 2>(coeffs, x);
+    double last = stretch;
+    stretch = std::sqrt(1 + slope * slope);
+    // The trapezoid rule on ds / dx.
+    s_[i] = i == 0 ? 0 : s_[i - 1] + step_ * (last + stretch) / 2;
+    x_[i] = x;
+    y_[i] = PolyEval<3>(coeffs, x);
+    heading_[i] = std::atan(slope);
+    curvature_[i] = bend / (stretch * stretch * stretch);
+  }
+}
+
+void PathCache::At(double s, double& x, double& y, double& heading,
+                   double& curvature) const {
+  size_t last = s_.size() - 1;
+  if (s <= 0 || s >= s_[last]) {
+    size_t i = s <= 0 ? 0 : last;
+    double ds = s - s_[i];
+    heading = heading_[i];
+    x = x_[i] + ds * std::cos(heading);
+    y = y_[i] + ds * std::sin(heading);
+    curvature = 0;
+    return;
+  }
+  size_t i = std::upper_bound(s_.begin(), s_.end(), s) - s_.begin() - 1;
+  double f = (s - s_[i]) / (s_[i + 1] - s_[i]);
+  x = x_[i] + f * (x_[i + 1] - x_[i]);
+  y = y_[i] + f * (y_[i + 1] - y_[i]);
+  heading = heading_[i] + f * (heading_[i + 1] - heading_[i]);
+  curvature = curvature_[i] + f * (curvature_[i + 1] - curvature_[i]);
+}
+
+void PathCache::Project(double x, double y, double& s,
+                        double& offset) const {
+  // From the sample below x, down the distance to the nearest sample.
+  long last = long(s_.size()) - 1;
+  long i = std::min(std::max(long(std::floor((x - x_[0]) / step_)), 0L),
+                    last);
+  auto distance = [&](long k) {
+    return (x - x_[k]) * (x - x_[k]) + (y - y_[k]) * (y - y_[k]);
+  };
+  while (i > 0 && distance(i - 1) < distance(i)) {
+    i--;
+  }
+  while (i < last && distance(i + 1) < distance(i)) {
+    i++;
+  }
+  // Then onto the tangent there.
+  double c = std::cos(heading_[i]);
+  double n = std::sin(heading_[i]);
+  double dx = x - x_[i];
+  double dy = y - y_[i];
+  s = s_[i] + dx * c + dy * n;
+  offset = dy * c - dx * n;
+}
+
+// The taped problem of FrenetMPC: variable-major, all s, then n, mu, v,
+// delta and a, and the dynamic parameters the initial [s, n, mu, v]
+// followed by the curvature of each step.
+class PathProblem {
+ public:
+  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+  static const size_t STATES = 4;
+
+  explicit PathProblem(const MpcConfig& config)
+      : N(config.N), dt(config.dt), Lf(config.Lf),
+        slopes(config.integrator == MpcConfig::EULER      ? 1
+               : config.integrator == MpcConfig::MIDPOINT ? 2
+                                                          : 4),
+        cost(config.weights, config.refV),
+        n_vars(STATES * N + 2 * (N - 1)), n_constraints(STATES * N),
+        n_params(STATES + N - 1),
+        n_residuals(TrackingCost::STATE_TERMS * N +
+                    TrackingCost::INPUT_TERMS * (N - 1) +
+                    TrackingCost::RATE_TERMS * (N - 2)) {}
+
+  size_t N;
+  double dt;
+  double Lf;
+  size_t slopes;
+  TrackingCost cost;
+  size_t n_vars;
+  size_t n_constraints;
+  size_t n_params;
+  size_t n_residuals;
+
+  // Stage t's state variable i, of [s, n, mu, v], and its actuation j, of
+  // [delta, a], for t < N - 1; the constraint on stage t's state i.
+  size_t state(size_t i, size_t t) const { return i * N + t; }
+  size_t input(size_t j, size_t t) const {
+    return STATES * N + j * (N - 1) + t;
+  }
+  size_t constraint(size_t i, size_t t) const { return i * N + t; }
+
+  template <class Scalar>
+  void Rates(const Scalar* z, const Scalar* u, const Scalar& kappa,
+             Scalar* dz) const {
+    using std::cos;
+    using std::sin;
+    Scalar ds = z[3] * cos(z[2]) / (1 - kappa * z[1]);
+    dz[0] = ds;
+    dz[1] = z[3] * sin(z[2]);
+    dz[2] = z[3] * u[0] / Lf - kappa * ds;
+    dz[3] = u[1];
+  }
+
+  // The weights are constants here: the curvatures are the parameters.
+  void residuals(ADvector& r, const ADvector& vars,
+                 const ADvector& params) const {
+    size_t i = 0;
+    AD<double> terms[TrackingCost::STATE_TERMS];
+    for (size_t t = 0; t < N; t++) {
+      cost.StateResiduals(AD<double>(-vars[state(1, t)]), vars[state(2, t)],
+                          vars[state(3, t)], terms);
+      for (size_t k = 0; k < TrackingCost::STATE_TERMS; k++) {
+        r[i++] = terms[k];
+      }
+    }
+    for (size_t t = 0; t + 1 < N; t++) {
+      cost.InputResiduals(vars[input(0, t)], vars[input(1, t)], terms);
+      for (size_t k = 0; k < TrackingCost::INPUT_TERMS; k++) {
+        r[i++] = terms[k];
+      }
+    }
+    for (size_t t = 0; t + 2 < N; t++) {
+      cost.RateResiduals(vars[input(0, t + 1)] - vars[input(0, t)],
+                         vars[input(1, t + 1)] - vars[input(1, t)], terms);
+      for (size_t k = 0; k < TrackingCost::RATE_TERMS; k++) {
+        r[i++] = terms[k];
+      }
+    }
+  }
+
+  void operator()(ADvector& fg, const ADvector& vars, const ADvector& params) {
+    ADvector r(n_residuals);
+    residuals(r, vars, params);
+    fg[0] = 0;
+    for (size_t i = 0; i < n_residuals; i++) {
+      fg[0] += r[i] * r[i];
+    }
+    for (size_t i = 0; i < STATES; i++) {
+      fg[1 + constraint(i, 0)] = vars[state(i, 0)] - params[i];
+    }
+
+    // By the Runge-Kutta rule of `slopes` slopes, as FG_eval's, with the
+    // step's curvature held.
+    static const double euler_at[1] = {0};
+    static const double euler_weight[1] = {1};
+    static const double midpoint_at[2] = {0, 0.5};
+    static const double midpoint_weight[2] = {0, 1};
+    static const double rk4_at[4] = {0, 0.5, 0.5, 1};
+    static const double rk4_weight[4] = {1. / 6, 1. / 3, 1. / 3, 1. / 6};
+    const double* at =
+        slopes == 1 ? euler_at : slopes == 2 ? midpoint_at : rk4_at;
+    const double* weight = slopes == 1   ? euler_weight
+                           : slopes == 2 ? midpoint_weight
+                                         : rk4_weight;
+    for (size_t t = 0; t + 1 < N; t++) {
+      AD<double> z[STATES];
+      AD<double> end[STATES];
+      for (size_t i = 0; i < STATES; i++) {
+        z[i] = vars[state(i, t)];
+        end[i] = z[i];
+      }
+      AD<double> u[2] = {vars[input(0, t)], vars[input(1, t)]};
+      const AD<double>& kappa = params[STATES + t];
+      AD<double> k[STATES];
+      AD<double> zk[STATES];
+      for (size_t j = 0; j < slopes; j++) {
+        for (size_t i = 0; i < STATES; i++) {
+          zk[i] = j == 0 ? z[i] : z[i] + at[j] * dt * k[i];
+        }
+        Rates(zk, u, kappa, k);
+        for (size_t i = 0; i < STATES; i++) {
+          if (weight[j] != 0) {
+            end[i] += weight[j] * dt * k[i];
+          }
+        }
+      }
+      for (size_t i = 0; i < STATES; i++) {
+        fg[1 + constraint(i, t + 1)] = vars[state(i, t + 1)] - end[i];
+      }
+    }
+  }
+};
+
+FrenetMPC::FrenetMPC(const MpcConfig& config)
+    : warmStart(true), lastConverged(false), deadlineReached(false),
+      lastIterations(0), lastCost(0), N_(config.N), dt_(config.dt),
+      path_(size_t((PATH_REACH * std::max(config.refV, 1.) * config.dt *
+                        (config.N - 1) +
+                    2 * PATH_BEHIND) /
+                   PATH_STEP) +
+                1,
+            PATH_STEP),
+      nlp_(new MPC_NLP()), app_(new Ipopt::IpoptApplication()),
+      optimized_(false), has_solution_(false) {
+  PathProblem problem(config);
+  nlp_->optimize_tape = config.optimizeTape;
+  nlp_->share_tapes = config.shareTapes;
+  nlp_->Record(problem, problem.n_vars, problem.n_constraints,
+               problem.n_params);
+  if (config.hessian == MpcConfig::GAUSS_NEWTON) {
+    nlp_->RecordResiduals(problem, problem.n_vars, problem.n_residuals,
+                          problem.n_params);
+  }
+  params_.resize(problem.n_params);
+  for (size_t i = 0; i < problem.n_vars; i++) {
+    nlp_->x_lowerbound[i] = -1.0e19;
+    nlp_->x_upperbound[i] = 1.0e19;
+  }
+  for (size_t t = 0; t + 1 < N_; t++) {
+    nlp_->x_lowerbound[problem.input(0, t)] = -MAX_STEER;
+    nlp_->x_upperbound[problem.input(0, t)] = MAX_STEER;
+    nlp_->x_lowerbound[problem.input(1, t)] = -1;
+    nlp_->x_upperbound[problem.input(1, t)] = 1;
+  }
+  for (size_t i = 0; i < problem.n_constraints; i++) {
+    nlp_->g_lowerbound[i] = 0;
+    nlp_->g_upperbound[i] = 0;
+  }
+
+  // As MPC's problems.
+  app_->Options()->SetStringValue("sb", "yes");
+  app_->Options()->SetIntegerValue("print_level", 0);
+  app_->Options()->SetNumericValue("max_cpu_time", 30);
+  app_->Options()->SetStringValue("linear_solver",
+                                  LinearSolverName(config.linearSolver));
+  app_->Options()->SetNumericValue("tol", config.tolerance);
+  app_->Options()->SetNumericValue("acceptable_tol",
+                                   config.acceptableTolerance);
+  app_->Options()->SetIntegerValue("acceptable_iter",
+                                   config.acceptableIterations);
+  app_->Options()->SetStringValue(
+      "mu_strategy", config.adaptiveMu ? "adaptive" : "monotone");
+  if (config.hessian == MpcConfig::LIMITED_MEMORY) {
+    app_->Options()->SetStringValue("hessian_approximation",
+                                    "limited-memory");
+  }
+  app_->Initialize();
+}
+
+Input FrenetMPC::Solve(const State& state, const Cubic& coeffs,
+                       std::vector<double>& mpc_x_vals,
+                       std::vector<double>& mpc_y_vals,
+                       std::chrono::steady_clock::time_point deadline) {
+  const size_t N = N_;
+  // Indices as PathProblem's.
+  auto S = [N](size_t i, size_t t) { return i * N + t; };
+  auto U = [N](size_t j, size_t t) { return 4 * N + j * (N - 1) + t; };
+
+  path_.Build(coeffs, std::min(state[0], 0.) - PATH_BEHIND);
+  double s0, n0;
+  path_.Project(state[0], state[1], s0, n0);
+  double px, py, heading, kappa;
+  path_.At(s0, px, py, heading, kappa);
+  double initial[4] = {s0, n0, state[2] - heading, state[3]};
+
+  // The last solution a stage on, its arc lengths from where the car is
+  // now, or the speed held along the path.
+  MPC_NLP& nlp = *nlp_;
+  MPC_NLP::Dvector& vars = nlp.x_init;
+  bool warm = warmStart && has_solution_;
+  const MPC_NLP::Dvector& last = nlp.x;
+  for (size_t t = 0; t < N; t++) {
+    size_t from = std::min(t + 1, N - 1);
+    for (size_t i = 0; i < 4; i++) {
+      vars[S(i, t)] = t == 0 ? initial[i] : warm ? last[S(i, from)]
+                                                 : initial[i];
+    }
+    if (t > 0) {
+      vars[S(0, t)] = warm && t + 1 < N
+                          ? s0 + last[S(0, t + 1)] - last[S(0, 1)]
+                          : vars[S(0, t - 1)] +
+                                std::max(vars[S(3, t - 1)], 0.) * dt_;
+    }
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    size_t from = std::min(t + 1, N - 2);
+    for (size_t j = 0; j < 2; j++) {
+      vars[U(j, t)] = warm ? last[U(j, from)] : 0;
+    }
+  }
+
+  for (size_t i = 0; i < 4; i++) {
+    params_[i] = initial[i];
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    path_.At((vars[S(0, t)] + vars[S(0, t + 1)]) / 2, px, py, heading,
+             kappa);
+    params_[4 + t] = kappa;
+  }
+  nlp.SetParameters(params_);
+  nlp.deadline = deadline;
+  nlp.deadline_reached = false;
+  if (optimized_) {
+    app_->ReOptimizeTNLP(GetRawPtr(nlp_));
+  } else {
+    app_->OptimizeTNLP(GetRawPtr(nlp_));
+    optimized_ = true;
+  }
+  lastConverged = MPC_NLP::Usable(nlp.status);
+  deadlineReached = nlp.deadline_reached;
+  lastIterations = nlp.iterations;
+  lastCost = nlp.obj_value;
+  has_solution_ = lastConverged;
+
+  const MPC_NLP::Dvector& x = nlp.x;
+  for (size_t t = 1; t < N; t++) {
+    path_.At(x[S(0, t)], px, py, heading, kappa);
+    mpc_x_vals.push_back(px - x[S(1, t)] * std::sin(heading));
+    mpc_y_vals.push_back(py + x[S(1, t)] * std::cos(heading));
+  }
+  return Input(x[U(0, 0)], x[U(1, 0)]);
+}
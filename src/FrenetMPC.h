@@ -0,0 +1,98 @@
+#ifndef FRENET_MPC_H
+#define FRENET_MPC_H
+
+#include <chrono>
+#include <vector>
+#include <coin/IpIpoptApplication.hpp>
+#include "BicycleModel.h"
+#include "MPC_NLP.h"
+#include "MpcConfig.h"
+
+// A frame's path by arc length: the cubic y = c(x) of the vehicle frame
+// sampled at even steps of x, with the arc length, heading and curvature
+// at each sample, so that a solve in path coordinates only looks them up.
+// Sized at construction.
+class PathCache {
+ public:
+  // Samples `step` meters of x apart, `points` of them.
+  PathCache(size_t points, double step);
+
+  // Sample `coeffs` from x = from on.
+  void Build(const Cubic& coeffs, double from);
+
+  // At arc length s from the first sample: the point, the heading of the
+  // tangent and the curvature, positive turning left. Beyond the samples
+  // the path goes on straight from the last one.
+  void At(double s, double& x, double& y, double& heading,
+          double& curvature) const;
+  // The arc length of the point of the path nearest (x, y), and how far
+  // (x, y) is to the left of it.
+  void Project(double x, double y, double& s, double& offset) const;
+
+  // Arc length to the last sample.
+  double length() const { return s_.back(); }
+
+ private:
+  double step_;
+  std::vector<double> s_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> heading_;
+  std::vector<double> curvature_;
+};
+
+// MPC in path coordinates: each stage's state is the arc length s along
+// the path, the offset n to its left and the heading error mu, with the
+// speed, instead of the position and heading in the vehicle frame, and the
+// kinematic bicycle moves them as
+//
+//   s' = v cos(mu) / (1 - kappa n),  n' = v sin(mu),
+//   mu' = v delta / Lf - kappa s',   v' = a,
+//
+// on the path's curvature kappa. The curvature of each step is a dynamic
+// parameter of the tape, looked up in a PathCache of the frame's cubic at
+// where the last solution, or the speed held, puts the car then, so the
+// tape has no polynomial and no atan of its slope, and the path isn't
+// differentiated through at all. cte and epsi are -n and mu, and the cost
+// is TrackingCost's, as for MPC's IPOPT method.
+//
+// Integrated by config.integrator, EXACT by RK4, at config.dt over
+// config.N stages; the horizon schedules, move blocking and the state
+// constraints of the Cartesian tape are left out.
+class FrenetMPC {
+ public:
+  explicit FrenetMPC(const MpcConfig& config);
+
+  // Start each solve from the last solution, shifted a stage.
+  bool warmStart;
+
+  // Returns the first actuations {delta, a} and appends the predicted
+  // trajectory in the vehicle frame, like MPC::Solve. Ipopt is stopped at
+  // `deadline`.
+  Input Solve(const State& state, const Cubic& coeffs,
+              std::vector<double>& mpc_x_vals,
+              std::vector<double>& mpc_y_vals,
+              std::chrono::steady_clock::time_point deadline);
+
+  // The last Solve: whether it converged, see MPC_NLP::Usable, or ran into
+  // the deadline, its iterations and its cost.
+  bool lastConverged;
+  bool deadlineReached;
+  int lastIterations;
+  double lastCost;
+
+  size_t tapeBytes() const { return nlp_->TapeBytes(); }
+  size_t workspaceBytes() const { return nlp_->WorkspaceBytes(); }
+
+ private:
+  size_t N_;
+  double dt_;
+  PathCache path_;
+  Ipopt::SmartPtr<MPC_NLP> nlp_;
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app_;
+  bool optimized_;
+  bool has_solution_;
+  MPC_NLP::Dvector params_;
+};
+
+#endif /* FRENET_MPC_H */
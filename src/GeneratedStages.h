@@ -0,0 +1,41 @@
+#ifndef GENERATED_STAGES_H
+#define GENERATED_STAGES_H
+
+#include <cstddef>
+#include "MpcConfig.h"
+
+// A stage of the full formulation and its derivatives as straight-line C++,
+// written at build time by tools/derivative_codegen for one model and
+// integrator over the stage lengths of MpcConfig's defaults, and compiled
+// into mpc_core as GeneratedStages.cpp; see StageStep in ProblemPolicies.h.
+// AutoDiffNLP evaluates a stage with these in place of AutoDiffScalar when
+// one was generated for its problem, see MpcConfig::generatedStages.
+//
+// Each function takes the path's cubic c and the stage's variables w, as
+// StageStep does: `step` gives the next state, `jacobian` its derivatives
+// by w as a dense 6 x 8 row-major block, and `hessian` the lower triangle
+// of those of lambda' next, row by row, for the multipliers lambda of the
+// next stage's constraints.
+struct GeneratedStage {
+  // What it was generated for, the model's constants and the length of
+  // the stage baked in.
+  MpcConfig::Model model;
+  MpcConfig::Integrator integrator;
+  double dt;
+  double Lf;
+  Tires tires;
+
+  void (*step)(const double* c, const double* w, double* next);
+  void (*jacobian)(const double* c, const double* w, double* J);
+  void (*hessian)(const double* c, const double* w, const double* lambda,
+                  double* H);
+};
+
+extern const GeneratedStage GENERATED_STAGES[];
+extern const size_t GENERATED_STAGE_COUNT;
+
+// The stage generated for config's model and integrator over stages of dt,
+// or NULL if there is none.
+const GeneratedStage* FindGeneratedStage(const MpcConfig& config, double dt);
+
+#endif /* GENERATED_STAGES_H */
@@ -0,0 +1,210 @@
+#include "Handoff.h"
+#include "Checkpoint.h"
+#include "Session.h"
+
+static void Respond(uWS::HttpResponse* res, const char* status,
+                    const std::string& body = std::string()) {
+  std::string head = "HTTP/1.1 ";
+  head += status;
+  head += "\r\nContent-Type: application/octet-stream\r\nContent-Length: ";
+  head += std::to_string(body.length());
+  head += "\r\n\r\n";
+  head += body;
+  res->write(head.data(), head.length());
+  res->end(nullptr, 0);
+}
+
+Handoffs::Handoffs(double maxAge, size_t maxBytes)
+    : max_age_(std::chrono::duration_cast<
+               std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(maxAge))),
+      max_bytes_(maxBytes) {}
+
+void Handoffs::Open(const std::string& key,
+                    const std::shared_ptr<Session>& session) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sessions_[key] = session;
+}
+
+void Handoffs::Close(const std::string& key, const Session* session) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = sessions_.find(key);
+  // Unless the key was opened again since.
+  if (found != sessions_.end()) {
+    std::shared_ptr<Session> open = found->second.lock();
+    if (!open || open.get() == session) {
+      sessions_.erase(found);
+    }
+  }
+}
+
+bool Handoffs::Take(const std::string& key, LatencyEstimator& response,
+                    LatencyEstimator& roundTrip, std::string& controller) {
+  Posted posted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = posted_.find(key);
+    if (found == posted_.end()) {
+      return false;
+    }
+    posted = std::move(found->second);
+    posted_.erase(found);
+  }
+  if (std::chrono::steady_clock::now() - posted.time > max_age_) {
+    return false;
+  }
+  const std::string& checkpoint = posted.checkpoint;
+  CheckpointReader in(checkpoint.data(),
+                      checkpoint.data() + checkpoint.size());
+  if (!in.Header() || !response.Restore(in) || !roundTrip.Restore(in)) {
+    return false;
+  }
+  controller.assign(in.position(), checkpoint.data() + checkpoint.size());
+  return true;
+}
+
+void Handoffs::Request(uWS::HttpResponse* res, uWS::HttpRequest req,
+                       const std::string& key, char* data, size_t length,
+                       size_t remaining) {
+  if (key.empty()) {
+    Respond(res, "400 Bad Request");
+  } else if (req.getMethod() == uWS::HttpMethod::METHOD_GET) {
+    Export(res, key);
+  } else if (req.getMethod() != uWS::HttpMethod::METHOD_POST) {
+    Respond(res, "405 Method Not Allowed");
+  } else if (length + remaining > max_bytes_) {
+    Respond(res, "413 Payload Too Large");
+  } else {
+    Upload upload;
+    upload.key = key;
+    upload.body.reserve(length + remaining);
+    upload.body.append(data, length);
+    if (remaining == 0) {
+      Import(res, upload);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    uploads_[res] = std::move(upload);
+  }
+}
+
+void Handoffs::Data(uWS::HttpResponse* res, char* data, size_t length,
+                    size_t remaining) {
+  Upload upload;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = uploads_.find(res);
+    if (found == uploads_.end()) {
+      return;
+    }
+    found->second.body.append(data, length);
+    if (remaining > 0) {
+      return;
+    }
+    upload = std::move(found->second);
+    uploads_.erase(found);
+  }
+  Import(res, upload);
+}
+
+void Handoffs::Cancelled(uWS::HttpResponse* res) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uploads_.erase(res);
+}
+
+void Handoffs::Export(uWS::HttpResponse* res, const std::string& key) {
+  std::shared_ptr<Session> session;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = sessions_.find(key);
+    if (found != sessions_.end()) {
+      session = found->second.lock();
+    }
+  }
+  if (!session) {
+    Respond(res, "404 Not Found");
+    return;
+  }
+  std::string checkpoint;
+  {
+    std::lock_guard<std::mutex> lock(session->checkpointMutex);
+    int stage = session->checkpointStage.load(std::memory_order_relaxed);
+    if (stage == Session::CHECKPOINT_TAKEN) {
+      checkpoint.swap(session->checkpoint);
+      session->checkpointStage.store(Session::NO_CHECKPOINT,
+                                     std::memory_order_relaxed);
+    } else if (stage == Session::NO_CHECKPOINT) {
+      session->checkpoint.clear();
+      session->checkpointStage.store(Session::CHECKPOINT_WANTED,
+                                     std::memory_order_relaxed);
+    }
+  }
+  if (checkpoint.empty()) {
+    Respond(res, "202 Accepted");
+  } else {
+    Respond(res, "200 OK", checkpoint);
+  }
+}
+
+void Handoffs::Import(uWS::HttpResponse* res, Upload& upload) {
+  const std::string& body = upload.body;
+  CheckpointReader in(body.data(), body.data() + body.size());
+  if (!in.Header()) {
+    Respond(res, "400 Bad Request");
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Those never claimed go once they are too old to be.
+    for (auto i = posted_.begin(); i != posted_.end();) {
+      if (now - i->second.time > max_age_) {
+        i = posted_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+    Posted& posted = posted_[upload.key];
+    posted.checkpoint.swap(upload.body);
+    posted.time = now;
+  }
+  Respond(res, "200 OK");
+}
+
+void CheckpointLatencies(Session& session) {
+  if (session.checkpointStage.load(std::memory_order_relaxed) !=
+      Session::CHECKPOINT_WANTED) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(session.checkpointMutex);
+  if (session.checkpointStage.load(std::memory_order_relaxed) ==
+      Session::CHECKPOINT_WANTED) {
+    CheckpointWriter out(session.checkpoint);
+    out.Header();
+    session.response.Checkpoint(out);
+    session.roundTrip.Checkpoint(out);
+    session.checkpointStage.store(Session::CHECKPOINT_LATENCIES,
+                                  std::memory_order_relaxed);
+  }
+}
+
+void CheckpointController(Session& session) {
+  if (session.checkpointStage.load(std::memory_order_relaxed) !=
+      Session::CHECKPOINT_LATENCIES) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(session.checkpointMutex);
+  if (session.checkpointStage.load(std::memory_order_relaxed) ==
+      Session::CHECKPOINT_LATENCIES) {
+    CheckpointWriter out(session.checkpoint);
+    session.controller->Checkpoint(out);
+    session.checkpointStage.store(Session::CHECKPOINT_TAKEN,
+                                  std::memory_order_relaxed);
+  }
+}
+
+bool RestoreController(Session& session, const std::string& controller) {
+  CheckpointReader in(controller.data(),
+                      controller.data() + controller.size());
+  return session.controller->Restore(in);
+}
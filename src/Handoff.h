@@ -0,0 +1,100 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <uWS/uWS.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "LatencyEstimator.h"
+
+class Session;
+
+// Moving a session to another server when the sessions are rebalanced,
+// without it starting cold there: no warm start, no latency estimate and a
+// search of the whole track. A connection that may move opens with
+// ?handoff=<key> in its URL, the key unique among the servers it may move
+// between, and whoever moves it then
+//
+//   1. GETs /checkpoint?handoff=<key> from the old server, which answers 202
+//      while the session takes its checkpoint, see below, and then 200 with
+//      it, see Checkpoint.h;
+//   2. POSTs that body to /checkpoint?handoff=<key> on the new server, which
+//      keeps it for maxAge seconds;
+//   3. has the client reconnect to the new server with the same key, and
+//      hang up on the old one.
+//
+// The new session reads the checkpoint before its first frame, and answers
+// it warm started from the old one's last solution, with its latency
+// estimates, ladder tier and place on the track. The old session answers
+// frames until the client leaves it, and the checkpoint ages with each: it
+// is for the frame after the first GET. Both servers should run the same
+// tuning on the same track; whatever doesn't match starts afresh.
+//
+// The checkpoint is taken in two halves, each on the thread that owns it:
+// after the GET, the session's event loop writes the latency estimates as
+// the next frame arrives, and its worker the controller's state the next
+// time it is between frames, see Session::checkpointStage.
+//
+// One for all the hubs: the sessions of every hub, by key, and the
+// checkpoints posted, under a mutex.
+class Handoffs {
+ public:
+  // Checkpoints posted are kept for maxAge seconds, and those over maxBytes
+  // refused.
+  Handoffs(double maxAge, size_t maxBytes);
+
+  // A session opened or closed under `key`; on its event loop.
+  void Open(const std::string& key, const std::shared_ptr<Session>& session);
+  void Close(const std::string& key, const Session* session);
+
+  // The checkpoint posted for `key`, taken out, or empty if there is none
+  // younger than maxAge; on the event loop opening the new session. Its
+  // latency estimates go into `response` and `roundTrip`, and the rest,
+  // for RestoreController, into `controller`; false if it is none.
+  bool Take(const std::string& key, LatencyEstimator& response,
+            LatencyEstimator& roundTrip, std::string& controller);
+
+  // Answer a GET or POST for `key`, and take the rest of a POST's body, as
+  // Planner::Request and Data do; on any hub.
+  void Request(uWS::HttpResponse* res, uWS::HttpRequest req,
+               const std::string& key, char* data, size_t length,
+               size_t remaining);
+  void Data(uWS::HttpResponse* res, char* data, size_t length,
+            size_t remaining);
+  void Cancelled(uWS::HttpResponse* res);
+
+ private:
+  struct Posted {
+    std::string checkpoint;
+    std::chrono::steady_clock::time_point time;
+  };
+  struct Upload {
+    std::string key;
+    std::string body;
+  };
+
+  // Answer step 1 and step 2.
+  void Export(uWS::HttpResponse* res, const std::string& key);
+  void Import(uWS::HttpResponse* res, Upload& upload);
+
+  std::chrono::steady_clock::duration max_age_;
+  size_t max_bytes_;
+  std::mutex mutex_;
+  std::map<std::string, std::weak_ptr<Session> > sessions_;
+  std::map<std::string, Posted> posted_;
+  std::map<uWS::HttpResponse*, Upload> uploads_;
+};
+
+// The halves of a wanted checkpoint: the latency estimates, on the
+// session's event loop as a frame arrives, and the controller's state, on
+// its worker between frames.
+void CheckpointLatencies(Session& session);
+void CheckpointController(Session& session);
+
+// Read the controller's half of a checkpoint, from Handoffs::Take, into the
+// session's controller; on its worker once it is set up.
+bool RestoreController(Session& session, const std::string& controller);
+
+#endif /* HANDOFF_H */
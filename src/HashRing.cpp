@@ -0,0 +1,60 @@
+#include "HashRing.h"
+#include <algorithm>
+#include <cmath>
+
+HashRing::HashRing(size_t replicas) : replicas_(replicas) {}
+
+void HashRing::Set(const std::vector<std::string>& nodes) {
+  points_.clear();
+  points_.reserve(nodes.size() * replicas_);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    for (size_t r = 0; r < replicas_; r++) {
+      points_.emplace_back(Hash(nodes[i] + "#" + std::to_string(r)), i);
+    }
+  }
+  std::sort(points_.begin(), points_.end());
+}
+
+size_t HashRing::Find(const std::string& key, const std::vector<double>& load,
+                      double factor) const {
+  double total = 1;
+  size_t up = 0;
+  for (double l : load) {
+    if (std::isfinite(l)) {
+      total += l;
+      up++;
+    }
+  }
+  if (up == 0 || points_.empty()) {
+    return NONE;
+  }
+  // The least loaded node is under the mean, and so always has room.
+  double capacity = std::ceil(factor * total / up);
+  auto start = std::lower_bound(
+      points_.begin(), points_.end(),
+      std::make_pair(Hash(key), size_t(0)));
+  for (size_t k = 0; k < points_.size(); k++) {
+    size_t i = (start - points_.begin() + k) % points_.size();
+    size_t node = points_[i].second;
+    if (node < load.size() && load[node] < capacity) {
+      return node;
+    }
+  }
+  return NONE;
+}
+
+// FNV-1a, with the finalizer of splitmix64 to spread the nearby hashes of
+// a node's replicas over the ring.
+uint64_t HashRing::Hash(const std::string& key) {
+  uint64_t h = 14695981039346656037ull;
+  for (char c : key) {
+    h ^= uint8_t(c);
+    h *= 1099511628211ull;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h;
+}
@@ -0,0 +1,43 @@
+#ifndef HASH_RING_H
+#define HASH_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Consistent hashing with bounded loads, for placing sessions on nodes.
+//
+// Each node is `replicas` points on a ring of 64-bit hashes, and a key goes
+// to the first node clockwise of its own hash: a node joining takes about
+// 1/n of the keys, from every other node, and one leaving hands its keys
+// around the ring, while the other keys stay where they were. Find() also
+// skips the nodes already at capacity, ceil(factor times the mean load)
+// with the new key counted, so that no node takes more than its share
+// however the keys hash; see Mirrokni, Thorup and Zadimoghaddam,
+// "Consistent Hashing with Bounded Loads".
+class HashRing {
+ public:
+  static const size_t NONE = size_t(-1);
+
+  explicit HashRing(size_t replicas = 100);
+
+  // Place `nodes`, which are then known by their indices there; the points
+  // of a node depend on its name only.
+  void Set(const std::vector<std::string>& nodes);
+
+  // The node of `key`, given each node's load, or NONE if none has one;
+  // an infinite load takes a node out, as when it is down.
+  size_t Find(const std::string& key, const std::vector<double>& load,
+              double factor) const;
+
+  static uint64_t Hash(const std::string& key);
+
+ private:
+  size_t replicas_;
+  // By hash.
+  std::vector<std::pair<uint64_t, size_t> > points_;
+};
+
+#endif /* HASH_RING_H */
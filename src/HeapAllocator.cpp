@@ -0,0 +1,99 @@
+#include "HeapAllocator.h"
+#include <dlfcn.h>
+#include <malloc.h>
+#include <cstddef>
+
+// jemalloc's and mimalloc's entry points for their statistics, looked up
+// rather than linked, for a build that runs on either or on neither.
+typedef int (*Mallctl)(const char* name, void* old_value, size_t* old_length,
+                       void* new_value, size_t new_length);
+typedef void (*MiProcessInfo)(size_t* elapsed_ms, size_t* user_ms,
+                              size_t* system_ms, size_t* rss,
+                              size_t* peak_rss, size_t* commit,
+                              size_t* peak_commit, size_t* page_faults);
+
+static Mallctl FindMallctl() {
+  static Mallctl mallctl =
+      reinterpret_cast<Mallctl>(dlsym(RTLD_DEFAULT, "mallctl"));
+  return mallctl;
+}
+
+static MiProcessInfo FindMiProcessInfo() {
+  static MiProcessInfo info =
+      reinterpret_cast<MiProcessInfo>(dlsym(RTLD_DEFAULT, "mi_process_info"));
+  return info;
+}
+
+HeapAllocatorKind HeapAllocator() {
+  if (FindMallctl()) {
+    return JEMALLOC;
+  }
+  if (FindMiProcessInfo()) {
+    return MIMALLOC;
+  }
+  return GLIBC_MALLOC;
+}
+
+const char* HeapAllocatorName(HeapAllocatorKind kind) {
+  switch (kind) {
+    case JEMALLOC:
+      return "jemalloc";
+    case MIMALLOC:
+      return "mimalloc";
+    default:
+      return "glibc";
+  }
+}
+
+// A size_t statistic of jemalloc's.
+static bool JemallocStat(Mallctl mallctl, const char* name, uint64_t& value) {
+  size_t v = 0;
+  size_t length = sizeof(v);
+  if (mallctl(name, &v, &length, nullptr, 0) != 0) {
+    return false;
+  }
+  value = v;
+  return true;
+}
+
+bool ReadHeapUsage(HeapUsage& usage) {
+  switch (HeapAllocator()) {
+    case JEMALLOC: {
+      Mallctl mallctl = FindMallctl();
+      // Its statistics are as of the last epoch.
+      uint64_t epoch = 1;
+      size_t length = sizeof(epoch);
+      mallctl("epoch", &epoch, &length, &epoch, sizeof(epoch));
+      uint64_t resident = 0;
+      if (!JemallocStat(mallctl, "stats.allocated", usage.inuse) ||
+          !JemallocStat(mallctl, "stats.resident", resident) ||
+          !JemallocStat(mallctl, "stats.mapped", usage.mapped)) {
+        return false;
+      }
+      usage.free = resident > usage.inuse ? resident - usage.inuse : 0;
+      return true;
+    }
+    case MIMALLOC: {
+      size_t elapsed, user, system, rss, peak_rss, commit, peak_commit;
+      size_t faults;
+      FindMiProcessInfo()(&elapsed, &user, &system, &rss, &peak_rss, &commit,
+                          &peak_commit, &faults);
+      usage.inuse = 0;
+      usage.free = 0;
+      usage.mapped = commit;
+      return true;
+    }
+    default: {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+      struct mallinfo2 info = mallinfo2();
+#else
+      // Before glibc 2.33, in ints that wrap past 2 GB.
+      struct mallinfo info = mallinfo();
+#endif
+      usage.inuse = info.uordblks;
+      usage.free = info.fordblks;
+      usage.mapped = info.hblkhd;
+      return true;
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef HEAP_ALLOCATOR_H
+#define HEAP_ALLOCATOR_H
+
+#include <cstdint>
+
+// The malloc the process runs on. Ipopt, CppAD's pools through operator new
+// and Eigen all allocate from it, and glibc's arenas are taken under locks
+// that the solver threads contend for; jemalloc and mimalloc keep caches of
+// their own on each thread instead. Either replaces glibc's when linked
+// into the server, see MPC_ALLOCATOR in CMakeLists.txt, or preloaded with
+// LD_PRELOAD, and is found here by its entry points, so that the same build
+// reports on whichever it runs on; bench/allocators.cpp compares them.
+enum HeapAllocatorKind { GLIBC_MALLOC, JEMALLOC, MIMALLOC };
+
+HeapAllocatorKind HeapAllocator();
+const char* HeapAllocatorName(HeapAllocatorKind kind);
+
+// The heap as the allocator holds it: allocated; held but not allocated,
+// in glibc's arenas or jemalloc's resident pages and thread caches; and
+// mapped, glibc's large blocks on their own or all of jemalloc's. mimalloc
+// tells only what it has committed, as mapped. What is held against what
+// is allocated is the fragmentation a long run leaves.
+struct HeapUsage {
+  uint64_t inuse;
+  uint64_t free;
+  uint64_t mapped;
+};
+bool ReadHeapUsage(HeapUsage& usage);
+
+#endif /* HEAP_ALLOCATOR_H */
@@ -0,0 +1,97 @@
+#include "HeapGuard.h"
+
+#ifdef MPC_STATIC_MEMORY
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// glibc's own allocator, under the names it keeps for interposers.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void __libc_free(void* p);
+}
+
+static std::atomic<bool> sealed(false);
+
+// Nothing here may allocate, so the message goes straight to the fd.
+static void Touched(const char* call) {
+  static const char prefix[] = "heap guard: ";
+  static const char suffix[] = " after SealHeap()\n";
+  ssize_t ignored = write(2, prefix, sizeof(prefix) - 1);
+  ignored = write(2, call, strlen(call));
+  ignored = write(2, suffix, sizeof(suffix) - 1);
+  (void)ignored;
+  abort();
+}
+
+static inline void Check(const char* call) {
+  if (sealed.load(std::memory_order_relaxed)) {
+    Touched(call);
+  }
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+  Check("malloc");
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  Check("calloc");
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+  Check("realloc");
+  return __libc_realloc(p, size);
+}
+
+void* memalign(size_t align, size_t size) {
+  Check("memalign");
+  return __libc_memalign(align, size);
+}
+
+void* aligned_alloc(size_t align, size_t size) {
+  Check("aligned_alloc");
+  return __libc_memalign(align, size);
+}
+
+int posix_memalign(void** p, size_t align, size_t size) {
+  Check("posix_memalign");
+  void* q = __libc_memalign(align, size);
+  if (!q) {
+    return ENOMEM;
+  }
+  *p = q;
+  return 0;
+}
+
+void free(void* p) {
+  if (p) {
+    Check("free");
+  }
+  __libc_free(p);
+}
+
+}  // extern "C"
+
+bool GuardingHeap() { return true; }
+void SealHeap() { sealed.store(true, std::memory_order_relaxed); }
+void UnsealHeap() { sealed.store(false, std::memory_order_relaxed); }
+bool HeapSealed() { return sealed.load(std::memory_order_relaxed); }
+
+#else
+
+bool GuardingHeap() { return false; }
+void SealHeap() {}
+void UnsealHeap() {}
+bool HeapSealed() { return false; }
+
+#endif
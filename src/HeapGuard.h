@@ -0,0 +1,25 @@
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+// The heap guard of the static-memory profile, for deployments that may not
+// touch the heap once the control loop runs. Built with MPC_STATIC_MEMORY,
+// HeapGuard.cpp interposes malloc, calloc, realloc, the aligned allocators
+// and free over glibc's, which covers operator new, Eigen and the standard
+// containers alike; after SealHeap() any of them aborts the process. Without
+// it nothing is replaced and sealing does nothing. The CMake option of the
+// same name builds the profile, see bench/static_memory.cpp.
+//
+// Everything a controller uses is sized or drawn at construction and in
+// MPC::WarmUp: the LTV and LQR methods then solve without allocating, the
+// others may not, see MPC::StaticMemory.
+
+// Whether this build guards the heap.
+bool GuardingHeap();
+// From now on, abort on any heap call, on any thread. Call it once the
+// controllers are constructed and warmed up.
+void SealHeap();
+// Allow the heap again, for shutdown.
+void UnsealHeap();
+bool HeapSealed();
+
+#endif /* HEAP_GUARD_H */
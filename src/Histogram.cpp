@@ -0,0 +1,72 @@
+#include "Histogram.h"
+#include <cmath>
+
+// Exponents of the first and last bucket bounds, and buckets per doubling.
+static const int MIN_EXPONENT = -24;
+static const int MAX_EXPONENT = 8;
+static const int SUB_BUCKETS = 4;
+
+Histogram::Histogram() : count_(0), sum_(0) {
+  for (int i = 0; i < BUCKETS; i++) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Record(double seconds) {
+  // seconds = m 2^e with m in [0.5, 1); the top bits of m past the leading
+  // one pick the bucket within the doubling.
+  int e;
+  double m = frexp(seconds, &e);
+  int i;
+  if (!(seconds > 0) || e <= MIN_EXPONENT) {
+    i = 0;
+  } else if (e > MAX_EXPONENT) {
+    i = BUCKETS - 1;
+  } else {
+    i = 1 + (e - 1 - MIN_EXPONENT) * SUB_BUCKETS +
+        int((m - 0.5) * 2 * SUB_BUCKETS);
+  }
+  counts_[i].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  if (seconds > 0) {
+    sum_.fetch_add(uint64_t(seconds * 1e9 + 0.5), std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Read(Snapshot& snapshot) const {
+  snapshot.count = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.counts[i];
+  }
+  snapshot.sum = sum_.load(std::memory_order_relaxed) * 1e-9;
+}
+
+double Histogram::UpperBound(int i) {
+  if (i >= BUCKETS - 1) {
+    return INFINITY;
+  }
+  if (i == 0) {
+    return ldexp(1.0, MIN_EXPONENT);
+  }
+  int doubling = (i - 1) / SUB_BUCKETS;
+  int sub = (i - 1) % SUB_BUCKETS;
+  return ldexp(1.0 + double(sub + 1) / SUB_BUCKETS,
+               MIN_EXPONENT + doubling);
+}
+
+double Histogram::Snapshot::Percentile(double p) const {
+  if (count == 0) {
+    return 0;
+  }
+  // The rank of the quantile, counting from 1.
+  uint64_t rank = uint64_t(p * (count - 1)) + 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return UpperBound(i);
+    }
+  }
+  return UpperBound(BUCKETS - 1);
+}
@@ -0,0 +1,48 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free histogram of durations, recorded from any number of threads and
+// read from any other while they do.
+//
+// The buckets are logarithmic, four to each doubling from 2^-24 s (60 ns) to
+// 2^8 s, so a quantile read from them, a bucket's upper bound, is at most 25%
+// above the true one. Recording is a few relaxed atomic increments, with no
+// allocation and no locks; reading copies the counts one by one, so a
+// snapshot taken while samples come in may miss some of those.
+class Histogram {
+ public:
+  // Below the first bound, the bounded buckets, and above the last.
+  static const int BUCKETS = 1 + 4 * 32 + 1;
+
+  Histogram();
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void Record(double seconds);
+
+  // The counts at one moment.
+  struct Snapshot {
+    uint64_t counts[BUCKETS];
+    uint64_t count;
+    double sum;
+
+    // The upper bound of the bucket holding the p-quantile, p in [0, 1]; 0
+    // without samples.
+    double Percentile(double p) const;
+  };
+  void Read(Snapshot& snapshot) const;
+
+  // The largest duration in bucket i, in seconds; infinite for the last.
+  static double UpperBound(int i);
+
+ private:
+  std::atomic<uint64_t> counts_[BUCKETS];
+  std::atomic<uint64_t> count_;
+  // In nanoseconds, to stay an integer.
+  std::atomic<uint64_t> sum_;
+};
+
+#endif /* HISTOGRAM_H */
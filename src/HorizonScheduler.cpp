@@ -0,0 +1,75 @@
+#include "HorizonScheduler.h"
+#include <cmath>
+#include "Checkpoint.h"
+
+// Weight of the newest sample in the smoothed solve times.
+static const double SOLVE_TIME_SMOOTHING = 0.2;
+// Over-budget candidates aren't solved, so their times are decayed by this
+// fraction per frame instead, to retry them once the host has headroom.
+static const double SOLVE_TIME_DECAY = 0.01;
+
+HorizonScheduler::HorizonScheduler(const std::vector<Horizon>& candidates)
+    : lookaheadBase(0.3), lookaheadGain(0.01), hysteresis(0.1), budget(0.05),
+      candidates_(candidates), solve_time_(candidates.size(), 0),
+      current_(0) {}
+
+size_t HorizonScheduler::Select(double v) {
+  double target = lookaheadBase + lookaheadGain * std::fabs(v);
+  size_t best = candidates_.size();
+  double best_error = 0;
+  size_t fastest = 0;
+  for (size_t i = 0; i < candidates_.size(); i++) {
+    if (solve_time_[i] < solve_time_[fastest]) {
+      fastest = i;
+    }
+    if (solve_time_[i] > budget) {
+      if (i != current_) {
+        solve_time_[i] *= 1 - SOLVE_TIME_DECAY;
+      }
+      continue;
+    }
+    double error = std::fabs(candidates_[i].N * candidates_[i].dt - target);
+    if (best == candidates_.size() || error < best_error) {
+      best = i;
+      best_error = error;
+    }
+  }
+  if (best == candidates_.size()) {
+    // Nothing fits the budget; fall back to the quickest one seen.
+    current_ = fastest;
+    return current_;
+  }
+  double current_error = std::fabs(
+      candidates_[current_].N * candidates_[current_].dt - target);
+  bool current_fits = solve_time_[current_] <= budget;
+  if (!current_fits || current_error > best_error + hysteresis) {
+    current_ = best;
+  }
+  return current_;
+}
+
+void HorizonScheduler::Record(size_t i, double seconds) {
+  if (solve_time_[i] == 0) {
+    solve_time_[i] = seconds;
+  } else {
+    solve_time_[i] += SOLVE_TIME_SMOOTHING * (seconds - solve_time_[i]);
+  }
+}
+
+void HorizonScheduler::Checkpoint(CheckpointWriter& out) const {
+  out.Count(current_);
+  out.Doubles(solve_time_, solve_time_.size());
+}
+
+bool HorizonScheduler::Restore(CheckpointReader& in) {
+  size_t current;
+  std::vector<double> solve_time;
+  if (!in.Count(current) || !in.Doubles(solve_time)) {
+    return false;
+  }
+  if (solve_time.size() == solve_time_.size() && current < solve_time.size()) {
+    current_ = current;
+    solve_time_.swap(solve_time);
+  }
+  return true;
+}
@@ -0,0 +1,56 @@
+#ifndef HORIZON_SCHEDULER_H
+#define HORIZON_SCHEDULER_H
+
+#include <cstddef>
+#include <vector>
+
+class CheckpointReader;
+class CheckpointWriter;
+
+// A problem shape: N steps of dt seconds.
+struct Horizon {
+  size_t N;
+  double dt;
+};
+
+// Picks the horizon for each frame from the current speed and the measured
+// solve times.
+//
+// The lookahead should grow with speed: at low speed a long horizon is wasted
+// compute, at high speed 0.5 s doesn't see the next corner. Select() aims for
+// lookaheadBase + lookaheadGain * v seconds among the candidates whose
+// smoothed solve time fits the budget, and only leaves the current candidate
+// when another is closer by more than `hysteresis` seconds. The candidates
+// are fixed at construction, and their indices identify them to the caller.
+class HorizonScheduler {
+ public:
+  explicit HorizonScheduler(const std::vector<Horizon>& candidates);
+
+  // Lookahead target in seconds, v in the simulator's speed units.
+  double lookaheadBase;
+  double lookaheadGain;
+  double hysteresis;
+  // Solve time budget in seconds.
+  double budget;
+
+  // Index of the candidate to use at speed v.
+  size_t Select(double v);
+  // Record how long a solve with candidate i took.
+  void Record(size_t i, double seconds);
+
+  const std::vector<Horizon>& candidates() const { return candidates_; }
+  // Smoothed solve time of candidate i, 0 until it has been measured.
+  double solveTime(size_t i) const { return solve_time_[i]; }
+
+  // Write the current candidate and the solve times into a checkpoint, and
+  // read them back; a scheduler of other candidates reads past them.
+  void Checkpoint(CheckpointWriter& out) const;
+  bool Restore(CheckpointReader& in);
+
+ private:
+  std::vector<Horizon> candidates_;
+  std::vector<double> solve_time_;
+  size_t current_;
+};
+
+#endif /* HORIZON_SCHEDULER_H */
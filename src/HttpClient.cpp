@@ -0,0 +1,145 @@
+#include "HttpClient.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <strings.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+typedef std::chrono::steady_clock Clock;
+
+// Milliseconds left until `deadline`, at least 0.
+static int Remaining(Clock::time_point deadline) {
+  auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - Clock::now());
+  return left.count() > 0 ? int(left.count()) : 0;
+}
+
+// Wait for `events` on `fd` until `deadline`.
+static bool Ready(int fd, short events, Clock::time_point deadline) {
+  pollfd p;
+  p.fd = fd;
+  p.events = events;
+  return poll(&p, 1, Remaining(deadline)) == 1;
+}
+
+// The Content-Length of the response headers `head`, or -1.
+static long ContentLength(const std::string& head) {
+  static const char name[] = "\r\ncontent-length:";
+  size_t n = sizeof(name) - 1;
+  for (size_t i = 0; i + n <= head.size(); i++) {
+    if (strncasecmp(head.data() + i, name, n) == 0) {
+      return strtol(head.c_str() + i + n, nullptr, 10);
+    }
+  }
+  return -1;
+}
+
+static bool Exchange(int fd, const std::string& request,
+                     Clock::time_point deadline, int& status,
+                     std::string& response) {
+  for (size_t sent = 0; sent < request.size();) {
+    if (!Ready(fd, POLLOUT, deadline)) {
+      return false;
+    }
+    ssize_t n = send(fd, request.data() + sent, request.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  std::string in;
+  char buffer[4096];
+  size_t body = std::string::npos;
+  long length = -1;
+  for (;;) {
+    if (body != std::string::npos && length >= 0 &&
+        in.size() >= body + length) {
+      break;
+    }
+    if (!Ready(fd, POLLIN, deadline)) {
+      return false;
+    }
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      // Without a length, the body is what came before the end.
+      if (body == std::string::npos || length >= 0) {
+        return false;
+      }
+      break;
+    }
+    in.append(buffer, n);
+    if (body == std::string::npos) {
+      size_t end = in.find("\r\n\r\n");
+      if (end != std::string::npos) {
+        body = end + 4;
+        length = ContentLength(in.substr(0, body));
+      }
+    }
+  }
+  if (in.compare(0, 5, "HTTP/") != 0 || in.find(' ') == std::string::npos) {
+    return false;
+  }
+  status = atoi(in.c_str() + in.find(' ') + 1);
+  response.assign(in, body, length >= 0 ? size_t(length) : std::string::npos);
+  return true;
+}
+
+bool HttpRequest(const char* host, int port, const char* method,
+                 const std::string& target, const std::string& body,
+                 double timeout, int& status, std::string& response) {
+  Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeout));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(uint16_t(port));
+  if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+    return false;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    return false;
+  }
+  // Connected once writable, if without an error.
+  int error = 0;
+  socklen_t size = sizeof(error);
+  bool connected =
+      (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+           0 ||
+       (errno == EINPROGRESS && Ready(fd, POLLOUT, deadline) &&
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) == 0 &&
+        error == 0));
+  std::string request = std::string(method) + " " + target +
+                        " HTTP/1.1\r\nHost: " + host +
+                        "\r\nConnection: close\r\nContent-Length: " +
+                        std::to_string(body.size()) + "\r\n\r\n" + body;
+  bool answered =
+      connected && Exchange(fd, request, deadline, status, response);
+  close(fd);
+  return answered;
+}
+
+std::string QueryParameter(const std::string& url, const std::string& name) {
+  size_t query = url.find('?');
+  while (query != std::string::npos) {
+    size_t begin = query + 1;
+    size_t end = std::min(url.find('&', begin), url.length());
+    if (url.compare(begin, name.length(), name) == 0 &&
+        begin + name.length() < end && url[begin + name.length()] == '=') {
+      return url.substr(begin + name.length() + 1,
+                        end - begin - name.length() - 1);
+    }
+    query = end < url.length() ? end : std::string::npos;
+  }
+  return std::string();
+}
@@ -0,0 +1,19 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <string>
+
+// A blocking HTTP/1.1 request, on a connection of its own, for talking to
+// other servers off the event loop: scraping their /metrics and handing
+// sessions over, see Proxy. `host` is an IPv4 address. The response must
+// carry a Content-Length, as uWS's do, or end with the connection. False
+// if the server couldn't be reached or didn't answer in `timeout` seconds
+// overall; the status code and the body otherwise.
+bool HttpRequest(const char* host, int port, const char* method,
+                 const std::string& target, const std::string& body,
+                 double timeout, int& status, std::string& response);
+
+// The value of parameter `name` in the query of `url`, or empty.
+std::string QueryParameter(const std::string& url, const std::string& name);
+
+#endif /* HTTP_CLIENT_H */
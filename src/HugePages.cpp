@@ -0,0 +1,88 @@
+#include "HugePages.h"
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#ifdef __GLIBC__
+#include <gnu/libc-version.h>
+#endif
+
+static const char* const MODE_NAMES[] = {"none", "transparent", "explicit"};
+
+// The tunable, set to the mode's number.
+static const char TUNABLE[] = "glibc.malloc.hugetlb=";
+
+const char* HugePageModeName(HugePageMode mode) { return MODE_NAMES[mode]; }
+
+// Whether this glibc reads glibc.malloc.hugetlb: 2.35 and later.
+static bool HasTunable() {
+#ifdef __GLIBC__
+  int major = 0;
+  int minor = 0;
+  return sscanf(gnu_get_libc_version(), "%d.%d", &major, &minor) == 2 &&
+         (major > 2 || (major == 2 && minor >= 35));
+#else
+  return false;
+#endif
+}
+
+HugePageMode HeapHugePages() {
+  const char* tunables = getenv("GLIBC_TUNABLES");
+  const char* setting = tunables ? strstr(tunables, TUNABLE) : nullptr;
+  if (!setting || !HasTunable()) {
+    return NO_HUGE_PAGES;
+  }
+  switch (atoi(setting + sizeof(TUNABLE) - 1)) {
+    case 1:
+      return TRANSPARENT_HUGE_PAGES;
+    case 0:
+      return NO_HUGE_PAGES;
+    default:
+      return EXPLICIT_HUGE_PAGES;
+  }
+}
+
+bool UseHugePages(HugePageMode mode, char* argv[]) {
+  if (!HasTunable()) {
+    return false;
+  }
+  if (HeapHugePages() == mode) {
+    return true;
+  }
+  // The other tunables stay, and glibc takes the last of a repeated one.
+  const char* tunables = getenv("GLIBC_TUNABLES");
+  std::string value = tunables ? std::string(tunables) + ":" : "";
+  value += TUNABLE + std::to_string(int(mode));
+  setenv("GLIBC_TUNABLES", value.c_str(), 1);
+  execv("/proc/self/exe", argv);
+  perror("execv");
+  return false;
+}
+
+bool ReadHugePageUsage(HugePageUsage& usage) {
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  if (!smaps) {
+    return false;
+  }
+  usage.transparentBytes = 0;
+  usage.explicitBytes = 0;
+  std::string key;
+  uint64_t kilobytes;
+  while (smaps >> key) {
+    if (!(smaps >> kilobytes)) {
+      // The header line's address range and path.
+      smaps.clear();
+      smaps.ignore(1 << 16, '\n');
+      continue;
+    }
+    if (key == "AnonHugePages:") {
+      usage.transparentBytes += kilobytes << 10;
+    } else if (key == "Shared_Hugetlb:" || key == "Private_Hugetlb:") {
+      usage.explicitBytes += kilobytes << 10;
+    }
+    smaps.ignore(1 << 16, '\n');
+  }
+  return true;
+}
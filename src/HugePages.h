@@ -0,0 +1,42 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Huge pages for the controllers' memory, against the TLB misses of
+// hundreds of sessions' tapes, KKT matrices and sweep buffers spread over
+// small pages. That memory all comes from malloc: Eigen's, CppAD's pools
+// through operator new, Ipopt's; so it is malloc's arenas that are backed,
+// through glibc's glibc.malloc.hugetlb tunable (2.35 and later).
+// TRANSPARENT_HUGE_PAGES has malloc madvise its heaps for transparent huge
+// pages, which the kernel may or may not find; EXPLICIT_HUGE_PAGES maps
+// them with MAP_HUGETLB from the pages reserved in vm.nr_hugepages, falling
+// back to small pages once those run out.
+enum HugePageMode {
+  NO_HUGE_PAGES,
+  TRANSPARENT_HUGE_PAGES,
+  EXPLICIT_HUGE_PAGES
+};
+
+const char* HugePageModeName(HugePageMode mode);
+
+// Back malloc with `mode`'s pages. glibc reads its tunables as the process
+// starts, so unless they already ask for `mode` this executes the program
+// again with them, with the same `argv`, and doesn't return; call it first
+// thing in main, before any thread starts. False, changing nothing, if this
+// glibc has no such tunable.
+bool UseHugePages(HugePageMode mode, char* argv[]);
+
+// The mode malloc was started with.
+HugePageMode HeapHugePages();
+
+// The process's memory in huge pages: transparent ones, and those of
+// vm.nr_hugepages. False where /proc doesn't say.
+struct HugePageUsage {
+  uint64_t transparentBytes;
+  uint64_t explicitBytes;
+};
+bool ReadHugePageUsage(HugePageUsage& usage);
+
+#endif /* HUGE_PAGES_H */
@@ -0,0 +1,616 @@
+#include "InteriorPoint.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+// Ipopt's defaults, where it has the same parameter.
+static const double BOUND_INFINITY = 1e19;
+static const double BOUND_PUSH = 1e-2;
+static const double WARM_BOUND_PUSH = 1e-6;
+static const double MU_INIT = 0.1;
+static const double BARRIER_TOL_FACTOR = 10;
+static const double MU_LINEAR_DECREASE = 0.2;
+static const double MU_SUPERLINEAR_DECREASE = 1.5;
+static const double TAU_MIN = 0.99;
+static const double KAPPA_SIGMA = 1e10;
+static const double S_MAX = 100;
+static const double FIRST_HESSIAN_PERTURBATION = 1e-4;
+static const double MIN_HESSIAN_PERTURBATION = 1e-20;
+static const double MAX_HESSIAN_PERTURBATION = 1e20;
+static const double JACOBIAN_REGULARIZATION = 1e-8;
+// Armijo's sufficient decrease and the line search's trials.
+static const double ARMIJO = 1e-4;
+static const int LINE_SEARCH_TRIALS = 30;
+static const int MAX_SOC = 4;
+// Iterative refinement of the KKT solves, as Ipopt's, until the residual is
+// this small relative to the right hand side.
+static const int MAX_REFINEMENT_STEPS = 10;
+static const double RESIDUAL_RATIO = 1e-10;
+
+namespace {
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace
+
+InteriorPoint::InteriorPoint()
+    : tol(1e-8), maxIterations(3000), fixedIterations(0), warmStart(false),
+      muInit(MU_INIT), n_(-1), m_(-1), n_slacks_(0), n_kkt_(0), last_delta_(0),
+      f_(0), eval_seconds_(0), linear_solve_seconds_(0) {}
+
+void InteriorPoint::Setup(MPC_NLP& nlp) {
+  Ipopt::Index n;
+  Ipopt::Index m;
+  Ipopt::Index nnz_jac;
+  Ipopt::Index nnz_hes;
+  Ipopt::TNLP::IndexStyleEnum style;
+  nlp.get_nlp_info(n, m, nnz_jac, nnz_hes, style);
+  n_ = n;
+  m_ = m;
+  jac_row_.resize(nnz_jac);
+  jac_col_.resize(nnz_jac);
+  hes_row_.resize(nnz_hes);
+  hes_col_.resize(nnz_hes);
+  nlp.eval_jac_g(n, NULL, false, m, nnz_jac, jac_row_.data(), jac_col_.data(),
+                 NULL);
+  nlp.eval_h(n, NULL, false, 1, m, NULL, false, nnz_hes, hes_row_.data(),
+             hes_col_.data(), NULL);
+
+  // The inequality constraints, which get the slacks.
+  g_lower_.resize(m);
+  g_upper_.resize(m);
+  Eigen::VectorXd x_l(n);
+  Eigen::VectorXd x_u(n);
+  nlp.get_bounds_info(n, x_l.data(), x_u.data(), m, g_lower_.data(),
+                      g_upper_.data());
+  slack_.assign(m, -1);
+  n_slacks_ = 0;
+  for (int i = 0; i < m; i++) {
+    if (g_lower_[i] < g_upper_[i]) {
+      slack_[i] = n + n_slacks_++;
+    }
+  }
+  const int n_y = n + n_slacks_;
+  n_kkt_ = n_y + m;
+
+  // The lower triangle of
+  //
+  //   [ W + Sigma + delta_w I        J'      ]
+  //   [          J             -delta_c I    ]
+  //
+  // over y, then the constraints, its diagonal whole.
+  std::vector<Eigen::Triplet<double> > entries;
+  for (int k = 0; k < n_kkt_; k++) {
+    entries.push_back(Eigen::Triplet<double>(k, k, 1));
+  }
+  for (int k = 0; k < nnz_jac; k++) {
+    entries.push_back(
+        Eigen::Triplet<double>(n_y + jac_row_[k], jac_col_[k], 1));
+  }
+  for (int k = 0; k < nnz_hes; k++) {
+    entries.push_back(
+        Eigen::Triplet<double>(std::max(hes_row_[k], hes_col_[k]),
+                               std::min(hes_row_[k], hes_col_[k]), 1));
+  }
+  for (int i = 0; i < m; i++) {
+    if (slack_[i] >= 0) {
+      entries.push_back(Eigen::Triplet<double>(n_y + i, slack_[i], 1));
+    }
+  }
+  SpMat pattern(n_kkt_, n_kkt_);
+  pattern.setFromTriplets(entries.begin(), entries.end());
+
+  // The AMD order, as SimplicialLDLT would take it, applied once here.
+  Eigen::AMDOrdering<int> amd;
+  Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> inverse;
+  amd(pattern.selfadjointView<Eigen::Lower>(), inverse);
+  Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> permutation =
+      inverse.inverse();
+  order_.assign(permutation.indices().data(),
+                permutation.indices().data() + n_kkt_);
+  for (size_t k = 0; k < entries.size(); k++) {
+    int i = order_[entries[k].row()];
+    int j = order_[entries[k].col()];
+    entries[k] = Eigen::Triplet<double>(std::min(i, j), std::max(i, j), 0);
+  }
+  kkt_.resize(n_kkt_, n_kkt_);
+  kkt_.setFromTriplets(entries.begin(), entries.end());
+  kkt_.makeCompressed();
+
+  jac_slot_.resize(nnz_jac);
+  for (int k = 0; k < nnz_jac; k++) {
+    jac_slot_[k] = Slot(n_y + jac_row_[k], jac_col_[k]);
+  }
+  hes_slot_.resize(nnz_hes);
+  for (int k = 0; k < nnz_hes; k++) {
+    hes_slot_[k] = Slot(hes_row_[k], hes_col_[k]);
+  }
+  slack_slot_.assign(m, -1);
+  for (int i = 0; i < m; i++) {
+    if (slack_[i] >= 0) {
+      slack_slot_[i] = Slot(n_y + i, slack_[i]);
+    }
+  }
+  diagonal_slot_.resize(n_kkt_);
+  for (int k = 0; k < n_kkt_; k++) {
+    diagonal_slot_[k] = Slot(k, k);
+  }
+  ldlt_.Analyze(kkt_);
+  last_delta_ = 0;
+
+  lower_.resize(n_y);
+  upper_.resize(n_y);
+  fixed_.assign(n_y, false);
+  y_.resize(n_y);
+  z_l_.resize(n_y);
+  z_u_.resize(n_y);
+  lambda_.resize(m);
+  g_.resize(m);
+  c_.resize(m);
+  grad_.resize(n);
+  jac_.resize(nnz_jac);
+  hes_.resize(nnz_hes);
+  dual_.resize(n_y);
+  rhs_.resize(n_kkt_);
+  permuted_.resize(n_kkt_);
+  permuted_rhs_.resize(n_kkt_);
+  residual_.resize(n_kkt_);
+  direction_.resize(n_kkt_);
+  dy_.resize(n_y);
+  dlambda_.resize(m);
+  dz_l_.resize(n_y);
+  dz_u_.resize(n_y);
+  trial_.resize(n_y);
+  c_old_.resize(m);
+  c_soc_.resize(m);
+}
+
+int InteriorPoint::Slot(int i, int j) const {
+  int row = std::min(order_[i], order_[j]);
+  int col = std::max(order_[i], order_[j]);
+  const int* begin = kkt_.innerIndexPtr() + kkt_.outerIndexPtr()[col];
+  const int* end = kkt_.innerIndexPtr() + kkt_.outerIndexPtr()[col + 1];
+  return int(std::lower_bound(begin, end, row) - kkt_.innerIndexPtr());
+}
+
+void InteriorPoint::Evaluate(MPC_NLP& nlp, const Eigen::VectorXd& y) {
+  auto start = std::chrono::steady_clock::now();
+  nlp.eval_f(n_, y.data(), true, f_);
+  nlp.eval_g(n_, y.data(), false, m_, g_.data());
+  for (int i = 0; i < m_; i++) {
+    c_[i] = g_[i] - (slack_[i] < 0 ? g_lower_[i] : y[slack_[i]]);
+  }
+  eval_seconds_ += Seconds(start);
+}
+
+void InteriorPoint::Derive(MPC_NLP& nlp) {
+  auto start = std::chrono::steady_clock::now();
+  nlp.eval_grad_f(n_, y_.data(), false, grad_.data());
+  nlp.eval_jac_g(n_, y_.data(), false, m_, int(jac_.size()), NULL, NULL,
+                 jac_.data());
+  nlp.eval_h(n_, y_.data(), false, 1, m_, lambda_.data(), true,
+             int(hes_.size()), NULL, NULL, hes_.data());
+  eval_seconds_ += Seconds(start);
+}
+
+double InteriorPoint::Merit(const Eigen::VectorXd& y, double mu,
+                            double nu) const {
+  double merit = f_ + nu * c_.lpNorm<1>();
+  for (int j = 0; j < int(y.size()); j++) {
+    if (fixed_[j]) {
+      continue;
+    }
+    if (std::isfinite(lower_[j])) {
+      merit -= mu * std::log(y[j] - lower_[j]);
+    }
+    if (std::isfinite(upper_[j])) {
+      merit -= mu * std::log(upper_[j] - y[j]);
+    }
+  }
+  return merit;
+}
+
+double InteriorPoint::Complementarity(double mu) const {
+  double error = 0;
+  for (int j = 0; j < int(y_.size()); j++) {
+    if (fixed_[j]) {
+      continue;
+    }
+    if (std::isfinite(lower_[j])) {
+      error = std::max(error, std::fabs((y_[j] - lower_[j]) * z_l_[j] - mu));
+    }
+    if (std::isfinite(upper_[j])) {
+      error = std::max(error, std::fabs((upper_[j] - y_[j]) * z_u_[j] - mu));
+    }
+  }
+  return error;
+}
+
+bool InteriorPoint::Factorize(double mu) {
+  const int n_y = n_ + n_slacks_;
+  double delta_w = 0;
+  double delta_c = 0;
+  while (true) {
+    double* values = kkt_.valuePtr();
+    std::fill(values, values + kkt_.nonZeros(), 0.);
+    for (int j = 0; j < n_y; j++) {
+      double sigma = delta_w;
+      if (std::isfinite(lower_[j])) {
+        sigma += z_l_[j] / (y_[j] - lower_[j]);
+      }
+      if (std::isfinite(upper_[j])) {
+        sigma += z_u_[j] / (upper_[j] - y_[j]);
+      }
+      values[diagonal_slot_[j]] = fixed_[j] ? 1 : sigma;
+    }
+    for (size_t k = 0; k < hes_slot_.size(); k++) {
+      if (!fixed_[hes_row_[k]] && !fixed_[hes_col_[k]]) {
+        values[hes_slot_[k]] += hes_[k];
+      }
+    }
+    for (size_t k = 0; k < jac_slot_.size(); k++) {
+      if (!fixed_[jac_col_[k]]) {
+        values[jac_slot_[k]] += jac_[k];
+      }
+    }
+    for (int i = 0; i < m_; i++) {
+      values[diagonal_slot_[n_y + i]] = -delta_c;
+      if (slack_[i] >= 0) {
+        values[slack_slot_[i]] = -1;
+      }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ldlt_.Factorize(kkt_);
+    linear_solve_seconds_ += Seconds(start);
+    int positive = 0;
+    int negative = 0;
+    if (ldlt_.info() == Eigen::Success) {
+      const Eigen::VectorXd& d = ldlt_.vectorD();
+      for (int k = 0; k < n_kkt_; k++) {
+        positive += d[k] > 0;
+        negative += d[k] < 0;
+      }
+    }
+    if (positive == n_y && negative == m_) {
+      if (delta_w > 0) {
+        last_delta_ = delta_w;
+      }
+      return true;
+    }
+    // Singular: the constraints may be degenerate as well.
+    if (positive + negative < n_kkt_) {
+      delta_c = JACOBIAN_REGULARIZATION * std::pow(mu, 0.25);
+    }
+    if (delta_w == 0) {
+      delta_w = last_delta_ == 0
+                    ? FIRST_HESSIAN_PERTURBATION
+                    : std::max(MIN_HESSIAN_PERTURBATION, last_delta_ / 3);
+    } else {
+      delta_w *= last_delta_ == 0 ? 100 : 8;
+    }
+    if (delta_w > MAX_HESSIAN_PERTURBATION) {
+      return false;
+    }
+  }
+}
+
+void InteriorPoint::SolveKkt() {
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < n_kkt_; k++) {
+    permuted_rhs_[order_[k]] = rhs_[k];
+  }
+  permuted_ = permuted_rhs_;
+  ldlt_.matrixL().solveInPlace(permuted_);
+  permuted_.array() /= ldlt_.vectorD().array();
+  ldlt_.matrixU().solveInPlace(permuted_);
+  // The barrier terms leave the matrix badly conditioned near a solution,
+  // where the steps have to be accurate.
+  double scale = permuted_rhs_.lpNorm<Eigen::Infinity>();
+  for (int step = 0; step < MAX_REFINEMENT_STEPS; step++) {
+    residual_.noalias() = kkt_.selfadjointView<Eigen::Upper>() * permuted_;
+    residual_ = permuted_rhs_ - residual_;
+    if (residual_.lpNorm<Eigen::Infinity>() <= RESIDUAL_RATIO * scale) {
+      break;
+    }
+    ldlt_.matrixL().solveInPlace(residual_);
+    residual_.array() /= ldlt_.vectorD().array();
+    ldlt_.matrixU().solveInPlace(residual_);
+    permuted_ += residual_;
+  }
+  for (int k = 0; k < n_kkt_; k++) {
+    direction_[k] = permuted_[order_[k]];
+  }
+  linear_solve_seconds_ += Seconds(start);
+}
+
+double InteriorPoint::MaxStep(const Eigen::VectorXd& dy, double tau) const {
+  double alpha = 1;
+  for (int j = 0; j < int(y_.size()); j++) {
+    if (dy[j] < 0 && std::isfinite(lower_[j])) {
+      alpha = std::min(alpha, -tau * (y_[j] - lower_[j]) / dy[j]);
+    } else if (dy[j] > 0 && std::isfinite(upper_[j])) {
+      alpha = std::min(alpha, tau * (upper_[j] - y_[j]) / dy[j]);
+    }
+  }
+  return alpha;
+}
+
+bool InteriorPoint::Solve(MPC_NLP& nlp) {
+  Ipopt::Index n;
+  Ipopt::Index m;
+  Ipopt::Index nnz_jac;
+  Ipopt::Index nnz_hes;
+  Ipopt::TNLP::IndexStyleEnum style;
+  nlp.get_nlp_info(n, m, nnz_jac, nnz_hes, style);
+  if (n != n_ || m != m_) {
+    Setup(nlp);
+  }
+  const int n_y = n_ + n_slacks_;
+  eval_seconds_ = 0;
+  linear_solve_seconds_ = 0;
+
+  // The bounds, which change from frame to frame with the initial state's,
+  // and the start inside them.
+  nlp.get_bounds_info(n_, lower_.data(), upper_.data(), m_, g_lower_.data(),
+                      g_upper_.data());
+  for (int i = 0; i < m_; i++) {
+    if (slack_[i] >= 0) {
+      lower_[slack_[i]] = g_lower_[i];
+      upper_[slack_[i]] = g_upper_[i];
+    }
+  }
+  const double infinity = std::numeric_limits<double>::infinity();
+  for (int j = 0; j < n_y; j++) {
+    if (lower_[j] <= -BOUND_INFINITY) {
+      lower_[j] = -infinity;
+    }
+    if (upper_[j] >= BOUND_INFINITY) {
+      upper_[j] = infinity;
+    }
+    fixed_[j] = lower_[j] == upper_[j];
+  }
+  nlp.get_starting_point(n_, true, y_.data(), warmStart, z_l_.data(),
+                         z_u_.data(), m_, warmStart, lambda_.data());
+  if (!warmStart) {
+    lambda_.setZero();
+  }
+  Evaluate(nlp, y_);
+  for (int i = 0; i < m_; i++) {
+    if (slack_[i] >= 0) {
+      y_[slack_[i]] = g_[i];
+    }
+  }
+  const double push = warmStart ? WARM_BOUND_PUSH : BOUND_PUSH;
+  bool moved = false;
+  for (int j = 0; j < n_y; j++) {
+    double y = y_[j];
+    if (fixed_[j]) {
+      y = lower_[j];
+    } else {
+      double width = upper_[j] - lower_[j];
+      if (std::isfinite(lower_[j])) {
+        y = std::max(y, lower_[j] + std::min(push * std::max(1., std::fabs(
+                                                         lower_[j])),
+                                             push * width));
+      }
+      if (std::isfinite(upper_[j])) {
+        y = std::min(y, upper_[j] - std::min(push * std::max(1., std::fabs(
+                                                         upper_[j])),
+                                             push * width));
+      }
+    }
+    moved = moved || (j < n_ && y != y_[j]);
+    y_[j] = y;
+  }
+  if (moved) {
+    Evaluate(nlp, y_);
+  } else {
+    for (int i = 0; i < m_; i++) {
+      if (slack_[i] >= 0) {
+        c_[i] = g_[i] - y_[slack_[i]];
+      }
+    }
+  }
+  double mu = warmStart ? muInit : MU_INIT;
+  for (int j = 0; j < n_y; j++) {
+    bool slack = j >= n_;
+    double l = slack || !warmStart ? 1 : z_l_[j];
+    double u = slack || !warmStart ? 1 : z_u_[j];
+    z_l_[j] = std::isfinite(lower_[j]) && !fixed_[j] ? std::max(l, mu * push)
+                                                     : 0;
+    z_u_[j] = std::isfinite(upper_[j]) && !fixed_[j] ? std::max(u, mu * push)
+                                                     : 0;
+  }
+
+  Ipopt::SolverReturn status = Ipopt::MAXITER_EXCEEDED;
+  double nu = 1;
+  int iter = 0;
+  for (;; iter++) {
+    if (!std::isfinite(f_) || !c_.allFinite()) {
+      status = Ipopt::INVALID_NUMBER_DETECTED;
+      break;
+    }
+    Derive(nlp);
+
+    // The gradient of the Lagrangian, and the errors Ipopt scales.
+    dual_.head(n_) = grad_;
+    dual_.tail(n_slacks_).setZero();
+    for (int k = 0; k < int(jac_.size()); k++) {
+      dual_[jac_col_[k]] += jac_[k] * lambda_[jac_row_[k]];
+    }
+    for (int i = 0; i < m_; i++) {
+      if (slack_[i] >= 0) {
+        dual_[slack_[i]] -= lambda_[i];
+      }
+    }
+    dual_ += z_u_ - z_l_;
+    double dual = 0;
+    for (int j = 0; j < n_y; j++) {
+      if (!fixed_[j]) {
+        dual = std::max(dual, std::fabs(dual_[j]));
+      }
+    }
+    double z_norm = z_l_.lpNorm<1>() + z_u_.lpNorm<1>();
+    double s_d = std::max(S_MAX, (lambda_.lpNorm<1>() + z_norm) /
+                                     std::max(1, m_ + 2 * n_y)) /
+                 S_MAX;
+    double s_c = std::max(S_MAX, z_norm / std::max(1, 2 * n_y)) / S_MAX;
+    double primal = c_.lpNorm<Eigen::Infinity>();
+    double error = std::max(std::max(dual / s_d, primal),
+                            Complementarity(0) / s_c);
+    if (fixedIterations == 0 && error <= tol) {
+      status = Ipopt::SUCCESS;
+      break;
+    }
+    if (!nlp.intermediate_callback(Ipopt::RegularMode, iter, f_, primal,
+                                   dual, mu, 0, last_delta_, 0, 0, 0, NULL,
+                                   NULL)) {
+      status = Ipopt::USER_REQUESTED_STOP;
+      break;
+    }
+    if (fixedIterations > 0 && iter >= fixedIterations) {
+      status = error <= tol ? Ipopt::SUCCESS : Ipopt::MAXITER_EXCEEDED;
+      break;
+    }
+    if (iter >= maxIterations) {
+      break;
+    }
+
+    // Fiacco-McCormick: a smaller barrier once this one's problem is solved.
+    while (mu > tol / 10 &&
+           std::max(std::max(dual / s_d, primal), Complementarity(mu) / s_c) <=
+               BARRIER_TOL_FACTOR * mu) {
+      mu = std::max(tol / 10, std::min(MU_LINEAR_DECREASE * mu,
+                                       std::pow(mu, MU_SUPERLINEAR_DECREASE)));
+    }
+
+    // The Newton step, the bound multipliers eliminated.
+    if (!Factorize(mu)) {
+      status = Ipopt::ERROR_IN_STEP_COMPUTATION;
+      break;
+    }
+    for (int j = 0; j < n_y; j++) {
+      double r = dual_[j] + z_l_[j] - z_u_[j];
+      if (std::isfinite(lower_[j])) {
+        r -= mu / (y_[j] - lower_[j]);
+      }
+      if (std::isfinite(upper_[j])) {
+        r += mu / (upper_[j] - y_[j]);
+      }
+      rhs_[j] = fixed_[j] ? 0 : -r;
+    }
+    for (int i = 0; i < m_; i++) {
+      rhs_[n_y + i] = -c_[i];
+    }
+    SolveKkt();
+    dy_ = direction_.head(n_y);
+    dlambda_ = direction_.tail(m_);
+
+    // The largest steps of the fraction to the boundary rule.
+    double tau = std::max(TAU_MIN, 1 - mu);
+    double alpha_primal = MaxStep(dy_, tau);
+    double alpha_dual = 1;
+    double slope = 0;
+    for (int j = 0; j < n_y; j++) {
+      dz_l_[j] = 0;
+      dz_u_[j] = 0;
+      if (fixed_[j]) {
+        continue;
+      }
+      double gradient = j < n_ ? grad_[j] : 0;
+      if (std::isfinite(lower_[j])) {
+        double gap = y_[j] - lower_[j];
+        gradient -= mu / gap;
+        dz_l_[j] = mu / gap - z_l_[j] - z_l_[j] / gap * dy_[j];
+        if (dz_l_[j] < 0) {
+          alpha_dual = std::min(alpha_dual, -tau * z_l_[j] / dz_l_[j]);
+        }
+      }
+      if (std::isfinite(upper_[j])) {
+        double gap = upper_[j] - y_[j];
+        gradient += mu / gap;
+        dz_u_[j] = mu / gap - z_u_[j] + z_u_[j] / gap * dy_[j];
+        if (dz_u_[j] < 0) {
+          alpha_dual = std::min(alpha_dual, -tau * z_u_[j] / dz_u_[j]);
+        }
+      }
+      slope += gradient * dy_[j];
+    }
+
+    // Backtrack on the l1 merit function, its penalty above the multipliers
+    // of the step.
+    nu = std::max(nu, 1.1 * (lambda_ + dlambda_).lpNorm<Eigen::Infinity>());
+    double merit = Merit(y_, mu, nu);
+    slope = std::min(slope - nu * c_.lpNorm<1>(), 0.);
+    c_old_ = c_;
+    double alpha = alpha_primal;
+    bool accepted = fixedIterations > 0;
+    if (accepted) {
+      // The same work every iteration: the step as the boundary allows it.
+      trial_ = y_ + alpha * dy_;
+      Evaluate(nlp, trial_);
+    }
+    for (int trial = 0; trial < LINE_SEARCH_TRIALS && !accepted; trial++) {
+      trial_ = y_ + alpha * dy_;
+      Evaluate(nlp, trial_);
+      double next = Merit(trial_, mu, nu);
+      accepted = next <= merit + ARMIJO * alpha * slope;
+      // The full step rejected, correct it for the constraints' curvature,
+      // which near a solution the merit function would otherwise keep
+      // cutting it short for.
+      double alpha_soc = alpha;
+      c_soc_ = c_old_;
+      for (int soc = 0; trial == 0 && !accepted && soc < MAX_SOC; soc++) {
+        c_soc_ = alpha_soc * c_soc_ + c_;
+        rhs_.tail(m_) = -c_soc_;
+        SolveKkt();
+        alpha_soc = MaxStep(direction_.head(n_y), tau);
+        trial_ = y_ + alpha_soc * direction_.head(n_y);
+        Evaluate(nlp, trial_);
+        next = Merit(trial_, mu, nu);
+        accepted = next <= merit + ARMIJO * alpha * slope;
+      }
+      if (!accepted) {
+        alpha /= 2;
+      }
+    }
+    y_ = trial_;
+    lambda_ += alpha * dlambda_;
+    z_l_ += alpha_dual * dz_l_;
+    z_u_ += alpha_dual * dz_u_;
+    // Keep the multipliers near mu over the distance to the bound.
+    for (int j = 0; j < n_y; j++) {
+      if (std::isfinite(lower_[j]) && !fixed_[j]) {
+        double center = mu / (y_[j] - lower_[j]);
+        z_l_[j] = std::max(std::min(z_l_[j], KAPPA_SIGMA * center),
+                           center / KAPPA_SIGMA);
+      }
+      if (std::isfinite(upper_[j]) && !fixed_[j]) {
+        double center = mu / (upper_[j] - y_[j]);
+        z_u_[j] = std::max(std::min(z_u_[j], KAPPA_SIGMA * center),
+                           center / KAPPA_SIGMA);
+      }
+    }
+  }
+
+  // A fixed variable's multipliers are what the gradient of the Lagrangian
+  // leaves there, as with Ipopt's make_parameter.
+  for (int j = 0; j < n_; j++) {
+    if (fixed_[j]) {
+      z_l_[j] = std::max(dual_[j], 0.);
+      z_u_[j] = std::max(-dual_[j], 0.);
+    }
+  }
+  nlp.finalize_solution(status, n_, y_.data(), z_l_.data(), z_u_.data(), m_,
+                        g_.data(), lambda_.data(), f_, NULL, NULL);
+  nlp.iterations = iter;
+  nlp.eval_seconds = eval_seconds_;
+  nlp.linear_solve_seconds = linear_solve_seconds_;
+  return status == Ipopt::SUCCESS;
+}
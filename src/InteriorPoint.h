@@ -0,0 +1,155 @@
+#ifndef INTERIOR_POINT_H
+#define INTERIOR_POINT_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCore"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "MPC_NLP.h"
+
+// A primal-dual interior point method for the MPC problems, in place of
+// Ipopt, through the same TNLP interface of an MPC_NLP: the tape's, or
+// KinematicNLP's and AutoDiffNLP's derivatives.
+//
+// It is Ipopt's algorithm cut down to what these problems need: the
+// Fiacco-McCormick barrier update, Newton steps on the KKT system with the
+// bound multipliers eliminated, inertia correction by a multiple of the
+// identity, the fraction to the boundary rule and a backtracking line search
+// on an l1 merit function with Ipopt's second order corrections, without its
+// filter or restoration phase.
+// Inequality constraints get a slack each; fixed variables keep their value.
+//
+// The KKT matrix's pattern, of the Hessian's and the Jacobian's entries and
+// the diagonal, is built and put in a fill-reducing (AMD) order once, at
+// the first Solve() of a problem, and analyzed once for SimplicialLDLT.
+// Each iteration writes the values into it in place and factorizes it, with
+// no allocation and nothing parsed; the solves are refined iteratively, as
+// Ipopt's. Up to N of about 30 the factors, the
+// matrix and the vectors fit in L2.
+//
+// Ipopt's user scaling and its L-BFGS Hessian aren't there; MPC keeps
+// Ipopt for those. MPC_NLP's deadline, cancellation and anytime tracking
+// work as with Ipopt, through intermediate_callback.
+class InteriorPoint {
+ public:
+  InteriorPoint();
+
+  // Convergence tolerance of the scaled KKT error, as Ipopt's tol, and the
+  // iteration limit.
+  double tol;
+  int maxIterations;
+  // Take exactly this many Newton steps, each the fraction to the boundary
+  // step without the line search, and answer with the last iterate, which
+  // succeeds if it meets tol; 0 to iterate to tol. The inertia corrections
+  // and the refinement of the solves are all that still varies, and they
+  // are bounded.
+  int fixedIterations;
+  // Whether Solve() starts from the problem's multipliers, z_l_init,
+  // z_u_init and lambda_init, at the barrier parameter muInit; else from
+  // unit bound multipliers at mu 0.1, as Ipopt.
+  bool warmStart;
+  double muInit;
+
+  // Solve nlp from its x_init, and write the solution and the statistics
+  // to it as finalize_solution does. Returns whether it converged.
+  bool Solve(MPC_NLP& nlp);
+
+ private:
+  typedef Eigen::SparseMatrix<double, Eigen::ColMajor, int> SpMat;
+
+  // SimplicialLDLT of a matrix already in its fill-reducing order, given as
+  // its upper triangle, which factorize() then neither copies nor permutes.
+  class KktLDLT
+      : public Eigen::SimplicialLDLT<SpMat, Eigen::Upper,
+                                     Eigen::NaturalOrdering<int> > {
+   public:
+    void Analyze(const SpMat& a) { analyzePattern_preordered(a, true); }
+    void Factorize(const SpMat& a) { factorize_preordered<true>(a); }
+  };
+
+  // The KKT pattern of nlp and its ordering.
+  void Setup(MPC_NLP& nlp);
+  // The KKT entry (i, j), in the original order, in kkt_'s values.
+  int Slot(int i, int j) const;
+  // The problem's functions at y into f_, g_ and c_, and its derivatives
+  // there into grad_, jac_ and hes_, for the multipliers lambda_; the
+  // derivatives are of the point last evaluated.
+  void Evaluate(MPC_NLP& nlp, const Eigen::VectorXd& y);
+  void Derive(MPC_NLP& nlp);
+  // The barrier objective of y, whose functions are in f_ and c_, plus nu
+  // times the l1 norm of its constraints.
+  double Merit(const Eigen::VectorXd& y, double mu, double nu) const;
+  // The complementarity error of the iterate for the barrier mu.
+  double Complementarity(double mu) const;
+  // Factorize the KKT matrix of the iterate, correcting its inertia; false
+  // when no correction gives the right one.
+  bool Factorize(double mu);
+  // The solution of the factorized KKT system for rhs_, into direction_.
+  void SolveKkt();
+  // The largest step along dy within the fraction tau of the distance to
+  // the bounds.
+  double MaxStep(const Eigen::VectorXd& dy, double tau) const;
+
+  int n_;
+  int m_;
+  // Slacks, one per inequality constraint, follow the variables in y.
+  int n_slacks_;
+  int n_kkt_;
+  std::vector<int> slack_;
+  std::vector<Ipopt::Index> jac_row_;
+  std::vector<Ipopt::Index> jac_col_;
+  std::vector<Ipopt::Index> hes_row_;
+  std::vector<Ipopt::Index> hes_col_;
+  // Position of each original row and column in kkt_.
+  std::vector<int> order_;
+  // kkt_'s values of the Jacobian's, the Hessian's and the slacks' entries,
+  // of the diagonal of each row and column.
+  std::vector<int> jac_slot_;
+  std::vector<int> hes_slot_;
+  std::vector<int> slack_slot_;
+  std::vector<int> diagonal_slot_;
+  SpMat kkt_;
+  KktLDLT ldlt_;
+  // The last regularization of the Hessian that gave the right inertia.
+  double last_delta_;
+
+  // Bounds of y, infinite ones at +-inf, and the constraints' sides.
+  Eigen::VectorXd lower_;
+  Eigen::VectorXd upper_;
+  std::vector<bool> fixed_;
+  Eigen::VectorXd g_lower_;
+  Eigen::VectorXd g_upper_;
+
+  // The iterate, its functions and the step.
+  Eigen::VectorXd y_;
+  Eigen::VectorXd z_l_;
+  Eigen::VectorXd z_u_;
+  Eigen::VectorXd lambda_;
+  double f_;
+  Eigen::VectorXd g_;
+  Eigen::VectorXd c_;
+  Eigen::VectorXd grad_;
+  Eigen::VectorXd jac_;
+  Eigen::VectorXd hes_;
+  Eigen::VectorXd dual_;
+  Eigen::VectorXd rhs_;
+  // The KKT system in kkt_'s order: its right hand side, solution and the
+  // residual of that.
+  Eigen::VectorXd permuted_rhs_;
+  Eigen::VectorXd permuted_;
+  Eigen::VectorXd residual_;
+  Eigen::VectorXd direction_;
+  Eigen::VectorXd dy_;
+  Eigen::VectorXd dlambda_;
+  Eigen::VectorXd dz_l_;
+  Eigen::VectorXd dz_u_;
+  Eigen::VectorXd trial_;
+  // The constraints before the step, and their second order correction.
+  Eigen::VectorXd c_old_;
+  Eigen::VectorXd c_soc_;
+
+  double eval_seconds_;
+  double linear_solve_seconds_;
+};
+
+#endif /* INTERIOR_POINT_H */
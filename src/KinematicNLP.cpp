@@ -0,0 +1,491 @@
+#include "KinematicNLP.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+#include "Polynomial.h"
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+double KinematicNLPBase::CheckDerivatives(const Dvector& x, double obj_factor,
+                                          const Dvector& lambda) {
+  Index n = x.size();
+  Index m = lambda.size();
+  double err = 0;
+
+  Dvector grad(n);
+  Dvector grad_tape(n);
+  eval_grad_f(n, x.data(), true, grad.data());
+  MPC_NLP::eval_grad_f(n, x.data(), true, grad_tape.data());
+  for (Index i = 0; i < n; i++) {
+    err = std::max(err, std::fabs(grad[i] - grad_tape[i]));
+  }
+
+  // The two evaluators list their nonzeros differently, so compare them as
+  // maps from (row, col) to value.
+  typedef std::map<std::pair<Index, Index>, double> Sparse;
+  auto compare = [&err](const Sparse& a, const Sparse& b) {
+    Sparse diff = a;
+    for (auto& e : b) {
+      diff[e.first] -= e.second;
+    }
+    for (auto& e : diff) {
+      err = std::max(err, std::fabs(e.second));
+    }
+  };
+  // Sum duplicates, the same way Ipopt does.
+  auto collect = [](size_t nnz, const Index* r, const Index* c,
+                    const Number* v) {
+    Sparse s;
+    for (size_t k = 0; k < nnz; k++) {
+      s[std::make_pair(r[k], c[k])] += v[k];
+    }
+    return s;
+  };
+
+  Index n_tape, m_tape, nnz_jac, nnz_hes;
+  IndexStyleEnum style;
+  MPC_NLP::get_nlp_info(n_tape, m_tape, nnz_jac, nnz_hes, style);
+  // And this evaluator's.
+  Index own_jac, own_hes;
+  get_nlp_info(n_tape, m_tape, own_jac, own_hes, style);
+  {
+    std::vector<Index> r(nnz_jac), c(nnz_jac);
+    std::vector<Number> v(nnz_jac);
+    MPC_NLP::eval_jac_g(n, x.data(), true, m, nnz_jac, r.data(), c.data(),
+                        NULL);
+    MPC_NLP::eval_jac_g(n, x.data(), true, m, nnz_jac, NULL, NULL, v.data());
+    Sparse tape = collect(nnz_jac, r.data(), c.data(), v.data());
+
+    std::vector<Index> ra(own_jac), ca(own_jac);
+    std::vector<Number> va(own_jac);
+    eval_jac_g(n, x.data(), true, m, own_jac, ra.data(), ca.data(), NULL);
+    eval_jac_g(n, x.data(), true, m, own_jac, NULL, NULL, va.data());
+    compare(collect(own_jac, ra.data(), ca.data(), va.data()), tape);
+  }
+  {
+    std::vector<Index> r(nnz_hes), c(nnz_hes);
+    std::vector<Number> v(nnz_hes);
+    MPC_NLP::eval_h(n, x.data(), true, obj_factor, m, lambda.data(), true,
+                    nnz_hes, r.data(), c.data(), NULL);
+    MPC_NLP::eval_h(n, x.data(), true, obj_factor, m, lambda.data(), true,
+                    nnz_hes, NULL, NULL, v.data());
+    Sparse tape = collect(nnz_hes, r.data(), c.data(), v.data());
+
+    std::vector<Index> ra(own_hes), ca(own_hes);
+    std::vector<Number> va(own_hes);
+    eval_h(n, x.data(), true, obj_factor, m, lambda.data(), true, own_hes,
+           ra.data(), ca.data(), NULL);
+    eval_h(n, x.data(), true, obj_factor, m, lambda.data(), true, own_hes,
+           NULL, NULL, va.data());
+    compare(collect(own_hes, ra.data(), ca.data(), va.data()), tape);
+  }
+  return err;
+}
+
+template <size_t N>
+KinematicNLP<N>::KinematicNLP(double dt, double Lf, double ref_v,
+                              const KinematicWeights& weights)
+    : dt_(dt), Lf_(Lf), ref_v_(ref_v), w_(weights) {
+  for (size_t i = 0; i < n_params; i++) {
+    params_[i] = 0;
+  }
+  for (size_t i = 0; i < n_vars; i++) {
+    zero_[i] = 0;
+  }
+  for (size_t i = 0; i < n_constraints; i++) {
+    zero_lambda_[i] = 0;
+  }
+  nnz_jac_ = Jacobian(zero_, NULL, NULL, NULL);
+  nnz_hes_ = Hessian(zero_, 0, zero_lambda_, NULL, NULL, NULL);
+}
+
+template <size_t N>
+KinematicNLP<N>::~KinematicNLP() {}
+
+template <size_t N>
+void KinematicNLP<N>::SetParameters(const Dvector& params) {
+  // Keep the tape in sync so that CheckDerivatives compares like with like.
+  MPC_NLP::SetParameters(params);
+  for (size_t i = 0; i < n_params; i++) {
+    params_[i] = params[i];
+  }
+}
+
+template <size_t N>
+bool KinematicNLP<N>::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
+                                Index& nnz_h_lag,
+                                IndexStyleEnum& index_style) {
+  n = n_vars;
+  m = n_constraints;
+  nnz_jac_g = nnz_jac_;
+  nnz_h_lag = nnz_hes_;
+  index_style = C_STYLE;
+  return true;
+}
+
+template <size_t N>
+bool KinematicNLP<N>::eval_f(Index n, const Number* x, bool new_x,
+                          Number& obj_value) {
+  obj_value = 0;
+  for (size_t t = 0; t < N; t++) {
+    double ev = x[v_start + t] - ref_v_;
+    obj_value += w_.cte * x[cte_start + t] * x[cte_start + t];
+    obj_value += w_.epsi * x[epsi_start + t] * x[epsi_start + t];
+    obj_value += w_.v * ev * ev;
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    obj_value += w_.delta * x[delta_start + t] * x[delta_start + t];
+    obj_value += w_.a * x[a_start + t] * x[a_start + t];
+  }
+  for (size_t t = 0; t + 2 < N; t++) {
+    double dd = x[delta_start + t + 1] - x[delta_start + t];
+    double da = x[a_start + t + 1] - x[a_start + t];
+    obj_value += w_.delta_diff * dd * dd;
+    obj_value += w_.a_diff * da * da;
+  }
+  return true;
+}
+
+template <size_t N>
+bool KinematicNLP<N>::eval_grad_f(Index n, const Number* x, bool new_x,
+                               Number* grad_f) {
+  for (Index i = 0; i < n; i++) {
+    grad_f[i] = 0;
+  }
+  for (size_t t = 0; t < N; t++) {
+    grad_f[cte_start + t] = 2 * w_.cte * x[cte_start + t];
+    grad_f[epsi_start + t] = 2 * w_.epsi * x[epsi_start + t];
+    grad_f[v_start + t] = 2 * w_.v * (x[v_start + t] - ref_v_);
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    grad_f[delta_start + t] = 2 * w_.delta * x[delta_start + t];
+    grad_f[a_start + t] = 2 * w_.a * x[a_start + t];
+  }
+  for (size_t t = 0; t + 2 < N; t++) {
+    double dd =
+        2 * w_.delta_diff * (x[delta_start + t + 1] - x[delta_start + t]);
+    double da = 2 * w_.a_diff * (x[a_start + t + 1] - x[a_start + t]);
+    grad_f[delta_start + t + 1] += dd;
+    grad_f[delta_start + t] -= dd;
+    grad_f[a_start + t + 1] += da;
+    grad_f[a_start + t] -= da;
+  }
+  return true;
+}
+
+template <size_t N>
+bool KinematicNLP<N>::eval_g(Index n, const Number* x, bool new_x, Index m,
+                          Number* g) {
+  NotePoint(x);
+  const double* c = params_;
+  const double* x_init = c + n_coeffs;
+  g[x_start] = x[x_start] - x_init[0];
+  g[y_start] = x[y_start] - x_init[1];
+  g[psi_start] = x[psi_start] - x_init[2];
+  g[v_start] = x[v_start] - x_init[3];
+  g[cte_start] = x[cte_start] - x_init[4];
+  g[epsi_start] = x[epsi_start] - x_init[5];
+
+  if (pool_) {
+    pool_->Run(1, N, [this, x, g](size_t begin, size_t end) {
+      ConstraintStages(x, begin, end, g);
+    });
+  } else {
+    ConstraintStages(x, 1, N, g);
+  }
+  return true;
+}
+
+template <size_t N>
+void KinematicNLP<N>::ConstraintStages(const Number* x, size_t begin,
+                                       size_t end, Number* g) const {
+  const double* c = params_;
+  for (size_t t = begin; t < end; t++) {
+    double x0 = x[x_start + t - 1];
+    double y0 = x[y_start + t - 1];
+    double psi0 = x[psi_start + t - 1];
+    double v0 = x[v_start + t - 1];
+    double epsi0 = x[epsi_start + t - 1];
+    double delta0 = x[delta_start + t - 1];
+    double a0 = x[a_start + t - 1];
+
+    double f0 = PolyEval<3>(c, x0);
+    double psides0 = atan(PolyEval<3, 1>(c, x0));
+
+    g[x_start + t] = x[x_start + t] - (x0 + v0 * cos(psi0) * dt_);
+    g[y_start + t] = x[y_start + t] - (y0 + v0 * sin(psi0) * dt_);
+    g[psi_start + t] = x[psi_start + t] - (psi0 + v0 * delta0 / Lf_ * dt_);
+    g[v_start + t] = x[v_start + t] - (v0 + a0 * dt_);
+    g[cte_start + t] =
+        x[cte_start + t] - ((f0 - y0) + (v0 * sin(epsi0) * dt_));
+    g[epsi_start + t] =
+        x[epsi_start + t] - ((psi0 - psides0) + v0 * delta0 / Lf_ * dt_);
+  }
+}
+
+template <size_t N>
+bool KinematicNLP<N>::eval_jac_g(Index n, const Number* x, bool new_x, Index m,
+                              Index nele_jac, Index* iRow, Index* jCol,
+                              Number* values) {
+  Jacobian(values == NULL ? zero_ : x, iRow, jCol, values);
+  return true;
+}
+
+template <size_t N>
+bool KinematicNLP<N>::eval_h(Index n, const Number* x, bool new_x,
+                          Number obj_factor, Index m, const Number* lambda,
+                          bool new_lambda, Index nele_hess, Index* iRow,
+                          Index* jCol, Number* values) {
+  if (values == NULL) {
+    Hessian(zero_, 0, zero_lambda_, iRow, jCol, NULL);
+  } else {
+    Hessian(x, obj_factor, lambda, NULL, NULL, values);
+  }
+  return true;
+}
+
+template <size_t N>
+size_t KinematicNLP<N>::Jacobian(const Number* x, Index* iRow, Index* jCol,
+                              Number* values) {
+  size_t k = 0;
+  auto entry = [&](size_t row, size_t col, double value) {
+    if (values != NULL) {
+      values[k] = value;
+    } else if (iRow != NULL) {
+      iRow[k] = row;
+      jCol[k] = col;
+    }
+    k++;
+  };
+
+  // Initial state rows.
+  entry(x_start, x_start, 1);
+  entry(y_start, y_start, 1);
+  entry(psi_start, psi_start, 1);
+  entry(v_start, v_start, 1);
+  entry(cte_start, cte_start, 1);
+  entry(epsi_start, epsi_start, 1);
+
+  if (values != NULL && pool_) {
+    pool_->Run(1, N, [this, x, values](size_t begin, size_t end) {
+      for (size_t t = begin; t < end; t++) {
+        JacobianStage(t, x, jac_offset_[t], NULL, NULL, values);
+      }
+    });
+    return nnz_jac_;
+  }
+  for (size_t t = 1; t < N; t++) {
+    jac_offset_[t] = k;
+    k = JacobianStage(t, x, k, iRow, jCol, values);
+  }
+  return k;
+}
+
+template <size_t N>
+size_t KinematicNLP<N>::JacobianStage(size_t t, const Number* x, size_t k,
+                                      Index* iRow, Index* jCol,
+                                      Number* values) const {
+  auto entry = [&](size_t row, size_t col, double value) {
+    if (values != NULL) {
+      values[k] = value;
+    } else if (iRow != NULL) {
+      iRow[k] = row;
+      jCol[k] = col;
+    }
+    k++;
+  };
+  const double* c = params_;
+  size_t ix = x_start + t - 1;
+  size_t iy = y_start + t - 1;
+  size_t ipsi = psi_start + t - 1;
+  size_t iv = v_start + t - 1;
+  size_t iepsi = epsi_start + t - 1;
+  size_t idelta = delta_start + t - 1;
+  size_t ia = a_start + t - 1;
+
+  double x0 = x[ix];
+  double psi0 = x[ipsi];
+  double v0 = x[iv];
+  double epsi0 = x[iepsi];
+  double delta0 = x[idelta];
+  double df = PolyEval<3, 1>(c, x0);
+  double d2f = PolyEval<3, 2>(c, x0);
+
+  size_t r = x_start + t;
+  entry(r, r, 1);
+  entry(r, ix, -1);
+  entry(r, ipsi, v0 * sin(psi0) * dt_);
+  entry(r, iv, -cos(psi0) * dt_);
+
+  r = y_start + t;
+  entry(r, r, 1);
+  entry(r, iy, -1);
+  entry(r, ipsi, -v0 * cos(psi0) * dt_);
+  entry(r, iv, -sin(psi0) * dt_);
+
+  r = psi_start + t;
+  entry(r, r, 1);
+  entry(r, ipsi, -1);
+  entry(r, iv, -delta0 / Lf_ * dt_);
+  entry(r, idelta, -v0 / Lf_ * dt_);
+
+  r = v_start + t;
+  entry(r, r, 1);
+  entry(r, iv, -1);
+  entry(r, ia, -dt_);
+
+  r = cte_start + t;
+  entry(r, r, 1);
+  entry(r, ix, -df);
+  entry(r, iy, 1);
+  entry(r, iv, -sin(epsi0) * dt_);
+  entry(r, iepsi, -v0 * cos(epsi0) * dt_);
+
+  r = epsi_start + t;
+  entry(r, r, 1);
+  entry(r, ix, d2f / (1 + df * df));
+  entry(r, ipsi, -1);
+  entry(r, iv, -delta0 / Lf_ * dt_);
+  entry(r, idelta, -v0 / Lf_ * dt_);
+  return k;
+}
+
+template <size_t N>
+size_t KinematicNLP<N>::Hessian(const Number* x, Number obj_factor,
+                             const Number* lambda, Index* iRow, Index* jCol,
+                             Number* values) {
+  size_t k = 0;
+  // Lower triangle, one stage at a time.
+  if (values != NULL && pool_) {
+    pool_->Run(0, N, [this, x, obj_factor, lambda, values](size_t begin,
+                                                          size_t end) {
+      for (size_t t = begin; t < end; t++) {
+        HessianStage(t, x, obj_factor, lambda, hes_offset_[t], NULL, NULL,
+                     values);
+      }
+    });
+    return nnz_hes_;
+  }
+  for (size_t t = 0; t < N; t++) {
+    hes_offset_[t] = k;
+    k = HessianStage(t, x, obj_factor, lambda, k, iRow, jCol, values);
+  }
+  return k;
+}
+
+template <size_t N>
+size_t KinematicNLP<N>::HessianStage(size_t t, const Number* x,
+                                     Number obj_factor, const Number* lambda,
+                                     size_t k, Index* iRow, Index* jCol,
+                                     Number* values) const {
+  auto entry = [&](size_t row, size_t col, double value) {
+    if (values != NULL) {
+      values[k] = value;
+    } else if (iRow != NULL) {
+      iRow[k] = row;
+      jCol[k] = col;
+    }
+    k++;
+  };
+  const double* c = params_;
+
+  // Stage t's dynamics rows are the constraints t + 1, which only involve
+  // stage t's variables nonlinearly.
+  size_t ix = x_start + t;
+  size_t ipsi = psi_start + t;
+  size_t iv = v_start + t;
+  size_t icte = cte_start + t;
+  size_t iepsi = epsi_start + t;
+  bool dynamics = t + 1 < N;
+
+  if (dynamics) {
+    double l_x = lambda[x_start + t + 1];
+    double l_y = lambda[y_start + t + 1];
+    double l_psi = lambda[psi_start + t + 1];
+    double l_cte = lambda[cte_start + t + 1];
+    double l_epsi = lambda[epsi_start + t + 1];
+
+    double x0 = x[ix];
+    double psi0 = x[ipsi];
+    double v0 = x[iv];
+    double epsi0 = x[iepsi];
+    double df = PolyEval<3, 1>(c, x0);
+    double d2f = PolyEval<3, 2>(c, x0);
+    double d3f = PolyEval<3, 3>(c, x0);
+    double q = 1 + df * df;
+    // d2/dx2 of atan(f'(x)).
+    double d2psides = (d3f * q - 2 * df * d2f * d2f) / (q * q);
+
+    entry(ix, ix, -l_cte * d2f + l_epsi * d2psides);
+    entry(ipsi, ipsi,
+          (l_x * v0 * cos(psi0) + l_y * v0 * sin(psi0)) * dt_);
+    entry(iv, ipsi, (l_x * sin(psi0) - l_y * cos(psi0)) * dt_);
+    entry(iv, iv, obj_factor * 2 * w_.v);
+    entry(icte, icte, obj_factor * 2 * w_.cte);
+    entry(iepsi, iv, -l_cte * cos(epsi0) * dt_);
+    entry(iepsi, iepsi,
+          obj_factor * 2 * w_.epsi + l_cte * v0 * sin(epsi0) * dt_);
+
+    size_t idelta = delta_start + t;
+    size_t ia = a_start + t;
+    // Number of control-difference terms stage t appears in.
+    double n_diff = (t > 0 ? 1 : 0) + (t + 2 < N ? 1 : 0);
+    entry(idelta, iv, -(l_psi + l_epsi) / Lf_ * dt_);
+    entry(idelta, idelta,
+          obj_factor * 2 * (w_.delta + n_diff * w_.delta_diff));
+    if (t > 0) {
+      entry(idelta, idelta - 1, -obj_factor * 2 * w_.delta_diff);
+    }
+    entry(ia, ia, obj_factor * 2 * (w_.a + n_diff * w_.a_diff));
+    if (t > 0) {
+      entry(ia, ia - 1, -obj_factor * 2 * w_.a_diff);
+    }
+  } else {
+    entry(iv, iv, obj_factor * 2 * w_.v);
+    entry(icte, icte, obj_factor * 2 * w_.cte);
+    entry(iepsi, iepsi, obj_factor * 2 * w_.epsi);
+  }
+  return k;
+}
+
+template <size_t N> constexpr size_t KinematicNLP<N>::x_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::y_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::psi_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::v_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::cte_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::epsi_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::delta_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::a_start;
+template <size_t N> constexpr size_t KinematicNLP<N>::n_vars;
+template <size_t N> constexpr size_t KinematicNLP<N>::n_constraints;
+
+// The horizons we run.
+template class KinematicNLP<6>;
+template class KinematicNLP<10>;
+template class KinematicNLP<15>;
+template class KinematicNLP<20>;
+template class KinematicNLP<30>;
+template class KinematicNLP<50>;
+
+KinematicNLPBase* NewKinematicNLP(size_t N, double dt, double Lf, double ref_v,
+                                  const KinematicWeights& weights) {
+  switch (N) {
+    case 6:
+      return new KinematicNLP<6>(dt, Lf, ref_v, weights);
+    case 10:
+      return new KinematicNLP<10>(dt, Lf, ref_v, weights);
+    case 15:
+      return new KinematicNLP<15>(dt, Lf, ref_v, weights);
+    case 20:
+      return new KinematicNLP<20>(dt, Lf, ref_v, weights);
+    case 30:
+      return new KinematicNLP<30>(dt, Lf, ref_v, weights);
+    case 50:
+      return new KinematicNLP<50>(dt, Lf, ref_v, weights);
+    default:
+      return NULL;
+  }
+}
@@ -0,0 +1,126 @@
+#ifndef KINEMATIC_NLP_H
+#define KINEMATIC_NLP_H
+
+#include <memory>
+#include "BicycleModel.h"
+#include "MPC_NLP.h"
+#include "StagePool.h"
+
+// The interface of the evaluators with derivatives of their own rather than
+// the tape's, KinematicNLP<N> and AutoDiffNLP.
+class KinematicNLPBase : public MPC_NLP {
+ public:
+  virtual ~KinematicNLPBase() {}
+
+  // Largest absolute difference between these and the taped gradient,
+  // constraint Jacobian and Lagrangian Hessian at (x, obj_factor, lambda).
+  double CheckDerivatives(const Dvector& x, double obj_factor,
+                          const Dvector& lambda);
+
+  // Split the stage loops of the constraints, their Jacobian and the
+  // Lagrangian Hessian across `pool`, or run them serially if it is null.
+  void SetStagePool(const std::shared_ptr<StagePool>& pool) { pool_ = pool; }
+
+ protected:
+  std::shared_ptr<StagePool> pool_;
+};
+
+// The MPC problem of FG_eval with hand-written derivatives.
+//
+// The kinematic bicycle model and the quadratic cost have closed-form first
+// and second derivatives with a stage-local sparsity pattern, so this
+// evaluator hands them to Ipopt directly instead of sweeping the CppAD tape.
+// It still derives from MPC_NLP: the tape is recorded as usual and serves as
+// the reference for CheckDerivatives().
+//
+// The horizon is a template parameter so that the variable offsets are
+// constants, the stage loops can be unrolled and the buffers live inside the
+// object. KinematicNLP.cpp instantiates N = 6, 10, 15, 20, 30 and 50.
+//
+// Every stage's constraints and derivative entries are at fixed positions,
+// so with a StagePool they are evaluated a range of stages per thread.
+template <size_t N>
+class KinematicNLP : public KinematicNLPBase {
+ public:
+  static constexpr size_t x_start = 0;
+  static constexpr size_t y_start = x_start + N;
+  static constexpr size_t psi_start = y_start + N;
+  static constexpr size_t v_start = psi_start + N;
+  static constexpr size_t cte_start = v_start + N;
+  static constexpr size_t epsi_start = cte_start + N;
+  static constexpr size_t delta_start = epsi_start + N;
+  static constexpr size_t a_start = delta_start + N - 1;
+  static constexpr size_t n_vars = 6 * N + 2 * (N - 1);
+  static constexpr size_t n_constraints = 6 * N;
+  // Path coefficients followed by the initial state.
+  static constexpr size_t n_coeffs = 4;
+  static constexpr size_t n_params = n_coeffs + 6;
+
+  KinematicNLP(double dt, double Lf, double ref_v,
+               const KinematicWeights& weights);
+  virtual ~KinematicNLP();
+
+  void SetParameters(const Dvector& params);
+
+  bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                    Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+  bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number& obj_value);
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                   Ipopt::Number* grad_f);
+  bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Index m, Ipopt::Number* g);
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index* iRow,
+                  Ipopt::Index* jCol, Ipopt::Number* values);
+  bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m,
+              const Ipopt::Number* lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol,
+              Ipopt::Number* values);
+
+ private:
+  // Each of these fills values when given, else the structure when iRow is
+  // given, and returns the number of entries either way.
+  size_t Jacobian(const Ipopt::Number* x, Ipopt::Index* iRow,
+                  Ipopt::Index* jCol, Ipopt::Number* values);
+  size_t Hessian(const Ipopt::Number* x, Ipopt::Number obj_factor,
+                 const Ipopt::Number* lambda, Ipopt::Index* iRow,
+                 Ipopt::Index* jCol, Ipopt::Number* values);
+  // The dynamics constraints of stages [begin, end), 0 < begin.
+  void ConstraintStages(const Ipopt::Number* x, size_t begin, size_t end,
+                        Ipopt::Number* g) const;
+  // The entries of stage t from the k-th on, like Jacobian() and Hessian();
+  // returns the index past them.
+  size_t JacobianStage(size_t t, const Ipopt::Number* x, size_t k,
+                       Ipopt::Index* iRow, Ipopt::Index* jCol,
+                       Ipopt::Number* values) const;
+  size_t HessianStage(size_t t, const Ipopt::Number* x,
+                      Ipopt::Number obj_factor, const Ipopt::Number* lambda,
+                      size_t k, Ipopt::Index* iRow, Ipopt::Index* jCol,
+                      Ipopt::Number* values) const;
+
+  double dt_;
+  double Lf_;
+  double ref_v_;
+  KinematicWeights w_;
+
+  // Path coefficients and initial state, as passed to SetParameters.
+  double params_[n_params];
+  // Stand-in point for the structure-only calls.
+  double zero_[n_vars];
+  double zero_lambda_[n_constraints];
+  size_t nnz_jac_;
+  size_t nnz_hes_;
+  // Index of the first entry of each stage's Jacobian rows (from stage 1)
+  // and Hessian entries.
+  size_t jac_offset_[N];
+  size_t hes_offset_[N];
+};
+
+// The KinematicNLP specialization for horizon N, or NULL if N isn't one of
+// the instantiated horizons.
+KinematicNLPBase* NewKinematicNLP(size_t N, double dt, double Lf, double ref_v,
+                                  const KinematicWeights& weights);
+
+#endif /* KINEMATIC_NLP_H */
@@ -0,0 +1,126 @@
+#include "LQR.h"
+#include <algorithm>
+#include <cmath>
+
+// Speed grid of the steering gains.
+static const double V_STEP = 5;
+static const double V_MAX = 150;
+// Riccati iterations per grid speed; the recursion converges long before.
+static const int DARE_ITERATIONS = 2000;
+
+// Steady-state gain of the discrete algebraic Riccati equation, by iterating
+// the recursion, and optionally the solution P.
+static Eigen::RowVector2d SteeringGain(const Eigen::Matrix2d& A,
+                                       const Eigen::Vector2d& B,
+                                       const Eigen::Matrix2d& Q, double R,
+                                       Eigen::Matrix2d* solution = nullptr) {
+  Eigen::Matrix2d P = Q;
+  Eigen::RowVector2d K = Eigen::RowVector2d::Zero();
+  for (int i = 0; i < DARE_ITERATIONS; i++) {
+    double s = R + B.dot(P * B);
+    K = (B.transpose() * P * A) / s;
+    Eigen::Matrix2d next = Q + A.transpose() * P * (A - B * K);
+    next = 0.5 * (next + next.transpose());
+    bool done = (next - P).lpNorm<Eigen::Infinity>() <=
+                1e-12 * (1 + P.lpNorm<Eigen::Infinity>());
+    P = next;
+    if (done) {
+      break;
+    }
+  }
+  if (solution) {
+    *solution = P;
+  }
+  return K;
+}
+
+// The lateral error dynamics linearized about straight driving at speed v.
+static void LateralModel(double v, double dt, double Lf, Eigen::Matrix2d& A,
+                         Eigen::Vector2d& B) {
+  A << 1, -v * dt, 0, 1;
+  B << 0, v * dt / Lf;
+}
+
+Eigen::Matrix2d LateralCostToGo(double v, double dt, double Lf,
+                                const KinematicWeights& weights) {
+  Eigen::Matrix2d A;
+  Eigen::Vector2d B;
+  LateralModel(v, dt, Lf, A, B);
+  Eigen::Matrix2d Q = Eigen::Vector2d(weights.cte, weights.epsi).asDiagonal();
+  Eigen::Matrix2d P;
+  SteeringGain(A, B, Q, weights.delta, &P);
+  return P;
+}
+
+// Speed is a scalar integrator, v' = v + dt a, whose Riccati equation has a
+// closed form.
+double SpeedCostToGo(double dt, const KinematicWeights& weights) {
+  double q = weights.v;
+  double r = weights.a;
+  double b2 = dt * dt;
+  return (q * b2 + std::sqrt(q * q * b2 * b2 + 4 * b2 * q * r)) / (2 * b2);
+}
+
+LateralLQR::LateralLQR(size_t N, double dt, double Lf, double ref_v,
+                       const KinematicWeights& weights)
+    : N_(N), dt_(dt), Lf_(Lf), ref_v_(ref_v), u_(2, N - 1), x_(6, N) {
+  Eigen::Matrix2d Q = Eigen::Vector2d(weights.cte, weights.epsi).asDiagonal();
+  for (double v = 0; v <= V_MAX + 1e-9; v += V_STEP) {
+    Eigen::Matrix2d A;
+    Eigen::Vector2d B;
+    LateralModel(v, dt, Lf, A, B);
+    gains_.push_back(SteeringGain(A, B, Q, weights.delta));
+  }
+
+  double p = SpeedCostToGo(dt, weights);
+  speed_gain_ = dt * p / (weights.a + dt * dt * p);
+}
+
+Eigen::RowVector2d LateralLQR::Gain(double v) const {
+  double t = std::min(std::max(v, 0.), V_MAX) / V_STEP;
+  size_t i = std::min(size_t(t), gains_.size() - 2);
+  double frac = t - i;
+  return (1 - frac) * gains_[i] + frac * gains_[i + 1];
+}
+
+Input LateralLQR::Control(const State& state,
+                          const Cubic& coeffs,
+                          std::vector<double>& mpc_x_vals,
+                          std::vector<double>& mpc_y_vals) {
+  Input u = Law(state, coeffs);
+  u_.row(0).setConstant(u[0]);
+  u_.row(1).setConstant(u[1]);
+  BicycleRollout(state, u_, coeffs, dt_, Lf_, x_);
+  for (size_t k = 1; k < N_; k++) {
+    mpc_x_vals.push_back(x_(0, k));
+    mpc_y_vals.push_back(x_(1, k));
+  }
+  return u;
+}
+
+Input LateralLQR::Law(const State& state, const Cubic& coeffs) const {
+  double v = state[3];
+  Eigen::RowVector2d K = Gain(v);
+
+  // Curvature of the path at the car, held by delta = Lf kappa.
+  double df = coeffs[1];
+  double kappa = 2 * coeffs[2] / std::pow(1 + df * df, 1.5);
+  double delta = Lf_ * kappa - K.dot(Eigen::Vector2d(state[4], state[5]));
+  double a = speed_gain_ * (ref_v_ - v);
+  delta = std::min(std::max(delta, -MAX_DELTA), MAX_DELTA);
+  a = std::min(std::max(a, -MAX_A), MAX_A);
+  return Input(delta, a);
+}
+
+Input LateralLQR::Track(const State& state, const State& planned,
+                        const Input& feedforward) const {
+  // cte and epsi are relative to the path, so the plan's carry over to later
+  // frames and their fits.
+  Eigen::RowVector2d K = Gain(state[3]);
+  Eigen::Vector2d error(state[4] - planned[4], state[5] - planned[5]);
+  double delta = feedforward[0] - K.dot(error);
+  double a = feedforward[1] + speed_gain_ * (planned[3] - state[3]);
+  delta = std::min(std::max(delta, -MAX_DELTA), MAX_DELTA);
+  a = std::min(std::max(a, -MAX_A), MAX_A);
+  return Input(delta, a);
+}
@@ -0,0 +1,65 @@
+#ifndef LQR_H
+#define LQR_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+
+// Gain-scheduled LQR on the path errors, for when there is no time to
+// optimize at all.
+//
+// Steering regulates (cte, epsi) through the lateral error dynamics linearized
+// about straight driving at speed v,
+//
+//   cte'  = cte - v dt epsi
+//   epsi' = epsi + v dt / Lf delta,
+//
+// on top of the steering that holds the path curvature at the car. Throttle
+// regulates v towards ref_v. The infinite-horizon gains come from the cost
+// weights of the NMPC, and are solved for a grid of speeds at construction,
+// so a control is an interpolation and a few multiplications.
+class LateralLQR {
+ public:
+  LateralLQR(size_t N, double dt, double Lf, double ref_v,
+             const KinematicWeights& weights);
+
+  // Returns the actuations {delta, a} and appends the trajectory they lead
+  // to when held, like MPC::Solve.
+  Input Control(const State& state, const Cubic& coeffs,
+                std::vector<double>& mpc_x_vals,
+                std::vector<double>& mpc_y_vals);
+
+  // The same actuations alone, for rollouts of the law.
+  Input Law(const State& state, const Cubic& coeffs) const;
+
+  // The actuations that hold the car to a planned state: the plan's
+  // actuations plus the same gains on the deviations of cte, epsi and v from
+  // it, clipped to the actuator limits. For MPC::solveEvery.
+  Input Track(const State& state, const State& planned,
+              const Input& feedforward) const;
+
+ private:
+  // The steering gains at speed v, interpolated on the grid.
+  Eigen::RowVector2d Gain(double v) const;
+
+  size_t N_;
+  double dt_;
+  double Lf_;
+  double ref_v_;
+  // Steering gains on (cte, epsi), every V_STEP of speed from 0.
+  std::vector<Eigen::RowVector2d,
+              Eigen::aligned_allocator<Eigen::RowVector2d> > gains_;
+  double speed_gain_;
+  Eigen::MatrixXd u_;
+  Eigen::MatrixXd x_;
+};
+
+// The infinite-horizon cost-to-go of LateralLQR's models, for the terminal
+// cost of the NMPC: (cte, epsi)' P (cte, epsi) for the lateral errors at
+// speed v, from the discrete algebraic Riccati equation, and p (v - ref_v)^2
+// for the speed.
+Eigen::Matrix2d LateralCostToGo(double v, double dt, double Lf,
+                                const KinematicWeights& weights);
+double SpeedCostToGo(double dt, const KinematicWeights& weights);
+
+#endif /* LQR_H */
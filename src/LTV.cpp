@@ -0,0 +1,375 @@
+#include "LTV.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// ADMM settings of the RICCATI formulation, as in SparseQP.
+static const double RICCATI_RHO = 0.1;
+static const double RICCATI_ALPHA = 1.6;
+static const double RICCATI_EPS = 1e-4;
+static const int RICCATI_MAX_ITERATIONS = 4000;
+static const int RICCATI_CHECK_INTERVAL = 5;
+static const double RICCATI_RHO_ADAPT_FACTOR = 5;
+
+template <class Scalar>
+BasicLTVMPC<Scalar>::BasicLTVMPC(
+    size_t N, const std::shared_ptr<const ProblemIR>& problem)
+    : formulation(SPARSE), fixedIterations(0), lastIterations(0),
+      lastConverged(false), N_(N), problem_(problem), n_u_(2 * (N - 1)),
+      n_z_(8 * (N - 1)), riccati_(N - 1), riccati_rho_(RICCATI_RHO) {
+  typedef Eigen::Triplet<double> Triplet;
+  typedef ProblemIR::StageJacobian StageJacobian;
+  const ProblemIR& ir = *problem;
+  Eigen::Matrix<double, 8, 8> hessian =
+      ir.residualJacobian.transpose() * ir.residualJacobian;
+  Eigen::Matrix<double, 8, 1> gradient =
+      ir.residualJacobian.transpose() * ir.residualOffset;
+  assert((hessian.topRightCorner<6, 2>().isZero()));
+  state_hessian_ = hessian.topLeftCorner<6, 6>().cast<Scalar>();
+  state_gradient_ = gradient.head<6>().cast<Scalar>();
+  input_hessian_ = hessian.bottomRightCorner<2, 2>().cast<Scalar>();
+  input_gradient_ = gradient.tail<2>().cast<Scalar>();
+  rate_hessian_ =
+      (ir.rateJacobian.transpose() * ir.rateJacobian).cast<Scalar>();
+
+  coeffs_.setZero();
+  xbar_ = Matrix::Zero(6, N);
+  ubar_ = Matrix::Zero(2, N - 1);
+  A_.resize(N - 1);
+  B_.resize(N - 1);
+  R_ = Matrix::Zero(n_u_, n_u_);
+  u_gradient_ = Vector::Zero(n_u_);
+  for (size_t k = 0; k + 1 < N; k++) {
+    R_.template block<2, 2>(2 * k, 2 * k) += input_hessian_;
+    u_gradient_.template segment<2>(2 * k) = input_gradient_;
+  }
+  for (size_t k = 0; k + 2 < N; k++) {
+    R_.template block<4, 4>(2 * k, 2 * k) += rate_hessian_;
+  }
+
+  // Cost: u' R u on the controls, and the state terms on states 1..N-1. The
+  // diagonal entries without a term stay in the pattern as zeros.
+  std::vector<Triplet> p;
+  for (size_t i = 0; i < n_u_; i++) {
+    for (size_t j = 0; j < n_u_; j++) {
+      if (R_(i, j) != 0) {
+        p.push_back(Triplet(du(i / 2) + i % 2, du(j / 2) + j % 2,
+                            2 * R_(i, j)));
+      }
+    }
+  }
+  for (size_t k = 1; k < N; k++) {
+    for (size_t s = 0; s < 6; s++) {
+      for (size_t t = 0; t < 6; t++) {
+        if (s == t || state_hessian_(s, t) != 0) {
+          p.push_back(Triplet(dx(k) + s, dx(k) + t,
+                              2 * state_hessian_(s, t)));
+        }
+      }
+    }
+  }
+  SparseQP::SpMat P(n_z_, n_z_);
+  P.setFromTriplets(p.begin(), p.end());
+
+  // Constraints: 6 dynamics rows per stage, then the box on each control.
+  // A_k and B_k are added with all their nonzero entries, so that the
+  // pattern is fixed, the constant ones already at their values.
+  size_t n_dyn = 6 * (N - 1);
+  const StageJacobian& constant = ir.constantJacobian;
+  std::vector<Triplet> c;
+  for (size_t k = 0; k + 1 < N; k++) {
+    for (size_t s = 0; s < 6; s++) {
+      size_t row = 6 * k + s;
+      c.push_back(Triplet(row, dx(k + 1) + s, 1));
+      for (size_t t = 0; t < 8; t++) {
+        if (ir.structure[s][t] != ProblemIR::ZERO && (k > 0 || t >= 6)) {
+          size_t column = t < 6 ? dx(k) + t : du(k) + t - 6;
+          c.push_back(Triplet(row, column, -constant(s, t)));
+        }
+      }
+    }
+    for (size_t i = 0; i < 2; i++) {
+      c.push_back(Triplet(n_dyn + 2 * k + i, du(k) + i, 1));
+    }
+  }
+  SparseQP::SpMat C(n_dyn + n_u_, n_z_);
+  C.setFromTriplets(c.begin(), c.end());
+
+  std::vector<bool> equality(n_dyn + n_u_, false);
+  std::fill(equality.begin(), equality.begin() + n_dyn, true);
+  qp_.Setup(P, C, equality);
+
+  // Condensed formulation, over the controls only.
+  gamma_ = Matrix::Zero(6 * (N - 1), n_u_);
+  q_gamma_ = Matrix::Zero(6 * (N - 1), n_u_);
+  residual_ = Vector::Zero(6 * (N - 1));
+  H_ = Matrix::Zero(n_u_, n_u_);
+  g_ = Vector::Zero(n_u_);
+  dense_.Resize(n_u_);
+  active_.Resize(n_u_);
+
+  q_ = Eigen::VectorXd::Zero(n_z_);
+  lower_ = Eigen::VectorXd::Zero(n_dyn + n_u_);
+  upper_ = Eigen::VectorXd::Zero(n_dyn + n_u_);
+  zero_ = Eigen::VectorXd::Zero(n_z_);
+  lb_ = Vector::Zero(n_u_);
+  ub_ = Vector::Zero(n_u_);
+  du_ = Vector::Zero(n_u_);
+  r_base_ = Vector::Zero(n_u_);
+  box_ = Vector::Zero(n_u_);
+  box_dual_ = Vector::Zero(n_u_);
+}
+
+template <class Scalar>
+Input BasicLTVMPC<Scalar>::Solve(const State& state, const Cubic& coeffs,
+                                 std::vector<double>& mpc_x_vals,
+                                 std::vector<double>& mpc_y_vals) {
+  // Linearize about the previous controls, advanced by one stage.
+  for (size_t k = 0; k + 2 < N_; k++) {
+    ubar_.col(k) = ubar_.col(k + 1);
+  }
+  coeffs_ = coeffs;
+  xbar_.col(0) = state.cast<Scalar>();
+  Rollout(true);
+  const ProblemIR::StageVector& lower = problem_->lower;
+  const ProblemIR::StageVector& upper = problem_->upper;
+  for (size_t k = 0; k + 1 < N_; k++) {
+    for (size_t i = 0; i < 2; i++) {
+      lb_[2 * k + i] = lower[6 + i] - ubar_(i, k);
+      ub_[2 * k + i] = upper[6 + i] - ubar_(i, k);
+    }
+  }
+
+  if (formulation == CONDENSED || formulation == ACTIVE_SET) {
+    SolveCondensed();
+  } else if (formulation == RICCATI) {
+    SolveRiccati();
+  } else {
+    SolveSparse();
+  }
+
+  for (size_t i = 0; i < n_u_; i++) {
+    ubar_(i) += std::min(std::max(du_[i], lb_[i]), ub_[i]);
+  }
+  Rollout(false);
+
+  for (size_t k = 1; k < N_; k++) {
+    mpc_x_vals.push_back(xbar_(0, k));
+    mpc_y_vals.push_back(xbar_(1, k));
+  }
+  return ubar_.col(0).template cast<double>();
+}
+
+template <class Scalar>
+void BasicLTVMPC<Scalar>::Rollout(bool linearize) {
+  double w[ProblemIR::STAGE_VARS];
+  double next[ProblemIR::STATES];
+  ProblemIR::StageJacobian J;
+  for (size_t k = 0; k + 1 < N_; k++) {
+    for (size_t i = 0; i < 6; i++) {
+      w[i] = xbar_(i, k);
+    }
+    w[6] = ubar_(0, k);
+    w[7] = ubar_(1, k);
+    if (linearize) {
+      problem_->Linearize(coeffs_.data(), w, next, J);
+      A_[k] = J.leftCols<6>().cast<Scalar>();
+      B_[k] = J.rightCols<2>().cast<Scalar>();
+    } else {
+      problem_->Step(coeffs_.data(), w, next);
+    }
+    xbar_.col(k + 1) = State::Map(next).cast<Scalar>();
+  }
+}
+
+template <class Scalar>
+void BasicLTVMPC<Scalar>::SolveSparse() {
+  // The constant entries of A_k and B_k are in place from the setup.
+  for (size_t k = 0; k + 1 < N_; k++) {
+    for (size_t i = 0; i < 6; i++) {
+      for (size_t j = 0; k > 0 && j < 6; j++) {
+        if (problem_->structure[i][j] == ProblemIR::VARYING) {
+          qp_.SetConstraint(6 * k + i, dx(k) + j, -A_[k](i, j));
+        }
+      }
+      for (size_t j = 0; j < 2; j++) {
+        if (problem_->structure[i][6 + j] == ProblemIR::VARYING) {
+          qp_.SetConstraint(6 * k + i, du(k) + j, -B_[k](i, j));
+        }
+      }
+    }
+  }
+
+  // Linear cost terms of the deviations.
+  Eigen::Map<Vector> u_flat(ubar_.data(), n_u_);
+  for (size_t i = 0; i < n_u_; i++) {
+    q_[du(i / 2) + i % 2] = 2 * (R_.row(i).dot(u_flat) + u_gradient_[i]);
+  }
+  for (size_t k = 1; k < N_; k++) {
+    q_.segment<6>(dx(k)) =
+        (2 * (state_hessian_ * xbar_.col(k) + state_gradient_))
+            .template cast<double>();
+  }
+  lower_.tail(n_u_) = lb_.template cast<double>();
+  upper_.tail(n_u_) = ub_.template cast<double>();
+
+  // The trajectory already carries the last solution, so the deviations
+  // start from zero; the multipliers carry over.
+  qp_.WarmStart(zero_);
+  qp_.fixedIterations = fixedIterations;
+  lastIterations = qp_.Solve(q_, lower_, upper_);
+  lastConverged = qp_.converged();
+
+  const Eigen::VectorXd& z = qp_.solution();
+  for (size_t i = 0; i < n_u_; i++) {
+    du_[i] = z[du(i / 2) + i % 2];
+  }
+}
+
+template <class Scalar>
+void BasicLTVMPC<Scalar>::SolveCondensed() {
+  // residual_ is the gradient of the state terms at the trajectory.
+  for (size_t k = 0; k + 1 < N_; k++) {
+    CondenseStage(k, A_[k], B_[k], gamma_);
+    residual_.template segment<6>(6 * k).noalias() =
+        state_hessian_ * xbar_.col(k + 1) + state_gradient_;
+    q_gamma_.middleRows(6 * k, 6).noalias() =
+        state_hessian_ * gamma_.middleRows(6 * k, 6);
+  }
+  H_.noalias() = Scalar(2) * gamma_.transpose() * q_gamma_;
+  H_ += Scalar(2) * R_;
+  Eigen::Map<Vector> u_flat(ubar_.data(), n_u_);
+  g_.noalias() = Scalar(2) * gamma_.transpose() * residual_;
+  g_.noalias() += Scalar(2) * R_ * u_flat;
+  g_ += Scalar(2) * u_gradient_;
+
+  if (formulation == ACTIVE_SET) {
+    // The bounds active last frame, on the stages they are now.
+    active_.Shift(2);
+    du_.setZero();
+    active_.WarmStart(du_);
+    lastIterations = active_.Solve(H_, g_, lb_, ub_);
+    lastConverged = active_.converged();
+    du_ = active_.solution();
+    return;
+  }
+  du_.setZero();
+  dense_.WarmStart(du_);
+  dense_.fixedIterations = fixedIterations;
+  lastIterations = dense_.Solve(H_, g_, lb_, ub_);
+  lastConverged = dense_.converged();
+  du_ = dense_.solution();
+}
+
+template <class Scalar>
+void BasicLTVMPC<Scalar>::SolveRiccati() {
+  // Stage k has the state [dx_k, du_{k-1}] and the control du_k; the rate
+  // terms couple du_k to the previous control carried in the state.
+  typedef Eigen::Matrix<Scalar, 2, 2> Block;
+  const Block rate_previous = rate_hessian_.template topLeftCorner<2, 2>();
+  const Block rate_cross = rate_hessian_.template topRightCorner<2, 2>();
+  const Block rate_current = rate_hessian_.template bottomRightCorner<2, 2>();
+  size_t T = N_ - 1;
+  for (size_t k = 0; k <= T; k++) {
+    riccati_.Q[k].setZero();
+    riccati_.q[k].setZero();
+    if (k > 0) {
+      riccati_.Q[k].template topLeftCorner<6, 6>() =
+          Scalar(2) * state_hessian_;
+      riccati_.q[k].template head<6>() =
+          Scalar(2) * (state_hessian_ * xbar_.col(k) + state_gradient_);
+    }
+    if (k == T) {
+      break;
+    }
+    riccati_.A[k].setZero();
+    riccati_.A[k].template topLeftCorner<6, 6>() = A_[k];
+    riccati_.B[k].setZero();
+    riccati_.B[k].template topRows<6>() = B_[k];
+    riccati_.B[k].template bottomRows<2>().setIdentity();
+    riccati_.S[k].setZero();
+    riccati_.R[k] = Scalar(2) * input_hessian_;
+    riccati_.R[k].diagonal().array() += riccati_rho_;
+    r_base_.template segment<2>(2 * k) =
+        Scalar(2) * (input_hessian_ * ubar_.col(k) + input_gradient_);
+    if (k > 0) {
+      riccati_.R[k] += Scalar(2) * rate_current;
+      riccati_.Q[k].template bottomRightCorner<2, 2>() =
+          Scalar(2) * rate_previous;
+      riccati_.S[k].template bottomRows<2>() = Scalar(2) * rate_cross;
+      r_base_.template segment<2>(2 * k) +=
+          Scalar(2) * (rate_cross.transpose() * ubar_.col(k - 1) +
+                       rate_current * ubar_.col(k));
+      riccati_.q[k].template tail<2>() =
+          Scalar(2) * (rate_previous * ubar_.col(k - 1) +
+                       rate_cross * ubar_.col(k));
+    }
+  }
+  riccati_.x0.setZero();
+  riccati_.Factorize();
+
+  // ADMM on du = box, with box within [lb, ub]. As in SolveSparse, the
+  // controls start from the trajectory and the multipliers carry over.
+  box_.setZero();
+  int limit = fixedIterations > 0 ? fixedIterations : RICCATI_MAX_ITERATIONS;
+  lastIterations = 0;
+  lastConverged = false;
+  while (lastIterations < limit) {
+    lastIterations++;
+    Scalar rho = riccati_rho_;
+    for (size_t k = 0; k < T; k++) {
+      for (size_t i = 0; i < 2; i++) {
+        size_t j = 2 * k + i;
+        riccati_.r[k][i] = r_base_[j] - rho * box_[j] + box_dual_[j];
+      }
+    }
+    riccati_.Solve();
+
+    double prim = 0;
+    double dual = 0;
+    double prim_scale = 0;
+    double dual_scale = 0;
+    for (size_t k = 0; k < T; k++) {
+      for (size_t i = 0; i < 2; i++) {
+        size_t j = 2 * k + i;
+        Scalar u = riccati_.u[k][i];
+        Scalar relaxed = RICCATI_ALPHA * u + (1 - RICCATI_ALPHA) * box_[j];
+        Scalar next =
+            std::min(std::max(relaxed + box_dual_[j] / rho, lb_[j]), ub_[j]);
+        box_dual_[j] += rho * (relaxed - next);
+        prim = std::max(prim, double(std::fabs(u - next)));
+        dual = std::max(dual, double(rho * std::fabs(next - box_[j])));
+        prim_scale = std::max(prim_scale, double(std::max(std::fabs(u),
+                                                          std::fabs(next))));
+        dual_scale = std::max(dual_scale, double(std::fabs(box_dual_[j])));
+        box_[j] = next;
+      }
+    }
+    lastConverged = prim <= RICCATI_EPS + RICCATI_EPS * prim_scale &&
+                    dual <= RICCATI_EPS + RICCATI_EPS * dual_scale;
+    if (lastConverged && fixedIterations == 0) {
+      break;
+    }
+    if (fixedIterations > 0 ||
+        lastIterations % RICCATI_CHECK_INTERVAL != 0) {
+      continue;
+    }
+
+    // Rebalance the residuals; only R_k depends on rho.
+    double ratio = std::sqrt((prim / (prim_scale + 1e-10)) /
+                             (dual / (dual_scale + 1e-10) + 1e-10));
+    double next = std::min(std::max(rho * ratio, 1e-6), 1e6);
+    if (next > RICCATI_RHO_ADAPT_FACTOR * rho ||
+        next < rho / RICCATI_RHO_ADAPT_FACTOR) {
+      for (size_t k = 0; k < T; k++) {
+        riccati_.R[k].diagonal().array() += Scalar(next - rho);
+      }
+      riccati_rho_ = next;
+      riccati_.Factorize();
+    }
+  }
+  du_ = box_;
+}
+
+template class BasicLTVMPC<double>;
+template class BasicLTVMPC<float>;
@@ -0,0 +1,159 @@
+#ifndef LTV_H
+#define LTV_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "ActiveSetQP.h"
+#include "BicycleModel.h"
+#include "DenseQP.h"
+#include "ProblemIR.h"
+#include "Riccati.h"
+#include "SparseQP.h"
+
+// Linear time-varying MPC.
+//
+// Each frame, the previous control trajectory is shifted one stage and rolled
+// out from the new state through the dynamics of the ProblemIR, whichever
+// model and integrator it has; they are linearized along that trajectory
+// into A_k, B_k, and with the IR's cost and actuator bounds the QP in the
+// deviations
+// (dx_1, ..., dx_{N-1}, du_0, ..., du_{N-2}) is solved to convergence by
+// SparseQP. The variables are interleaved by stage, [du_0, dx_1, du_1, ...],
+// and the dynamics dx_{k+1} = A_k dx_k + B_k du_k are kept as equality
+// constraints, so the KKT matrix stays banded as N grows. The sparsity
+// pattern is set up once, with the entries of A_k and B_k the IR finds
+// ZERO left out and the CONSTANT ones set; only the VARYING ones change
+// between frames. The cost's terms are taken as TrackingCost's are, of a
+// stage's state or of its actuations but not of both.
+//
+// Alternatively the same QP can be condensed: the dynamics are substituted
+// out through the sensitivities of the states to the controls, which leaves
+// a dense QP in the 2 (N - 1) controls for DenseQP. That is the smaller
+// problem for short horizons, but condensing costs O(N^3) against the sparse
+// formulation's O(N); bench/ltv_formulations.cpp measures the crossover.
+// ACTIVE_SET solves the condensed QP with ActiveSetQP instead, hot started
+// from the previous frame's active bounds shifted one stage.
+//
+// RICCATI keeps the stage structure instead: ADMM splits off the control
+// bounds, and each iteration solves the remaining equality-constrained LQ
+// problem with a Riccati recursion over the state augmented with the previous
+// control. The matrices are factorized once per frame (and when rho moves),
+// so an iteration is two O(N) sweeps over fixed-size blocks.
+//
+// All of it is in the scalar of BasicLTVMPC: LTV.cpp instantiates double,
+// LTVMPC, and float, the controller's with MPC_SINGLE_PRECISION (see
+// Precision.h), whose dense QPs refine their solves in double where the
+// factorizations are too badly conditioned for float. The SPARSE QP stays
+// double: its KKT pivots span sigma to the equality penalty, and ADMM in
+// float stalls on them. The state, the path and the actuations in and out
+// stay double, and so do the IR's stages.
+class LTVFormulations {
+ public:
+  enum Formulation { SPARSE, CONDENSED, RICCATI, ACTIVE_SET };
+};
+
+template <class Scalar>
+class BasicLTVMPC : public LTVFormulations {
+ public:
+  // `problem` over N stages.
+  BasicLTVMPC(size_t N, const std::shared_ptr<const ProblemIR>& problem);
+
+  // Which QP Solve builds; both are set up at construction.
+  Formulation formulation;
+  // Run the ADMM of SPARSE, CONDENSED and RICCATI for exactly this many
+  // iterations at a fixed rho, see SparseQP::fixedIterations; 0 to iterate
+  // to the tolerances. ACTIVE_SET ignores it.
+  int fixedIterations;
+
+  // Returns the first actuations {delta, a} and appends the predicted
+  // trajectory, like MPC::Solve.
+  Input Solve(const State& state, const Cubic& coeffs,
+              std::vector<double>& mpc_x_vals,
+              std::vector<double>& mpc_y_vals);
+
+  // ADMM iterations used by the last QP, or ACTIVE_SET's changes of the
+  // working set, and whether it met the tolerances.
+  int lastIterations;
+  bool lastConverged;
+
+ private:
+  typedef BicycleTypes<Scalar> Types;
+  typedef typename Types::Matrix Matrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+  typedef typename Types::StateJacobian StateJacobianT;
+  typedef typename Types::InputJacobian InputJacobianT;
+  typedef std::vector<StateJacobianT, Eigen::aligned_allocator<StateJacobianT> >
+      StateJacobians;
+  typedef std::vector<InputJacobianT,
+                      Eigen::aligned_allocator<InputJacobianT> >
+      InputJacobians;
+
+  // Roll ubar_ out from xbar_'s first state, linearizing each stage into
+  // A_ and B_ if asked.
+  void Rollout(bool linearize);
+  void SolveSparse();
+  void SolveCondensed();
+  void SolveRiccati();
+
+  // Offsets of du_k and dx_k in the sparse QP variables.
+  size_t du(size_t k) const { return 8 * k; }
+  size_t dx(size_t k) const { return 8 * (k - 1) + 2; }
+
+  size_t N_;
+  std::shared_ptr<const ProblemIR> problem_;
+  size_t n_u_;
+  size_t n_z_;
+
+  // The cost of a stage, J_r' J_r and J_r' r_0 of the IR's residuals, over
+  // its state and over its actuations, and J_r' J_r of the change over
+  // [delta, a] of two stages.
+  Eigen::Matrix<Scalar, 6, 6> state_hessian_;
+  Eigen::Matrix<Scalar, 6, 1> state_gradient_;
+  Eigen::Matrix<Scalar, 2, 2> input_hessian_;
+  Eigen::Matrix<Scalar, 2, 1> input_gradient_;
+  Eigen::Matrix<Scalar, 4, 4> rate_hessian_;
+
+  Cubic coeffs_;
+  Matrix xbar_;
+  Matrix ubar_;
+  StateJacobians A_;
+  InputJacobians B_;
+  // The actuations' Hessian, and their constant gradient, stacked.
+  Matrix R_;
+  Vector u_gradient_;
+  // Control bounds and step, stacked [delta0, a0, delta1, a1, ...].
+  Vector lb_;
+  Vector ub_;
+  Vector du_;
+
+  // Double whatever the scalar: float stalls ADMM on this KKT matrix.
+  SparseQP qp_;
+  Eigen::VectorXd q_;
+  Eigen::VectorXd lower_;
+  Eigen::VectorXd upper_;
+  Eigen::VectorXd zero_;
+
+  BasicDenseQP<Scalar> dense_;
+  BasicActiveSetQP<Scalar> active_;
+  Matrix gamma_;
+  Matrix q_gamma_;
+  Vector residual_;
+  Matrix H_;
+  Vector g_;
+
+  Riccati<8, 2, Scalar> riccati_;
+  Scalar riccati_rho_;
+  // Linear control terms before the ADMM penalty, the bounded copy of the
+  // controls and its scaled multipliers.
+  Vector r_base_;
+  Vector box_;
+  Vector box_dual_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef BasicLTVMPC<double> LTVMPC;
+
+#endif /* LTV_H */
@@ -0,0 +1,56 @@
+#include "LatencyEstimator.h"
+#include <algorithm>
+#include "Checkpoint.h"
+
+LatencyEstimator::LatencyEstimator(size_t window, double weight)
+    : weight_(weight), mean_(0), total_(0), window_(window), next_(0) {
+  samples_.reserve(window);
+  sorted_.reserve(window);
+}
+
+void LatencyEstimator::Record(double seconds) {
+  mean_ = total_ == 0 ? seconds : (1 - weight_) * mean_ + weight_ * seconds;
+  total_++;
+  if (samples_.size() < window_) {
+    samples_.push_back(seconds);
+  } else {
+    samples_[next_] = seconds;
+    next_ = (next_ + 1) % samples_.size();
+  }
+}
+
+double LatencyEstimator::Percentile(double p) const {
+  if (samples_.empty()) {
+    return 0;
+  }
+  sorted_ = samples_;
+  size_t k = std::min(size_t(p * (sorted_.size() - 1) + 0.5),
+                      sorted_.size() - 1);
+  std::nth_element(sorted_.begin(), sorted_.begin() + k, sorted_.end());
+  return sorted_[k];
+}
+
+void LatencyEstimator::Checkpoint(CheckpointWriter& out) const {
+  out.Double(mean_);
+  out.Count(total_);
+  // The ring buffer starts at next_ once it is full.
+  out.Count(samples_.size());
+  for (size_t i = 0; i < samples_.size(); i++) {
+    out.Double(samples_[(next_ + i) % samples_.size()]);
+  }
+}
+
+bool LatencyEstimator::Restore(CheckpointReader& in) {
+  double mean;
+  size_t total;
+  std::vector<double> samples;
+  if (!in.Double(mean) || !in.Count(total) || !in.Doubles(samples)) {
+    return false;
+  }
+  mean_ = mean;
+  total_ = total;
+  size_t kept = std::min(samples.size(), window_);
+  samples_.assign(samples.end() - kept, samples.end());
+  next_ = 0;
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef LATENCY_ESTIMATOR_H
+#define LATENCY_ESTIMATOR_H
+
+#include <cstddef>
+#include <vector>
+
+class CheckpointReader;
+class CheckpointWriter;
+
+// Smoothed estimate and percentiles of a measured delay.
+//
+// mean() is an exponentially weighted moving average, for prediction: it
+// follows drift within a few dozen samples and ignores single outliers.
+// Percentile() is over the last `window` samples, for monitoring the tail.
+class LatencyEstimator {
+ public:
+  explicit LatencyEstimator(size_t window = 200, double weight = 0.1);
+
+  // Record one delay, in seconds.
+  void Record(double seconds);
+
+  // Samples recorded so far.
+  size_t count() const { return total_; }
+  // The smoothed delay; 0 until a sample is recorded.
+  double mean() const { return mean_; }
+  // The p-quantile, p in [0, 1], of the samples in the window.
+  double Percentile(double p) const;
+
+  // Write the estimate and the window, oldest first, into a checkpoint, and
+  // read them back, the newest that fit if the window is shorter here.
+  void Checkpoint(CheckpointWriter& out) const;
+  bool Restore(CheckpointReader& in);
+
+ private:
+  double weight_;
+  double mean_;
+  size_t total_;
+  // Ring buffer of the window, and scratch space for the quantiles.
+  std::vector<double> samples_;
+  size_t window_;
+  size_t next_;
+  mutable std::vector<double> sorted_;
+};
+
+#endif /* LATENCY_ESTIMATOR_H */
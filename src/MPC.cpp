@@ -1,274 +1,2410 @@
 #include "MPC.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <cppad/cppad.hpp>
-#include <cppad/ipopt/solve.hpp>
+#include "AutoDiffNLP.h"
+#include "BicycleAtomic.h"
+#include "Checkpoint.h"
+#include "EnergyMeter.h"
+#include "KinematicNLP.h"
+#include "PerfCounters.h"
+#include "Polynomial.h"
+#include "ProblemPolicies.h"
 #include "Eigen-3.3/Eigen/Core"
 
 using CppAD::AD;
 
 const double PI = 3.14159;
 
-// Set the timestep length and duration
-size_t N = 10;
-double dt = 0.05;
+// Dynamic parameters of the tape: the fitted cubic's coefficients followed by
+// the initial state [x, y, psi, v, cte, epsi], then the cost's, see
+// Layout::cost_param, and the discs of the obstacle slots, see
+// Layout::obstacle_param.
+const size_t n_coeffs = 4;
+const size_t n_params = n_coeffs + 6;
+const size_t n_cost_params = TrackingCost::PARAMETERS + 6;
 
-// This value assumes the model presented in the classroom is used.
+// The solver takes all the state variables and actuator
+// variables in a singular vector. Thus, we should to establish
+// when one variable starts and another ends to make our lifes easier.
+//
+// Set the number of model variables (includes both states and inputs).
+// For example: If the state is a 4 element vector, the actuators is a 2
+// element vector and there are 10 timesteps. The number of variables is:
+// 4 * 10 + 2 * 9
 //
-// It was obtained by measuring the radius formed by running the vehicle in the
-// simulator around in a circle with a constant steering angle and velocity on a
-// flat terrain.
+// Variable-major, the default, is all x, then all y, psi, v, cte, epsi,
+// delta and a. Stage-major is stage by stage, [x0 y0 psi0 v0 cte0 epsi0
+// delta0 a0 | x1 ...], with the constraints stage by stage as well: each
+// stage's update then touches neighbouring entries, and the KKT matrix is
+// banded in its natural order, with a bandwidth independent of N.
 //
-// Lf was tuned until the the radius formed by the simulating the model
-// presented in the classroom matched the previous radius.
+// The reduced formulations drop variables and constraints: with
+// initial_bounds the initial state is held by bounds on stage 0, which Ipopt
+// takes out of the problem, instead of by six equality constraints; with
+// derived_errors cte and epsi are not variables but expressions of the
+// stage before, which the model gives exactly, so that their constraints go
+// too.
 //
-// This is the length from front to CoG that has a similar radius.
-const double Lf = 2.67;
+// With move blocking the actuations are held over blocks of stages, of the
+// given lengths with the last repeated to the end of the horizon, and there
+// is one pair of actuation variables a block (variable-major only).
+//
+// The state constraints come after the dynamics: the terminal region's, a
+// pair a stage for the corridor on cte, one a stage for the speed limit and
+// one a stage for each obstacle slot. They are soft with softConstraints:
+// each has a slack variable, after all the others, which relaxes it at a
+// price in the cost, so that the problem always stays feasible.
+struct Layout {
+  // The layout config asks for on the tape or, without `tape`, the full
+  // variable-major one with no state constraints that KinematicNLP has
+  // built in. The Gauss-Newton residuals need the errors as variables, and
+  // move blocking keeps the variable-major layout.
+  Layout(size_t N, const MpcConfig& config, bool tape)
+      : N(N),
+        stage_major(tape && config.stageMajor && config.moveBlocks.empty()),
+        initial_bounds(tape && config.initialStateBounds),
+        derived_errors(tape && config.derivedErrors &&
+                       config.hessian != MpcConfig::GAUSS_NEWTON),
+        n_states(derived_errors ? 4 : 6),
+        first(initial_bounds ? 1 : 0),
+        block(Blocks(N - 1, tape ? config.moveBlocks : std::vector<size_t>())),
+        n_blocks(block.empty() ? 0 : block.back() + 1),
+        terminal_region(tape && config.terminalRegion > 0),
+        corridor(tape && config.cteLimit > 0),
+        speed_limit(tape && config.speedLimit > 0),
+        obstacles(tape ? config.obstacleSlots : 0),
+        soft(tape && config.softConstraints),
+        n_dynamics(n_states * (N - first)),
+        n_constraints(n_dynamics + terminal_region + 2 * (N - 1) * corridor +
+                      (N - 1) * (speed_limit + obstacles)),
+        n_slacks(soft ? terminal_region +
+                            (N - 1) * (corridor + speed_limit + obstacles)
+                      : 0),
+        n_vars(n_states * N + 2 * n_blocks + n_slacks),
+        n_params(::n_params + n_cost_params + 3 * (N - 1) * obstacles) {
+    assert(!stage_major || n_blocks + 1 == N);
+  }
 
-// The reference velocity
-double REF_V = 50;
+  // The block of each of `stages` stages, one stage per block without
+  // lengths.
+  static std::vector<size_t> Blocks(size_t stages,
+                                    const std::vector<size_t>& lengths) {
+    std::vector<size_t> block(stages);
+    size_t b = 0;
+    size_t end = 0;  // the first stage past block b
+    for (size_t t = 0; t < stages; t++) {
+      if (t == end) {
+        b = t == 0 ? 0 : b + 1;
+        size_t length =
+            lengths.empty() ? 1 : lengths[std::min(b, lengths.size() - 1)];
+        end = t + std::max<size_t>(length, 1);
+      }
+      block[t] = b;
+    }
+    return block;
+  }
 
-// The solver takes all the state variables and actuator
-// variables in a singular vector. Thus, we should to establish
-// when one variable starts and another ends to make our lifes easier.
-size_t x_start = 0;
-size_t y_start = x_start + N;
-size_t psi_start = y_start + N;
-size_t v_start = psi_start + N;
-size_t cte_start = v_start + N;
-size_t epsi_start = cte_start + N;
-size_t delta_start = epsi_start + N; // steering angle
-size_t a_start = delta_start + N - 1; // acceleration
-
-// cost coefficient for cte
-double LAMBDA_CTE = 4;
-// cost coefficient for espi
-double LAMBDA_EPSI = 4;
-// cost coefficient for velocity
-double LAMBDA_V = 1;
-// cost coefficient for steering
-double LAMBDA_DELTA = 1000;
-// cost coefficient for accleration
-double LAMBDA_A = 10;
-// cost coefficient for steering gap betweent two timestamps
-double LAMBDA_DELTA_DIFF = 4;
-// cost coefficient for accleration gap betweent two timestamps
-double LAMBDA_A_DIFF = 0;
-
-
-class FG_eval {
- public:
-  // Fitted polynomial coefficients
-  Eigen::VectorXd coeffs;
-  FG_eval(Eigen::VectorXd coeffs) { this->coeffs = coeffs;}
+  // Stage t's state variable i, of [x, y, psi, v, cte, epsi], i < n_states.
+  size_t state(size_t i, size_t t) const {
+    return stage_major ? (n_states + 2) * t + i : i * N + t;
+  }
+  // Stage t's actuation j, of [delta, a], for t < N - 1.
+  size_t input(size_t j, size_t t) const {
+    return stage_major ? (n_states + 2) * t + n_states + j
+                       : n_states * N + j * n_blocks + block[t];
+  }
+  // The constraint on stage t's state variable i, for t >= first.
+  size_t constraint(size_t i, size_t t) const {
+    return stage_major ? n_states * (t - first) + i
+                       : i * (N - first) + t - first;
+  }
+  // The state constraints, for t >= 1: the terminal region's, stage t's
+  // corridor, side 0 for cte at most the limit and 1 for at least minus it,
+  // its speed limit and its obstacle slot j's clearance.
+  size_t terminal() const { return n_dynamics; }
+  size_t corridor_constraint(size_t side, size_t t) const {
+    return n_dynamics + terminal_region + 2 * (t - 1) + side;
+  }
+  size_t speed_constraint(size_t t) const {
+    return n_dynamics + terminal_region + 2 * (N - 1) * corridor + t - 1;
+  }
+  size_t obstacle_constraint(size_t j, size_t t) const {
+    return n_dynamics + terminal_region +
+           (N - 1) * (2 * corridor + speed_limit) + obstacles * (t - 1) + j;
+  }
+  // Their slacks, with soft.
+  size_t terminal_slack() const { return n_states * N + 2 * n_blocks; }
+  size_t corridor_slack(size_t t) const {
+    return terminal_slack() + terminal_region + t - 1;
+  }
+  size_t speed_slack(size_t t) const {
+    return terminal_slack() + terminal_region + (N - 1) * corridor + t - 1;
+  }
+  size_t obstacle_slack(size_t j, size_t t) const {
+    return terminal_slack() + terminal_region +
+           (N - 1) * (corridor + speed_limit) + obstacles * (t - 1) + j;
+  }
+  // The dynamic parameters of the cost, see CostParameters: the Cost's,
+  // the factor U of the terminal cost-to-go, as [U00, U01, U11], and the
+  // square root of its speed's, then the slacks' prices soft_l1 and
+  // sqrt(soft_l2). A tuning that changes only these shares the tapes.
+  size_t cost_param() const { return ::n_params; }
+  size_t terminal_param() const {
+    return cost_param() + TrackingCost::PARAMETERS;
+  }
+  size_t slack_param() const { return terminal_param() + 4; }
+  // The dynamic parameters of stage t's obstacle slot j: the disc's center
+  // in the vehicle frame and its squared radius, margin included.
+  size_t obstacle_param(size_t j, size_t t) const {
+    return ::n_params + n_cost_params + 3 * (obstacles * (t - 1) + j);
+  }
+
+  size_t x(size_t t) const { return state(0, t); }
+  size_t y(size_t t) const { return state(1, t); }
+  size_t psi(size_t t) const { return state(2, t); }
+  size_t v(size_t t) const { return state(3, t); }
+  size_t cte(size_t t) const { return state(4, t); }
+  size_t epsi(size_t t) const { return state(5, t); }
+  size_t delta(size_t t) const { return input(0, t); }  // steering angle
+  size_t a(size_t t) const { return input(1, t); }  // acceleration
 
+  size_t N;
+  bool stage_major;
+  bool initial_bounds;
+  bool derived_errors;
+  size_t n_states;
+  // The first stage with constraints.
+  size_t first;
+  // The actuation block of each stage but the last.
+  std::vector<size_t> block;
+  size_t n_blocks;
+  bool terminal_region;
+  bool corridor;
+  bool speed_limit;
+  // Obstacle slots a stage.
+  size_t obstacles;
+  bool soft;
+  size_t n_dynamics;
+  size_t n_constraints;
+  size_t n_slacks;
+  size_t n_vars;
+  size_t n_params;
+};
+
+// The step of stage t to the next: config.stageDt, its last step repeated,
+// or dt throughout.
+static double StageStep(const MpcConfig& config, size_t t, double dt) {
+  if (config.stageDt.empty()) {
+    return dt;
+  }
+  return config.stageDt[std::min(t, config.stageDt.size() - 1)];
+}
+
+static std::vector<double> StageSteps(const MpcConfig& config, size_t N,
+                                      double dt) {
+  std::vector<double> steps(N - 1);
+  for (size_t t = 0; t + 1 < N; t++) {
+    steps[t] = StageStep(config, t, dt);
+  }
+  return steps;
+}
+
+// The cost's dynamic parameters of a problem of config with steps of dt,
+// n_cost_params of them from p, see Layout::cost_param.
+static void CostParameters(const MpcConfig& config, double dt, double* p) {
+  TrackingCost::Parameters(config.weights, config.refV, p);
+  // The cost-to-go P = U' U of the errors at the reference speed, and
+  // the speed's, factored for the residuals.
+  double* u = p + TrackingCost::PARAMETERS;
+  Eigen::Matrix2d P =
+      LateralCostToGo(config.refV, dt, config.Lf, config.weights);
+  u[0] = std::sqrt(P(0, 0));
+  u[1] = P(0, 1) / u[0];
+  u[2] = std::sqrt(P(1, 1) - u[1] * u[1]);
+  u[3] = std::sqrt(SpeedCostToGo(dt, config.weights));
+  u[4] = config.softL1;
+  u[5] = std::sqrt(config.softL2);
+}
+
+// The problem of a Model and a Cost, see ProblemPolicies.h, the Cost's
+// weights dynamic parameters. The members shadow the config's N and dt, so
+// that each problem shape gets its own tape; the weights and refV don't
+// shape it. The layout carries the kinematic state and inputs, which every
+// model shares.
+template <class Model, template <class> class Cost>
+class FG_eval : public Layout {
+ public:
   typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+  typedef Cost<AD<double> > TapedCost;
+  static_assert(Model::STATES == 6 && Model::INPUTS == 2,
+                "the layout has 6 states and 2 inputs a stage");
 
-  void operator()(ADvector& fg, const ADvector& vars) {
-    // vars: [x0, ..., x_t-1, y0, ..., psi0, ..., v0, ..., cte0, ..., epsi0, ...]
-    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
-    // NOTE: You'll probably go back and forth between this function and
-    // the Solver function below.
+  FG_eval(const MpcConfig& config, const Layout& layout, double dt,
+          const Model& model)
+      : Layout(layout),
+        n_residuals(TapedCost::STATE_TERMS * N +
+                    TapedCost::INPUT_TERMS * (N - 1) +
+                    TapedCost::RATE_TERMS * (n_blocks - 1) +
+                    (config.terminalCost ? 3 : 0) + n_slacks),
+        dt(StageSteps(config, N, dt)), Lf(config.Lf), model(model),
+        atomic_dynamics(config.atomicDynamics &&
+                        config.integrator == MpcConfig::EULER &&
+                        config.model == MpcConfig::KINEMATIC),
+        integrator(config.integrator),
+        terminal_cost(config.terminalCost) {}
 
-    // The cost is stored is the first element of `fg`
-    fg[0] = 0;
+  size_t n_residuals;
+  // The step from each stage to the next, see MpcConfig::stageDt.
+  std::vector<double> dt;
+  double Lf;
+  Model model;
+  bool atomic_dynamics;
+  MpcConfig::Integrator integrator;
+  // Whether the cost ends with the LQR cost-to-go of the last stage, see
+  // MpcConfig::terminalCost, its factor U among the parameters.
+  bool terminal_cost;
+
+  // The lateral errors scaled by U, whose square norm is the cost-to-go.
+  void TerminalErrors(const ADvector& params, const AD<double>& cte_T,
+                      const AD<double>& epsi_T, AD<double>& r0,
+                      AD<double>& r1) const {
+    const AD<double>* u = &params[terminal_param()];
+    r0 = u[0] * cte_T + u[1] * epsi_T;
+    r1 = u[2] * epsi_T;
+  }
 
-    // The part of the cost based on the reference state.
-    for (int t = 0; t < N; t++) {
-      fg[0] += LAMBDA_CTE * CppAD::pow(vars[cte_start + t], 2);
-      fg[0] += LAMBDA_EPSI * CppAD::pow(vars[epsi_start + t], 2);
-      // mainly penalize exeed speed limit 
-      fg[0] += LAMBDA_V * CppAD::pow(vars[v_start + t] - REF_V, 2);
+  // The step of dt from stage (x0, y0, psi0, v0, epsi0) by forward Euler,
+  // the midpoint rule, RK4 or exactly, on the model's rates. cte and epsi
+  // start over from the path at x0, and only their change over the step is
+  // integrated. A model without an exact step takes RK4 for it.
+  void Integrate(ADvector& next, const ADvector& coeffs,
+                 const AD<double>& x0, const AD<double>& y0,
+                 const AD<double>& psi0, const AD<double>& v0,
+                 const AD<double>& epsi0, const AD<double>& delta0,
+                 const AD<double>& a0, double dt) const {
+    AD<double> z[6] = {x0, y0, psi0, v0, 0, epsi0};
+    AD<double> u[2] = {delta0, a0};
+    AD<double> end[6];
+    if (integrator != MpcConfig::EXACT || !model.ExactStep(z, u, dt, end)) {
+      // Where each slope is taken, as a fraction of dt from the start, and
+      // the weights of the slopes.
+      static const double euler_at[1] = {0};
+      static const double euler_weight[1] = {1};
+      static const double midpoint_at[2] = {0, 0.5};
+      static const double midpoint_weight[2] = {0, 1};
+      static const double rk4_at[4] = {0, 0.5, 0.5, 1};
+      static const double rk4_weight[4] = {1. / 6, 1. / 3, 1. / 3, 1. / 6};
+      const size_t stages = integrator == MpcConfig::EULER      ? 1
+                            : integrator == MpcConfig::MIDPOINT ? 2
+                                                                : 4;
+      const double* at =
+          stages == 1 ? euler_at : stages == 2 ? midpoint_at : rk4_at;
+      const double* weight = stages == 1   ? euler_weight
+                             : stages == 2 ? midpoint_weight
+                                           : rk4_weight;
+      AD<double> k[6];
+      AD<double> zk[6];
+      for (size_t i = 0; i < 6; i++) {
+        end[i] = z[i];
+      }
+      for (size_t j = 0; j < stages; j++) {
+        for (size_t i = 0; i < 6; i++) {
+          zk[i] = j == 0 ? z[i] : z[i] + at[j] * dt * k[i];
+        }
+        model.Rates(zk, u, k);
+        for (size_t i = 0; i < 6; i++) {
+          if (weight[j] != 0) {
+            end[i] += weight[j] * dt * k[i];
+          }
+        }
+      }
     }
+    AD<double> f0 = PolyEval<3>(coeffs, x0);
+    AD<double> psides0 = CppAD::atan(PolyEval<3, 1>(coeffs, x0));
+    for (size_t i = 0; i < 4; i++) {
+      next[i] = end[i];
+    }
+    next[4] = (f0 - y0) + end[4];
+    next[5] = (psi0 - psides0) + (end[5] - epsi0);
+  }
 
-    // Minimize the use of actuators.
-    for (int t = 0; t < N - 1; t++) {
-      fg[0] += LAMBDA_DELTA * CppAD::pow(vars[delta_start + t], 2);
-      fg[0] += LAMBDA_A * CppAD::pow(vars[a_start + t], 2);
+  // The cost is the sum of the squares of these: the Cost's terms of each
+  // stage's state, of the actuations and of the gaps between sequential
+  // ones (between blocks, within which they are held), then the terminal
+  // cost's and the slacks'. cte_t and epsi_t are the errors of each stage,
+  // variables or expressions.
+  void residuals(ADvector& r, const ADvector& vars, const ADvector& params,
+                 const ADvector& cte_t, const ADvector& epsi_t) const {
+    const TapedCost cost(&params[cost_param()]);
+    size_t i = 0;
+    AD<double> terms[TapedCost::STATE_TERMS + TapedCost::INPUT_TERMS +
+                     TapedCost::RATE_TERMS];
+    for (size_t t = 0; t < N; t++) {
+      cost.StateResiduals(cte_t[t], epsi_t[t], vars[v(t)], terms);
+      for (size_t k = 0; k < TapedCost::STATE_TERMS; k++) {
+        r[i++] = terms[k];
+      }
+    }
+    for (size_t t = 0; t + 1 < N; t++) {
+      cost.InputResiduals(vars[delta(t)], vars[a(t)], terms);
+      for (size_t k = 0; k < TapedCost::INPUT_TERMS; k++) {
+        r[i++] = terms[k];
+      }
+    }
+    for (size_t t = 0; t + 2 < N; t++) {
+      if (block[t + 1] == block[t]) {
+        continue;
+      }
+      cost.RateResiduals(vars[delta(t + 1)] - vars[delta(t)],
+                         vars[a(t + 1)] - vars[a(t)], terms);
+      for (size_t k = 0; k < TapedCost::RATE_TERMS; k++) {
+        r[i++] = terms[k];
+      }
     }
+    if (terminal_cost) {
+      TerminalErrors(params, cte_t[N - 1], epsi_t[N - 1], r[i], r[i + 1]);
+      r[i + 2] =
+          params[terminal_param() + 3] * (vars[v(N - 1)] - cost.ref_v);
+      i += 3;
+    }
+    for (size_t k = 0; k < n_slacks; k++) {
+      r[i++] = params[slack_param() + 1] * vars[terminal_slack() + k];
+    }
+  }
 
-    // Minimize the value gap between sequential actuations.
-    for (int t = 0; t < N - 2; t++) {
-      fg[0] += LAMBDA_DELTA_DIFF * CppAD::pow(vars[delta_start + t + 1] - vars[delta_start + t], 2);
-      fg[0] += LAMBDA_A_DIFF * CppAD::pow(vars[a_start + t + 1] - vars[a_start + t], 2);
+  // The same with the errors taken from the variables, so functions of them
+  // and the parameters alone, for the Gauss-Newton Hessian; not with
+  // derived_errors.
+  void residuals(ADvector& r, const ADvector& vars,
+                 const ADvector& params) const {
+    ADvector cte_t(N);
+    ADvector epsi_t(N);
+    for (size_t t = 0; t < N; t++) {
+      cte_t[t] = vars[cte(t)];
+      epsi_t[t] = vars[epsi(t)];
+    }
+    residuals(r, vars, params, cte_t, epsi_t);
+  }
+
+  void operator()(ADvector& fg, const ADvector& vars, const ADvector& params) {
+    // vars: [x0, ..., x_t-1, y0, ..., psi0, ..., v0, ..., cte0, ..., epsi0, ...]
+    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
+    // `params` are the fitted polynomial coefficients and the initial state.
+    // They are dynamic parameters, so this is only evaluated once, to record
+    // the tape.
+    ADvector coeffs(n_coeffs);
+    for (size_t i = 0; i < n_coeffs; i++) {
+      coeffs[i] = params[i];
+    }
+
+    // The errors of each stage: the variables, or with derived_errors the
+    // initial state's, then filled in by the dynamics below.
+    ADvector cte_t(N);
+    ADvector epsi_t(N);
+    if (derived_errors) {
+      cte_t[0] = params[n_coeffs + 4];
+      epsi_t[0] = params[n_coeffs + 5];
+    } else {
+      for (size_t t = 0; t < N; t++) {
+        cte_t[t] = vars[cte(t)];
+        epsi_t[t] = vars[epsi(t)];
+      }
     }
 
     // Setup Constraints
 
-    // Initial constraints
+    // Initial constraints, unless the initial state is held by bounds.
     // We add 1 to each of the starting indices due to cost being located at index 0 of `fg`.
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    fg[1 + cte_start] = vars[cte_start];
-    fg[1 + epsi_start] = vars[epsi_start];
+    if (!initial_bounds) {
+      for (size_t i = 0; i < n_states; i++) {
+        fg[1 + constraint(i, 0)] = vars[state(i, 0)] - params[n_coeffs + i];
+      }
+    }
 
     // The rest of the constraints
-    for (int t = 1; t < N; t++) {
+    ADvector next(BicycleAtomic::RESULTS);
+    ADvector u(BicycleAtomic::ARGUMENTS);
+    for (size_t i = 0; i < n_coeffs; i++) {
+      u[BicycleAtomic::C0 + i] = coeffs[i];
+    }
+    u[BicycleAtomic::LF] = Lf;
+    for (size_t t = 1; t < N; t++) {
+      const double dt = this->dt[t - 1];
+
       // The state at time t+1 .
-      AD<double> x1 = vars[x_start + t];
-      AD<double> y1 = vars[y_start + t];
-      AD<double> psi1 = vars[psi_start + t];
-      AD<double> v1 = vars[v_start + t];
-      AD<double> cte1 = vars[cte_start + t];
-      AD<double> epsi1 = vars[epsi_start + t];
+      AD<double> x1 = vars[x(t)];
+      AD<double> y1 = vars[y(t)];
+      AD<double> psi1 = vars[psi(t)];
+      AD<double> v1 = vars[v(t)];
 
       // The state at time t.
-      AD<double> x0 = vars[x_start + t - 1];
-      AD<double> y0 = vars[y_start + t - 1];
-      AD<double> psi0 = vars[psi_start + t - 1];
-      AD<double> v0 = vars[v_start + t - 1];
-      AD<double> cte0 = vars[cte_start + t - 1];
-      AD<double> epsi0 = vars[epsi_start + t - 1];
+      AD<double> x0 = vars[x(t - 1)];
+      AD<double> y0 = vars[y(t - 1)];
+      AD<double> psi0 = vars[psi(t - 1)];
+      AD<double> v0 = vars[v(t - 1)];
+      AD<double> epsi0 = epsi_t[t - 1];
 
       // Only consider the actuation at time t.
-      AD<double> delta0 = vars[delta_start + t - 1];
-      AD<double> a0 = vars[a_start + t - 1];
-
-      AD<double> f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * x0 * x0 + coeffs[3] * x0 * x0 * x0;
-      AD<double> psides0 = CppAD::atan(coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * x0 * x0);
+      AD<double> delta0 = vars[delta(t - 1)];
+      AD<double> a0 = vars[a(t - 1)];
 
       // Here's `x` to get you started.
       // The idea here is to constraint this value to be 0.
       //
-      // Recall the equations for the model:
+      // Recall the equations for the kinematic model, under Euler:
       // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
       // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
       // psi_[t+1] = psi[t] + v[t] / Lf * delta[t] * dt
       // v_[t+1] = v[t] + a[t] * dt
       // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
       // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
-      fg[1 + x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
-      fg[1 + y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
-      fg[1 + psi_start + t] = psi1 - (psi0 + v0 * delta0 / Lf * dt);
-      fg[1 + v_start + t] = v1 - (v0 + a0 * dt);
-      fg[1 + cte_start + t] =
-          cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * dt));
-      fg[1 + epsi_start + t] =
-          epsi1 - ((psi0 - psides0) + v0 * delta0 / Lf * dt);
+      if (atomic_dynamics) {
+        // The same step as one operation on the tape, see BicycleAtomic.
+        u[BicycleAtomic::X] = x0;
+        u[BicycleAtomic::Y] = y0;
+        u[BicycleAtomic::PSI] = psi0;
+        u[BicycleAtomic::V] = v0;
+        u[BicycleAtomic::EPSI] = epsi0;
+        u[BicycleAtomic::DELTA] = delta0;
+        u[BicycleAtomic::A] = a0;
+        u[BicycleAtomic::DT] = dt;
+        BicycleAtomic::Instance()(u, next);
+      } else {
+        Integrate(next, coeffs, x0, y0, psi0, v0, epsi0, delta0, a0, dt);
+      }
+      fg[1 + constraint(0, t)] = x1 - next[0];
+      fg[1 + constraint(1, t)] = y1 - next[1];
+      fg[1 + constraint(2, t)] = psi1 - next[2];
+      fg[1 + constraint(3, t)] = v1 - next[3];
+      if (derived_errors) {
+        cte_t[t] = next[4];
+        epsi_t[t] = next[5];
+      } else {
+        fg[1 + constraint(4, t)] = cte_t[t] - next[4];
+        fg[1 + constraint(5, t)] = epsi_t[t] - next[5];
+      }
+    }
+
+    // The cost is stored is the first element of `fg`: the reference state,
+    // the use of actuators and the value gap between sequential actuations,
+    // see residuals().
+    ADvector r(n_residuals);
+    residuals(r, vars, params, cte_t, epsi_t);
+    fg[0] = 0;
+    for (size_t i = 0; i < n_residuals; i++) {
+      fg[0] += r[i] * r[i];
+    }
+
+    // The linear part of the slacks' price, which the Gauss-Newton
+    // residuals leave out as it has no curvature.
+    for (size_t k = 0; k < n_slacks; k++) {
+      fg[0] += params[slack_param()] * vars[terminal_slack() + k];
+    }
+
+    // The state constraints, less their slacks when soft: the last stage's
+    // errors within the level set of the cost-to-go, cte in the corridor,
+    // the speed under the limit and the position outside the obstacles'
+    // discs.
+    if (terminal_region) {
+      AD<double> r0;
+      AD<double> r1;
+      TerminalErrors(params, cte_t[N - 1], epsi_t[N - 1], r0, r1);
+      fg[1 + terminal()] = r0 * r0 + r1 * r1;
+      if (soft) {
+        fg[1 + terminal()] -= vars[terminal_slack()];
+      }
+    }
+    for (size_t t = 1; t < N; t++) {
+      if (corridor) {
+        AD<double> slack = soft ? vars[corridor_slack(t)] : AD<double>(0);
+        fg[1 + corridor_constraint(0, t)] = cte_t[t] - slack;
+        fg[1 + corridor_constraint(1, t)] = cte_t[t] + slack;
+      }
+      if (speed_limit) {
+        fg[1 + speed_constraint(t)] = vars[v(t)];
+        if (soft) {
+          fg[1 + speed_constraint(t)] -= vars[speed_slack(t)];
+        }
+      }
+      for (size_t j = 0; j < obstacles; j++) {
+        size_t p = obstacle_param(j, t);
+        AD<double> dx = vars[x(t)] - params[p];
+        AD<double> dy = vars[y(t)] - params[p + 1];
+        fg[1 + obstacle_constraint(j, t)] = dx * dx + dy * dy - params[p + 2];
+        if (soft) {
+          fg[1 + obstacle_constraint(j, t)] += vars[obstacle_slack(j, t)];
+        }
+      }
     }
   }
 };
 
+typedef CPPAD_TESTVECTOR(double) Dvector;
+
+// Move state variable i, or actuation j, one stage earlier, repeating the
+// last stage.
+static void ShiftState(Dvector& v, const Layout& L, size_t i) {
+  for (size_t t = 0; t + 1 < L.N; t++) {
+    v[L.state(i, t)] = v[L.state(i, t + 1)];
+  }
+}
+
+// Within move blocks, each block takes the actuation the stage after it had.
+static void ShiftInput(Dvector& v, const Layout& L, size_t j) {
+  for (size_t t = 0; t + 2 < L.N; t++) {
+    v[L.input(j, t)] = v[L.input(j, t + 1)];
+  }
+}
+
+// Move the trajectory in vars rigidly, in (x, y, psi), so that stage `from`
+// lands on the new initial state. The previous trajectory is expressed in the
+// old vehicle frame.
+static void AnchorSolution(Dvector& vars, const State& state,
+                           const Layout& L, size_t from) {
+  double dx = state[0] - vars[L.x(from)];
+  double dy = state[1] - vars[L.y(from)];
+  double dpsi = state[2] - vars[L.psi(from)];
+  double ox = vars[L.x(from)];
+  double oy = vars[L.y(from)];
+  double c = cos(dpsi);
+  double s = sin(dpsi);
+  for (size_t t = from; t < L.N; t++) {
+    double rx = vars[L.x(t)] - ox;
+    double ry = vars[L.y(t)] - oy;
+    vars[L.x(t)] = ox + dx + c * rx - s * ry;
+    vars[L.y(t)] = oy + dy + s * rx + c * ry;
+    vars[L.psi(t)] += dpsi;
+  }
+}
+
+// Whether the car is far from where the last solution in x had it a stage
+// on, as when it was put back on the track or frames were lost: by speed
+// and the errors, which a new vehicle frame doesn't change.
+static bool Jumped(const Dvector& x, const State& state, const Layout& L) {
+  static const double SPEED = 5;
+  static const double CTE = 1;
+  static const double EPSI = 0.3;
+  return std::abs(x[L.v(1)] - state[3]) > SPEED ||
+         std::abs(x[L.cte(1)] - state[4]) > CTE ||
+         std::abs(x[L.epsi(1)] - state[5]) > EPSI;
+}
+
+// The per-stage slacks of soft state constraints, or their bound
+// multipliers; the terminal region's stays.
+static void ShiftSlacks(Dvector& v, const Layout& L) {
+  if (!L.soft) {
+    return;
+  }
+  for (size_t t = 1; t + 1 < L.N; t++) {
+    if (L.corridor) {
+      v[L.corridor_slack(t)] = v[L.corridor_slack(t + 1)];
+    }
+    if (L.speed_limit) {
+      v[L.speed_slack(t)] = v[L.speed_slack(t + 1)];
+    }
+    for (size_t j = 0; j < L.obstacles; j++) {
+      v[L.obstacle_slack(j, t)] = v[L.obstacle_slack(j, t + 1)];
+    }
+  }
+}
+
+// Advance the previous solution one stage along the horizon so that it can
+// seed the next solve, starting at the new initial state.
+static void ShiftSolution(Dvector& vars, const State& state,
+                          const Layout& L) {
+  AnchorSolution(vars, state, L, 1);
+  for (size_t i = 0; i < L.n_states; i++) {
+    ShiftState(vars, L, i);
+  }
+  ShiftInput(vars, L, 0);
+  ShiftInput(vars, L, 1);
+  ShiftSlacks(vars, L);
+}
+
+// The bound multipliers z_L or z_U of the same: only the actuations and the
+// slacks have finite bounds, but for stage 0's with initial_bounds, which
+// Ipopt takes out of the problem.
+static void ShiftBoundMultipliers(Dvector& z, const Layout& L) {
+  ShiftInput(z, L, 0);
+  ShiftInput(z, L, 1);
+  ShiftSlacks(z, L);
+}
+
+// Constraint multipliers have a row per state variable and constrained
+// stage, and per state constraint and stage from 1.
+static void ShiftMultipliers(Dvector& lambda, const Layout& L) {
+  for (size_t i = 0; i < L.n_states; i++) {
+    for (size_t t = L.first; t + 1 < L.N; t++) {
+      lambda[L.constraint(i, t)] = lambda[L.constraint(i, t + 1)];
+    }
+  }
+  for (size_t t = 1; t + 1 < L.N; t++) {
+    if (L.corridor) {
+      for (size_t side = 0; side < 2; side++) {
+        lambda[L.corridor_constraint(side, t)] =
+            lambda[L.corridor_constraint(side, t + 1)];
+      }
+    }
+    if (L.speed_limit) {
+      lambda[L.speed_constraint(t)] = lambda[L.speed_constraint(t + 1)];
+    }
+    // The slots are refilled each frame nearest first, so that slot j of a
+    // stage mostly keeps the disc it had a stage later.
+    for (size_t j = 0; j < L.obstacles; j++) {
+      lambda[L.obstacle_constraint(j, t)] =
+          lambda[L.obstacle_constraint(j, t + 1)];
+    }
+  }
+}
+
+// Whether config asks for anything only the tape has, beyond the layouts,
+// the models and the integrators, which AutoDiffNLP has too.
+static bool TapeOnlyProblem(const MpcConfig& config) {
+  return !config.stageDt.empty() || config.terminalCost ||
+         config.terminalRegion > 0 || config.cteLimit > 0 ||
+         config.speedLimit > 0 || config.obstacleSlots > 0;
+}
+
+// The same for KinematicNLP, which has the kinematic model on EULER only.
+static bool TapeOnly(const MpcConfig& config) {
+  return TapeOnlyProblem(config) || config.integrator != MpcConfig::EULER ||
+         config.model != MpcConfig::KINEMATIC;
+}
+
+// User scaling: variables, their constraints and the cost divided by their
+// typical magnitudes, from the physical units and the bounds. Positions go
+// up to the lookahead, speeds to refV, angles to a fraction of a radian and
+// the actuations to their limits, and the cost is its value with each term
+// at its typical magnitude, so that all of them come out of order 1.
+static void ScaleProblem(MPC_NLP& nlp, const MpcConfig& config,
+                         const Layout& L, double dt) {
+  const size_t N = L.N;
+  const double lookahead = std::max(1., config.refV * dt * (N - 1));
+  const double cte = config.cteLimit > 0 ? config.cteLimit : 1;
+  const double reach = std::max(1., config.obstacleReach);
+  const double typical[6] = {lookahead, lookahead, 0.5,
+                             std::max(1., config.refV), cte, 0.5};
+  for (size_t t = 0; t < N; t++) {
+    for (size_t i = 0; i < L.n_states; i++) {
+      nlp.x_scaling[L.state(i, t)] = 1 / typical[i];
+      if (t >= L.first) {
+        nlp.g_scaling[L.constraint(i, t)] = 1 / typical[i];
+      }
+    }
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    nlp.x_scaling[L.delta(t)] = 1 / MAX_DELTA;
+    nlp.x_scaling[L.a(t)] = 1 / MAX_A;
+  }
+  if (L.terminal_region) {
+    nlp.g_scaling[L.terminal()] = 1 / config.terminalRegion;
+    if (L.soft) {
+      nlp.x_scaling[L.terminal_slack()] = 1 / config.terminalRegion;
+    }
+  }
+  for (size_t t = 1; t < N; t++) {
+    if (L.corridor) {
+      nlp.g_scaling[L.corridor_constraint(0, t)] = 1 / config.cteLimit;
+      nlp.g_scaling[L.corridor_constraint(1, t)] = 1 / config.cteLimit;
+      if (L.soft) {
+        nlp.x_scaling[L.corridor_slack(t)] = 1 / config.cteLimit;
+      }
+    }
+    if (L.speed_limit) {
+      nlp.g_scaling[L.speed_constraint(t)] = 1 / config.speedLimit;
+      if (L.soft) {
+        nlp.x_scaling[L.speed_slack(t)] = 1 / config.speedLimit;
+      }
+    }
+    // Squared distances, out to the reach.
+    for (size_t j = 0; j < L.obstacles; j++) {
+      nlp.g_scaling[L.obstacle_constraint(j, t)] = 1 / (reach * reach);
+      if (L.soft) {
+        nlp.x_scaling[L.obstacle_slack(j, t)] = 1 / (reach * reach);
+      }
+    }
+  }
+
+  const KinematicWeights& w = config.weights;
+  const double v = 0.1 * typical[3];
+  double cost = N * (w.cte * cte * cte + w.epsi * typical[5] * typical[5] +
+                     w.v * v * v) +
+                (N - 1) * (w.delta * MAX_DELTA * MAX_DELTA +
+                           w.a * MAX_A * MAX_A);
+  nlp.obj_scaling = 1 / std::max(1., cost);
+}
+
+// Compare the derivatives of KinematicNLP or AutoDiffNLP against the tape
+// at an arbitrary, curved point, the tape on the cost's parameters.
+static double CheckKinematic(KinematicNLPBase& nlp, const Layout& L,
+                             const Dvector& cost_params) {
+  Dvector params(L.n_params);
+  double coeffs[n_coeffs] = {0.5, 0.1, -0.02, 0.003};
+  for (size_t i = 0; i < n_coeffs; i++) {
+    params[i] = coeffs[i];
+  }
+  for (size_t i = 0; i < 6; i++) {
+    params[n_coeffs + i] = 0.1 * i;
+  }
+  for (size_t i = 0; i < n_cost_params; i++) {
+    params[L.cost_param() + i] = cost_params[i];
+  }
+  nlp.SetParameters(params);
+
+  Dvector x(L.n_vars);
+  Dvector lambda(L.n_constraints);
+  for (size_t i = 0; i < L.n_vars; i++) {
+    x[i] = 1 + 0.5 * sin(double(i));
+  }
+  for (size_t i = 0; i < L.n_constraints; i++) {
+    lambda[i] = cos(double(i));
+  }
+  return nlp.CheckDerivatives(x, 0.7, lambda);
+}
+
+// Whether Ipopt solves with `solver` can run at the same time. The HSL
+// solvers keep all their state in the arguments; MUMPS has globals, and
+// Pardiso is left serialized for want of a guarantee.
+static bool Reentrant(MpcConfig::LinearSolver solver) {
+  return solver != MpcConfig::MUMPS && solver != MpcConfig::PARDISO;
+}
+
+// Held across Ipopt solves when MPC::serializeIpopt is set.
+static std::mutex ipopt_mutex;
+
 //
 // MPC class definition implementation.
 //
-MPC::MPC() {}
-MPC::~MPC() {}
+MPC::MPC(const MpcConfig& config, bool analyticDerivatives)
+    : warmStart(true), warmStartDuals(false), warmStartMu(1e-4),
+      method(IPOPT),
+      ltvFormulation(LTVMPC::SPARSE), fallback(true), usedFallback(false),
+      sensitivity(false), usedPrediction(false), solveEvery(1),
+      framePeriod(0), usedPlan(false), eventTriggered(false),
+      forcedSolve(false), keepControls(false), usedCache(false),
+      cacheSeeded(false),
+      trackPosition(-1), trackSeeded(false), obstacles(nullptr), worldX(0),
+      worldY(0), worldPsi(0), usedTable(false), primitiveSeeded(false),
+      policyCheckEvery(20), policyError(0), checkedPolicy(false),
+      anytime(false), abortHopeless(false), raceWinner(-1), start(WARM_START),
+      polishIterations(10), lowestCost(false),
+      adaptiveHorizon(false), scheduler(config.horizons),
+      degrade(false), ladderStep(false), predictTier(false), hostLoad(0),
+      energyMode(false), energyMeter(nullptr), energyStep(false),
+      hybridLqr(false),
+      usedFastPath(false),
+      speculative(false),
+      serializeIpopt(!Reentrant(config.linearSolver)), batchThreads(0),
+      laneBatch(false),
+      config_(config),
+      stages_(config.stageThreads > 1 ? new StagePool(config.stageThreads)
+                                      : nullptr),
+      current_(0), active_(IPOPT), stats_(),
+      tier_(DegradationLadder::NUM_TIERS), predicted_seconds_(-1),
+      last_iterations_(0),
+      problem_(std::make_shared<ProblemIR>(config, config.dt)),
+      rti_(config.N, config.dt, config.Lf, config.refV, config.weights),
+      ltv_(config.N, problem_),
+      lqr_(config.N, config.dt, config.Lf, config.refV, config.weights),
+      mppi_(config.N, *problem_, config.Lf,
+            {config.mppiEngine, config.mppiSamples, config.mppiThreads,
+             config.mppiLambda, config.mppiSigmaDelta, config.mppiSigmaA}),
+      robust_(config.N, config.dt, config.refV, config.weights,
+              config.scenarios, config.scenarioThreads),
+      params_(n_params), sensitivity_index_(0), factor_pending_(false),
+      warming_(false), predict_params_(n_params), plan_stages_(0),
+      plan_frames_(0), plan_fresh_(false),
+      race_stop_(false), cancel_(nullptr), policy_frames_(0) {
+  // About what the car drifts from a plan in a frame of steady driving;
+  // bench/event_trigger measures the solves they save.
+  trigger.cte = 0.1;
+  trigger.epsi = 0.02;
+  trigger.v = 1;
+  trigger.curvature = 0.002;
+  trigger.maxFrames = 5;
 
-/* 
- * @param: state: [x, y, psi, v ,cte, epsi]
- */ 
-vector<double> MPC::Solve(
-    Eigen::VectorXd state, Eigen::VectorXd coeffs,
-    std::vector<double> & mpc_x_vals, std::vector<double> & mpc_y_vals) {
-  bool ok = true;
-  // size_t i;
-  typedef CPPAD_TESTVECTOR(double) Dvector;
+  // Every shape is built up front, so that the scheduler can switch between
+  // them without recording a tape or allocating a solver mid-drive.
+  size_t longest = std::max(config.N, config.shortHorizon.N);
+  for (size_t i = 0; i < scheduler.candidates().size(); i++) {
+    Horizon horizon = scheduler.candidates()[i];
+    problems_.push_back(NewProblem(config, horizon.N, horizon.dt,
+                                   analyticDerivatives, stages_));
+    longest = std::max(longest, horizon.N);
+  }
+  short_index_ = problems_.size();
+  problems_.push_back(NewProblem(config, config.shortHorizon.N,
+                                 config.shortHorizon.dt, analyticDerivatives,
+                                 stages_));
+  rti_.fixedSweeps = config.fixedIterations;
+  ltv_.fixedIterations = config.fixedIterations;
+  trajectory_x_.reserve(longest);
+  trajectory_y_.reserve(longest);
+  seed_x_.reserve(config.N);
+  seed_y_.reserve(config.N);
+  plan_u_.resize(2, longest - 1);
+  plan_x_.resize(6, longest);
+  plan_t_.resize(longest);
+  if (config.cacheEntries > 0) {
+    size_t width = 0;
+    for (const Problem& problem : problems_) {
+      width = std::max(width, problem.layout->n_vars);
+    }
+    cache_.reset(new SolutionCache(config.cacheEntries, width, longest,
+                                   config.cacheTolerance));
+  }
+}
+
+bool MPC::LoadWarmStarts(const std::string& path, double length,
+                         double bin) {
+  warm_starts_.reset(
+      new TrackWarmStarts(length, bin, problems_[0].layout->n_vars));
+  return warm_starts_->Load(path);
+}
+
+bool MPC::SaveWarmStarts(const std::string& path) {
+  return warm_starts_ && warm_starts_->filled() > 0 &&
+         warm_starts_->Save(path);
+}
+
+void MPC::Checkpoint(CheckpointWriter& out) const {
+  const Problem& problem = problems_[current_];
+  const MPC_NLP* nlp = GetRawPtr(problem.nlp);
+  size_t n = problem.has_solution ? problem.layout->n_vars : 0;
+  size_t m = problem.has_solution ? problem.layout->n_constraints : 0;
+  out.Count(current_);
+  out.Count(problem.speculated);
+  out.Doubles(nlp->x, n);
+  out.Doubles(nlp->z_l, n);
+  out.Doubles(nlp->z_u, n);
+  out.Doubles(nlp->lambda, m);
+  scheduler.Checkpoint(out);
+  ladder.Checkpoint(out);
+}
+
+bool MPC::Restore(CheckpointReader& in) {
+  size_t index;
+  size_t speculated;
+  std::vector<double> x;
+  std::vector<double> z_l;
+  std::vector<double> z_u;
+  std::vector<double> lambda;
+  if (!in.Count(index) || !in.Count(speculated) || !in.Doubles(x) ||
+      !in.Doubles(z_l) || !in.Doubles(z_u) || !in.Doubles(lambda) ||
+      !scheduler.Restore(in) || !ladder.Restore(in)) {
+    return false;
+  }
+  // Without a solution, or with one of another tuning's problems, the next
+  // Solve starts cold as it would have.
+  if (x.empty() || index >= problems_.size()) {
+    return true;
+  }
+  Problem& problem = problems_[index];
+  const Layout& L = *problem.layout;
+  if (x.size() != L.n_vars || z_l.size() != L.n_vars ||
+      z_u.size() != L.n_vars || lambda.size() != L.n_constraints) {
+    return true;
+  }
+  MPC_NLP* nlp = GetRawPtr(problem.nlp);
+  for (size_t i = 0; i < L.n_vars; i++) {
+    nlp->x[i] = x[i];
+    nlp->z_l[i] = z_l[i];
+    nlp->z_u[i] = z_u[i];
+  }
+  for (size_t i = 0; i < L.n_constraints; i++) {
+    nlp->lambda[i] = lambda[i];
+  }
+  problem.has_solution = true;
+  problem.speculated = speculated != 0;
+  current_ = index;
+  return true;
+}
+
+bool MPC::LoadControlTable(const std::string& path) {
+  std::unique_ptr<ControlTable> table(new ControlTable());
+  if (!table->Load(path)) {
+    return false;
+  }
+  const ControlTable::Model& model = table->model();
+  if (model.N != config_.N || model.dt != config_.dt ||
+      model.Lf != config_.Lf || model.refV != config_.refV) {
+    return false;
+  }
+  table_ = std::move(table);
+  return true;
+}
+
+bool MPC::LoadPrimitives(const std::string& path) {
+  std::unique_ptr<MotionPrimitives> primitives(new MotionPrimitives());
+  if (!primitives->Load(path)) {
+    return false;
+  }
+  const ControlTable::Model& model = primitives->model();
+  if (model.N != config_.N || model.dt != config_.dt ||
+      model.Lf != config_.Lf || model.refV != config_.refV ||
+      primitives->width() != variables()) {
+    return false;
+  }
+  primitives_ = std::move(primitives);
+  return true;
+}
+
+size_t MPC::variables() const { return problems_[0].layout->n_vars; }
+
+bool MPC::Solution(std::vector<double>& x) const {
+  const Problem& problem = problems_[0];
+  if (current_ != 0 || !problem.has_solution) {
+    return false;
+  }
+  const MPC_NLP* nlp = GetRawPtr(problem.nlp);
+  x.assign(&nlp->x[0], &nlp->x[0] + problem.layout->n_vars);
+  return true;
+}
+
+void MPC::AddRival(const MpcConfig& config, bool warmStart) {
+  // Each rival is built, solves and is destroyed on a thread of its own,
+  // for its tapes and CppAD's per-thread allocator, see SetupThreads.
+  std::unique_ptr<WorkerPool> worker(new WorkerPool(1));
+  std::promise<MPC*> built;
+  worker->Submit(0, [&] { built.set_value(new MPC(config)); });
+  MPC* rival = built.get_future().get();
+  rival->warmStart = warmStart;
+  rival->anytime = anytime;
+  rival->abortHopeless = abortHopeless;
+  rival->polishIterations = polishIterations;
+  // The leader falls back for the race as a whole.
+  rival->fallback = false;
+  rival->cancel_ = &race_stop_;
+  rivals_.emplace_back(rival);
+  race_workers_.push_back(std::move(worker));
+  size_t longest = std::max(config.N, config.shortHorizon.N);
+  for (const Horizon& horizon : config.horizons) {
+    longest = std::max(longest, horizon.N);
+  }
+  rival_x_.emplace_back(longest);
+  rival_y_.emplace_back(longest);
+  rival_answers_.resize(rivals_.size());
+}
+
+void MPC::AddStart(Start start) {
+  AddRival(config_, false);
+  rivals_.back()->start = start;
+}
+
+Input MPC::Race(size_t index, const State& state, const Cubic& coeffs,
+                std::vector<double>& mpc_x_vals,
+                std::vector<double>& mpc_y_vals,
+                std::chrono::steady_clock::time_point deadline) {
+  std::atomic<int> winner(-1);
+  race_stop_.store(false);
+  cancel_ = &race_stop_;
+  race_pending_ = rivals_.size();
+  auto finish = [&](int i, bool converged) {
+    int none = -1;
+    if (converged && !lowestCost &&
+        winner.compare_exchange_strong(none, i)) {
+      race_stop_.store(true, std::memory_order_relaxed);
+    }
+  };
+  for (size_t i = 0; i < rivals_.size(); i++) {
+    race_workers_[i]->Submit(0, [&, i] {
+      MPC& rival = *rivals_[i];
+      Result& answer = rival_answers_[i];
+      answer = {0, 0, rival_x_[i].data(), rival_y_[i].data(),
+                rival_x_[i].size(), 0};
+      rival.obstacles = obstacles;
+      rival.worldX = worldX;
+      rival.worldY = worldY;
+      rival.worldPsi = worldPsi;
+      rival.Solve(state, coeffs, answer, deadline);
+      finish(int(i + 1), rival.stats().status == CONVERGED);
+      std::lock_guard<std::mutex> lock(race_mutex_);
+      if (--race_pending_ == 0) {
+        race_done_.notify_one();
+      }
+    });
+  }
+  Input own = SolveIpopt(index, state, coeffs, mpc_x_vals, mpc_y_vals,
+                         deadline);
+  finish(0, stats_.status == CONVERGED);
+  {
+    std::unique_lock<std::mutex> lock(race_mutex_);
+    race_done_.wait(lock, [this] { return race_pending_ == 0; });
+  }
+  cancel_ = nullptr;
+  if (lowestCost) {
+    double lowest = stats_.status == CONVERGED
+                        ? stats_.cost
+                        : std::numeric_limits<double>::infinity();
+    winner = stats_.status == CONVERGED ? 0 : -1;
+    for (size_t i = 0; i < rivals_.size(); i++) {
+      const SolveStats& stats = rivals_[i]->stats();
+      if (stats.status == CONVERGED && stats.cost < lowest) {
+        lowest = stats.cost;
+        winner = int(i + 1);
+      }
+    }
+  }
+  raceWinner = std::max(winner.load(), 0);
+  if (raceWinner == 0) {
+    return own;
+  }
+  const MPC& rival = *rivals_[raceWinner - 1];
+  const Result& answer = rival_answers_[raceWinner - 1];
+  stats_ = rival.stats();
+  mpc_x_vals.assign(answer.x, answer.x + answer.size);
+  mpc_y_vals.assign(answer.y, answer.y + answer.size);
+  return Input(answer.delta, answer.a);
+}
 
-  // Set the number of model variables (includes both states and inputs).
-  // For example: If the state is a 4 element vector, the actuators is a 2
-  // element vector and there are 10 timesteps. The number of variables is:
-  // 4 * 10 + 2 * 9
-  size_t n_vars = 6 * N + 2 * (N - 1);
-  // Set the number of constraints
-  size_t n_constraints = 6 * N;
+bool MPC::LoadPolicy(const std::string& path) {
+  return policy_.Load(path);
+}
 
-  // Initial value of the independent variables: all 0 besides initial state.
-  Dvector vars(n_vars);
-  for (int i = 0; i < n_vars; i++) {
-    vars[i] = 0;
+// Record the problem of `model` and the tracking cost into `nlp`, with its
+// residuals for the Gauss-Newton Hessian if `residuals`.
+template <class Model>
+static void RecordProblem(MPC_NLP& nlp, const MpcConfig& config,
+                          const Layout& L, double dt, const Model& model,
+                          bool residuals) {
+  FG_eval<Model, BasicTrackingCost> fg_eval(config, L, dt, model);
+  nlp.Record(fg_eval, L.n_vars, L.n_constraints, L.n_params);
+  if (residuals) {
+    nlp.RecordResiduals(fg_eval, L.n_vars, fg_eval.n_residuals, L.n_params);
+  }
+}
+
+// The same for config's model.
+static void RecordProblem(MPC_NLP& nlp, const MpcConfig& config,
+                          const Layout& L, double dt, bool residuals) {
+  if (config.model == MpcConfig::DYNAMIC) {
+    RecordProblem(nlp, config, L, dt, DynamicModel(config.Lf, config.tires),
+                  residuals);
+  } else {
+    RecordProblem(nlp, config, L, dt, KinematicModel(config.Lf), residuals);
+  }
+}
+
+Ipopt::SmartPtr<MPC_NLP> MPC::RecordTape(const MpcConfig& config, size_t N,
+                                         double dt) {
+  Layout L(N, config, true);
+  Ipopt::SmartPtr<MPC_NLP> nlp = new MPC_NLP();
+  nlp->optimize_tape = config.optimizeTape;
+  nlp->pattern_cache = config.patternCache;
+  nlp->share_tapes = config.shareTapes;
+  RecordProblem(*nlp, config, L, dt,
+                config.hessian == MpcConfig::GAUSS_NEWTON);
+  return nlp;
+}
+
+MPC::Problem MPC::NewProblem(const MpcConfig& config, size_t N, double dt,
+                             bool analyticDerivatives,
+                             const std::shared_ptr<StagePool>& stages) {
+  Problem problem;
+  problem.horizon.N = N;
+  problem.horizon.dt = dt;
+  problem.app = new Ipopt::IpoptApplication();
+  problem.optimized = false;
+  problem.has_solution = false;
+  problem.speculated = false;
+  problem.cost_params.resize(n_cost_params);
+  CostParameters(config, dt, &problem.cost_params[0]);
+
+  // The operation sequence doesn't depend on the coefficients or the initial
+  // state, so the tape is recorded once here and reused by every Solve.
+  KinematicNLPBase* kinematic = NULL;
+  if (analyticDerivatives && !TapeOnly(config)) {
+    // Horizons without a specialization fall back to the tape, and so does
+    // everything KinematicNLP doesn't implement.
+    kinematic =
+        NewKinematicNLP(N, dt, config.Lf, config.refV, config.weights);
+  }
+  bool autoDiff = false;
+  if (kinematic == NULL && config.autoDiff && !TapeOnlyProblem(config)) {
+    // NULL for EXACT, which is left to the tape.
+    kinematic = NewAutoDiffNLP(config, N, dt);
+    autoDiff = kinematic != NULL;
+  }
+  problem.layout = std::make_shared<const Layout>(N, config, kinematic == NULL);
+  const Layout& L = *problem.layout;
+  if (kinematic != NULL) {
+    problem.nlp = kinematic;
+    problem.nlp->optimize_tape = config.optimizeTape;
+    problem.nlp->pattern_cache = config.patternCache;
+    problem.nlp->share_tapes = config.shareTapes;
+    // With the residuals when AutoDiffNLP's Hessian is Gauss-Newton, for
+    // CheckDerivatives to compare it with.
+    RecordProblem(*problem.nlp, config, L, dt,
+                  autoDiff && config.hessian == MpcConfig::GAUSS_NEWTON);
+    if (stages && N >= config.parallelStagesFrom) {
+      kinematic->SetStagePool(stages);
+    }
+  } else {
+    problem.nlp = RecordTape(config, N, dt);
   }
 
   // Set lower and upper limits for variables.
-  Dvector vars_lowerbound(n_vars);
-  Dvector vars_upperbound(n_vars);
-  
+  MPC_NLP* nlp = GetRawPtr(problem.nlp);
   // Set all non-actuators upper and lowerlimits
-  // to the max negative and positive values.
-  for (int i = 0; i < delta_start; i++) {
-    vars_lowerbound[i] = -1.0e19;
-    vars_upperbound[i] = 1.0e19;
+  // to the max negative and positive values. With initial_bounds Solve
+  // fixes stage 0 to each frame's state.
+  for (size_t i = 0; i < L.n_vars; i++) {
+    nlp->x_lowerbound[i] = -1.0e19;
+    nlp->x_upperbound[i] = 1.0e19;
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    // The upper and lower limits of delta are set to -25 and 25 degrees
+    // (values in radians).
+    nlp->x_lowerbound[L.delta(t)] = - 25. / 180 * PI;
+    nlp->x_upperbound[L.delta(t)] = 25. / 180 * PI;
+    // The upper and lower limits for acceleration
+    nlp->x_lowerbound[L.a(t)] = -1.;
+    nlp->x_upperbound[L.a(t)] = 1.;
+  }
+  // Lower and upper limits for the constraints
+  // All 0: the initial state enters the tape as a parameter.
+  for (size_t i = 0; i < L.n_constraints; i++) {
+    nlp->g_lowerbound[i] = 0;
+    nlp->g_upperbound[i] = 0;
+  }
+  // The state constraints are inequalities, and their slacks positive.
+  if (L.terminal_region) {
+    nlp->g_lowerbound[L.terminal()] = -1.0e19;
+    nlp->g_upperbound[L.terminal()] = config.terminalRegion;
+  }
+  for (size_t t = 1; t < N; t++) {
+    if (L.corridor) {
+      nlp->g_lowerbound[L.corridor_constraint(0, t)] = -1.0e19;
+      nlp->g_upperbound[L.corridor_constraint(0, t)] = config.cteLimit;
+      nlp->g_lowerbound[L.corridor_constraint(1, t)] = -config.cteLimit;
+      nlp->g_upperbound[L.corridor_constraint(1, t)] = 1.0e19;
+    }
+    if (L.speed_limit) {
+      nlp->g_lowerbound[L.speed_constraint(t)] = -1.0e19;
+      nlp->g_upperbound[L.speed_constraint(t)] = config.speedLimit;
+    }
+    // Switched off until a frame fills them, see PlaceObstacles.
+    for (size_t j = 0; j < L.obstacles; j++) {
+      nlp->g_lowerbound[L.obstacle_constraint(j, t)] = -1.0e19;
+      nlp->g_upperbound[L.obstacle_constraint(j, t)] = 1.0e19;
+    }
+  }
+  for (size_t i = 0; i < L.n_slacks; i++) {
+    nlp->x_lowerbound[L.terminal_slack() + i] = 0;
+  }
+  if (config.userScaling) {
+    ScaleProblem(*nlp, config, L, dt);
   }
 
-  // The upper and lower limits of delta are set to -25 and 25 degrees (values in radians).
-  for (int i = delta_start; i < a_start; i++) {
-    vars_lowerbound[i] = - 25. / 180 * PI;
-    vars_upperbound[i] = 25. / 180 * PI;
+  // options for IPOPT solver
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app = problem.app;
+  app->Options()->SetStringValue("sb", "yes");
+  // Set this higher if you'd like more print information
+  app->Options()->SetIntegerValue("print_level", 0);
+  // Only a backstop: Solve's deadline is enforced in wall-clock time by
+  // MPC_NLP::intermediate_callback.
+  app->Options()->SetNumericValue("max_cpu_time", 30);
+  // Only used when warm_start_init_point is switched on per frame.
+  app->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+  app->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+  app->Options()->SetStringValue("linear_solver",
+                                 LinearSolverName(config.linearSolver));
+  app->Options()->SetNumericValue("tol", config.tolerance);
+  app->Options()->SetNumericValue("acceptable_tol",
+                                  config.acceptableTolerance);
+  app->Options()->SetIntegerValue("acceptable_iter",
+                                  config.acceptableIterations);
+  app->Options()->SetStringValue("mu_strategy",
+                                 config.adaptiveMu ? "adaptive" : "monotone");
+  if (config.hessian == MpcConfig::LIMITED_MEMORY) {
+    app->Options()->SetStringValue("hessian_approximation", "limited-memory");
   }
+  if (config.userScaling) {
+    app->Options()->SetStringValue("nlp_scaling_method", "user-scaling");
+  }
+  app->Initialize();
+  if (config.nlpSolver == MpcConfig::INTERIOR_POINT &&
+      config.hessian != MpcConfig::LIMITED_MEMORY) {
+    problem.interior = std::make_shared<InteriorPoint>();
+    problem.interior->tol = config.tolerance;
+    problem.interior->fixedIterations = config.fixedIterations;
+  }
+  return problem;
+}
+MPC::~MPC() {
+  // The rivals go on the threads they solved on; then the workers join.
+  for (size_t i = 0; i < rivals_.size(); i++) {
+    MPC* rival = rivals_[i].release();
+    race_workers_[i]->Submit(0, [rival] { delete rival; });
+  }
+  race_workers_.clear();
+  for (size_t i = 0; i < batch_.size(); i++) {
+    MPC* solver = batch_[i].release();
+    batch_workers_->Submit(i, [solver] { delete solver; });
+  }
+  batch_workers_.reset();
+}
 
-  // The upper and lower limits for acceleration
-  for (int i = a_start; i < n_vars; i++) {
-    vars_lowerbound[i] = -1.;
-    vars_upperbound[i] = 1.;
+void MPC::SetupThreads(size_t threads, bool (*in_parallel)(),
+                       size_t (*thread_number)()) {
+  CppAD::thread_alloc::parallel_setup(threads, in_parallel, thread_number);
+  CppAD::thread_alloc::hold_memory(true);
+  CppAD::parallel_ad<double>();
+}
+
+// The thread numbers of SetupThreads(threads): which are taken, the one of
+// the thread that set up, and whether it has.
+static std::mutex numbers_mutex;
+static std::vector<bool> numbers_taken;
+static std::thread::id numbers_master;
+static std::atomic<bool> numbers_parallel(false);
+
+// No number: the thread's own, or none taken.
+static const size_t NO_NUMBER = std::numeric_limits<size_t>::max();
+
+// The lowest free number. 0 is the thread that set up's.
+static size_t TakeNumber() {
+  std::lock_guard<std::mutex> lock(numbers_mutex);
+  size_t number = 0;
+  while (number < numbers_taken.size() && numbers_taken[number]) {
+    number++;
   }
+  if (number == numbers_taken.size()) {
+    std::cerr << "MPC: more than " << numbers_taken.size()
+              << " threads and allocators use CppAD, see MPC::SetupThreads"
+              << std::endl;
+    std::abort();
+  }
+  numbers_taken[number] = true;
+  return number;
+}
 
-  // Lower and upper limits for the constraints
-  // Should be 0 besides initial state.
-  Dvector constraints_lowerbound(n_constraints);
-  Dvector constraints_upperbound(n_constraints);
-  for (int i = 0; i < n_constraints; i++) {
-    constraints_lowerbound[i] = 0;
-    constraints_upperbound[i] = 0;
+static void FreeNumber(size_t number) {
+  if (number != 0) {
+    std::lock_guard<std::mutex> lock(numbers_mutex);
+    numbers_taken[number] = false;
   }
+}
 
-  // For the first state
-  constraints_lowerbound[x_start] = state[0];
-  constraints_upperbound[x_start] = state[0];
+namespace {
+// A thread's number for as long as it runs.
+struct ThreadNumber {
+  ThreadNumber()
+      : number(std::this_thread::get_id() == numbers_master ? 0
+                                                             : TakeNumber()) {}
+  ~ThreadNumber() { FreeNumber(number); }
+  size_t number;
+};
+}
 
-  constraints_lowerbound[y_start] = state[1];
-  constraints_upperbound[y_start] = state[1];
+// The number of the Allocator::Scope open on the thread.
+static thread_local size_t scoped_number = NO_NUMBER;
 
-  constraints_lowerbound[psi_start] = state[2];
-  constraints_upperbound[psi_start] = state[2];
+static bool InParallel() { return numbers_parallel; }
 
-  constraints_lowerbound[v_start] = state[3];
-  constraints_upperbound[v_start] = state[3];
+static size_t CurrentThreadNumber() {
+  if (!numbers_parallel) {
+    return 0;
+  }
+  if (scoped_number != NO_NUMBER) {
+    return scoped_number;
+  }
+  thread_local ThreadNumber current;
+  return current.number;
+}
 
-  constraints_lowerbound[cte_start] = state[4];
-  constraints_upperbound[cte_start] = state[4];
+void MPC::SetupThreads(size_t threads) {
+  threads = std::min<size_t>(threads, CPPAD_MAX_NUM_THREADS);
+  numbers_master = std::this_thread::get_id();
+  numbers_taken.assign(threads, false);
+  numbers_taken[0] = true;
+  SetupThreads(threads, InParallel, CurrentThreadNumber);
+  numbers_parallel = true;
+}
 
-  constraints_lowerbound[epsi_start] = state[5];
-  constraints_upperbound[epsi_start] = state[5];
+MPC::Allocator::Allocator()
+    : number_(numbers_parallel ? TakeNumber() : NO_NUMBER) {}
 
-  // object that computes objective and constraints
-  FG_eval fg_eval(coeffs);
+MPC::Allocator::~Allocator() {
+  if (number_ != NO_NUMBER) {
+    FreeNumber(number_);
+  }
+}
 
-  // options for IPOPT solver
-  std::string options;
-  // Uncomment this if you'd like more print information
-  options += "Integer print_level  0\n";
-  // NOTE: Setting sparse to true allows the solver to take advantage
-  // of sparse routines, this makes the computation MUCH FASTER. If you
-  // can uncomment 1 of these and see if it makes a difference or not but
-  // if you uncomment both the computation time should go up in orders of
-  // magnitude.
-  options += "Sparse  true        forward\n";
-  options += "Sparse  true        reverse\n";
-  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-  // Change this as you see fit.
-  options += "Numeric max_cpu_time 30 \n";
-
-  // place to return solution
-  CppAD::ipopt::solve_result<Dvector> solution;
+MPC::Allocator::Scope::Scope(const Allocator& allocator)
+    : previous_(scoped_number) {
+  if (allocator.number_ != NO_NUMBER) {
+    scoped_number = allocator.number_;
+  }
+}
+
+MPC::Allocator::Scope::~Scope() { scoped_number = previous_; }
+
+void MPC::ThreadMemory(size_t& thread, size_t& inuse, size_t& available) {
+  thread = CppAD::thread_alloc::thread_num();
+  inuse = CppAD::thread_alloc::inuse(thread);
+  available = CppAD::thread_alloc::available(thread);
+}
+
+void MPC::FreeThreadMemory() {
+  CppAD::thread_alloc::free_available(CppAD::thread_alloc::thread_num());
+}
+
+size_t MPC::tapeBytes() const {
+  size_t bytes = 0;
+  for (const Problem& problem : problems_) {
+    bytes += problem.nlp->TapeBytes();
+  }
+  if (frenet_) {
+    bytes += frenet_->tapeBytes();
+  }
+  for (const std::unique_ptr<MPC>& rival : rivals_) {
+    bytes += rival->tapeBytes();
+  }
+  return bytes;
+}
+
+size_t MPC::workspaceBytes() const {
+  size_t bytes = 0;
+  for (const Problem& problem : problems_) {
+    bytes += problem.nlp->WorkspaceBytes();
+  }
+  if (frenet_) {
+    bytes += frenet_->workspaceBytes();
+  }
+  for (const std::unique_ptr<MPC>& rival : rivals_) {
+    bytes += rival->workspaceBytes();
+  }
+  return bytes;
+}
+
+void MPC::WarmUp(size_t solves) {
+  for (size_t i = 0; i < rivals_.size(); i++) {
+    std::promise<void> warm;
+    MPC* rival = rivals_[i].get();
+    race_workers_[i]->Submit(0, [&] {
+      rival->WarmUp(solves);
+      warm.set_value();
+    });
+    warm.get_future().wait();
+  }
+
+  // (v, cte, epsi, curvature), as ControlTable::Sample takes them.
+  const double frames[][ControlTable::DIMENSIONS] = {
+      {0.5 * config_.refV, 0.5, 0.05, 0},
+      {config_.refV, -0.3, -0.02, 0.02},
+      {config_.refV, 0.2, 0.03, -0.02},
+      {0.8 * config_.refV, 0, 0, 0.05}};
+  const size_t n_frames = sizeof(frames) / sizeof(frames[0]);
+  std::vector<double> mpc_x_vals;
+  std::vector<double> mpc_y_vals;
+  warming_ = true;
+  for (size_t k = 0; k < solves; k++) {
+    State state;
+    Cubic coeffs;
+    ControlTable::Sample(frames[k % n_frames], state, coeffs);
+    for (size_t index = 0; index < problems_.size(); index++) {
+      mpc_x_vals.clear();
+      mpc_y_vals.clear();
+      SolveIpopt(index, state, coeffs, mpc_x_vals, mpc_y_vals,
+                 std::chrono::steady_clock::time_point::max());
+    }
+  }
+  warming_ = false;
+
+  for (Problem& problem : problems_) {
+    problem.has_solution = false;
+    problem.speculated = false;
+  }
+  stats_ = SolveStats();
+  plan_stages_ = 0;
+  factor_pending_ = false;
+}
+
+bool MPC::StaticMemory() const {
+  if (degrade) {
+    return false;
+  }
+  return method == LQR || (method == LINEAR_TIME_VARYING &&
+                           ltvFormulation != LTVMPC::SPARSE);
+}
+
+double MPC::CheckDerivatives() {
+  double error = 0;
+  for (Problem& problem : problems_) {
+    KinematicNLPBase* kinematic =
+        dynamic_cast<KinematicNLPBase*>(GetRawPtr(problem.nlp));
+    if (kinematic) {
+      error = std::max(error, CheckKinematic(*kinematic, *problem.layout,
+                                             problem.cost_params));
+    }
+  }
+  return error;
+}
+
+bool MPC::Retunable(double refV) const {
+  for (const Problem& problem : problems_) {
+    if (dynamic_cast<const KinematicNLPBase*>(GetRawPtr(problem.nlp))) {
+      return false;
+    }
+  }
+  bool refV_used = (table_ || primitives_) && refV != config_.refV;
+  return (method == IPOPT || method == REAL_TIME_ITERATION ||
+          method == LQR) &&
+         !degrade && start != MPPI_START && !cache_ && !refV_used;
+}
+
+bool MPC::Retune(const KinematicWeights& weights, double refV) {
+  if (!Retunable(refV)) {
+    return false;
+  }
+  for (const auto& other : rivals_) {
+    if (!other->Retunable(refV)) {
+      return false;
+    }
+  }
+  for (const auto& other : batch_) {
+    if (!other->Retunable(refV)) {
+      return false;
+    }
+  }
+  for (const auto& other : rivals_) {
+    other->Retune(weights, refV);
+  }
+  for (const auto& other : batch_) {
+    other->Retune(weights, refV);
+  }
+  config_.weights = weights;
+  config_.refV = refV;
+  for (Problem& problem : problems_) {
+    CostParameters(config_, problem.horizon.dt, &problem.cost_params[0]);
+    if (config_.userScaling) {
+      ScaleProblem(*problem.nlp, config_, *problem.layout,
+                   problem.horizon.dt);
+    }
+  }
+  rti_ = RTI(config_.N, config_.dt, config_.Lf, refV, weights);
+  rti_.fixedSweeps = config_.fixedIterations;
+  lqr_ = LateralLQR(config_.N, config_.dt, config_.Lf, refV, weights);
+  // Factored for the old cost.
+  sensitivity_.Clear();
+  factor_pending_ = false;
+  return true;
+}
+
+void MPC::SolveBatch(const BatchProblem* problems, Result* results,
+                     size_t count, Status* statuses,
+                     const std::chrono::steady_clock::time_point* deadlines) {
+  size_t threads = batchThreads > 0
+                       ? batchThreads
+                       : std::max(1u, std::thread::hardware_concurrency());
+  if (batch_.size() != threads) {
+    for (size_t i = 0; i < batch_.size(); i++) {
+      MPC* solver = batch_[i].release();
+      batch_workers_->Submit(i, [solver] { delete solver; });
+    }
+    batch_.clear();
+    batch_workers_.reset(new WorkerPool(threads));
+    batch_.resize(threads);
+    // No cache either, whose answers would depend on the earlier problems.
+    MpcConfig config = config_;
+    config.cacheEntries = 0;
+    std::vector<std::future<void> > built;
+    for (size_t i = 0; i < threads; i++) {
+      std::shared_ptr<std::promise<void> > done(new std::promise<void>());
+      built.push_back(done->get_future());
+      batch_workers_->Submit(i, [this, i, done, config] {
+        batch_[i].reset(new MPC(config));
+        done->set_value();
+      });
+    }
+    for (std::future<void>& b : built) {
+      b.wait();
+    }
+  }
+
+  bool lanes = laneBatch && method == LINEAR_TIME_VARYING &&
+               ltvFormulation == LTVMPC::RICCATI;
+  std::atomic<size_t> next(0);
+  std::vector<std::future<void> > finished;
+  for (size_t i = 0; i < threads; i++) {
+    MPC* solver = batch_[i].get();
+    solver->method = method;
+    solver->ltvFormulation = ltvFormulation;
+    solver->fallback = fallback;
+    solver->anytime = anytime;
+    solver->abortHopeless = abortHopeless;
+    solver->warmStart = false;
+    std::shared_ptr<std::promise<void> > done(new std::promise<void>());
+    finished.push_back(done->get_future());
+    if (lanes) {
+      batch_workers_->Submit(i, [=, &next] {
+        for (size_t k = next.fetch_add(LaneBatch::LANES); k < count;
+             k = next.fetch_add(LaneBatch::LANES)) {
+          solver->SolveLanes(problems + k, results + k,
+                             std::min<size_t>(LaneBatch::LANES, count - k),
+                             statuses ? statuses + k : nullptr);
+        }
+        done->set_value();
+      });
+      continue;
+    }
+    batch_workers_->Submit(i, [=, &next] {
+      for (size_t k = next++; k < count; k = next++) {
+        solver->Solve(problems[k].state, problems[k].coeffs, results[k],
+                      deadlines ? deadlines[k]
+                                : std::chrono::steady_clock::time_point::max());
+        if (statuses) {
+          statuses[k] = solver->stats_.status;
+        }
+      }
+      done->set_value();
+    });
+  }
+  for (std::future<void>& f : finished) {
+    f.wait();
+  }
+}
+
+void MPC::SolveLanes(const BatchProblem* problems, Result* results,
+                     size_t count, Status* statuses) {
+  const size_t LANES = LaneBatch::LANES;
+  if (!lanes_) {
+    lanes_.reset(new LaneBatch(config_.N, config_.dt, config_.Lf,
+                               config_.refV, config_.weights));
+    lanes_->fixedIterations = config_.fixedIterations;
+    lane_states_.resize(LANES);
+    lane_coeffs_.resize(LANES);
+  }
+  for (size_t k = 0; k < count; k++) {
+    lane_states_[k] = problems[k].state;
+    lane_coeffs_[k] = problems[k].coeffs;
+  }
+  lanes_->Solve(lane_states_.data(), lane_coeffs_.data(), count);
+  for (size_t k = 0; k < count; k++) {
+    Result& result = results[k];
+    // As Solve's LTV answer, down to the fallback.
+    bool converged = lanes_->lastConverged[k] || config_.fixedIterations > 0;
+    if (fallback && !converged) {
+      trajectory_x_.clear();
+      trajectory_y_.clear();
+      Input u = lqr_.Control(problems[k].state, problems[k].coeffs,
+                             trajectory_x_, trajectory_y_);
+      result.delta = u[0];
+      result.a = u[1];
+      result.size = std::min(result.capacity, trajectory_x_.size());
+      std::copy(trajectory_x_.begin(), trajectory_x_.begin() + result.size,
+                result.x);
+      std::copy(trajectory_y_.begin(), trajectory_y_.begin() + result.size,
+                result.y);
+    } else {
+      Input u = lanes_->First(k);
+      result.delta = u[0];
+      result.a = u[1];
+      result.size = lanes_->Predicted(k, result.x, result.y, result.capacity);
+    }
+    if (statuses) {
+      statuses[k] = converged ? CONVERGED : FAILED;
+    }
+  }
+}
+
+void MPC::Prepare() {
+  if (active_ == REAL_TIME_ITERATION) {
+    rti_.Prepare();
+  }
+  if (factor_pending_) {
+    // The parameters of the solution may have been moved by Predict().
+    MPC_NLP& nlp = *problems_[sensitivity_index_].nlp;
+    nlp.SetParameters(params_);
+    sensitivity_.Factor(nlp);
+    predicted_.resize(nlp.x.size());
+    factor_pending_ = false;
+  }
+}
+
+bool MPC::Predict(const State& state, const Cubic& coeffs, Result& result) {
+  if (!sensitivity_.factored()) {
+    return false;
+  }
+  if (predict_params_.size() != params_.size()) {
+    predict_params_.resize(params_.size());
+  }
+  for (size_t i = 0; i < n_coeffs; i++) {
+    predict_params_[i] = coeffs[i];
+  }
+  for (size_t i = 0; i < 6; i++) {
+    predict_params_[n_coeffs + i] = state[i];
+  }
+  // The obstacles stay as the solution had them.
+  for (size_t i = n_params; i < params_.size(); i++) {
+    predict_params_[i] = params_[i];
+  }
+  const Problem& problem = problems_[sensitivity_index_];
+  if (!sensitivity_.Predict(*problem.nlp, predict_params_, predicted_)) {
+    return false;
+  }
+  const Layout& L = *problem.layout;
+  result.delta = predicted_[L.delta(0)];
+  result.a = predicted_[L.a(0)];
+  result.size = 0;
+  for (size_t t = 1; t < L.N && result.size < result.capacity; t++) {
+    result.x[result.size] = predicted_[L.x(t)];
+    result.y[result.size] = predicted_[L.y(t)];
+    result.size++;
+  }
+  return true;
+}
+
+void MPC::StorePlan(size_t index, const State& state, const Cubic& coeffs,
+                    const MPC_NLP::Dvector& x) {
+  const Problem& problem = problems_[index];
+  const Layout& L = *problem.layout;
+  // The states are rolled out from the inputs rather than read, as not all
+  // of them are variables with derived errors.
+  plan_x_.col(0) = state;
+  plan_t_[0] = 0;
+  for (size_t t = 0; t + 1 < L.N; t++) {
+    double dt = StageStep(config_, t, problem.horizon.dt);
+    Input u(x[L.delta(t)], x[L.a(t)]);
+    State s = plan_x_.col(t);
+    plan_u_.col(t) = u;
+    plan_x_.col(t + 1) = BicycleStep(s, u, coeffs, dt, config_.Lf);
+    plan_t_[t + 1] = plan_t_[t] + dt;
+  }
+  plan_coeffs_ = coeffs;
+  plan_stages_ = L.N;
+  plan_fresh_ = true;
+}
+
+size_t MPC::controls(double* t, double* delta, double* a,
+                     size_t capacity) const {
+  if (!plan_fresh_ || plan_stages_ == 0) {
+    return 0;
+  }
+  size_t n = std::min(plan_stages_ - 1, capacity);
+  for (size_t k = 0; k < n; k++) {
+    t[k] = plan_t_[k];
+    delta[k] = plan_u_(0, k);
+    a[k] = plan_u_(1, k);
+  }
+  return n;
+}
+
+bool MPC::PlanAt(std::chrono::steady_clock::time_point now, size_t& k,
+                 State& planned, Input& feedforward) const {
+  double elapsed =
+      framePeriod > 0
+          ? framePeriod * (plan_frames_ + 1)
+          : std::chrono::duration<double>(now - plan_time_).count();
+  // Past the plan's last input the full solve is due early.
+  size_t last = plan_stages_ - 1;
+  if (elapsed >= plan_t_[last]) {
+    return false;
+  }
+  k = 0;
+  while (plan_t_[k + 1] <= elapsed) {
+    k++;
+  }
+  double frac = (elapsed - plan_t_[k]) / (plan_t_[k + 1] - plan_t_[k]);
+  planned = (1 - frac) * plan_x_.col(k) + frac * plan_x_.col(k + 1);
+  feedforward = plan_u_.col(k);
+  if (k + 1 < last) {
+    feedforward = (1 - frac) * feedforward + frac * plan_u_.col(k + 1);
+  }
+  return true;
+}
+
+// The curvature of the path y = f(x) at x.
+static double PathCurvature(const Cubic& c, double x) {
+  double df = c[1] + (2 * c[2] + 3 * c[3] * x) * x;
+  double ddf = 2 * c[2] + 6 * c[3] * x;
+  return ddf / std::pow(1 + df * df, 1.5);
+}
+
+bool MPC::NearPlan(const State& state, const Cubic& coeffs,
+                   const State& planned) const {
+  // cte, epsi and curvature are all relative to the path, so they compare
+  // across the frames of the solve and of now.
+  double bend = PathCurvature(coeffs, 0) -
+                PathCurvature(plan_coeffs_, planned[0]);
+  return std::abs(state[4] - planned[4]) <= trigger.cte &&
+         std::abs(state[5] - planned[5]) <= trigger.epsi &&
+         std::abs(state[3] - planned[3]) <= trigger.v &&
+         std::abs(bend) <= trigger.curvature;
+}
+
+void MPC::FollowPlan(size_t k, const State& planned, const Input& feedforward,
+                     const State& state, const Cubic& coeffs,
+                     std::vector<double>& mpc_x_vals,
+                     std::vector<double>& mpc_y_vals, Input& result) {
+  result = lqr_.Track(state, planned, feedforward);
+
+  // The rest of the plan from here, for the trajectory shown.
+  size_t last = plan_stages_ - 1;
+  State s = state;
+  for (size_t t = 1; t < plan_stages_; t++) {
+    size_t j = std::min(k + t - 1, last - 1);
+    Input u = t == 1 ? result : Input(plan_u_.col(j));
+    s = BicycleStep(s, u, coeffs, plan_t_[j + 1] - plan_t_[j], config_.Lf);
+    mpc_x_vals.push_back(s[0]);
+    mpc_y_vals.push_back(s[1]);
+  }
+}
+
+void MPC::SeedRollout(Dvector& vars, const State& state,
+                      const Cubic& coeffs, const Problem& problem) const {
+  const Layout& L = *problem.layout;
+  const Eigen::MatrixXd& nominal = mppi_.actuations();
+  State s = state;
+  double time = 0;
+  for (size_t t = 0; t + 1 < L.N; t++) {
+    double dt = StageStep(config_, t, problem.horizon.dt);
+    Input u;
+    if (t > 0 && L.input(0, t) == L.input(0, t - 1)) {
+      // Within a move block the first stage's actuation stands.
+      u = Input(vars[L.input(0, t)], vars[L.input(1, t)]);
+    } else if (start == FALLBACK_START) {
+      u = lqr_.Law(s, coeffs);
+    } else if (start == MPPI_START) {
+      // MPPI's stage at this one's time, on its own grid of config.dt.
+      size_t k = std::min(size_t(time / config_.dt + 0.5),
+                          size_t(nominal.cols() - 1));
+      u = nominal.col(k);
+    } else {
+      double delta = config_.Lf * PathCurvature(coeffs, s[0]);
+      u = Input(std::min(std::max(delta, -MAX_DELTA), MAX_DELTA), 0);
+    }
+    vars[L.input(0, t)] = u[0];
+    vars[L.input(1, t)] = u[1];
+    s = BicycleStep(s, u, coeffs, dt, config_.Lf);
+    time += dt;
+    for (size_t i = 0; i < L.n_states; i++) {
+      vars[L.state(i, t + 1)] = s[i];
+    }
+  }
+}
+
+void MPC::PlaceObstacles(const Layout& L, const Dvector& vars,
+                         bool trajectory, const State& state, double dt,
+                         MPC_NLP& nlp) {
+  const size_t stages = L.N - 1;
+  const size_t k = L.obstacles;
+  obstacle_x_.resize(stages);
+  obstacle_y_.resize(stages);
+  obstacle_near_.resize(stages * k);
+  obstacle_clearance_.resize(stages * k);
+  obstacle_count_.assign(stages, 0);
+  const double c = cos(worldPsi);
+  const double s = sin(worldPsi);
+  double along = 0;
+  for (size_t t = 1; t < L.N; t++) {
+    double x;
+    double y;
+    if (trajectory) {
+      x = vars[L.x(t)];
+      y = vars[L.y(t)];
+    } else {
+      // At least walking pace, so that a car at rest still looks ahead.
+      along += std::max(state[3], 1.) * StageStep(config_, t - 1, dt);
+      x = state[0] + along * cos(state[2]);
+      y = state[1] + along * sin(state[2]);
+    }
+    obstacle_x_[t - 1] = worldX + c * x - s * y;
+    obstacle_y_[t - 1] = worldY + s * x + c * y;
+  }
+  if (obstacles) {
+    obstacles->Near(obstacle_x_.data(), obstacle_y_.data(), stages,
+                    config_.obstacleReach, k, obstacle_near_.data(),
+                    obstacle_clearance_.data(), obstacle_count_.data());
+  }
+  for (size_t t = 1; t < L.N; t++) {
+    for (size_t j = 0; j < k; j++) {
+      size_t p = L.obstacle_param(j, t);
+      size_t g = L.obstacle_constraint(j, t);
+      if (j >= obstacle_count_[t - 1]) {
+        params_[p] = 0;
+        params_[p + 1] = 0;
+        params_[p + 2] = 0;
+        nlp.g_lowerbound[g] = -1.0e19;
+        continue;
+      }
+      const ObstacleMap::Disc& d =
+          (*obstacles)[obstacle_near_[k * (t - 1) + j]];
+      double dx = d.x - worldX;
+      double dy = d.y - worldY;
+      double r = d.radius + config_.obstacleMargin;
+      params_[p] = c * dx + s * dy;
+      params_[p + 1] = c * dy - s * dx;
+      params_[p + 2] = r * r;
+      nlp.g_lowerbound[g] = 0;
+    }
+  }
+}
+
+void MPC::HoldTrajectory(const State& state, const Cubic& coeffs,
+                         const Input& u, std::vector<double>& mpc_x_vals,
+                         std::vector<double>& mpc_y_vals) const {
+  State s = state;
+  for (size_t t = 1; t < config_.N; t++) {
+    s = BicycleStep(s, u, coeffs, config_.dt, config_.Lf);
+    mpc_x_vals.push_back(s[0]);
+    mpc_y_vals.push_back(s[1]);
+  }
+}
+
+/* 
+ * @param: state: [x, y, psi, v ,cte, epsi]
+ */ 
+void MPC::Solve(const State& state, const Cubic& coeffs,
+                Result& answer,
+                std::chrono::steady_clock::time_point deadline) {
+  auto start = std::chrono::steady_clock::now();
+  stats_ = SolveStats();
+  Method active = method;
+  size_t index = adaptiveHorizon ? scheduler.Select(state[3]) : 0;
+  DegradationLadder::Tier tier = ladder.tier();
+  bool tiered = degrade || ladder.floor() != DegradationLadder::FULL_NMPC;
+  bool predicting = predictTier && !speculative && !warming_;
+  SolveTimePredictor::Features features;
+  if (predicting) {
+    features = SolveTimePredictor::Describe(state.data(), coeffs.data(),
+                                            last_iterations_, hostLoad);
+    double budget =
+        std::chrono::duration<double>(deadline - start).count();
+    tier = std::max(predictor.Select(features, budget), ladder.floor());
+    tiered = true;
+  }
+  if (energyMode && !speculative) {
+    tier = std::max(tiered ? tier : ladder.floor(), governor.tier());
+    tiered = true;
+  }
+  double joules = energyMeter ? energyMeter->Joules() : 0;
+  if (!tiered) {
+    tier = DegradationLadder::FULL_NMPC;
+  }
+  if (tier != DegradationLadder::FULL_NMPC) {
+    index = short_index_;
+    active = tier == DegradationLadder::SHORT_HORIZON ? IPOPT
+           : tier == DegradationLadder::RTI_STEP ? REAL_TIME_ITERATION
+           : tier == DegradationLadder::LTV_QP ? LINEAR_TIME_VARYING
+           : LQR;
+  }
+  // On a straight the LQR law answers. The solution left from before it
+  // is frames old by the time the method takes over again, so the next
+  // IPOPT solve starts afresh.
+  usedFastPath = false;
+  if (hybridLqr && !speculative &&
+      segments.Update(state, coeffs, config_.refV) && active != LQR) {
+    usedFastPath = true;
+    active = LQR;
+    if (current_ < problems_.size()) {
+      problems_[current_].has_solution = false;
+    }
+  }
+  // Without a network, and every policyCheckEvery-th frame as a check on
+  // it, IPOPT answers for the policy.
+  checkedPolicy = false;
+  if (active == POLICY) {
+    checkedPolicy = policy_.loaded() && policyCheckEvery > 0 &&
+                    !speculative && ++policy_frames_ >= policyCheckEvery;
+    if (!policy_.loaded() || checkedPolicy) {
+      active = IPOPT;
+    }
+  }
+  // Back on IPOPT from another method, its last solution is frames old; a
+  // primitive is the better start.
+  if (primitives_ && active == IPOPT && active_ != IPOPT &&
+      current_ < problems_.size()) {
+    problems_[current_].has_solution = false;
+  }
+  active_ = active;
+
+  // The solvers append to these, within the capacity reserved for them at
+  // construction.
+  std::vector<double>& mpc_x_vals = trajectory_x_;
+  std::vector<double>& mpc_y_vals = trajectory_y_;
+  mpc_x_vals.clear();
+  mpc_y_vals.clear();
+  Input result;
+  // Between the full solves of the multi-rate mode, and while the event
+  // trigger doesn't fire, the plan of the last one is tracked instead for as
+  // long as it lasts.
+  usedPlan = false;
+  forcedSolve = false;
+  usedCache = false;
+  cacheSeeded = false;
+  trackSeeded = false;
+  primitiveSeeded = false;
+  usedTable = false;
+  raceWinner = -1;
+  plan_fresh_ = false;
+  bool rated = solveEvery > 1 && plan_frames_ + 1 < solveEvery;
+  size_t k = 0;
+  State planned;
+  Input feedforward;
+  if (!speculative && plan_stages_ > 0 && (rated || eventTriggered) &&
+      PlanAt(start, k, planned, feedforward)) {
+    if (rated) {
+      usedPlan = true;
+    } else {
+      forcedSolve = plan_frames_ >= trigger.maxFrames;
+      usedPlan = !forcedSolve && NearPlan(state, coeffs, planned);
+    }
+  }
+  if (usedPlan) {
+    FollowPlan(k, planned, feedforward, state, coeffs, mpc_x_vals,
+               mpc_y_vals, result);
+    stats_.status = CONVERGED;
+    plan_frames_++;
+  } else if (active == REAL_TIME_ITERATION) {
+    // A single step by design.
+    stats_.status = CONVERGED;
+    stats_.iterations = 1;
+    result = rti_.Feedback(state, coeffs, mpc_x_vals, mpc_y_vals);
+  } else if (active == LINEAR_TIME_VARYING) {
+    ltv_.formulation = ltvFormulation;
+    result = ltv_.Solve(state, coeffs, mpc_x_vals, mpc_y_vals);
+    // A fixed count answers with its last iterate, met tolerances or not.
+    bool fixed = config_.fixedIterations > 0 &&
+                 ltvFormulation != LTVMPC::ACTIVE_SET;
+    stats_.status = ltv_.lastConverged || fixed ? CONVERGED : FAILED;
+    stats_.iterations = ltv_.lastIterations;
+  } else if (active == LQR) {
+    stats_.status = CONVERGED;
+    result = lqr_.Control(state, coeffs, mpc_x_vals, mpc_y_vals);
+  } else if (active == PATH_INTEGRAL) {
+    stats_.status = CONVERGED;
+    result = mppi_.Control(state, coeffs, mpc_x_vals, mpc_y_vals);
+    stats_.cost = mppi_.lastCost;
+  } else if (active == ROBUST) {
+    result = robust_.Solve(state, coeffs, mpc_x_vals, mpc_y_vals);
+    stats_.status = robust_.lastConverged ? CONVERGED : FAILED;
+    stats_.iterations = robust_.lastIterations;
+  } else if (active == FRENET) {
+    if (!frenet_) {
+      frenet_.reset(new FrenetMPC(config_));
+    }
+    frenet_->warmStart = warmStart;
+    {
+      std::unique_lock<std::mutex> lock(ipopt_mutex, std::defer_lock);
+      if (serializeIpopt) {
+        lock.lock();
+      }
+      result = frenet_->Solve(state, coeffs, mpc_x_vals, mpc_y_vals,
+                              deadline);
+    }
+    stats_.status = frenet_->lastConverged     ? CONVERGED
+                    : frenet_->deadlineReached ? DEADLINE_EXCEEDED
+                                               : FAILED;
+    stats_.iterations = frenet_->lastIterations;
+    stats_.cost = frenet_->lastCost;
+  } else if (active == POLICY) {
+    stats_.status = CONVERGED;
+    result = policy_.Evaluate(state, coeffs);
+    HoldTrajectory(state, coeffs, result, mpc_x_vals, mpc_y_vals);
+  } else {
+    factor_pending_ = false;
+    if (!rivals_.empty() && !speculative) {
+      result = Race(index, state, coeffs, mpc_x_vals, mpc_y_vals, deadline);
+      // A rival's answer isn't the plan kept.
+      plan_fresh_ = plan_fresh_ && raceWinner == 0;
+    } else {
+      result = SolveIpopt(index, state, coeffs, mpc_x_vals, mpc_y_vals,
+                          deadline);
+    }
+    // A cached or tabled answer has no multipliers to go with it.
+    if (sensitivity && stats_.status == CONVERGED && !usedCache &&
+        !usedTable) {
+      factor_pending_ = true;
+      sensitivity_index_ = index;
+    }
+    if (checkedPolicy) {
+      policy_frames_ = 0;
+      if (stats_.status == CONVERGED) {
+        policyError = (policy_.Evaluate(state, coeffs) - result).norm();
+      }
+    }
+  }
+  if (!usedPlan && !speculative) {
+    // Only an IPOPT solve leaves a plan, see SolveIpopt.
+    plan_frames_ = 0;
+    plan_time_ = start;
+    if (active != IPOPT) {
+      plan_stages_ = 0;
+    }
+  }
+
+  // Without a converged or at least feasible answer, the last iterate can be
+  // anything; the LQR law costs next to nothing and is always sound. An
+  // update of the last factored solution is closer to the optimum, when
+  // there is one of this problem.
+  bool unsolved = stats_.status == DEADLINE_EXCEEDED || stats_.status == FAILED;
+  usedPrediction = false;
+  if (fallback && unsolved && sensitivity && active == IPOPT &&
+      sensitivity_index_ == index && sensitivity_.factored()) {
+    Result predicted = {0, 0, answer.x, answer.y, answer.capacity, 0};
+    if (Predict(state, coeffs, predicted)) {
+      usedPrediction = true;
+      result = Input(predicted.delta, predicted.a);
+      mpc_x_vals.assign(answer.x, answer.x + predicted.size);
+      mpc_y_vals.assign(answer.y, answer.y + predicted.size);
+    }
+  }
+  usedFallback = fallback && unsolved && !usedPrediction;
+  if (usedFallback) {
+    mpc_x_vals.clear();
+    mpc_y_vals.clear();
+    result = lqr_.Control(state, coeffs, mpc_x_vals, mpc_y_vals);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  stats_.seconds = std::chrono::duration<double>(end - start).count();
+  if (energyMeter) {
+    stats_.joules = energyMeter->Joules() - joules;
+  }
+  last_iterations_ = stats_.iterations;
+  bool solved = !speculative && !usedPlan && !usedFastPath && !usedCache &&
+                !usedTable;
+  tier_ = solved ? tier : DegradationLadder::NUM_TIERS;
+  predicted_seconds_ = -1;
+  if (predicting && solved) {
+    if (predictor.trained(tier)) {
+      predicted_seconds_ = predictor.Predict(tier, features);
+    }
+    predictor.Record(tier, features, stats_.seconds);
+  }
+  energyStep = energyMode && solved &&
+               governor.Record(tier, std::fabs(state[4]),
+                               energyMeter ? stats_.joules : -1);
+  // Any frame that overran counts, whichever the method.
+  ladderStep = degrade && !predictTier && !speculative && !usedPlan &&
+               ladder.Record(end > deadline);
+
+  answer.delta = result[0];
+  answer.a = result[1];
+  answer.size = std::min(answer.capacity, mpc_x_vals.size());
+  std::copy(mpc_x_vals.begin(), mpc_x_vals.begin() + answer.size, answer.x);
+  std::copy(mpc_y_vals.begin(), mpc_y_vals.begin() + answer.size, answer.y);
+}
+
+vector<double> MPC::Solve(const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs,
+                          std::vector<double>& mpc_x_vals,
+                          std::vector<double>& mpc_y_vals,
+                          std::chrono::steady_clock::time_point deadline) {
+  Result answer = {0, 0, nullptr, nullptr, 0, 0};
+  Solve(state.head<6>(), coeffs.head<4>(), answer, deadline);
+  mpc_x_vals.insert(mpc_x_vals.end(), trajectory_x_.begin(),
+                    trajectory_x_.end());
+  mpc_y_vals.insert(mpc_y_vals.end(), trajectory_y_.begin(),
+                    trajectory_y_.end());
+  return {answer.delta, answer.a};
+}
+
+Input MPC::SolveIpopt(size_t index, const State& state,
+                      const Cubic& coeffs,
+                      std::vector<double>& mpc_x_vals,
+                      std::vector<double>& mpc_y_vals,
+                      std::chrono::steady_clock::time_point deadline) {
+  // A shape that wasn't solved last frame has no recent solution to warm
+  // start from.
+  if (index != current_) {
+    problems_[index].has_solution = false;
+    current_ = index;
+  }
+  Problem& problem = problems_[index];
+
+  // Inside the table, its interpolation is the answer, with the trajectory
+  // of holding it over the horizon. It leaves nothing to warm start or track
+  // from.
+  double q[ControlTable::DIMENSIONS];
+  Input tabled;
+  if (table_ && index == 0 && !speculative && !warming_) {
+    ControlTable::Query(state, coeffs, q);
+    usedTable = table_->Lookup(q, tabled);
+  }
+  if (usedTable) {
+    problem.has_solution = false;
+    plan_stages_ = 0;
+    stats_.status = CONVERGED;
+    HoldTrajectory(state, coeffs, tabled, mpc_x_vals, mpc_y_vals);
+    return tabled;
+  }
+
+  MPC_NLP* nlp = GetRawPtr(problem.nlp);
+  Ipopt::IpoptApplication* app = GetRawPtr(problem.app);
+  const Layout& L = *problem.layout;
+  const size_t n_vars = L.n_vars;
+  const size_t n_constraints = L.n_constraints;
+  auto solve_start = std::chrono::steady_clock::now();
+
+  // Close enough to a cached solution, that is the answer; otherwise one in
+  // the same cell is the warm start.
+  bool answers = false;
+  const SolutionCache::Entry* hit =
+      cache_ && start == WARM_START && !warming_
+          ? cache_->Find(index, state, coeffs, answers)
+          : nullptr;
+  const double* seed = hit ? cache_->solution(*hit) : nullptr;
+  if (answers) {
+    for (size_t i = 0; i < n_vars; i++) {
+      nlp->x[i] = seed[i];
+    }
+    problem.has_solution = true;
+    problem.speculated = speculative;
+    usedCache = true;
+    stats_.status = CONVERGED;
+    if ((solveEvery > 1 || eventTriggered || keepControls) && !speculative) {
+      StorePlan(index, state, coeffs, nlp->x);
+    }
+    mpc_x_vals.assign(cache_->x(*hit), cache_->x(*hit) + hit->points);
+    mpc_y_vals.assign(cache_->y(*hit), cache_->y(*hit) + hit->points);
+    return Input(hit->delta, hit->a);
+  }
+  cacheSeeded = hit != nullptr;
+  // Without a recent solution, one solved here on an earlier lap is the next
+  // best start.
+  const float* stored = nullptr;
+  if (!seed && !(warmStart && problem.has_solution) && warm_starts_ &&
+      start == WARM_START && trackPosition >= 0 &&
+      n_vars == warm_starts_->width()) {
+    stored = warm_starts_->Find(trackPosition);
+  }
+  trackSeeded = stored != nullptr;
+  // Failing those, the nearest motion primitive; also for a car that
+  // jumped away from where the last solution had it next, reset or moved,
+  // which the shifted solution would start far from.
+  const float* primitive = nullptr;
+  bool from_scratch = !seed && !stored && start == WARM_START &&
+                      !(warmStart && problem.has_solution &&
+                        !Jumped(nlp->x, state, L));
+  if (primitives_ && from_scratch && n_vars == primitives_->width()) {
+    double q[ControlTable::DIMENSIONS];
+    ControlTable::Query(state, coeffs, q);
+    primitive = primitives_->Find(q[ControlTable::V],
+                                  q[ControlTable::CURVATURE]);
+  }
+  primitiveSeeded = primitive != nullptr;
+
+  bool ok = true;
+  // size_t i;
+
+  // Initial value of the independent variables: all 0 besides initial state,
+  // or the previous solution shifted one stage when warm starting, or a
+  // rollout for the other starts. A speculative or cached solution was
+  // already for this frame, and is only moved to the actual initial state.
+  Dvector& vars = nlp->x_init;
+  bool warm = warmStart && problem.has_solution && !seed &&
+              start == WARM_START && !primitive;
+  bool shift = !(problem.speculated && !speculative);
+  if (seed) {
+    for (size_t i = 0; i < n_vars; i++) {
+      vars[i] = seed[i];
+    }
+    AnchorSolution(vars, state, L, 0);
+  } else if (stored || primitive) {
+    const float* from = stored ? stored : primitive;
+    for (size_t i = 0; i < n_vars; i++) {
+      vars[i] = from[i];
+    }
+    AnchorSolution(vars, state, L, 0);
+  } else if (warm) {
+    for (int i = 0; i < n_vars; i++) {
+      vars[i] = nlp->x[i];
+    }
+    if (shift) {
+      ShiftSolution(vars, state, L);
+    } else {
+      AnchorSolution(vars, state, L, 0);
+    }
+  } else {
+    for (int i = 0; i < n_vars; i++) {
+      vars[i] = 0;
+    }
+    if (start == MPPI_START) {
+      seed_x_.clear();
+      seed_y_.clear();
+      mppi_.Control(state, coeffs, seed_x_, seed_y_);
+    }
+    if (start == CURVATURE_START || start == FALLBACK_START ||
+        start == MPPI_START) {
+      SeedRollout(vars, state, coeffs, problem);
+    }
+  }
+  for (size_t i = 0; i < L.n_states; i++) {
+    vars[L.state(i, 0)] = state[i];
+  }
+  // Ipopt takes fixed variables out of the problem (fixed_variable_treatment
+  // make_parameter), so that the initial state costs neither variables nor
+  // constraints.
+  if (L.initial_bounds) {
+    for (size_t i = 0; i < L.n_states; i++) {
+      nlp->x_lowerbound[L.state(i, 0)] = state[i];
+      nlp->x_upperbound[L.state(i, 0)] = state[i];
+    }
+  }
+
+  // Interior point iterations only benefit fully from a warm start when the
+  // bound and constraint multipliers are carried over as well.
+  bool warm_duals = warm && warmStartDuals;
+  if (warm_duals) {
+    for (int i = 0; i < n_vars; i++) {
+      nlp->z_l_init[i] = nlp->z_l[i];
+      nlp->z_u_init[i] = nlp->z_u[i];
+    }
+    for (int i = 0; i < n_constraints; i++) {
+      nlp->lambda_init[i] = nlp->lambda[i];
+    }
+    if (shift) {
+      ShiftBoundMultipliers(nlp->z_l_init, L);
+      ShiftBoundMultipliers(nlp->z_u_init, L);
+      ShiftMultipliers(nlp->lambda_init, L);
+    }
+  }
+
+  // The other bounds are the same every frame, and set by NewProblem, but
+  // for the obstacle slots'. Point the cached tape at this frame's path,
+  // initial state and obstacles.
+  if (params_.size() != L.n_params) {
+    params_.resize(L.n_params);
+  }
+  if (L.obstacles) {
+    bool trajectory = seed || stored || primitive || warm ||
+                      start == CURVATURE_START ||
+                      start == FALLBACK_START || start == MPPI_START;
+    PlaceObstacles(L, vars, trajectory, state, problem.horizon.dt, *nlp);
+  }
+  for (size_t i = 0; i < n_coeffs; i++) {
+    params_[i] = coeffs[i];
+  }
+  for (size_t i = 0; i < 6; i++) {
+    params_[n_coeffs + i] = state[i];
+  }
+  for (size_t i = 0; i < n_cost_params; i++) {
+    params_[L.cost_param() + i] = problem.cost_params[i];
+  }
+  nlp->SetParameters(params_);
+
+  // A warm started point is already close to the central path: restarting
+  // the barrier at Ipopt's default mu_init of 0.1 would pull it back off.
+  if (warm_duals) {
+    app->Options()->SetStringValue("warm_start_init_point", "yes");
+    app->Options()->SetNumericValue("mu_init",
+                                    warmStartMu > 0 ? warmStartMu : 0.1);
+  } else {
+    app->Options()->SetStringValue("warm_start_init_point", "no");
+    app->Options()->SetNumericValue("mu_init", 0.1);
+  }
+  // A polish stops at its cap and answers from its best feasible iterate;
+  // other solves keep Ipopt's default cap.
+  bool polish = start == MPPI_START && polishIterations > 0;
+  app->Options()->SetIntegerValue("max_iter", polish ? polishIterations
+                                                     : 3000);
+
+  nlp->deadline = deadline;
+  nlp->deadline_reached = false;
+  nlp->cancel = cancel_;
+  nlp->abortHopeless = abortHopeless;
+  nlp->aborted = MPC_NLP::NOT_ABORTED;
+  nlp->track_best = anytime || polish;
+  nlp->has_best = false;
 
   // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
-      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-      constraints_upperbound, fg_eval, solution);
+  // The first solve sets up Ipopt's internal NLP adapter and linear solver;
+  // later frames re-optimize the same TNLP and keep them.
+  std::unique_lock<std::mutex> lock(ipopt_mutex, std::defer_lock);
+  if (serializeIpopt) {
+    lock.lock();
+  }
+  // Ipopt's own work, mostly its linear solves, is all of it but the
+  // evaluations.
+  PerfScope linear_algebra(STAGE_LINEAR_ALGEBRA, STAGE_EVAL);
+  if (problem.interior) {
+    problem.interior->warmStart = warm_duals;
+    problem.interior->muInit = warm_duals && warmStartMu > 0 ? warmStartMu
+                                                             : 0.1;
+    problem.interior->maxIterations = polish ? polishIterations : 3000;
+    problem.interior->Solve(*nlp);
+  } else if (problem.optimized) {
+    app->ReOptimizeTNLP(GetRawPtr(problem.nlp));
+  } else {
+    app->OptimizeTNLP(GetRawPtr(problem.nlp));
+    problem.optimized = true;
+  }
+  linear_algebra.Stop();
+  if (lock.owns_lock()) {
+    lock.unlock();
+  }
+  if (index < scheduler.candidates().size() && !warming_) {
+    scheduler.Record(index, std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - solve_start)
+                                .count());
+  }
 
   // Check some of the solution values
-  ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  ok &= MPC_NLP::Usable(nlp->status, problem.interior &&
+                                         problem.interior->fixedIterations > 0);
+  // Take the answer from the best feasible iterate when the solve didn't
+  // converge; without one there is nothing better than the last iterate.
+  const Dvector* answer = &nlp->x;
+  stats_.iterations = nlp->iterations;
+  stats_.restorations = nlp->restorations;
+  stats_.aborted = nlp->aborted;
+  stats_.cost = nlp->obj_value;
+  stats_.constraintViolation = nlp->violation;
+  stats_.evalSeconds = nlp->eval_seconds;
+  stats_.linearSolveSeconds = nlp->linear_solve_seconds;
+  if (ok) {
+    stats_.status = CONVERGED;
+  } else if ((anytime || polish) && nlp->has_best) {
+    stats_.status = BEST_FEASIBLE;
+    answer = &nlp->best_x;
+    stats_.cost = nlp->best_obj_value;
+    stats_.constraintViolation = nlp->best_violation;
+  } else if (nlp->deadline_reached) {
+    stats_.status = DEADLINE_EXCEEDED;
+  } else {
+    stats_.status = FAILED;
+  }
+  // Don't seed the next frame from a failed solve.
+  problem.has_solution = ok;
+  problem.speculated = speculative;
 
   // Cost
-  // cout << "cost: " << solution.obj_value << endl;
+  // cout << "cost: " << nlp->obj_value << endl;
 
-  for (int i = x_start + 1; i < y_start; i++){
-    mpc_x_vals.push_back(solution.x[i]);
+  const Dvector& x = *answer;
+  if ((solveEvery > 1 || eventTriggered || keepControls) && !speculative) {
+    if (stats_.status == CONVERGED || stats_.status == BEST_FEASIBLE) {
+      StorePlan(index, state, coeffs, x);
+    } else {
+      plan_stages_ = 0;
+    }
+  }
+  for (size_t t = 1; t < L.N; t++){
+    mpc_x_vals.push_back(x[L.x(t)]);
+  }
+  for (size_t t = 1; t < L.N; t++){
+    mpc_y_vals.push_back(x[L.y(t)]);
+  }
+  if (warm_starts_ && ok && trackPosition >= 0 && !warming_ &&
+      n_vars == warm_starts_->width()) {
+    warm_starts_->Store(trackPosition, &x[0]);
   }
-  for (int i = y_start + 1; i < psi_start; i++){
-    mpc_y_vals.push_back(solution.x[i]);
+  if (cache_ && ok && !warming_) {
+    cache_->Store(index, state, coeffs, &x[0], n_vars, x[L.delta(0)],
+                  x[L.a(0)], mpc_x_vals.data(), mpc_y_vals.data(),
+                  mpc_x_vals.size());
   }
 
   //  Return the first actuator values.
-  return {solution.x[delta_start], solution.x[a_start]};
+  return Input(x[L.delta(0)], x[L.a(0)]);
 }
@@ -1,25 +1,672 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include <coin/IpIpoptApplication.hpp>
+#include "BatchLTV.h"
+#include "ControlTable.h"
+#include "DegradationLadder.h"
+#include "EnergyGovernor.h"
+#include "FrenetMPC.h"
+#include "HorizonScheduler.h"
+#include "InteriorPoint.h"
+#include "MPC_NLP.h"
+#include "LQR.h"
+#include "LTV.h"
+#include "MotionPrimitives.h"
+#include "MpcConfig.h"
+#include "MPPI.h"
+#include "Obstacles.h"
+#include "PolicyNet.h"
+#include "Precision.h"
+#include "RTI.h"
+#include "SegmentDetector.h"
+#include "SolveTimePredictor.h"
+#include "Sensitivity.h"
+#include "SolutionCache.h"
+#include "StagePool.h"
+#include "TrackWarmStarts.h"
+#include "WorkerPool.h"
+
+class CheckpointReader;
+class CheckpointWriter;
+class EnergyMeter;
 
 using namespace std;
 
+struct Layout;
+
 class MPC {
  public:
-  MPC();
+  // analyticDerivatives selects the hand-written derivatives of
+  // KinematicNLP over CppAD sweeps of the tape.
+  explicit MPC(const MpcConfig& config = MpcConfig(),
+               bool analyticDerivatives = false);
 
   virtual ~MPC();
+
+  // Set CppAD up for controllers on up to `threads` threads, numbered by
+  // thread_number from 0, with in_parallel true once they run. Call it
+  // before any MPC is constructed.
+  static void SetupThreads(size_t threads, bool (*in_parallel)(),
+                           size_t (*thread_number)());
+  // The same, numbering the threads itself: the calling thread is 0, and
+  // any other gets the lowest free number the first time CppAD asks for it,
+  // and frees it when it exits, so that the workers, the rivals and any
+  // other threads solving each have an allocator of their own. Each tape is
+  // used on one thread at a time, by the controller that recorded it, or,
+  // shared, by the controllers on the thread number it was copied for. At
+  // most CPPAD_MAX_NUM_THREADS threads; using CppAD on more at once aborts.
+  // Call it from the main thread before any other thread uses CppAD.
+  static void SetupThreads(size_t threads);
+
+  // A CppAD allocator of its own, for a controller that moves between
+  // threads, like a session's under FrameScheduler. While a Scope of it is
+  // open CppAD on the thread uses its number instead of the thread's, so the
+  // controller's memory goes back where it came from on whichever thread it
+  // is freed. One thread at a time. Takes a free number of
+  // SetupThreads(threads) as a thread does, and gives it back with its
+  // memory held for the next; without SetupThreads a scope changes nothing.
+  class Allocator {
+   public:
+    Allocator();
+    ~Allocator();
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(const Allocator&) = delete;
+
+    class Scope {
+     public:
+      explicit Scope(const Allocator& allocator);
+      ~Scope();
+
+     private:
+      size_t previous_;
+    };
+
+   private:
+    size_t number_;
+  };
+
+  // The cost and constraint tape of an N-stage problem, recorded as the
+  // constructor does for each horizon.
+  static Ipopt::SmartPtr<MPC_NLP> RecordTape(const MpcConfig& config,
+                                             size_t N, double dt);
   
-  // TODO: delete
-  double prevDelta;
-  double prevA;
-
-  // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuatotions.
-  vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs,
-  	std::vector<double> & mpc_x_vals, std::vector<double> & mpc_y_vals);
+  // Seed each solve with the previous solution shifted one stage forward.
+  bool warmStart;
+  // Also carry over the bound and constraint multipliers, shifted one stage
+  // as well, and let Ipopt use them through warm_start_init_point.
+  bool warmStartDuals;
+  // The barrier parameter Ipopt then starts from, instead of its mu_init of
+  // 0.1; 0 keeps 0.1.
+  double warmStartMu;
+  // How Solve computes the actuations.
+  enum Method {
+    // The nonlinear program, solved to convergence by Ipopt.
+    IPOPT,
+    // A single real-time iteration SQP step per frame.
+    REAL_TIME_ITERATION,
+    // The model linearized along the previous trajectory, solved as a QP.
+    LINEAR_TIME_VARYING,
+    // Gain-scheduled LQR on cte and epsi; no optimization at all.
+    LQR,
+    // The learned imitation of IPOPT, see LoadPolicy; IPOPT until one is
+    // loaded.
+    POLICY,
+    // Sampled rollouts weighted by their costs, see MPPI.
+    PATH_INTEGRAL,
+    // One first move for all of MpcConfig::scenarios, see ScenarioMPC.
+    ROBUST,
+    // The nonlinear program in path coordinates, on the path's curvature
+    // rather than its cubic, solved by Ipopt, see FrenetMPC. Built on its
+    // first Solve, which WarmUp makes.
+    FRENET
+  };
+  Method method;
+  // The QP that LINEAR_TIME_VARYING solves.
+  LTVMPC::Formulation ltvFormulation;
+
+  // Work for the next frame that doesn't depend on its telemetry. Call it
+  // once the actuations of the current frame have been sent.
+  void Prepare();
+
+  // Memory, for the metrics: the bytes in use by CppAD's allocator on the
+  // calling thread and held for it (see SetupThreads), with the thread's
+  // number, and the bytes of this controller's tapes and an estimate of its
+  // solver workspace (see MPC_NLP::WorkspaceBytes), its rivals' included.
+  static void ThreadMemory(size_t& thread, size_t& inuse, size_t& available);
+  // Give what CppAD's allocator holds for reuse on the calling thread's
+  // number back to the heap, once its controllers are gone.
+  static void FreeThreadMemory();
+  size_t tapeBytes() const;
+  size_t workspaceBytes() const;
+
+  // Solve each problem `solves` times, from frames of a car near the path
+  // at speed on straights and in either turn, and then forget them, as if
+  // nothing had been solved. Ipopt's first-solve setup, the first sweeps of
+  // the tapes, and the memory the solves fault in and CppAD's allocator
+  // keeps (see SetupThreads) are then done with before the first real
+  // frame. The rivals warm up too, on their threads.
+  void WarmUp(size_t solves);
+  // Whether Solve, as tuned, leaves the heap alone once the controller is
+  // constructed, for the static-memory profile (see HeapGuard.h): the LQR
+  // method does, and LINEAR_TIME_VARYING but for the SPARSE formulation,
+  // whose sparse LDLT allocates as it factorizes; not with degrade, which
+  // can step up to Ipopt.
+  bool StaticMemory() const;
+  // The largest difference of the hand-written or AutoDiffNLP derivatives
+  // of the problems from their tapes', at an arbitrary curved point; 0 if
+  // no problem has them. Sets the problems' parameters, so not during a
+  // Solve.
+  double CheckDerivatives();
+  // Take up new cost weights and refV, see MpcConfig, between frames and
+  // without recording a tape: the tapes take them as dynamic parameters,
+  // so problems of any tuning share one shape (see MPC_NLP::share_tapes),
+  // and RTI and LQR are rebuilt, being cheap. False, with nothing changed,
+  // when something else was built for the old ones: the analytic
+  // derivatives, the LTV, MPPI, ROBUST, FRENET and POLICY methods or the
+  // ladder that steps down to LTV, MPPI_START, the solution cache, or a
+  // control table or primitives for another refV. Build another MPC then.
+  bool Retune(const KinematicWeights& weights, double refV);
+
+  // Outcome of the last Solve.
+  enum Status {
+    // Converged, or stopped at an acceptable iterate, see MPC_NLP::Usable.
+    CONVERGED,
+    // Ipopt was stopped at the deadline, short of a feasible iterate.
+    DEADLINE_EXCEEDED,
+    // Ipopt was stopped or failed, and the actuations come from the best
+    // feasible iterate it went through (anytime mode).
+    BEST_FEASIBLE,
+    // The solver gave up or failed to converge.
+    FAILED
+  };
+  // What the last Solve did.
+  struct SolveStats {
+    Status status;
+    // Iterations of the method's solver: Ipopt's, the LTV QP's ADMM
+    // iterations or working-set changes, 1 for RTI and 0 for LQR. How many
+    // times Ipopt entered its restoration phase.
+    int iterations;
+    int restorations;
+    // Why an IPOPT solve was stopped early, see abortHopeless.
+    MPC_NLP::Abort aborted;
+    // The cost of the solution answered with, and its largest bound or
+    // constraint violation. IPOPT only, but for the cost of the best
+    // rollout of PATH_INTEGRAL.
+    double cost;
+    double constraintViolation;
+    // Wall-clock seconds in Solve, and for IPOPT the parts of them it spent
+    // evaluating the problem and in the linear solver, see MPC_NLP.
+    double seconds;
+    double evalSeconds;
+    double linearSolveSeconds;
+    // The CPU's joules meanwhile, see energyMeter; 0 unmetered.
+    double joules;
+  };
+  const SolveStats& stats() const { return stats_; }
+  // Answer with the LQR law instead of the solver's last iterate when the
+  // status is DEADLINE_EXCEEDED or FAILED, and whether the last Solve did.
+  bool fallback;
+  bool usedFallback;
+  // Factor the KKT matrix of each converged IPOPT solution in Prepare(), so
+  // that Predict() can answer for another state and path in a
+  // back-substitution (see Sensitivity), and a solve that doesn't converge
+  // answers with that prediction rather than the LQR law when it is for the
+  // same problem. Whether the last Solve did.
+  bool sensitivity;
+  bool usedPrediction;
+  // Multi-rate mode: solve in full only every solveEvery frames, and in
+  // between track the plan of the last IPOPT solve, its actuations as the
+  // feedforward and the LQR gains on the deviations from its states (see
+  // LateralLQR::Track), for about 1 / solveEvery of the CPU. 1 solves every
+  // frame. framePeriod is how far along the plan each frame is, in seconds;
+  // 0 measures it by the clock. Whether the last Solve tracked the plan.
+  size_t solveEvery;
+  double framePeriod;
+  bool usedPlan;
+  // Event-triggered mode: after each IPOPT solve, track its plan as between
+  // the solves of solveEvery for as long as the car follows it and the path
+  // ahead keeps its shape, that is while the deviations from the planned
+  // cte, epsi and v and the change of the path's curvature at the car from
+  // the planned one are within trigger, and solve again when one isn't or
+  // after trigger.maxFrames frames. Whether the last Solve was forced by
+  // maxFrames.
+  struct Trigger {
+    double cte;
+    double epsi;
+    double v;
+    double curvature;
+    size_t maxFrames;
+  };
+  bool eventTriggered;
+  Trigger trigger;
+  bool forcedSolve;
+  // Keep the inputs of each converged or feasible IPOPT solve over its
+  // horizon, for controls(), even without solveEvery or eventTriggered.
+  bool keepControls;
+  // The inputs of the last Solve's plan, when it solved one: up to
+  // `capacity` of them into delta and a, each applied from t seconds after
+  // the state solved from; the number written, 0 when the last Solve kept
+  // no plan.
+  size_t controls(double* t, double* delta, double* a,
+                  size_t capacity) const;
+  // Whether the last Solve was answered from the solution cache, see
+  // MpcConfig::cacheEntries, or started from a solution in it; and the
+  // cache, nullptr without one.
+  bool usedCache;
+  bool cacheSeeded;
+  const SolutionCache* cache() const { return cache_.get(); }
+
+  // Warm starts by position along a track of `length` meters, in bins of
+  // about `bin` meters (see TrackWarmStarts), for the solves of the default
+  // horizon: loaded from `path` if it has them for this track and problem,
+  // else starting empty. False if they couldn't be loaded.
+  bool LoadWarmStarts(const std::string& path, double length, double bin);
+  // Write them to `path`; false without any or if they couldn't be written.
+  bool SaveWarmStarts(const std::string& path);
+  const TrackWarmStarts* warmStarts() const { return warm_starts_.get(); }
+
+  // Write what the next Solve goes on from into a checkpoint: the last
+  // solution of the IPOPT method with its multipliers, and the scheduler's
+  // and the ladder's state; and read it back into a controller of the same
+  // tuning, whose next Solve then warm starts from it as from its own. A
+  // solution of a problem shape not here is read past, and the other
+  // methods start their first frame afresh. See Checkpoint.h.
+  void Checkpoint(CheckpointWriter& out) const;
+  bool Restore(CheckpointReader& in);
+  // The arc length along the track of the car for the next Solve, negative
+  // off the track. A cold IPOPT solve then starts from the warm start of
+  // that position, and any converged one is kept as it. Whether the last
+  // Solve started from one.
+  double trackPosition;
+  bool trackSeeded;
+  // The built map of the obstacle constraints, see
+  // MpcConfig::obstacleSlots, null for none, and where the vehicle frame of
+  // the next Solve is in its world coordinates: the car's position and
+  // heading in the frame's telemetry. Controller::Step sets the pose.
+  const ObstacleMap* obstacles;
+  double worldX;
+  double worldY;
+  double worldPsi;
+  // Explicit MPC: answer the IPOPT solves of the default horizon from the
+  // control table in `path` wherever it covers the frame, see ControlTable,
+  // and solve only outside it. False if it couldn't be loaded or was solved
+  // for another horizon or model. Whether the last Solve was answered from
+  // it.
+  bool LoadControlTable(const std::string& path);
+  const ControlTable* controlTable() const { return table_.get(); }
+  bool usedTable;
+  // Start the IPOPT solves of the default horizon that have no solution to
+  // warm start from, or a cached or stored one, from the nearest motion
+  // primitive in `path` instead of zeros, see MotionPrimitives: the first
+  // solve of a session, one after a failed one, after another method
+  // answered, or after the car jumped away from where the last solution
+  // had it. False if it couldn't be loaded or was solved for another
+  // horizon, model or problem. Whether the last Solve started from one.
+  bool LoadPrimitives(const std::string& path);
+  const MotionPrimitives* primitives() const { return primitives_.get(); }
+  bool primitiveSeeded;
+  // The number of variables of the IPOPT problem of the default horizon,
+  // and their values at its last solve, for tools/build_primitives.cpp;
+  // false if it has none.
+  size_t variables() const;
+  bool Solution(std::vector<double>& x) const;
+  // The network of the POLICY method, from the weights in `path`, see
+  // PolicyNet; false if they couldn't be loaded. Every policyCheckEvery-th
+  // POLICY frame is solved by IPOPT instead, as a check on the network, and
+  // policyError is how far off the network's actuations were the last time,
+  // as the norm of the (delta, a) difference; 0 never checks. Whether the
+  // last Solve was such a check.
+  bool LoadPolicy(const std::string& path);
+  size_t policyCheckEvery;
+  double policyError;
+  bool checkedPolicy;
+  // Anytime mode: have Ipopt keep its best feasible iterate, and answer with
+  // it when a solve doesn't converge.
+  bool anytime;
+  // Stop an IPOPT solve as soon as it diverges, stalls or enters the
+  // restoration phase, see MPC_NLP::abortHopeless, and answer as for one
+  // that failed: from the best feasible iterate, or the fallback, with the
+  // rest of the time left to it.
+  bool abortHopeless;
+
+  // Hedged solves: race each IPOPT solve against rival controllers of
+  // their own tunings, e.g. cold started or with another linear solver or
+  // Hessian, on threads of their own, answer with the first to converge
+  // and stop the others at their next iteration. Without any converging it
+  // is this controller's answer. The rivals see every frame this
+  // controller solves with IPOPT, for warm starts of their own, and must
+  // solve with thread-safe linear solvers to actually run in parallel, see
+  // serializeIpopt. raceWinner is who answered the last Solve: 0 for this
+  // controller, i for the i-th rival added, -1 without a race.
+  void AddRival(const MpcConfig& config, bool warmStart);
+  size_t rivals() const { return rivals_.size(); }
+  int raceWinner;
+  // What IPOPT solves start from: the shifted last solution, or a cached
+  // or stored one, else zeros; zeros always; the rollout of holding the
+  // path's curvature at the car, or of the LQR law in closed loop; or the
+  // rollout of the nominal of a pass of MPPI, see MpcConfig::mppiSamples,
+  // for Ipopt to polish in at most polishIterations, answering with the
+  // best feasible iterate if it doesn't converge in them. MPPI lands in the
+  // basin of the better optimum where a cold start from zero doesn't, in
+  // sharp turns.
+  enum Start {
+    WARM_START,
+    ZERO_START,
+    CURVATURE_START,
+    FALLBACK_START,
+    MPPI_START
+  };
+  Start start;
+  int polishIterations;
+  // Multi-start: a rival of this tuning that starts from `start`, so that
+  // in sharp turns some start is in the basin of the better optimum. With
+  // lowestCost the race waits for every solve and answers with the
+  // converged one of lowest cost instead of the first.
+  void AddStart(Start start);
+  bool lowestCost;
+
+  // Pick N and dt per frame from the speed and solve times, among the
+  // scheduler's candidates. Only the IPOPT method; the others keep the
+  // default horizon.
+  bool adaptiveHorizon;
+  HorizonScheduler scheduler;
+
+  // Step down from the configured method through cheaper ones while frames
+  // miss their deadline: a shorter Ipopt horizon, RTI, the LTV QP and LQR.
+  // The ladder's tier overrides method and adaptiveHorizon, except at
+  // FULL_NMPC; a floor on the ladder holds even without degrade, see
+  // DegradationLadder::SetFloor. Whether the last Solve moved the ladder
+  // to another tier; it counts its moves, see stepDowns() and stepUps().
+  bool degrade;
+  DegradationLadder ladder;
+  bool ladderStep;
+  // Pick each frame's tier before solving it instead, as the most accurate
+  // that `predictor` expects to meet the deadline, and teach the predictor
+  // every solve; the ladder's floor still holds, and it doesn't move
+  // meanwhile. hostLoad is the host's utilization, 0 to 1, for the caller
+  // to set before each Solve. The tier of the last Solve, NUM_TIERS if it
+  // didn't solve, tracking a plan, on the fast path or from the cache or
+  // the table, and what the predictor expected it to take, -1 if it didn't
+  // predict.
+  bool predictTier;
+  SolveTimePredictor predictor;
+  double hostLoad;
+  DegradationLadder::Tier tier() const { return tier_; }
+  double predictedSeconds() const { return predicted_seconds_; }
+  // Energy mode, for units on battery: run each frame at the cheapest tier
+  // that keeps the car within governor.errorBound of the path, or at the
+  // ladder's or the predictor's tier where that is cheaper still. Metered
+  // by energyMeter, shared and outliving the controller, if not null.
+  // Whether the last Solve moved the governor to another tier.
+  bool energyMode;
+  EnergyGovernor governor;
+  EnergyMeter* energyMeter;
+  bool energyStep;
+
+  // Hybrid mode: on the straights `segments` finds, answer with the LQR
+  // law, which holds the car on a straight line as well as any solver, and
+  // hand back to the method where the path bends or the errors grow. Takes
+  // precedence over the ladder. Whether the last Solve took the LQR's fast
+  // path.
+  bool hybridLqr;
+  SegmentDetector segments;
+  bool usedFastPath;
+
+  // Set while solving a predicted frame ahead of its telemetry. The IPOPT
+  // method then takes the next non-speculative Solve to be for the same
+  // frame, and starts it from the speculative solution without shifting.
+  // Speculative solves don't count for the ladder.
+  bool speculative;
+  // The method of the last Solve, after the ladder.
+  Method active() const { return active_; }
+  const MpcConfig& config() const { return config_; }
+
+  // Run one Ipopt solve at a time across all MPC instances. MUMPS, the
+  // linear solver our Ipopt 3.12 builds come with, isn't reentrant; this is
+  // off by default with the thread-safe HSL solvers, see
+  // MpcConfig::linearSolver.
+  bool serializeIpopt;
+
+  // The answer of a Solve, into memory the caller owns: the first
+  // actuations, and the predicted trajectory in vehicle coordinates as up to
+  // `capacity` points into x and y, of which Solve writes `size`.
+  struct Result {
+    double delta;
+    double a;
+    double* x;
+    double* y;
+    size_t capacity;
+    size_t size;
+  };
+
+  // Solve the model given an initial state [x, y, psi, v, cte, epsi] and the
+  // path's cubic, with the statistics of the solve in stats(). The IPOPT
+  // method is stopped at `deadline`, in wall-clock time. Nothing is
+  // allocated here; the solvers' buffers are all sized at construction.
+  void Solve(const State& state, const Cubic& coeffs,
+             Result& result,
+             std::chrono::steady_clock::time_point deadline =
+                 std::chrono::steady_clock::time_point::max());
+
+  // The same, returning the first actuatotions and appending the predicted
+  // trajectory to mpc_x_vals and mpc_y_vals.
+  vector<double> Solve(const Eigen::VectorXd& state,
+                       const Eigen::VectorXd& coeffs,
+                       std::vector<double>& mpc_x_vals,
+                       std::vector<double>& mpc_y_vals,
+                       std::chrono::steady_clock::time_point deadline =
+                           std::chrono::steady_clock::time_point::max());
+
+  // The first-order update of the last factored IPOPT solution to this state
+  // and path, see sensitivity: what Solve would answer, near it, in
+  // microseconds, as when telemetry arrives mid-solve. False with no
+  // factored solution. It is closest for the frame that solution was for,
+  // and so best after a speculative Solve.
+  bool Predict(const State& state, const Cubic& coeffs, Result& result);
+
+  // One of a batch of independent problems: a state and path as Solve
+  // takes them.
+  struct BatchProblem {
+    State state;
+    Cubic coeffs;
+  };
+  // Solve `count` independent problems into results, and their outcomes
+  // into statuses unless null, spread over batchThreads threads, 0 for one
+  // per core, each taking the next problem as it finishes one. Each thread
+  // has a controller of this one's config and method, built on the first
+  // batch and kept, with its tapes and solver workspace, for the next; the
+  // threads need numbers of SetupThreads. IPOPT solves each problem from a
+  // cold start, without the solution cache, so its answer doesn't depend
+  // on which thread got it or what that thread solved before. This
+  // controller's own state is left alone. Unless deadlines is null, problem
+  // k's IPOPT solve is stopped at deadlines[k], as Solve's is; the problems
+  // are taken in order, so put the earliest first.
+  void SolveBatch(const BatchProblem* problems, Result* results,
+                  size_t count, Status* statuses = nullptr,
+                  const std::chrono::steady_clock::time_point* deadlines =
+                      nullptr);
+  size_t batchThreads;
+  // With LINEAR_TIME_VARYING and the RICCATI formulation, SolveBatch's
+  // threads take the problems a lane group at a time and solve each group
+  // at once across SIMD lanes, see BatchLTV: 4 lanes of double, or 8 of
+  // float with MPC_SINGLE_PRECISION. Each problem starts cold there, as a
+  // new controller's first LTV solve, where the threads' LTVMPCs otherwise
+  // linearize about the last problem they solved. No deadlines.
+  bool laneBatch;
+
+ private:
+  Input SolveIpopt(size_t index, const State& state,
+                   const Cubic& coeffs,
+                   std::vector<double>& mpc_x_vals,
+                   std::vector<double>& mpc_y_vals,
+                   std::chrono::steady_clock::time_point deadline);
+
+  // The NLP for one horizon.
+  struct Problem {
+    Horizon horizon;
+    // Owns the cost/constraint tape, recorded once at construction.
+    Ipopt::SmartPtr<MPC_NLP> nlp;
+    // Long-lived solver, re-optimized on nlp every frame.
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+    // Solves nlp instead of app with MpcConfig::INTERIOR_POINT, else NULL.
+    std::shared_ptr<InteriorPoint> interior;
+    bool optimized;
+    // Whether nlp holds a successful solution to warm start from.
+    bool has_solution;
+    // Whether that solution is from a speculative Solve.
+    bool speculated;
+    // Where nlp's variables and constraints are, see MPC.cpp.
+    std::shared_ptr<const Layout> layout;
+    // The weights of config_ and the cost-to-go of the horizon, as the
+    // tape's parameters take them, see Layout::cost_param.
+    MPC_NLP::Dvector cost_params;
+  };
+  // Keep the solution x of problems_[index] as the plan.
+  void StorePlan(size_t index, const State& state, const Cubic& coeffs,
+                 const MPC_NLP::Dvector& x);
+  // Where the plan is at `now`, from its stage k, and its inputs there;
+  // false once past its last stage.
+  bool PlanAt(std::chrono::steady_clock::time_point now, size_t& k,
+              State& planned, Input& feedforward) const;
+  // Whether the event trigger holds off for state and coeffs.
+  bool NearPlan(const State& state, const Cubic& coeffs,
+                const State& planned) const;
+  // The actuations and trajectory that track the plan from there.
+  void FollowPlan(size_t k, const State& planned, const Input& feedforward,
+                  const State& state, const Cubic& coeffs,
+                  std::vector<double>& mpc_x_vals,
+                  std::vector<double>& mpc_y_vals, Input& result);
+  // SolveIpopt raced against the rivals.
+  Input Race(size_t index, const State& state, const Cubic& coeffs,
+             std::vector<double>& mpc_x_vals,
+             std::vector<double>& mpc_y_vals,
+             std::chrono::steady_clock::time_point deadline);
+  // Initialize vars to the rollout from state of the start's law.
+  void SeedRollout(MPC_NLP::Dvector& vars, const State& state,
+                   const Cubic& coeffs, const Problem& problem) const;
+  // Fill the obstacle slots of the problem laid out by L for the
+  // trajectory in vars, or, without one, for going straight on from state:
+  // their discs into params_ and their bounds, which switch off the slots
+  // left empty.
+  void PlaceObstacles(const Layout& L, const MPC_NLP::Dvector& vars,
+                      bool trajectory, const State& state, double dt,
+                      MPC_NLP& nlp);
+  // The trajectory of holding u from state over the default horizon.
+  void HoldTrajectory(const State& state, const Cubic& coeffs,
+                      const Input& u, std::vector<double>& mpc_x_vals,
+                      std::vector<double>& mpc_y_vals) const;
+
+  static Problem NewProblem(const MpcConfig& config, size_t N, double dt,
+                            bool analyticDerivatives,
+                            const std::shared_ptr<StagePool>& stages);
+
+  MpcConfig config_;
+  // Shared by the problems long enough to split, if config_ asks for it.
+  std::shared_ptr<StagePool> stages_;
+  // One per scheduler candidate, by index, and last the short horizon of
+  // the ladder.
+  std::vector<Problem> problems_;
+  size_t short_index_;
+  // Whether Retune can take up refV, see there.
+  bool Retunable(double refV) const;
+  // The problem solved last.
+  size_t current_;
+  // The method of the last Solve, after the ladder.
+  Method active_;
+  SolveStats stats_;
+  DegradationLadder::Tier tier_;
+  double predicted_seconds_;
+  // The iterations of the last Solve, for the predictor's next.
+  int last_iterations_;
+  // config_'s problem over the first horizon, for the backends built on it.
+  std::shared_ptr<const ProblemIR> problem_;
+  RTI rti_;
+  // In single precision with MPC_SINGLE_PRECISION.
+  BasicLTVMPC<CoreScalar> ltv_;
+  LateralLQR lqr_;
+  MPPI mppi_;
+  ScenarioMPC robust_;
+  std::unique_ptr<FrenetMPC> frenet_;
+  // The tape's dynamic parameters, rewritten by each IPOPT Solve, and the
+  // predicted trajectory of the last Solve, reserved for the longest horizon.
+  MPC_NLP::Dvector params_;
+  std::vector<double> trajectory_x_;
+  std::vector<double> trajectory_y_;
+  // The trajectory of MPPI_START's pass, unused.
+  std::vector<double> seed_x_;
+  std::vector<double> seed_y_;
+  // PlaceObstacles' world positions of the stages and the discs near them.
+  std::vector<double> obstacle_x_;
+  std::vector<double> obstacle_y_;
+  std::vector<uint32_t> obstacle_near_;
+  std::vector<double> obstacle_clearance_;
+  std::vector<size_t> obstacle_count_;
+  // The factored solution, of problems_[sensitivity_index_], and whether the
+  // last Solve converged for Prepare() to factor it.
+  Sensitivity sensitivity_;
+  size_t sensitivity_index_;
+  bool factor_pending_;
+  // Set during WarmUp: no table, cache or scheduler.
+  bool warming_;
+  MPC_NLP::Dvector predicted_;
+  MPC_NLP::Dvector predict_params_;
+  // The plan: the inputs of the last IPOPT solve, the states they lead to at
+  // the times plan_t_ from it, over plan_stages_ stages (0 without one), the
+  // path it was for, and the frames tracked since the solve at plan_time_.
+  Eigen::MatrixXd plan_u_;
+  Eigen::MatrixXd plan_x_;
+  Cubic plan_coeffs_;
+  std::vector<double> plan_t_;
+  size_t plan_stages_;
+  size_t plan_frames_;
+  // Whether the plan is of the last Solve.
+  bool plan_fresh_;
+  std::chrono::steady_clock::time_point plan_time_;
+  std::unique_ptr<SolutionCache> cache_;
+  std::unique_ptr<TrackWarmStarts> warm_starts_;
+  std::unique_ptr<ControlTable> table_;
+  std::unique_ptr<MotionPrimitives> primitives_;
+  // The rivals, their answers and the buffers for them, the thread each
+  // races on, how many are still at it, and what stops the losers: this
+  // controller's flag, which rivals point at the flag of the controller
+  // they race for.
+  std::vector<std::unique_ptr<MPC> > rivals_;
+  std::vector<std::vector<double> > rival_x_;
+  std::vector<std::vector<double> > rival_y_;
+  std::vector<Result> rival_answers_;
+  std::vector<std::unique_ptr<WorkerPool> > race_workers_;
+  std::mutex race_mutex_;
+  std::condition_variable race_done_;
+  size_t race_pending_;
+  std::atomic<bool> race_stop_;
+  const std::atomic<bool>* cancel_;
+  // SolveBatch's controllers, each built, solving and destroyed on its
+  // thread of batch_workers_.
+  std::unique_ptr<WorkerPool> batch_workers_;
+  std::vector<std::unique_ptr<MPC> > batch_;
+  // A lane group of SolveBatch's problems on this, a batch controller, into
+  // their results and statuses; its BatchLTV is built on the first, on the
+  // controller's thread, with the group's states and paths.
+  typedef BatchLTV<CoreScalar, sizeof(CoreScalar) == 4 ? 8 : 4> LaneBatch;
+  void SolveLanes(const BatchProblem* problems, Result* results,
+                  size_t count, Status* statuses);
+  std::unique_ptr<LaneBatch> lanes_;
+  States lane_states_;
+  Cubics lane_coeffs_;
+  PolicyNet policy_;
+  // POLICY frames since the last check.
+  size_t policy_frames_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
 #endif /* MPC_H */
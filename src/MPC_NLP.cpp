@@ -0,0 +1,1215 @@
+#include "MPC_NLP.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <unistd.h>
+#include <coin/IpIpoptData.hpp>
+#include "PerfCounters.h"
+#include "Trace.h"
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+// Pattern cache files hold a header, then the row and the column indices of
+// the Jacobian pattern and of the Hessian pattern, and the indices of the
+// Jacobian entries constant in x, all in native byte order: the cache is
+// local to the machine.
+static const char PATTERN_MAGIC[4] = {'M', 'S', 'P', 'C'};
+static const uint32_t PATTERN_VERSION = 2;
+
+namespace {
+
+struct PatternHeader {
+  char magic[4];
+  uint32_t version;
+  // The tape the patterns are of, as far as its sizes tell it apart.
+  uint64_t n;
+  uint64_t m;
+  uint64_t size_var;
+  uint64_t size_op;
+  uint64_t jac_nnz;
+  uint64_t hes_nnz;
+  uint64_t constant_nnz;
+};
+
+}  // namespace
+
+static bool WriteIndices(FILE* file, const CPPAD_TESTVECTOR(size_t)& v) {
+  for (size_t k = 0; k < v.size(); k++) {
+    uint64_t i = v[k];
+    if (fwrite(&i, sizeof(i), 1, file) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Read `count` indices below `bound` into `v`.
+static bool ReadIndices(FILE* file, size_t count, size_t bound,
+                        CPPAD_TESTVECTOR(size_t)& v) {
+  std::vector<uint64_t> indices(count);
+  if (fread(indices.data(), sizeof(uint64_t), count, file) != count) {
+    return false;
+  }
+  v.resize(count);
+  for (size_t k = 0; k < count; k++) {
+    if (indices[k] >= bound) {
+      return false;
+    }
+    v[k] = indices[k];
+  }
+  return true;
+}
+
+// Read an nr x nc pattern of nnz entries into `pattern`.
+static bool ReadPattern(FILE* file, size_t nr, size_t nc, size_t nnz,
+                        CppAD::sparse_rc<CPPAD_TESTVECTOR(size_t)>& pattern) {
+  std::vector<uint64_t> rc(2 * nnz);
+  if (fread(rc.data(), sizeof(uint64_t), rc.size(), file) != rc.size()) {
+    return false;
+  }
+  pattern.resize(nr, nc, nnz);
+  for (size_t k = 0; k < nnz; k++) {
+    if (rc[k] >= nr || rc[nnz + k] >= nc) {
+      return false;
+    }
+    pattern.set(k, rc[k], rc[nnz + k]);
+  }
+  return true;
+}
+
+// A tape's derivative drivers keep their colorings and the values they
+// compute in the work objects and the sparse_rcv, and the ADFun keeps the
+// Taylor coefficients of the last sweep and the dynamic parameters, so
+// those go together, one of each per thread that evaluates a shape.
+struct MPC_NLP::Sweep {
+  Sweep() : version(0) {}
+  Sweep(const Sweep& other);
+
+  // fg_fun, and the cost and the nonlinear constraints, fg_fun's rows 0
+  // and nonlinear_rows, re-recorded, and with optimize_tape optimized,
+  // without what only the linear rows take.
+  CppAD::ADFun<double> fg_fun;
+  CppAD::ADFun<double> nonlinear_fun;
+  // The constraint rows of the Jacobian, the lower triangle of the
+  // Hessian, and the varying entries of jac in nonlinear_fun's rows.
+  CppAD::sparse_rcv<Svector, Dvector> jac;
+  CppAD::sparse_jac_work jac_work;
+  CppAD::sparse_rcv<Svector, Dvector> hes;
+  CppAD::sparse_hes_work hes_work;
+  CppAD::sparse_rcv<Svector, Dvector> varying_jac;
+  CppAD::sparse_jac_work varying_work;
+  Dvector x;
+  Dvector w;
+  Dvector nonlinear_w;
+  // The version of the parameters the tapes have, 0 for none.
+  uint64_t version;
+};
+
+// ADFun can be assigned but not copy constructed.
+MPC_NLP::Sweep::Sweep(const Sweep& other)
+    : jac(other.jac), jac_work(other.jac_work), hes(other.hes),
+      hes_work(other.hes_work), varying_jac(other.varying_jac),
+      varying_work(other.varying_work), x(other.x), w(other.w),
+      nonlinear_w(other.nonlinear_w), version(0) {
+  fg_fun = other.fg_fun;
+  nonlinear_fun = other.nonlinear_fun;
+}
+
+struct MPC_NLP::ResidualSweep {
+  ResidualSweep() : version(0) {}
+  ResidualSweep(const ResidualSweep& other)
+      : residual_jac(other.residual_jac), residual_work(other.residual_work),
+        x(other.x), version(0) {
+    residual_fun = other.residual_fun;
+  }
+
+  CppAD::ADFun<double> residual_fun;
+  CppAD::sparse_rcv<Svector, Dvector> residual_jac;
+  CppAD::sparse_jac_work residual_work;
+  Dvector x;
+  // The version of the parameters the tape has, as Sweep's.
+  uint64_t version;
+};
+
+namespace {
+
+// The sweeps of a shape: the one its tapes were recorded into, which, when
+// the shape is shared, is only ever copied, and a copy of it for each
+// CppAD thread number that evaluates the shape. A number is used by one
+// thread at a time, and MPC::Allocator gives a session moving between
+// threads its own, so no two threads sweep a copy at once and a copy's
+// memory stays with its number. Unshared, the recorded sweep is the only
+// one, as the tapes were the problem's.
+template <class S>
+struct Sweeps {
+  Sweeps(S* recorded, bool shared)
+      : recorded(recorded), shared(shared), copies(0) {}
+
+  S& Get() {
+    if (!shared) {
+      return *recorded;
+    }
+    std::unique_ptr<S>& copy = slots[CppAD::thread_alloc::thread_num()];
+    if (!copy) {
+      copy.reset(new S(*recorded));
+      copies++;
+    }
+    return *copy;
+  }
+
+  // How many sweeps there are.
+  size_t count() const { return shared ? copies.load() : 1; }
+
+  std::unique_ptr<S> recorded;
+  bool shared;
+  std::unique_ptr<S> slots[CPPAD_MAX_NUM_THREADS];
+  std::atomic<size_t> copies;
+};
+
+// What tells two tapes apart: their sizes, whether they were optimized,
+// and their values at an arbitrary point and parameters.
+struct TapeKey {
+  bool optimized;
+  size_t n;
+  size_t range;
+  size_t n_params;
+  size_t size_var;
+  size_t size_op;
+  std::vector<double> probe;
+
+  bool operator==(const TapeKey& other) const {
+    return optimized == other.optimized && n == other.n &&
+           range == other.range && n_params == other.n_params &&
+           size_var == other.size_var && size_op == other.size_op &&
+           probe == other.probe;
+  }
+};
+
+TapeKey KeyOf(CppAD::ADFun<double>& fun, bool optimized) {
+  TapeKey key;
+  key.optimized = optimized;
+  key.n = fun.Domain();
+  key.range = fun.Range();
+  key.n_params = fun.size_dyn_ind();
+  key.size_var = fun.size_var();
+  key.size_op = fun.size_op();
+  // Small, so that no model overflows there, and different in every
+  // variable and parameter.
+  CPPAD_TESTVECTOR(double) x(key.n);
+  CPPAD_TESTVECTOR(double) params(key.n_params);
+  for (size_t i = 0; i < key.n; i++) {
+    x[i] = 0.1 * std::sin(1.0 + i);
+  }
+  for (size_t i = 0; i < key.n_params; i++) {
+    params[i] = 0.1 * std::cos(1.0 + i);
+  }
+  if (key.n_params > 0) {
+    fun.new_dynamic(params);
+  }
+  CPPAD_TESTVECTOR(double) y = fun.Forward(0, x);
+  key.probe.assign(y.data(), y.data() + y.size());
+  return key;
+}
+
+// The shapes of the process by their tapes' keys. They are kept for the
+// process, as few as there are configurations, for the next problem of
+// theirs, and so that no sweep is freed on a thread but its own.
+template <class T>
+class ShapeRegistry {
+ public:
+  std::shared_ptr<T> Find(const TapeKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return FindLocked(key);
+  }
+
+  // Add `shape`, unless another of the same key was meanwhile: returns the
+  // one registered.
+  std::shared_ptr<T> Add(const TapeKey& key, const std::shared_ptr<T>& shape) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<T> found = FindLocked(key);
+    if (found) {
+      return found;
+    }
+    shapes_.emplace_back(key, shape);
+    return shape;
+  }
+
+ private:
+  std::shared_ptr<T> FindLocked(const TapeKey& key) {
+    for (const auto& entry : shapes_) {
+      if (entry.first == key) {
+        return entry.second;
+      }
+    }
+    return nullptr;
+  }
+
+  std::mutex mutex_;
+  std::vector<std::pair<TapeKey, std::shared_ptr<T> > > shapes_;
+};
+
+// The problems holding `shape`, without the registry when it is shared.
+template <class T>
+size_t Sharers(const std::shared_ptr<T>& shape) {
+  return shape.use_count() - (shape->sweeps.shared ? 1 : 0);
+}
+
+// The versions of SetParameters, from 1.
+std::atomic<uint64_t> parameter_versions(0);
+
+}  // namespace
+
+// Everything derived from a tape of fg that doesn't change with the
+// parameters, with the tape's sweeps.
+struct MPC_NLP::Shape {
+  Shape(Sweep* recorded, bool shared) : sweeps(recorded, shared) {}
+
+  // Compute the patterns, or read them from the cache in `directory`
+  // unless it is empty, and color them.
+  void Build(const std::string& directory, bool optimize);
+  // The pattern cache file in `directory`.
+  std::string PatternCachePath(const std::string& directory) const;
+  // Read jac_pattern and hes_pattern from the cache file at `path`, false
+  // if it is missing, of another tape or damaged; or write them to it.
+  bool LoadPatterns(const std::string& path);
+  bool SavePatterns(const std::string& path) const;
+  // The rows of fg_fun with no second derivatives and the Jacobian entries
+  // that don't depend on x, from each row's Hessian pattern.
+  void FindConstantEntries();
+  // Record nonlinear_fun from fg_fun and set up its derivatives.
+  void InitializeNonlinear(bool optimize);
+  size_t TapeBytes() const;
+  size_t WorkspaceBytes() const;
+
+  size_t n;
+  size_t m;
+  // Full sparsity patterns of fg and of the Lagrangian Hessian.
+  CppAD::sparse_rc<Svector> jac_pattern;
+  CppAD::sparse_rc<Svector> hes_pattern;
+  // Linear constraints, and whether each of the sweeps' jac entries is
+  // constant in x; the latter's index in jac_pattern, for the pattern
+  // cache.
+  std::vector<bool> linear;
+  std::vector<bool> constant;
+  Svector constant_entries;
+  // nonlinear_fun's rows in fg_fun and its Jacobian's pattern, and the
+  // index in jac of each of varying_jac's entries.
+  std::vector<size_t> nonlinear_rows;
+  CppAD::sparse_rc<Svector> nonlinear_pattern;
+  std::vector<size_t> varying_slots;
+  Sweeps<Sweep> sweeps;
+};
+
+// Gauss-Newton: the residual Jacobian's pattern, the lower triangle of
+// J_r^T J_r, and for each product of two entries in a row of J_r a triple
+// of the two entries and the Hessian entry it adds to.
+struct MPC_NLP::ResidualShape {
+  ResidualShape(ResidualSweep* recorded, bool shared)
+      : sweeps(recorded, shared) {}
+
+  void Build();
+  size_t TapeBytes() const;
+  size_t WorkspaceBytes() const;
+
+  CppAD::sparse_rc<Svector> residual_pattern;
+  std::vector<Ipopt::Index> gn_rows;
+  std::vector<Ipopt::Index> gn_cols;
+  std::vector<size_t> gn_terms;
+  Sweeps<ResidualSweep> sweeps;
+};
+
+MPC_NLP::MPC_NLP()
+    : optimize_tape(true), share_tapes(false),
+      obj_scaling(1),
+      deadline(std::chrono::steady_clock::time_point::max()),
+      deadline_reached(false), cancel(nullptr), abortHopeless(false),
+      abortOnRestoration(true), divergenceFactor(100),
+      divergenceIterations(3), stallIterations(15), aborted(NOT_ABORTED),
+      track_best(false),
+      feasibility_tol(1e-6),
+      has_best(false), best_obj_value(0), best_violation(0), best_iter(0),
+      iterations(0), eval_seconds(0), linear_solve_seconds(0),
+      restorations(0), status(Ipopt::UNASSIGNED), obj_value(0), violation(0),
+      n_(0), m_(0), params_version_(0), restoring_(false), lowest_inf_pr_(0),
+      diverging_(0), stall_mu_(0), stall_inf_pr_(0), stalled_(0),
+      constants_stale_(true) {}
+MPC_NLP::~MPC_NLP() {}
+
+void MPC_NLP::Initialize(CppAD::ADFun<double>& fg_fun) {
+  n_ = fg_fun.Domain();
+  m_ = fg_fun.Range() - 1;
+
+  x_init.resize(n_);
+  z_l_init.resize(n_);
+  z_u_init.resize(n_);
+  lambda_init.resize(m_);
+  x_lowerbound.resize(n_);
+  x_upperbound.resize(n_);
+  g_lowerbound.resize(m_);
+  g_upperbound.resize(m_);
+  x_scaling.resize(n_);
+  g_scaling.resize(m_);
+  for (size_t i = 0; i < n_; i++) {
+    x_scaling[i] = 1;
+  }
+  for (size_t i = 0; i < m_; i++) {
+    g_scaling[i] = 1;
+  }
+  x.resize(n_);
+  z_l.resize(n_);
+  z_u.resize(n_);
+  lambda.resize(m_);
+  fg_.resize(m_ + 1);
+  best_x.resize(n_);
+  last_x_.resize(n_);
+  last_g_.resize(m_);
+  for (size_t i = 0; i < n_; i++) {
+    best_x[i] = 0;
+    last_x_[i] = 0;
+    x_init[i] = 0;
+    z_l_init[i] = 0;
+    z_u_init[i] = 0;
+    x[i] = 0;
+    z_l[i] = 0;
+    z_u[i] = 0;
+  }
+  for (size_t i = 0; i < m_; i++) {
+    lambda_init[i] = 0;
+    lambda[i] = 0;
+  }
+  // Until SetParameters, the parameters are 0, as recorded.
+  params_.resize(fg_fun.size_dyn_ind());
+  for (size_t i = 0; i < params_.size(); i++) {
+    params_[i] = 0;
+  }
+  params_version_ = ++parameter_versions;
+
+  // Never destroyed, see ShapeRegistry.
+  static ShapeRegistry<Shape>& shapes = *new ShapeRegistry<Shape>();
+  TapeKey key;
+  shape_.reset();
+  if (share_tapes) {
+    key = KeyOf(fg_fun, optimize_tape);
+    shape_ = shapes.Find(key);
+  }
+  if (!shape_) {
+    Sweep* recorded = new Sweep();
+    recorded->fg_fun = std::move(fg_fun);
+    shape_ = std::make_shared<Shape>(recorded, share_tapes);
+    shape_->Build(pattern_cache, optimize_tape);
+    if (share_tapes) {
+      shape_ = shapes.Add(key, shape_);
+    }
+  }
+  jac_values_.resize(shape_->sweeps.recorded->jac.nnz());
+  constants_stale_ = true;
+}
+
+void MPC_NLP::Shape::Build(const std::string& directory, bool optimize) {
+  Sweep& sweep = *sweeps.recorded;
+  CppAD::ADFun<double>& fg_fun = sweep.fg_fun;
+  n = fg_fun.Domain();
+  m = fg_fun.Range() - 1;
+  sweep.x.resize(n);
+  sweep.w.resize(m + 1);
+
+  std::string cache = PatternCachePath(directory);
+  if (cache.empty() || !LoadPatterns(cache)) {
+    // Jacobian sparsity of fg, from an identity seed in forward mode.
+    CppAD::sparse_rc<Svector> eye(n, n, n);
+    for (size_t i = 0; i < n; i++) {
+      eye.set(i, i, i);
+    }
+    fg_fun.for_jac_sparsity(eye, false, false, true, jac_pattern);
+
+    // Hessian of the Lagrangian: every row of fg gets a weight.
+    CPPAD_TESTVECTOR(bool) select_range(m + 1);
+    for (size_t i = 0; i <= m; i++) {
+      select_range[i] = true;
+    }
+    fg_fun.rev_hes_sparsity(select_range, false, true, hes_pattern);
+    FindConstantEntries();
+    if (!cache.empty()) {
+      SavePatterns(cache);
+    }
+  }
+
+  // Ipopt only wants the constraint rows; row 0 is the cost gradient. A row
+  // is linear when none of its entries varies.
+  std::vector<bool> constant_pattern(jac_pattern.nnz(), false);
+  for (size_t k = 0; k < constant_entries.size(); k++) {
+    constant_pattern[constant_entries[k]] = true;
+  }
+  size_t nnz = 0;
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    if (jac_pattern.row()[k] > 0) {
+      nnz++;
+    }
+  }
+  CppAD::sparse_rc<Svector> jac_subset(m + 1, n, nnz);
+  constant.assign(nnz, false);
+  linear.assign(m, true);
+  nnz = 0;
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    size_t row = jac_pattern.row()[k];
+    if (row > 0) {
+      constant[nnz] = constant_pattern[k];
+      linear[row - 1] = linear[row - 1] && constant_pattern[k];
+      jac_subset.set(nnz++, row, jac_pattern.col()[k]);
+    }
+  }
+  sweep.jac = CppAD::sparse_rcv<Svector, Dvector>(jac_subset);
+
+  // Ipopt takes the lower triangle only.
+  nnz = 0;
+  for (size_t k = 0; k < hes_pattern.nnz(); k++) {
+    if (hes_pattern.row()[k] >= hes_pattern.col()[k]) {
+      nnz++;
+    }
+  }
+  CppAD::sparse_rc<Svector> hes_subset(n, n, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < hes_pattern.nnz(); k++) {
+    if (hes_pattern.row()[k] >= hes_pattern.col()[k]) {
+      hes_subset.set(nnz++, hes_pattern.row()[k], hes_pattern.col()[k]);
+    }
+  }
+  sweep.hes = CppAD::sparse_rcv<Svector, Dvector>(hes_subset);
+
+  // The drivers color the patterns on their first call and keep the
+  // colorings in the work objects, so one call each here, at an arbitrary
+  // point, takes that out of the first frame, and out of every copy of
+  // the sweep.
+  sweep.jac_work.clear();
+  sweep.hes_work.clear();
+  for (size_t i = 0; i < n; i++) {
+    sweep.x[i] = 0;
+  }
+  fg_fun.sparse_jac_for(1, sweep.x, sweep.jac, jac_pattern, "cppad",
+                        sweep.jac_work);
+  InitializeNonlinear(optimize);
+}
+
+void MPC_NLP::Shape::FindConstantEntries() {
+  CppAD::ADFun<double>& fg_fun = sweeps.recorded->fg_fun;
+  // An entry of row i varies with x when its column is in the pattern of
+  // the row's Hessian.
+  std::vector<std::vector<size_t> > row_entries(m + 1);
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    row_entries[jac_pattern.row()[k]].push_back(k);
+  }
+  CPPAD_TESTVECTOR(bool) select_range(m + 1);
+  std::vector<bool> varies(n);
+  std::vector<size_t> constant;
+  CppAD::sparse_rc<Svector> row_hessian;
+  for (size_t i = 1; i <= m; i++) {
+    if (row_entries[i].empty()) {
+      continue;
+    }
+    for (size_t r = 0; r <= m; r++) {
+      select_range[r] = r == i;
+    }
+    fg_fun.rev_hes_sparsity(select_range, false, true, row_hessian);
+    std::fill(varies.begin(), varies.end(), false);
+    for (size_t k = 0; k < row_hessian.nnz(); k++) {
+      varies[row_hessian.row()[k]] = true;
+    }
+    for (size_t k : row_entries[i]) {
+      if (!varies[jac_pattern.col()[k]]) {
+        constant.push_back(k);
+      }
+    }
+  }
+  constant_entries.resize(constant.size());
+  for (size_t k = 0; k < constant.size(); k++) {
+    constant_entries[k] = constant[k];
+  }
+}
+
+void MPC_NLP::Shape::InitializeNonlinear(bool optimize) {
+  Sweep& sweep = *sweeps.recorded;
+  nonlinear_rows.clear();
+  std::vector<size_t> nonlinear_row(m + 1, 0);
+  for (size_t i = 0; i < m; i++) {
+    if (!linear[i]) {
+      nonlinear_row[1 + i] = 1 + nonlinear_rows.size();
+      nonlinear_rows.push_back(1 + i);
+    }
+  }
+
+  // fg_fun replayed as operations on AD<double>, its parameters dynamic
+  // again, and only the rows kept recorded.
+  CppAD::ADFun<CppAD::AD<double>, double> replay = sweep.fg_fun.base2ad();
+  size_t n_params = sweep.fg_fun.size_dyn_ind();
+  ADvector avars(n);
+  ADvector aparams(n_params);
+  for (size_t i = 0; i < n; i++) {
+    avars[i] = 0;
+  }
+  for (size_t i = 0; i < n_params; i++) {
+    aparams[i] = 0;
+  }
+  CppAD::Independent(avars, 0, false, aparams);
+  replay.new_dynamic(aparams);
+  ADvector afg = replay.Forward(0, avars);
+  ADvector kept(1 + nonlinear_rows.size());
+  kept[0] = afg[0];
+  for (size_t r = 0; r < nonlinear_rows.size(); r++) {
+    kept[1 + r] = afg[nonlinear_rows[r]];
+  }
+  sweep.nonlinear_fun.Dependent(avars, kept);
+  if (optimize) {
+    sweep.nonlinear_fun.optimize();
+  }
+
+  // Its Jacobian's pattern is that of the rows kept, and the entries wanted
+  // of it jac's varying ones.
+  size_t nnz = 0;
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    size_t row = jac_pattern.row()[k];
+    nnz += row == 0 || nonlinear_row[row] > 0;
+  }
+  nonlinear_pattern.resize(kept.size(), n, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    size_t row = jac_pattern.row()[k];
+    if (row == 0 || nonlinear_row[row] > 0) {
+      nonlinear_pattern.set(nnz++, nonlinear_row[row], jac_pattern.col()[k]);
+    }
+  }
+  const CppAD::sparse_rcv<Svector, Dvector>& jac = sweep.jac;
+  varying_slots.clear();
+  for (size_t k = 0; k < jac.nnz(); k++) {
+    if (!constant[k]) {
+      varying_slots.push_back(k);
+    }
+  }
+  CppAD::sparse_rc<Svector> varying(kept.size(), n, varying_slots.size());
+  for (size_t v = 0; v < varying_slots.size(); v++) {
+    size_t k = varying_slots[v];
+    varying.set(v, nonlinear_row[jac.row()[k]], jac.col()[k]);
+  }
+  sweep.varying_jac = CppAD::sparse_rcv<Svector, Dvector>(varying);
+  sweep.nonlinear_w.resize(kept.size());
+  for (size_t r = 0; r < kept.size(); r++) {
+    sweep.nonlinear_w[r] = 0;
+  }
+
+  // The linear rows have no Hessian, so fg_fun's pattern is this one's.
+  sweep.varying_work.clear();
+  sweep.hes_work.clear();
+  for (size_t i = 0; i < n; i++) {
+    sweep.x[i] = 0;
+  }
+  sweep.nonlinear_fun.sparse_jac_for(1, sweep.x, sweep.varying_jac,
+                                     nonlinear_pattern, "cppad",
+                                     sweep.varying_work);
+  sweep.nonlinear_fun.sparse_hes(sweep.x, sweep.nonlinear_w, sweep.hes,
+                                 hes_pattern, "cppad.symmetric",
+                                 sweep.hes_work);
+}
+
+std::string MPC_NLP::Shape::PatternCachePath(
+    const std::string& directory) const {
+  if (directory.empty()) {
+    return std::string();
+  }
+  const CppAD::ADFun<double>& fg_fun = sweeps.recorded->fg_fun;
+  char name[128];
+  snprintf(name, sizeof(name), "/sparsity-%zu-%zu-%zu-%zu.bin", n, m,
+           size_t(fg_fun.size_var()), size_t(fg_fun.size_op()));
+  return directory + name;
+}
+
+bool MPC_NLP::Shape::LoadPatterns(const std::string& path) {
+  const CppAD::ADFun<double>& fg_fun = sweeps.recorded->fg_fun;
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  PatternHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, PATTERN_MAGIC, sizeof(header.magic)) == 0 &&
+               header.version == PATTERN_VERSION && header.n == n &&
+               header.m == m && header.size_var == fg_fun.size_var() &&
+               header.size_op == fg_fun.size_op() &&
+               ReadPattern(file, m + 1, n, header.jac_nnz, jac_pattern) &&
+               ReadPattern(file, n, n, header.hes_nnz, hes_pattern) &&
+               ReadIndices(file, header.constant_nnz, header.jac_nnz,
+                           constant_entries);
+  fclose(file);
+  return valid;
+}
+
+bool MPC_NLP::Shape::SavePatterns(const std::string& path) const {
+  const CppAD::ADFun<double>& fg_fun = sweeps.recorded->fg_fun;
+  // Written aside and renamed into place, so that controllers starting
+  // together never read a partial file.
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".%d.%p", int(getpid()),
+           static_cast<const void*>(this));
+  std::string temporary = path + suffix;
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  PatternHeader header;
+  memcpy(header.magic, PATTERN_MAGIC, sizeof(PATTERN_MAGIC));
+  header.version = PATTERN_VERSION;
+  header.n = n;
+  header.m = m;
+  header.size_var = fg_fun.size_var();
+  header.size_op = fg_fun.size_op();
+  header.jac_nnz = jac_pattern.nnz();
+  header.hes_nnz = hes_pattern.nnz();
+  header.constant_nnz = constant_entries.size();
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 WriteIndices(file, jac_pattern.row()) &&
+                 WriteIndices(file, jac_pattern.col()) &&
+                 WriteIndices(file, hes_pattern.row()) &&
+                 WriteIndices(file, hes_pattern.col()) &&
+                 WriteIndices(file, constant_entries);
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+void MPC_NLP::InitializeGaussNewton(CppAD::ADFun<double>& residual_fun) {
+  static ShapeRegistry<ResidualShape>& shapes =
+      *new ShapeRegistry<ResidualShape>();
+  TapeKey key;
+  residuals_.reset();
+  if (share_tapes) {
+    key = KeyOf(residual_fun, optimize_tape);
+    residuals_ = shapes.Find(key);
+  }
+  if (!residuals_) {
+    ResidualSweep* recorded = new ResidualSweep();
+    recorded->residual_fun = std::move(residual_fun);
+    residuals_ = std::make_shared<ResidualShape>(recorded, share_tapes);
+    residuals_->Build();
+    if (share_tapes) {
+      residuals_ = shapes.Add(key, residuals_);
+    }
+  }
+}
+
+void MPC_NLP::ResidualShape::Build() {
+  ResidualSweep& sweep = *sweeps.recorded;
+  size_t n = sweep.residual_fun.Domain();
+  size_t n_r = sweep.residual_fun.Range();
+  CppAD::sparse_rc<Svector> eye(n, n, n);
+  for (size_t i = 0; i < n; i++) {
+    eye.set(i, i, i);
+  }
+  sweep.residual_fun.for_jac_sparsity(eye, false, false, false,
+                                      residual_pattern);
+  sweep.residual_jac = CppAD::sparse_rcv<Svector, Dvector>(residual_pattern);
+  sweep.residual_work.clear();
+  sweep.x.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    sweep.x[i] = 0;
+  }
+  sweep.residual_fun.sparse_jac_for(1, sweep.x, sweep.residual_jac,
+                                    residual_pattern, "cppad",
+                                    sweep.residual_work);
+
+  // The entries of each residual's row.
+  std::vector<std::vector<size_t> > row_entries(n_r);
+  const Svector& row = residual_pattern.row();
+  const Svector& col = residual_pattern.col();
+  for (size_t k = 0; k < residual_pattern.nnz(); k++) {
+    row_entries[row[k]].push_back(k);
+  }
+  std::map<std::pair<size_t, size_t>, size_t> entries;
+  gn_rows.clear();
+  gn_cols.clear();
+  gn_terms.clear();
+  for (size_t r = 0; r < n_r; r++) {
+    const std::vector<size_t>& e = row_entries[r];
+    for (size_t a = 0; a < e.size(); a++) {
+      for (size_t b = 0; b < e.size(); b++) {
+        size_t i = col[e[a]];
+        size_t j = col[e[b]];
+        if (i < j) {
+          continue;
+        }
+        auto inserted = entries.insert({{i, j}, gn_rows.size()});
+        if (inserted.second) {
+          gn_rows.push_back(i);
+          gn_cols.push_back(j);
+        }
+        gn_terms.push_back(e[a]);
+        gn_terms.push_back(e[b]);
+        gn_terms.push_back(inserted.first->second);
+      }
+    }
+  }
+}
+
+size_t MPC_NLP::Shape::TapeBytes() const {
+  const Sweep& sweep = *sweeps.recorded;
+  // The recorded tapes are kept to copy when shared.
+  size_t tapes = sweeps.count() + (sweeps.shared ? 1 : 0);
+  return tapes *
+         (sweep.fg_fun.size_op_seq() + sweep.nonlinear_fun.size_op_seq());
+}
+
+size_t MPC_NLP::ResidualShape::TapeBytes() const {
+  size_t tapes = sweeps.count() + (sweeps.shared ? 1 : 0);
+  return tapes * sweeps.recorded->residual_fun.size_op_seq();
+}
+
+size_t MPC_NLP::Shape::WorkspaceBytes() const {
+  const Sweep& sweep = *sweeps.recorded;
+  size_t doubles = sweep.x.size() + sweep.w.size() + sweep.nonlinear_w.size() +
+                   sweep.jac.nnz() + sweep.hes.nnz() + sweep.varying_jac.nnz();
+  size_t entries = jac_pattern.nnz() + hes_pattern.nnz() +
+                   nonlinear_pattern.nnz() + sweep.jac.nnz() +
+                   sweep.hes.nnz() + sweep.varying_jac.nnz();
+  return sweeps.count() * doubles * sizeof(double) +
+         entries * 2 * sizeof(size_t) +
+         (constant_entries.size() + varying_slots.size() +
+          nonlinear_rows.size()) * sizeof(size_t);
+}
+
+size_t MPC_NLP::ResidualShape::WorkspaceBytes() const {
+  const ResidualSweep& sweep = *sweeps.recorded;
+  size_t doubles = sweep.x.size() + sweep.residual_jac.nnz();
+  return sweeps.count() * doubles * sizeof(double) +
+         residual_pattern.nnz() * 2 * sizeof(size_t) +
+         (gn_rows.size() + gn_cols.size()) * sizeof(Ipopt::Index) +
+         gn_terms.size() * sizeof(size_t);
+}
+
+size_t MPC_NLP::sharers() const { return shape_ ? Sharers(shape_) : 1; }
+
+bool MPC_NLP::linear(size_t i) const { return shape_->linear[i]; }
+
+size_t MPC_NLP::varyingJacobianEntries() const {
+  return shape_->varying_slots.size();
+}
+
+size_t MPC_NLP::TapeBytes() const {
+  size_t bytes = 0;
+  if (shape_) {
+    bytes += shape_->TapeBytes() / Sharers(shape_);
+  }
+  if (residuals_) {
+    bytes += residuals_->TapeBytes() / Sharers(residuals_);
+  }
+  return bytes;
+}
+
+size_t MPC_NLP::WorkspaceBytes() const {
+  const Dvector* vectors[] = {
+      &x_init, &z_l_init, &z_u_init, &lambda_init, &x_lowerbound,
+      &x_upperbound, &g_lowerbound, &g_upperbound, &x_scaling, &g_scaling,
+      &best_x, &x, &z_l, &z_u, &lambda, &params_, &fg_, &last_x_, &last_g_,
+      &jac_values_};
+  size_t doubles = 0;
+  for (const Dvector* v : vectors) {
+    doubles += v->size();
+  }
+  size_t bytes = doubles * sizeof(double);
+  size_t kkt = n_ + m_;
+  if (shape_) {
+    bytes += shape_->WorkspaceBytes() / Sharers(shape_);
+    kkt += shape_->sweeps.recorded->jac.nnz();
+    kkt += residuals_ ? residuals_->gn_rows.size()
+                      : shape_->sweeps.recorded->hes.nnz();
+  }
+  if (residuals_) {
+    bytes += residuals_->WorkspaceBytes() / Sharers(residuals_);
+  }
+  return bytes + kkt * (sizeof(Ipopt::Number) + 2 * sizeof(Ipopt::Index));
+}
+
+void MPC_NLP::SetParameters(const Dvector& params) {
+  params_ = params;
+  params_version_ = ++parameter_versions;
+  constants_stale_ = true;
+}
+
+MPC_NLP::Sweep& MPC_NLP::Checkout() {
+  Sweep& sweep = shape_->sweeps.Get();
+  if (sweep.version != params_version_) {
+    sweep.fg_fun.new_dynamic(params_);
+    sweep.nonlinear_fun.new_dynamic(params_);
+    sweep.version = params_version_;
+  }
+  return sweep;
+}
+
+void MPC_NLP::Forward(Sweep& sweep, const Number* x) {
+  for (size_t i = 0; i < n_; i++) {
+    sweep.x[i] = x[i];
+  }
+  fg_ = sweep.fg_fun.Forward(0, sweep.x);
+}
+
+bool MPC_NLP::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
+                           Index& nnz_h_lag, IndexStyleEnum& index_style) {
+  n = n_;
+  m = m_;
+  const Sweep& sweep = *shape_->sweeps.recorded;
+  nnz_jac_g = sweep.jac.nnz();
+  nnz_h_lag = residuals_ ? residuals_->gn_rows.size() : sweep.hes.nnz();
+  index_style = C_STYLE;
+  return true;
+}
+
+bool MPC_NLP::get_bounds_info(Index n, Number* x_l, Number* x_u, Index m,
+                              Number* g_l, Number* g_u) {
+  for (Index i = 0; i < n; i++) {
+    x_l[i] = x_lowerbound[i];
+    x_u[i] = x_upperbound[i];
+  }
+  for (Index i = 0; i < m; i++) {
+    g_l[i] = g_lowerbound[i];
+    g_u[i] = g_upperbound[i];
+  }
+  return true;
+}
+
+bool MPC_NLP::get_scaling_parameters(Number& obj_scaling,
+                                     bool& use_x_scaling, Index n,
+                                     Number* x_scaling, bool& use_g_scaling,
+                                     Index m, Number* g_scaling) {
+  obj_scaling = this->obj_scaling;
+  use_x_scaling = true;
+  use_g_scaling = true;
+  for (Index i = 0; i < n; i++) {
+    x_scaling[i] = this->x_scaling[i];
+  }
+  for (Index i = 0; i < m; i++) {
+    g_scaling[i] = this->g_scaling[i];
+  }
+  return true;
+}
+
+bool MPC_NLP::get_constraints_linearity(Index m, LinearityType* const_types) {
+  for (Index i = 0; i < m; i++) {
+    const_types[i] = shape_->linear[i] ? LINEAR : NON_LINEAR;
+  }
+  return true;
+}
+
+bool MPC_NLP::get_starting_point(Index n, bool init_x, Number* x, bool init_z,
+                                 Number* z_L, Number* z_U, Index m,
+                                 bool init_lambda, Number* lambda) {
+  iteration_start_ = std::chrono::steady_clock::now();
+  restorations = 0;
+  restoring_ = false;
+  aborted = NOT_ABORTED;
+  if (init_x) {
+    for (Index i = 0; i < n; i++) {
+      x[i] = x_init[i];
+    }
+  }
+  if (init_z) {
+    for (Index i = 0; i < n; i++) {
+      z_L[i] = z_l_init[i];
+      z_U[i] = z_u_init[i];
+    }
+  }
+  if (init_lambda) {
+    for (Index i = 0; i < m; i++) {
+      lambda[i] = lambda_init[i];
+    }
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_f(Index n, const Number* x, bool new_x, Number& obj_value) {
+  PerfScope counts(STAGE_EVAL);
+  if (new_x) {
+    Forward(Checkout(), x);
+  }
+  obj_value = fg_[0];
+  return true;
+}
+
+bool MPC_NLP::eval_grad_f(Index n, const Number* x, bool new_x,
+                          Number* grad_f) {
+  PerfScope counts(STAGE_EVAL);
+  // The reverse sweep needs the zero order Taylor coefficients at x, which the
+  // sparse derivative drivers may have overwritten since the last eval_f.
+  Sweep& sweep = Checkout();
+  Forward(sweep, x);
+  sweep.w[0] = 1;
+  for (size_t i = 1; i <= m_; i++) {
+    sweep.w[i] = 0;
+  }
+  Dvector grad = sweep.fg_fun.Reverse(1, sweep.w);
+  for (Index i = 0; i < n; i++) {
+    grad_f[i] = grad[i];
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_g(Index n, const Number* x, bool new_x, Index m,
+                     Number* g) {
+  PerfScope counts(STAGE_EVAL);
+  NotePoint(x);
+  if (new_x) {
+    Forward(Checkout(), x);
+  }
+  for (Index i = 0; i < m; i++) {
+    g[i] = fg_[1 + i];
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_jac_g(Index n, const Number* x, bool new_x, Index m,
+                         Index nele_jac, Index* iRow, Index* jCol,
+                         Number* values) {
+  PerfScope counts(STAGE_EVAL);
+  const Shape& shape = *shape_;
+  if (values == NULL) {
+    const CppAD::sparse_rcv<Svector, Dvector>& jac = shape.sweeps.recorded->jac;
+    for (size_t k = 0; k < jac.nnz(); k++) {
+      iRow[k] = jac.row()[k] - 1;
+      jCol[k] = jac.col()[k];
+    }
+    return true;
+  }
+  Sweep& sweep = Checkout();
+  for (size_t i = 0; i < n_; i++) {
+    sweep.x[i] = x[i];
+  }
+  if (constants_stale_) {
+    // The whole of it once a frame, for the constant entries.
+    sweep.fg_fun.sparse_jac_for(1, sweep.x, sweep.jac, shape.jac_pattern,
+                                "cppad", sweep.jac_work);
+    for (size_t k = 0; k < sweep.jac.nnz(); k++) {
+      jac_values_[k] = sweep.jac.val()[k];
+    }
+    constants_stale_ = false;
+  } else {
+    sweep.nonlinear_fun.sparse_jac_for(1, sweep.x, sweep.varying_jac,
+                                       shape.nonlinear_pattern, "cppad",
+                                       sweep.varying_work);
+    for (size_t v = 0; v < shape.varying_slots.size(); v++) {
+      jac_values_[shape.varying_slots[v]] = sweep.varying_jac.val()[v];
+    }
+  }
+  for (size_t k = 0; k < jac_values_.size(); k++) {
+    values[k] = jac_values_[k];
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_h(Index n, const Number* x, bool new_x, Number obj_factor,
+                     Index m, const Number* lambda, bool new_lambda,
+                     Index nele_hess, Index* iRow, Index* jCol,
+                     Number* values) {
+  PerfScope counts(STAGE_EVAL);
+  if (residuals_) {
+    return GaussNewtonHessian(x, obj_factor, iRow, jCol, values);
+  }
+  const Shape& shape = *shape_;
+  if (values == NULL) {
+    const CppAD::sparse_rcv<Svector, Dvector>& hes = shape.sweeps.recorded->hes;
+    for (size_t k = 0; k < hes.nnz(); k++) {
+      iRow[k] = hes.row()[k];
+      jCol[k] = hes.col()[k];
+    }
+    return true;
+  }
+  Sweep& sweep = Checkout();
+  for (size_t i = 0; i < n_; i++) {
+    sweep.x[i] = x[i];
+  }
+  // The linear constraints' multipliers weigh nothing.
+  sweep.nonlinear_w[0] = obj_factor;
+  for (size_t r = 0; r < shape.nonlinear_rows.size(); r++) {
+    sweep.nonlinear_w[1 + r] = lambda[shape.nonlinear_rows[r] - 1];
+  }
+  sweep.nonlinear_fun.sparse_hes(sweep.x, sweep.nonlinear_w, sweep.hes,
+                                 shape.hes_pattern, "cppad.symmetric",
+                                 sweep.hes_work);
+  for (size_t k = 0; k < sweep.hes.nnz(); k++) {
+    values[k] = sweep.hes.val()[k];
+  }
+  return true;
+}
+
+bool MPC_NLP::GaussNewtonHessian(const Number* x, Number obj_factor,
+                                 Index* iRow, Index* jCol, Number* values) {
+  const ResidualShape& shape = *residuals_;
+  if (values == NULL) {
+    for (size_t k = 0; k < shape.gn_rows.size(); k++) {
+      iRow[k] = shape.gn_rows[k];
+      jCol[k] = shape.gn_cols[k];
+    }
+    return true;
+  }
+  ResidualSweep& sweep = residuals_->sweeps.Get();
+  if (sweep.version != params_version_) {
+    sweep.residual_fun.new_dynamic(params_);
+    sweep.version = params_version_;
+  }
+  for (size_t i = 0; i < n_; i++) {
+    sweep.x[i] = x[i];
+  }
+  sweep.residual_fun.sparse_jac_for(1, sweep.x, sweep.residual_jac,
+                                    shape.residual_pattern, "cppad",
+                                    sweep.residual_work);
+  for (size_t k = 0; k < shape.gn_rows.size(); k++) {
+    values[k] = 0;
+  }
+  const Dvector& jac = sweep.residual_jac.val();
+  const std::vector<size_t>& terms = shape.gn_terms;
+  double scale = 2 * obj_factor;
+  for (size_t k = 0; k < terms.size(); k += 3) {
+    values[terms[k + 2]] += scale * jac[terms[k]] * jac[terms[k + 1]];
+  }
+  return true;
+}
+
+bool MPC_NLP::Usable(Ipopt::SolverReturn status, bool fixed_iterations) {
+  return status == Ipopt::SUCCESS ||
+         status == Ipopt::STOP_AT_ACCEPTABLE_POINT ||
+         (fixed_iterations && status == Ipopt::MAXITER_EXCEEDED);
+}
+
+void MPC_NLP::finalize_solution(Ipopt::SolverReturn status, Index n,
+                                const Number* x, const Number* z_L,
+                                const Number* z_U, Index m, const Number* g,
+                                const Number* lambda, Number obj_value,
+                                const Ipopt::IpoptData* ip_data,
+                                Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  this->status = status;
+  for (Index i = 0; i < n; i++) {
+    this->x[i] = x[i];
+    this->z_l[i] = z_L[i];
+    this->z_u[i] = z_U[i];
+  }
+  for (Index i = 0; i < m; i++) {
+    this->lambda[i] = lambda[i];
+  }
+  this->obj_value = obj_value;
+  violation = Violation(x, g);
+
+  // Ipopt resets its timing statistics at the start of every optimization.
+  if (ip_data) {
+    Ipopt::TimingStatistics& timing =
+        const_cast<Ipopt::IpoptData*>(ip_data)->TimingStats();
+    iterations = ip_data->iter_count();
+    eval_seconds = timing.TotalFunctionEvaluationWallclockTime();
+    linear_solve_seconds =
+        timing.LinearSystemFactorization().TotalWallclockTime() +
+        timing.LinearSystemBackSolve().TotalWallclockTime();
+  }
+}
+
+bool MPC_NLP::intermediate_callback(
+    Ipopt::AlgorithmMode mode, Index iter, Number obj_value, Number inf_pr,
+    Number inf_du, Number mu, Number d_norm, Number regularization_size,
+    Number alpha_du, Number alpha_pr, Index ls_trials,
+    const Ipopt::IpoptData* ip_data, Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  // Restoration phase iterates minimize the infeasibility rather than the
+  // cost, so only regular iterates are candidates.
+  if (track_best && mode == Ipopt::RegularMode) {
+    // eval_g last saw the iterate Ipopt just accepted; re-evaluating it keeps
+    // any cache in the evaluators on the same point.
+    eval_g(n_, last_x_.data(), true, m_, last_g_.data());
+    double violation = Violation(last_x_.data(), last_g_.data());
+    if (violation <= feasibility_tol) {
+      Number f;
+      eval_f(n_, last_x_.data(), false, f);
+      if (!has_best || f < best_obj_value) {
+        has_best = true;
+        best_x = last_x_;
+        best_obj_value = f;
+        best_violation = violation;
+        best_iter = iter;
+      }
+    }
+  }
+
+  bool restoring = mode == Ipopt::RestorationPhaseMode;
+  restorations += restoring && !restoring_;
+  restoring_ = restoring;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (TracingEnabled()) {
+    TraceEvent(mode == Ipopt::RegularMode ? "ipopt iteration"
+                                          : "restoration iteration",
+               iteration_start_, now, iter);
+    iteration_start_ = now;
+  }
+  if (now >= deadline ||
+      (cancel && cancel->load(std::memory_order_relaxed))) {
+    deadline_reached = true;
+    return false;
+  }
+  if (abortHopeless) {
+    aborted = Hopeless(restoring, iter, inf_pr, mu);
+    return aborted == NOT_ABORTED;
+  }
+  return true;
+}
+
+MPC_NLP::Abort MPC_NLP::Hopeless(bool restoring, Index iter, Number inf_pr,
+                                 Number mu) {
+  if (restoring) {
+    return abortOnRestoration ? RESTORATION : NOT_ABORTED;
+  }
+  if (iter == 0) {
+    lowest_inf_pr_ = inf_pr;
+    diverging_ = 0;
+    stall_mu_ = mu;
+    stall_inf_pr_ = inf_pr;
+    stalled_ = 0;
+    return NOT_ABORTED;
+  }
+  lowest_inf_pr_ = std::min(lowest_inf_pr_, double(inf_pr));
+  if (divergenceFactor > 0 && divergenceIterations > 0) {
+    bool growing =
+        inf_pr > divergenceFactor * lowest_inf_pr_ && inf_pr > feasibility_tol;
+    diverging_ = growing ? diverging_ + 1 : 0;
+    if (diverging_ >= divergenceIterations) {
+      return DIVERGENCE;
+    }
+  }
+  if (stallIterations > 0) {
+    if (mu < stall_mu_ || inf_pr < 0.5 * stall_inf_pr_) {
+      stall_mu_ = mu;
+      stall_inf_pr_ = inf_pr;
+      stalled_ = 0;
+    } else if (++stalled_ >= stallIterations) {
+      return STALL;
+    }
+  }
+  return NOT_ABORTED;
+}
+
+double MPC_NLP::Violation(const Number* x, const Number* g) const {
+  double violation = 0;
+  for (size_t i = 0; i < n_; i++) {
+    violation = std::max(violation, x_lowerbound[i] - x[i]);
+    violation = std::max(violation, x[i] - x_upperbound[i]);
+  }
+  for (size_t i = 0; i < m_; i++) {
+    violation = std::max(violation, g_lowerbound[i] - g[i]);
+    violation = std::max(violation, g[i] - g_upperbound[i]);
+  }
+  return violation;
+}
+
+void MPC_NLP::NotePoint(const Number* x) {
+  for (size_t i = 0; i < n_; i++) {
+    last_x_[i] = x[i];
+  }
+}
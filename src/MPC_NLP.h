@@ -0,0 +1,337 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cppad/cppad.hpp>
+#include <coin/IpTNLP.hpp>
+
+// Ipopt problem evaluated from a cached CppAD tape.
+//
+// The operation sequence of an FG_eval functor is recorded once by Record(),
+// with everything that changes between frames (path coefficients, initial
+// state) or between tunings (the cost's weights) declared as CppAD dynamic
+// parameters. Each frame then only updates the parameters and runs
+// forward/reverse sweeps on the same tape; sparsity
+// patterns are computed once, right after recording, and by then the tape
+// has been optimized, since its one optimization pays off over every frame.
+//
+// fg[0] is the cost and fg[1 + i] is constraint i, as in CppAD::ipopt::solve.
+//
+// When the cost is a sum of squared residuals, RecordResiduals() can tape
+// them as well, for a Gauss-Newton Hessian: 2 J_r^T J_r times obj_factor,
+// dropping the residuals' own curvature and the constraints'. That needs
+// only a forward Jacobian sweep of the residuals and no second order sweep
+// at all, and when the residuals are linear in the variables, as the MPC
+// cost's are, it is the cost's exact Hessian.
+//
+// Record() also finds the structure the tape has: the constraint rows with
+// no second derivatives, such as the initial state's and the speed's
+// updates, and the Jacobian entries that don't depend on the variables,
+// such as the 1 of each next state in its update, whatever the parameters
+// make of the rest. Those entries are evaluated once a frame, at the first
+// eval_jac_g after SetParameters; the others, and the Lagrangian Hessian,
+// come from a copy of the tape with the linear rows left out, so that
+// their operations are in neither the Jacobian's sweeps nor the Hessian's.
+// Ipopt is told which rows are linear too.
+//
+// With share_tapes, problems whose tapes are the same share them, with the
+// patterns, the colorings and the rest of what Record() derives from them:
+// the first problem of a shape builds it, and the next finds it by its
+// tapes' sizes and their values at an arbitrary point and drops its own
+// recording. CppAD keeps a sweep's Taylor coefficients and parameters in
+// the ADFun, so a shared shape makes a copy of its tapes for each CppAD
+// thread number that evaluates it, and each evaluation brings its copy's
+// parameters up to date with the problem's; a problem itself keeps only
+// its data and its solution. The stages generated as code, see
+// GeneratedStages.h, are shared as any code is.
+class MPC_NLP : public Ipopt::TNLP {
+ public:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(CppAD::AD<double>) ADvector;
+  typedef CPPAD_TESTVECTOR(size_t) Svector;
+
+  MPC_NLP();
+  virtual ~MPC_NLP();
+
+  // Record fg_eval(fg, vars, params) over n_vars variables, n_constraints
+  // constraints and n_params dynamic parameters.
+  template <class FG_eval>
+  void Record(FG_eval& fg_eval, size_t n_vars, size_t n_constraints,
+              size_t n_params) {
+    CppAD::ADFun<double> fg_fun;
+    ADvector avars(n_vars);
+    ADvector aparams(n_params);
+    ADvector afg(n_constraints + 1);
+    for (size_t i = 0; i < n_vars; i++) {
+      avars[i] = 0;
+    }
+    for (size_t i = 0; i < n_params; i++) {
+      aparams[i] = 0;
+    }
+    CppAD::Independent(avars, 0, false, aparams);
+    fg_eval(afg, avars, aparams);
+    fg_fun.Dependent(avars, afg);
+    if (optimize_tape) {
+      fg_fun.optimize();
+    }
+    Initialize(fg_fun);
+  }
+
+  // Record fg_eval.residuals(r, vars, params), the n_residuals residuals of
+  // the cost as functions of the variables, on the same dynamic parameters
+  // as Record(), the cost being the sum of their squares, and switch eval_h
+  // to the Gauss-Newton Hessian. Call it after Record(), before the first
+  // solve.
+  template <class FG_eval>
+  void RecordResiduals(FG_eval& fg_eval, size_t n_vars, size_t n_residuals,
+                       size_t n_params) {
+    CppAD::ADFun<double> residual_fun;
+    ADvector avars(n_vars);
+    ADvector aparams(n_params);
+    ADvector ar(n_residuals);
+    for (size_t i = 0; i < n_vars; i++) {
+      avars[i] = 0;
+    }
+    for (size_t i = 0; i < n_params; i++) {
+      aparams[i] = 0;
+    }
+    CppAD::Independent(avars, 0, false, aparams);
+    fg_eval.residuals(ar, avars, aparams);
+    residual_fun.Dependent(avars, ar);
+    if (optimize_tape) {
+      residual_fun.optimize();
+    }
+    InitializeGaussNewton(residual_fun);
+  }
+  bool gaussNewton() const { return residuals_ != nullptr; }
+
+  // Whether Record() and RecordResiduals() optimize the tapes they record,
+  // dropping dead operations and sharing common subexpressions such as the
+  // powers of x0 the path and its slope both take. Set before recording.
+  bool optimize_tape;
+  // Directory in which Record() keeps the sparsity patterns it computes, one
+  // file per tape, named by its sizes, to read them back instead the next
+  // time a tape of the same sizes is recorded; empty for none. Colorings
+  // can't be kept: they are computed at Record() from the patterns.
+  std::string pattern_cache;
+  // Whether Record() and RecordResiduals() share the tapes with the other
+  // problems of the process that have the same, see above. Set before
+  // recording.
+  bool share_tapes;
+
+  // Set the dynamic parameters for the next solve.
+  virtual void SetParameters(const Dvector& params);
+
+  // The bytes of the recorded operation sequences, and an estimate of the
+  // solver workspace: the vectors and sparse derivatives here, and the
+  // KKT system Ipopt assembles from them, as values and index pairs. Ipopt
+  // doesn't say what it and the linear solver's factors take beyond that.
+  // What a shared shape takes is divided among the problems sharing it.
+  size_t TapeBytes() const;
+  size_t WorkspaceBytes() const;
+  // How many problems share this one's tapes, itself included.
+  size_t sharers() const;
+
+  // Whether constraint i has no second derivatives, and how many of the
+  // Jacobian's entries vary with the variables; set by Record().
+  bool linear(size_t i) const;
+  size_t varyingJacobianEntries() const;
+
+  // Problem data, sized by Record(). Callers fill these before each solve.
+  Dvector x_init;
+  // Multiplier starting point, used when Ipopt's warm_start_init_point is set.
+  Dvector z_l_init;
+  Dvector z_u_init;
+  Dvector lambda_init;
+  Dvector x_lowerbound;
+  Dvector x_upperbound;
+  Dvector g_lowerbound;
+  Dvector g_upperbound;
+  // Factors for Ipopt's nlp_scaling_method user-scaling, which multiplies
+  // the cost, each variable and each constraint by them; all 1 until set.
+  double obj_scaling;
+  Dvector x_scaling;
+  Dvector g_scaling;
+
+  // Wall-clock time after which intermediate_callback stops Ipopt, which then
+  // returns USER_REQUESTED_STOP. time_point::max() means no deadline.
+  std::chrono::steady_clock::time_point deadline;
+  // Whether the last solve was stopped by the deadline. Reset by callers.
+  bool deadline_reached;
+  // Set from another thread to stop the solve at its next iteration as if
+  // at the deadline, or null; see MPC::AddRival.
+  const std::atomic<bool>* cancel;
+
+  // Stop a solve that is going nowhere rather than let it run to the
+  // deadline, so that the fallback and the other sessions get the time
+  // left: on entering the restoration phase; once the primal infeasibility
+  // has been over divergenceFactor times the lowest of the solve, and over
+  // feasibility_tol, for divergenceIterations iterations in a row; or once
+  // neither the barrier parameter nor the infeasibility, by half, has come
+  // down for stallIterations iterations. Off unless abortHopeless; a
+  // factor or count of 0 leaves its test out. Why the last solve was
+  // stopped is in `aborted`, reset by each solve.
+  enum Abort { NOT_ABORTED, RESTORATION, DIVERGENCE, STALL, ABORTS };
+  bool abortHopeless;
+  bool abortOnRestoration;
+  double divergenceFactor;
+  int divergenceIterations;
+  int stallIterations;
+  Abort aborted;
+
+  // Anytime mode: intermediate_callback keeps the lowest-cost iterate whose
+  // bound and constraint violation is within feasibility_tol, so that a solve
+  // cut short still has a usable point. has_best is reset by callers.
+  bool track_best;
+  double feasibility_tol;
+  bool has_best;
+  Dvector best_x;
+  double best_obj_value;
+  double best_violation;
+  Ipopt::Index best_iter;
+
+  // Ipopt's statistics of the last solve, written by finalize_solution: its
+  // iterations, and the wall-clock time it spent evaluating the problem and
+  // in the linear solver's factorizations and back solves.
+  Ipopt::Index iterations;
+  double eval_seconds;
+  double linear_solve_seconds;
+  // How many times the last solve entered the restoration phase, counted by
+  // intermediate_callback.
+  int restorations;
+
+  // Whether a solve that ended with `status` has an answer to act on and to
+  // seed the next solve from: it converged, or stopped at an iterate within
+  // acceptable_tol, or, with `fixed_iterations`, ran out of them, since
+  // InteriorPoint's fixed count ends at its last iterate, which is its
+  // answer.
+  static bool Usable(Ipopt::SolverReturn status,
+                     bool fixed_iterations = false);
+
+  // Result of the last solve, written by finalize_solution, with the largest
+  // bound or constraint violation of x.
+  Ipopt::SolverReturn status;
+  Dvector x;
+  Dvector z_l;
+  Dvector z_u;
+  Dvector lambda;
+  double obj_value;
+  double violation;
+
+  // Ipopt::TNLP interface.
+  bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                    Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+  bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l, Ipopt::Number* x_u,
+                       Ipopt::Index m, Ipopt::Number* g_l, Ipopt::Number* g_u);
+  bool get_scaling_parameters(Ipopt::Number& obj_scaling,
+                              bool& use_x_scaling, Ipopt::Index n,
+                              Ipopt::Number* x_scaling, bool& use_g_scaling,
+                              Ipopt::Index m, Ipopt::Number* g_scaling);
+  bool get_constraints_linearity(Ipopt::Index m, LinearityType* const_types);
+  bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number* x,
+                          bool init_z, Ipopt::Number* z_L, Ipopt::Number* z_U,
+                          Ipopt::Index m, bool init_lambda,
+                          Ipopt::Number* lambda);
+  bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number& obj_value);
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                   Ipopt::Number* grad_f);
+  bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Index m, Ipopt::Number* g);
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index* iRow,
+                  Ipopt::Index* jCol, Ipopt::Number* values);
+  bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m,
+              const Ipopt::Number* lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol,
+              Ipopt::Number* values);
+  void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                         const Ipopt::Number* x, const Ipopt::Number* z_L,
+                         const Ipopt::Number* z_U, Ipopt::Index m,
+                         const Ipopt::Number* g, const Ipopt::Number* lambda,
+                         Ipopt::Number obj_value,
+                         const Ipopt::IpoptData* ip_data,
+                         Ipopt::IpoptCalculatedQuantities* ip_cq);
+  bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter,
+                             Ipopt::Number obj_value, Ipopt::Number inf_pr,
+                             Ipopt::Number inf_du, Ipopt::Number mu,
+                             Ipopt::Number d_norm,
+                             Ipopt::Number regularization_size,
+                             Ipopt::Number alpha_du, Ipopt::Number alpha_pr,
+                             Ipopt::Index ls_trials,
+                             const Ipopt::IpoptData* ip_data,
+                             Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+ protected:
+  // Called by eval_g with every point Ipopt evaluates, for the anytime mode.
+  void NotePoint(const Ipopt::Number* x);
+
+ private:
+  // The tapes with what the derivative drivers keep between sweeps, and a
+  // shape's tapes with everything derived from them; see MPC_NLP.cpp.
+  struct Sweep;
+  struct ResidualSweep;
+  struct Shape;
+  struct ResidualShape;
+
+  // Size the problem data and find or build the shape of the tape fg_fun,
+  // which it may take.
+  void Initialize(CppAD::ADFun<double>& fg_fun);
+  // The same for the residuals' tape, for the Gauss-Newton Hessian.
+  void InitializeGaussNewton(CppAD::ADFun<double>& residual_fun);
+  // The sweep of the calling thread, with this problem's parameters.
+  Sweep& Checkout();
+  // eval_h with the Gauss-Newton Hessian.
+  bool GaussNewtonHessian(const Ipopt::Number* x, Ipopt::Number obj_factor,
+                          Ipopt::Index* iRow, Ipopt::Index* jCol,
+                          Ipopt::Number* values);
+  // Zero order forward sweep at x, results in fg_.
+  void Forward(Sweep& sweep, const Ipopt::Number* x);
+  // Largest violation of the bounds by x, or of the constraints by its g.
+  double Violation(const Ipopt::Number* x, const Ipopt::Number* g) const;
+  // Which of the abort tests, if any, the iterate of intermediate_callback
+  // fails.
+  Abort Hopeless(bool restoring, Ipopt::Index iter, Ipopt::Number inf_pr,
+                 Ipopt::Number mu);
+
+  size_t n_;
+  size_t m_;
+
+  std::shared_ptr<Shape> shape_;
+  // Null without the Gauss-Newton Hessian.
+  std::shared_ptr<ResidualShape> residuals_;
+  // The parameters of SetParameters, and their version, unique in the
+  // process, for Checkout() to tell whether a sweep has them.
+  Dvector params_;
+  uint64_t params_version_;
+
+  Dvector fg_;
+  // Last point seen by eval_g, and its constraints, for the anytime mode.
+  Dvector last_x_;
+  Dvector last_g_;
+  // When the current Ipopt iteration started, for the trace.
+  std::chrono::steady_clock::time_point iteration_start_;
+  // Whether the last iteration was in the restoration phase.
+  bool restoring_;
+  // The abort tests' state: the lowest infeasibility of the solve and the
+  // iterations in a row over divergenceFactor times it, and mu and the
+  // infeasibility when either last came down and the iterations since.
+  double lowest_inf_pr_;
+  int diverging_;
+  double stall_mu_;
+  double stall_inf_pr_;
+  int stalled_;
+
+  // The Jacobian's values in Ipopt's order, the constant ones as of the
+  // first eval_jac_g since the parameters were set.
+  Dvector jac_values_;
+  bool constants_stale_;
+};
+
+#endif /* MPC_NLP_H */
@@ -0,0 +1,180 @@
+#include "MPPI.h"
+#include "MPPITensor.h"
+#include "SimdKernels.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+#ifdef MPC_CUDA
+// In MPPICuda.cu.
+MPPIEngine* NewCudaMPPI(size_t samples, size_t stages);
+#endif
+
+struct MPPI::Device {
+  explicit Device(size_t threads)
+      : pool(int(threads)), device(&pool, int(threads)) {}
+  Eigen::NonBlockingThreadPool pool;
+  Eigen::ThreadPoolDevice device;
+};
+
+MPPI::MPPI(size_t N, const ProblemIR& problem, double Lf,
+           const Options& options)
+    : lastCost(0), N_(N), dt_(problem.dt), Lf_(Lf), ref_v_(0),
+      max_delta_(problem.upper[6]), max_a_(problem.upper[7]),
+      options_(options),
+      pool_(new StagePool(options.engine == ARRAYS ? options.threads : 1)),
+      frame_(0), u_(Eigen::MatrixXd::Zero(2, N - 1)),
+      last_u_(Eigen::MatrixXd::Zero(2, N - 1)), x_(6, N) {
+  bool tracking = problem.Tracking(w_, ref_v_);
+  assert(tracking && "the rollouts cost TrackingCost's terms");
+  (void)tracking;
+  size_t stages = N - 1;
+  if (options.engine == ARRAYS) {
+    size_t samples = options.samples;
+    delta_.resize(samples, stages);
+    a_.resize(samples, stages);
+    for (Eigen::ArrayXf* a : {&px_, &py_, &psi_, &v_, &cte_, &epsi_,
+                              &next_cte_, &cost_, &weight_}) {
+      a->resize(samples);
+    }
+    return;
+  }
+#ifdef MPC_CUDA
+  if (options.engine == TENSOR_CUDA) {
+    engine_.reset(NewCudaMPPI(options.samples, stages));
+  }
+#endif
+  if (!engine_) {
+    device_.reset(new Device(std::max<size_t>(options.threads, 1)));
+    engine_.reset(new MPPITensor<Eigen::ThreadPoolDevice>(
+        device_->device, options.samples, stages));
+  }
+  nominal_.resize(2 * stages);
+  MPPIEngine::Parameters& p = parameters_;
+  p.dt = dt_;
+  p.turn = dt_ / Lf;
+  p.refV = ref_v_;
+  p.lambda = options.lambda;
+  p.sigmaDelta = options.sigmaDelta;
+  p.sigmaA = options.sigmaA;
+  p.maxDelta = max_delta_;
+  p.maxA = max_a_;
+  p.weights.cte = w_.cte;
+  p.weights.epsi = w_.epsi;
+  p.weights.v = w_.v;
+  p.weights.delta = w_.delta;
+  p.weights.a = w_.a;
+  p.weights.delta_diff = w_.delta_diff;
+  p.weights.a_diff = w_.a_diff;
+}
+
+// The engine goes before the device it runs on.
+MPPI::~MPPI() { engine_.reset(); }
+
+void MPPI::Rollout(size_t begin, size_t end, const State& state,
+                   const Cubic& coeffs) {
+  Eigen::Index n = end - begin;
+  size_t stages = N_ - 1;
+
+  // The perturbations, clipped to the actuator limits; the rollouts are of
+  // the actuations as applied.
+  std::minstd_rand random(frame_ * 7919u + unsigned(begin));
+  std::normal_distribution<float> normal(0, 1);
+  for (size_t t = 0; t < stages; t++) {
+    float delta = u_(0, t);
+    float a = u_(1, t);
+    for (size_t i = begin; i < end; i++) {
+      delta_(i, t) = std::max(
+          float(-max_delta_),
+          std::min(float(max_delta_),
+                   delta + float(options_.sigmaDelta) * normal(random)));
+      a_(i, t) = std::max(
+          float(-max_a_),
+          std::min(float(max_a_), a + float(options_.sigmaA) * normal(random)));
+    }
+  }
+
+  px_.segment(begin, n).setConstant(state[0]);
+  py_.segment(begin, n).setConstant(state[1]);
+  psi_.segment(begin, n).setConstant(state[2]);
+  v_.segment(begin, n).setConstant(state[3]);
+  cte_.segment(begin, n).setConstant(state[4]);
+  epsi_.segment(begin, n).setConstant(state[5]);
+  cost_.segment(begin, n).setZero();
+
+  MppiRollout r;
+  r.x = px_.data() + begin;
+  r.y = py_.data() + begin;
+  r.psi = psi_.data() + begin;
+  r.v = v_.data() + begin;
+  r.cte = cte_.data() + begin;
+  r.epsi = epsi_.data() + begin;
+  r.next_cte = next_cte_.data() + begin;
+  r.cost = cost_.data() + begin;
+  r.delta = delta_.data() + begin;
+  r.a = a_.data() + begin;
+  r.stride = delta_.rows();
+  r.n = n;
+  r.stages = stages;
+  r.dt = dt_;
+  r.turn = dt_ / Lf_;
+  r.refV = ref_v_;
+  for (int i = 0; i < 4; i++) {
+    r.coeffs[i] = coeffs[i];
+  }
+  r.wCte = w_.cte;
+  r.wEpsi = w_.epsi;
+  r.wV = w_.v;
+  r.wDelta = w_.delta;
+  r.wA = w_.a;
+  r.wDeltaDiff = w_.delta_diff;
+  r.wADiff = w_.a_diff;
+  Kernels().mppiRollout(r);
+}
+
+Input MPPI::Control(const State& state, const Cubic& coeffs,
+                    std::vector<double>& mpc_x_vals,
+                    std::vector<double>& mpc_y_vals) {
+  frame_++;
+  size_t stages = N_ - 1;
+  if (engine_) {
+    for (size_t t = 0; t < stages; t++) {
+      nominal_[t] = u_(0, t);
+      nominal_[stages + t] = u_(1, t);
+    }
+    lastCost = engine_->Update(state, coeffs, parameters_, frame_,
+                               nominal_.data());
+    for (size_t t = 0; t < stages; t++) {
+      u_(0, t) = nominal_[t];
+      u_(1, t) = nominal_[stages + t];
+    }
+  } else {
+    pool_->Run(0, options_.samples, [&](size_t begin, size_t end) {
+      Rollout(begin, end, state, coeffs);
+    });
+
+    // Relative to the best rollout, so the exponentials don't underflow.
+    lastCost = cost_.minCoeff();
+    weight_ = (-(cost_ - float(lastCost)) / float(options_.lambda)).exp();
+    float total = weight_.sum();
+    for (size_t t = 0; t < stages; t++) {
+      u_(0, t) = (weight_ * delta_.col(t)).sum() / total;
+      u_(1, t) = (weight_ * a_.col(t)).sum() / total;
+    }
+  }
+
+  BicycleRollout(state, u_, coeffs, dt_, Lf_, x_);
+  for (size_t k = 1; k < N_; k++) {
+    mpc_x_vals.push_back(x_(0, k));
+    mpc_y_vals.push_back(x_(1, k));
+  }
+  Input result = u_.col(0);
+  last_u_ = u_;
+
+  // The next frame starts from this one's nominal, a stage on.
+  for (size_t t = 0; t + 2 < N_; t++) {
+    u_.col(t) = u_.col(t + 1);
+  }
+  return result;
+}
@@ -0,0 +1,143 @@
+#ifndef MPPI_H
+#define MPPI_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+#include "ProblemIR.h"
+#include "StagePool.h"
+
+// The rollouts and weighting of one MPPI frame on another engine, see
+// MPPITensor.h.
+class MPPIEngine {
+ public:
+  // The model, cost and sampling, in the engines' single precision.
+  struct Parameters {
+    float dt;
+    // dt / Lf.
+    float turn;
+    float refV;
+    float lambda;
+    float sigmaDelta;
+    float sigmaA;
+    float maxDelta;
+    float maxA;
+    struct {
+      float cte;
+      float epsi;
+      float v;
+      float delta;
+      float a;
+      float delta_diff;
+      float a_diff;
+    } weights;
+  };
+
+  virtual ~MPPIEngine() {}
+
+  // Sample around the nominal actuations, delta for each stage then a for
+  // each, roll the samples out from state along coeffs, and replace the
+  // nominal by their weighted average. Returns the lowest rollout cost.
+  virtual float Update(const State& state, const Cubic& coeffs,
+                       const Parameters& p, unsigned seed,
+                       float* nominal) = 0;
+};
+
+// Model predictive path integral control: thousands of perturbations of the
+// nominal actuations rolled out through the kinematic model, and the nominal
+// moved towards them by the exponentials of their costs. No solver and no
+// derivatives, and the same work every frame, split evenly across threads.
+//
+// The rollouts are kept as structures of arrays in single precision, a
+// column of samples per stage, so each step of the model runs over
+// contiguous floats with Eigen's packet math, sin and cos included, in the
+// widest instruction set the CPU has (see SimdKernels.h). The cost is
+// FG_eval's, term for term, with the weights and actuator limits of the
+// ProblemIR; the rollouts stay the kinematic bicycle's, with its Lf,
+// whatever model the IR has. Each frame starts from the last nominal
+// shifted one stage, as Ipopt's warm start does.
+class MPPI {
+ public:
+  // What runs the rollouts: Eigen arrays on the StagePool, the Tensor
+  // expressions of MPPITensor on Eigen's thread pool device, or the same on
+  // a CUDA device, in builds with MPC_CUDA; without it TENSOR_CUDA runs on
+  // the thread pool.
+  enum Engine { ARRAYS, TENSOR_THREADS, TENSOR_CUDA };
+  struct Options {
+    Engine engine;
+    // Rollouts per frame, and the threads, the calling one included, to
+    // split them between.
+    size_t samples;
+    size_t threads;
+    // The temperature of the weighting: lower follows the best rollouts
+    // more closely.
+    double lambda;
+    // The standard deviations of the perturbations of delta and a.
+    double sigmaDelta;
+    double sigmaA;
+  };
+
+  // `problem`'s cost, which must be TrackingCost's, and bounds over N
+  // stages.
+  MPPI(size_t N, const ProblemIR& problem, double Lf, const Options& options);
+  ~MPPI();
+
+  // Returns the first actuations {delta, a} and appends the trajectory of
+  // the updated nominal, like MPC::Solve.
+  Input Control(const State& state, const Cubic& coeffs,
+                std::vector<double>& mpc_x_vals,
+                std::vector<double>& mpc_y_vals);
+
+  // The lowest rollout cost of the last frame.
+  double lastCost;
+  // The nominal actuations the last Control answered with, 2 x (N - 1),
+  // before they were shifted for the next frame.
+  const Eigen::MatrixXd& actuations() const { return last_u_; }
+
+ private:
+  typedef Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic> Samples;
+
+  // Roll out samples [begin, end) from state along coeffs into cost_.
+  void Rollout(size_t begin, size_t end, const State& state,
+               const Cubic& coeffs);
+
+  size_t N_;
+  double dt_;
+  double Lf_;
+  double ref_v_;
+  KinematicWeights w_;
+  // The actuators' limits, delta's and a's.
+  double max_delta_;
+  double max_a_;
+  Options options_;
+  std::unique_ptr<StagePool> pool_;
+  unsigned frame_;
+  // The nominal actuations, 2 x (N - 1).
+  Eigen::MatrixXd u_;
+  Eigen::MatrixXd last_u_;
+  Eigen::MatrixXd x_;
+  // The sampled actuations, samples x (N - 1) each, after clipping.
+  Samples delta_;
+  Samples a_;
+  // The state of each rollout, and its cost.
+  Eigen::ArrayXf px_;
+  Eigen::ArrayXf py_;
+  Eigen::ArrayXf psi_;
+  Eigen::ArrayXf v_;
+  Eigen::ArrayXf cte_;
+  Eigen::ArrayXf epsi_;
+  Eigen::ArrayXf next_cte_;
+  Eigen::ArrayXf cost_;
+  Eigen::ArrayXf weight_;
+  // The tensor engine, and the thread pool device it runs on unless on
+  // CUDA; with the nominal in single precision and the model and cost it is
+  // given.
+  struct Device;
+  std::unique_ptr<Device> device_;
+  std::unique_ptr<MPPIEngine> engine_;
+  std::vector<float> nominal_;
+  MPPIEngine::Parameters parameters_;
+};
+
+#endif /* MPPI_H */
@@ -0,0 +1,28 @@
+// The tensor engine of MPPI on the first CUDA device, for builds with
+// MPC_CUDA; see MPPITensor.h.
+#define EIGEN_USE_GPU
+#include "MPPITensor.h"
+
+namespace {
+
+class CudaMPPI : public MPPIEngine {
+ public:
+  CudaMPPI(size_t samples, size_t stages)
+      : device_(&stream_), tensor_(device_, samples, stages) {}
+
+  float Update(const State& state, const Cubic& coeffs, const Parameters& p,
+               unsigned seed, float* nominal) {
+    return tensor_.Update(state, coeffs, p, seed, nominal);
+  }
+
+ private:
+  Eigen::CudaStreamDevice stream_;
+  Eigen::GpuDevice device_;
+  MPPITensor<Eigen::GpuDevice> tensor_;
+};
+
+}  // namespace
+
+MPPIEngine* NewCudaMPPI(size_t samples, size_t stages) {
+  return new CudaMPPI(samples, stages);
+}
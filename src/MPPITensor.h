@@ -0,0 +1,166 @@
+#ifndef MPPI_TENSOR_H
+#define MPPI_TENSOR_H
+
+#include <vector>
+#ifndef EIGEN_USE_THREADS
+#define EIGEN_USE_THREADS
+#endif
+#include "Eigen-3.3/unsupported/Eigen/CXX11/Tensor"
+#include "MPPI.h"
+
+// The rollouts and weighting of MPPI as Tensor expressions on an Eigen
+// device: Eigen::ThreadPoolDevice in MPPI.cpp, and Eigen::GpuDevice in
+// MPPICuda.cu when built with MPC_CUDA. Each model step is one expression
+// per state over all the samples, which the device splits across its
+// threads or CUDA blocks; the perturbations are drawn on the device too,
+// so a frame moves only the nominal actuations to the device and their
+// weighted sums back.
+//
+// All buffers are allocated on the device at construction. A column of
+// the sampled actuations holds a stage's samples, contiguously, as in MPPI.
+template <typename Device>
+class MPPITensor : public MPPIEngine {
+ public:
+  typedef Eigen::Tensor<float, 1>::Index Index;
+  typedef Eigen::TensorMap<Eigen::Tensor<float, 0> > Scalar;
+  typedef Eigen::TensorMap<Eigen::Tensor<float, 1> > Vector;
+  typedef Eigen::TensorMap<Eigen::Tensor<float, 2> > Matrix;
+
+  MPPITensor(const Device& device, size_t samples, size_t stages)
+      : device_(device), samples_(samples), stages_(stages),
+        buffer_(static_cast<float*>(
+            device.allocate(sizeof(float) * BufferSize()))),
+        weighted_(2 * stages + 2) {}
+  ~MPPITensor() { device_.deallocate(buffer_); }
+
+  float Update(const State& state, const Cubic& coeffs,
+               const Parameters& p, unsigned seed, float* nominal) {
+    const Index S = samples_;
+    const Index T = stages_;
+    float* next = buffer_;
+    Matrix delta(Take(next, S * T), S, T);
+    Matrix a(Take(next, S * T), S, T);
+    Vector x(Take(next, S), S);
+    Vector y(Take(next, S), S);
+    Vector psi(Take(next, S), S);
+    Vector v(Take(next, S), S);
+    Vector cte(Take(next, S), S);
+    Vector epsi(Take(next, S), S);
+    Vector next_cte(Take(next, S), S);
+    Vector cost(Take(next, S), S);
+    Vector weight(Take(next, S), S);
+    float* center = Take(next, 2 * T);
+    Matrix nominal_delta(center, 1, T);
+    Matrix nominal_a(center + T, 1, T);
+    float* sums = Take(next, 2 * T);
+    Vector sum_delta(sums, T);
+    Vector sum_a(sums + T, T);
+    float* scalars = Take(next, 2);
+    Scalar lowest(scalars);
+    Scalar total(scalars + 1);
+
+    device_.memcpyHostToDevice(center, nominal, sizeof(float) * 2 * T);
+    Eigen::array<Index, 2> across = {{S, 1}};
+    typedef Eigen::internal::NormalRandomGenerator<float> Normal;
+    delta.device(device_) =
+        (nominal_delta.broadcast(across) +
+         delta.random(Normal(2 * uint64_t(seed) + 1)) * p.sigmaDelta)
+            .cwiseMax(-p.maxDelta)
+            .cwiseMin(p.maxDelta);
+    a.device(device_) =
+        (nominal_a.broadcast(across) +
+         a.random(Normal(2 * uint64_t(seed) + 2)) * p.sigmaA)
+            .cwiseMax(-p.maxA)
+            .cwiseMin(p.maxA);
+
+    x.device(device_) = x.constant(float(state[0]));
+    y.device(device_) = y.constant(float(state[1]));
+    psi.device(device_) = psi.constant(float(state[2]));
+    v.device(device_) = v.constant(float(state[3]));
+    cte.device(device_) = cte.constant(float(state[4]));
+    epsi.device(device_) = epsi.constant(float(state[5]));
+    cost.device(device_) = cost.constant(0.f);
+
+    const float c0 = coeffs[0], c1 = coeffs[1], c2 = coeffs[2],
+                c3 = coeffs[3];
+    Eigen::internal::scalar_sin_op<float> sin;
+    Eigen::internal::scalar_cos_op<float> cos;
+    Eigen::internal::scalar_atan_op<float> atan;
+    for (Index t = 0; t < T; t++) {
+      auto d = delta.chip(t, 1);
+      auto u = a.chip(t, 1);
+      // BicycleStep, the errors first since they need the old state.
+      next_cte.device(device_) = ((x * c3 + c2) * x + c1) * x + c0 - y +
+                                 v * epsi.unaryExpr(sin) * p.dt;
+      epsi.device(device_) =
+          psi - ((x * (3 * c3) + 2 * c2) * x + c1).unaryExpr(atan) +
+          v * d * p.turn;
+      cte.device(device_) = next_cte;
+      x.device(device_) += v * psi.unaryExpr(cos) * p.dt;
+      y.device(device_) += v * psi.unaryExpr(sin) * p.dt;
+      psi.device(device_) += v * d * p.turn;
+      v.device(device_) += u * p.dt;
+
+      cost.device(device_) += cte.square() * p.weights.cte +
+                              epsi.square() * p.weights.epsi +
+                              (v - p.refV).square() * p.weights.v +
+                              d.square() * p.weights.delta +
+                              u.square() * p.weights.a;
+      if (t > 0) {
+        cost.device(device_) +=
+            (d - delta.chip(t - 1, 1)).square() * p.weights.delta_diff +
+            (u - a.chip(t - 1, 1)).square() * p.weights.a_diff;
+      }
+    }
+
+    // Relative to the best rollout, so the exponentials don't underflow.
+    float lo;
+    lowest.device(device_) = cost.minimum();
+    device_.memcpyDeviceToHost(&lo, scalars, sizeof(float));
+    Synchronize(device_);
+    weight.device(device_) = ((cost - lo) * (-1 / p.lambda)).exp();
+    total.device(device_) = weight.sum();
+    Eigen::array<Index, 2> column = {{S, 1}};
+    Eigen::array<Index, 2> spread = {{1, T}};
+    Eigen::array<Index, 1> over_samples = {{0}};
+    sum_delta.device(device_) =
+        (delta * weight.reshape(column).broadcast(spread)).sum(over_samples);
+    sum_a.device(device_) =
+        (a * weight.reshape(column).broadcast(spread)).sum(over_samples);
+
+    // The sums, then the lowest cost and the total weight.
+    float* weighted = weighted_.data();
+    device_.memcpyDeviceToHost(weighted, sums, sizeof(float) * (2 * T + 2));
+    Synchronize(device_);
+    for (Index t = 0; t < 2 * T; t++) {
+      nominal[t] = weighted[t] / weighted[2 * T + 1];
+    }
+    return lo;
+  }
+
+ private:
+  size_t BufferSize() const {
+    return 2 * samples_ * stages_ + 9 * samples_ + 4 * stages_ + 2;
+  }
+  // The next n floats of the buffer.
+  static float* Take(float*& next, Index n) {
+    float* taken = next;
+    next += n;
+    return taken;
+  }
+
+  static void Synchronize(const Eigen::ThreadPoolDevice&) {}
+#ifdef EIGEN_USE_GPU
+  static void Synchronize(const Eigen::GpuDevice& device) {
+    device.synchronize();
+  }
+#endif
+
+  const Device& device_;
+  size_t samples_;
+  size_t stages_;
+  float* buffer_;
+  std::vector<float> weighted_;
+};
+
+#endif /* MPPI_TENSOR_H */
@@ -0,0 +1,49 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <memory>
+
+// A lock-free single-slot mailbox between two threads, where the newest item
+// wins: posting replaces whatever the consumer hasn't taken yet, and the
+// replaced item is dropped. Ownership moves through the slot by atomic
+// exchange, so neither side ever waits on the other.
+template <class T>
+class Mailbox {
+ public:
+  Mailbox() : slot_(nullptr), dropped_(0) {}
+  ~Mailbox() { delete slot_.exchange(nullptr); }
+
+  Mailbox(const Mailbox&) = delete;
+  Mailbox& operator=(const Mailbox&) = delete;
+
+  // Leave `item` for the consumer. Returns false if it replaced one that
+  // was never taken.
+  bool Post(std::unique_ptr<T> item) {
+    std::unique_ptr<T> stale(slot_.exchange(item.release()));
+    if (stale) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  // The newest item, or null if there is none.
+  std::unique_ptr<T> Take() {
+    return std::unique_ptr<T>(slot_.exchange(nullptr));
+  }
+
+  // Whether there is nothing to take; only a hint while the producer runs.
+  bool empty() const { return slot_.load() == nullptr; }
+
+  // Items replaced before they were taken.
+  unsigned long dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<T*> slot_;
+  std::atomic<unsigned long> dropped_;
+};
+
+#endif /* MAILBOX_H */
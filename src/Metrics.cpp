@@ -0,0 +1,446 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include "AllocationCounter.h"
+#include "HeapAllocator.h"
+#include "HugePages.h"
+#include "PerfCounters.h"
+#include "SloTracker.h"
+#include "StackSampler.h"
+#include "Stages.h"
+
+// In the order of MPC::Status.
+static const char* const STATUS_NAMES[Metrics::STATUSES] = {
+    "converged", "deadline_exceeded", "best_feasible", "failed"};
+
+// In the order of MPC_NLP::Abort, after NOT_ABORTED.
+static const char* const ABORT_NAMES[Metrics::ABORTS] = {
+    "restoration", "divergence", "stall"};
+
+Metrics metrics;
+
+Metrics::Metrics()
+    : ipoptSolves(0), ipoptIterations(0), planFrames(0), forcedSolves(0),
+      forcedSolveInterval(0), fastPathFrames(0), predictedSolves(0),
+      predictionError(0), underpredictedSolves(0), cacheLookups(0),
+      cacheAnswers(0), cacheSeeds(0), primitiveSeeds(0), meteredSolves(0),
+      solveEnergy(0),
+      deadlineMisses(0), preemptions(0), preemptedFrames(0), connections(0),
+      framesPending(0), framesReplaced(0), framesStale(0), sessionCpu(0),
+      utilization(0), sessionsRefused(0), sessionsDegraded(0), workers(0),
+      tapeBytes(0), workspaceBytes(0), bufferBytes(0), sessionsHibernated(0),
+      hibernationBytes(0), hibernations(0), wakeups(0),
+      allocationFrames(0), frameAllocations(0), shadowFrames(0),
+      shadowDropped(0), shadowSteeringError(0), shadowThrottleError(0),
+      shadowDisagreements(0), cyclesRun(0), cyclesMissed(0), cyclesIdle(0) {
+  for (int i = 0; i < STATUSES; i++) {
+    solves[i].store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < ABORTS; i++) {
+    abortedSolves[i].store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < OBJECTIVES; i++) {
+    sloViolations[i].store(0, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    cppadInuse[i].store(0, std::memory_order_relaxed);
+    cppadAvailable[i].store(0, std::memory_order_relaxed);
+    workerBusy[i].store(0, std::memory_order_relaxed);
+    workerSteals[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+// Resident set size in bytes; 0 where /proc isn't available.
+static uint64_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t pages = 0;
+  uint64_t resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void Line(std::string& out, const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  out += line;
+  out += '\n';
+}
+
+static unsigned long long Load(const std::atomic<uint64_t>& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+static long long Load(const std::atomic<int64_t>& gauge) {
+  return gauge.load(std::memory_order_relaxed);
+}
+
+void WriteMetrics(std::string& out) {
+  out.clear();
+  Line(out, "# HELP mpc_stage_seconds Time of each stage of a frame.");
+  Line(out, "# TYPE mpc_stage_seconds histogram");
+  Histogram::Snapshot s;
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    const char* stage = StageName(Stage(i));
+    StageHistogram(Stage(i)).Read(s);
+    unsigned long long cumulative = 0;
+    for (int b = 0; b < Histogram::BUCKETS - 1; b++) {
+      cumulative += s.counts[b];
+      Line(out, "mpc_stage_seconds_bucket{stage=\"%s\",le=\"%.6g\"} %llu",
+           stage, Histogram::UpperBound(b), cumulative);
+    }
+    Line(out, "mpc_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu",
+         stage, (unsigned long long)s.count);
+    Line(out, "mpc_stage_seconds_sum{stage=\"%s\"} %.9g", stage, s.sum);
+    Line(out, "mpc_stage_seconds_count{stage=\"%s\"} %llu", stage,
+         (unsigned long long)s.count);
+  }
+  if (CountingPerf()) {
+    Line(out, "# HELP mpc_stage_events_total Hardware events of each stage, "
+              "see PerfCounters.h.");
+    Line(out, "# TYPE mpc_stage_events_total counter");
+    PerfCounts counts;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+      if (ReadPerfStage(Stage(i), counts) == 0) {
+        continue;
+      }
+      for (int e = 0; e < PERF_EVENTS; e++) {
+        Line(out, "mpc_stage_events_total{stage=\"%s\",event=\"%s\"} %llu",
+             StageName(Stage(i)), PerfEventName(PerfEvent(e)),
+             (unsigned long long)counts.events[e]);
+      }
+    }
+    Line(out, "# HELP mpc_stage_counted_total Scopes of each stage whose "
+              "events were counted.");
+    Line(out, "# TYPE mpc_stage_counted_total counter");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+      uint64_t scopes = ReadPerfStage(Stage(i), counts);
+      if (scopes > 0) {
+        Line(out, "mpc_stage_counted_total{stage=\"%s\"} %llu",
+             StageName(Stage(i)), (unsigned long long)scopes);
+      }
+    }
+  }
+
+  Line(out, "# HELP mpc_solves_total Solves by outcome.");
+  Line(out, "# TYPE mpc_solves_total counter");
+  for (int i = 0; i < Metrics::STATUSES; i++) {
+    Line(out, "mpc_solves_total{status=\"%s\"} %llu", STATUS_NAMES[i],
+         Load(metrics.solves[i]));
+  }
+  Line(out, "# HELP mpc_ipopt_solves_total Solves by Ipopt.");
+  Line(out, "# TYPE mpc_ipopt_solves_total counter");
+  Line(out, "mpc_ipopt_solves_total %llu", Load(metrics.ipoptSolves));
+  Line(out, "# HELP mpc_ipopt_iterations_total Ipopt iterations, over all "
+            "its solves.");
+  Line(out, "# TYPE mpc_ipopt_iterations_total counter");
+  Line(out, "mpc_ipopt_iterations_total %llu", Load(metrics.ipoptIterations));
+  Line(out, "# HELP mpc_plan_frames_total Frames answered from the last "
+            "plan without solving.");
+  Line(out, "# TYPE mpc_plan_frames_total counter");
+  Line(out, "mpc_plan_frames_total %llu", Load(metrics.planFrames));
+  Line(out, "# HELP mpc_forced_solves_total Solves the event trigger forced "
+            "after the most frames from one plan.");
+  Line(out, "# TYPE mpc_forced_solves_total counter");
+  Line(out, "mpc_forced_solves_total %llu", Load(metrics.forcedSolves));
+  Line(out, "# HELP mpc_forced_solve_interval Most frames answered from one "
+            "plan before the event trigger forces a solve.");
+  Line(out, "# TYPE mpc_forced_solve_interval gauge");
+  Line(out, "mpc_forced_solve_interval %lld",
+       (long long)metrics.forcedSolveInterval.load(std::memory_order_relaxed));
+  Line(out, "# HELP mpc_fast_path_frames_total Frames the LQR law "
+            "answered on straights.");
+  Line(out, "# TYPE mpc_fast_path_frames_total counter");
+  Line(out, "mpc_fast_path_frames_total %llu", Load(metrics.fastPathFrames));
+  Line(out, "# HELP mpc_solve_time_predictions_total Solves whose time was "
+            "predicted to pick their tier.");
+  Line(out, "# TYPE mpc_solve_time_predictions_total counter");
+  Line(out, "mpc_solve_time_predictions_total %llu",
+       Load(metrics.predictedSolves));
+  Line(out, "# HELP mpc_solve_time_prediction_error_seconds_total Absolute "
+            "error of the predicted solve times.");
+  Line(out, "# TYPE mpc_solve_time_prediction_error_seconds_total counter");
+  Line(out, "mpc_solve_time_prediction_error_seconds_total %.9g",
+       1e-9 * Load(metrics.predictionError));
+  Line(out, "# HELP mpc_solve_time_underpredictions_total Solves that took "
+            "longer than predicted.");
+  Line(out, "# TYPE mpc_solve_time_underpredictions_total counter");
+  Line(out, "mpc_solve_time_underpredictions_total %llu",
+       Load(metrics.underpredictedSolves));
+  Line(out, "# HELP mpc_solves_aborted_total Ipopt solves stopped early as "
+            "hopeless, by reason.");
+  Line(out, "# TYPE mpc_solves_aborted_total counter");
+  for (int i = 0; i < Metrics::ABORTS; i++) {
+    Line(out, "mpc_solves_aborted_total{reason=\"%s\"} %llu", ABORT_NAMES[i],
+         Load(metrics.abortedSolves[i]));
+  }
+  Line(out, "# HELP mpc_cache_lookups_total Solves looked up in the "
+            "solution cache.");
+  Line(out, "# TYPE mpc_cache_lookups_total counter");
+  Line(out, "mpc_cache_lookups_total %llu", Load(metrics.cacheLookups));
+  Line(out, "# HELP mpc_cache_hits_total Lookups that found a solution, by "
+            "whether it answered or warm started the solve.");
+  Line(out, "# TYPE mpc_cache_hits_total counter");
+  Line(out, "mpc_cache_hits_total{use=\"answer\"} %llu",
+       Load(metrics.cacheAnswers));
+  Line(out, "mpc_cache_hits_total{use=\"seed\"} %llu",
+       Load(metrics.cacheSeeds));
+  Line(out, "# HELP mpc_primitive_seeds_total Solves started from a motion "
+            "primitive.");
+  Line(out, "# TYPE mpc_primitive_seeds_total counter");
+  Line(out, "mpc_primitive_seeds_total %llu", Load(metrics.primitiveSeeds));
+  Line(out, "# HELP mpc_metered_solves_total Solves whose energy was "
+            "metered.");
+  Line(out, "# TYPE mpc_metered_solves_total counter");
+  Line(out, "mpc_metered_solves_total %llu", Load(metrics.meteredSolves));
+  Line(out, "# HELP mpc_solve_energy_joules_total Energy the CPU used over "
+            "the metered solves.");
+  Line(out, "# TYPE mpc_solve_energy_joules_total counter");
+  Line(out, "mpc_solve_energy_joules_total %.9g",
+       1e-6 * Load(metrics.solveEnergy));
+  Line(out, "# HELP mpc_deadline_misses_total Commands sent later than the "
+            "control period after their frame.");
+  Line(out, "# TYPE mpc_deadline_misses_total counter");
+  Line(out, "mpc_deadline_misses_total %llu", Load(metrics.deadlineMisses));
+  Line(out, "# HELP mpc_preemptions_total Involuntary context switches of "
+            "the workers while solving frames.");
+  Line(out, "# TYPE mpc_preemptions_total counter");
+  Line(out, "mpc_preemptions_total %llu", Load(metrics.preemptions));
+  Line(out, "# HELP mpc_preempted_frames_total Frames whose worker was "
+            "preempted while solving them.");
+  Line(out, "# TYPE mpc_preempted_frames_total counter");
+  Line(out, "mpc_preempted_frames_total %llu", Load(metrics.preemptedFrames));
+  Line(out, "# HELP mpc_connections Open connections.");
+  Line(out, "# TYPE mpc_connections gauge");
+  Line(out, "mpc_connections %lld",
+       (long long)metrics.connections.load(std::memory_order_relaxed));
+  Line(out, "# HELP mpc_frames_pending Frames waiting for their solve, over "
+            "the open sessions.");
+  Line(out, "# TYPE mpc_frames_pending gauge");
+  Line(out, "mpc_frames_pending %lld", Load(metrics.framesPending));
+  Line(out, "# HELP mpc_frames_dropped_total Frames not solved, by whether "
+            "a newer one replaced them or they were stale.");
+  Line(out, "# TYPE mpc_frames_dropped_total counter");
+  Line(out, "mpc_frames_dropped_total{reason=\"replaced\"} %llu",
+       Load(metrics.framesReplaced));
+  Line(out, "mpc_frames_dropped_total{reason=\"stale\"} %llu",
+       Load(metrics.framesStale));
+  Line(out, "# HELP mpc_session_cpu_seconds_total CPU time of the sessions' "
+            "steps on the workers.");
+  Line(out, "# TYPE mpc_session_cpu_seconds_total counter");
+  Line(out, "mpc_session_cpu_seconds_total %.9g",
+       1e-9 * Load(metrics.sessionCpu));
+  Line(out, "# HELP mpc_utilization The workers' CPU taken by sessions, as "
+            "admission control last sampled it.");
+  Line(out, "# TYPE mpc_utilization gauge");
+  Line(out, "mpc_utilization %.6f", 1e-6 * Load(metrics.utilization));
+  Line(out, "# HELP mpc_admission_decisions_total New sessions admission "
+            "control refused, or held to a cheaper tier.");
+  Line(out, "# TYPE mpc_admission_decisions_total counter");
+  Line(out, "mpc_admission_decisions_total{decision=\"refused\"} %llu",
+       Load(metrics.sessionsRefused));
+  Line(out, "mpc_admission_decisions_total{decision=\"degraded\"} %llu",
+       Load(metrics.sessionsDegraded));
+  int workers = int(std::min<long long>(Load(metrics.workers),
+                                        (long long)Metrics::THREADS));
+  Line(out, "# HELP mpc_worker_busy_seconds_total Time each worker spent "
+            "running tasks; its rate is the worker's utilization.");
+  Line(out, "# TYPE mpc_worker_busy_seconds_total counter");
+  for (int i = 0; i < workers; i++) {
+    Line(out, "mpc_worker_busy_seconds_total{worker=\"%d\"} %.9g", i,
+         1e-9 * Load(metrics.workerBusy[i]));
+  }
+  Line(out, "# HELP mpc_worker_steals_total Tasks each worker took from "
+            "another's queue.");
+  Line(out, "# TYPE mpc_worker_steals_total counter");
+  for (int i = 0; i < workers; i++) {
+    Line(out, "mpc_worker_steals_total{worker=\"%d\"} %llu", i,
+         Load(metrics.workerSteals[i]));
+  }
+  Line(out, "# HELP mpc_cppad_memory_bytes CppAD's allocator by thread, in "
+            "use or held for reuse.");
+  Line(out, "# TYPE mpc_cppad_memory_bytes gauge");
+  for (int i = 0; i < Metrics::THREADS; i++) {
+    long long inuse = Load(metrics.cppadInuse[i]);
+    long long available = Load(metrics.cppadAvailable[i]);
+    if (inuse == 0 && available == 0) {
+      continue;
+    }
+    Line(out, "mpc_cppad_memory_bytes{thread=\"%d\",state=\"inuse\"} %lld", i,
+         inuse);
+    Line(out, "mpc_cppad_memory_bytes{thread=\"%d\",state=\"available\"} "
+              "%lld", i, available);
+  }
+  Line(out, "# HELP mpc_session_memory_bytes Over the open sessions: tapes, "
+            "estimated solver workspace, and frame and reply buffers.");
+  Line(out, "# TYPE mpc_session_memory_bytes gauge");
+  Line(out, "mpc_session_memory_bytes{use=\"tapes\"} %lld",
+       Load(metrics.tapeBytes));
+  Line(out, "mpc_session_memory_bytes{use=\"workspace\"} %lld",
+       Load(metrics.workspaceBytes));
+  Line(out, "mpc_session_memory_bytes{use=\"buffers\"} %lld",
+       Load(metrics.bufferBytes));
+  Line(out, "mpc_session_memory_bytes{use=\"hibernated\"} %lld",
+       Load(metrics.hibernationBytes));
+  Line(out, "# HELP mpc_sessions_hibernated Open sessions whose controllers "
+            "are hibernated.");
+  Line(out, "# TYPE mpc_sessions_hibernated gauge");
+  Line(out, "mpc_sessions_hibernated %lld", Load(metrics.sessionsHibernated));
+  Line(out, "# HELP mpc_hibernations_total Sessions hibernated, and woken "
+            "by a frame.");
+  Line(out, "# TYPE mpc_hibernations_total counter");
+  Line(out, "mpc_hibernations_total{event=\"hibernate\"} %llu",
+       Load(metrics.hibernations));
+  Line(out, "mpc_hibernations_total{event=\"wake\"} %llu",
+       Load(metrics.wakeups));
+  if (CountingAllocations()) {
+    Line(out, "# HELP mpc_frame_allocations_total Global operator new calls "
+              "while solving frames.");
+    Line(out, "# TYPE mpc_frame_allocations_total counter");
+    Line(out, "mpc_frame_allocations_total %llu",
+         Load(metrics.frameAllocations));
+    Line(out, "# HELP mpc_allocation_frames_total Frames the allocations "
+              "were counted over.");
+    Line(out, "# TYPE mpc_allocation_frames_total counter");
+    Line(out, "mpc_allocation_frames_total %llu",
+         Load(metrics.allocationFrames));
+  }
+  Line(out, "# HELP mpc_shadow_frames_total Frames sampled for the "
+            "candidate engine, by whether it solved them or they were "
+            "dropped.");
+  Line(out, "# TYPE mpc_shadow_frames_total counter");
+  Line(out, "mpc_shadow_frames_total{outcome=\"solved\"} %llu",
+       Load(metrics.shadowFrames));
+  Line(out, "mpc_shadow_frames_total{outcome=\"dropped\"} %llu",
+       Load(metrics.shadowDropped));
+  Line(out, "# HELP mpc_shadow_difference_total Absolute differences of the "
+            "candidate's actuations from the live engine's, summed.");
+  Line(out, "# TYPE mpc_shadow_difference_total counter");
+  Line(out, "mpc_shadow_difference_total{actuation=\"steering_rad\"} %.9g",
+       1e-6 * Load(metrics.shadowSteeringError));
+  Line(out, "mpc_shadow_difference_total{actuation=\"throttle\"} %.9g",
+       1e-6 * Load(metrics.shadowThrottleError));
+  Line(out, "# HELP mpc_shadow_disagreements_total Frames the engines' "
+            "actuations differed on beyond the tolerance.");
+  Line(out, "# TYPE mpc_shadow_disagreements_total counter");
+  Line(out, "mpc_shadow_disagreements_total %llu",
+       Load(metrics.shadowDisagreements));
+  Line(out, "# HELP mpc_shadow_solve_seconds Solve time of each engine over "
+            "the frames both solved.");
+  Line(out, "# TYPE mpc_shadow_solve_seconds histogram");
+  const char* const engines[] = {"live", "candidate"};
+  for (int i = 0; i < 2; i++) {
+    (i == 0 ? metrics.shadowLive : metrics.shadowCandidate).Read(s);
+    unsigned long long cumulative = 0;
+    for (int b = 0; b < Histogram::BUCKETS - 1; b++) {
+      cumulative += s.counts[b];
+      Line(out, "mpc_shadow_solve_seconds_bucket{engine=\"%s\",le=\"%.6g\"} "
+                "%llu",
+           engines[i], Histogram::UpperBound(b), cumulative);
+    }
+    Line(out, "mpc_shadow_solve_seconds_bucket{engine=\"%s\",le=\"+Inf\"} "
+              "%llu",
+         engines[i], (unsigned long long)s.count);
+    Line(out, "mpc_shadow_solve_seconds_sum{engine=\"%s\"} %.9g", engines[i],
+         s.sum);
+    Line(out, "mpc_shadow_solve_seconds_count{engine=\"%s\"} %llu",
+         engines[i], (unsigned long long)s.count);
+  }
+  Line(out, "# HELP mpc_slo_violations_total Times a session's window of "
+            "commands went into violation of an objective.");
+  Line(out, "# TYPE mpc_slo_violations_total counter");
+  for (int i = 0; i < Metrics::OBJECTIVES; i++) {
+    Line(out, "mpc_slo_violations_total{objective=\"%s\"} %llu",
+         SloTracker::Name(SloTracker::Objective(i)),
+         Load(metrics.sloViolations[i]));
+  }
+  Line(out, "# HELP mpc_command_seconds Age of the state each command was "
+            "computed from, and its inter-departure jitter, as it went out.");
+  Line(out, "# TYPE mpc_command_seconds histogram");
+  const char* const measures[] = {"age", "jitter"};
+  for (int i = 0; i < 2; i++) {
+    (i == 0 ? metrics.commandAge : metrics.commandJitter).Read(s);
+    unsigned long long cumulative = 0;
+    for (int b = 0; b < Histogram::BUCKETS - 1; b++) {
+      cumulative += s.counts[b];
+      Line(out, "mpc_command_seconds_bucket{measure=\"%s\",le=\"%.6g\"} "
+                "%llu",
+           measures[i], Histogram::UpperBound(b), cumulative);
+    }
+    Line(out, "mpc_command_seconds_bucket{measure=\"%s\",le=\"+Inf\"} %llu",
+         measures[i], (unsigned long long)s.count);
+    Line(out, "mpc_command_seconds_sum{measure=\"%s\"} %.9g", measures[i],
+         s.sum);
+    Line(out, "mpc_command_seconds_count{measure=\"%s\"} %llu", measures[i],
+         (unsigned long long)s.count);
+  }
+  Line(out, "# HELP mpc_cycles_total Time-triggered control cycles, by "
+            "whether they ran, were missed, or had no new frame.");
+  Line(out, "# TYPE mpc_cycles_total counter");
+  Line(out, "mpc_cycles_total{outcome=\"run\"} %llu", Load(metrics.cyclesRun));
+  Line(out, "mpc_cycles_total{outcome=\"missed\"} %llu",
+       Load(metrics.cyclesMissed));
+  Line(out, "mpc_cycles_total{outcome=\"idle\"} %llu",
+       Load(metrics.cyclesIdle));
+  Line(out, "# HELP mpc_cycle_jitter_seconds How late each time-triggered "
+            "cycle's timer fired.");
+  Line(out, "# TYPE mpc_cycle_jitter_seconds histogram");
+  metrics.cycleJitter.Read(s);
+  {
+    unsigned long long cumulative = 0;
+    for (int b = 0; b < Histogram::BUCKETS - 1; b++) {
+      cumulative += s.counts[b];
+      Line(out, "mpc_cycle_jitter_seconds_bucket{le=\"%.6g\"} %llu",
+           Histogram::UpperBound(b), cumulative);
+    }
+  }
+  Line(out, "mpc_cycle_jitter_seconds_bucket{le=\"+Inf\"} %llu",
+       (unsigned long long)s.count);
+  Line(out, "mpc_cycle_jitter_seconds_sum %.9g", s.sum);
+  Line(out, "mpc_cycle_jitter_seconds_count %llu",
+       (unsigned long long)s.count);
+  Line(out, "# HELP mpc_profile_samples_total Stacks sampled, see "
+            "StackSampler.h.");
+  Line(out, "# TYPE mpc_profile_samples_total counter");
+  Line(out, "mpc_profile_samples_total %llu",
+       (unsigned long long)StackSamples());
+  Line(out, "# HELP process_resident_memory_bytes Resident memory size.");
+  Line(out, "# TYPE process_resident_memory_bytes gauge");
+  Line(out, "process_resident_memory_bytes %llu",
+       (unsigned long long)ResidentBytes());
+  Line(out, "# HELP mpc_heap_allocator The malloc the process runs on, see "
+            "HeapAllocator.h.");
+  Line(out, "# TYPE mpc_heap_allocator gauge");
+  Line(out, "mpc_heap_allocator{allocator=\"%s\"} 1",
+       HeapAllocatorName(HeapAllocator()));
+  HeapUsage heap;
+  if (ReadHeapUsage(heap)) {
+    Line(out, "# HELP mpc_heap_bytes The heap as the allocator holds it: "
+              "allocated, held but free, and mapped.");
+    Line(out, "# TYPE mpc_heap_bytes gauge");
+    Line(out, "mpc_heap_bytes{state=\"inuse\"} %llu",
+         (unsigned long long)heap.inuse);
+    Line(out, "mpc_heap_bytes{state=\"free\"} %llu",
+         (unsigned long long)heap.free);
+    Line(out, "mpc_heap_bytes{state=\"mapped\"} %llu",
+         (unsigned long long)heap.mapped);
+  }
+  HugePageUsage huge;
+  if (ReadHugePageUsage(huge)) {
+    Line(out, "# HELP mpc_huge_page_bytes Memory in huge pages, see "
+              "HugePages.h, with the heap's mode.");
+    Line(out, "# TYPE mpc_huge_page_bytes gauge");
+    const char* mode = HugePageModeName(HeapHugePages());
+    Line(out, "mpc_huge_page_bytes{kind=\"transparent\",heap=\"%s\"} %llu",
+         mode, (unsigned long long)huge.transparentBytes);
+    Line(out, "mpc_huge_page_bytes{kind=\"explicit\",heap=\"%s\"} %llu",
+         mode, (unsigned long long)huge.explicitBytes);
+  }
+}
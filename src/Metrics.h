@@ -0,0 +1,138 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "Histogram.h"
+
+// Process-wide counters for the /metrics endpoint, next to the stage
+// histograms of Stages.h. All are relaxed atomics that any thread bumps
+// without waiting, so that a scrape never holds up a solve.
+struct Metrics {
+  Metrics();
+
+  // Workers, or CppAD allocators, shown; those past THREADS aren't.
+  static const int THREADS = 64;
+  // Solves by MPC::Status.
+  static const int STATUSES = 4;
+  std::atomic<uint64_t> solves[STATUSES];
+  // IPOPT solves and the iterations they took.
+  std::atomic<uint64_t> ipoptSolves;
+  std::atomic<uint64_t> ipoptIterations;
+  // Frames answered by tracking the last plan instead of solving, see
+  // MPC::solveEvery and eventTriggered, and the solves the event trigger
+  // forced after trigger.maxFrames of them, which it holds.
+  std::atomic<uint64_t> planFrames;
+  std::atomic<uint64_t> forcedSolves;
+  std::atomic<int64_t> forcedSolveInterval;
+  // Frames the LQR law answered on straights, see MPC::hybridLqr.
+  std::atomic<uint64_t> fastPathFrames;
+  // Solves whose time was predicted beforehand, see MPC::predictTier: the
+  // absolute error of the predictions, in nanoseconds, and those that took
+  // longer than predicted.
+  std::atomic<uint64_t> predictedSolves;
+  std::atomic<uint64_t> predictionError;
+  std::atomic<uint64_t> underpredictedSolves;
+  // IPOPT solves stopped as hopeless, by MPC_NLP::Abort but NOT_ABORTED,
+  // see MPC::abortHopeless.
+  static const int ABORTS = 3;
+  std::atomic<uint64_t> abortedSolves[ABORTS];
+  // IPOPT solves looked up in the solution cache, and those answered or
+  // warm started from it, see MpcConfig::cacheEntries.
+  std::atomic<uint64_t> cacheLookups;
+  std::atomic<uint64_t> cacheAnswers;
+  std::atomic<uint64_t> cacheSeeds;
+  // IPOPT solves started from a motion primitive, see MPC::LoadPrimitives.
+  std::atomic<uint64_t> primitiveSeeds;
+  // Solves metered by an EnergyMeter, and the CPU's energy over them, in
+  // microjoules, see MPC::energyMeter.
+  std::atomic<uint64_t> meteredSolves;
+  std::atomic<uint64_t> solveEnergy;
+  // Commands that went out later than the control period after their frame.
+  std::atomic<uint64_t> deadlineMisses;
+  // Times workers were preempted while solving a frame, and the frames that
+  // were, see ThreadPreemptions().
+  std::atomic<uint64_t> preemptions;
+  std::atomic<uint64_t> preemptedFrames;
+  std::atomic<int64_t> connections;
+  // Frames handed to the sessions and not yet taken for a solve, and those
+  // dropped instead: replaced by a newer one while waiting, or stale by the
+  // time their solve came, see Session::staleAfter.
+  std::atomic<int64_t> framesPending;
+  std::atomic<uint64_t> framesReplaced;
+  std::atomic<uint64_t> framesStale;
+  // The CPU time of the sessions' steps on the workers, in nanoseconds, and
+  // what AdmissionControl made of it: the workers' utilization, in
+  // millionths, and the sessions it refused and those it held to a cheaper
+  // tier.
+  std::atomic<uint64_t> sessionCpu;
+  std::atomic<int64_t> utilization;
+  std::atomic<uint64_t> sessionsRefused;
+  std::atomic<uint64_t> sessionsDegraded;
+  // The FrameScheduler's workers: their time running tasks, in
+  // nanoseconds, and the tasks they took from other workers' queues.
+  std::atomic<int64_t> workers;
+  std::atomic<uint64_t> workerBusy[THREADS];
+  std::atomic<uint64_t> workerSteals[THREADS];
+
+  // Memory. CppAD's allocator by thread number, in use and held for reuse,
+  // as each worker last saw it.
+  std::atomic<int64_t> cppadInuse[THREADS];
+  std::atomic<int64_t> cppadAvailable[THREADS];
+  // Over the open sessions: their controllers' tapes and solver workspaces,
+  // see MPC::workspaceBytes, and their json arenas and reply buffers.
+  std::atomic<int64_t> tapeBytes;
+  std::atomic<int64_t> workspaceBytes;
+  std::atomic<int64_t> bufferBytes;
+  // Sessions hibernated while their vehicles send nothing, see
+  // Session::Hibernate, their checkpoints' bytes, and the times sessions
+  // were hibernated and woken.
+  std::atomic<int64_t> sessionsHibernated;
+  std::atomic<int64_t> hibernationBytes;
+  std::atomic<uint64_t> hibernations;
+  std::atomic<uint64_t> wakeups;
+  // Frames solved, and the global operator new calls on the worker while
+  // solving them, in builds with MPC_COUNT_ALLOCATIONS.
+  std::atomic<uint64_t> allocationFrames;
+  std::atomic<uint64_t> frameAllocations;
+
+  // Shadow evaluation, see ShadowEvaluator: the frames the candidate engine
+  // solved, and those sampled but dropped for want of room; the sums of the
+  // absolute differences of its steering from the live engine's, in
+  // microradians, and of its throttle, in millionths, and the frames either
+  // was beyond the tolerance; and the solve times of each engine over the
+  // frames solved by both.
+  std::atomic<uint64_t> shadowFrames;
+  std::atomic<uint64_t> shadowDropped;
+  std::atomic<uint64_t> shadowSteeringError;
+  std::atomic<uint64_t> shadowThrottleError;
+  std::atomic<uint64_t> shadowDisagreements;
+  Histogram shadowLive;
+  Histogram shadowCandidate;
+
+  // Service level objectives, see SloTracker: the violations by objective,
+  // in the order of SloTracker::Objective, and the age of the state each
+  // command was computed from and its inter-departure jitter as it went out.
+  static const int OBJECTIVES = 3;
+  std::atomic<uint64_t> sloViolations[OBJECTIVES];
+  Histogram commandAge;
+  Histogram commandJitter;
+
+  // Time-triggered control cycles, see PeriodicExecutor: the cycles run,
+  // those missed because the timer or the previous cycle overran their
+  // period, and those with no new frame to solve; and how late each
+  // cycle's timer fired.
+  std::atomic<uint64_t> cyclesRun;
+  std::atomic<uint64_t> cyclesMissed;
+  std::atomic<uint64_t> cyclesIdle;
+  Histogram cycleJitter;
+};
+
+extern Metrics metrics;
+
+// Everything, the stage histograms included, in the Prometheus text
+// exposition format, into `out`.
+void WriteMetrics(std::string& out);
+
+#endif /* METRICS_H */
@@ -0,0 +1,127 @@
+#include "MotionPrimitives.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+static const char PRIMITIVES_MAGIC[4] = {'M', 'M', 'P', 'L'};
+static const uint32_t PRIMITIVES_VERSION = 1;
+
+namespace {
+
+struct PrimitivesHeader {
+  char magic[4];
+  uint32_t version;
+  ControlTable::Axis axes[MotionPrimitives::DIMENSIONS];
+  ControlTable::Model model;
+  uint64_t width;
+};
+
+}  // namespace
+
+MotionPrimitives::MotionPrimitives() : axes_(), model_(), width_(0) {}
+
+MotionPrimitives::MotionPrimitives(const ControlTable::Axis axes[DIMENSIONS],
+                                   const ControlTable::Model& model,
+                                   size_t width)
+    : model_(model), width_(width) {
+  for (int d = 0; d < DIMENSIONS; d++) {
+    axes_[d] = axes[d];
+  }
+  filled_.assign(size_t(axes_[V].n) * axes_[CURVATURE].n, 0);
+  solutions_.assign(filled_.size() * width_, 0.f);
+}
+
+size_t MotionPrimitives::filled() const {
+  return std::count(filled_.begin(), filled_.end(), 1);
+}
+
+void MotionPrimitives::Point(size_t index, double& v,
+                             double& curvature) const {
+  const ControlTable::Axis& av = axes_[V];
+  const ControlTable::Axis& ac = axes_[CURVATURE];
+  v = av.lo + (av.hi - av.lo) * (index / ac.n) / (av.n - 1);
+  curvature = ac.lo + (ac.hi - ac.lo) * (index % ac.n) / (ac.n - 1);
+}
+
+void MotionPrimitives::Set(size_t index, const double* x) {
+  filled_[index] = 1;
+  std::copy(x, x + width_, solutions_.begin() + index * width_);
+}
+
+size_t MotionPrimitives::Nearest(Dimension d, double value) const {
+  const ControlTable::Axis& axis = axes_[d];
+  double t = (value - axis.lo) / (axis.hi - axis.lo) * (axis.n - 1);
+  // NaN lands on the first.
+  return t > 0 ? std::min(size_t(t + 0.5), size_t(axis.n - 1)) : 0;
+}
+
+const float* MotionPrimitives::Find(double v, double curvature) const {
+  if (filled_.empty()) {
+    return nullptr;
+  }
+  size_t index = Nearest(V, v) * axes_[CURVATURE].n +
+                 Nearest(CURVATURE, curvature);
+  return filled_[index] ? &solutions_[index * width_] : nullptr;
+}
+
+bool MotionPrimitives::Load(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  PrimitivesHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, PRIMITIVES_MAGIC,
+                      sizeof(header.magic)) == 0 &&
+               header.version == PRIMITIVES_VERSION &&
+               header.width > 0 && header.width <= 1 << 20;
+  for (int d = 0; valid && d < DIMENSIONS; d++) {
+    const ControlTable::Axis& axis = header.axes[d];
+    valid = axis.n >= 2 && axis.n <= 1 << 12 && axis.hi > axis.lo;
+  }
+  std::vector<unsigned char> filled;
+  std::vector<float> solutions;
+  if (valid) {
+    filled.resize(size_t(header.axes[V].n) * header.axes[CURVATURE].n);
+    solutions.resize(filled.size() * header.width);
+    valid = fread(filled.data(), 1, filled.size(), file) == filled.size() &&
+            fread(solutions.data(), sizeof(float), solutions.size(),
+                  file) == solutions.size();
+  }
+  fclose(file);
+  if (!valid) {
+    return false;
+  }
+  for (int d = 0; d < DIMENSIONS; d++) {
+    axes_[d] = header.axes[d];
+  }
+  model_ = header.model;
+  width_ = header.width;
+  filled_.swap(filled);
+  solutions_.swap(solutions);
+  return true;
+}
+
+bool MotionPrimitives::Save(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  PrimitivesHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PRIMITIVES_MAGIC, sizeof(PRIMITIVES_MAGIC));
+  header.version = PRIMITIVES_VERSION;
+  for (int d = 0; d < DIMENSIONS; d++) {
+    header.axes[d] = axes_[d];
+  }
+  header.model = model_;
+  header.width = width_;
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(filled_.data(), 1, filled_.size(), file) == filled_.size() &&
+      fwrite(solutions_.data(), sizeof(float), solutions_.size(), file) ==
+          solutions_.size();
+  return fclose(file) == 0 && written;
+}
@@ -0,0 +1,60 @@
+#ifndef MOTION_PRIMITIVES_H
+#define MOTION_PRIMITIVES_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "ControlTable.h"
+
+// A library of solved trajectories over a grid of speed and path
+// curvature, built offline by tools/build_primitives.cpp, for IPOPT solves
+// with nothing recent to warm start from, after a reconnect, a switch of
+// method or horizon, or a jump of the car, to start near the solution
+// instead of from zeros. A primitive is the solution for the car on the
+// path at that speed, on a path of that constant curvature, as
+// ControlTable::Sample makes the frame; a frame picks the nearest in O(1)
+// by its ControlTable::Query coordinates, clamped to the grid, and the
+// solver moves it to the car, see MPC::AnchorSolution.
+//
+// The file is a header, with the grid, the horizon and model and the
+// problem's width, and then a flag byte per primitive and its `width`
+// variables as floats, in grid order with curvature fastest, in native
+// byte order. A library is only taken by a controller of the model and
+// problem it was solved for.
+class MotionPrimitives {
+ public:
+  enum Dimension { V, CURVATURE, DIMENSIONS };
+
+  MotionPrimitives();
+  // An empty library over `axes`, n >= 2 points each, for Set().
+  MotionPrimitives(const ControlTable::Axis axes[DIMENSIONS],
+                   const ControlTable::Model& model, size_t width);
+
+  bool Load(const std::string& path);
+  bool Save(const std::string& path) const;
+
+  size_t size() const { return filled_.size(); }
+  size_t filled() const;
+  size_t width() const { return width_; }
+  const ControlTable::Axis& axis(Dimension d) const { return axes_[d]; }
+  const ControlTable::Model& model() const { return model_; }
+
+  // The speed and curvature of primitive `index`.
+  void Point(size_t index, double& v, double& curvature) const;
+  void Set(size_t index, const double* x);
+
+  // The primitive nearest to (v, curvature); nullptr if it failed to
+  // solve.
+  const float* Find(double v, double curvature) const;
+
+ private:
+  size_t Nearest(Dimension d, double value) const;
+
+  ControlTable::Axis axes_[DIMENSIONS];
+  ControlTable::Model model_;
+  size_t width_;
+  std::vector<unsigned char> filled_;
+  std::vector<float> solutions_;
+};
+
+#endif /* MOTION_PRIMITIVES_H */
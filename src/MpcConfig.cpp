@@ -0,0 +1,194 @@
+#include "MpcConfig.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static const char* const LINEAR_SOLVER_NAMES[MpcConfig::LINEAR_SOLVERS] = {
+    "mumps", "ma27", "ma57", "ma86", "ma97", "pardiso"};
+
+MpcConfig::MpcConfig() {
+  N = 10;
+  dt = 0.05;
+
+  // This value assumes the model presented in the classroom is used.
+  //
+  // It was obtained by measuring the radius formed by running the vehicle in
+  // the simulator around in a circle with a constant steering angle and
+  // velocity on a flat terrain.
+  //
+  // Lf was tuned until the the radius formed by the simulating the model
+  // presented in the classroom matched the previous radius.
+  Lf = 2.67;
+
+  refV = 50;
+
+  // cost coefficient for cte
+  weights.cte = 4;
+  // cost coefficient for espi
+  weights.epsi = 4;
+  // cost coefficient for velocity
+  weights.v = 1;
+  // cost coefficient for steering
+  weights.delta = 1000;
+  // cost coefficient for accleration
+  weights.a = 10;
+  // cost coefficient for steering gap betweent two timestamps
+  weights.delta_diff = 4;
+  // cost coefficient for accleration gap betweent two timestamps
+  weights.a_diff = 0;
+
+  Horizon candidates[] = {{N, dt}, {15, 0.05}, {20, 0.05}, {15, 0.1}};
+  horizons.assign(candidates, candidates + 4);
+  // About the default lookahead over fewer, coarser stages.
+  shortHorizon.N = 6;
+  shortHorizon.dt = 0.08;
+
+  linearSolver = MUMPS;
+  hessian = EXACT_HESSIAN;
+  nlpSolver = IPOPT;
+  tolerance = 1e-8;
+  acceptableTolerance = 1e-6;
+  acceptableIterations = 15;
+  adaptiveMu = false;
+  atomicDynamics = false;
+  autoDiff = false;
+  generatedStages = true;
+  optimizeTape = true;
+  shareTapes = true;
+  stageMajor = false;
+  initialStateBounds = false;
+  derivedErrors = false;
+  integrator = EULER;
+  model = KINEMATIC;
+  // A mid-size sedan, understeering.
+  tires.mass = 1500;
+  tires.lr = 1.2;
+  tires.frontStiffness = 80000;
+  tires.rearStiffness = 120000;
+  terminalCost = false;
+  terminalRegion = 0;
+  cteLimit = 0;
+  speedLimit = 0;
+  obstacleSlots = 0;
+  obstacleMargin = 1;
+  obstacleReach = 10;
+  softConstraints = false;
+  softL1 = 1000;
+  softL2 = 10;
+  userScaling = false;
+  cacheEntries = 0;
+  cacheTolerance = 0.05;
+  stageThreads = 1;
+  parallelStagesFrom = 50;
+  mppiEngine = MPPI::ARRAYS;
+  mppiSamples = 2048;
+  mppiThreads = 1;
+  mppiLambda = 10;
+  mppiSigmaDelta = 0.1;
+  mppiSigmaA = 0.5;
+  // The model, Lf 10% off either way, actuations landing 50 ms late, and
+  // 80% of the grip.
+  Scenario models[] = {{Lf, 0, 1},
+                       {0.9 * Lf, 0, 1},
+                       {1.1 * Lf, 0, 1},
+                       {Lf, 0.05, 1},
+                       {Lf, 0, 0.8}};
+  scenarios.assign(models, models + 5);
+  scenarioThreads = 1;
+  fixedIterations = 0;
+}
+
+const char* LinearSolverName(MpcConfig::LinearSolver solver) {
+  return LINEAR_SOLVER_NAMES[solver];
+}
+
+MpcConfig::LinearSolver LinearSolverNamed(const char* name) {
+  int i = 0;
+  while (i < MpcConfig::LINEAR_SOLVERS &&
+         strcmp(name, LINEAR_SOLVER_NAMES[i]) != 0) {
+    i++;
+  }
+  return MpcConfig::LinearSolver(i);
+}
+
+bool ApplySolverProfile(MpcConfig& config, const std::string& name) {
+  if (name == "realtime") {
+    config.tolerance = 1e-4;
+    config.acceptableTolerance = 1e-2;
+    config.acceptableIterations = 2;
+    config.adaptiveMu = true;
+    config.linearSolver = MpcConfig::MA27;
+    config.hessian = MpcConfig::GAUSS_NEWTON;
+  } else if (name == "balanced") {
+    config.tolerance = 1e-6;
+    config.acceptableTolerance = 1e-4;
+    config.acceptableIterations = 5;
+    config.adaptiveMu = true;
+    config.linearSolver = MpcConfig::MUMPS;
+    config.hessian = MpcConfig::EXACT_HESSIAN;
+  } else if (name == "offline-accurate") {
+    config.tolerance = 1e-10;
+    config.acceptableTolerance = 1e-8;
+    config.acceptableIterations = 15;
+    config.adaptiveMu = false;
+    config.linearSolver = MpcConfig::MUMPS;
+    config.hessian = MpcConfig::EXACT_HESSIAN;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool SetTuning(MpcConfig& config, const std::string& name, double value) {
+  KinematicWeights& w = config.weights;
+  if (name == "cte") {
+    w.cte = value;
+  } else if (name == "epsi") {
+    w.epsi = value;
+  } else if (name == "v") {
+    w.v = value;
+  } else if (name == "delta") {
+    w.delta = value;
+  } else if (name == "a") {
+    w.a = value;
+  } else if (name == "delta_diff") {
+    w.delta_diff = value;
+  } else if (name == "a_diff") {
+    w.a_diff = value;
+  } else if (name == "ref_v") {
+    config.refV = value;
+  } else if (name == "N" && value >= 2) {
+    config.N = size_t(value + 0.5);
+    if (!config.horizons.empty()) {
+      config.horizons[0].N = config.N;
+    }
+  } else if (name == "dt" && value > 0) {
+    config.dt = value;
+    if (!config.horizons.empty()) {
+      config.horizons[0].dt = value;
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool LoadTuning(const std::string& path, MpcConfig& config) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    double value;
+    if (!(fields >> name) || name[0] == '#') {
+      continue;
+    }
+    if (!(fields >> value) || !SetTuning(config, name, value)) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,260 @@
+#ifndef MPC_CONFIG_H
+#define MPC_CONFIG_H
+
+#include <string>
+#include <vector>
+#include "BicycleModel.h"
+#include "HorizonScheduler.h"
+#include "MPPI.h"
+#include "ScenarioMPC.h"
+
+// The tuning of one controller. MPC copies it at construction and builds
+// every problem from the copy, so controllers with different tunings can
+// run side by side.
+struct MpcConfig {
+  // The tuning the controller was developed with.
+  MpcConfig();
+
+  // Set the timestep length and duration
+  size_t N;
+  double dt;
+
+  // This is the length from front to CoG that has a similar radius.
+  double Lf;
+
+  // The reference velocity
+  double refV;
+
+  // Cost coefficients.
+  KinematicWeights weights;
+
+  // Problem shapes for the adaptive horizon; the first should be {N, dt}.
+  std::vector<Horizon> horizons;
+  // The degradation ladder's short horizon.
+  Horizon shortHorizon;
+
+  // Ipopt's linear solver. Ipopt must have been built with it, see
+  // install_ipopt.sh: MUMPS always is, the HSL solvers and Pardiso only when
+  // their sources or libraries are supplied. MA86 and MA97 factorize in
+  // parallel.
+  enum LinearSolver { MUMPS, MA27, MA57, MA86, MA97, PARDISO, LINEAR_SOLVERS };
+  LinearSolver linearSolver;
+
+  // How Ipopt gets the Hessian of the Lagrangian: exactly from the tape, or
+  // skipping second order derivatives with the Gauss-Newton approximation of
+  // the least-squares cost (see MPC_NLP) or Ipopt's L-BFGS approximation.
+  // The analytic derivatives of KinematicNLP are always exact, but take the
+  // L-BFGS approximation too.
+  enum Hessian { EXACT_HESSIAN, GAUSS_NEWTON, LIMITED_MEMORY };
+  Hessian hessian;
+
+  // What solves the NLPs: Ipopt, or the cut down InteriorPoint on the same
+  // problems, without Ipopt's overhead per iteration. InteriorPoint has no
+  // L-BFGS Hessian, so LIMITED_MEMORY keeps Ipopt, and it ignores
+  // userScaling.
+  enum NlpSolver { IPOPT, INTERIOR_POINT };
+  NlpSolver nlpSolver;
+
+  // Ipopt's convergence tests, its tol, acceptable_tol and acceptable_iter,
+  // and whether its barrier parameter follows mu_strategy adaptive rather
+  // than monotone; Ipopt's defaults unless a profile sets them, see
+  // ApplySolverProfile. InteriorPoint takes the tolerance too.
+  double tolerance;
+  double acceptableTolerance;
+  int acceptableIterations;
+  bool adaptiveMu;
+
+  // Whether the tape records each stage's dynamics as one call of the atomic
+  // BicycleAtomic rather than as its operations. The tape is then a fraction
+  // of the size at any horizon, and cheaper to record and to sweep.
+  bool atomicDynamics;
+
+  // Whether the problems take each stage's derivatives from Eigen's
+  // AutoDiffScalar, see AutoDiffNLP, rather than from sweeps of the tape,
+  // where KinematicNLP's aren't asked for or don't fit: with either model
+  // and any integrator but EXACT, in the full formulation.
+  bool autoDiff;
+  // Whether AutoDiffNLP evaluates the stages generated as straight-line
+  // code at build time, where one was for the problem; see
+  // GeneratedStages.h.
+  bool generatedStages;
+
+  // Whether each tape is optimized once after recording, see MPC_NLP.
+  bool optimizeTape;
+
+  // Directory to keep each tape's sparsity patterns in across runs, so that
+  // only the first run with a problem shape computes them, see
+  // MPC_NLP::pattern_cache; empty to compute them every time.
+  std::string patternCache;
+
+  // Whether controllers with the same tapes share them, with their
+  // patterns and colorings, instead of each keeping its own, see
+  // MPC_NLP::share_tapes.
+  bool shareTapes;
+
+  // Lay the variables and constraints of the tape out stage by stage rather
+  // than variable by variable, for locality in the sweeps and a banded KKT
+  // matrix; see Layout in MPC.cpp. The analytic derivatives of KinematicNLP
+  // keep the variable-major layout.
+  bool stageMajor;
+
+  // Reduced formulations of the taped problem (see Layout in MPC.cpp):
+  // initialStateBounds fixes stage 0 through its bounds instead of equality
+  // constraints, and derivedErrors makes cte and epsi expressions of the
+  // stage before instead of variables, which leaves 4 states a stage. The
+  // analytic derivatives keep the full formulation, and so do the
+  // Gauss-Newton residuals for derivedErrors.
+  bool initialStateBounds;
+  bool derivedErrors;
+
+  // Move blocking: the lengths in stages of the blocks the actuations are
+  // held over, the last repeated to the end of the horizon, so that a long
+  // horizon has a handful of actuation variables; e.g. {1, 1, 2, 2, 4}.
+  // Empty for an actuation pair each stage. The taped problem only, in the
+  // variable-major layout.
+  std::vector<size_t> moveBlocks;
+
+  // A non-uniform time grid: the step in seconds from each stage to the
+  // next, the last repeated to the end of the horizon, in place of the
+  // horizon's dt; e.g. 0.05 s near the car growing to 0.2 s far out, for the
+  // same lookahead over fewer stages. Empty for uniform steps. The taped
+  // problems only: the analytic derivatives and the RTI, LTV and LQR
+  // controllers keep dt, and the adaptive horizon still judges lookaheads by
+  // N * dt.
+  std::vector<double> stageDt;
+
+  // How the taped dynamics integrate each stage: forward Euler as the model
+  // was written, the midpoint rule, RK4, or exactly for actuations held
+  // over the stage. The higher orders stay accurate at longer steps, for
+  // the same lookahead over fewer stages. Only EULER has the analytic
+  // derivatives and BicycleAtomic; the others fall back to the tape of the
+  // operations.
+  enum Integrator { EULER, MIDPOINT, RK4, EXACT };
+  Integrator integrator;
+
+  // The vehicle model of the taped problems, see ProblemPolicies.h: the
+  // kinematic bicycle, or DYNAMIC's steady-state tire forces with `tires`.
+  // The LTV controller takes it and the integrator from ProblemIR, with
+  // EXACT as RK4; the latency prediction and the RTI, LQR and sampling
+  // controllers keep the kinematic model, and the tape integrates DYNAMIC
+  // with RK4 for EXACT.
+  enum Model { KINEMATIC, DYNAMIC };
+  Model model;
+  Tires tires;
+
+  // Terminal ingredients for short horizons, of the taped problems. With
+  // terminalCost the cost ends with the infinite-horizon LQR cost-to-go of
+  // the last stage: (cte, epsi)' P (cte, epsi) from the discrete algebraic
+  // Riccati equation of LateralLQR's model at refV, and the speed's. A
+  // positive terminalRegion constrains the last stage's (cte, epsi)' P
+  // (cte, epsi) to at most that, which far from the path can be infeasible
+  // unless softConstraints.
+  bool terminalCost;
+  double terminalRegion;
+
+  // State constraints of the taped problems, off at 0: |cte| at most
+  // cteLimit and the speed at most speedLimit, at every stage after the
+  // first.
+  //
+  // Obstacle constraints, off at 0 slots: each stage after the first keeps
+  // obstacleMargin meters clear of the discs of MPC::obstacles nearest it,
+  // up to obstacleSlots of them, out of those within obstacleReach of where
+  // the last solution put the stage (see ObstacleMap::Near). The slots are
+  // on the tape with their discs as dynamic parameters, so that the problem
+  // has one shape whatever the map; each frame fills them, and the bounds
+  // switch off those left empty. The reach covers how far a stage moves
+  // between frames.
+  //
+  // With softConstraints all of them and the terminal region are relaxed by
+  // slack variables priced at softL1 s + softL2 s^2 in the cost, so that an
+  // unreachable constraint costs instead of making the problem infeasible
+  // and sending Ipopt into its restoration phase. softL1 beyond the
+  // constraints' multipliers keeps the penalty exact: the slacks stay 0
+  // whenever the hard problem is feasible.
+  double cteLimit;
+  double speedLimit;
+  size_t obstacleSlots;
+  double obstacleMargin;
+  double obstacleReach;
+  bool softConstraints;
+  double softL1;
+  double softL2;
+
+  // Scale the problem for Ipopt by the typical magnitudes of its variables,
+  // constraints and cost, from their units and bounds (see ScaleProblem in
+  // MPC.cpp), instead of Ipopt's gradient-based scaling at the first point.
+  bool userScaling;
+
+  // Keep up to cacheEntries IPOPT solutions by their rounded inputs, see
+  // SolutionCache: a solve whose inputs fall in the cell of a kept one
+  // starts from it, and is answered with it outright within cacheTolerance
+  // cells of its inputs; 0 for no cache, and a cacheTolerance of 0 only
+  // warm starts.
+  size_t cacheEntries;
+  double cacheTolerance;
+
+  // Threads, the solving one included, to evaluate the stages of the
+  // analytic derivatives on (see KinematicNLP), at horizons of
+  // parallelStagesFrom stages and more; shorter horizons and 1 thread
+  // evaluate serially. Either way the results are the same to the bit.
+  size_t stageThreads;
+  size_t parallelStagesFrom;
+
+  // The MPPI controller of MPC::PATH_INTEGRAL, see MPPI: the engine of its
+  // rollouts, rollouts per frame and the threads, the solving one included,
+  // to run them on, the temperature of its weighting, and the standard
+  // deviations of its perturbations of delta and a.
+  MPPI::Engine mppiEngine;
+  size_t mppiSamples;
+  size_t mppiThreads;
+  double mppiLambda;
+  double mppiSigmaDelta;
+  double mppiSigmaA;
+
+  // The models MPC::ROBUST plans one first move for, see ScenarioMPC, and
+  // the threads, the solving one included, to split them between.
+  std::vector<Scenario> scenarios;
+  size_t scenarioThreads;
+
+  // Deterministic iteration counts, off at 0: every solve runs exactly this
+  // many iterations and answers with the last iterate, with no test of a
+  // tolerance to stop early on, so that its time is the same from frame to
+  // frame and its worst case can be bounded. RTI's QP takes this many
+  // sweeps; LTV's SPARSE, CONDENSED and RICCATI QPs this many ADMM
+  // iterations, at a rho held where it is; InteriorPoint this many Newton
+  // steps, each the fraction to the boundary step with no line search.
+  // Ipopt, ACTIVE_SET and the sampling controllers keep their own
+  // termination. bench/wcet.cpp measures the worst case.
+  int fixedIterations;
+};
+
+// Ipopt's name for the linear solver, its linear_solver option.
+const char* LinearSolverName(MpcConfig::LinearSolver solver);
+// The solver named `name`, or LINEAR_SOLVERS.
+MpcConfig::LinearSolver LinearSolverNamed(const char* name);
+
+// Set the solver options of `config` to those of a named profile: the
+// tolerances, the barrier update, the linear solver and the Hessian.
+//
+//   realtime          loose tolerances, accepting an iterate after 2
+//                     acceptable iterations, as converged, adaptive mu,
+//                     MA27 and the Gauss-Newton Hessian: fewest and
+//                     cheapest iterations, for tight control periods; needs
+//                     Ipopt built with HSL
+//   balanced          tol 1e-6, adaptive mu, MUMPS and the exact Hessian
+//   offline-accurate  tol 1e-10, monotone mu, MUMPS and the exact Hessian,
+//                     for reference solutions
+//
+// False for any other name, leaving `config` as it was.
+bool ApplySolverProfile(MpcConfig& config, const std::string& name);
+
+// Set the tuning parameter `name` of `config`: a weight by its name in
+// KinematicWeights, "ref_v", "N" or "dt", the last two for the first
+// horizon as well. False for any other name.
+bool SetTuning(MpcConfig& config, const std::string& name, double value);
+// Set the parameters of a tuning file, "name value" lines of SetTuning's
+// names, such as tools/tune.cpp writes; blank lines and lines starting with
+// '#' are skipped. False if it can't be read or has any other line.
+bool LoadTuning(const std::string& path, MpcConfig& config);
+
+#endif /* MPC_CONFIG_H */
@@ -0,0 +1,175 @@
+#include "Obstacles.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include "Eigen-3.3/Eigen/Geometry"
+#include "Eigen-3.3/unsupported/Eigen/BVH"
+#include "TrackMap.h"
+
+struct ObstacleMap::Tree {
+  Eigen::KdBVH<double, 2, int> bvh;
+};
+
+namespace {
+
+// The BVIntersect visitor of ObstacleMap::Near: a box is entered if it is
+// within reach of any point, and a disc within reach of a point takes its
+// place among the point's k nearest.
+struct NearTrajectory {
+  typedef Eigen::AlignedBox2d Volume;
+
+  const std::vector<ObstacleMap::Disc>& discs;
+  const double* x;
+  const double* y;
+  size_t n;
+  double reach;
+  size_t k;
+  uint32_t* near;
+  double* clearance;
+  size_t* count;
+  // All of the points, grown by reach.
+  Volume bounds;
+
+  bool intersectVolume(const Volume& box) const {
+    if (!bounds.intersects(box)) {
+      return false;
+    }
+    const double reach2 = reach * reach;
+    for (size_t t = 0; t < n; t++) {
+      if (box.squaredExteriorDistance(Eigen::Vector2d(x[t], y[t])) <=
+          reach2) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool intersectObject(int i) {
+    const ObstacleMap::Disc& d = discs[i];
+    for (size_t t = 0; t < n; t++) {
+      double c = std::hypot(d.x - x[t], d.y - y[t]) - d.radius;
+      if (c > reach) {
+        continue;
+      }
+      // Insertion into the point's sorted slots, dropping the farthest
+      // when they are full.
+      uint32_t* slots = near + k * t;
+      double* clear = clearance + k * t;
+      size_t j = count[t] < k ? count[t]++ : k;
+      for (; j > 0 && clear[j - 1] > c; j--) {
+        if (j < k) {
+          slots[j] = slots[j - 1];
+          clear[j] = clear[j - 1];
+        }
+      }
+      if (j < k) {
+        slots[j] = uint32_t(i);
+        clear[j] = c;
+      }
+    }
+    return false;
+  }
+};
+
+}  // namespace
+
+ObstacleMap::ObstacleMap() : tree_(new Tree) {}
+
+ObstacleMap::~ObstacleMap() {}
+
+void ObstacleMap::Add(double x, double y, double radius) {
+  discs_.push_back(Disc{x, y, radius});
+}
+
+void ObstacleMap::AddEdge(const double* x, const double* y, size_t n,
+                          double radius) {
+  if (n == 0 || radius <= 0) {
+    return;
+  }
+  Add(x[0], y[0], radius);
+  for (size_t i = 1; i < n; i++) {
+    double length = std::hypot(x[i] - x[i - 1], y[i] - y[i - 1]);
+    size_t steps = size_t(std::ceil(length / radius));
+    for (size_t j = 1; j <= steps; j++) {
+      double f = double(j) / steps;
+      Add(x[i - 1] + f * (x[i] - x[i - 1]), y[i - 1] + f * (y[i] - y[i - 1]),
+          radius);
+    }
+  }
+}
+
+void ObstacleMap::AddRoadEdges(const TrackMap& track, double half_width,
+                               double radius) {
+  if (track.size() == 0 || radius <= 0) {
+    return;
+  }
+  const double offset = half_width + radius;
+  double s = 0;
+  while (s < track.length()) {
+    double x;
+    double y;
+    double dx;
+    double dy;
+    track.Evaluate(s, x, y, dx, dy);
+    double norm = std::hypot(dx, dy);
+    double nx = -dy / norm;
+    double ny = dx / norm;
+    Add(x + offset * nx, y + offset * ny, radius);
+    Add(x - offset * nx, y - offset * ny, radius);
+    // The edge on the outside of a bend is longer than the centerline.
+    double kappa = std::fabs(track.curvature(track.Segment(s)));
+    s += radius / (1 + kappa * offset);
+  }
+}
+
+bool ObstacleMap::Load(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    size_t first = line.find(',');
+    size_t second =
+        first == std::string::npos ? first : line.find(',', first + 1);
+    if (second != std::string::npos) {
+      Add(atof(line.c_str()), atof(line.c_str() + first + 1),
+          atof(line.c_str() + second + 1));
+    }
+  }
+  return true;
+}
+
+void ObstacleMap::Build() {
+  std::vector<int> indices(discs_.size());
+  std::vector<Eigen::AlignedBox2d> boxes(discs_.size());
+  for (size_t i = 0; i < discs_.size(); i++) {
+    const Disc& d = discs_[i];
+    indices[i] = int(i);
+    boxes[i] = Eigen::AlignedBox2d(Eigen::Vector2d(d.x, d.y))
+                   .extend(Eigen::Vector2d(d.x - d.radius, d.y - d.radius))
+                   .extend(Eigen::Vector2d(d.x + d.radius, d.y + d.radius));
+  }
+  tree_->bvh.init(indices.begin(), indices.end(), boxes.begin(),
+                  boxes.end());
+}
+
+void ObstacleMap::Near(const double* x, const double* y, size_t n,
+                       double reach, size_t k, uint32_t* near,
+                       double* clearance, size_t* count) const {
+  std::fill(count, count + n, size_t(0));
+  if (n == 0 || k == 0 || discs_.empty()) {
+    return;
+  }
+  NearTrajectory visitor = {discs_, x,         y,     n,
+                            reach,  k,         near,  clearance,
+                            count,  Eigen::AlignedBox2d()};
+  for (size_t t = 0; t < n; t++) {
+    visitor.bounds.extend(Eigen::Vector2d(x[t], y[t]));
+  }
+  visitor.bounds.min().array() -= reach;
+  visitor.bounds.max().array() += reach;
+  Eigen::BVIntersect(tree_->bvh, visitor);
+}
@@ -0,0 +1,66 @@
+#ifndef OBSTACLES_H
+#define OBSTACLES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TrackMap;
+
+// Static obstacles and road edges, as discs in world coordinates, for the
+// obstacle constraints of the taped problems (see MpcConfig::obstacleSlots).
+//
+// The discs are indexed by a bounding volume hierarchy, Eigen's KdBVH from
+// unsupported/Eigen/BVH, so that a frame finds the few of them near the
+// car's predicted trajectory by descending into the boxes within reach of
+// it, and a map of thousands of obstacles costs a frame about what one of
+// tens does. Road edges are lines of discs along them.
+class ObstacleMap {
+ public:
+  struct Disc {
+    double x;
+    double y;
+    double radius;
+  };
+
+  ObstacleMap();
+  ~ObstacleMap();
+  ObstacleMap(const ObstacleMap&) = delete;
+  ObstacleMap& operator=(const ObstacleMap&) = delete;
+
+  // An obstacle at (x, y).
+  void Add(double x, double y, double radius);
+  // A wall along the polyline (x[i], y[i]), i < n, as discs of `radius`
+  // at most `radius` apart, so that no gap between them lets a point
+  // through by more than about a seventh of the radius.
+  void AddEdge(const double* x, const double* y, size_t n, double radius);
+  // The road edges of `track`, `half_width` either side of its centerline,
+  // as walls of discs of `radius` just outside them.
+  void AddRoadEdges(const TrackMap& track, double half_width, double radius);
+  // Add the obstacles of "x,y,radius" lines after a header line. False if
+  // the file can't be read.
+  bool Load(const std::string& path);
+  // Index the discs. Call it after adding them and before Near.
+  void Build();
+
+  size_t size() const { return discs_.size(); }
+  const Disc& operator[](size_t i) const { return discs_[i]; }
+
+  // For each point t < n of a trajectory, (x[t], y[t]), up to k of the
+  // discs whose edges come within `reach` of it, nearest edge first: their
+  // indices at near[k t], the distances of their edges at clearance[k t],
+  // negative inside them, and how many in count[t].
+  void Near(const double* x, const double* y, size_t n, double reach,
+            size_t k, uint32_t* near, double* clearance,
+            size_t* count) const;
+
+ private:
+  struct Tree;
+  std::vector<Disc> discs_;
+  // The hierarchy over discs_ as of the last Build.
+  std::unique_ptr<Tree> tree_;
+};
+
+#endif /* OBSTACLES_H */
@@ -0,0 +1,183 @@
+#include "PerfCounters.h"
+#include <atomic>
+#include <cstring>
+#if defined(MPC_PERF_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char* const NAMES[PERF_EVENTS] = {
+    "cycles",     "instructions",  "l1d_misses",
+    "llc_misses", "branch_misses", "dtlb_misses"};
+
+const char* PerfEventName(PerfEvent event) { return NAMES[event]; }
+
+#ifdef MPC_PERF_COUNTERS
+
+namespace {
+
+struct Totals {
+  std::atomic<uint64_t> scopes;
+  std::atomic<uint64_t> events[PERF_EVENTS];
+};
+
+// Zero-initialized as statics.
+Totals totals[STAGE_COUNT];
+
+}  // namespace
+
+bool CountingPerf() { return true; }
+
+uint64_t ReadPerfStage(Stage stage, PerfCounts& counts) {
+  for (int e = 0; e < PERF_EVENTS; e++) {
+    counts.events[e] = totals[stage].events[e].load(std::memory_order_relaxed);
+  }
+  return totals[stage].scopes.load(std::memory_order_relaxed);
+}
+
+#ifdef __linux__
+
+namespace {
+
+const uint32_t TYPES[PERF_EVENTS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                     PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+                                     PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+const uint64_t CONFIGS[PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+        PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+        PERF_COUNT_HW_CACHE_RESULT_MISS << 16};
+
+// The counters of a thread, led by its cycles and read together; closed
+// with the thread.
+class Group {
+ public:
+  Group() : opened_(false), size_(0) {}
+  ~Group() { Close(); }
+
+  // Opens the counters the first time.
+  bool Counting() {
+    if (!opened_) {
+      opened_ = true;
+      Open();
+    }
+    return size_ > 0;
+  }
+
+  // False, and the thread stops counting, once the group can't be read, as
+  // when a pinned group is pushed off the PMU.
+  bool Read(PerfCounts& counts) {
+    uint64_t values[1 + PERF_EVENTS];
+    ssize_t length = size_ > 0 ? read(fds_[0], values, sizeof(values)) : 0;
+    if (length < ssize_t((1 + size_) * sizeof(uint64_t))) {
+      Close();
+      return false;
+    }
+    for (int e = 0; e < PERF_EVENTS; e++) {
+      counts.events[e] = slots_[e] < 0 ? 0 : values[1 + slots_[e]];
+    }
+    return true;
+  }
+
+  // What the thread's scopes counted into each stage.
+  PerfCounts stages[STAGE_COUNT];
+
+ private:
+  void Open() {
+    memset(stages, 0, sizeof(stages));
+    for (int e = 0; e < PERF_EVENTS; e++) {
+      slots_[e] = -1;
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = TYPES[e];
+      attr.config = CONFIGS[e];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      // All on the PMU or none, so that counts are never scaled estimates.
+      attr.pinned = size_ == 0;
+      int fd = syscall(SYS_perf_event_open, &attr, 0, -1,
+                       size_ == 0 ? -1 : fds_[0], PERF_FLAG_FD_CLOEXEC);
+      if (fd < 0) {
+        // Without its leader there is no group.
+        if (size_ == 0) {
+          return;
+        }
+        continue;
+      }
+      slots_[e] = size_;
+      fds_[size_++] = fd;
+    }
+  }
+
+  void Close() {
+    for (int i = size_ - 1; i >= 0; i--) {
+      close(fds_[i]);
+    }
+    size_ = 0;
+  }
+
+  bool opened_;
+  int size_;
+  int fds_[PERF_EVENTS];
+  // Each event's place in the group's read, -1 for those not opened.
+  int slots_[PERF_EVENTS];
+};
+
+thread_local Group group;
+
+}  // namespace
+
+PerfScope::PerfScope(Stage stage, Stage excluded)
+    : stage_(stage),
+      excluded_(excluded),
+      counting_(group.Counting() && group.Read(start_)) {
+  if (counting_ && excluded_ != STAGE_COUNT) {
+    excluded_start_ = group.stages[excluded_];
+  }
+}
+
+void PerfScope::Stop() {
+  if (!counting_) {
+    return;
+  }
+  counting_ = false;
+  PerfCounts end;
+  if (!group.Read(end)) {
+    return;
+  }
+  Totals& stage = totals[stage_];
+  for (int e = 0; e < PERF_EVENTS; e++) {
+    uint64_t count = end.events[e] - start_.events[e];
+    if (excluded_ != STAGE_COUNT) {
+      count -= group.stages[excluded_].events[e] - excluded_start_.events[e];
+    }
+    group.stages[stage_].events[e] += count;
+    stage.events[e].fetch_add(count, std::memory_order_relaxed);
+  }
+  stage.scopes.fetch_add(1, std::memory_order_relaxed);
+}
+
+#else
+
+PerfScope::PerfScope(Stage stage, Stage excluded)
+    : stage_(stage), excluded_(excluded), counting_(false) {}
+
+void PerfScope::Stop() {}
+
+#endif
+
+#else
+
+bool CountingPerf() { return false; }
+
+uint64_t ReadPerfStage(Stage, PerfCounts& counts) {
+  memset(&counts, 0, sizeof(counts));
+  return 0;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include "Stages.h"
+
+// Hardware events per stage of the pipeline, for telling a stage that got
+// slower because it does more from one that waits more on memory or
+// mispredicts more. Built with MPC_PERF_COUNTERS on Linux, each thread opens
+// a group of counters with perf_event_open(2) the first time it enters a
+// counted stage, counting in user space only so that perf_event_paranoid up
+// to 2 allows it. A PerfScope reads the group on entry and on exit, a read(2)
+// each, and adds the difference to the stage's totals for the process.
+// Events the CPU lacks count 0; a thread whose counters can't be opened, or
+// lose the PMU to another group, counts nothing. Without the option, scopes
+// compile to nothing.
+enum PerfEvent {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  // Read misses of the L1 data cache, and misses of the last level cache.
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  // Read misses of the data TLB.
+  PERF_DTLB_MISSES,
+  PERF_EVENTS
+};
+
+struct PerfCounts {
+  uint64_t events[PERF_EVENTS];
+};
+
+const char* PerfEventName(PerfEvent event);
+
+// Whether this build counts.
+bool CountingPerf();
+// The totals of `stage` over every thread, and the scopes that added them.
+uint64_t ReadPerfStage(Stage stage, PerfCounts& totals);
+
+#ifdef MPC_PERF_COUNTERS
+
+// The calling thread's events from construction until Stop, or destruction,
+// into `stage`; less those it counted into `excluded` meanwhile, for a stage
+// that encloses the scopes of another.
+class PerfScope {
+ public:
+  explicit PerfScope(Stage stage, Stage excluded = STAGE_COUNT);
+  ~PerfScope() { Stop(); }
+  PerfScope(const PerfScope&) = delete;
+  PerfScope& operator=(const PerfScope&) = delete;
+  void Stop();
+
+ private:
+  Stage stage_;
+  Stage excluded_;
+  bool counting_;
+  PerfCounts start_;
+  PerfCounts excluded_start_;
+};
+
+#else
+
+class PerfScope {
+ public:
+  explicit PerfScope(Stage, Stage = STAGE_COUNT) {}
+  PerfScope(const PerfScope&) = delete;
+  PerfScope& operator=(const PerfScope&) = delete;
+  void Stop() {}
+};
+
+#endif
+
+#endif /* PERF_COUNTERS_H */
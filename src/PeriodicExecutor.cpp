@@ -0,0 +1,132 @@
+#include "PeriodicExecutor.h"
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstdio>
+#include "Metrics.h"
+#include "Realtime.h"
+#include "StackSampler.h"
+
+#ifdef __linux__
+
+static int NewTimer() {
+  return timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+}
+
+// Have `timer` expire at `ns` on CLOCK_MONOTONIC, or never for 0.
+static void SetTimer(int timer, int64_t ns) {
+  itimerspec at = {{0, 0}, {ns / 1000000000, ns % 1000000000}};
+  timerfd_settime(timer, TFD_TIMER_ABSTIME, &at, nullptr);
+}
+
+// Wait for `timer` to expire; false if it can't be waited on.
+static bool WaitTimer(int timer) {
+  uint64_t expirations;
+  return read(timer, &expirations, sizeof(expirations)) >= 0 ||
+         errno == EINTR;
+}
+
+static void CloseTimer(int timer) { close(timer); }
+
+#else
+
+static int NewTimer() { return -1; }
+static void SetTimer(int, int64_t) {}
+static bool WaitTimer(int) { return false; }
+static void CloseTimer(int) {}
+
+#endif
+
+PeriodicExecutor::PeriodicExecutor(int priority)
+    : next_(0), stopping_(false),
+      timer_fd_(NewTimer()),
+      priority_(priority) {
+  if (timer_fd_ >= 0) {
+    thread_ = std::thread(&PeriodicExecutor::Run, this);
+  }
+}
+
+PeriodicExecutor::~PeriodicExecutor() {
+  if (timer_fd_ < 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    // Expired as soon as it is set.
+    SetTimer(timer_fd_, 1);
+  }
+  thread_.join();
+  CloseTimer(timer_fd_);
+}
+
+uint64_t PeriodicExecutor::Add(Clock::time_point first,
+                               Clock::duration period, Tick tick) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t timer = ++next_;
+  timers_[timer] = Timer{first, period, std::move(tick)};
+  due_.insert(std::make_pair(first, timer));
+  if (due_.begin()->second == timer) {
+    Arm();
+  }
+  return timer;
+}
+
+void PeriodicExecutor::Remove(uint64_t timer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = timers_.find(timer);
+  if (it == timers_.end()) {
+    return;
+  }
+  due_.erase(std::make_pair(it->second.due, timer));
+  timers_.erase(it);
+}
+
+void PeriodicExecutor::Arm() {
+  int64_t ns = 0;
+  if (!due_.empty()) {
+    ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+             due_.begin()->first.time_since_epoch()).count();
+    // Zero would disarm it.
+    ns = ns > 0 ? ns : 1;
+  }
+  SetTimer(timer_fd_, ns);
+}
+
+void PeriodicExecutor::Run() {
+  SampleThread("cycles");
+  if (priority_ > 0 && !SetFifoPriority(priority_)) {
+    fprintf(stderr, "Failed to set the cycle timer to SCHED_FIFO\n");
+  }
+  for (;;) {
+    if (!WaitTimer(timer_fd_)) {
+      perror("cycle timer");
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      return;
+    }
+    Clock::time_point now = Clock::now();
+    while (!due_.empty() && due_.begin()->first <= now) {
+      uint64_t id = due_.begin()->second;
+      due_.erase(due_.begin());
+      Timer& timer = timers_[id];
+      metrics.cycleJitter.Record(
+          std::chrono::duration<double>(now - timer.due).count());
+      // Ticks whose period had already gone by are skipped, and this one
+      // stands for the last of them.
+      Clock::duration::rep missed = (now - timer.due) / timer.period;
+      if (missed > 0) {
+        metrics.cyclesMissed.fetch_add(missed, std::memory_order_relaxed);
+      }
+      Clock::time_point due = timer.due + missed * timer.period;
+      timer.due = due + timer.period;
+      due_.insert(std::make_pair(timer.due, id));
+      timer.tick(due);
+    }
+    Arm();
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef PERIODIC_EXECUTOR_H
+#define PERIODIC_EXECUTOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+// A thread that ticks each of its timers at a fixed period, for control
+// cycles that run on the clock rather than as frames come.
+//
+// The ticks fall on a grid of absolute times, `first` plus whole periods,
+// and the thread sleeps on a timerfd armed for the soonest of them with
+// TFD_TIMER_ABSTIME, so that a tick that comes late doesn't push back the
+// ones after it the way a sleep for the period would. A tick is called
+// once however late it is: the periods it overran are skipped, not caught
+// up on, and counted as missed. How late each tick was called, its
+// jitter, and the periods missed go into the metrics.
+//
+// The ticks run on the executor's thread, under its mutex, so they are to
+// hand their work on, to a FrameScheduler say, and return.
+class PeriodicExecutor {
+ public:
+  // CLOCK_MONOTONIC, which the timerfd is on.
+  typedef std::chrono::steady_clock Clock;
+  // Called with the time the tick was due.
+  typedef std::function<void(Clock::time_point due)> Tick;
+
+  // Starts the thread; with a `priority`, at that SCHED_FIFO priority,
+  // see SetFifoPriority.
+  explicit PeriodicExecutor(int priority = 0);
+  // Joins the thread; the ticks still added are never called again.
+  ~PeriodicExecutor();
+
+  PeriodicExecutor(const PeriodicExecutor&) = delete;
+  PeriodicExecutor& operator=(const PeriodicExecutor&) = delete;
+
+  // False if the timerfd couldn't be made, and nothing will tick.
+  bool ok() const { return timer_fd_ >= 0; }
+
+  // Call `tick` at `first` and every `period` after; returns the timer's
+  // number, never 0, for Remove().
+  uint64_t Add(Clock::time_point first, Clock::duration period, Tick tick);
+  // Stop the timer; once this returns its tick isn't running and won't be
+  // called again. Not from a tick.
+  void Remove(uint64_t timer);
+
+ private:
+  struct Timer {
+    Clock::time_point due;
+    Clock::duration period;
+    Tick tick;
+  };
+
+  void Run();
+  // Arm the timerfd for the soonest timer, or disarm it; under mutex_.
+  void Arm();
+
+  std::mutex mutex_;
+  std::map<uint64_t, Timer> timers_;
+  // The timers by when they are due, soonest first.
+  std::set<std::pair<Clock::time_point, uint64_t> > due_;
+  uint64_t next_;
+  bool stopping_;
+  int timer_fd_;
+  int priority_;
+  std::thread thread_;
+};
+
+#endif /* PERIODIC_EXECUTOR_H */
@@ -0,0 +1,286 @@
+#include "Planner.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "BinaryProtocol.h"
+#include "SteerMessage.h"
+#include "TelemetryParser.h"
+
+namespace {
+
+// By MPC::Status, as in the metrics.
+const char* const STATUS_NAMES[] = {"converged", "deadline_exceeded",
+                                    "best_feasible", "failed"};
+
+}  // namespace
+
+Planner::Solvers::Solvers(Factory factory, size_t count)
+    : factory_(factory) {
+  for (size_t i = 0; i < std::max<size_t>(count, 1); i++) {
+    solvers_.emplace_back(new Solver());
+    free_.push_back(solvers_.back().get());
+  }
+}
+
+Planner::Solvers::Solver* Planner::Solvers::Take() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  freed_.wait(lock, [this] { return !free_.empty(); });
+  Solver* solver = free_.back();
+  free_.pop_back();
+  return solver;
+}
+
+void Planner::Solvers::Give(Solver* solver) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(solver);
+  }
+  freed_.notify_one();
+}
+
+Planner::Planner(uv_loop_t* loop, FrameScheduler& scheduler,
+                 Solvers& solvers, const Options& options)
+    : scheduler_(scheduler),
+      solvers_(solvers),
+      options_(options),
+      next_worker_(0) {
+  options_.chunk = std::max<size_t>(options_.chunk, 1);
+  uv_async_init(loop, &async_, [](uv_async_t* handle) {
+    static_cast<Planner*>(handle->data)->Flush();
+  });
+  async_.data = this;
+  uv_unref(reinterpret_cast<uv_handle_t*>(&async_));
+}
+
+// The loop has stopped by then, and its handles with it.
+Planner::~Planner() {}
+
+void Planner::Refuse(uWS::HttpResponse* res, const char* status) {
+  std::string head = "HTTP/1.1 ";
+  head += status;
+  head += "\r\nContent-Length: 0\r\n\r\n";
+  res->write(head.data(), head.length());
+  res->end(nullptr, 0);
+}
+
+bool Planner::Request(uWS::HttpResponse* res, uWS::HttpRequest req,
+                      char* data, size_t length, size_t remaining) {
+  if (req.getUrl().toString() != options_.path) {
+    return false;
+  }
+  if (req.getMethod() != uWS::HttpMethod::METHOD_POST) {
+    Refuse(res, "405 Method Not Allowed");
+    return true;
+  }
+  if (length + remaining > options_.maxBytes) {
+    Refuse(res, "413 Payload Too Large");
+    return true;
+  }
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->res = res;
+  uWS::Header type = req.getHeader("content-type");
+  job->binary = type && type.toString() == "application/octet-stream";
+  job->due = FrameScheduler::Clock::now() +
+             std::chrono::duration_cast<FrameScheduler::Clock::duration>(
+                 std::chrono::duration<double>(options_.slack));
+  job->written = 0;
+  job->cancelled = false;
+  job->body.reserve(length + remaining);
+  job->body.append(data, length);
+  res->userData = job.get();
+  jobs_[job.get()] = job;
+  if (remaining == 0) {
+    Start(job);
+  }
+  return true;
+}
+
+void Planner::Data(uWS::HttpResponse* res, char* data, size_t length,
+                   size_t remaining) {
+  auto found = jobs_.find(static_cast<Job*>(res->userData));
+  if (found == jobs_.end()) {
+    return;
+  }
+  std::shared_ptr<Job> job = found->second;
+  job->body.append(data, length);
+  if (remaining == 0) {
+    Start(job);
+  }
+}
+
+void Planner::Cancelled(uWS::HttpResponse* res) {
+  auto found = jobs_.find(static_cast<Job*>(res->userData));
+  if (found == jobs_.end()) {
+    return;
+  }
+  Job& job = *found->second;
+  job.res = nullptr;
+  job.cancelled = true;
+  // Chunks on the workers hand the job back to Flush, which drops it.
+  if (job.done.empty()) {
+    jobs_.erase(found);
+  }
+}
+
+void Planner::Start(const std::shared_ptr<Job>& job) {
+  const char* p = job->body.data();
+  const char* end = p + job->body.size();
+  bool parsed = true;
+  Telemetry t;
+  while (parsed && p < end) {
+    if (job->binary) {
+      size_t n = size_t(end - p) < BINARY_HEADER_SIZE
+                     ? 0
+                     : uint8_t(p[4]) | size_t(uint8_t(p[5])) << 8;
+      size_t size = BINARY_HEADER_SIZE + 8 * (6 + 2 * n);
+      parsed = size_t(end - p) >= size && ParseBinaryTelemetry(p, p + size, t);
+      p += size;
+    } else {
+      const char* first = p;
+      const char* line = std::find(p, end, '\n');
+      const char* last = line;
+      while (last > first && (last[-1] == '\r' || last[-1] == ' ')) {
+        last--;
+      }
+      p = line == end ? end : line + 1;
+      if (last == first) {
+        continue;
+      }
+      try {
+        parsed = ParseTelemetry(first, last, t) ||
+                 ParseTelemetryJson(first, last, t, arena_);
+      } catch (const std::exception&) {
+        parsed = false;
+      }
+    }
+    if (parsed) {
+      t.received = FrameScheduler::Clock::now();
+      t.latency = 0;
+      t.prepared = false;
+      job->problems.push_back(t);
+    }
+  }
+  std::string().swap(job->body);
+  if (!parsed || job->problems.empty()) {
+    uWS::HttpResponse* res = job->res;
+    res->userData = nullptr;
+    jobs_.erase(job.get());
+    Refuse(res, "400 Bad Request");
+    return;
+  }
+
+  size_t chunks =
+      (job->problems.size() + options_.chunk - 1) / options_.chunk;
+  job->answers.resize(chunks);
+  job->done.assign(chunks, false);
+  std::string head = "HTTP/1.1 200 OK\r\nContent-Type: ";
+  head += job->binary ? "application/octet-stream" : "application/x-ndjson";
+  head += "\r\nTransfer-Encoding: chunked\r\n\r\n";
+  job->res->write(head.data(), head.length());
+  for (size_t c = 0; c < chunks; c++) {
+    scheduler_.Submit(next_worker_++ % scheduler_.size(), job->due,
+                      [this, job, c] { Solve(job, c); });
+  }
+}
+
+void Planner::Solve(const std::shared_ptr<Job>& job, size_t chunk) {
+  size_t first = chunk * options_.chunk;
+  size_t last = std::min(job->problems.size(), first + options_.chunk);
+  if (!job->cancelled.load(std::memory_order_relaxed)) {
+    Solvers::Solver* solver = solvers_.Take();
+    {
+      MPC::Allocator::Scope scope(solver->allocator);
+      if (!solver->controller) {
+        solver->controller = solvers_.factory_();
+      }
+      Controller& controller = *solver->controller;
+      Controller::Output& out = solver->out;
+      std::string& text = solver->text;
+      text.clear();
+      for (size_t k = first; k < last; k++) {
+        if (job->cancelled.load(std::memory_order_relaxed)) {
+          break;
+        }
+        controller.Step(
+            job->problems[k],
+            FrameScheduler::Clock::now() +
+                std::chrono::duration_cast<FrameScheduler::Clock::duration>(
+                    std::chrono::duration<double>(options_.budget)),
+            out);
+        if (job->binary) {
+          WriteBinarySteer(solver->message, out.steering, out.throttle,
+                           out.x, out.y, out.points, nullptr, nullptr, 0);
+          text += solver->message;
+          continue;
+        }
+        text += "{\"index\":";
+        text += std::to_string(k);
+        text += ",\"status\":\"";
+        text += STATUS_NAMES[controller.mpc().stats().status];
+        text += "\",\"steering_angle\":";
+        AppendDouble(text, out.steering);
+        text += ",\"throttle\":";
+        AppendDouble(text, out.throttle);
+        text += ",\"mpc_x\":[";
+        for (size_t i = 0; i < out.points; i++) {
+          if (i > 0) {
+            text += ',';
+          }
+          AppendDouble(text, out.x[i]);
+        }
+        text += "],\"mpc_y\":[";
+        for (size_t i = 0; i < out.points; i++) {
+          if (i > 0) {
+            text += ',';
+          }
+          AppendDouble(text, out.y[i]);
+        }
+        text += "]}\n";
+      }
+      // As one chunk of the chunked encoding, in which an empty one would
+      // end the response.
+      if (!text.empty()) {
+        char size[24];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", text.size());
+        std::string& answer = job->answers[chunk];
+        answer.reserve(n + text.size() + 2);
+        answer.assign(size, n);
+        answer += text;
+        answer += "\r\n";
+      }
+    }
+    solvers_.Give(solver);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    solved_.emplace_back(job, chunk);
+  }
+  uv_async_send(&async_);
+}
+
+void Planner::Flush() {
+  std::vector<std::pair<std::shared_ptr<Job>, size_t> > solved;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    solved.swap(solved_);
+  }
+  for (const auto& handed : solved) {
+    Job& job = *handed.first;
+    job.done[handed.second] = true;
+    while (job.written < job.done.size() && job.done[job.written]) {
+      std::string& answer = job.answers[job.written];
+      if (job.res && !answer.empty()) {
+        job.res->write(answer.data(), answer.length());
+      }
+      std::string().swap(answer);
+      job.written++;
+    }
+    if (job.written == job.done.size()) {
+      if (job.res) {
+        job.res->userData = nullptr;
+        job.res->end("0\r\n\r\n", 5);
+      }
+      jobs_.erase(&job);
+    }
+  }
+}
@@ -0,0 +1,146 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <uWS/uWS.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Arena.h"
+#include "Controller.h"
+#include "FrameScheduler.h"
+#include "MPC.h"
+#include "Telemetry.h"
+
+// Batch planning over HTTP, for offline queries and what-if runs against
+// the serving binary: a POST to the planner's path carries a batch of
+// independent problems, each a frame as a client sends it, and is answered
+// with each problem's solve, streamed back in order as they finish.
+//
+// With a Content-Type of application/octet-stream the body is TELEMETRY
+// messages of BinaryProtocol.h back to back, and each answer a STEER
+// message; otherwise it is telemetry payloads, ["telemetry",{...}], one per
+// line, and each answer a line
+//
+//   {"index":k,"status":"converged","steering_angle":...,"throttle":...,
+//    "mpc_x":[...],"mpc_y":[...]}
+//
+// in a chunked application/x-ndjson response. A problem is solved from its
+// frame's state as given, without predicting over any latency.
+//
+// The problems go to the sessions' FrameScheduler in chunks, each due
+// `slack` after the request arrived: a worker takes one only when no frame
+// is due sooner, so a batch fills the workers' idle time and delays a frame
+// by at most the chunk in progress, while a busy server still gets through
+// it eventually. Chunks are solved by controllers of the planner's own,
+// each used by one chunk at a time and built on first use, with their CppAD
+// memory in an MPC::Allocator, since a chunk runs on whichever worker is
+// free. Answers come back through a uv_async_t, like the sessions' replies.
+class Planner {
+ public:
+  // A new controller for planning; on a worker, under its allocator.
+  typedef std::function<std::unique_ptr<Controller>()> Factory;
+
+  // The controllers, shared by the planners of every event loop; as many
+  // as the scheduler has workers, so that a chunk never waits for one.
+  class Solvers {
+   public:
+    Solvers(Factory factory, size_t count);
+    Solvers(const Solvers&) = delete;
+    Solvers& operator=(const Solvers&) = delete;
+
+   private:
+    friend class Planner;
+    struct Solver {
+      MPC::Allocator allocator;
+      std::unique_ptr<Controller> controller;
+      Controller::Output out;
+      std::string text;
+      std::string message;
+    };
+    // A free solver; waits for one when all are busy.
+    Solver* Take();
+    void Give(Solver* solver);
+
+    Factory factory_;
+    std::mutex mutex_;
+    std::condition_variable freed_;
+    std::vector<std::unique_ptr<Solver> > solvers_;
+    std::vector<Solver*> free_;
+  };
+
+  struct Options {
+    Options()
+        : path("/plan"), chunk(16), slack(1), budget(1), maxBytes(16 << 20) {}
+    // The URL it answers, and the problems of a task.
+    std::string path;
+    size_t chunk;
+    // Seconds after its request that a chunk is due on the scheduler, and
+    // that each problem's solve is stopped at after it starts.
+    double slack;
+    double budget;
+    // Larger bodies are refused with 413.
+    size_t maxBytes;
+  };
+
+  // On the thread of `loop`, before it runs; the loop, the scheduler and
+  // the solvers outlive it.
+  Planner(uv_loop_t* loop, FrameScheduler& scheduler, Solvers& solvers,
+          const Options& options);
+  ~Planner();
+  Planner(const Planner&) = delete;
+  Planner& operator=(const Planner&) = delete;
+
+  // The uWS HTTP callbacks, on the event loop thread. Request returns false
+  // for a request that isn't the planner's, for the caller to answer.
+  bool Request(uWS::HttpResponse* res, uWS::HttpRequest req, char* data,
+               size_t length, size_t remaining);
+  void Data(uWS::HttpResponse* res, char* data, size_t length,
+            size_t remaining);
+  void Cancelled(uWS::HttpResponse* res);
+
+ private:
+  struct Job {
+    // Null once the request is cancelled.
+    uWS::HttpResponse* res;
+    bool binary;
+    FrameScheduler::Clock::time_point due;
+    std::string body;
+    std::vector<Telemetry> problems;
+    // Each chunk's answers, set on the worker that solved it; and on the
+    // loop, which have come back and how many are written.
+    std::vector<std::string> answers;
+    std::vector<bool> done;
+    size_t written;
+    std::atomic<bool> cancelled;
+  };
+
+  // Parse the body of `job` and queue its chunks.
+  void Start(const std::shared_ptr<Job>& job);
+  void Solve(const std::shared_ptr<Job>& job, size_t chunk);
+  // Write out what the workers handed back; on the loop.
+  void Flush();
+  static void Refuse(uWS::HttpResponse* res, const char* status);
+
+  FrameScheduler& scheduler_;
+  Solvers& solvers_;
+  Options options_;
+  uv_async_t async_;
+  // For the payloads ParseTelemetry leaves to ParseTelemetryJson.
+  Arena arena_;
+  // The requests in progress, by their responses' user data; loop only.
+  std::map<Job*, std::shared_ptr<Job> > jobs_;
+  size_t next_worker_;
+  // Chunks solved and not yet flushed, under mutex_.
+  std::mutex mutex_;
+  std::vector<std::pair<std::shared_ptr<Job>, size_t> > solved_;
+};
+
+#endif /* PLANNER_H */
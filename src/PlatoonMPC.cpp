@@ -0,0 +1,191 @@
+#include "PlatoonMPC.h"
+#include <algorithm>
+#include <cmath>
+
+PlatoonMPC::PlatoonMPC(size_t N, double dt, double Lf,
+                       const KinematicWeights& weights, size_t cars,
+                       size_t threads)
+    : minGap(10), maxIterations(50), rho(50), tolerance(0.05),
+      lastIterations(0), lastConverged(false), lastGapViolation(0), N_(N),
+      dt_(dt), Lf_(Lf), w_(weights), n_u_(2 * (N - 1)),
+      pool_(new StagePool(threads)) {
+  R_ = ControlCost(N, w_);
+  double state_weight[6] = {0, 0, 0, w_.v, w_.cte, w_.epsi};
+  state_weight_ = Eigen::VectorXd::Zero(6 * (N - 1));
+  for (size_t k = 0; k + 1 < N; k++) {
+    state_weight_.segment<6>(6 * k) = Eigen::Map<State>(state_weight);
+  }
+  cars_.resize(cars);
+  for (Car& c : cars_) {
+    c.ubar = Eigen::MatrixXd::Zero(2, N - 1);
+    c.xbar = Eigen::MatrixXd::Zero(6, N);
+    c.gamma = Eigen::MatrixXd::Zero(6 * (N - 1), n_u_);
+    c.q_gamma = Eigen::MatrixXd::Zero(6 * (N - 1), n_u_);
+    c.residual = Eigen::VectorXd::Zero(6 * (N - 1));
+    c.H = Eigen::MatrixXd::Zero(n_u_, n_u_);
+    c.g = Eigen::VectorXd::Zero(n_u_);
+    c.H_rho = Eigen::MatrixXd::Zero(n_u_, n_u_);
+    c.g_rho = Eigen::VectorXd::Zero(n_u_);
+    c.lb = Eigen::VectorXd::Zero(n_u_);
+    c.ub = Eigen::VectorXd::Zero(n_u_);
+    c.zero = Eigen::VectorXd::Zero(n_u_);
+    c.position_gamma = Eigen::MatrixXd::Zero(N - 1, n_u_);
+    c.base = Eigen::VectorXd::Zero(N - 1);
+    c.planned = Eigen::VectorXd::Zero(N - 1);
+    c.dual = Eigen::VectorXd::Zero(N - 1);
+    c.qp.Resize(n_u_);
+  }
+  positions_ = Eigen::MatrixXd::Zero(N - 1, cars);
+  consensus_ = Eigen::MatrixXd::Zero(N - 1, cars);
+  previous_ = Eigen::MatrixXd::Zero(N - 1, cars);
+  block_sum_.reserve(cars);
+  block_size_.reserve(cars);
+}
+
+void PlatoonMPC::Prepare(Car& c, const PlatoonCar& car) {
+  for (size_t k = 0; k + 2 < N_; k++) {
+    c.ubar.col(k) = c.ubar.col(k + 1);
+    c.dual[k] = c.dual[k + 1];
+  }
+  c.coeffs = car.coeffs;
+  c.xbar.col(0) = car.state;
+  StateJacobian A;
+  InputJacobian B;
+  for (size_t k = 0; k + 1 < N_; k++) {
+    State s = c.xbar.col(k);
+    Input u = c.ubar.col(k);
+    c.xbar.col(k + 1) = BicycleStep(s, u, car.coeffs, dt_, Lf_);
+    BicycleLinearize(s, u, car.coeffs, dt_, Lf_, A, B);
+    CondenseStage(k, A, B, c.gamma);
+    c.residual.segment<6>(6 * k) = c.xbar.col(k + 1);
+    c.residual[6 * k + 3] -= car.refV;
+    c.lb[2 * k] = -MAX_DELTA - c.ubar(0, k);
+    c.ub[2 * k] = MAX_DELTA - c.ubar(0, k);
+    c.lb[2 * k + 1] = -MAX_A - c.ubar(1, k);
+    c.ub[2 * k + 1] = MAX_A - c.ubar(1, k);
+    c.position_gamma.row(k) = c.gamma.row(6 * k);
+    c.base[k] = car.s + c.xbar(0, k + 1) - car.state[0];
+  }
+  c.q_gamma.noalias() = state_weight_.asDiagonal() * c.gamma;
+  c.H.noalias() = 2 * c.gamma.transpose() * c.q_gamma;
+  c.H += 2 * R_;
+  Eigen::Map<Eigen::VectorXd> u_flat(c.ubar.data(), n_u_);
+  c.g.noalias() = 2 * c.q_gamma.transpose() * c.residual;
+  c.g.noalias() += 2 * R_ * u_flat;
+  // rho / 2 |base + P du - z + dual|^2 on top of the car's own cost; only
+  // its linear term changes between iterations.
+  c.H_rho = c.H;
+  c.H_rho.noalias() += rho * c.position_gamma.transpose() * c.position_gamma;
+  c.planned = c.base;
+  c.qp.WarmStart(c.zero);
+}
+
+void PlatoonMPC::Step(Car& c, const Eigen::VectorXd& z) {
+  c.g_rho = c.g;
+  c.g_rho.noalias() +=
+      rho * c.position_gamma.transpose() * (c.base - z + c.dual);
+  // From where the last iteration's QP left off.
+  c.qp.Solve(c.H_rho, c.g_rho, c.lb, c.ub);
+  c.planned = c.base;
+  c.planned.noalias() +=
+      c.position_gamma * c.qp.solution().cwiseMax(c.lb).cwiseMin(c.ub);
+}
+
+void PlatoonMPC::Project() {
+  size_t cars = cars_.size();
+  for (size_t k = 0; k + 1 < N_; k++) {
+    // With w_i = z_i + i minGap the gaps are w_0 >= w_1 >= ..., so the
+    // nearest positions are the nonincreasing regression of the w: each
+    // block of cars that would break the order moves to its mean.
+    block_sum_.clear();
+    block_size_.clear();
+    for (size_t i = 0; i < cars; i++) {
+      double sum = positions_(k, i) + i * minGap;
+      size_t size = 1;
+      while (!block_sum_.empty() &&
+             block_sum_.back() * size < sum * block_size_.back()) {
+        sum += block_sum_.back();
+        size += block_size_.back();
+        block_sum_.pop_back();
+        block_size_.pop_back();
+      }
+      block_sum_.push_back(sum);
+      block_size_.push_back(size);
+    }
+    size_t i = 0;
+    for (size_t b = 0; b < block_sum_.size(); b++) {
+      double mean = block_sum_[b] / block_size_[b];
+      for (size_t j = 0; j < block_size_[b]; j++, i++) {
+        consensus_(k, i) = mean - i * minGap;
+      }
+    }
+  }
+}
+
+void PlatoonMPC::Solve(const PlatoonCar* cars, Input* inputs) {
+  size_t V = cars_.size();
+  pool_->Run(0, V, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      Prepare(cars_[i], cars[i]);
+    }
+  });
+
+  for (size_t i = 0; i < V; i++) {
+    positions_.col(i) = cars_[i].base + cars_[i].dual;
+  }
+  Project();
+  lastConverged = false;
+  lastIterations = 0;
+  while (lastIterations < maxIterations && !lastConverged) {
+    pool_->Run(0, V, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        Step(cars_[i], consensus_.col(i));
+      }
+    });
+    for (size_t i = 0; i < V; i++) {
+      positions_.col(i) = cars_[i].planned + cars_[i].dual;
+    }
+    previous_ = consensus_;
+    Project();
+    double disagreement = 0;
+    for (size_t i = 0; i < V; i++) {
+      Car& c = cars_[i];
+      c.dual += c.planned - consensus_.col(i);
+      disagreement = std::max(
+          disagreement,
+          (c.planned - consensus_.col(i)).lpNorm<Eigen::Infinity>());
+    }
+    // How far the consensus moved, ADMM's dual residual over rho.
+    double moved = (consensus_ - previous_).lpNorm<Eigen::Infinity>();
+    lastIterations++;
+    lastConverged = disagreement <= tolerance && moved <= tolerance;
+  }
+
+  // Each car keeps its plan for the next frame, and its multipliers unless
+  // they went on growing with gaps that could not be kept.
+  lastGapViolation = 0;
+  for (size_t i = 0; i < V; i++) {
+    Car& c = cars_[i];
+    if (!lastConverged) {
+      c.dual.setZero();
+    }
+    Eigen::VectorXd du = c.qp.solution().cwiseMax(c.lb).cwiseMin(c.ub);
+    Eigen::Map<Eigen::VectorXd>(c.ubar.data(), n_u_) += du;
+    inputs[i] = c.ubar.col(0);
+    if (i > 0) {
+      double gap = (cars_[i - 1].planned - c.planned).minCoeff();
+      lastGapViolation = std::max(lastGapViolation, minGap - gap);
+    }
+  }
+}
+
+void PlatoonMPC::Predicted(size_t i, std::vector<double>& mpc_x_vals,
+                           std::vector<double>& mpc_y_vals) const {
+  const Car& c = cars_[i];
+  State s = c.xbar.col(0);
+  for (size_t k = 0; k + 1 < N_; k++) {
+    s = BicycleStep(s, Input(c.ubar.col(k)), c.coeffs, dt_, Lf_);
+    mpc_x_vals.push_back(s[0]);
+    mpc_y_vals.push_back(s[1]);
+  }
+}
@@ -0,0 +1,125 @@
+#ifndef PLATOON_MPC_H
+#define PLATOON_MPC_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+#include "DenseQP.h"
+#include "StagePool.h"
+
+// One car of a platoon, as its own MPC sees it: its state and path in its
+// own frame, as MPC::Solve takes them, with the frame's x axis along the
+// road, where it is along the road, in meters of arc length, as a
+// TrackLocalizer places it, and its reference speed; the leader's sets the
+// pace of the cars behind it.
+struct PlatoonCar {
+  State state;
+  Cubic coeffs;
+  double s;
+  double refV;
+};
+
+// Distributed MPC of a platoon: each car follows its own path as an LTV-MPC
+// does, while keeping at least minGap meters of road behind the car ahead
+// of it at every stage of the horizon. Only over the horizon, so it has to
+// be long enough for a car to brake for the one ahead of it.
+//
+// Each car's problem is the LTV-MPC of LTVMPC's CONDENSED formulation, as
+// a ScenarioMPC branch is. The cars are coupled only through their
+// predicted positions along the road, s plus the x of each stage, so the
+// problem splits by consensus ADMM: every iteration each car solves its
+// own box QP with a proximal term pulling its positions towards the
+// consensus, all of them in parallel on a StagePool, and the consensus
+// becomes the nearest positions that keep the gaps, a projection that is
+// one pass of pool-adjacent-violators over the cars at each stage. A car
+// hands on no more than its N - 1 positions an iteration, and an
+// iteration costs one QP a car and O(cars) to agree, so more cars take
+// more cores rather than more time.
+class PlatoonMPC {
+ public:
+  PlatoonMPC(size_t N, double dt, double Lf, const KinematicWeights& weights,
+             size_t cars, size_t threads);
+
+  // Meters of road each car keeps behind the one ahead of it.
+  double minGap;
+  // Consensus iterations per frame at most, the penalty on positions off
+  // the consensus, and the disagreement, in meters, to stop at.
+  int maxIterations;
+  double rho;
+  double tolerance;
+
+  size_t size() const { return cars_.size(); }
+
+  // The first actuations {delta, a} of each car, from cars[0], the leader,
+  // back, into inputs[i].
+  void Solve(const PlatoonCar* cars, Input* inputs);
+
+  // Appends car i's predicted trajectory in its frame, like MPC::Solve.
+  void Predicted(size_t i, std::vector<double>& mpc_x_vals,
+                 std::vector<double>& mpc_y_vals) const;
+
+  // Consensus iterations of the last Solve, whether the positions agreed to
+  // within tolerance, and how far, in meters, the cars' own plans came
+  // within minGap of the car ahead at worst.
+  int lastIterations;
+  bool lastConverged;
+  double lastGapViolation;
+
+ private:
+  struct Car {
+    Cubic coeffs;
+    // The last actuations, linearization trajectory and condensed QP.
+    Eigen::MatrixXd ubar;
+    Eigen::MatrixXd xbar;
+    Eigen::MatrixXd gamma;
+    Eigen::MatrixXd q_gamma;
+    Eigen::VectorXd residual;
+    Eigen::MatrixXd H;
+    Eigen::VectorXd g;
+    Eigen::MatrixXd H_rho;
+    Eigen::VectorXd g_rho;
+    Eigen::VectorXd lb;
+    Eigen::VectorXd ub;
+    Eigen::VectorXd zero;
+    // The rows of gamma that move its positions along the road, the
+    // positions at du = 0 and in its plan, and their scaled multipliers,
+    // kept from frame to frame a stage on like the actuations.
+    Eigen::MatrixXd position_gamma;
+    Eigen::VectorXd base;
+    Eigen::VectorXd planned;
+    Eigen::VectorXd dual;
+    DenseQP qp;
+  };
+
+  // Linearize and condense car c about its shifted actuations.
+  void Prepare(Car& c, const PlatoonCar& car);
+  // Its QP with the consensus term towards z.
+  void Step(Car& c, const Eigen::VectorXd& z);
+  // The positions nearest those in `positions_` that keep the gaps, into
+  // consensus_.
+  void Project();
+
+  size_t N_;
+  double dt_;
+  double Lf_;
+  KinematicWeights w_;
+  size_t n_u_;
+  Eigen::MatrixXd R_;
+  Eigen::VectorXd state_weight_;
+  std::vector<Car, Eigen::aligned_allocator<Car> > cars_;
+  std::unique_ptr<StagePool> pool_;
+  // A column per car: the positions it put forward, plus its multipliers,
+  // and the consensus, now and an iteration before.
+  Eigen::MatrixXd positions_;
+  Eigen::MatrixXd consensus_;
+  Eigen::MatrixXd previous_;
+  // Pool-adjacent-violators' blocks: their sums and sizes.
+  std::vector<double> block_sum_;
+  std::vector<size_t> block_size_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* PLATOON_MPC_H */
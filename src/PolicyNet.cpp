@@ -0,0 +1,55 @@
+#include "PolicyNet.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace {
+
+// Read rows x cols numbers, row by row, into m.
+template <typename Matrix>
+bool ReadMatrix(std::istream& in, Matrix& m) {
+  for (Eigen::Index i = 0; i < m.rows(); i++) {
+    for (Eigen::Index j = 0; j < m.cols(); j++) {
+      if (!(in >> m(i, j))) {
+        return false;
+      }
+    }
+  }
+  return m.allFinite();
+}
+
+}  // namespace
+
+PolicyNet::PolicyNet() : loaded_(false) {}
+
+bool PolicyNet::Load(const std::string& path) {
+  std::ifstream in(path);
+  std::string magic;
+  int version = 0;
+  int features = 0;
+  int hidden = 0;
+  int outputs = 0;
+  loaded_ = false;
+  if (!(in >> magic >> version >> features >> hidden >> outputs) ||
+      magic != "mpc-policy" || version != 1 || features != FEATURES ||
+      hidden != HIDDEN || outputs != 2) {
+    return false;
+  }
+  loaded_ = ReadMatrix(in, mean_) && ReadMatrix(in, scale_) &&
+            (scale_.array() > 0).all() && ReadMatrix(in, w1_) &&
+            ReadMatrix(in, b1_) && ReadMatrix(in, w2_) &&
+            ReadMatrix(in, b2_) && ReadMatrix(in, w3_) && ReadMatrix(in, b3_);
+  return loaded_;
+}
+
+Input PolicyNet::Evaluate(const State& state, const Cubic& coeffs) const {
+  Features x;
+  x << state, coeffs;
+  x = (x - mean_).cwiseQuotient(scale_);
+  Hidden h1 = (w1_ * x + b1_).array().tanh().matrix();
+  Hidden h2 = (w2_ * h1 + b2_).array().tanh().matrix();
+  Input u = w3_ * h2 + b3_;
+  u[0] = std::max(-MAX_DELTA, std::min(MAX_DELTA, u[0]));
+  u[1] = std::max(-MAX_A, std::min(MAX_A, u[1]));
+  return u;
+}
@@ -0,0 +1,50 @@
+#ifndef POLICY_NET_H
+#define POLICY_NET_H
+
+#include <string>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+
+// A small multilayer perceptron trained to imitate MPC::Solve: the
+// compensated state and the path's cubic in, the first actuations out, in a
+// few microseconds and without allocating. The samples to train it on come
+// from bench/mpc_replay.cpp, as (state, coeffs, delta, a) rows.
+//
+// The features are normalized as (x - mean) / scale, go through two tanh
+// layers of HIDDEN units and a linear output layer, and the actuations are
+// clipped to the actuator limits.
+//
+// The weights file is text: the line "mpc-policy 1 10 32 2", then the 10
+// means, the 10 scales, and each layer's weights row by row followed by its
+// biases, all whitespace separated.
+class PolicyNet {
+ public:
+  static const int FEATURES = 10;
+  static const int HIDDEN = 32;
+
+  PolicyNet();
+
+  bool Load(const std::string& path);
+  bool loaded() const { return loaded_; }
+
+  Input Evaluate(const State& state, const Cubic& coeffs) const;
+
+ private:
+  typedef Eigen::Matrix<double, FEATURES, 1> Features;
+  typedef Eigen::Matrix<double, HIDDEN, 1> Hidden;
+
+  bool loaded_;
+  Features mean_;
+  Features scale_;
+  Eigen::Matrix<double, HIDDEN, FEATURES> w1_;
+  Hidden b1_;
+  Eigen::Matrix<double, HIDDEN, HIDDEN> w2_;
+  Hidden b2_;
+  Eigen::Matrix<double, 2, HIDDEN> w3_;
+  Input b3_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* POLICY_NET_H */
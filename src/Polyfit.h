@@ -0,0 +1,58 @@
+#ifndef POLYFIT_H
+#define POLYFIT_H
+
+#include <algorithm>
+#include <cassert>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// Least-squares polynomial fits, coefficients in increasing order.
+
+// Any number of points and any order, through a Householder QR of the
+// Vandermonde matrix.
+// Adapted from
+// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
+Eigen::VectorXd polyfit(const Eigen::VectorXd& xvals,
+                        const Eigen::VectorXd& yvals, int order);
+
+// Order known at compile time, and the point count too when x and y are
+// fixed size, as for the 6 waypoints of a frame: then the Vandermonde matrix
+// and the normal equations are fixed-size and nothing is allocated. The
+// abscissae are scaled to [-1, 1] first, which keeps the normal equations
+// well enough conditioned for a cubic to be solved by LDLT, in single
+// precision too: the fit is in the scalar of x and y.
+template <int Order, class DerivedX, class DerivedY>
+Eigen::Matrix<typename DerivedX::Scalar, Order + 1, 1> polyfit(
+    const Eigen::MatrixBase<DerivedX>& xvals,
+    const Eigen::MatrixBase<DerivedY>& yvals) {
+  typedef typename DerivedX::Scalar Scalar;
+  typedef Eigen::Matrix<Scalar, DerivedX::SizeAtCompileTime, Order + 1>
+      Vandermonde;
+  assert(xvals.size() == yvals.size());
+  assert(xvals.size() > Order);
+  Scalar scale = xvals.cwiseAbs().maxCoeff();
+  if (scale == 0) {
+    scale = 1;
+  }
+
+  Vandermonde A(xvals.size(), Order + 1);
+  A.col(0).setOnes();
+  for (int i = 0; i < Order; i++) {
+    A.col(i + 1) = A.col(i).cwiseProduct(xvals) / scale;
+  }
+  Eigen::Matrix<Scalar, Order + 1, Order + 1> AtA;
+  AtA.noalias() = A.transpose() * A;
+  Eigen::Matrix<Scalar, Order + 1, 1> Aty;
+  Aty.noalias() = A.transpose() * yvals;
+  Eigen::Matrix<Scalar, Order + 1, 1> result = AtA.ldlt().solve(Aty);
+
+  // Back from the scaled abscissae.
+  Scalar power = 1;
+  for (int i = 0; i <= Order; i++) {
+    result[i] /= power;
+    power *= scale;
+  }
+  return result;
+}
+
+#endif /* POLYFIT_H */
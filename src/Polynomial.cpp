@@ -0,0 +1,7 @@
+#include "Polynomial.h"
+#include "SimdKernels.h"
+
+void polyeval(const Eigen::Ref<const Eigen::VectorXd>& coeffs, const double* x,
+              double* y, size_t n) {
+  Kernels().polyeval(coeffs.data(), coeffs.size(), x, y, n);
+}
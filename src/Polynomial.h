@@ -0,0 +1,43 @@
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+
+// Polynomials c[0] + c[1] x + c[2] x^2 + ..., evaluated in Horner form.
+
+// The `Derivative`th derivative of a polynomial of degree `Degree` at x. `c`
+// only needs operator[], and T can be a CppAD type, so the tapes and the
+// analytic models share the one definition of the path.
+template <int Degree, int Derivative = 0, class Coeffs, class T>
+T PolyEval(const Coeffs& c, const T& x) {
+  // c[i] x^i contributes i! / (i - Derivative)! c[i] x^(i - Derivative).
+  T result = T(0);
+  for (int i = Degree; i >= Derivative; i--) {
+    double factor = 1;
+    for (int k = 0; k < Derivative; k++) {
+      factor *= i - k;
+    }
+    result = result * x + c[i] * factor;
+  }
+  return result;
+}
+
+// A polynomial of any degree at x. The coefficients can be any contiguous
+// vector, fixed-size ones included, without a copy.
+inline double polyeval(const Eigen::Ref<const Eigen::VectorXd>& coeffs,
+                       double x) {
+  double result = 0;
+  for (Eigen::Index i = coeffs.size() - 1; i >= 0; i--) {
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+// At each of x[0, n) into y[0, n), a coefficient at a time over all the
+// points, so that Eigen runs the Horner steps in SIMD packets of the widest
+// instruction set the CPU has, see SimdKernels.h.
+void polyeval(const Eigen::Ref<const Eigen::VectorXd>& coeffs, const double* x,
+              double* y, size_t n);
+
+#endif /* POLYNOMIAL_H */
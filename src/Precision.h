@@ -0,0 +1,34 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <limits>
+
+// The scalar the controller core's LTV path computes in: double, or float
+// with MPC_SINGLE_PRECISION for targets whose double arithmetic is slow.
+// The model, the fixed-size fit, the dense QPs, Riccati and LTVMPC are
+// templates on it; see BicycleModel.h and LTV.h.
+#ifdef MPC_SINGLE_PRECISION
+typedef float CoreScalar;
+#else
+typedef double CoreScalar;
+#endif
+
+// A factorization in Scalar solves to about the condition number of the
+// matrix times Scalar's epsilon, relative. The ratio of its largest to its
+// smallest pivot is a cheap stand-in for that condition number; beyond this
+// error the QPs refine their solves with residuals in double. That
+// only gains anything over a factorization in a narrower scalar, so double
+// never refines.
+static const double REFINEMENT_THRESHOLD = 1e-6;
+// Refinement steps per solve; each gains about what the factorization
+// alone gets right.
+static const int REFINEMENT_STEPS = 2;
+
+template <class Scalar>
+inline bool NeedsRefinement(double pivot_ratio) {
+  return sizeof(Scalar) < sizeof(double) &&
+         pivot_ratio * std::numeric_limits<Scalar>::epsilon() >
+             REFINEMENT_THRESHOLD;
+}
+
+#endif /* PRECISION_H */
@@ -0,0 +1,216 @@
+#include "ProblemIR.h"
+#include <cmath>
+#include "Eigen-3.3/unsupported/Eigen/AutoDiff"
+#include "GeneratedStages.h"
+#include "MpcConfig.h"
+#include "ProblemPolicies.h"
+
+typedef ProblemIR::StageJacobian StageJacobian;
+
+// The kinematic bicycle on forward Euler, StageStep's EULER by hand.
+class BicycleDynamics : public ProblemIR::Dynamics {
+ public:
+  BicycleDynamics(double Lf, double dt) : Lf_(Lf), dt_(dt) {}
+
+  void Step(const double* c, const double* w, double* next) const {
+    State s = State::Map(w);
+    Input u = Input::Map(w + 6);
+    Cubic coeffs = Cubic::Map(c);
+    State::Map(next) = BicycleStep(s, u, coeffs, dt_, Lf_);
+  }
+
+  void Linearize(const double* c, const double* w, double* next,
+                 StageJacobian& J) const {
+    State s = State::Map(w);
+    Input u = Input::Map(w + 6);
+    Cubic coeffs = Cubic::Map(c);
+    StateJacobian A;
+    InputJacobian B;
+    BicycleLinearize(s, u, coeffs, dt_, Lf_, A, B);
+    J << A, B;
+    State::Map(next) = BicycleStep(s, u, coeffs, dt_, Lf_);
+  }
+
+ private:
+  double Lf_;
+  double dt_;
+};
+
+// Any Model of ProblemPolicies.h, its Jacobian from one pass of StageStep
+// on AutoDiffScalar, as AutoDiffNLP's.
+template <class Model>
+class PolicyDynamics : public ProblemIR::Dynamics {
+ public:
+  typedef Eigen::AutoDiffScalar<ProblemIR::StageVector> Active;
+
+  PolicyDynamics(const Model& model, size_t slopes, double dt)
+      : model_(model), slopes_(slopes), dt_(dt) {}
+
+  void Step(const double* c, const double* w, double* next) const {
+    StageStep(model_, slopes_, dt_, c, w, next);
+  }
+
+  void Linearize(const double* c, const double* w, double* next,
+                 StageJacobian& J) const {
+    const int n = ProblemIR::STAGE_VARS;
+    Active a[n];
+    for (int i = 0; i < n; i++) {
+      a[i] = Active(w[i], n, i);
+    }
+    Active end[ProblemIR::STATES];
+    StageStep(model_, slopes_, dt_, c, a, end);
+    for (int i = 0; i < ProblemIR::STATES; i++) {
+      next[i] = end[i].value();
+      J.row(i) = end[i].derivatives().transpose();
+    }
+  }
+
+ private:
+  Model model_;
+  size_t slopes_;
+  double dt_;
+};
+
+// The straight-line stage of tools/derivative_codegen.
+class GeneratedDynamics : public ProblemIR::Dynamics {
+ public:
+  explicit GeneratedDynamics(const GeneratedStage* stage) : stage_(stage) {}
+
+  void Step(const double* c, const double* w, double* next) const {
+    stage_->step(c, w, next);
+  }
+
+  void Linearize(const double* c, const double* w, double* next,
+                 StageJacobian& J) const {
+    typedef Eigen::Matrix<double, ProblemIR::STATES, ProblemIR::STAGE_VARS,
+                          Eigen::RowMajor>
+        RowMajor;
+    RowMajor values;
+    stage_->step(c, w, next);
+    stage_->jacobian(c, w, values.data());
+    J = values;
+  }
+
+ private:
+  const GeneratedStage* stage_;
+};
+
+// The residuals of Cost, whose terms are affine, as matrices: the offset
+// at w = 0 and a column for each variable.
+template <class Cost>
+static void CostMatrices(const Cost& cost, ProblemIR::ResidualJacobian& J,
+                         ProblemIR::Residuals& offset,
+                         ProblemIR::RateJacobian& rate) {
+  static_assert(Cost::STATE_TERMS + Cost::INPUT_TERMS ==
+                        size_t(ProblemIR::STAGE_TERMS) &&
+                    Cost::RATE_TERMS == size_t(ProblemIR::RATE_TERMS),
+                "the IR has TrackingCost's terms");
+  auto stage = [&cost](const ProblemIR::StageVector& w,
+                       ProblemIR::Residuals& r) {
+    cost.StateResiduals(w[4], w[5], w[3], r.data());
+    cost.InputResiduals(w[6], w[7], r.data() + Cost::STATE_TERMS);
+  };
+  stage(ProblemIR::StageVector::Zero(), offset);
+  for (int i = 0; i < ProblemIR::STAGE_VARS; i++) {
+    ProblemIR::Residuals r;
+    stage(ProblemIR::StageVector::Unit(i), r);
+    J.col(i) = r - offset;
+  }
+  for (int i = 0; i < 2 * ProblemIR::INPUTS; i++) {
+    Eigen::Vector4d q = Eigen::Vector4d::Unit(i);
+    cost.RateResiduals(q[2] - q[0], q[3] - q[1], rate.col(i).data());
+  }
+}
+
+ProblemIR::ProblemIR(const MpcConfig& config, double dt) : dt(dt) {
+  const GeneratedStage* generated =
+      config.generatedStages ? FindGeneratedStage(config, dt) : NULL;
+  size_t slopes = config.integrator == MpcConfig::EULER      ? 1
+                  : config.integrator == MpcConfig::MIDPOINT ? 2
+                                                             : 4;
+  if (generated != NULL) {
+    dynamics_.reset(new GeneratedDynamics(generated));
+  } else if (config.model == MpcConfig::DYNAMIC) {
+    dynamics_.reset(new PolicyDynamics<DynamicModel>(
+        DynamicModel(config.Lf, config.tires), slopes, dt));
+  } else if (slopes == 1) {
+    dynamics_.reset(new BicycleDynamics(config.Lf, dt));
+  } else {
+    dynamics_.reset(new PolicyDynamics<KinematicModel>(
+        KinematicModel(config.Lf), slopes, dt));
+  }
+  CostMatrices(TrackingCost(config.weights, config.refV), residualJacobian,
+               residualOffset, rateJacobian);
+
+  lower.setConstant(-1.0e19);
+  upper.setConstant(1.0e19);
+  lower.tail<INPUTS>() << -MAX_DELTA, -MAX_A;
+  upper.tail<INPUTS>() << MAX_DELTA, MAX_A;
+  Probe();
+}
+
+void ProblemIR::Probe() {
+  // Two points with every state, actuation and coefficient apart, none of
+  // them where a term of the model happens to vanish.
+  const double c[2][4] = {{0.3, -0.2, 0.05, -0.004},
+                          {-0.7, 0.1, -0.03, 0.002}};
+  const double w[2][STAGE_VARS] = {
+      {1.3, -0.4, 0.2, 12.5, 0.6, -0.1, 0.15, 0.4},
+      {-2.1, 0.9, -0.35, 31.0, -1.2, 0.25, -0.3, -0.7}};
+  StageJacobian J[2];
+  double next[STATES];
+  for (int p = 0; p < 2; p++) {
+    Linearize(c[p], w[p], next, J[p]);
+  }
+  linear = true;
+  constantJacobian.setZero();
+  for (int i = 0; i < STATES; i++) {
+    for (int j = 0; j < STAGE_VARS; j++) {
+      if (J[0](i, j) == 0 && J[1](i, j) == 0) {
+        structure[i][j] = ZERO;
+      } else if (J[0](i, j) == J[1](i, j)) {
+        structure[i][j] = CONSTANT;
+        constantJacobian(i, j) = J[0](i, j);
+      } else {
+        structure[i][j] = VARYING;
+        linear = false;
+      }
+    }
+  }
+}
+
+bool ProblemIR::Tracking(KinematicWeights& weights, double& ref_v) const {
+  // Each of TrackingCost's residuals scales one variable: cte, epsi, v,
+  // delta and a, the speed's off ref_v.
+  static const int column[STAGE_TERMS] = {4, 5, 3, 6, 7};
+  for (int i = 0; i < STAGE_TERMS; i++) {
+    for (int j = 0; j < STAGE_VARS; j++) {
+      if (j != column[i] && residualJacobian(i, j) != 0) {
+        return false;
+      }
+    }
+    if (i != 2 && residualOffset[i] != 0) {
+      return false;
+    }
+  }
+  for (int i = 0; i < RATE_TERMS; i++) {
+    for (int j = 0; j < 2 * INPUTS; j++) {
+      double expected = j == i ? -rateJacobian(i, i + INPUTS)
+                        : j == i + INPUTS ? rateJacobian(i, j)
+                                          : 0;
+      if (rateJacobian(i, j) != expected) {
+        return false;
+      }
+    }
+  }
+  const ResidualJacobian& J = residualJacobian;
+  weights.cte = J(0, 4) * J(0, 4);
+  weights.epsi = J(1, 5) * J(1, 5);
+  weights.v = J(2, 3) * J(2, 3);
+  weights.delta = J(3, 6) * J(3, 6);
+  weights.a = J(4, 7) * J(4, 7);
+  weights.delta_diff = rateJacobian(0, 2) * rateJacobian(0, 2);
+  weights.a_diff = rateJacobian(1, 3) * rateJacobian(1, 3);
+  ref_v = J(2, 3) != 0 ? -residualOffset[2] / J(2, 3) : 0;
+  return true;
+}
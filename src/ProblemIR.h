@@ -0,0 +1,107 @@
+#ifndef PROBLEM_IR_H
+#define PROBLEM_IR_H
+
+#include <cstddef>
+#include <memory>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+
+struct MpcConfig;
+
+// The optimal-control problem of the controller as the backends share it,
+// stage by stage, built once from the Model and Cost policies of
+// ProblemPolicies.h that MpcConfig chooses. A backend that takes its problem
+// from here rather than writing FG_eval's again solves every model and
+// integrator the policies have.
+//
+// Stage t has the variables w = [x, y, psi, v, cte, epsi, delta, a], its
+// state and the actuations held until stage t + 1, whose state is Step of
+// them on the path's cubic c. The cost sums the squares of residuals: of
+// each stage's state and actuations, affine in w, and of the change of the
+// actuations from one stage to the next, linear in it; being constant,
+// their Jacobians are kept here as matrices. The actuations are bounded by
+// MAX_DELTA and MAX_A, and the states are free.
+//
+// Which entries of the dynamics' Jacobian are zero, constant or vary with
+// the point is found by probing two points far apart, as AutoDiffNLP's
+// patterns are, so that a backend can size its sparsity patterns once and
+// keep the constant entries out of its work per frame.
+//
+// The dynamics are the kinematic bicycle's hand-written BicycleStep and
+// BicycleLinearize on EULER, the stage generated at build time where
+// MpcConfig::generatedStages finds one, and else StageStep differentiated
+// by AutoDiffScalar. EXACT is taken as RK4, as it is for DYNAMIC in the
+// tape: the conditional of ExactStep has no AutoDiffScalar form.
+class ProblemIR {
+ public:
+  static const int STATES = 6;
+  static const int INPUTS = 2;
+  static const int STAGE_VARS = STATES + INPUTS;
+  // The state's residuals and the actuations', and those of their change.
+  static const int STAGE_TERMS = 5;
+  static const int RATE_TERMS = 2;
+
+  typedef Eigen::Matrix<double, STAGE_VARS, 1> StageVector;
+  typedef Eigen::Matrix<double, STATES, STAGE_VARS> StageJacobian;
+  typedef Eigen::Matrix<double, STAGE_TERMS, STAGE_VARS> ResidualJacobian;
+  typedef Eigen::Matrix<double, STAGE_TERMS, 1> Residuals;
+  typedef Eigen::Matrix<double, RATE_TERMS, 2 * INPUTS> RateJacobian;
+
+  // How an entry of a derivative depends on the point it is taken at.
+  enum Dependence { ZERO, CONSTANT, VARYING };
+
+  // A stage's dynamics, on the path's cubic c of 4 coefficients.
+  class Dynamics {
+   public:
+    virtual ~Dynamics() {}
+    virtual void Step(const double* c, const double* w,
+                      double* next) const = 0;
+    // The next state and its Jacobian by w.
+    virtual void Linearize(const double* c, const double* w, double* next,
+                           StageJacobian& J) const = 0;
+  };
+
+  // config's problem over stages of dt.
+  ProblemIR(const MpcConfig& config, double dt);
+
+  double dt;
+
+  void Step(const double* c, const double* w, double* next) const {
+    dynamics_->Step(c, w, next);
+  }
+  void Linearize(const double* c, const double* w, double* next,
+                 StageJacobian& J) const {
+    dynamics_->Linearize(c, w, next, J);
+  }
+
+  // Each entry of the dynamics' Jacobian, and the values of the CONSTANT
+  // ones, 0 elsewhere. Linear dynamics have no VARYING entry.
+  Dependence structure[STATES][STAGE_VARS];
+  StageJacobian constantJacobian;
+  bool linear;
+
+  // A stage's residuals, residualJacobian w + residualOffset; the last
+  // stage's are its state's, the first 3. And those of the change, by
+  // [delta, a] of stage t - 1 and of stage t.
+  ResidualJacobian residualJacobian;
+  Residuals residualOffset;
+  RateJacobian rateJacobian;
+
+  // The bounds of a stage's variables, +-1.0e19 for none as in Ipopt.
+  StageVector lower;
+  StageVector upper;
+
+  // The cost as TrackingCost's weights and reference speed, for the
+  // backends written against its terms; false if it has others.
+  bool Tracking(KinematicWeights& weights, double& ref_v) const;
+
+ private:
+  void Probe();
+
+  std::unique_ptr<Dynamics> dynamics_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* PROBLEM_IR_H */
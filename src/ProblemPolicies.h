@@ -0,0 +1,257 @@
+#ifndef PROBLEM_POLICIES_H
+#define PROBLEM_POLICIES_H
+
+#include <cmath>
+#include <cstddef>
+#include <cppad/cppad.hpp>
+#include "BicycleModel.h"
+#include "Polynomial.h"
+
+// The policies the taped problem is built from, see FG_eval in MPC.cpp: a
+// Model of the car's motion and a Cost of its tracking. Both are templates
+// over the scalar type, run on AD<double> while a tape is recorded and on
+// double anywhere else. FG_eval is specialized for each pair, and each pair
+// records a tape of its own, so the choice costs neither a virtual call nor
+// a branch in the operations that are evaluated every iteration.
+//
+// A Model moves the tracking state z = [x, y, psi, v, cte, epsi], STATES
+// long, under the inputs u = [delta, a], INPUTS long. Rates gives dz/dt with
+// u held, with cte and epsi changing against the path's tangent at the
+// start of the step. ExactStep gives the state dt later in closed form, or
+// returns false for a model without one.
+//
+// A Cost gives the residuals whose squares it sums: STATE_TERMS of each
+// stage's state, INPUT_TERMS of its inputs and RATE_TERMS of the change
+// from one stage's inputs to the next. Its weights may be of another type
+// than the residuals too: AD<double> on a tape that takes them as dynamic
+// parameters, PARAMETERS of them as Parameters() writes them, so that a
+// tuning changes the parameters rather than the operation sequence.
+
+// The kinematic bicycle, turning by its geometry alone, with Lf from the
+// front axle to the center of gravity.
+struct KinematicModel {
+  static const size_t STATES = 6;
+  static const size_t INPUTS = 2;
+
+  explicit KinematicModel(double Lf) : Lf(Lf) {}
+  double Lf;
+
+  template <class Scalar>
+  void Rates(const Scalar* z, const Scalar* u, Scalar* dz) const {
+    using std::cos;
+    using std::sin;
+    dz[0] = z[3] * cos(z[2]);
+    dz[1] = z[3] * sin(z[2]);
+    dz[2] = z[3] * u[0] / Lf;
+    dz[3] = u[1];
+    dz[4] = z[3] * sin(z[5]);
+    dz[5] = z[3] * u[0] / Lf;
+  }
+
+  // The heading changes with the distance s covered, psi = psi0 + s delta /
+  // Lf, whatever the speed profile, and over S = v0 dt + a dt^2 / 2 the
+  // position moves by S along the chord, at psi0 + h for h = S delta /
+  // (2 Lf), scaled by sin(h) / h. cte here is only its change.
+  template <class Scalar>
+  bool ExactStep(const Scalar* z, const Scalar* u, double dt,
+                 Scalar* end) const {
+    using std::cos;
+    using std::sin;
+    Scalar S = z[3] * dt + u[1] * (dt * dt / 2);
+    Scalar h = S * u[0] / (2 * Lf);
+    // Both sides of the condition are evaluated: keep sin(h) / h away from
+    // 0 / 0 when the series is taken.
+    const Scalar small = 1e-4;
+    Scalar safe = CppAD::CondExpLt(h * h, small * small, small, h);
+    Scalar sinc = CppAD::CondExpLt(h * h, small * small,
+                                   Scalar(1) - h * h / 6, sin(safe) / safe);
+    Scalar chord = S * sinc;
+    end[0] = z[0] + chord * cos(z[2] + h);
+    end[1] = z[1] + chord * sin(z[2] + h);
+    end[2] = z[2] + 2 * h;
+    end[3] = z[3] + u[1] * dt;
+    end[4] = chord * sin(z[5] + h);
+    end[5] = z[5] + 2 * h;
+    return true;
+  }
+};
+
+// The car turned by its tire forces: the linear bicycle in steady-state
+// cornering, whose lateral forces give the yaw rate
+// r = v delta / (Lf + K v^2), with the understeer gradient
+// K = m (lr / Cf - lf / Cr) / Lf, and move it at the body slip angle
+// beta = delta (lr - m lf v^2 / (Cr Lf)) / (Lf + K v^2) off its heading.
+// Lf stands for the wheelbase, as in the kinematic model, which this
+// becomes at low speed but for the slip; lf = Lf - lr. An oversteering car,
+// K < 0, is unstable from sqrt(-Lf / K) on.
+//
+// The transients of the lateral velocity and yaw rate, which the full
+// dynamic bicycle carries as states, are left out so that the state stays
+// the one the rest of the controller shares.
+struct DynamicModel {
+  static const size_t STATES = 6;
+  static const size_t INPUTS = 2;
+
+  DynamicModel(double Lf, const Tires& tires)
+      : L(Lf), lr(tires.lr),
+        K(tires.mass * (tires.lr / tires.frontStiffness -
+                        (Lf - tires.lr) / tires.rearStiffness) /
+          Lf),
+        slip(tires.mass * (Lf - tires.lr) / (tires.rearStiffness * Lf)) {}
+  double L;
+  double lr;
+  double K;
+  // m lf / (Cr L), the slip's loss per v^2.
+  double slip;
+
+  template <class Scalar>
+  void Rates(const Scalar* z, const Scalar* u, Scalar* dz) const {
+    using std::cos;
+    using std::sin;
+    Scalar v2 = z[3] * z[3];
+    Scalar turn = u[0] / (L + K * v2);
+    Scalar beta = turn * (lr - slip * v2);
+    dz[0] = z[3] * cos(z[2] + beta);
+    dz[1] = z[3] * sin(z[2] + beta);
+    dz[2] = z[3] * turn;
+    dz[3] = u[1];
+    dz[4] = z[3] * sin(z[5] + beta);
+    dz[5] = z[3] * turn;
+  }
+
+  template <class Scalar>
+  bool ExactStep(const Scalar*, const Scalar*, double, Scalar*) const {
+    return false;
+  }
+};
+
+// A stage of the full formulation: the next state from the stage's
+// variables w = [x, y, psi, v, cte, epsi, delta, a] on the path of the
+// cubic c, by a Runge-Kutta rule of 1, 2 or 4 `slopes`, forward Euler, the
+// midpoint rule or RK4. As in FG_eval, cte and epsi start over from the
+// path at x, and only their change over the step is integrated. The
+// coefficients may be of another type than the variables, constants while
+// those are differentiated.
+template <class Model, class Coeff, class Scalar>
+void StageStep(const Model& model, size_t slopes, double dt, const Coeff* c,
+               const Scalar* w, Scalar* next) {
+  using std::atan2;
+  const size_t S = Model::STATES;
+  Scalar z[S];
+  for (size_t i = 0; i < S; i++) {
+    z[i] = w[i];
+  }
+  z[4] = Scalar(0.);
+  const Scalar* u = w + S;
+
+  // Where each slope is taken, as a fraction of dt from the start, and the
+  // weights of the slopes.
+  static const double euler_at[1] = {0};
+  static const double euler_weight[1] = {1};
+  static const double midpoint_at[2] = {0, 0.5};
+  static const double midpoint_weight[2] = {0, 1};
+  static const double rk4_at[4] = {0, 0.5, 0.5, 1};
+  static const double rk4_weight[4] = {1. / 6, 1. / 3, 1. / 3, 1. / 6};
+  const double* at =
+      slopes == 1 ? euler_at : slopes == 2 ? midpoint_at : rk4_at;
+  const double* weight = slopes == 1   ? euler_weight
+                         : slopes == 2 ? midpoint_weight
+                                       : rk4_weight;
+  Scalar end[S];
+  Scalar k[S];
+  Scalar zk[S];
+  for (size_t i = 0; i < S; i++) {
+    end[i] = z[i];
+  }
+  for (size_t j = 0; j < slopes; j++) {
+    for (size_t i = 0; i < S; i++) {
+      if (j == 0) {
+        zk[i] = z[i];
+      } else {
+        zk[i] = z[i] + at[j] * dt * k[i];
+      }
+    }
+    model.Rates(zk, u, k);
+    for (size_t i = 0; i < S; i++) {
+      if (weight[j] != 0) {
+        end[i] += weight[j] * dt * k[i];
+      }
+    }
+  }
+
+  Scalar f0 = PolyEval<3>(c, w[0]);
+  Scalar psides0 = atan2(PolyEval<3, 1>(c, w[0]), Scalar(1.));
+  for (size_t i = 0; i < 4; i++) {
+    next[i] = end[i];
+  }
+  next[4] = (f0 - w[1]) + end[4];
+  next[5] = (w[2] - psides0) + (end[5] - w[5]);
+}
+
+// The tracking cost the controller was developed with: the errors and the
+// speed's distance from ref_v, the inputs, and their changes, each weighted
+// by KinematicWeights.
+template <class Weight>
+struct BasicTrackingCost {
+  static const size_t STATE_TERMS = 3;
+  static const size_t INPUT_TERMS = 2;
+  static const size_t RATE_TERMS = 2;
+  static const size_t PARAMETERS = 8;
+
+  BasicTrackingCost(const KinematicWeights& w, double ref_v)
+      : ref_v(ref_v), cte(std::sqrt(w.cte)), epsi(std::sqrt(w.epsi)),
+        v(std::sqrt(w.v)), delta(std::sqrt(w.delta)), a(std::sqrt(w.a)),
+        delta_diff(std::sqrt(w.delta_diff)), a_diff(std::sqrt(w.a_diff)) {}
+  // The PARAMETERS at p.
+  explicit BasicTrackingCost(const Weight* p)
+      : ref_v(p[0]), cte(p[1]), epsi(p[2]), v(p[3]), delta(p[4]), a(p[5]),
+        delta_diff(p[6]), a_diff(p[7]) {}
+
+  // Write the PARAMETERS of w and ref_v to p.
+  static void Parameters(const KinematicWeights& w, double ref_v, double* p) {
+    BasicTrackingCost<double> cost(w, ref_v);
+    const double values[PARAMETERS] = {cost.ref_v, cost.cte,   cost.epsi,
+                                       cost.v,     cost.delta, cost.a,
+                                       cost.delta_diff, cost.a_diff};
+    for (size_t i = 0; i < PARAMETERS; i++) {
+      p[i] = values[i];
+    }
+  }
+
+  Weight ref_v;
+  // The square roots of the weights.
+  Weight cte;
+  Weight epsi;
+  Weight v;
+  Weight delta;
+  Weight a;
+  Weight delta_diff;
+  Weight a_diff;
+
+  template <class Scalar>
+  void StateResiduals(const Scalar& cte_t, const Scalar& epsi_t,
+                      const Scalar& v_t, Scalar* r) const {
+    r[0] = cte * cte_t;
+    r[1] = epsi * epsi_t;
+    // mainly penalize exeed speed limit
+    r[2] = v * (v_t - ref_v);
+  }
+
+  template <class Scalar>
+  void InputResiduals(const Scalar& delta_t, const Scalar& a_t,
+                      Scalar* r) const {
+    r[0] = delta * delta_t;
+    r[1] = a * a_t;
+  }
+
+  template <class Scalar>
+  void RateResiduals(const Scalar& delta_change, const Scalar& a_change,
+                     Scalar* r) const {
+    r[0] = delta_diff * delta_change;
+    r[1] = a_diff * a_change;
+  }
+};
+
+typedef BasicTrackingCost<double> TrackingCost;
+
+#endif /* PROBLEM_POLICIES_H */
@@ -0,0 +1,452 @@
+#include "Proxy.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "HttpClient.h"
+
+// Between the GETs of a checkpoint the node hasn't taken yet.
+static const std::chrono::milliseconds HANDOFF_POLL(5);
+
+// The value of `name` in the Prometheus text `metrics`, or 0.
+static double Metric(const std::string& metrics, const std::string& name) {
+  for (size_t line = 0; line < metrics.size();) {
+    if (metrics.compare(line, name.size(), name) == 0 &&
+        metrics[line + name.size()] == ' ') {
+      return strtod(metrics.c_str() + line + name.size() + 1, nullptr);
+    }
+    size_t end = metrics.find('\n', line);
+    line = end == std::string::npos ? metrics.size() : end + 1;
+  }
+  return 0;
+}
+
+Proxy::Proxy(uWS::Hub& hub, const Options& options)
+    : hub_(hub), options_(options), ring_(options.replicas), next_link_(0),
+      scraping_(false),
+      helpers_(1 + std::max<size_t>(options.handoffThreads, 1)),
+      next_helper_(0) {
+  std::random_device random;
+  char prefix[32];
+  snprintf(prefix, sizeof(prefix), "proxy-%08x%08x-", random(), random());
+  prefix_ = prefix;
+  uv_loop_t* loop = hub.getLoop();
+  uv_async_init(loop, &async_, [](uv_async_t* handle) {
+    static_cast<Proxy*>(handle->data)->Flush();
+  });
+  async_.data = this;
+  uv_unref(reinterpret_cast<uv_handle_t*>(&async_));
+  uv_timer_init(loop, &scrape_timer_);
+  scrape_timer_.data = this;
+  uint64_t interval = uint64_t(options.scrapeInterval * 1000 + 0.5);
+  uv_timer_start(&scrape_timer_,
+                 [](uv_timer_t* timer) {
+                   static_cast<Proxy*>(timer->data)->StartScrape();
+                 },
+                 interval, interval);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&scrape_timer_));
+  Serve();
+}
+
+bool Proxy::SetBackends(const std::vector<std::string>& backends) {
+  std::vector<Backend> parsed;
+  for (const std::string& name : backends) {
+    Backend node;
+    size_t colon = name.rfind(':');
+    in_addr address;
+    if (colon == std::string::npos) {
+      return false;
+    }
+    node.name = name;
+    node.host = name.substr(0, colon);
+    node.port = atoi(name.c_str() + colon + 1);
+    if (inet_pton(AF_INET, node.host.c_str(), &address) != 1 ||
+        node.port <= 0 || node.port > 65535) {
+      return false;
+    }
+    parsed.push_back(node);
+  }
+  std::vector<bool> members(backends_.size());
+  for (size_t i = 0; i < backends_.size(); i++) {
+    members[i] = Member(i);
+    backends_[i].listed = false;
+  }
+  bool added = false;
+  for (Backend& node : parsed) {
+    auto found = std::find_if(
+        backends_.begin(), backends_.end(),
+        [&node](const Backend& b) { return b.name == node.name; });
+    if (found != backends_.end()) {
+      found->listed = true;
+      continue;
+    }
+    // Up once it answers a scrape.
+    node.listed = true;
+    node.up = false;
+    node.connections = 0;
+    node.pending = 0;
+    node.sessions = 0;
+    backends_.push_back(node);
+    added = true;
+  }
+  if (added) {
+    std::vector<std::string> names;
+    for (const Backend& node : backends_) {
+      names.push_back(node.name);
+    }
+    ring_.Set(names);
+  }
+  Rebalance(members);
+  StartScrape();
+  return true;
+}
+
+bool Proxy::ReadBackends(const char* path,
+                         std::vector<std::string>& backends) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  backends.clear();
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin != std::string::npos) {
+      backends.push_back(
+          line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin));
+    }
+  }
+  return true;
+}
+
+void Proxy::Serve() {
+  hub_.onConnection([this](uWS::WebSocket<uWS::SERVER> ws,
+                           uWS::HttpRequest req) {
+    std::string url = req.getUrl().toString();
+    std::unique_ptr<Link> owned(new Link());
+    Link& link = *owned;
+    link.id = next_link_++;
+    link.client = ws;
+    link.key = QueryParameter(url, "handoff");
+    size_t query = url.find('?');
+    link.query = query == std::string::npos ? "" : url.substr(query + 1);
+    if (link.key.empty()) {
+      link.key = prefix_ + std::to_string(link.id);
+      link.query += (link.query.empty() ? "handoff=" : "&handoff=") + link.key;
+    }
+    link.backend = HashRing::NONE;
+    link.upstream = nullptr;
+    link.next = nullptr;
+    link.handingOver = false;
+    link.held = false;
+    links_[link.id] = std::move(owned);
+    ws.setUserData(&link);
+    Place(link);
+  });
+  hub_.onMessage([](uWS::WebSocket<uWS::SERVER> ws, char* data,
+                    size_t length, uWS::OpCode opCode) {
+    Link* link = static_cast<Link*>(ws.getUserData());
+    if (!link) {
+      return;
+    }
+    if (link->upstream) {
+      link->upstream->ws.send(data, length, opCode);
+    } else {
+      link->frame.assign(data, length);
+      link->opCode = opCode;
+      link->held = true;
+    }
+  });
+  hub_.onDisconnection([this](uWS::WebSocket<uWS::SERVER> ws, int code,
+                              char* message, size_t length) {
+    Link* link = static_cast<Link*>(ws.getUserData());
+    if (link) {
+      ws.setUserData(nullptr);
+      Close(*link);
+    }
+  });
+  hub_.onHttpRequest([](uWS::HttpResponse* res, uWS::HttpRequest req,
+                        char* data, size_t length, size_t remaining) {
+    res->end(nullptr, 0);
+  });
+
+  // The backends' side.
+  hub_.onConnection([](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    Upstream* upstream = static_cast<Upstream*>(ws.getUserData());
+    upstream->ws = ws;
+    upstream->open = true;
+    Link* link = upstream->link;
+    if (!link || link->next != upstream) {
+      ws.close();
+      return;
+    }
+    // The old node's session goes as the client would leave it.
+    if (link->upstream) {
+      link->upstream->link = nullptr;
+      link->upstream->ws.close();
+    }
+    link->upstream = upstream;
+    link->next = nullptr;
+    if (link->held) {
+      ws.send(link->frame.data(), link->frame.size(), link->opCode);
+      link->held = false;
+    }
+  });
+  hub_.onMessage([](uWS::WebSocket<uWS::CLIENT> ws, char* data,
+                    size_t length, uWS::OpCode opCode) {
+    Upstream* upstream = static_cast<Upstream*>(ws.getUserData());
+    Link* link = upstream->link;
+    if (link && link->upstream == upstream) {
+      link->client.send(data, length, opCode);
+    }
+  });
+  hub_.onDisconnection([this](uWS::WebSocket<uWS::CLIENT> ws, int code,
+                              char* message, size_t length) {
+    Upstream* upstream = static_cast<Upstream*>(ws.getUserData());
+    Link* link = upstream->link;
+    bool relayed = link && link->upstream == upstream;
+    Release(upstream);
+    // The node hung up on a session it still had: on to where the ring has
+    // it now, cold.
+    if (relayed) {
+      link->upstream = nullptr;
+      if (!link->next && !link->handingOver) {
+        Place(*link);
+      }
+    }
+  });
+  hub_.onError([this](void* user) {
+    Upstream* upstream = static_cast<Upstream*>(user);
+    Link* link = upstream->link;
+    bool next = link && link->next == upstream;
+    Release(upstream);
+    if (!next) {
+      return;
+    }
+    link->next = nullptr;
+    // Relayed to the old node still, the session stays there; with nowhere
+    // to relay to, the client is told by hanging up.
+    if (!link->upstream) {
+      link->client.close();
+      return;
+    }
+    backends_[link->backend].sessions--;
+    link->backend = link->upstream->backend;
+    backends_[link->backend].sessions++;
+    std::cerr << "Failed to move " << link->key << std::endl;
+  });
+}
+
+std::vector<double> Proxy::Loads() const {
+  std::vector<double> load(backends_.size(), INFINITY);
+  for (size_t i = 0; i < backends_.size(); i++) {
+    const Backend& node = backends_[i];
+    if (Member(i)) {
+      load[i] = std::max(node.connections, double(node.sessions)) +
+                node.pending;
+    }
+  }
+  return load;
+}
+
+bool Proxy::Member(size_t backend) const {
+  return backends_[backend].listed && backends_[backend].up;
+}
+
+void Proxy::Place(Link& link) {
+  size_t backend = ring_.Find(link.key, Loads(), options_.loadFactor);
+  if (backend == HashRing::NONE) {
+    std::cerr << "No backend up for " << link.key << std::endl;
+    link.client.close();
+    return;
+  }
+  Move(link, backend);
+}
+
+void Proxy::Move(Link& link, size_t backend) {
+  size_t from = link.backend;
+  if (from != HashRing::NONE) {
+    backends_[from].sessions--;
+  }
+  backends_[backend].sessions++;
+  link.backend = backend;
+  if (!link.upstream || !backends_[link.upstream->backend].up) {
+    Connect(link, backend);
+    return;
+  }
+  link.handingOver = true;
+  size_t helper = 1 + next_helper_++ % (helpers_.size() - 1);
+  uint64_t id = link.id;
+  std::string key = link.key;
+  Backend source = backends_[link.upstream->backend];
+  Backend target = backends_[backend];
+  helpers_.Submit(helper, [this, id, key, source, target, backend] {
+    Handoff(id, key, source, target, backend);
+  });
+}
+
+void Proxy::Connect(Link& link, size_t backend) {
+  std::unique_ptr<Upstream> upstream(new Upstream());
+  upstream->link = &link;
+  upstream->backend = backend;
+  upstream->open = false;
+  if (link.next) {
+    link.next->link = nullptr;
+  }
+  link.next = upstream.get();
+  Upstream* user = upstream.get();
+  upstreams_[user] = std::move(upstream);
+  hub_.connect("ws://" + backends_[backend].name + "/?" + link.query, user);
+}
+
+void Proxy::Rebalance(const std::vector<bool>& members) {
+  std::vector<bool> joined(backends_.size(), false);
+  bool changed = false;
+  for (size_t i = 0; i < backends_.size(); i++) {
+    bool was = i < members.size() && members[i];
+    joined[i] = Member(i) && !was;
+    changed = changed || Member(i) != was;
+  }
+  if (!changed) {
+    return;
+  }
+  size_t moved = 0;
+  for (auto& entry : links_) {
+    Link& link = *entry.second;
+    size_t from = link.backend;
+    if (link.next || link.handingOver || from == HashRing::NONE) {
+      continue;
+    }
+    // Where the ring would put it afresh; only the moves a join or a leave
+    // calls for are made, so that sessions don't follow the load about.
+    backends_[from].sessions--;
+    size_t to = ring_.Find(link.key, Loads(), options_.loadFactor);
+    backends_[from].sessions++;
+    if (to != HashRing::NONE && to != from && (!Member(from) || joined[to])) {
+      Move(link, to);
+      moved++;
+    }
+  }
+  if (moved > 0) {
+    std::cout << "Moving " << moved << " sessions" << std::endl;
+  }
+}
+
+void Proxy::Close(Link& link) {
+  for (Upstream* upstream : {link.upstream, link.next}) {
+    if (upstream) {
+      upstream->link = nullptr;
+      if (upstream->open) {
+        upstream->ws.close();
+      }
+    }
+  }
+  if (link.backend != HashRing::NONE) {
+    backends_[link.backend].sessions--;
+  }
+  links_.erase(link.id);
+}
+
+void Proxy::Release(Upstream* upstream) { upstreams_.erase(upstream); }
+
+void Proxy::StartScrape() {
+  if (scraping_) {
+    return;
+  }
+  scraping_ = true;
+  std::vector<Backend> nodes = backends_;
+  helpers_.Submit(0, [this, nodes] { Scrape(nodes); });
+}
+
+void Proxy::Scrape(std::vector<Backend> nodes) {
+  for (Backend& node : nodes) {
+    int status = 0;
+    std::string metrics;
+    node.up = node.listed &&
+              HttpRequest(node.host.c_str(), node.port, "GET", "/metrics",
+                          "", options_.timeout, status, metrics) &&
+              status == 200;
+    if (node.up) {
+      node.connections = Metric(metrics, "mpc_connections");
+      node.pending = Metric(metrics, "mpc_frames_pending");
+    }
+  }
+  Post([this, nodes] {
+    scraping_ = false;
+    std::vector<bool> members(backends_.size());
+    for (size_t i = 0; i < backends_.size(); i++) {
+      members[i] = Member(i);
+    }
+    // Nodes added since keep waiting for the next scrape.
+    for (size_t i = 0; i < nodes.size(); i++) {
+      Backend& node = backends_[i];
+      if (node.listed && node.up != nodes[i].up) {
+        std::cout << "Backend " << node.name
+                  << (nodes[i].up ? " is up" : " is down") << std::endl;
+      }
+      node.up = nodes[i].up;
+      node.connections = nodes[i].connections;
+      node.pending = nodes[i].pending;
+    }
+    Rebalance(members);
+  });
+}
+
+void Proxy::Handoff(uint64_t id, const std::string& key, const Backend& from,
+                    const Backend& to, size_t backend) {
+  std::string target = "/checkpoint?handoff=" + key;
+  typedef std::chrono::steady_clock Clock;
+  std::chrono::duration<double> limit(options_.handoffTimeout);
+  Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(limit);
+  // 202 until the session has taken it, a frame or so after the first.
+  int status = 0;
+  std::string checkpoint;
+  while (HttpRequest(from.host.c_str(), from.port, "GET", target, "",
+                     options_.timeout, status, checkpoint) &&
+         status == 202 && Clock::now() < deadline) {
+    std::this_thread::sleep_for(HANDOFF_POLL);
+  }
+  std::string answer;
+  int posted = 0;
+  if (!(status == 200 && !checkpoint.empty() &&
+        HttpRequest(to.host.c_str(), to.port, "POST", target, checkpoint,
+                    options_.timeout, posted, answer) &&
+        posted == 200)) {
+    std::cerr << "Failed to hand " << key << " over from " << from.name
+              << " to " << to.name << ", it goes on cold" << std::endl;
+  }
+  Post([this, id, backend] {
+    auto found = links_.find(id);
+    if (found != links_.end()) {
+      found->second->handingOver = false;
+      Connect(*found->second, backend);
+    }
+  });
+}
+
+void Proxy::Post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    posted_.push_back(std::move(task));
+  }
+  uv_async_send(&async_);
+}
+
+void Proxy::Flush() {
+  std::vector<std::function<void()> > tasks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks.swap(posted_);
+  }
+  for (std::function<void()>& task : tasks) {
+    task();
+  }
+}
@@ -0,0 +1,159 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <uWS/uWS.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "HashRing.h"
+#include "WorkerPool.h"
+
+// The server binary as a front proxy, for more vehicles than one node can
+// serve: it takes the simulators' websocket connections and relays each,
+// message for message, to a backend, a solver node serving the sessions.
+//
+// A connection's key is the ?handoff key it came with, or one the proxy
+// gives it, and its backend the node a HashRing finds for the key among
+// the nodes up, by their live load: the sessions a node reports in its
+// /metrics, or the proxy's on it if more, plus the frames waiting for its
+// workers. The proxy scrapes the nodes every scrapeInterval seconds, off
+// the loop; one that doesn't answer is down until it does again.
+//
+// When a node joins, by being added or by coming back up, the sessions the
+// ring now gives it move to it, and when one leaves, those it had move on:
+// the proxy hands each over as Handoffs describes, on the client's behalf,
+// and relays to the old node until the new one is connected. A node that
+// went down has no checkpoint to give, and its sessions go on cold.
+//
+// While a session has no backend connected, the newest of its frames is
+// kept for when it has, as the server only keeps the newest too. One event
+// loop; the scrapes and handoffs run on threads of their own.
+class Proxy {
+ public:
+  struct Options {
+    Options()
+        : scrapeInterval(1), timeout(0.5), handoffTimeout(1),
+          loadFactor(1.25), replicas(100), handoffThreads(8) {}
+    double scrapeInterval;
+    // Seconds a scrape or a handoff request may take, and a handoff's
+    // checkpoint all told.
+    double timeout;
+    double handoffTimeout;
+    // Most load a node takes, over the mean, see HashRing::Find.
+    double loadFactor;
+    size_t replicas;
+    // Handoffs at a time, each on a thread; a node leaving hands over all
+    // its sessions at once.
+    size_t handoffThreads;
+  };
+
+  // Takes over the hub's handlers.
+  Proxy(uWS::Hub& hub, const Options& options);
+  Proxy(const Proxy&) = delete;
+  Proxy& operator=(const Proxy&) = delete;
+
+  // Relay to `backends` from now on, each an IPv4 address and port as
+  // host:port; the nodes no longer among them leave. False, changing
+  // nothing, if one isn't one.
+  bool SetBackends(const std::vector<std::string>& backends);
+
+  // The backends listed in the file at `path`, one a line, with # starting
+  // a comment.
+  static bool ReadBackends(const char* path,
+                           std::vector<std::string>& backends);
+
+ private:
+  struct Backend {
+    std::string name;
+    std::string host;
+    int port;
+    // Whether it is among the backends, and answered the last scrape.
+    bool listed;
+    bool up;
+    // Its sessions and waiting frames at the last scrape, and the proxy's
+    // sessions on it.
+    double connections;
+    double pending;
+    size_t sessions;
+  };
+  struct Upstream;
+  // A client's connection.
+  struct Link {
+    uint64_t id;
+    uWS::WebSocket<uWS::SERVER> client;
+    std::string key;
+    // The client's query, with the key, for the backends.
+    std::string query;
+    // The node the session is counted on, the connection relayed to, or
+    // null, and the one being connected to it, or null; and whether its
+    // handoff to `backend` is under way.
+    size_t backend;
+    Upstream* upstream;
+    Upstream* next;
+    bool handingOver;
+    // The newest frame while there is no upstream.
+    bool held;
+    std::string frame;
+    uWS::OpCode opCode;
+  };
+  // A connection to a backend, for a link until it closes or moves on.
+  struct Upstream {
+    Link* link;
+    size_t backend;
+    bool open;
+    uWS::WebSocket<uWS::CLIENT> ws;
+  };
+
+  void Serve();
+  // Each node's load, infinite for those not listed and up.
+  std::vector<double> Loads() const;
+  bool Member(size_t backend) const;
+  // Put a link with no node up on the one the ring has for it now, or
+  // hang up on its client if there is none.
+  void Place(Link& link);
+  // Count the link on `backend`, and connect it there, after a handoff
+  // from the node it is relayed to if that is up.
+  void Move(Link& link, size_t backend);
+  void Connect(Link& link, size_t backend);
+  // Move the sessions the joined nodes now take, and those of the nodes
+  // that left, given which were members before.
+  void Rebalance(const std::vector<bool>& members);
+  void Close(Link& link);
+  void Release(Upstream* upstream);
+
+  // Scrape the nodes listed, unless a scrape is still under way.
+  void StartScrape();
+  // Scrape `nodes`, and hand the session of link `id` over from node
+  // `from` to `to`, on helpers_; each posts what it found to the loop.
+  void Scrape(std::vector<Backend> nodes);
+  void Handoff(uint64_t id, const std::string& key, const Backend& from,
+               const Backend& to, size_t backend);
+  // Run `task` on the loop.
+  void Post(std::function<void()> task);
+  void Flush();
+
+  uWS::Hub& hub_;
+  Options options_;
+  HashRing ring_;
+  // Never shrinks, so that their indices stay put in ring_.
+  std::vector<Backend> backends_;
+  std::map<uint64_t, std::unique_ptr<Link> > links_;
+  std::map<Upstream*, std::unique_ptr<Upstream> > upstreams_;
+  uint64_t next_link_;
+  // The prefix of the keys the proxy gives.
+  std::string prefix_;
+  bool scraping_;
+  uv_timer_t scrape_timer_;
+  uv_async_t async_;
+  std::mutex mutex_;
+  std::vector<std::function<void()> > posted_;
+  WorkerPool helpers_;
+  size_t next_helper_;
+};
+
+#endif /* PROXY_H */
@@ -0,0 +1,70 @@
+#ifndef PUBLISHED_H
+#define PUBLISHED_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// A value that is replaced while many threads read it, RCU style: a reload
+// publishes a new version beside the old rather than changing it, readers
+// move to it when they next look, at a boundary of their own such as
+// between frames, and each old version is freed when the last reader lets
+// go of it. No reader ever waits for the writer or for another reader.
+//
+// Each reader keeps its own Reader, a counted reference to the version it
+// is on. Refresh() compares the reader's version number with the current
+// one, a single atomic load, so looking every frame costs nothing while no
+// reload has happened; only after one does it copy the new version's
+// pointer, through the standard library's atomic shared_ptr access.
+template <class T>
+class Published {
+ public:
+  struct Reader {
+    Reader() : version(0) {}
+    const T* get() const { return value.get(); }
+
+    std::shared_ptr<const T> value;
+    uint64_t version;
+  };
+
+  explicit Published(std::shared_ptr<const T> value = nullptr)
+      : value_(std::move(value)), version_(1) {}
+
+  Published(const Published&) = delete;
+  Published& operator=(const Published&) = delete;
+
+  // Make `value` the current version. Readers move to it at their next
+  // Refresh; the one it replaces lives on while any is still on it.
+  void Publish(std::shared_ptr<const T> value) {
+    std::atomic_store(&value_, std::move(value));
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  // The current version.
+  std::shared_ptr<const T> Get() const { return std::atomic_load(&value_); }
+  uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+  // Move `reader` to the current version. True if it was on another one,
+  // false if it was current already.
+  bool Refresh(Reader& reader) const {
+    uint64_t version = this->version();
+    if (version == reader.version) {
+      return false;
+    }
+    reader.version = version;
+    std::shared_ptr<const T> value = Get();
+    // A Publish between the two loads leaves the version behind the value,
+    // and the next look takes the same value again.
+    if (value == reader.value) {
+      return false;
+    }
+    reader.value = std::move(value);
+    return true;
+  }
+
+ private:
+  std::shared_ptr<const T> value_;
+  std::atomic<uint64_t> version_;
+};
+
+#endif /* PUBLISHED_H */
@@ -0,0 +1,185 @@
+// pympc: the controller in process for Python, for offline sweeps and
+// dataset generation at native speed instead of through the websocket.
+//
+//   import numpy as np, pympc
+//   config = pympc.Config()
+//   config.set("ref_v", 60)
+//   mpc = pympc.MPC(config, pympc.Method.IPOPT)
+//   delta, a, status, x, y = mpc.solve(state, coeffs)
+//   actuations, statuses, x, y, sizes = mpc.solve_batch(states, coeffs)
+//
+// States are rows [x, y, psi, v, cte, epsi] and coeffs rows of the path's
+// cubic in increasing order, as MPC::Solve takes them. Inputs are read in
+// place when they are C-contiguous float64 and converted otherwise; the
+// actuations, statuses and trajectories are written by the solvers straight
+// into the arrays returned. The GIL is released while solving.
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <string>
+#include <vector>
+#include "MPC.h"
+#include "MpcConfig.h"
+
+namespace py = pybind11;
+
+namespace {
+
+typedef py::array_t<double, py::array::c_style | py::array::forcecast>
+    Doubles;
+
+// MPC with the solver statistics it keeps, and room for the trajectory of a
+// single solve.
+class PyMPC {
+ public:
+  PyMPC(const MpcConfig& config, MPC::Method method) : mpc_(config) {
+    mpc_.method = method;
+  }
+
+  py::tuple Solve(Doubles state, Doubles coeffs) {
+    if (state.size() != 6 || coeffs.size() != 4) {
+      throw py::value_error("solve takes a state of 6 and a cubic of 4");
+    }
+    const size_t points = mpc_.config().N;
+    py::array_t<double> x(points);
+    py::array_t<double> y(points);
+    MPC::Result result = {0, 0, x.mutable_data(), y.mutable_data(), points,
+                          0};
+    State s = Eigen::Map<const State>(state.data());
+    Cubic c = Eigen::Map<const Cubic>(coeffs.data());
+    {
+      py::gil_scoped_release release;
+      mpc_.Solve(s, c, result);
+    }
+    x.resize({result.size});
+    y.resize({result.size});
+    return py::make_tuple(result.delta, result.a, mpc_.stats().status, x, y);
+  }
+
+  py::tuple SolveBatch(Doubles states, Doubles coeffs, size_t threads) {
+    if (states.ndim() != 2 || states.shape(1) != 6 || coeffs.ndim() != 2 ||
+        coeffs.shape(1) != 4 || states.shape(0) != coeffs.shape(0)) {
+      throw py::value_error(
+          "solve_batch takes states of shape (n, 6) and coeffs of (n, 4)");
+    }
+    const size_t n = states.shape(0);
+    const size_t points = mpc_.config().N;
+    py::array_t<double> actuations({n, size_t(2)});
+    py::array_t<int> statuses(n);
+    py::array_t<double> x({n, points});
+    py::array_t<double> y({n, points});
+    py::array_t<size_t> sizes(n);
+
+    // BatchProblem holds its state and cubic by value: ten doubles a
+    // problem, copied here, while the results point into the arrays.
+    problems_.resize(n);
+    results_.resize(n);
+    status_.resize(n);
+    const double* s = states.data();
+    const double* c = coeffs.data();
+    double* xs = x.mutable_data();
+    double* ys = y.mutable_data();
+    for (size_t k = 0; k < n; k++) {
+      problems_[k].state = Eigen::Map<const State>(s + 6 * k);
+      problems_[k].coeffs = Eigen::Map<const Cubic>(c + 4 * k);
+      MPC::Result r = {0, 0, xs + points * k, ys + points * k, points, 0};
+      results_[k] = r;
+    }
+    {
+      py::gil_scoped_release release;
+      mpc_.batchThreads = threads;
+      mpc_.SolveBatch(problems_.data(), results_.data(), n, status_.data());
+    }
+    auto u = actuations.mutable_unchecked<2>();
+    auto st = statuses.mutable_unchecked<1>();
+    auto sz = sizes.mutable_unchecked<1>();
+    for (size_t k = 0; k < n; k++) {
+      u(k, 0) = results_[k].delta;
+      u(k, 1) = results_[k].a;
+      st(k) = status_[k];
+      sz(k) = results_[k].size;
+    }
+    return py::make_tuple(actuations, statuses, x, y, sizes);
+  }
+
+  const MPC::SolveStats& stats() const { return mpc_.stats(); }
+  const MpcConfig& config() const { return mpc_.config(); }
+
+ private:
+  MPC mpc_;
+  // The last batch's problems and results, kept for the next.
+  std::vector<MPC::BatchProblem> problems_;
+  std::vector<MPC::Result> results_;
+  std::vector<MPC::Status> status_;
+};
+
+}  // namespace
+
+PYBIND11_MODULE(pympc, m) {
+  m.doc() = "In-process model predictive control, see src/MPC.h.";
+
+  // The batch threads and the solving Python threads, each with a CppAD
+  // allocator of its own.
+  MPC::SetupThreads(CPPAD_MAX_NUM_THREADS);
+
+  py::enum_<MPC::Method>(m, "Method")
+      .value("IPOPT", MPC::IPOPT)
+      .value("REAL_TIME_ITERATION", MPC::REAL_TIME_ITERATION)
+      .value("LINEAR_TIME_VARYING", MPC::LINEAR_TIME_VARYING)
+      .value("LQR", MPC::LQR)
+      .value("POLICY", MPC::POLICY)
+      .value("PATH_INTEGRAL", MPC::PATH_INTEGRAL)
+      .value("ROBUST", MPC::ROBUST)
+      .value("FRENET", MPC::FRENET);
+
+  py::enum_<MPC::Status>(m, "Status")
+      .value("CONVERGED", MPC::CONVERGED)
+      .value("DEADLINE_EXCEEDED", MPC::DEADLINE_EXCEEDED)
+      .value("BEST_FEASIBLE", MPC::BEST_FEASIBLE)
+      .value("FAILED", MPC::FAILED);
+
+  py::class_<MpcConfig>(m, "Config")
+      .def(py::init<>())
+      .def_readonly("N", &MpcConfig::N)
+      .def_readonly("dt", &MpcConfig::dt)
+      .def_readwrite("Lf", &MpcConfig::Lf)
+      .def_readonly("ref_v", &MpcConfig::refV)
+      .def("set",
+           [](MpcConfig& config, const std::string& name, double value) {
+             if (!SetTuning(config, name, value)) {
+               throw py::value_error("no tuning parameter " + name);
+             }
+           },
+           "Set a tuning parameter by its name in a tuning file.")
+      .def("load",
+           [](MpcConfig& config, const std::string& path) {
+             if (!LoadTuning(path, config)) {
+               throw py::value_error("can't load tuning " + path);
+             }
+           },
+           "Set the parameters of a tuning file.");
+
+  py::class_<MPC::SolveStats>(m, "SolveStats")
+      .def_readonly("status", &MPC::SolveStats::status)
+      .def_readonly("iterations", &MPC::SolveStats::iterations)
+      .def_readonly("restorations", &MPC::SolveStats::restorations)
+      .def_readonly("cost", &MPC::SolveStats::cost)
+      .def_readonly("constraint_violation",
+                    &MPC::SolveStats::constraintViolation)
+      .def_readonly("seconds", &MPC::SolveStats::seconds);
+
+  py::class_<PyMPC>(m, "MPC")
+      .def(py::init<const MpcConfig&, MPC::Method>(),
+           py::arg("config") = MpcConfig(), py::arg("method") = MPC::IPOPT)
+      .def("solve", &PyMPC::Solve, py::arg("state"), py::arg("coeffs"),
+           "(delta, a, status, x, y) of one problem; the trajectory is in "
+           "the car's frame.")
+      .def("solve_batch", &PyMPC::SolveBatch, py::arg("states"),
+           py::arg("coeffs"), py::arg("threads") = 0,
+           "(actuations, statuses, x, y, sizes) of n independent problems, "
+           "over `threads` threads, 0 for one per core; row k of x and y "
+           "holds sizes[k] points.")
+      .def_property_readonly("stats", &PyMPC::stats,
+                             py::return_value_policy::reference_internal)
+      .def_property_readonly("config", &PyMPC::config,
+                             py::return_value_policy::reference_internal);
+}
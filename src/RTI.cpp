@@ -0,0 +1,116 @@
+#include "RTI.h"
+#include <algorithm>
+#include <cmath>
+
+// Projected Gauss-Seidel stops after this many sweeps, or once no control
+// moves by more than the tolerance.
+static const int MAX_SWEEPS = 100;
+static const double SWEEP_TOL = 1e-9;
+
+RTI::RTI(size_t N, double dt, double Lf, double ref_v,
+         const KinematicWeights& weights)
+    : lastSweeps(0), fixedSweeps(0), N_(N), dt_(dt), Lf_(Lf), ref_v_(ref_v),
+      w_(weights), n_u_(2 * (N - 1)), prepared_(false) {
+  coeffs_.setZero();
+  xbar_ = Eigen::MatrixXd::Zero(6, N);
+  ubar_ = Eigen::MatrixXd::Zero(2, N - 1);
+  gamma_ = Eigen::MatrixXd::Zero(6 * (N - 1), n_u_);
+  q_gamma_ = Eigen::MatrixXd::Zero(6 * (N - 1), n_u_);
+  residual_ = Eigen::VectorXd::Zero(6 * (N - 1));
+  H_ = Eigen::MatrixXd::Zero(n_u_, n_u_);
+  g_ = Eigen::VectorXd::Zero(n_u_);
+  du_ = Eigen::VectorXd::Zero(n_u_);
+  lb_ = Eigen::VectorXd::Zero(n_u_);
+  ub_ = Eigen::VectorXd::Zero(n_u_);
+
+  R_ = ControlCost(N, w_);
+
+  // Only v, cte and epsi are penalized; stage 0 is fixed by the state.
+  state_weight_ = Eigen::VectorXd::Zero(6 * (N - 1));
+  for (size_t k = 0; k + 1 < N; k++) {
+    state_weight_[6 * k + 3] = w_.v;
+    state_weight_[6 * k + 4] = w_.cte;
+    state_weight_[6 * k + 5] = w_.epsi;
+  }
+}
+
+void RTI::Prepare() {
+  // Advance the control trajectory by one stage, repeating the last one.
+  for (size_t k = 0; k + 2 < N_; k++) {
+    ubar_.col(k) = ubar_.col(k + 1);
+  }
+  for (size_t k = 0; k + 1 < N_; k++) {
+    lb_[2 * k] = -MAX_DELTA - ubar_(0, k);
+    ub_[2 * k] = MAX_DELTA - ubar_(0, k);
+    lb_[2 * k + 1] = -MAX_A - ubar_(1, k);
+    ub_[2 * k + 1] = MAX_A - ubar_(1, k);
+  }
+  prepared_ = true;
+}
+
+Input RTI::Feedback(const State& state,
+                    const Cubic& coeffs,
+                    std::vector<double>& mpc_x_vals,
+                    std::vector<double>& mpc_y_vals) {
+  if (!prepared_) {
+    Prepare();
+  }
+  coeffs_ = coeffs;
+  const State& x0 = state;
+  BicycleRollout(x0, ubar_, coeffs_, dt_, Lf_, xbar_);
+
+  // Condense: the deviation of state k + 1 is
+  // A_k * (deviation of state k) + B_k * du_k, starting from zero.
+  for (size_t k = 0; k + 1 < N_; k++) {
+    State s = xbar_.col(k);
+    Input u = ubar_.col(k);
+    BicycleLinearize(s, u, coeffs_, dt_, Lf_, A_, B_);
+    CondenseStage(k, A_, B_, gamma_);
+  }
+
+  for (size_t k = 0; k + 1 < N_; k++) {
+    residual_.segment<6>(6 * k) = xbar_.col(k + 1);
+    residual_[6 * k + 3] -= ref_v_;
+  }
+  q_gamma_.noalias() = state_weight_.asDiagonal() * gamma_;
+  H_.noalias() = 2 * gamma_.transpose() * q_gamma_;
+  H_ += 2 * R_;
+  Eigen::Map<Eigen::VectorXd> u_flat(ubar_.data(), n_u_);
+  g_.noalias() = 2 * q_gamma_.transpose() * residual_;
+  g_.noalias() += 2 * R_ * u_flat;
+
+  lastSweeps = SolveBoxQP();
+  u_flat += du_;
+  BicycleRollout(x0, ubar_, coeffs_, dt_, Lf_, xbar_);
+  prepared_ = false;
+
+  for (size_t k = 1; k < N_; k++) {
+    mpc_x_vals.push_back(xbar_(0, k));
+    mpc_y_vals.push_back(xbar_(1, k));
+  }
+  return ubar_.col(0);
+}
+
+int RTI::SolveBoxQP() {
+  // Projected Gauss-Seidel. H is positive definite because R is, so each
+  // coordinate update is well defined and the sweeps converge.
+  du_.setZero();
+  int sweeps = fixedSweeps > 0 ? fixedSweeps : MAX_SWEEPS;
+  int sweep = 0;
+  while (sweep < sweeps) {
+    sweep++;
+    double change = 0;
+    for (size_t i = 0; i < n_u_; i++) {
+      // H is symmetric; its columns are contiguous.
+      double r = g_[i] + H_.col(i).dot(du_);
+      double next = du_[i] - r / H_(i, i);
+      next = std::min(std::max(next, lb_[i]), ub_[i]);
+      change = std::max(change, std::fabs(next - du_[i]));
+      du_[i] = next;
+    }
+    if (fixedSweeps == 0 && change < SWEEP_TOL) {
+      break;
+    }
+  }
+  return sweep;
+}
@@ -0,0 +1,78 @@
+#ifndef RTI_H
+#define RTI_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+
+// Real-time iteration NMPC: one Gauss-Newton SQP step per control tick.
+//
+// Instead of solving the NLP to convergence, each tick linearizes the model
+// around the previous control trajectory advanced by one stage, condenses the
+// resulting QP onto the controls, and takes a single box-constrained QP step.
+// The iterate improves from tick to tick, and the work per tick is fixed.
+//
+// The work is split into two phases. Prepare() runs between frames and does
+// everything that doesn't need the new telemetry: shifting the control
+// trajectory and resetting the QP bounds around it. Feedback() runs once the
+// new state and path fit are known. Both are expressed in the vehicle frame of
+// the incoming telemetry, so the rollout, linearization and condensing
+// happen there; for the horizon sizes we run that is a few small dense
+// products, with all buffers allocated at construction.
+class RTI {
+ public:
+  RTI(size_t N, double dt, double Lf, double ref_v,
+      const KinematicWeights& weights);
+
+  // Preparation phase, for the frame after the last Feedback().
+  void Prepare();
+
+  // Feedback phase: one QP step from `state` along the path `coeffs`.
+  // Returns the first actuations {delta, a} and appends the predicted
+  // trajectory, like MPC::Solve.
+  Input Feedback(const State& state, const Cubic& coeffs,
+                 std::vector<double>& mpc_x_vals,
+                 std::vector<double>& mpc_y_vals);
+
+  // Number of projected Gauss-Seidel sweeps used by the last QP.
+  int lastSweeps;
+  // Run exactly this many sweeps, whatever the change, rather than to the
+  // tolerance; 0 for the tolerance.
+  int fixedSweeps;
+
+ private:
+  // Minimize 1/2 du' H du + g' du over lb <= du <= ub.
+  int SolveBoxQP();
+
+  size_t N_;
+  double dt_;
+  double Lf_;
+  double ref_v_;
+  KinematicWeights w_;
+  size_t n_u_;
+
+  Cubic coeffs_;
+  // Linearization trajectory: states 6 x N, controls 2 x (N - 1).
+  Eigen::MatrixXd xbar_;
+  Eigen::MatrixXd ubar_;
+  // Sensitivity of states 1..N-1 to the stacked controls.
+  Eigen::MatrixXd gamma_;
+  Eigen::MatrixXd q_gamma_;
+  // Control cost, constant: u' R u.
+  Eigen::MatrixXd R_;
+  Eigen::VectorXd state_weight_;
+  Eigen::VectorXd residual_;
+  Eigen::MatrixXd H_;
+  Eigen::VectorXd g_;
+  Eigen::VectorXd du_;
+  Eigen::VectorXd lb_;
+  Eigen::VectorXd ub_;
+  StateJacobian A_;
+  InputJacobian B_;
+  bool prepared_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* RTI_H */
@@ -0,0 +1,157 @@
+#include "Realtime.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// set_mempolicy's, from numaif.h, which only comes with libnuma.
+static const int MPOL_PREFERRED_MODE = 1;
+
+#ifdef __linux__
+
+bool PinThread(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool PinThread(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  return !cpus.empty() &&
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool PreferMemoryNode(int node) {
+  if (node < 0 || node >= 64) {
+    return false;
+  }
+  unsigned long mask = 1ul << node;
+  return syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &mask, 65) == 0;
+}
+
+bool SetFifoPriority(int priority) {
+  sched_param param;
+  param.sched_priority = priority;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+bool SetIdlePriority() {
+  sched_param param;
+  param.sched_priority = 0;
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0) {
+    return true;
+  }
+  // The thread's nice value, which Linux keeps per thread.
+  return setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19) == 0;
+}
+
+bool SetTimerSlack(uint64_t nanoseconds) {
+  // 0 would restore the default slack instead.
+  return prctl(PR_SET_TIMERSLACK, std::max<uint64_t>(nanoseconds, 1), 0, 0,
+               0) == 0;
+}
+
+uint64_t ThreadPreemptions() {
+  rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_nivcsw;
+}
+
+uint64_t ThreadCpuNanos() {
+  timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+#else
+
+bool PinThread(const std::vector<int>&) { return false; }
+bool PreferMemoryNode(int) { return false; }
+bool PinThread(int) { return false; }
+bool SetFifoPriority(int) { return false; }
+bool SetIdlePriority() { return false; }
+bool SetTimerSlack(uint64_t) { return false; }
+uint64_t ThreadPreemptions() { return 0; }
+uint64_t ThreadCpuNanos() { return 0; }
+
+#endif
+
+std::vector<NumaNode> NumaNodes() {
+  std::vector<NumaNode> nodes;
+  for (int id = 0;; id++) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) +
+                       "/cpulist");
+    if (!file) {
+      break;
+    }
+    std::string list;
+    std::getline(file, list);
+    // A node of memory alone has no cores to run workers on.
+    std::vector<int> cpus = ParseCpuList(list);
+    if (!cpus.empty()) {
+      nodes.push_back(NumaNode{id, cpus});
+    }
+  }
+  if (nodes.empty()) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    nodes.push_back(NumaNode{0, std::vector<int>()});
+    for (unsigned cpu = 0; cpu < cores; cpu++) {
+      nodes.back().cpus.push_back(int(cpu));
+    }
+  }
+  return nodes;
+}
+
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  const char* p = list.c_str();
+  while (*p) {
+    char* end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0) {
+      return std::vector<int>();
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first) {
+        return std::vector<int>();
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(int(cpu));
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p) {
+      return std::vector<int>();
+    }
+  }
+  return cpus;
+}
@@ -0,0 +1,52 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scheduling of the calling thread, for keeping the OS scheduler out of the
+// control loop's tail latency: pinning it to a core, and running it under
+// SCHED_FIFO, which preempts every normal thread and is only preempted by
+// higher real-time priorities. Threads a thread starts inherit both, so the
+// rivals and stage threads of a pinned worker's controllers stay with it.
+// Linux only; elsewhere the calls fail and nothing changes.
+
+// Pin the calling thread to `cpu`. False if it can't be.
+bool PinThread(int cpu);
+// Pin the calling thread to any of `cpus`. False if it can't be.
+bool PinThread(const std::vector<int>& cpus);
+// Run the calling thread under SCHED_FIFO at `priority`, 1 to 99. False
+// without the privilege, CAP_SYS_NICE or an RLIMIT_RTPRIO that allows it.
+bool SetFifoPriority(int priority);
+// Run the calling thread under SCHED_IDLE, below every normal thread, so
+// that it only gets a core none of them wants; failing that, at nice 19.
+// Needs no privilege. False if neither can be set.
+bool SetIdlePriority();
+// The NUMA nodes with cores, from sysfs; a single node 0 of every core
+// where there is no NUMA information.
+struct NumaNode {
+  int id;
+  std::vector<int> cpus;
+};
+std::vector<NumaNode> NumaNodes();
+// Have the calling thread's new pages allocated on NUMA `node` where it
+// has memory, and elsewhere otherwise. The kernel already places pages on
+// the node of the core that first touches them; this keeps them there
+// when the thread runs elsewhere for a moment. False if it can't be set.
+bool PreferMemoryNode(int node);
+// Let the kernel fire the calling thread's timers, and end its timed waits,
+// up to `nanoseconds` late, together with other timers, so that an idle
+// CPU wakes less often and stays in deeper sleep states. Threads started
+// after inherit it; SCHED_FIFO threads ignore it. False if it can't be set.
+bool SetTimerSlack(uint64_t nanoseconds);
+// The times the calling thread has been preempted so far: its involuntary
+// context switches.
+uint64_t ThreadPreemptions();
+// The CPU time the calling thread has run for so far, in nanoseconds.
+uint64_t ThreadCpuNanos();
+
+// The cores in a list like "2,3,6-8"; empty for an empty or malformed one.
+std::vector<int> ParseCpuList(const std::string& list);
+
+#endif /* REALTIME_H */
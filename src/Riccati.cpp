@@ -0,0 +1,54 @@
+#include "Riccati.h"
+#include "SimdKernels.h"
+
+template <int NX, int NU, class Scalar>
+Riccati<NX, NU, Scalar>::Riccati(size_t stages) : T_(0) {
+  Resize(stages);
+}
+
+template <int NX, int NU, class Scalar>
+void Riccati<NX, NU, Scalar>::Resize(size_t stages) {
+  T_ = stages;
+  A.assign(T_, StateMatrix::Zero());
+  B.assign(T_, CrossMatrix::Zero());
+  Q.assign(T_ + 1, StateMatrix::Zero());
+  S.assign(T_, CrossMatrix::Zero());
+  R.assign(T_, InputMatrix::Zero());
+  q.assign(T_ + 1, StateVector::Zero());
+  r.assign(T_, InputVector::Zero());
+  x0.setZero();
+  x.assign(T_ + 1, StateVector::Zero());
+  u.assign(T_, InputVector::Zero());
+  P_.assign(T_ + 1, StateMatrix::Zero());
+  K_.assign(T_, GainMatrix::Zero());
+  llt_.assign(T_, Eigen::LLT<InputMatrix>());
+  p_.assign(T_ + 1, StateVector::Zero());
+  k_.assign(T_, InputVector::Zero());
+}
+
+// The kernels of the instruction set chosen, by scalar.
+static bool Factorize(Riccati<8, 2, double>& riccati) {
+  return Kernels().riccatiFactorize(riccati);
+}
+static bool Factorize(Riccati<8, 2, float>& riccati) {
+  return Kernels().riccatiFactorizeFloat(riccati);
+}
+static void Solve(Riccati<8, 2, double>& riccati) {
+  Kernels().riccatiSolve(riccati);
+}
+static void Solve(Riccati<8, 2, float>& riccati) {
+  Kernels().riccatiSolveFloat(riccati);
+}
+
+template <int NX, int NU, class Scalar>
+bool Riccati<NX, NU, Scalar>::Factorize() {
+  return ::Factorize(*this);
+}
+
+template <int NX, int NU, class Scalar>
+void Riccati<NX, NU, Scalar>::Solve() {
+  ::Solve(*this);
+}
+
+template class Riccati<8, 2, double>;
+template class Riccati<8, 2, float>;
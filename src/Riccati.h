@@ -0,0 +1,85 @@
+#ifndef RICCATI_H
+#define RICCATI_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// The recursions of Riccati::Factorize and Solve, built for each
+// instruction set in SimdKernels.cpp.
+template <int Isa, class R>
+bool RiccatiFactorize(R& riccati);
+template <int Isa, class R>
+void RiccatiSolve(R& riccati);
+
+// Structured solver for the equality-constrained LQ problem
+//
+//   minimize    sum_{k<T} 1/2 x_k' Q_k x_k + x_k' S_k u_k + 1/2 u_k' R_k u_k
+//                         + q_k' x_k + r_k' u_k
+//               + 1/2 x_T' Q_T x_T + q_T' x_T
+//   subject to  x_{k+1} = A_k x_k + B_k u_k,  x_0 given,
+//
+// which is the KKT system of the MPC QP, block-tridiagonal by stage. The
+// stage-wise Riccati recursion eliminates it in O(T) with NX x NX and
+// NX x NU blocks, against a general sparse factorization of the whole
+// matrix. The work is split so that iterative callers only repeat the cheap
+// part: Factorize() depends on the matrices, Solve() on the linear terms.
+//
+// Riccati.cpp instantiates NX = 8, NU = 2: the bicycle state augmented with
+// the previous control, so that the actuator rate terms become stage costs;
+// in double and in float. The NU x NU factorizations are well conditioned
+// for the MPC weights, and aren't refined in float. Both recursions run in
+// the widest instruction set the CPU has, see SimdKernels.h.
+template <int NX, int NU, class Scalar = double>
+class Riccati {
+ public:
+  typedef Eigen::Matrix<Scalar, NX, NX> StateMatrix;
+  typedef Eigen::Matrix<Scalar, NX, NU> CrossMatrix;
+  typedef Eigen::Matrix<Scalar, NU, NU> InputMatrix;
+  typedef Eigen::Matrix<Scalar, NU, NX> GainMatrix;
+  typedef Eigen::Matrix<Scalar, NX, 1> StateVector;
+  typedef Eigen::Matrix<Scalar, NU, 1> InputVector;
+
+  explicit Riccati(size_t stages = 0);
+
+  // Size for T = `stages` controls, zeroing the problem data.
+  void Resize(size_t stages);
+
+  // Problem data. A, B, S, R, r have T entries; Q and q have T + 1.
+  std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix> > A;
+  std::vector<CrossMatrix, Eigen::aligned_allocator<CrossMatrix> > B;
+  std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix> > Q;
+  std::vector<CrossMatrix, Eigen::aligned_allocator<CrossMatrix> > S;
+  std::vector<InputMatrix, Eigen::aligned_allocator<InputMatrix> > R;
+  std::vector<StateVector, Eigen::aligned_allocator<StateVector> > q;
+  std::vector<InputVector, Eigen::aligned_allocator<InputVector> > r;
+  StateVector x0;
+
+  // Backward recursion on the matrices: cost-to-go Hessians and feedback
+  // gains. Returns false if some R_k + B_k' P_{k+1} B_k isn't positive
+  // definite.
+  bool Factorize();
+
+  // Backward recursion on the linear terms and forward rollout into x and u.
+  void Solve();
+
+  // Solution: T + 1 states and T controls.
+  std::vector<StateVector, Eigen::aligned_allocator<StateVector> > x;
+  std::vector<InputVector, Eigen::aligned_allocator<InputVector> > u;
+
+ private:
+  template <int Isa, class R>
+  friend bool RiccatiFactorize(R& riccati);
+  template <int Isa, class R>
+  friend void RiccatiSolve(R& riccati);
+
+  size_t T_;
+  std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix> > P_;
+  std::vector<GainMatrix, Eigen::aligned_allocator<GainMatrix> > K_;
+  std::vector<Eigen::LLT<InputMatrix>,
+              Eigen::aligned_allocator<Eigen::LLT<InputMatrix> > > llt_;
+  std::vector<StateVector, Eigen::aligned_allocator<StateVector> > p_;
+  std::vector<InputVector, Eigen::aligned_allocator<InputVector> > k_;
+};
+
+#endif /* RICCATI_H */
@@ -0,0 +1,240 @@
+// mpc_node: the controller as a ROS 2 node, for vehicle stacks on ROS 2,
+// in place of a bridge to the websocket server with its two serializations
+// and TCP hop. Built by the mpc_ros package in ros2/.
+//
+// It follows the nav_msgs/Path on `path` and answers each nav_msgs/Odometry
+// on `odom`, both in one world frame, with a solve: an mpc_ros/Actuation on
+// `mpc/actuation` and an mpc_ros/Prediction on `mpc/prediction`. Those are
+// fixed size, and loaned from the middleware where it can loan them, so
+// that with shared-memory transport, Cyclone DDS with iceoryx or Fast DDS
+// with data sharing, they reach subscribers on the host without a copy;
+// elsewhere they are published from messages of the node's own. The
+// subscriptions take loaned messages whenever the middleware offers them,
+// though Odometry and Path, with their frame ids and sequences of poses,
+// are copied by every middleware there is.
+//
+// Parameters:
+//   delay      seconds from the reply until the actuations take effect,
+//              added to the odometry's age for the state prediction (0.05)
+//   budget     seconds a solve may take (0.1)
+//   waypoints  poses of the path fitted, from the one nearest the car (12)
+//   method     ipopt, rti, ltv, lqr, mppi or frenet (ipopt)
+//   profile    a solver profile, see ApplySolverProfile ("")
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <nav_msgs/msg/odometry.hpp>
+#include <nav_msgs/msg/path.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include "Controller.h"
+#include "MPC.h"
+#include "MpcConfig.h"
+#include "Telemetry.h"
+#include "mpc_ros/msg/actuation.hpp"
+#include "mpc_ros/msg/prediction.hpp"
+
+namespace {
+
+// Telemetry has the simulator's speed in mph.
+const double MPH = 0.44704;
+
+const struct {
+  const char* name;
+  MPC::Method method;
+} METHODS[] = {{"ipopt", MPC::IPOPT},
+               {"rti", MPC::REAL_TIME_ITERATION},
+               {"ltv", MPC::LINEAR_TIME_VARYING},
+               {"lqr", MPC::LQR},
+               {"mppi", MPC::PATH_INTEGRAL},
+               {"frenet", MPC::FRENET}};
+
+// Publish a message filled by `fill`, loaned from the middleware if it can
+// loan one and `own` otherwise, so that no publish allocates.
+template <typename Message, typename Fill>
+void Publish(rclcpp::Publisher<Message>& publisher, Message& own,
+             Fill fill) {
+  if (publisher.can_loan_messages()) {
+    rclcpp::LoanedMessage<Message> loaned = publisher.borrow_loaned_message();
+    fill(loaned.get());
+    publisher.publish(std::move(loaned));
+  } else {
+    fill(own);
+    publisher.publish(own);
+  }
+}
+
+class MpcNode : public rclcpp::Node {
+ public:
+  MpcNode()
+      : rclcpp::Node("mpc"),
+        delay_(declare_parameter("delay", 0.05)),
+        budget_(declare_parameter("budget", 0.1)),
+        waypoints_(std::min<size_t>(
+            std::max<int64_t>(declare_parameter("waypoints", int64_t(12)),
+                              4),
+            MAX_WAYPOINTS)),
+        sequence_(0),
+        steering_(0),
+        throttle_(0),
+        output_(new Controller::Output),
+        actuation_(new mpc_ros::msg::Actuation),
+        prediction_(new mpc_ros::msg::Prediction) {
+    MpcConfig config;
+    std::string profile = declare_parameter("profile", std::string());
+    if (!profile.empty() && !ApplySolverProfile(config, profile)) {
+      RCLCPP_WARN(get_logger(), "No solver profile %s", profile.c_str());
+    }
+    controller_.reset(new Controller(config));
+    std::string method = declare_parameter("method", std::string("ipopt"));
+    bool known = false;
+    for (const auto& m : METHODS) {
+      if (method == m.name) {
+        controller_->mpc().method = m.method;
+        known = true;
+      }
+    }
+    if (!known) {
+      RCLCPP_WARN(get_logger(), "No method %s, solving with ipopt",
+                  method.c_str());
+    }
+    controller_->mpc().anytime = true;
+    controller_->mpc().WarmUp(3);
+
+    // Only the latest odometry is worth a solve.
+    rclcpp::QoS latest = rclcpp::QoS(rclcpp::KeepLast(1)).best_effort();
+    actuations_ = create_publisher<mpc_ros::msg::Actuation>(
+        "mpc/actuation", rclcpp::QoS(rclcpp::KeepLast(1)));
+    predictions_ = create_publisher<mpc_ros::msg::Prediction>(
+        "mpc/prediction", rclcpp::QoS(rclcpp::KeepLast(1)));
+    path_ = create_subscription<nav_msgs::msg::Path>(
+        "path", rclcpp::QoS(rclcpp::KeepLast(1)),
+        [this](const nav_msgs::msg::Path& path) { OnPath(path); });
+    odom_ = create_subscription<nav_msgs::msg::Odometry>(
+        "odom", latest,
+        [this](const nav_msgs::msg::Odometry& odom) { OnOdometry(odom); });
+  }
+
+ private:
+  void OnPath(const nav_msgs::msg::Path& path) {
+    path_x_.resize(path.poses.size());
+    path_y_.resize(path.poses.size());
+    for (size_t i = 0; i < path.poses.size(); i++) {
+      path_x_[i] = path.poses[i].pose.position.x;
+      path_y_[i] = path.poses[i].pose.position.y;
+    }
+  }
+
+  void OnOdometry(const nav_msgs::msg::Odometry& odom) {
+    Telemetry& t = telemetry_;
+    t.received = std::chrono::steady_clock::now();
+    t.sequence = ++sequence_;
+    t.px = odom.pose.pose.position.x;
+    t.py = odom.pose.pose.position.y;
+    const auto& q = odom.pose.pose.orientation;
+    t.psi = std::atan2(2 * (q.w * q.z + q.x * q.y),
+                       1 - 2 * (q.y * q.y + q.z * q.z));
+    // The twist is in the car's frame.
+    t.v = odom.twist.twist.linear.x / MPH;
+    t.delta = steering_;
+    t.a = throttle_;
+    t.latency =
+        std::max((now() - rclcpp::Time(odom.header.stamp)).seconds(), 0.) +
+        delay_;
+    t.binary = false;
+    t.prepared = false;
+    if (!Ahead(t)) {
+      RCLCPP_WARN_THROTTLE(get_logger(), *get_clock(), 5000,
+                           "No path to follow");
+      return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Controller::Output& out = *output_;
+    controller_->Step(
+        t,
+        start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(budget_)),
+        out);
+    steering_ = out.steering;
+    throttle_ = out.throttle;
+
+    const int64_t stamp = rclcpp::Time(odom.header.stamp).nanoseconds();
+    const MPC::SolveStats& stats = controller_->mpc().stats();
+    Publish(*actuations_, *actuation_, [&](mpc_ros::msg::Actuation& msg) {
+      msg.stamp = stamp;
+      msg.steering = out.steering;
+      msg.throttle = out.throttle;
+      msg.status = uint8_t(stats.status);
+      msg.solve_seconds = stats.seconds;
+    });
+    if (predictions_->get_subscription_count() == 0) {
+      return;
+    }
+    Publish(*predictions_, *prediction_, [&](mpc_ros::msg::Prediction& msg) {
+      msg.stamp = stamp;
+      msg.points = uint32_t(std::min(out.points, msg.x.size()));
+      std::copy(out.x, out.x + msg.points, msg.x.begin());
+      std::copy(out.y, out.y + msg.points, msg.y.begin());
+      std::copy(out.reference, out.reference + 4, msg.reference.begin());
+    });
+  }
+
+  // The waypoints of the path from the one nearest the car into `t`. False
+  // if there are too few to fit.
+  bool Ahead(Telemetry& t) const {
+    size_t nearest = 0;
+    double best = INFINITY;
+    for (size_t i = 0; i < path_x_.size(); i++) {
+      double d = std::hypot(path_x_[i] - t.px, path_y_[i] - t.py);
+      if (d < best) {
+        best = d;
+        nearest = i;
+      }
+    }
+    t.n_waypoints = 0;
+    for (size_t i = nearest; i < path_x_.size() && t.n_waypoints < waypoints_;
+         i++) {
+      t.ptsx[t.n_waypoints] = path_x_[i];
+      t.ptsy[t.n_waypoints] = path_y_[i];
+      t.n_waypoints++;
+    }
+    return t.n_waypoints >= 4;
+  }
+
+  const double delay_;
+  const double budget_;
+  const size_t waypoints_;
+  std::unique_ptr<Controller> controller_;
+  uint64_t sequence_;
+  // The last actuations sent, which the car is taken to apply.
+  double steering_;
+  double throttle_;
+  std::vector<double> path_x_;
+  std::vector<double> path_y_;
+  // Kept between messages, so that no odometry allocates.
+  Telemetry telemetry_;
+  std::unique_ptr<Controller::Output> output_;
+  std::unique_ptr<mpc_ros::msg::Actuation> actuation_;
+  std::unique_ptr<mpc_ros::msg::Prediction> prediction_;
+  rclcpp::Publisher<mpc_ros::msg::Actuation>::SharedPtr actuations_;
+  rclcpp::Publisher<mpc_ros::msg::Prediction>::SharedPtr predictions_;
+  rclcpp::Subscription<nav_msgs::msg::Path>::SharedPtr path_;
+  rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_;
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  MPC::SetupThreads(CPPAD_MAX_NUM_THREADS);
+  rclcpp::init(argc, argv);
+  // One thread runs both callbacks, so the path never changes mid-solve.
+  rclcpp::executors::SingleThreadedExecutor executor;
+  std::shared_ptr<MpcNode> node = std::make_shared<MpcNode>();
+  executor.add_node(node);
+  executor.spin();
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "ScenarioMPC.h"
+#include <algorithm>
+#include <cmath>
+
+ScenarioMPC::ScenarioMPC(size_t N, double dt, double ref_v,
+                         const KinematicWeights& weights,
+                         const std::vector<Scenario>& scenarios,
+                         size_t threads)
+    : maxIterations(50), rho(1000), tolerance(1e-3), lastIterations(0),
+      lastConverged(false), N_(N), dt_(dt), ref_v_(ref_v), w_(weights),
+      n_u_(2 * (N - 1)), pool_(new StagePool(threads)) {
+  R_ = ControlCost(N, w_);
+  double state_weight[6] = {0, 0, 0, w_.v, w_.cte, w_.epsi};
+  state_weight_ = Eigen::VectorXd::Zero(6 * (N - 1));
+  for (size_t k = 0; k + 1 < N; k++) {
+    state_weight_.segment<6>(6 * k) = Eigen::Map<State>(state_weight);
+  }
+  branches_.resize(scenarios.size());
+  for (size_t i = 0; i < scenarios.size(); i++) {
+    Branch& b = branches_[i];
+    b.scenario = scenarios[i];
+    b.ubar = Eigen::MatrixXd::Zero(2, N - 1);
+    b.xbar = Eigen::MatrixXd::Zero(6, N);
+    b.gamma = Eigen::MatrixXd::Zero(6 * (N - 1), n_u_);
+    b.q_gamma = Eigen::MatrixXd::Zero(6 * (N - 1), n_u_);
+    b.residual = Eigen::VectorXd::Zero(6 * (N - 1));
+    b.H = Eigen::MatrixXd::Zero(n_u_, n_u_);
+    b.g = Eigen::VectorXd::Zero(n_u_);
+    b.H_rho = Eigen::MatrixXd::Zero(n_u_, n_u_);
+    b.g_rho = Eigen::VectorXd::Zero(n_u_);
+    b.lb = Eigen::VectorXd::Zero(n_u_);
+    b.ub = Eigen::VectorXd::Zero(n_u_);
+    b.zero = Eigen::VectorXd::Zero(n_u_);
+    b.dual.setZero();
+    b.first.setZero();
+    b.qp.Resize(n_u_);
+  }
+  last_.setZero();
+}
+
+State ScenarioMPC::Step(const Branch& b, const State& s, const Input& u,
+                        const Cubic& coeffs, double dt) const {
+  return BicycleStep(s, b.scenario.grip * u, coeffs, dt, b.scenario.Lf);
+}
+
+void ScenarioMPC::Prepare(Branch& b, const State& state,
+                          const Cubic& coeffs) {
+  for (size_t k = 0; k + 2 < N_; k++) {
+    b.ubar.col(k) = b.ubar.col(k + 1);
+  }
+  // Later actuations land on a car moved on further under the last ones.
+  State x0 = state;
+  if (b.scenario.latency > 0) {
+    x0 = Step(b, state, last_, coeffs, b.scenario.latency);
+  }
+  b.xbar.col(0) = x0;
+  StateJacobian A;
+  InputJacobian B;
+  for (size_t k = 0; k + 1 < N_; k++) {
+    State s = b.xbar.col(k);
+    Input u = b.ubar.col(k);
+    b.xbar.col(k + 1) = Step(b, s, u, coeffs, dt_);
+    BicycleLinearize(s, b.scenario.grip * u, coeffs, dt_, b.scenario.Lf, A,
+                     B);
+    B *= b.scenario.grip;
+    CondenseStage(k, A, B, b.gamma);
+    b.residual.segment<6>(6 * k) = b.xbar.col(k + 1);
+    b.residual[6 * k + 3] -= ref_v_;
+    b.lb[2 * k] = -MAX_DELTA - b.ubar(0, k);
+    b.ub[2 * k] = MAX_DELTA - b.ubar(0, k);
+    b.lb[2 * k + 1] = -MAX_A - b.ubar(1, k);
+    b.ub[2 * k + 1] = MAX_A - b.ubar(1, k);
+  }
+  b.q_gamma.noalias() = state_weight_.asDiagonal() * b.gamma;
+  b.H.noalias() = 2 * b.gamma.transpose() * b.q_gamma;
+  b.H += 2 * R_;
+  Eigen::Map<Eigen::VectorXd> u_flat(b.ubar.data(), n_u_);
+  b.g.noalias() = 2 * b.q_gamma.transpose() * b.residual;
+  b.g.noalias() += 2 * R_ * u_flat;
+  b.dual.setZero();
+}
+
+void ScenarioMPC::Step(Branch& b, const Eigen::Vector2d& z) {
+  // rho / 2 |ubar_0 + du_0 - z + dual|^2 on top of the branch's own cost.
+  b.H_rho = b.H;
+  b.H_rho(0, 0) += rho;
+  b.H_rho(1, 1) += rho;
+  b.g_rho = b.g;
+  b.g_rho.head<2>() += rho * (b.ubar.col(0) - z + b.dual);
+  b.qp.WarmStart(b.zero);
+  b.qp.Solve(b.H_rho, b.g_rho, b.lb, b.ub);
+  const Eigen::VectorXd& du = b.qp.solution();
+  for (size_t i = 0; i < 2; i++) {
+    b.first[i] = b.ubar(i, 0) + std::min(std::max(du[i], b.lb[i]), b.ub[i]);
+  }
+}
+
+Input ScenarioMPC::Solve(const State& state, const Cubic& coeffs,
+                         std::vector<double>& mpc_x_vals,
+                         std::vector<double>& mpc_y_vals) {
+  size_t K = branches_.size();
+  pool_->Run(0, K, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      Prepare(branches_[i], state, coeffs);
+    }
+  });
+
+  Eigen::Vector2d z = Eigen::Vector2d::Zero();
+  for (const Branch& b : branches_) {
+    z += b.ubar.col(0) / K;
+  }
+  lastConverged = false;
+  lastIterations = 0;
+  while (lastIterations < maxIterations && !lastConverged) {
+    pool_->Run(0, K, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        Step(branches_[i], z);
+      }
+    });
+    Eigen::Vector2d next = Eigen::Vector2d::Zero();
+    for (const Branch& b : branches_) {
+      next += (b.first + b.dual) / K;
+    }
+    double disagreement = 0;
+    for (Branch& b : branches_) {
+      b.dual += b.first - next;
+      disagreement =
+          std::max(disagreement, (b.first - next).lpNorm<Eigen::Infinity>());
+    }
+    z = next;
+    lastIterations++;
+    lastConverged = disagreement <= tolerance;
+  }
+  z[0] = std::min(std::max(z[0], -MAX_DELTA), MAX_DELTA);
+  z[1] = std::min(std::max(z[1], -MAX_A), MAX_A);
+
+  // Each branch keeps its tail for the next frame, behind the shared move.
+  for (Branch& b : branches_) {
+    const Eigen::VectorXd& du = b.qp.solution();
+    for (size_t i = 2; i < n_u_; i++) {
+      b.ubar(i % 2, i / 2) += std::min(std::max(du[i], b.lb[i]), b.ub[i]);
+    }
+    b.ubar.col(0) = z;
+  }
+  const Branch& nominal = branches_[0];
+  State s = nominal.xbar.col(0);
+  for (size_t k = 0; k + 1 < N_; k++) {
+    s = Step(nominal, s, nominal.ubar.col(k), coeffs, dt_);
+    mpc_x_vals.push_back(s[0]);
+    mpc_y_vals.push_back(s[1]);
+  }
+  last_ = z;
+  return z;
+}
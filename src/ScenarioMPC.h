@@ -0,0 +1,98 @@
+#ifndef SCENARIO_MPC_H
+#define SCENARIO_MPC_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+#include "DenseQP.h"
+#include "StagePool.h"
+
+// One model the car might actually follow: its Lf, how much later than
+// the compensated latency the actuations land, in seconds, and the grip,
+// the share of the commanded steering and throttle the tires deliver.
+struct Scenario {
+  double Lf;
+  double latency;
+  double grip;
+};
+
+// Scenario-based robust MPC: a first move good for every scenario at once,
+// each with its own tail of actuations for the rest of the horizon.
+//
+// Each scenario is the LTV-MPC of LTVMPC's CONDENSED formulation: its
+// model linearized along its own last actuations and condensed onto them.
+// The scenarios only share the first move, so the problem splits by
+// consensus ADMM: every iteration each scenario solves its own box QP with
+// a proximal term pulling its first move towards the consensus, all of them
+// in parallel on a StagePool, and the consensus becomes their average.
+// More scenarios take more cores rather than more time.
+class ScenarioMPC {
+ public:
+  ScenarioMPC(size_t N, double dt, double ref_v,
+              const KinematicWeights& weights,
+              const std::vector<Scenario>& scenarios, size_t threads);
+
+  // Consensus iterations per frame at most, the penalty on disagreeing
+  // first moves, and the disagreement to stop at.
+  int maxIterations;
+  double rho;
+  double tolerance;
+
+  // Returns the shared first actuations {delta, a} and appends the
+  // trajectory of the first scenario, like MPC::Solve.
+  Input Solve(const State& state, const Cubic& coeffs,
+              std::vector<double>& mpc_x_vals,
+              std::vector<double>& mpc_y_vals);
+
+  // Consensus iterations of the last Solve, and whether the first moves
+  // agreed to within tolerance.
+  int lastIterations;
+  bool lastConverged;
+
+ private:
+  struct Branch {
+    Scenario scenario;
+    // The last actuations, linearization trajectory and condensed QP.
+    Eigen::MatrixXd ubar;
+    Eigen::MatrixXd xbar;
+    Eigen::MatrixXd gamma;
+    Eigen::MatrixXd q_gamma;
+    Eigen::VectorXd residual;
+    Eigen::MatrixXd H;
+    Eigen::VectorXd g;
+    Eigen::MatrixXd H_rho;
+    Eigen::VectorXd g_rho;
+    Eigen::VectorXd lb;
+    Eigen::VectorXd ub;
+    Eigen::VectorXd zero;
+    // The scaled multiplier of the consensus on the first move.
+    Eigen::Vector2d dual;
+    Eigen::Vector2d first;
+    DenseQP qp;
+  };
+
+  // Linearize and condense branch b about its shifted actuations.
+  void Prepare(Branch& b, const State& state, const Cubic& coeffs);
+  // Its QP with the consensus term towards z.
+  void Step(Branch& b, const Eigen::Vector2d& z);
+  // Its model, with the grip on the inputs.
+  State Step(const Branch& b, const State& s, const Input& u,
+             const Cubic& coeffs, double dt) const;
+
+  size_t N_;
+  double dt_;
+  double ref_v_;
+  KinematicWeights w_;
+  size_t n_u_;
+  Eigen::MatrixXd R_;
+  Eigen::VectorXd state_weight_;
+  std::vector<Branch, Eigen::aligned_allocator<Branch> > branches_;
+  std::unique_ptr<StagePool> pool_;
+  Input last_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* SCENARIO_MPC_H */
@@ -0,0 +1,50 @@
+#include "SegmentDetector.h"
+#include <cmath>
+
+SegmentDetector::SegmentDetector()
+    : dwell(10), straight_(false), within_(0), frames_(0),
+      straight_frames_(0), straights_(0) {
+  // Radii of curvature beyond 500 m to enter and 150 m to leave, with the
+  // car settled on the line at about the reference speed.
+  enter.c2 = 1e-3;
+  enter.c3 = 1e-5;
+  enter.cte = 0.3;
+  enter.epsi = 0.05;
+  enter.v = 3;
+  exit.c2 = 3.3e-3;
+  exit.c3 = 5e-5;
+  exit.cte = 0.8;
+  exit.epsi = 0.12;
+  exit.v = 6;
+}
+
+bool SegmentDetector::Within(const Bounds& bounds, const State& state,
+                             const Cubic& coeffs, double ref_v) {
+  return std::fabs(coeffs[2]) <= bounds.c2 &&
+         std::fabs(coeffs[3]) <= bounds.c3 &&
+         std::fabs(state[4]) <= bounds.cte &&
+         std::fabs(state[5]) <= bounds.epsi &&
+         std::fabs(state[3] - ref_v) <= bounds.v;
+}
+
+bool SegmentDetector::Update(const State& state, const Cubic& coeffs,
+                             double ref_v) {
+  frames_++;
+  if (straight_) {
+    straight_ = Within(exit, state, coeffs, ref_v);
+  } else {
+    within_ = Within(enter, state, coeffs, ref_v) ? within_ + 1 : 0;
+    if (within_ >= dwell) {
+      straight_ = true;
+      within_ = 0;
+      straights_++;
+    }
+  }
+  straight_frames_ += straight_;
+  return straight_;
+}
+
+void SegmentDetector::Reset() {
+  straight_ = false;
+  within_ = 0;
+}
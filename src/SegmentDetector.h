@@ -0,0 +1,57 @@
+#ifndef SEGMENT_DETECTOR_H
+#define SEGMENT_DETECTOR_H
+
+#include <cstddef>
+#include "BicycleModel.h"
+
+// Tells the long, nearly straight stretches driven at a steady speed, on
+// which the NMPC does no more than hold the car on the line and the LQR law
+// does as well, from the rest of the path, for MPC::hybridLqr.
+//
+// A frame is within a set of bounds when the path's quadratic and cubic
+// coefficients, the car's cte and epsi, and the gap of its speed to the
+// reference are all within them. The detector goes straight once `dwell`
+// frames in a row are within `enter`, and back on the first frame outside
+// the wider `exit`, so that it doesn't chatter at the ends of a straight.
+class SegmentDetector {
+ public:
+  struct Bounds {
+    double c2;
+    double c3;
+    double cte;
+    double epsi;
+    double v;
+  };
+
+  SegmentDetector();
+
+  Bounds enter;
+  Bounds exit;
+  size_t dwell;
+
+  // Record a frame, with ref_v the reference speed. Returns whether it is
+  // on a straight.
+  bool Update(const State& state, const Cubic& coeffs, double ref_v);
+  bool straight() const { return straight_; }
+  // Back to curved, as at construction.
+  void Reset();
+
+  // Counters: frames recorded and those on straights, and the straights
+  // entered.
+  size_t frames() const { return frames_; }
+  size_t straightFrames() const { return straight_frames_; }
+  size_t straights() const { return straights_; }
+
+ private:
+  static bool Within(const Bounds& bounds, const State& state,
+                     const Cubic& coeffs, double ref_v);
+
+  bool straight_;
+  // Frames in a row within enter, while curved.
+  size_t within_;
+  size_t frames_;
+  size_t straight_frames_;
+  size_t straights_;
+};
+
+#endif /* SEGMENT_DETECTOR_H */
@@ -0,0 +1,133 @@
+#include "Sensitivity.h"
+#include <algorithm>
+#include <cmath>
+
+// Bounds at or beyond this are none, as in Ipopt's nlp_lower_bound_inf.
+static const double INFINITE_BOUND = 1e19;
+// Keeps the factorization of a quasi-definite matrix away from zero pivots.
+static const double REGULARIZATION = 1e-8;
+// Smallest distance to a bound and multiplier the barrier terms divide by.
+static const double TINY = 1e-12;
+
+Sensitivity::Sensitivity() : n_(0), m_(0), factored_(false) {}
+
+void Sensitivity::Conditions(MPC_NLP& nlp, Eigen::VectorXd& f) {
+  Ipopt::Index n = n_;
+  Ipopt::Index m = m_;
+  const double* x = &x_[0];
+  nlp.eval_grad_f(n, x, true, &grad_[0]);
+  nlp.eval_jac_g(n, x, true, m, jac_values_.size(), nullptr, nullptr,
+                 &jac_values_[0]);
+  nlp.eval_g(n, x, true, m, &g_[0]);
+  for (size_t i = 0; i < n_; i++) {
+    f[i] = grad_[i];
+  }
+  for (size_t k = 0; k < jac_values_.size(); k++) {
+    f[jac_cols_[k]] += jac_values_[k] * lambda_[jac_rows_[k]];
+  }
+  for (size_t i = 0; i < m_; i++) {
+    f[n_ + i] = g_[i];
+  }
+}
+
+bool Sensitivity::Factor(MPC_NLP& nlp) {
+  factored_ = false;
+  nlp.track_best = false;
+  Ipopt::Index n;
+  Ipopt::Index m;
+  Ipopt::Index nnz_jac;
+  Ipopt::Index nnz_hes;
+  Ipopt::TNLP::IndexStyleEnum style;
+  if (!nlp.get_nlp_info(n, m, nnz_jac, nnz_hes, style)) {
+    return false;
+  }
+  for (Ipopt::Index i = 0; i < n; i++) {
+    if (nlp.x_lowerbound[i] == nlp.x_upperbound[i]) {
+      return false;
+    }
+  }
+  n_ = n;
+  m_ = m;
+  x_ = nlp.x;
+  lambda_ = nlp.lambda;
+  jac_rows_.resize(nnz_jac);
+  jac_cols_.resize(nnz_jac);
+  jac_values_.resize(nnz_jac);
+  hes_rows_.resize(nnz_hes);
+  hes_cols_.resize(nnz_hes);
+  hes_values_.resize(nnz_hes);
+  g_.resize(m_);
+  grad_.resize(n_);
+  f0_.resize(n_ + m_);
+  f_.resize(n_ + m_);
+  step_.resize(n_ + m_);
+  nlp.eval_jac_g(n, nullptr, false, m, nnz_jac, &jac_rows_[0], &jac_cols_[0],
+                 nullptr);
+  nlp.eval_h(n, nullptr, false, 1, m, nullptr, false, nnz_hes,
+             &hes_rows_[0], &hes_cols_[0], nullptr);
+  nlp.eval_h(n, &x_[0], true, 1, m, &lambda_[0], true, nnz_hes, nullptr,
+             nullptr, &hes_values_[0]);
+  Conditions(nlp, f0_);
+
+  // The upper triangle, which is what the factorization reads.
+  triplets_.clear();
+  for (size_t k = 0; k < hes_values_.size(); k++) {
+    int r = std::min(hes_rows_[k], hes_cols_[k]);
+    int c = std::max(hes_rows_[k], hes_cols_[k]);
+    triplets_.push_back(Eigen::Triplet<double>(r, c, hes_values_[k]));
+  }
+  for (size_t i = 0; i < n_; i++) {
+    double sigma = REGULARIZATION;
+    if (nlp.x_lowerbound[i] > -INFINITE_BOUND) {
+      sigma += nlp.z_l[i] / std::max(x_[i] - nlp.x_lowerbound[i], TINY);
+    }
+    if (nlp.x_upperbound[i] < INFINITE_BOUND) {
+      sigma += nlp.z_u[i] / std::max(nlp.x_upperbound[i] - x_[i], TINY);
+    }
+    triplets_.push_back(Eigen::Triplet<double>(i, i, sigma));
+  }
+  for (size_t k = 0; k < jac_values_.size(); k++) {
+    triplets_.push_back(Eigen::Triplet<double>(
+        jac_cols_[k], n_ + jac_rows_[k], jac_values_[k]));
+  }
+  for (size_t i = 0; i < m_; i++) {
+    // An inequality far from its bounds, or with a vanishing multiplier,
+    // drops out of the step; an equality is always in it.
+    double inverse = REGULARIZATION;
+    double lower = nlp.g_lowerbound[i];
+    double upper = nlp.g_upperbound[i];
+    if (lower != upper) {
+      double distance = INFINITE_BOUND;
+      if (lower > -INFINITE_BOUND) {
+        distance = std::min(distance, g_[i] - lower);
+      }
+      if (upper < INFINITE_BOUND) {
+        distance = std::min(distance, upper - g_[i]);
+      }
+      inverse += std::max(distance, TINY) /
+                 std::max(std::fabs(lambda_[i]), TINY);
+    }
+    triplets_.push_back(Eigen::Triplet<double>(n_ + i, n_ + i, -inverse));
+  }
+  K_.resize(n_ + m_, n_ + m_);
+  K_.setFromTriplets(triplets_.begin(), triplets_.end());
+  ldlt_.compute(K_);
+  factored_ = ldlt_.info() == Eigen::Success;
+  return factored_;
+}
+
+bool Sensitivity::Predict(MPC_NLP& nlp, const Dvector& params, Dvector& x) {
+  if (!factored_) {
+    return false;
+  }
+  nlp.track_best = false;
+  nlp.SetParameters(params);
+  Conditions(nlp, f_);
+  f_ -= f0_;
+  step_ = ldlt_.solve(f_);
+  for (size_t i = 0; i < n_; i++) {
+    x[i] = std::min(std::max(x_[i] - step_[i], nlp.x_lowerbound[i]),
+                    nlp.x_upperbound[i]);
+  }
+  return true;
+}
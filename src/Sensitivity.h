@@ -0,0 +1,79 @@
+#ifndef SENSITIVITY_H
+#define SENSITIVITY_H
+
+#include <vector>
+#include <coin/IpTNLP.hpp>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCore"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "MPC_NLP.h"
+
+// First-order parametric sensitivity of an MPC_NLP solution, in the style of
+// sIPOPT: the solution of a problem whose parameters, the path and the
+// initial state, moved a little from those it was solved for.
+//
+// Factor() assembles the primal-dual KKT matrix at the solution,
+//
+//   [ W + Sigma_x       J'      ]
+//   [     J       -Sigma_g^-1   ],
+//
+// with W the Hessian of the Lagrangian as nlp gives it (exact, or the
+// Gauss-Newton one), J the constraint Jacobian, Sigma_x the barrier terms
+// z / (x - bound) of the bounds and Sigma_g the same for the inequality
+// constraints, none for the equalities, and factors it once. Predict() then
+// evaluates how far the optimality conditions F = [grad L, g] move with the
+// new parameters, a few sweeps of the tape, and takes the step
+// -K^-1 (F(p') - F(p)) from the solution: a back-substitution.
+//
+// Ipopt's own factorization isn't reachable through the TNLP interface, so
+// the matrix is rebuilt from the tape; it is still factored only once per
+// solution, between frames.
+class Sensitivity {
+ public:
+  typedef MPC_NLP::Dvector Dvector;
+
+  Sensitivity();
+
+  // Factor the KKT matrix of nlp at its last solution, with the parameters
+  // it was solved for still in effect. False, and nothing to predict from,
+  // when nlp fixes variables through their bounds (see
+  // MpcConfig::initialStateBounds) or the matrix is singular.
+  bool Factor(MPC_NLP& nlp);
+  bool factored() const { return factored_; }
+  void Clear() { factored_ = false; }
+
+  // The predicted solution for params into x, clamped to the bounds. Leaves
+  // params in effect in nlp, and evaluates it outside of a solve: anytime
+  // tracking is switched off.
+  bool Predict(MPC_NLP& nlp, const Dvector& params, Dvector& x);
+
+ private:
+  typedef Eigen::SparseMatrix<double> SpMat;
+
+  // F at the solution x_ and lambda_ with nlp's parameters, into f.
+  void Conditions(MPC_NLP& nlp, Eigen::VectorXd& f);
+
+  size_t n_;
+  size_t m_;
+  bool factored_;
+  // The structure of J and W, from nlp.
+  std::vector<Ipopt::Index> jac_rows_;
+  std::vector<Ipopt::Index> jac_cols_;
+  std::vector<Ipopt::Number> jac_values_;
+  std::vector<Ipopt::Index> hes_rows_;
+  std::vector<Ipopt::Index> hes_cols_;
+  std::vector<Ipopt::Number> hes_values_;
+  std::vector<Eigen::Triplet<double> > triplets_;
+  SpMat K_;
+  Eigen::SimplicialLDLT<SpMat, Eigen::Upper> ldlt_;
+  // The solution, and F there with the parameters it was solved for.
+  Dvector x_;
+  Dvector lambda_;
+  Eigen::VectorXd f0_;
+  Eigen::VectorXd f_;
+  Eigen::VectorXd step_;
+  std::vector<Ipopt::Number> g_;
+  std::vector<Ipopt::Number> grad_;
+};
+
+#endif /* SENSITIVITY_H */
@@ -0,0 +1,494 @@
+#include "Session.h"
+#include "AllocationCounter.h"
+#include "Metrics.h"
+#include "Realtime.h"
+#include "Stages.h"
+
+// Room reserved for a reply: a steer message for a 30 step horizon.
+static const size_t COMMAND_CAPACITY = 4096;
+// Recycled commands kept; one being written, one waiting for the event loop
+// and one held back for the latency are all a session needs.
+static const size_t MAX_SPARE_COMMANDS = 4;
+
+std::shared_ptr<Session> Session::Open(
+    uv_loop_t* loop, uWS::WebSocket<uWS::SERVER> ws,
+    FrameScheduler& scheduler, size_t worker,
+    FrameScheduler::Clock::duration period, Setup setup, Preparer prepare,
+    Controller control, Idle idle, Sender send) {
+  std::shared_ptr<Session> session(new Session(loop, ws, scheduler, worker,
+                                               period, setup, prepare,
+                                               control, idle, send));
+#ifdef MPC_COROUTINES
+  if (session->prepare_) {
+    PrepareLoop(session);
+  }
+  Loop(session);
+#else
+  session->self_ = session;
+  session->Schedule(FrameScheduler::Clock::now());
+#endif
+  return session;
+}
+
+Session::Session(uv_loop_t* loop, uWS::WebSocket<uWS::SERVER> ws,
+                 FrameScheduler& scheduler, size_t worker,
+                 FrameScheduler::Clock::duration period, Setup setup,
+                 Preparer prepare, Controller control, Idle idle,
+                 Sender send)
+    : staleAfter(0), timeTriggered(false), drawEvery(0), tierFloor(0),
+      undrawn(0), unpublished(false),
+      checkpointStage(NO_CHECKPOINT), ws(ws), open(true), id(0), cycleTimer(0),
+      sent(false),
+      fd(SocketFd(ws)), scheduler_(scheduler), worker_(worker),
+      period_(period), setup_(setup),
+      prepare_(prepare), control_(control), idle_(idle), send_(send),
+      sequence_(0), answered_(0),
+      posted_(FrameScheduler::Clock::now()), hibernating_(false),
+      hibernate_wanted_(false), hibernated_(false), stale_(0), pending_(0),
+      cpu_nanos_(0), solved_(0), solve_nanos_(0), closing_(false),
+      reported_tapes_(0), reported_workspace_(0), reported_buffers_(0),
+#ifdef MPC_COROUTINES
+      executor_(LoopExecutor::Current(loop)) {
+  spare_.reserve(MAX_SPARE_COMMANDS);
+}
+#else
+      scheduled_(false), prepare_scheduled_(false), closed_(false) {
+  spare_.reserve(MAX_SPARE_COMMANDS);
+  uv_async_init(loop, &command_async_, OnCommand);
+  command_async_.data = this;
+}
+#endif
+
+Session::~Session() {
+  metrics.framesPending.fetch_sub(pending_, std::memory_order_relaxed);
+}
+
+std::unique_ptr<Telemetry> Session::NewFrame() {
+  std::unique_ptr<Telemetry> telemetry = spare_frames_.Take();
+  if (!telemetry) {
+    telemetry.reset(new Telemetry());
+  }
+  return telemetry;
+}
+
+void Session::Post(std::unique_ptr<Telemetry> telemetry) {
+  telemetry->sequence = ++sequence_;
+  posted_ = telemetry->received;
+  hibernating_ = false;
+  hibernate_wanted_ = false;
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  metrics.framesPending.fetch_add(1, std::memory_order_relaxed);
+#ifdef MPC_COROUTINES
+  // Straight to the coroutine, if it waits, which queues the frame's step.
+  if (!(prepare_ ? incoming_ : frames_).Post(std::move(telemetry))) {
+    Replaced();
+  }
+#else
+  if (prepare_) {
+    // Ahead of any solve, since the solve waits on it. Prepared frames go
+    // the same way, so that none overtakes another.
+    FrameScheduler::Clock::time_point deadline = telemetry->received;
+    if (!incoming_.Post(std::move(telemetry))) {
+      Replaced();
+    }
+    SchedulePrepare(deadline);
+    return;
+  }
+  FrameScheduler::Clock::time_point deadline = telemetry->received + period_;
+  if (!frames_.Post(std::move(telemetry))) {
+    Replaced();
+  }
+  if (!timeTriggered) {
+    Schedule(deadline);
+  }
+#endif
+}
+
+void Session::Taken() {
+  pending_.fetch_sub(1, std::memory_order_relaxed);
+  metrics.framesPending.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Session::Replaced() {
+  Taken();
+  metrics.framesReplaced.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Session::Account(uint64_t start) {
+  uint64_t cpu = ThreadCpuNanos() - start;
+  cpu_nanos_.fetch_add(cpu, std::memory_order_relaxed);
+  metrics.sessionCpu.fetch_add(cpu, std::memory_order_relaxed);
+}
+
+#ifdef MPC_COROUTINES
+Task Session::PrepareLoop(std::shared_ptr<Session> self) {
+  Session& s = *self;
+  while (std::unique_ptr<Telemetry> telemetry = co_await s.incoming_.Next()) {
+    if (!telemetry->prepared) {
+      // Without the controller's allocator, which a solve may be using.
+      co_await OnWorker(
+          s.scheduler_, s.worker_, telemetry->received, s.executor_,
+          [&s, &telemetry] {
+            auto prepare = std::chrono::steady_clock::now();
+            uint64_t cpu = ThreadCpuNanos();
+            s.prepare_(s, *telemetry);
+            s.Account(cpu);
+            RecordStage(STAGE_PREPARE, prepare);
+          });
+      if (s.closing_) {
+        break;
+      }
+    }
+    if (!s.frames_.Post(std::move(telemetry))) {
+      s.Replaced();
+    }
+  }
+}
+
+Task Session::Loop(std::shared_ptr<Session> self) {
+  Session& s = *self;
+  co_await s.OnController(FrameScheduler::Clock::now(), [&s] {
+    uint64_t cpu = ThreadCpuNanos();
+    s.setup_(s);
+    s.setup_ = nullptr;
+    s.Account(cpu);
+  });
+  while (std::unique_ptr<Telemetry> telemetry = co_await s.frames_.Next()) {
+    s.Taken();
+    FrameScheduler::Clock::time_point deadline =
+        telemetry->received + s.period_;
+    std::unique_ptr<Command> command;
+    co_await s.OnController(deadline, [&s, &telemetry, &command] {
+      command = s.Solve(*telemetry);
+    });
+    s.spare_frames_.Post(std::move(telemetry));
+    if (!command) {
+      continue;
+    }
+    if (s.open) {
+      s.send_(s, std::move(command));
+    }
+    co_await s.OnController(deadline, [&s] {
+      uint64_t cpu = ThreadCpuNanos();
+      s.idle_(s);
+      s.Account(cpu);
+    });
+  }
+  // After the last frame's steps, which were awaited.
+  co_await s.OnController(FrameScheduler::Clock::now(), [&s] { s.Release(); });
+}
+#else
+void Session::Schedule(FrameScheduler::Clock::time_point deadline) {
+  if (!scheduled_.exchange(true)) {
+    std::shared_ptr<Session> self = shared_from_this();
+    scheduler_.Submit(worker_, deadline, [self] { self->Run(); });
+  }
+}
+
+void Session::Tick(FrameScheduler::Clock::time_point due) {
+  if (closing_) {
+    return;
+  }
+  if (frames_.empty()) {
+    metrics.cyclesIdle.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // The last cycle's solve overran into this one's period.
+  if (scheduled_.exchange(true)) {
+    metrics.cyclesMissed.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  metrics.cyclesRun.fetch_add(1, std::memory_order_relaxed);
+  std::shared_ptr<Session> self = shared_from_this();
+  scheduler_.Submit(worker_, due + period_, [self] { self->Run(); });
+}
+
+void Session::Hibernate() {
+  hibernating_ = true;
+  spare_frames_.Take();
+  {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    spare_.clear();
+    spare_.shrink_to_fit();
+  }
+  ReportBuffers();
+  hibernate_wanted_ = true;
+  Schedule(FrameScheduler::Clock::now());
+}
+
+void Session::SchedulePrepare(FrameScheduler::Clock::time_point deadline) {
+  if (!prepare_scheduled_.exchange(true)) {
+    std::shared_ptr<Session> self = shared_from_this();
+    scheduler_.Submit(worker_, deadline, [self] { self->PrepareRun(); });
+  }
+}
+
+void Session::PrepareRun() {
+  for (;;) {
+    while (!closing_) {
+      std::unique_ptr<Telemetry> telemetry = incoming_.Take();
+      if (!telemetry) {
+        break;
+      }
+      if (!telemetry->prepared) {
+        auto prepare = std::chrono::steady_clock::now();
+        uint64_t cpu = ThreadCpuNanos();
+        prepare_(*this, *telemetry);
+        Account(cpu);
+        RecordStage(STAGE_PREPARE, prepare);
+      }
+      FrameScheduler::Clock::time_point deadline =
+          telemetry->received + period_;
+      if (!frames_.Post(std::move(telemetry))) {
+        Replaced();
+      }
+      if (!timeTriggered) {
+        Schedule(deadline);
+      }
+    }
+    // As in Run.
+    prepare_scheduled_ = false;
+    if (incoming_.empty() || closing_ || prepare_scheduled_.exchange(true)) {
+      return;
+    }
+  }
+}
+#endif
+
+void Session::Close() {
+  open = false;
+  metrics.bufferBytes.fetch_sub(reported_buffers_, std::memory_order_relaxed);
+  reported_buffers_ = 0;
+#ifdef MPC_COROUTINES
+  // The coroutines find the channels closed once they are done with the
+  // frame they have, and Loop releases the controller.
+  closing_ = true;
+  incoming_.Close();
+  frames_.Close();
+#else
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    closed_ = true;
+  }
+  uv_close(reinterpret_cast<uv_handle_t*>(&command_async_),
+           [](uv_handle_t* handle) {
+             static_cast<Session*>(handle->data)->self_.reset();
+           });
+  // After any frame still being solved.
+  closing_ = true;
+  Schedule(FrameScheduler::Clock::now());
+#endif
+}
+
+#ifndef MPC_COROUTINES
+void Session::Run() {
+  MPC::Allocator::Scope scope(allocator_);
+  if (setup_) {
+    uint64_t cpu = ThreadCpuNanos();
+    setup_(*this);
+    setup_ = nullptr;
+    Account(cpu);
+  }
+  for (;;) {
+    while (!closing_) {
+      std::unique_ptr<Telemetry> telemetry = frames_.Take();
+      if (!telemetry) {
+        break;
+      }
+      Taken();
+      std::unique_ptr<Command> command = Solve(*telemetry);
+      spare_frames_.Post(std::move(telemetry));
+      if (!command) {
+        continue;
+      }
+      commands_.Post(std::move(command));
+      {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        if (!closed_) {
+          uv_async_send(&command_async_);
+        }
+      }
+      uint64_t cpu = ThreadCpuNanos();
+      idle_(*this);
+      Account(cpu);
+      // A frame that came meanwhile waits for the next cycle.
+      if (timeTriggered) {
+        break;
+      }
+    }
+    if (closing_) {
+      Release();
+      return;
+    }
+    if (hibernate_wanted_.exchange(false) && frames_.empty() && controller) {
+      uint64_t cpu = ThreadCpuNanos();
+      hibernate(*this);
+      Release();
+      // The controller's memory, held for reuse by its allocator, goes
+      // back to the heap.
+      MPC::FreeThreadMemory();
+      ReportMemory();
+      Account(cpu);
+      hibernated_ = true;
+      metrics.sessionsHibernated.fetch_add(1, std::memory_order_relaxed);
+      metrics.hibernationBytes.fetch_add(hibernation.size(),
+                                         std::memory_order_relaxed);
+      metrics.hibernations.fetch_add(1, std::memory_order_relaxed);
+    }
+    // A frame posted, a Close or a Hibernate, after the last look found
+    // scheduled_ still set and didn't queue another Run, so look again
+    // before leaving.
+    scheduled_ = false;
+    if (((timeTriggered || frames_.empty()) && !closing_ &&
+         !hibernate_wanted_) ||
+        scheduled_.exchange(true)) {
+      return;
+    }
+  }
+}
+#endif
+
+std::unique_ptr<Command> Session::Solve(const Telemetry& telemetry) {
+  // Overtaken by a frame already answered, or too old to act on.
+  if (telemetry.sequence <= answered_ ||
+      (staleAfter > FrameScheduler::Clock::duration::zero() &&
+       FrameScheduler::Clock::now() - telemetry.received > staleAfter)) {
+    stale_.fetch_add(1, std::memory_order_relaxed);
+    metrics.framesStale.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  answered_ = telemetry.sequence;
+  if (hibernated_) {
+    metrics.hibernationBytes.fetch_sub(hibernation.size(),
+                                       std::memory_order_relaxed);
+    uint64_t cpu = ThreadCpuNanos();
+    wake(*this);
+    Account(cpu);
+    hibernated_ = false;
+    metrics.sessionsHibernated.fetch_sub(1, std::memory_order_relaxed);
+    metrics.wakeups.fetch_add(1, std::memory_order_relaxed);
+  }
+  std::unique_ptr<Command> command = NewCommand();
+  command->received = telemetry.received;
+  command->binary = telemetry.binary;
+  uint64_t allocations = ThreadAllocations();
+  uint64_t preemptions = ThreadPreemptions();
+  uint64_t cpu = ThreadCpuNanos();
+  auto start = FrameScheduler::Clock::now();
+  control_(*this, telemetry, command->msg);
+  solve_nanos_.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          FrameScheduler::Clock::now() - start).count(),
+      std::memory_order_relaxed);
+  solved_.fetch_add(1, std::memory_order_relaxed);
+  Account(cpu);
+  preemptions = ThreadPreemptions() - preemptions;
+  if (preemptions > 0) {
+    metrics.preemptions.fetch_add(preemptions, std::memory_order_relaxed);
+    metrics.preemptedFrames.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (CountingAllocations()) {
+    metrics.frameAllocations.fetch_add(ThreadAllocations() - allocations,
+                                       std::memory_order_relaxed);
+    metrics.allocationFrames.fetch_add(1, std::memory_order_relaxed);
+  }
+  ReportMemory();
+  return command;
+}
+
+void Session::Release() {
+  metrics.tapeBytes.fetch_sub(reported_tapes_, std::memory_order_relaxed);
+  metrics.workspaceBytes.fetch_sub(reported_workspace_,
+                                   std::memory_order_relaxed);
+  reported_tapes_ = 0;
+  reported_workspace_ = 0;
+  if (hibernated_) {
+    hibernated_ = false;
+    metrics.sessionsHibernated.fetch_sub(1, std::memory_order_relaxed);
+    metrics.hibernationBytes.fetch_sub(hibernation.size(),
+                                       std::memory_order_relaxed);
+  }
+  speculator.reset();
+  controller.reset();
+}
+
+std::unique_ptr<Command> Session::NewCommand() {
+  {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    if (!spare_.empty()) {
+      std::unique_ptr<Command> command = std::move(spare_.back());
+      spare_.pop_back();
+      return command;
+    }
+  }
+  std::unique_ptr<Command> command(new Command());
+  command->msg.reserve(COMMAND_CAPACITY);
+  return command;
+}
+
+void Session::Recycle(std::unique_ptr<Command> command) {
+  {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    if (spare_.size() < MAX_SPARE_COMMANDS) {
+      spare_.push_back(std::move(command));
+    }
+  }
+  ReportBuffers();
+}
+
+void Session::ReportMemory() {
+  size_t thread, inuse, available;
+  MPC::ThreadMemory(thread, inuse, available);
+  if (thread < size_t(Metrics::THREADS)) {
+    metrics.cppadInuse[thread].store(inuse, std::memory_order_relaxed);
+    metrics.cppadAvailable[thread].store(available,
+                                         std::memory_order_relaxed);
+  }
+  if (!controller) {
+    return;
+  }
+  int64_t tapes = controller->mpc().tapeBytes();
+  int64_t workspace = controller->mpc().workspaceBytes();
+  metrics.tapeBytes.fetch_add(tapes - reported_tapes_,
+                              std::memory_order_relaxed);
+  metrics.workspaceBytes.fetch_add(workspace - reported_workspace_,
+                                   std::memory_order_relaxed);
+  reported_tapes_ = tapes;
+  reported_workspace_ = workspace;
+}
+
+void Session::ReportBuffers() {
+  if (!open) {
+    return;
+  }
+  int64_t bytes = arena.capacity();
+  {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    for (const std::unique_ptr<Command>& command : spare_) {
+      bytes += command->msg.capacity();
+    }
+  }
+  metrics.bufferBytes.fetch_add(bytes - reported_buffers_,
+                                std::memory_order_relaxed);
+  reported_buffers_ = bytes;
+}
+
+int SocketFd(uWS::WebSocket<uWS::SERVER> ws) {
+  uv_os_fd_t fd;
+  if (uv_fileno(reinterpret_cast<uv_handle_t*>(ws.getPollHandle()), &fd) !=
+      0) {
+    return -1;
+  }
+  return fd;
+}
+
+#ifndef MPC_COROUTINES
+void Session::OnCommand(uv_async_t* handle) {
+  Session* self = static_cast<Session*>(handle->data);
+  while (std::unique_ptr<Command> command = self->commands_.Take()) {
+    if (self->open) {
+      self->send_(*self, std::move(command));
+    }
+  }
+}
+#endif
@@ -0,0 +1,360 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <uWS/uWS.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "Controller.h"
+#include "FrameScheduler.h"
+#include "LatencyEstimator.h"
+#include "MPC.h"
+#include "Mailbox.h"
+#include "Published.h"
+#include "SloTracker.h"
+#include "Speculator.h"
+#include "Telemetry.h"
+#include "TrackMap.h"
+#include "TrajectoryCodec.h"
+#include "WaypointFit.h"
+#ifdef MPC_COROUTINES
+#include "Coroutine.h"
+#endif
+
+// One simulator connection: its controller, and the plumbing that gets its
+// frames to a worker and its commands back to the event loop.
+//
+// Telemetry goes to the worker through a latest-wins Mailbox: a frame that
+// arrives while the session is being solved replaces any frame still
+// waiting, since only the newest one is worth solving. Frames are numbered
+// as they are posted, and one that comes up for its solve after a later
+// one was answered, or older than staleAfter, is dropped too, so that an
+// overloaded session skips frames rather than falling behind. The session
+// is queued on the FrameScheduler at most once at a time, due a control
+// period after its frame arrived, so its controller is only ever used by
+// one thread at a time; that is its worker's, unless another worker ran out
+// of frames and stole it. The controller's CppAD memory goes with it, see
+// MPC::Allocator. Setting up and releasing the controller are queued the
+// same way, so they come before the first frame and after the last.
+// With a Preparer, each frame is fitted and its state predicted in a task
+// of its own first, due when the frame arrived, and then handed on through
+// another such mailbox: a frame's preparation runs on an idle worker while
+// the frame before it is still being solved.
+// Commands come back through a second mailbox and a uv_async_t on the event
+// loop, where `send` is called. Sent commands are recycled, so that once a
+// session is running the replies are written into buffers it already has.
+//
+// Built with MPC_COROUTINES, the same steps are two coroutines on the event
+// loop instead, see Coroutine.h: one waits for a frame in a latest-wins
+// Channel, awaits its solve on the session's worker, sends the reply
+// straight from the loop and awaits the Idle work, and the other, with a
+// Preparer, awaits each frame's preparation ahead of it. Each step is still
+// a FrameScheduler task with the same deadline, so the scheduling and the
+// stealing are as above; what goes is the hand-offs between the steps.
+//
+// Time-triggered, without MPC_COROUTINES, a frame only waits in the
+// mailbox and the solve is queued by Tick() instead, once each control
+// period from a PeriodicExecutor: each cycle solves the newest frame that
+// came since the last, due a period after its tick.
+//
+// A session whose vehicle has sent nothing for a while can be hibernated,
+// also without MPC_COROUTINES: once no frame waits, its worker has
+// `hibernate` write what the controller goes on from into a checkpoint and
+// lets the controller go with the memory it held, and the next frame has
+// `wake` build it again from the checkpoint before its solve.
+class Session : public std::enable_shared_from_this<Session> {
+ public:
+  // Build the controller; called on a worker before the first frame.
+  typedef std::function<void(Session&)> Setup;
+  // Get a frame ready for its solve ahead of it; called on a worker, one
+  // frame at a time, maybe while the controller solves another.
+  typedef std::function<void(Session&, Telemetry&)> Preparer;
+  // Write the reply to one frame into `msg`; called on a worker.
+  typedef std::function<void(Session&, const Telemetry&, std::string& msg)>
+      Controller;
+  // Work between frames, after a reply is handed back; on a worker.
+  typedef std::function<void(Session&)> Idle;
+  // Deliver a reply, and Recycle() it once sent; called on the event loop
+  // thread.
+  typedef std::function<void(Session&, std::unique_ptr<Command>)> Sender;
+
+  // Starts a session on `worker` of `scheduler`, its frames due `period`
+  // after they arrive; event loop thread. An empty `prepare` leaves the
+  // frames whole to `control`. It lives until Close(), and after that as
+  // long as a task still holds it.
+  static std::shared_ptr<Session> Open(uv_loop_t* loop,
+                                       uWS::WebSocket<uWS::SERVER> ws,
+                                       FrameScheduler& scheduler,
+                                       size_t worker,
+                                       FrameScheduler::Clock::duration period,
+                                       Setup setup, Preparer prepare,
+                                       Controller control, Idle idle,
+                                       Sender send);
+  // Takes the frames still waiting out of the metrics.
+  ~Session();
+
+  // A frame to fill for Post(), reusing one the worker is done with if there
+  // is one; event loop thread.
+  std::unique_ptr<Telemetry> NewFrame();
+
+  // Hand a frame to the worker, through the Preparer if there is one;
+  // event loop thread.
+  void Post(std::unique_ptr<Telemetry> telemetry);
+
+  // Stop delivering commands, and release the controller on a worker;
+  // event loop thread.
+  void Close();
+
+  // Return a sent command, so that the next reply is written into its buffer
+  // instead of a new one; event loop thread.
+  void Recycle(std::unique_ptr<Command> command);
+
+#ifndef MPC_COROUTINES
+  // Start a time-triggered cycle that was `due`: queue the solve of the
+  // waiting frame, if there is one and the last cycle is done; from the
+  // PeriodicExecutor's thread.
+  void Tick(FrameScheduler::Clock::time_point due);
+
+  // Drop the spare buffers and hibernate the controller on the worker,
+  // unless a frame comes first; event loop thread, with `hibernate` set.
+  void Hibernate();
+#endif
+  // Whether Hibernate() was called since the last Post(), and when that
+  // frame, or else the session, came; event loop thread.
+  bool hibernating() const { return hibernating_; }
+  FrameScheduler::Clock::time_point lastPosted() const { return posted_; }
+
+#ifdef MPC_COROUTINES
+  typedef Channel<Telemetry> FrameQueue;
+#else
+  typedef Mailbox<Telemetry> FrameQueue;
+#endif
+
+  // Frames replaced by newer ones before the worker got to them, frames
+  // dropped as stale, and frames waiting.
+  unsigned long dropped() const {
+    return incoming_.dropped() + frames_.dropped();
+  }
+  unsigned long stale() const { return stale_.load(std::memory_order_relaxed); }
+  int64_t pending() const { return pending_.load(std::memory_order_relaxed); }
+  // The worker the session was placed on; others may steal its frames.
+  size_t worker() const { return worker_; }
+  // The CPU time of its steps on the workers, setting up and preparing
+  // included, and the frames solved and the time their solves took; read
+  // from any thread, as a session's share of the node.
+  double cpuSeconds() const {
+    return 1e-9 * cpu_nanos_.load(std::memory_order_relaxed);
+  }
+  uint64_t solved() const { return solved_.load(std::memory_order_relaxed); }
+  double solveSeconds() const {
+    return 1e-9 * solve_nanos_.load(std::memory_order_relaxed);
+  }
+
+  // The controller, built by Setup and only touched by the running task.
+  std::unique_ptr<::Controller> controller;
+  std::unique_ptr<Speculator> speculator;
+  // The Preparer's, left to it to build; only touched by the preparing
+  // task.
+  std::unique_ptr<WaypointFit> prepareFit;
+  // The solver profile the connection asked for, the track and tuning the
+  // controller was built on, and the track the Preparer fits to; each only
+  // touched by the task that uses it.
+  std::string profile;
+  Published<TrackMap>::Reader track;
+  Published<MpcConfig>::Reader tuning;
+  Published<TrackMap>::Reader prepareTrack;
+  // A frame that has waited longer than this for its solve is dropped
+  // instead; zero solves every frame that isn't replaced. Set before the
+  // first Post.
+  FrameScheduler::Clock::duration staleAfter;
+  // Whether frames are solved on Tick() rather than as they come; set
+  // before the first Post.
+  bool timeTriggered;
+  // Checkpoint the controller into `hibernation` before it is let go, and
+  // build it again from there; on the worker. Set before the first Post.
+  Setup hibernate;
+  Setup wake;
+  std::string hibernation;
+  // Replies carry the lines a viewer draws once in this many frames, and
+  // only the actuations otherwise; 0 never. Set on the event loop thread,
+  // when a viewer asks.
+  std::atomic<unsigned> drawEvery;
+  // The DegradationLadder::Tier admission control holds the controller to,
+  // see AdmissionControl; FULL_NMPC for none. Set on the event loop, and
+  // cleared by the worker once the node has room again.
+  std::atomic<int> tierFloor;
+  // Replies since the last that carried the lines; worker only.
+  unsigned undrawn;
+  // The output of the last frame solved, and whether it is yet to go to the
+  // dashboards; worker only.
+  ::Controller::Output output;
+  bool unpublished;
+  // Its trajectories for the compact dashboards; worker only.
+  TrajectoryEncoder dashboardEncoder;
+  // A checkpoint for handing the session over, see Handoffs, in
+  // `checkpoint`: wanted once asked for, with the latency estimates once
+  // the event loop has written them, and taken once the worker has added
+  // the controller's state. Changed under checkpointMutex, and read without
+  // it to skip the mutex while no checkpoint is wanted.
+  enum CheckpointStage {
+    NO_CHECKPOINT,
+    CHECKPOINT_WANTED,
+    CHECKPOINT_LATENCIES,
+    CHECKPOINT_TAKEN
+  };
+  std::atomic<int> checkpointStage;
+  std::mutex checkpointMutex;
+  std::string checkpoint;
+
+  // Event loop thread only.
+  uWS::WebSocket<uWS::SERVER> ws;
+  bool open;
+  // Numbers the connection in recorded frames, see FrameRecorder.
+  unsigned id;
+  // The key it may be handed over to another server by, or empty.
+  std::string handoffKey;
+  // Its timer on the PeriodicExecutor when time-triggered, or 0.
+  uint64_t cycleTimer;
+  // From receipt of a frame until its command goes out, and from a command
+  // going out until the next frame arrives.
+  LatencyEstimator response;
+  LatencyEstimator roundTrip;
+  std::chrono::steady_clock::time_point lastSent;
+  bool sent;
+  // Its service level objectives; set once it is numbered.
+  std::unique_ptr<SloTracker> slo;
+  // Holds the json DOM of the frame being parsed, see ParseTelemetryJson.
+  Arena arena;
+  // The connection's socket.
+  int fd;
+
+ private:
+  Session(uv_loop_t* loop, uWS::WebSocket<uWS::SERVER> ws,
+          FrameScheduler& scheduler, size_t worker,
+          FrameScheduler::Clock::duration period, Setup setup,
+          Preparer prepare, Controller control, Idle idle, Sender send);
+
+#ifdef MPC_COROUTINES
+  // The controller's allocator around `step`, as the step of a coroutine.
+  template <class Step>
+  struct Scoped {
+    MPC::Allocator& allocator;
+    Step step;
+    void operator()() {
+      MPC::Allocator::Scope scope(allocator);
+      step();
+    }
+  };
+  // Run `step` on the session's worker, with the controller's allocator,
+  // due by `deadline`: co_await OnController(...).
+  template <class Step>
+  OnWorker<Scoped<Step> > OnController(
+      FrameScheduler::Clock::time_point deadline, Step step) {
+    return OnWorker<Scoped<Step> >(scheduler_, worker_, deadline, executor_,
+                                   Scoped<Step>{allocator_, std::move(step)});
+  }
+  // Set up the controller, solve the frames as they come and release the
+  // controller once closed; started by Open and holding the session.
+  static Task Loop(std::shared_ptr<Session> self);
+  // Prepare the incoming frames and hand them on to Loop.
+  static Task PrepareLoop(std::shared_ptr<Session> self);
+#else
+  // Queue Run, due by `deadline`, unless it already is.
+  void Schedule(FrameScheduler::Clock::time_point deadline);
+  // Queue PrepareRun the same way.
+  void SchedulePrepare(FrameScheduler::Clock::time_point deadline);
+  // Prepare the incoming frames and hand them on to Run; on a worker.
+  void PrepareRun();
+  // Set up the controller if it isn't, solve the waiting frames, and
+  // release the controller once closing; on a worker.
+  void Run();
+#endif
+  // Count a frame taken from the mailboxes, and one a Post replaced.
+  void Taken();
+  void Replaced();
+  // Count the CPU time since ThreadCpuNanos() was `start` as the session's.
+  void Account(uint64_t start);
+  // The command answering `telemetry`, or null if it was overtaken by a
+  // frame already answered or is too old to act on; on a worker.
+  std::unique_ptr<Command> Solve(const Telemetry& telemetry);
+  void Release();
+  // Put the controller's memory and its CppAD allocator in the
+  // metrics after a frame, and the buffers' after a reply is recycled; the
+  // session's share is taken back out on Close().
+  void ReportMemory();
+  void ReportBuffers();
+  // A command to write a reply into, from the recycled ones if there is one;
+  // on the worker.
+  std::unique_ptr<Command> NewCommand();
+
+  FrameScheduler& scheduler_;
+  size_t worker_;
+  FrameScheduler::Clock::duration period_;
+  // Until it has run.
+  Setup setup_;
+  Preparer prepare_;
+  Controller control_;
+  Idle idle_;
+  Sender send_;
+
+  // Frames waiting for the Preparer, and for the controller.
+  FrameQueue incoming_;
+  FrameQueue frames_;
+  // The last frame's number, on the event loop, and the last answered's, by
+  // the running task.
+  uint64_t sequence_;
+  uint64_t answered_;
+  // Event loop thread only.
+  FrameScheduler::Clock::time_point posted_;
+  bool hibernating_;
+  // Whether the controller is to be hibernated, and whether it is; the
+  // latter by the running task.
+  std::atomic<bool> hibernate_wanted_;
+  bool hibernated_;
+  std::atomic<unsigned long> stale_;
+  std::atomic<int64_t> pending_;
+  std::atomic<uint64_t> cpu_nanos_;
+  std::atomic<uint64_t> solved_;
+  std::atomic<uint64_t> solve_nanos_;
+  // A solved frame, handed back for NewFrame().
+  Mailbox<Telemetry> spare_frames_;
+  // Sent commands, with their buffers.
+  std::vector<std::unique_ptr<Command> > spare_;
+  std::mutex spare_mutex_;
+  // Whether the controller is to be released once its frame is done.
+  std::atomic<bool> closing_;
+  // The controller's, wherever it runs.
+  MPC::Allocator allocator_;
+  // What the session last put in the memory metrics: on the worker, and on
+  // the event loop.
+  int64_t reported_tapes_;
+  int64_t reported_workspace_;
+  int64_t reported_buffers_;
+
+#ifdef MPC_COROUTINES
+  // Resumes the coroutines on the event loop.
+  LoopExecutor& executor_;
+#else
+  // Whether Run is queued or running, and PrepareRun too.
+  std::atomic<bool> scheduled_;
+  std::atomic<bool> prepare_scheduled_;
+  Mailbox<Command> commands_;
+  static void OnCommand(uv_async_t* handle);
+  uv_async_t command_async_;
+  // Guards command_async_ against being signalled once it is closing.
+  std::mutex async_mutex_;
+  bool closed_;
+  // The event loop's reference, dropped once command_async_ is closed.
+  std::shared_ptr<Session> self_;
+#endif
+};
+
+// The socket under `ws`, for its TCP options; -1 if there is none.
+int SocketFd(uWS::WebSocket<uWS::SERVER> ws);
+
+#endif /* SESSION_H */
@@ -0,0 +1,146 @@
+#include "ShadowEvaluator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include "Metrics.h"
+#include "Realtime.h"
+
+ShadowEvaluator::ShadowEvaluator(Factory factory, const Options& options)
+    : factory_(factory), options_(options), offered_(0), stopping_(false) {
+  options_.threads = std::max<size_t>(options_.threads, 1);
+  options_.queue = std::max<size_t>(options_.queue, 1);
+  for (size_t i = 0; i < options_.threads; i++) {
+    threads_.emplace_back(new Thread);
+    threads_.back()->frames.resize(options_.queue);
+    threads_.back()->head = 0;
+    threads_.back()->count = 0;
+  }
+  for (size_t i = 0; i < threads_.size(); i++) {
+    threads_[i]->thread = std::thread(&ShadowEvaluator::Run, this, i);
+  }
+}
+
+ShadowEvaluator::~ShadowEvaluator() {
+  stopping_ = true;
+  for (const std::unique_ptr<Thread>& thread : threads_) {
+    std::lock_guard<std::mutex> lock(thread->mutex);
+    thread->ready.notify_one();
+  }
+  for (const std::unique_ptr<Thread>& thread : threads_) {
+    thread->thread.join();
+  }
+}
+
+bool ShadowEvaluator::Sampled(uint64_t k) const {
+  // Every frame where the running count of samples steps up.
+  return uint64_t((k + 1) * options_.fraction) >
+         uint64_t(k * options_.fraction);
+}
+
+bool ShadowEvaluator::Offer(uint64_t session, const Telemetry& t,
+                            const Controller::Output& live, double seconds) {
+  if (!Sampled(offered_.fetch_add(1, std::memory_order_relaxed))) {
+    return false;
+  }
+  Thread& thread = *threads_[session % threads_.size()];
+  std::unique_lock<std::mutex> lock(thread.mutex, std::try_to_lock);
+  if (!lock.owns_lock() || thread.count == thread.frames.size()) {
+    metrics.shadowDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  Frame& frame =
+      thread.frames[(thread.head + thread.count) % thread.frames.size()];
+  thread.count++;
+  frame.session = session;
+  frame.t = t;
+  frame.t.prepared = true;
+  std::copy(live.reference, live.reference + 4, frame.t.coeffs);
+  std::copy(live.state, live.state + 6, frame.t.state);
+  frame.steering = live.steering;
+  frame.throttle = live.throttle;
+  frame.seconds = seconds;
+  lock.unlock();
+  thread.ready.notify_one();
+  return true;
+}
+
+void ShadowEvaluator::Close(uint64_t session) {
+  Thread& thread = *threads_[session % threads_.size()];
+  std::lock_guard<std::mutex> lock(thread.mutex);
+  thread.closed.push_back(session);
+  thread.ready.notify_one();
+}
+
+void ShadowEvaluator::Run(size_t index) {
+  if (!options_.cpus.empty() &&
+      !PinThread(options_.cpus[index % options_.cpus.size()])) {
+    std::cerr << "Failed to pin shadow thread " << index << std::endl;
+  }
+  if (!SetIdlePriority()) {
+    std::cerr << "Failed to lower the priority of shadow thread " << index
+              << std::endl;
+  }
+  Thread& thread = *threads_[index];
+  std::unordered_map<uint64_t, std::unique_ptr<Controller> > candidates;
+  std::unique_ptr<Frame> frame(new Frame);
+  std::unique_ptr<Controller::Output> out(new Controller::Output);
+  std::vector<uint64_t> closed;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(thread.mutex);
+      thread.ready.wait(lock, [&]() {
+        return stopping_ || thread.count > 0 || !thread.closed.empty();
+      });
+      if (stopping_) {
+        break;
+      }
+      // Closes wait for the frames queued before them.
+      if (thread.count == 0) {
+        closed.swap(thread.closed);
+      } else {
+        *frame = thread.frames[thread.head];
+        thread.head = (thread.head + 1) % thread.frames.size();
+        thread.count--;
+      }
+    }
+    if (!closed.empty()) {
+      for (uint64_t session : closed) {
+        candidates.erase(session);
+      }
+      closed.clear();
+      continue;
+    }
+
+    std::unique_ptr<Controller>& candidate = candidates[frame->session];
+    if (!candidate) {
+      candidate = factory_();
+      candidate->SetCounted(false);
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t cpu = ThreadCpuNanos();
+    candidate->Step(
+        frame->t,
+        start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(options_.budget)),
+        *out);
+    cpu = ThreadCpuNanos() - cpu;
+    // At idle priority the wall time counts the waits for a core; the CPU
+    // time is what the solve would take on one of its own.
+    double seconds = cpu > 0 ? 1e-9 * cpu : candidate->mpc().stats().seconds;
+
+    double steering = std::fabs(out->steering - frame->steering);
+    double throttle = std::fabs(out->throttle - frame->throttle);
+    metrics.shadowFrames.fetch_add(1, std::memory_order_relaxed);
+    metrics.shadowSteeringError.fetch_add(
+        uint64_t(std::llround(1e6 * steering)), std::memory_order_relaxed);
+    metrics.shadowThrottleError.fetch_add(
+        uint64_t(std::llround(1e6 * throttle)), std::memory_order_relaxed);
+    if (!(steering <= options_.tolerance && throttle <= options_.tolerance)) {
+      metrics.shadowDisagreements.fetch_add(1, std::memory_order_relaxed);
+    }
+    metrics.shadowLive.Record(frame->seconds);
+    metrics.shadowCandidate.Record(seconds);
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef SHADOW_EVALUATOR_H
+#define SHADOW_EVALUATOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Controller.h"
+#include "Telemetry.h"
+
+// A candidate solver engine run in the shadow of the live one, to see how it
+// would do before the sessions are switched to it: a sampled fraction of the
+// frames the live controllers answer is solved again by a candidate
+// controller, and its actuations are compared with those sent, into the
+// metrics, but never sent themselves.
+//
+// The candidate solves exactly the live solve's problem: the frame, with
+// the live solve's reference and predicted state, as if prepared ahead.
+// Each session gets a candidate of its own on the first of its frames
+// sampled, so its warm starts come from its earlier samples only.
+//
+// The control path never waits on it. Offer() takes a frame only when the
+// lock is free and there is room in the queue, and drops it otherwise; the
+// threads run under SCHED_IDLE, or at nice 19, pinned to spare cores if
+// given, so that they only get a core none of the workers wants. A
+// session's frames all go to one thread, which builds, steps and frees its
+// candidate, so that the candidate's CppAD memory stays with that thread.
+// The hardware counts of PerfCounters.h are by stage, not by thread, and
+// include the candidates' solves.
+class ShadowEvaluator {
+ public:
+  typedef std::function<std::unique_ptr<Controller>()> Factory;
+
+  struct Options {
+    Options()
+        : fraction(0.1), threads(1), queue(16), tolerance(0.01), budget(1) {}
+    // Of the frames offered, the fraction sampled, spread evenly.
+    double fraction;
+    size_t threads;
+    // Frames waiting on each thread; past these, frames are dropped.
+    size_t queue;
+    // How far apart the steering, in radians, or the throttle can be before
+    // the engines disagree on a frame.
+    double tolerance;
+    // Seconds a candidate's solve may take, its deadline.
+    double budget;
+    // Cores for the threads, one each in turn; any if empty.
+    std::vector<int> cpus;
+  };
+
+  // Candidates are built by `factory`, on the threads.
+  ShadowEvaluator(Factory factory, const Options& options);
+  // Drops the frames still queued and joins the threads.
+  ~ShadowEvaluator();
+
+  ShadowEvaluator(const ShadowEvaluator&) = delete;
+  ShadowEvaluator& operator=(const ShadowEvaluator&) = delete;
+
+  // Frame `t` of `session`, answered by the live engine with `live` in
+  // `seconds` of solve. True if it was sampled and taken. Never blocks.
+  bool Offer(uint64_t session, const Telemetry& t,
+             const Controller::Output& live, double seconds);
+  // Free the candidate of `session`, once its queued frames are done.
+  void Close(uint64_t session);
+
+ private:
+  struct Frame {
+    uint64_t session;
+    Telemetry t;
+    double steering;
+    double throttle;
+    double seconds;
+  };
+  struct Thread {
+    std::mutex mutex;
+    std::condition_variable ready;
+    // A ring of options.queue frames, `count` of them from `head`.
+    std::vector<Frame> frames;
+    size_t head;
+    size_t count;
+    std::vector<uint64_t> closed;
+    std::thread thread;
+  };
+
+  void Run(size_t index);
+  // Whether the `k`th frame offered is sampled.
+  bool Sampled(uint64_t k) const;
+
+  Factory factory_;
+  Options options_;
+  std::vector<std::unique_ptr<Thread> > threads_;
+  std::atomic<uint64_t> offered_;
+  std::atomic<bool> stopping_;
+};
+
+#endif /* SHADOW_EVALUATOR_H */
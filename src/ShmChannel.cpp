@@ -0,0 +1,181 @@
+#include "ShmChannel.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+static const uint32_t MAGIC = 0x4d504353;  // "MPCS"
+static const uint32_t VERSION = 1;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "the sequence is a plain futex word");
+
+#ifdef __linux__
+
+// Not FUTEX_PRIVATE_FLAG: the word is shared between processes.
+static void Wait(std::atomic<uint32_t>& word, uint32_t value,
+                 std::chrono::nanoseconds timeout) {
+  timespec ts;
+  ts.tv_sec = timeout.count() / 1000000000;
+  ts.tv_nsec = timeout.count() % 1000000000;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value,
+          &ts, nullptr, 0);
+}
+
+static void Wake(std::atomic<uint32_t>& word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX,
+          nullptr, nullptr, 0);
+}
+
+#else
+
+static void Wait(std::atomic<uint32_t>&, uint32_t,
+                 std::chrono::nanoseconds timeout) {
+  std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(
+      timeout, std::chrono::microseconds(50)));
+}
+
+static void Wake(std::atomic<uint32_t>&) {}
+
+#endif
+
+ShmChannel::ShmChannel() : region_(nullptr), created_(false) {
+  for (int d = 0; d < 2; d++) {
+    seen_[d] = 0;
+    read_[d] = 0;
+    skipped_[d] = 0;
+  }
+}
+
+ShmChannel::~ShmChannel() { Close(); }
+
+void ShmChannel::Close() {
+  if (region_) {
+    munmap(region_, sizeof(Region));
+    region_ = nullptr;
+  }
+  if (created_) {
+    shm_unlink(name_.c_str());
+    created_ = false;
+  }
+}
+
+bool ShmChannel::Create(const std::string& name) {
+  Close();
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  void* memory = MAP_FAILED;
+  if (ftruncate(fd, sizeof(Region)) == 0) {
+    memory = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+  // Fresh pages are zeros: both slots empty at sequence 0. The magic goes
+  // last, so a bridge never attaches to a region half set up.
+  region_ = static_cast<Region*>(memory);
+  region_->version = VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  region_->magic = MAGIC;
+  name_ = name;
+  created_ = true;
+  return true;
+}
+
+bool ShmChannel::Attach(const std::string& name) {
+  Close();
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void* memory = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Region)) {
+    memory = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  region_ = static_cast<Region*>(memory);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (region_->magic != MAGIC || region_->version != VERSION) {
+    Close();
+    return false;
+  }
+  // Only what is written from now on is news to this side.
+  for (int d = 0; d < 2; d++) {
+    Slot& slot = region_->slots[d];
+    seen_[d] = slot.sequence.load(std::memory_order_acquire) & ~1u;
+    read_[d] = slot.written;
+  }
+  name_ = name;
+  return true;
+}
+
+bool ShmChannel::Write(Direction direction, const char* data, size_t length) {
+  if (length > SLOT_BYTES) {
+    return false;
+  }
+  Slot& slot = region_->slots[direction];
+  uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(slot.data, data, length);
+  slot.length = uint32_t(length);
+  slot.written++;
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  Wake(slot.sequence);
+  return true;
+}
+
+bool ShmChannel::Read(Direction direction, std::string& message,
+                      std::chrono::nanoseconds timeout) {
+  Slot& slot = region_->slots[direction];
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;) {
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == seen_[direction] || (sequence & 1)) {
+      std::chrono::nanoseconds left =
+          deadline - std::chrono::steady_clock::now();
+      if (left <= std::chrono::nanoseconds::zero()) {
+        return false;
+      }
+      if (sequence & 1) {
+        // A write in progress takes a memcpy to finish.
+        std::this_thread::yield();
+      } else {
+        Wait(slot.sequence, sequence, left);
+      }
+      continue;
+    }
+    uint32_t length = std::min<uint32_t>(slot.length, SLOT_BYTES);
+    uint64_t written = slot.written;
+    message.assign(slot.data, length);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+      // Written over while copying.
+      continue;
+    }
+    seen_[direction] = sequence;
+    skipped_[direction] += written - read_[direction] - 1;
+    read_[direction] = written;
+    return true;
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Frames and replies between a simulator bridge and the controller on the
+// same host, through shared memory instead of a websocket: no framing, no
+// loopback TCP, and a message costs a copy in and a copy out.
+//
+// Each direction is a single slot under a seqlock, where the newest message
+// wins as in Mailbox: the writer never waits, and a message written over
+// before it was read is counted as skipped. The slot's sequence number is
+// even when the slot is complete and odd while it is being written, and is
+// also the futex word readers sleep on, so a reader waits without spinning
+// and is woken by the write. The messages are those of BinaryProtocol.h,
+// TELEMETRY in and STEER out.
+//
+// The controller creates the region and the bridge attaches to it. Linux
+// only; elsewhere readers poll.
+class ShmChannel {
+ public:
+  enum Direction { TELEMETRY, COMMAND };
+  // Room for a message, more than a STEER of the longest trajectory.
+  static const size_t SLOT_BYTES = 8192;
+
+  ShmChannel();
+  // Unmaps the region, and removes it if this side created it.
+  ~ShmChannel();
+  ShmChannel(const ShmChannel&) = delete;
+  ShmChannel& operator=(const ShmChannel&) = delete;
+
+  // Create the region `name`, like "/mpc", replacing any; the controller's
+  // side. False if it can't be.
+  bool Create(const std::string& name);
+  // Map the region `name` another process created; the bridge's side.
+  // False if there is none, or it is of another version.
+  bool Attach(const std::string& name);
+  bool isOpen() const { return region_ != nullptr; }
+
+  // Leave a message going `direction`, replacing one not yet read. False
+  // if it is longer than SLOT_BYTES.
+  bool Write(Direction direction, const char* data, size_t length);
+
+  // The next message going `direction` into `message`, waiting up to
+  // `timeout` for one newer than the last read. False if none came.
+  bool Read(Direction direction, std::string& message,
+            std::chrono::nanoseconds timeout);
+
+  // Messages going `direction` that were replaced before this side read
+  // them.
+  uint64_t skipped(Direction direction) const { return skipped_[direction]; }
+
+ private:
+  struct Slot {
+    // Even when complete, odd while written; the futex word.
+    std::atomic<uint32_t> sequence;
+    uint32_t length;
+    // Messages written to the slot so far.
+    uint64_t written;
+    char data[SLOT_BYTES];
+  };
+  struct Region {
+    uint32_t magic;
+    uint32_t version;
+    Slot slots[2];
+  };
+
+  void Close();
+
+  Region* region_;
+  std::string name_;
+  bool created_;
+  // The sequence and count of the last message read, per direction.
+  uint32_t seen_[2];
+  uint64_t read_[2];
+  uint64_t skipped_[2];
+};
+
+#endif /* SHM_CHANNEL_H */
@@ -0,0 +1,147 @@
+#include "SimEnvironments.h"
+#include <algorithm>
+#include <cmath>
+#include "TrackMap.h"
+
+static const double MPH = 0.44704;
+
+// Room for the last block to be filled out.
+static size_t Padded(size_t count) {
+  return (count + SimEnvironments::BLOCK - 1) / SimEnvironments::BLOCK *
+         SimEnvironments::BLOCK;
+}
+
+SimEnvironments::SimEnvironments(const TrackMap& track, size_t count,
+                                 double Lf)
+    : period(0.1), latency(0.1), step(0.005), maxAcceleration(5),
+      drag(0.135), offTrack(8), track_(track), count_(count), Lf_(Lf),
+      x_(Eigen::ArrayXd::Zero(Padded(count))),
+      y_(Eigen::ArrayXd::Zero(Padded(count))),
+      psi_(Eigen::ArrayXd::Zero(Padded(count))),
+      v_(Eigen::ArrayXd::Zero(Padded(count))),
+      steering_(Eigen::ArrayXd::Zero(Padded(count))),
+      throttle_(Eigen::ArrayXd::Zero(Padded(count))),
+      nextSteering_(Eigen::ArrayXd::Zero(Padded(count))),
+      nextThrottle_(Eigen::ArrayXd::Zero(Padded(count))),
+      localizers_(count), nearest_(count), s_(count), progress_(count),
+      cte_(count), batch_(count), problems_(count), results_(count) {
+  for (size_t i = 0; i < count; i++) {
+    Reset(i, 0);
+  }
+}
+
+void SimEnvironments::Reset(size_t i, double s, double speed) {
+  double dx;
+  double dy;
+  track_.Evaluate(s, x_[i], y_[i], dx, dy);
+  psi_[i] = atan2(dy, dx);
+  v_[i] = speed * MPH;
+  steering_[i] = 0;
+  throttle_[i] = 0;
+  localizers_[i].Reset();
+  nearest_[i] = localizers_[i].Nearest(track_, x_[i], y_[i]);
+  s_[i] = track_.Project(x_[i], y_[i], nearest_[i]);
+  progress_[i] = 0;
+  cte_[i] = 0;
+}
+
+void SimEnvironments::Step(const Action* actions) {
+  for (size_t i = 0; i < count_; i++) {
+    nextSteering_[i] =
+        std::max(-MAX_DELTA, std::min(MAX_DELTA, actions[i].steering));
+    nextThrottle_[i] = std::max(-1., std::min(1., actions[i].throttle));
+  }
+  const int steps = std::max(1, int(lround(period / step)));
+  const int switched = std::min(steps, int(lround(latency / step)));
+  const double dt = period / steps;
+  const double turn = dt / Lf_;
+  // The padding cars move too, harmlessly: they are never read.
+  for (size_t b = 0; b < size_t(x_.size()); b += BLOCK) {
+    Lanes x = x_.segment<BLOCK>(b);
+    Lanes y = y_.segment<BLOCK>(b);
+    Lanes psi = psi_.segment<BLOCK>(b);
+    Lanes v = v_.segment<BLOCK>(b);
+    Lanes steering = steering_.segment<BLOCK>(b);
+    Lanes throttle = throttle_.segment<BLOCK>(b);
+    for (int k = 0; k < steps; k++) {
+      if (k == switched) {
+        steering = nextSteering_.segment<BLOCK>(b);
+        throttle = nextThrottle_.segment<BLOCK>(b);
+      }
+      x += v * psi.cos() * dt;
+      y += v * psi.sin() * dt;
+      // Positive steering turns right, toward lower psi.
+      psi -= v * steering * turn;
+      v = (v + (maxAcceleration * throttle - drag * v) * dt).max(0.);
+    }
+    x_.segment<BLOCK>(b) = x;
+    y_.segment<BLOCK>(b) = y;
+    psi_.segment<BLOCK>(b) = psi;
+    v_.segment<BLOCK>(b) = v;
+  }
+  steering_ = nextSteering_;
+  throttle_ = nextThrottle_;
+
+  // Where each car is along the track, around the loop.
+  const double length = track_.length();
+  for (size_t i = 0; i < count_; i++) {
+    nearest_[i] = localizers_[i].Nearest(track_, x_[i], y_[i]);
+    double s = track_.Project(x_[i], y_[i], nearest_[i]);
+    double ds = s - s_[i];
+    if (ds < -length / 2) {
+      ds += length;
+    } else if (ds > length / 2) {
+      ds -= length;
+    }
+    progress_[i] += ds;
+    s_[i] = s;
+    double px;
+    double py;
+    double dx;
+    double dy;
+    track_.Evaluate(s, px, py, dx, dy);
+    cte_[i] = hypot(x_[i] - px, y_[i] - py);
+  }
+}
+
+void SimEnvironments::Observe(Telemetry* observations) const {
+  for (size_t i = 0; i < count_; i++) {
+    Telemetry& t = observations[i];
+    t.n_waypoints = track_.Ahead(nearest_[i], x_[i], y_[i], psi_[i],
+                                 FrameBatch::WAYPOINTS, t.ptsx, t.ptsy);
+    t.px = x_[i];
+    t.py = y_[i];
+    t.psi = fmod(psi_[i], 2 * M_PI);
+    if (t.psi < 0) {
+      t.psi += 2 * M_PI;
+    }
+    t.v = v_[i] / MPH;
+    t.delta = steering_[i];
+    t.a = throttle_[i];
+    t.latency = latency;
+    t.binary = false;
+    t.prepared = false;
+  }
+}
+
+void SimEnvironments::Control(MPC& mpc, const Telemetry* observations,
+                              Action* actions) {
+  batch_.Clear();
+  for (size_t i = 0; i < count_; i++) {
+    batch_.Add(observations[i]);
+  }
+  batch_.Prepare(Lf_);
+  for (size_t i = 0; i < count_; i++) {
+    batch_.Coeffs(i, problems_[i].coeffs.data());
+    batch_.State(i, problems_[i].state.data());
+    // The actions only; no trajectories.
+    MPC::Result result = {0, 0, nullptr, nullptr, 0, 0};
+    results_[i] = result;
+  }
+  mpc.SolveBatch(problems_.data(), results_.data(), count_);
+  for (size_t i = 0; i < count_; i++) {
+    // The model steers positive to the left.
+    actions[i].steering = -results_[i].delta;
+    actions[i].throttle = results_[i].a;
+  }
+}
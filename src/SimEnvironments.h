@@ -0,0 +1,109 @@
+#ifndef SIM_ENVIRONMENTS_H
+#define SIM_ENVIRONMENTS_H
+
+#include <cstddef>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FrameBatch.h"
+#include "MPC.h"
+#include "Telemetry.h"
+#include "TrackLocalizer.h"
+
+class TrackMap;
+
+// Many cars on one track, each its own environment, stepped together: the
+// kinematic bicycle of headless_sim standing in for the simulator, with
+// Step taking an action per car and Observe giving back each car's frame as
+// the simulator would send it, for tuning and learning over thousands of
+// runs at once.
+//
+// The cars are held as structures of arrays, an array per field, and Step
+// advances them BLOCK at a time as in FrameBatch: each block of cars stays
+// in registers through all the integration steps of a period, so the
+// arithmetic vectorizes across cars. Control answers every car's frame with
+// MPC::SolveBatch on its thread pool. Nothing is allocated after
+// construction.
+class SimEnvironments {
+ public:
+  static const int BLOCK = 8;
+
+  // As the simulator takes them: the steering angle in radians, positive
+  // to the right, and the throttle in [-1, 1]; clipped to MAX_DELTA and 1.
+  struct Action {
+    double steering;
+    double throttle;
+  };
+
+  // `count` cars on `track`, which outlives them and has at least 6
+  // waypoints, turning like a bicycle with Lf from the front axle to the
+  // center of gravity. All start at rest at the first waypoint.
+  SimEnvironments(const TrackMap& track, size_t count, double Lf);
+
+  size_t size() const { return count_; }
+
+  // Seconds of a Step, from its start to its actions taking effect, at
+  // most period, and of each integration step within it.
+  double period;
+  double latency;
+  double step;
+  // Meters per second squared at full throttle, and the drag, per second,
+  // that slows the car in proportion to its speed. Only roughly the
+  // simulator's; Lf is what its turning was fitted with.
+  double maxAcceleration;
+  double drag;
+  // Meters from the track at which a car has left it.
+  double offTrack;
+
+  // Put car i at rest, or at `speed` in mph, at arc length s along the
+  // track and heading along it, with its progress back at 0.
+  void Reset(size_t i, double s, double speed = 0);
+
+  // Advance every car by a period, each with its actions taking effect
+  // `latency` into it; the ones before hold until then.
+  void Step(const Action* actions);
+
+  // Each car's frame into observations, with the 6 waypoints the simulator
+  // would pick, its latency and the fields of DATA.md, not yet prepared.
+  void Observe(Telemetry* observations) const;
+
+  // Answer each observation as Controller::Step would, through
+  // FrameBatch and `mpc`'s SolveBatch, into actions.
+  void Control(MPC& mpc, const Telemetry* observations, Action* actions);
+
+  // Car i's distance from the track, meters along it since its Reset, and
+  // whether it has left it.
+  double cte(size_t i) const { return cte_[i]; }
+  double progress(size_t i) const { return progress_[i]; }
+  bool off(size_t i) const { return cte_[i] > offTrack; }
+
+ private:
+  typedef Eigen::Array<double, BLOCK, 1> Lanes;
+
+  const TrackMap& track_;
+  size_t count_;
+  double Lf_;
+  // The cars, with room for a whole number of blocks: pose, speed in
+  // meters per second, the actuations in effect and those to come.
+  Eigen::ArrayXd x_;
+  Eigen::ArrayXd y_;
+  Eigen::ArrayXd psi_;
+  Eigen::ArrayXd v_;
+  Eigen::ArrayXd steering_;
+  Eigen::ArrayXd throttle_;
+  Eigen::ArrayXd nextSteering_;
+  Eigen::ArrayXd nextThrottle_;
+  // Each car's place on the track, and its nearest waypoint and arc length
+  // at the last Step, and what the rest report.
+  std::vector<TrackLocalizer> localizers_;
+  std::vector<size_t> nearest_;
+  std::vector<double> s_;
+  std::vector<double> progress_;
+  std::vector<double> cte_;
+  // Control's buffers.
+  FrameBatch batch_;
+  std::vector<MPC::BatchProblem, Eigen::aligned_allocator<MPC::BatchProblem> >
+      problems_;
+  std::vector<MPC::Result> results_;
+};
+
+#endif /* SIM_ENVIRONMENTS_H */
@@ -0,0 +1,70 @@
+#include "SimdKernels.h"
+#include <cstdlib>
+#include <cstring>
+
+// In the copies of SimdKernels.cpp this build has.
+namespace simd_baseline {
+extern const SimdKernels kernels;
+}
+#ifdef MPC_SIMD_DISPATCH
+namespace simd_avx2 {
+extern const SimdKernels kernels;
+}
+namespace simd_avx512 {
+extern const SimdKernels kernels;
+}
+#endif
+
+static const char* const NAMES[ISAS] = {"baseline", "avx2", "avx512"};
+
+const char* IsaName(Isa isa) { return NAMES[isa]; }
+
+const SimdKernels* IsaKernels(Isa isa) {
+  switch (isa) {
+    case ISA_BASELINE:
+      return &simd_baseline::kernels;
+#ifdef MPC_SIMD_DISPATCH
+    case ISA_AVX2:
+      return &simd_avx2::kernels;
+    case ISA_AVX512:
+      return &simd_avx512::kernels;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+// What the CPU, and the OS's saving of the wider registers, allow.
+static Isa SupportedIsa() {
+#if defined(MPC_SIMD_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+    return ISA_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return ISA_AVX2;
+  }
+#endif
+  return ISA_BASELINE;
+}
+
+Isa DetectIsa() {
+  Isa isa = SupportedIsa();
+  const char* cap = getenv("MPC_ISA");
+  if (cap) {
+    for (int i = 0; i < ISAS; i++) {
+      if (strcmp(cap, NAMES[i]) == 0 && i < isa) {
+        isa = Isa(i);
+      }
+    }
+  }
+  while (!IsaKernels(isa)) {
+    isa = Isa(isa - 1);
+  }
+  return isa;
+}
+
+const SimdKernels& Kernels() {
+  static const SimdKernels& kernels = *IsaKernels(DetectIsa());
+  return kernels;
+}
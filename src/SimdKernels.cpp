@@ -0,0 +1,390 @@
+// Built once per instruction set, see SimdKernels.h: with MPC_SIMD_AVX2 or
+// MPC_SIMD_AVX512 and the compiler flags of that set, or plain for the
+// baseline.
+#if defined(MPC_SIMD_AVX2) || defined(MPC_SIMD_AVX512)
+#define EIGEN_MAX_ALIGN_BYTES 16
+#endif
+
+#include "SimdKernels.h"
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+#include "BatchRiccati.h"
+#include "Riccati.h"
+
+#if defined(MPC_SIMD_AVX512)
+#define SIMD_ISA ISA_AVX512
+#define SIMD_NAMESPACE simd_avx512
+#elif defined(MPC_SIMD_AVX2)
+#define SIMD_ISA ISA_AVX2
+#define SIMD_NAMESPACE simd_avx2
+#else
+#define SIMD_ISA ISA_BASELINE
+#define SIMD_NAMESPACE simd_baseline
+#endif
+
+// Everything a kernel calls is inlined into it, so that the variants leave
+// no out-of-line copy of an Eigen template, built with their flags, for the
+// linker to keep in place of the baseline's.
+#ifdef __GNUC__
+#define KERNEL __attribute__((flatten))
+#else
+#define KERNEL
+#endif
+
+template <int Isa, class R>
+KERNEL bool RiccatiFactorize(R& r) {
+  typedef typename R::StateMatrix StateMatrix;
+  typedef typename R::CrossMatrix CrossMatrix;
+  typedef typename R::InputMatrix InputMatrix;
+  typedef typename R::GainMatrix GainMatrix;
+  typedef typename StateMatrix::Scalar Scalar;
+  r.P_[r.T_] = r.Q[r.T_];
+  for (size_t i = r.T_; i-- > 0;) {
+    CrossMatrix PB = r.P_[i + 1] * r.B[i];
+    InputMatrix Ruu = r.R[i] + r.B[i].transpose() * PB;
+    GainMatrix Rux = r.S[i].transpose() + PB.transpose() * r.A[i];
+    r.llt_[i].compute(Ruu);
+    if (r.llt_[i].info() != Eigen::Success) {
+      return false;
+    }
+    // A column at a time, which Eigen unrolls, where a solve of the whole
+    // matrix goes through its out-of-line triangular solver.
+    for (int j = 0; j < Rux.cols(); j++) {
+      r.K_[i].col(j) = -r.llt_[i].solve(Rux.col(j));
+    }
+    StateMatrix P = r.Q[i] + r.A[i].transpose() * r.P_[i + 1] * r.A[i] +
+                    Rux.transpose() * r.K_[i];
+    r.P_[i] = Scalar(0.5) * (P + P.transpose());
+  }
+  return true;
+}
+
+template <int Isa, class R>
+KERNEL void RiccatiSolve(R& r) {
+  typedef typename R::InputVector InputVector;
+  // Lazy products, which Eigen evaluates inline, where it can hand a
+  // matrix-vector product of this size to its out-of-line GEMV.
+  r.p_[r.T_] = r.q[r.T_];
+  for (size_t i = r.T_; i-- > 0;) {
+    InputVector h = r.r[i] + r.B[i].transpose().lazyProduct(r.p_[i + 1]);
+    r.k_[i] = -r.llt_[i].solve(h);
+    r.p_[i] = r.q[i] + r.A[i].transpose().lazyProduct(r.p_[i + 1]) +
+              r.K_[i].transpose().lazyProduct(h);
+  }
+  r.x[0] = r.x0;
+  for (size_t i = 0; i < r.T_; i++) {
+    r.u[i] = r.K_[i].lazyProduct(r.x[i]) + r.k_[i];
+    r.x[i + 1] = r.A[i].lazyProduct(r.x[i]) + r.B[i].lazyProduct(r.u[i]);
+  }
+}
+
+// Solve L L' v = v in place, a lane each, for BatchRiccati's factor L:
+// column-major NU x NU, lower, with the reciprocals of its pivots on the
+// diagonal.
+template <int NU, class Block, class Lane>
+inline void LaneCholeskySolve(const Block& L, Lane* v) {
+  for (int i = 0; i < NU; i++) {
+    for (int k = 0; k < i; k++) {
+      v[i] -= L.col(i + NU * k) * v[k];
+    }
+    v[i] *= L.col(i + NU * i);
+  }
+  for (int i = NU; i-- > 0;) {
+    for (int k = i + 1; k < NU; k++) {
+      v[i] -= L.col(k + NU * i) * v[k];
+    }
+    v[i] *= L.col(i + NU * i);
+  }
+}
+
+// Riccati's recursions written out entry by entry, each entry an operation
+// on a column of Lanes, which Eigen maps onto whole vectors.
+template <int Isa, class R>
+KERNEL uint32_t BatchRiccatiFactorize(R& r) {
+  typedef typename R::StateBlock StateBlock;
+  typedef typename R::CrossBlock CrossBlock;
+  typedef typename R::InputBlock InputBlock;
+  typedef typename R::GainBlock GainBlock;
+  typedef typename R::Lane Lane;
+  typedef typename Lane::Scalar Scalar;
+  const int NX = R::StateLanes::ColsAtCompileTime;
+  const int NU = R::InputLanes::ColsAtCompileTime;
+  uint32_t failed = 0;
+  r.P_[r.T_] = r.Q[r.T_];
+  for (size_t t = r.T_; t-- > 0;) {
+    const StateBlock& P = r.P_[t + 1];
+    const StateBlock& A = r.A[t];
+    const CrossBlock& B = r.B[t];
+    CrossBlock PB;
+    for (int j = 0; j < NU; j++) {
+      for (int i = 0; i < NX; i++) {
+        Lane e = P.col(i) * B.col(NX * j);
+        for (int l = 1; l < NX; l++) {
+          e += P.col(i + NX * l) * B.col(l + NX * j);
+        }
+        PB.col(i + NX * j) = e;
+      }
+    }
+    InputBlock Ruu;
+    for (int b = 0; b < NU; b++) {
+      for (int a = 0; a < NU; a++) {
+        Lane e = r.R[t].col(a + NU * b);
+        for (int l = 0; l < NX; l++) {
+          e += B.col(l + NX * a) * PB.col(l + NX * b);
+        }
+        Ruu.col(a + NU * b) = e;
+      }
+    }
+    GainBlock Rux;
+    for (int c = 0; c < NX; c++) {
+      for (int a = 0; a < NU; a++) {
+        Lane e = r.S[t].col(c + NX * a);
+        for (int l = 0; l < NX; l++) {
+          e += PB.col(l + NX * a) * A.col(l + NX * c);
+        }
+        Rux.col(a + NU * c) = e;
+      }
+    }
+
+    InputBlock& L = r.L_[t];
+    for (int j = 0; j < NU; j++) {
+      Lane d = Ruu.col(j + NU * j);
+      for (int k = 0; k < j; k++) {
+        d -= L.col(j + NU * k).square();
+      }
+      for (int lane = 0; lane < R::LANES; lane++) {
+        if (!(d[lane] > 0)) {
+          failed |= uint32_t(1) << lane;
+        }
+      }
+      L.col(j + NU * j) = d.rsqrt();
+      for (int i = j + 1; i < NU; i++) {
+        Lane e = Ruu.col(i + NU * j);
+        for (int k = 0; k < j; k++) {
+          e -= L.col(i + NU * k) * L.col(j + NU * k);
+        }
+        L.col(i + NU * j) = e * L.col(j + NU * j);
+      }
+    }
+    GainBlock& K = r.K_[t];
+    for (int c = 0; c < NX; c++) {
+      Lane v[NU];
+      for (int a = 0; a < NU; a++) {
+        v[a] = Rux.col(a + NU * c);
+      }
+      LaneCholeskySolve<NU>(L, v);
+      for (int a = 0; a < NU; a++) {
+        K.col(a + NU * c) = -v[a];
+      }
+    }
+
+    StateBlock PA;
+    for (int c = 0; c < NX; c++) {
+      for (int i = 0; i < NX; i++) {
+        Lane e = P.col(i) * A.col(NX * c);
+        for (int l = 1; l < NX; l++) {
+          e += P.col(i + NX * l) * A.col(l + NX * c);
+        }
+        PA.col(i + NX * c) = e;
+      }
+    }
+    StateBlock& next = r.P_[t];
+    for (int c = 0; c < NX; c++) {
+      for (int i = 0; i < NX; i++) {
+        Lane e = r.Q[t].col(i + NX * c);
+        for (int l = 0; l < NX; l++) {
+          e += A.col(l + NX * i) * PA.col(l + NX * c);
+        }
+        for (int a = 0; a < NU; a++) {
+          e += Rux.col(a + NU * i) * K.col(a + NU * c);
+        }
+        next.col(i + NX * c) = e;
+      }
+    }
+    for (int c = 0; c < NX; c++) {
+      for (int i = c + 1; i < NX; i++) {
+        Lane e = Scalar(0.5) * (next.col(i + NX * c) + next.col(c + NX * i));
+        next.col(i + NX * c) = e;
+        next.col(c + NX * i) = e;
+      }
+    }
+  }
+  return failed;
+}
+
+template <int Isa, class R>
+KERNEL void BatchRiccatiSolve(R& r) {
+  typedef typename R::Lane Lane;
+  const int NX = R::StateLanes::ColsAtCompileTime;
+  const int NU = R::InputLanes::ColsAtCompileTime;
+  r.p_[r.T_] = r.q[r.T_];
+  for (size_t t = r.T_; t-- > 0;) {
+    const typename R::StateLanes& p = r.p_[t + 1];
+    Lane h[NU];
+    Lane v[NU];
+    for (int a = 0; a < NU; a++) {
+      Lane e = r.r[t].col(a);
+      for (int l = 0; l < NX; l++) {
+        e += r.B[t].col(l + NX * a) * p.col(l);
+      }
+      h[a] = e;
+      v[a] = e;
+    }
+    LaneCholeskySolve<NU>(r.L_[t], v);
+    for (int a = 0; a < NU; a++) {
+      r.k_[t].col(a) = -v[a];
+    }
+    for (int i = 0; i < NX; i++) {
+      Lane e = r.q[t].col(i);
+      for (int l = 0; l < NX; l++) {
+        e += r.A[t].col(l + NX * i) * p.col(l);
+      }
+      for (int a = 0; a < NU; a++) {
+        e += r.K_[t].col(a + NU * i) * h[a];
+      }
+      r.p_[t].col(i) = e;
+    }
+  }
+  r.x[0] = r.x0;
+  for (size_t t = 0; t < r.T_; t++) {
+    const typename R::StateLanes& x = r.x[t];
+    for (int a = 0; a < NU; a++) {
+      Lane e = r.k_[t].col(a);
+      for (int c = 0; c < NX; c++) {
+        e += r.K_[t].col(a + NU * c) * x.col(c);
+      }
+      r.u[t].col(a) = e;
+    }
+    for (int i = 0; i < NX; i++) {
+      Lane e = r.A[t].col(i) * x.col(0);
+      for (int l = 1; l < NX; l++) {
+        e += r.A[t].col(i + NX * l) * x.col(l);
+      }
+      for (int a = 0; a < NU; a++) {
+        e += r.B[t].col(i + NX * a) * r.u[t].col(a);
+      }
+      r.x[t + 1].col(i) = e;
+    }
+  }
+}
+
+template bool RiccatiFactorize<SIMD_ISA>(Riccati<8, 2, double>&);
+template void RiccatiSolve<SIMD_ISA>(Riccati<8, 2, double>&);
+template bool RiccatiFactorize<SIMD_ISA>(Riccati<8, 2, float>&);
+template void RiccatiSolve<SIMD_ISA>(Riccati<8, 2, float>&);
+template uint32_t BatchRiccatiFactorize<SIMD_ISA>(
+    BatchRiccati<8, 2, double, 4>&);
+template void BatchRiccatiSolve<SIMD_ISA>(BatchRiccati<8, 2, double, 4>&);
+template uint32_t BatchRiccatiFactorize<SIMD_ISA>(
+    BatchRiccati<8, 2, double, 8>&);
+template void BatchRiccatiSolve<SIMD_ISA>(BatchRiccati<8, 2, double, 8>&);
+template uint32_t BatchRiccatiFactorize<SIMD_ISA>(
+    BatchRiccati<8, 2, float, 8>&);
+template void BatchRiccatiSolve<SIMD_ISA>(BatchRiccati<8, 2, float, 8>&);
+template uint32_t BatchRiccatiFactorize<SIMD_ISA>(
+    BatchRiccati<8, 2, float, 16>&);
+template void BatchRiccatiSolve<SIMD_ISA>(BatchRiccati<8, 2, float, 16>&);
+
+namespace SIMD_NAMESPACE {
+
+KERNEL void ToVehicleFrame(double px, double py, double psi, const double* x,
+                           const double* y, size_t n, double* vehicle_x,
+                           double* vehicle_y) {
+  double c = cos(psi);
+  double s = sin(psi);
+  Eigen::Map<const Eigen::ArrayXd> xs(x, n);
+  Eigen::Map<const Eigen::ArrayXd> ys(y, n);
+  Eigen::Map<Eigen::ArrayXd> vx(vehicle_x, n);
+  Eigen::Map<Eigen::ArrayXd> vy(vehicle_y, n);
+  // Both outputs depend on both inputs, so go in blocks that fit in
+  // registers rather than through temporaries, which also lets the outputs
+  // alias the inputs.
+  const int BLOCK = 8;
+  size_t i = 0;
+  for (; i + BLOCK <= n; i += BLOCK) {
+    Eigen::Array<double, BLOCK, 1> dx = xs.segment<BLOCK>(i) - px;
+    Eigen::Array<double, BLOCK, 1> dy = ys.segment<BLOCK>(i) - py;
+    vx.segment<BLOCK>(i) = dx * c + dy * s;
+    vy.segment<BLOCK>(i) = dy * c - dx * s;
+  }
+  for (; i < n; i++) {
+    double dx = x[i] - px;
+    double dy = y[i] - py;
+    vehicle_x[i] = dx * c + dy * s;
+    vehicle_y[i] = dy * c - dx * s;
+  }
+}
+
+KERNEL void Polyeval(const double* coeffs, size_t size, const double* x,
+                     double* y, size_t n) {
+  Eigen::Map<const Eigen::ArrayXd> xs(x, n);
+  Eigen::Map<Eigen::ArrayXd> ys(y, n);
+  if (size == 0) {
+    ys.setZero();
+    return;
+  }
+  ys.setConstant(coeffs[size - 1]);
+  for (size_t i = size - 1; i-- > 0;) {
+    ys = ys * xs + coeffs[i];
+  }
+}
+
+KERNEL void RollOut(const MppiRollout& r) {
+  typedef Eigen::Map<Eigen::ArrayXf> Samples;
+  typedef Eigen::Map<const Eigen::ArrayXf> Actuations;
+  Eigen::Index n = r.n;
+  Samples x(r.x, n);
+  Samples y(r.y, n);
+  Samples psi(r.psi, n);
+  Samples v(r.v, n);
+  Samples cte(r.cte, n);
+  Samples epsi(r.epsi, n);
+  Samples next_cte(r.next_cte, n);
+  Samples cost(r.cost, n);
+  float dt = r.dt;
+  float turn = r.turn;
+  float c0 = r.coeffs[0], c1 = r.coeffs[1], c2 = r.coeffs[2],
+        c3 = r.coeffs[3];
+  for (size_t t = 0; t < r.stages; t++) {
+    Actuations delta(r.delta + t * r.stride, n);
+    Actuations a(r.a + t * r.stride, n);
+    // BicycleStep, the errors first since they need the old state.
+    next_cte = c0 + x * (c1 + x * (c2 + x * c3)) - y + v * epsi.sin() * dt;
+    epsi = psi - (c1 + x * (2 * c2 + 3 * c3 * x)).atan() + v * delta * turn;
+    cte = next_cte;
+    x += v * psi.cos() * dt;
+    y += v * psi.sin() * dt;
+    psi += v * delta * turn;
+    v += a * dt;
+
+    cost += r.wCte * cte.square() + r.wEpsi * epsi.square() +
+            r.wV * (v - r.refV).square() + r.wDelta * delta.square() +
+            r.wA * a.square();
+    if (t > 0) {
+      Actuations last_delta(r.delta + (t - 1) * r.stride, n);
+      Actuations last_a(r.a + (t - 1) * r.stride, n);
+      cost += r.wDeltaDiff * (delta - last_delta).square() +
+              r.wADiff * (a - last_a).square();
+    }
+  }
+}
+
+extern const SimdKernels kernels = {
+    SIMD_ISA,
+    ToVehicleFrame,
+    Polyeval,
+    RollOut,
+    RiccatiFactorize<SIMD_ISA, Riccati<8, 2, double> >,
+    RiccatiSolve<SIMD_ISA, Riccati<8, 2, double> >,
+    RiccatiFactorize<SIMD_ISA, Riccati<8, 2, float> >,
+    RiccatiSolve<SIMD_ISA, Riccati<8, 2, float> >,
+    BatchRiccatiFactorize<SIMD_ISA, BatchRiccati<8, 2, double, 4> >,
+    BatchRiccatiSolve<SIMD_ISA, BatchRiccati<8, 2, double, 4> >,
+    BatchRiccatiFactorize<SIMD_ISA, BatchRiccati<8, 2, double, 8> >,
+    BatchRiccatiSolve<SIMD_ISA, BatchRiccati<8, 2, double, 8> >,
+    BatchRiccatiFactorize<SIMD_ISA, BatchRiccati<8, 2, float, 8> >,
+    BatchRiccatiSolve<SIMD_ISA, BatchRiccati<8, 2, float, 8> >,
+    BatchRiccatiFactorize<SIMD_ISA, BatchRiccati<8, 2, float, 16> >,
+    BatchRiccatiSolve<SIMD_ISA, BatchRiccati<8, 2, float, 16> >};
+
+}  // namespace SIMD_NAMESPACE
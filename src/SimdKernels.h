@@ -0,0 +1,100 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// The SIMD-heavy kernels, built once per instruction set and chosen at
+// startup from the CPU's features, so that one binary runs the widest
+// vectors of each machine it is deployed to. SimdKernels.cpp is compiled for
+// the target's baseline and, on x86-64 with the MPC_SIMD_DISPATCH CMake
+// option, again for AVX2 with FMA and for AVX-512, each copy with its
+// kernels in a namespace of its own; the first call to Kernels() picks one
+// table for the process. AArch64's baseline has NEON already, and Eigen 3.3
+// nothing wider, so there it has the one.
+//
+// Every copy keeps Eigen's alignment at the baseline's 16 bytes, so that
+// fixed-size matrices laid out by baseline code, as Riccati's are, can be
+// handed to the wider kernels, which load them unaligned.
+enum Isa { ISA_BASELINE, ISA_AVX2, ISA_AVX512, ISAS };
+
+template <int NX, int NU, class Scalar>
+class Riccati;
+template <int NX, int NU, class Scalar, int Lanes>
+class BatchRiccati;
+
+// A chunk of MPPI's rollouts, see MPPI::Rollout: n samples stepped from
+// their states through `stages` stages, their costs accumulated.
+struct MppiRollout {
+  // n each, updated in place; next_cte is scratch.
+  float* x;
+  float* y;
+  float* psi;
+  float* v;
+  float* cte;
+  float* epsi;
+  float* next_cte;
+  float* cost;
+  // The n sampled actuations of stage t at delta + t * stride, and a's.
+  const float* delta;
+  const float* a;
+  size_t stride;
+  size_t n;
+  size_t stages;
+  float dt;
+  // dt / Lf.
+  float turn;
+  float refV;
+  float coeffs[4];
+  // FG_eval's weights, as in KinematicWeights.
+  float wCte;
+  float wEpsi;
+  float wV;
+  float wDelta;
+  float wA;
+  float wDeltaDiff;
+  float wADiff;
+};
+
+struct SimdKernels {
+  Isa isa;
+  // ToVehicleFrame.
+  void (*toVehicleFrame)(double px, double py, double psi, const double* x,
+                         const double* y, size_t n, double* vehicle_x,
+                         double* vehicle_y);
+  // polyeval at x[0, n) into y[0, n), of `size` coefficients.
+  void (*polyeval)(const double* coeffs, size_t size, const double* x,
+                   double* y, size_t n);
+  void (*mppiRollout)(const MppiRollout& rollout);
+  // Riccati::Factorize and Solve, in double and in float.
+  bool (*riccatiFactorize)(Riccati<8, 2, double>& riccati);
+  void (*riccatiSolve)(Riccati<8, 2, double>& riccati);
+  bool (*riccatiFactorizeFloat)(Riccati<8, 2, float>& riccati);
+  void (*riccatiSolveFloat)(Riccati<8, 2, float>& riccati);
+  // BatchRiccati::Factorize and Solve, by scalar and lanes.
+  uint32_t (*batchRiccatiFactorize4)(BatchRiccati<8, 2, double, 4>& riccati);
+  void (*batchRiccatiSolve4)(BatchRiccati<8, 2, double, 4>& riccati);
+  uint32_t (*batchRiccatiFactorize8)(BatchRiccati<8, 2, double, 8>& riccati);
+  void (*batchRiccatiSolve8)(BatchRiccati<8, 2, double, 8>& riccati);
+  uint32_t (*batchRiccatiFactorizeFloat8)(
+      BatchRiccati<8, 2, float, 8>& riccati);
+  void (*batchRiccatiSolveFloat8)(BatchRiccati<8, 2, float, 8>& riccati);
+  uint32_t (*batchRiccatiFactorizeFloat16)(
+      BatchRiccati<8, 2, float, 16>& riccati);
+  void (*batchRiccatiSolveFloat16)(BatchRiccati<8, 2, float, 16>& riccati);
+};
+
+const char* IsaName(Isa isa);
+
+// The widest set that the CPU runs and this build has kernels for. MPC_ISA
+// in the environment, "baseline", "avx2" or "avx512", caps it, for
+// comparing the variants on one machine.
+Isa DetectIsa();
+
+// The kernels of `isa`; null when this build has none for it.
+const SimdKernels* IsaKernels(Isa isa);
+
+// Those of DetectIsa(), for the life of the process.
+const SimdKernels& Kernels();
+
+#endif /* SIMD_KERNELS_H */
@@ -0,0 +1,93 @@
+#include "SloTracker.h"
+#include <algorithm>
+#include <cmath>
+
+static const char* const OBJECTIVE_NAMES[SloTracker::OBJECTIVES] = {
+    "deadline", "age", "jitter"};
+
+SloTracker::SloTracker(const Targets& targets, Alert alert)
+    : targets_(targets), alert_(std::move(alert)), commands_(0), next_(0),
+      jitterNext_(0), late_(0), lastInterval_(-1),
+      lastJitter_(-1) {
+  targets_.window = std::max<size_t>(targets_.window, 1);
+  targets_.checkEvery = std::max<size_t>(targets_.checkEvery, 1);
+  ages_.reserve(targets_.window);
+  jitters_.reserve(targets_.window);
+  scratch_.reserve(targets_.window);
+  std::fill(violated_, violated_ + OBJECTIVES, false);
+}
+
+const char* SloTracker::Name(Objective objective) {
+  return OBJECTIVE_NAMES[objective];
+}
+
+void SloTracker::Record(std::chrono::steady_clock::time_point sent,
+                        double age) {
+  // The late commands are counted as they enter and leave the window.
+  if (ages_.size() < targets_.window) {
+    ages_.push_back(age);
+  } else {
+    late_ -= ages_[next_] > targets_.deadline;
+    ages_[next_] = age;
+    next_ = (next_ + 1) % ages_.size();
+  }
+  late_ += age > targets_.deadline;
+
+  if (commands_ > 0) {
+    double interval = std::chrono::duration<double>(sent - lastSent_).count();
+    if (lastInterval_ >= 0) {
+      lastJitter_ = std::fabs(interval - lastInterval_);
+      if (jitters_.size() < targets_.window) {
+        jitters_.push_back(lastJitter_);
+      } else {
+        jitters_[jitterNext_] = lastJitter_;
+        jitterNext_ = (jitterNext_ + 1) % jitters_.size();
+      }
+    }
+    lastInterval_ = interval;
+  }
+  lastSent_ = sent;
+  commands_++;
+  if (commands_ % targets_.checkEvery == 0) {
+    Check();
+  }
+}
+
+double SloTracker::compliance() const {
+  return ages_.empty() ? 1 : 1 - double(late_) / ages_.size();
+}
+
+double SloTracker::age(double p) const { return Quantile(ages_, p); }
+
+double SloTracker::jitter(double p) const { return Quantile(jitters_, p); }
+
+double SloTracker::Quantile(const std::vector<double>& samples,
+                            double p) const {
+  if (samples.empty()) {
+    return 0;
+  }
+  scratch_.assign(samples.begin(), samples.end());
+  size_t k = std::min(size_t(p * (scratch_.size() - 1) + 0.5),
+                      scratch_.size() - 1);
+  std::nth_element(scratch_.begin(), scratch_.begin() + k, scratch_.end());
+  return scratch_[k];
+}
+
+void SloTracker::Check() {
+  Report reports[OBJECTIVES] = {
+      {DEADLINE, compliance(), targets_.compliance, commands_},
+      {AGE, targets_.age > 0 ? age(targets_.quantile) : 0, targets_.age,
+       commands_},
+      {JITTER, targets_.jitter > 0 ? jitter(targets_.quantile) : 0,
+       targets_.jitter, commands_}};
+  for (int i = 0; i < OBJECTIVES; i++) {
+    const Report& report = reports[i];
+    bool violated = i == DEADLINE ? report.value < report.target
+                                  : report.target > 0 &&
+                                        report.value > report.target;
+    if (violated && !violated_[i] && alert_) {
+      alert_(report);
+    }
+    violated_[i] = violated;
+  }
+}
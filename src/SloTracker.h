@@ -0,0 +1,91 @@
+#ifndef SLO_TRACKER_H
+#define SLO_TRACKER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// A session's service level objectives over its last `window` commands:
+// the fraction that went out within the deadline of their frame's receipt,
+// a quantile of the age of the state each was computed from when it went
+// out, and the same quantile of the inter-departure jitter, how much each
+// interval between consecutive commands differs from the one before.
+//
+// Every checkEvery commands the window is checked against the targets, and
+// `alert` is called for each objective that has just gone into violation;
+// it is called again for that objective only after a check found it met.
+// Event loop thread only; the windows are preallocated, so Record doesn't
+// allocate.
+class SloTracker {
+ public:
+  enum Objective { DEADLINE, AGE, JITTER, OBJECTIVES };
+
+  struct Targets {
+    Targets()
+        : window(200), checkEvery(50), deadline(0.1), compliance(0.99),
+          quantile(0.99), age(0.1), jitter(0.02) {}
+    size_t window;
+    size_t checkEvery;
+    // At least `compliance` of the commands within `deadline` seconds.
+    double deadline;
+    double compliance;
+    // The `quantile`-quantiles of the age and jitter at most `age` and
+    // `jitter` seconds; 0 for no target.
+    double quantile;
+    double age;
+    double jitter;
+  };
+
+  // A violation: the objective, its value over the window against its
+  // target, and the commands the session has sent.
+  struct Report {
+    Objective objective;
+    double value;
+    double target;
+    size_t commands;
+  };
+  typedef std::function<void(const Report&)> Alert;
+
+  SloTracker(const Targets& targets, Alert alert);
+
+  // A command that went out at `sent`, computed from a state `age` seconds
+  // old by then.
+  void Record(std::chrono::steady_clock::time_point sent, double age);
+
+  // Over the window: the fraction of the commands within the deadline, and
+  // quantile p of the ages and of the jitter; 1 and 0 without commands.
+  double compliance() const;
+  double age(double p) const;
+  double jitter(double p) const;
+  size_t commands() const { return commands_; }
+  // The jitter of the last command; negative until the third.
+  double lastJitter() const { return lastJitter_; }
+  // Whether `objective` was in violation at the last check.
+  bool violated(Objective objective) const { return violated_[objective]; }
+
+  static const char* Name(Objective objective);
+
+ private:
+  // Quantile p of `samples`, sorted in scratch_.
+  double Quantile(const std::vector<double>& samples, double p) const;
+  void Check();
+
+  Targets targets_;
+  Alert alert_;
+  size_t commands_;
+  // Rings of the window's ages and jitter, the next slots at next_ and
+  // jitterNext_.
+  std::vector<double> ages_;
+  std::vector<double> jitters_;
+  size_t next_;
+  size_t jitterNext_;
+  size_t late_;
+  std::chrono::steady_clock::time_point lastSent_;
+  double lastInterval_;
+  double lastJitter_;
+  bool violated_[OBJECTIVES];
+  mutable std::vector<double> scratch_;
+};
+
+#endif /* SLO_TRACKER_H */
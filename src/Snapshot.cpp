@@ -0,0 +1,139 @@
+#include "Snapshot.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+static const char SNAPSHOT_MAGIC[4] = {'M', 'S', 'N', 'P'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const char MANIFEST[] = "MANIFEST";
+
+struct Manifest {
+  char magic[4];
+  uint32_t version;
+  uint64_t binary;
+  uint64_t inputs;
+};
+
+// FNV-1a, 64 bits.
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static uint64_t Hash(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+// Add the contents of the file at `path` to `hash`; false if it can't be
+// read.
+static bool HashFile(const char* path, uint64_t& hash) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  uint64_t size = st.st_size;
+  hash = Hash(hash, &size, sizeof(size));
+  if (size > 0) {
+    void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    hash = Hash(hash, base, size);
+    munmap(base, size);
+  }
+  close(fd);
+  return true;
+}
+
+Snapshot::Snapshot() : binary_(0), inputs_(0), complete_(false) {}
+
+bool Snapshot::Open(const std::string& root,
+                    const std::vector<std::string>& inputs) {
+  directory_.clear();
+  complete_ = false;
+  binary_ = FNV_OFFSET;
+  if (!HashFile("/proc/self/exe", binary_)) {
+    return false;
+  }
+  // Each input's place counts, and an empty one, so that the tuning can't
+  // pass for the track.
+  inputs_ = FNV_OFFSET;
+  for (const std::string& input : inputs) {
+    bool given = !input.empty();
+    inputs_ = Hash(inputs_, &given, sizeof(given));
+    if (given && !HashFile(input.c_str(), inputs_)) {
+      return false;
+    }
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx-%016llx",
+           static_cast<unsigned long long>(binary_),
+           static_cast<unsigned long long>(inputs_));
+  std::string directory = root + name;
+  if ((mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) ||
+      (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)) {
+    return false;
+  }
+  directory_ = directory;
+  complete_ = ReadManifest();
+  return true;
+}
+
+std::string Snapshot::Path(const std::string& name) const {
+  return directory_ + "/" + name;
+}
+
+bool Snapshot::ReadManifest() const {
+  FILE* file = fopen(Path(MANIFEST).c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  Manifest manifest;
+  bool valid =
+      fread(&manifest, sizeof(manifest), 1, file) == 1 &&
+      memcmp(manifest.magic, SNAPSHOT_MAGIC, sizeof(manifest.magic)) == 0 &&
+      manifest.version == SNAPSHOT_VERSION && manifest.binary == binary_ &&
+      manifest.inputs == inputs_;
+  fclose(file);
+  return valid;
+}
+
+bool Snapshot::Commit() {
+  if (!open()) {
+    return false;
+  }
+  // Written aside and renamed into place, as the pattern files are.
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d", int(getpid()));
+  std::string path = Path(MANIFEST);
+  std::string temporary = path + suffix;
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  Manifest manifest;
+  memcpy(manifest.magic, SNAPSHOT_MAGIC, sizeof(manifest.magic));
+  manifest.version = SNAPSHOT_VERSION;
+  manifest.binary = binary_;
+  manifest.inputs = inputs_;
+  bool written = fwrite(&manifest, sizeof(manifest), 1, file) == 1;
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  complete_ = true;
+  return true;
+}
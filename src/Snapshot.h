@@ -0,0 +1,54 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the server derives at startup from its binary, tuning and track,
+// kept on disk for the next start to map instead of deriving it again: the
+// sparsity patterns of the tapes, as MpcConfig::patternCache keeps them, and
+// the track compiled, as TrackMap::Save writes it, for a track given as
+// waypoints. A node of an autoscaled fleet starting on a snapshot another
+// left skips both, and maps the track from the page cache.
+//
+// A snapshot is a directory under the root named by a hash of the binary
+// and one of the contents of the inputs, so that a snapshot is never taken
+// by a binary or configuration it wasn't made by: all of the server's
+// settings but the tuning and the track are in its binary. A MANIFEST with
+// the version and both hashes, written last and renamed into place, marks
+// it complete; until then it is being built, by this process or another,
+// and only the pattern files, each checked and renamed into place on its
+// own, are read from it.
+//
+// The tapes and the colorings of their patterns aren't kept: CppAD can't
+// write a tape, and computes the colorings in its drivers.
+class Snapshot {
+ public:
+  Snapshot();
+
+  // The snapshot under `root` for this binary and the files at `inputs`, an
+  // empty path for none, created if there is none. False if the binary or
+  // an input can't be read, or the directory can't be created.
+  bool Open(const std::string& root, const std::vector<std::string>& inputs);
+
+  bool open() const { return !directory_.empty(); }
+  // Whether it was complete when opened.
+  bool complete() const { return complete_; }
+  const std::string& directory() const { return directory_; }
+  // The file `name` in the snapshot.
+  std::string Path(const std::string& name) const;
+
+  // Mark the snapshot complete, once everything is written to it.
+  bool Commit();
+
+ private:
+  bool ReadManifest() const;
+
+  std::string directory_;
+  uint64_t binary_;
+  uint64_t inputs_;
+  bool complete_;
+};
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,39 @@
+#include "SocketOptions.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+
+bool SetNoDelay(int fd, bool enable) {
+  int value = enable;
+  return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) ==
+         0;
+}
+
+bool SetCork(int fd, bool enable) {
+  int value = enable;
+#if defined(TCP_CORK)
+  return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0;
+#elif defined(TCP_NOPUSH)
+  return setsockopt(fd, IPPROTO_TCP, TCP_NOPUSH, &value, sizeof(value)) == 0;
+#else
+  (void)fd;
+  (void)value;
+  return false;
+#endif
+}
+
+int UnsentBytes(int fd) {
+#ifdef SIOCOUTQNSD
+  int bytes;
+  if (ioctl(fd, SIOCOUTQNSD, &bytes) == 0) {
+    return bytes;
+  }
+#else
+  (void)fd;
+#endif
+  return -1;
+}
@@ -0,0 +1,21 @@
+#ifndef SOCKET_OPTIONS_H
+#define SOCKET_OPTIONS_H
+
+// TCP options of a connected socket, set per kind of connection rather than
+// left to uWS's defaults. Each returns false where the option can't be set,
+// and changes nothing then.
+
+// Send small writes at once instead of holding them for Nagle's algorithm,
+// which together with the peer's delayed ACKs can hold a steer message for
+// tens of milliseconds.
+bool SetNoDelay(int fd, bool enable);
+
+// While corked, writes are held and sent as full segments when uncorked:
+// TCP_CORK on Linux, TCP_NOPUSH on the BSDs.
+bool SetCork(int fd, bool enable);
+
+// Bytes written to `fd` that the kernel has not yet sent, SIOCOUTQNSD; -1
+// where that can't be read, which is everywhere but Linux.
+int UnsentBytes(int fd);
+
+#endif /* SOCKET_OPTIONS_H */
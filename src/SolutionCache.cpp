@@ -0,0 +1,197 @@
+#include "SolutionCache.h"
+#include <algorithm>
+#include <cmath>
+
+// A cell of each input: positions in meters, angles in radians and the
+// speed in the simulator's units, then the coefficients of the path down
+// to its curvature and its change along it.
+const double SolutionCache::STEPS[INPUTS] = {0.1, 0.1, 0.02, 1,   0.1,
+                                             0.02, 0.1, 0.02, 0.002, 0.0002};
+
+static void Inputs(const State& state, const Cubic& coeffs, double* inputs) {
+  for (size_t i = 0; i < 6; i++) {
+    inputs[i] = state[i];
+  }
+  for (size_t i = 0; i < 4; i++) {
+    inputs[6 + i] = coeffs[i];
+  }
+}
+
+SolutionCache::SolutionCache(size_t entries, size_t width, size_t points,
+                             double tolerance)
+    : width_(width), points_(points), tolerance_(tolerance),
+      entries_(entries), solutions_(entries * width),
+      trajectories_(2 * entries * points), used_(0), newest_(-1),
+      oldest_(-1), answers_(0), seeds_(0), misses_(0) {
+  size_t slots = 1;
+  while (slots < 2 * entries) {
+    slots *= 2;
+  }
+  table_.assign(slots, -1);
+  mask_ = slots - 1;
+}
+
+void SolutionCache::Quantize(size_t shape, const double* inputs,
+                             int32_t* key, uint64_t& hash) const {
+  // FNV-1a over the shape and the cells.
+  hash = 14695981039346656037ull;
+  hash = (hash ^ shape) * 1099511628211ull;
+  for (size_t i = 0; i < KEYS; i++) {
+    size_t input = INPUTS - KEYS + i;
+    double cell = std::floor(inputs[input] / STEPS[input] + 0.5);
+    key[i] = int32_t(std::min(std::max(cell, -2e9), 2e9));
+    hash = (hash ^ uint32_t(key[i])) * 1099511628211ull;
+  }
+}
+
+size_t SolutionCache::Slot(size_t shape, const int32_t* key,
+                           uint64_t hash) const {
+  size_t slot = hash & mask_;
+  while (table_[slot] >= 0) {
+    const Entry& entry = entries_[table_[slot]];
+    if (entry.hash == hash && entry.shape == shape &&
+        std::equal(key, key + KEYS, entry.key)) {
+      break;
+    }
+    slot = (slot + 1) & mask_;
+  }
+  return slot;
+}
+
+// Backward-shift deletion, which keeps every entry reachable from its home
+// slot without tombstones.
+void SolutionCache::Remove(size_t slot) {
+  size_t next = slot;
+  while (true) {
+    next = (next + 1) & mask_;
+    if (table_[next] < 0) {
+      break;
+    }
+    size_t home = entries_[table_[next]].hash & mask_;
+    // Whether home lies cyclically in (slot, next]: the entry at next can't
+    // move to slot then.
+    bool stays = slot <= next ? slot < home && home <= next
+                              : slot < home || home <= next;
+    if (!stays) {
+      table_[slot] = table_[next];
+      slot = next;
+    }
+  }
+  table_[slot] = -1;
+}
+
+void SolutionCache::Unlink(int index) {
+  Entry& entry = entries_[index];
+  if (entry.newer >= 0) {
+    entries_[entry.newer].older = entry.older;
+  } else {
+    newest_ = entry.older;
+  }
+  if (entry.older >= 0) {
+    entries_[entry.older].newer = entry.newer;
+  } else {
+    oldest_ = entry.newer;
+  }
+}
+
+void SolutionCache::PushNewest(int index) {
+  Entry& entry = entries_[index];
+  entry.newer = -1;
+  entry.older = newest_;
+  if (newest_ >= 0) {
+    entries_[newest_].newer = index;
+  } else {
+    oldest_ = index;
+  }
+  newest_ = index;
+}
+
+const SolutionCache::Entry* SolutionCache::Find(size_t shape,
+                                                const State& state,
+                                                const Cubic& coeffs,
+                                                bool& answers) {
+  answers = false;
+  double inputs[INPUTS];
+  int32_t key[KEYS];
+  uint64_t hash;
+  Inputs(state, coeffs, inputs);
+  Quantize(shape, inputs, key, hash);
+  int index = entries_.empty() ? -1 : table_[Slot(shape, key, hash)];
+  if (index < 0) {
+    misses_++;
+    return nullptr;
+  }
+  Unlink(index);
+  PushNewest(index);
+
+  const Entry& entry = entries_[index];
+  answers = tolerance_ > 0;
+  for (size_t i = 0; i < INPUTS && answers; i++) {
+    answers = std::abs(inputs[i] - entry.inputs[i]) <= tolerance_ * STEPS[i];
+  }
+  if (answers) {
+    answers_++;
+  } else {
+    seeds_++;
+  }
+  return &entry;
+}
+
+void SolutionCache::Store(size_t shape, const State& state,
+                          const Cubic& coeffs, const double* solution,
+                          size_t size, double delta, double a,
+                          const double* x, const double* y, size_t points) {
+  if (entries_.empty() || size > width_) {
+    return;
+  }
+  double inputs[INPUTS];
+  int32_t key[KEYS];
+  uint64_t hash;
+  Inputs(state, coeffs, inputs);
+  Quantize(shape, inputs, key, hash);
+  size_t slot = Slot(shape, key, hash);
+  int index = table_[slot];
+  if (index >= 0) {
+    Unlink(index);
+  } else {
+    if (used_ < entries_.size()) {
+      index = int(used_++);
+    } else {
+      // The least recently used makes way; its removal may move the empty
+      // slot found for the new entry.
+      index = oldest_;
+      Unlink(index);
+      const Entry& old = entries_[index];
+      Remove(Slot(old.shape, old.key, old.hash));
+      slot = Slot(shape, key, hash);
+    }
+    table_[slot] = index;
+  }
+  PushNewest(index);
+
+  Entry& entry = entries_[index];
+  entry.shape = shape;
+  entry.hash = hash;
+  std::copy(key, key + KEYS, entry.key);
+  std::copy(inputs, inputs + INPUTS, entry.inputs);
+  entry.delta = delta;
+  entry.a = a;
+  entry.size = size;
+  entry.points = std::min(points, points_);
+  std::copy(solution, solution + size, solutions_.begin() + index * width_);
+  double* trajectory = &trajectories_[2 * index * points_];
+  std::copy(x, x + entry.points, trajectory);
+  std::copy(y, y + entry.points, trajectory + points_);
+}
+
+const double* SolutionCache::solution(const Entry& entry) const {
+  return &solutions_[Index(&entry) * width_];
+}
+
+const double* SolutionCache::x(const Entry& entry) const {
+  return &trajectories_[2 * Index(&entry) * points_];
+}
+
+const double* SolutionCache::y(const Entry& entry) const {
+  return &trajectories_[2 * Index(&entry) * points_ + points_];
+}
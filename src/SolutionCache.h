@@ -0,0 +1,97 @@
+#ifndef SOLUTION_CACHE_H
+#define SOLUTION_CACHE_H
+
+#include <cstdint>
+#include <vector>
+#include "BicycleModel.h"
+
+// Solutions of earlier frames by their inputs, for a closed track where the
+// controller sees nearly the same state and path lap after lap.
+//
+// Entries are keyed on the problem shape and (v, cte, epsi, c0, c1, c2, c3)
+// rounded to STEPS, and evicted least recently used first. A hit is the
+// solution of a frame in the same cell, a warm start as good as the shifted
+// last one or better; and when all the inputs, the predicted position and
+// heading included, are within `tolerance` steps of that frame's, its
+// actuations and trajectory are the answer as they are. Everything is
+// allocated at construction: a hash table with linear probing of twice the
+// entries, and the solutions side by side.
+class SolutionCache {
+ public:
+  // Inputs compared, [x, y, psi, v, cte, epsi, c0, c1, c2, c3], the last
+  // KEYS of them keyed on.
+  static const size_t INPUTS = 10;
+  static const size_t KEYS = 7;
+  static const double STEPS[INPUTS];
+
+  // Up to `entries` solutions of up to `width` variables, and trajectories
+  // of up to `points` points.
+  SolutionCache(size_t entries, size_t width, size_t points,
+                double tolerance);
+
+  struct Entry {
+    size_t shape;
+    uint64_t hash;
+    int32_t key[KEYS];
+    double inputs[INPUTS];
+    double delta;
+    double a;
+    size_t size;
+    size_t points;
+    // Neighbours in the recency list, by index; -1 at its ends.
+    int newer;
+    int older;
+  };
+
+  // The entry of the cell of `state` and `coeffs` for problem `shape`, now
+  // the most recently used, and whether it answers for them; nullptr on a
+  // miss.
+  const Entry* Find(size_t shape, const State& state, const Cubic& coeffs,
+                    bool& answers);
+
+  // Keep a solution of `size` variables, its actuations and trajectory, in
+  // the cell of `state` and `coeffs`, over the one there or else the least
+  // recently used when full.
+  void Store(size_t shape, const State& state, const Cubic& coeffs,
+             const double* solution, size_t size, double delta, double a,
+             const double* x, const double* y, size_t points);
+
+  const double* solution(const Entry& entry) const;
+  const double* x(const Entry& entry) const;
+  const double* y(const Entry& entry) const;
+
+  size_t size() const { return used_; }
+  // Lookups answered from an entry, seeded by one, and missed.
+  unsigned long answers() const { return answers_; }
+  unsigned long seeds() const { return seeds_; }
+  unsigned long misses() const { return misses_; }
+
+ private:
+  void Quantize(size_t shape, const double* inputs, int32_t* key,
+                uint64_t& hash) const;
+  // The table slot holding `entry`, or of it when absent, an empty one.
+  size_t Slot(size_t shape, const int32_t* key, uint64_t hash) const;
+  void Remove(size_t slot);
+  void Unlink(int index);
+  void PushNewest(int index);
+  size_t Index(const Entry* entry) const { return entry - entries_.data(); }
+
+  size_t width_;
+  size_t points_;
+  double tolerance_;
+  std::vector<Entry> entries_;
+  std::vector<double> solutions_;
+  std::vector<double> trajectories_;
+  // Entry indices, -1 where empty.
+  std::vector<int> table_;
+  size_t mask_;
+  size_t used_;
+  int newest_;
+  int oldest_;
+
+  unsigned long answers_;
+  unsigned long seeds_;
+  unsigned long misses_;
+};
+
+#endif /* SOLUTION_CACHE_H */
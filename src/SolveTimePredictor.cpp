@@ -0,0 +1,110 @@
+#include "SolveTimePredictor.h"
+#include <cmath>
+#include <fstream>
+
+// The regression is in milliseconds, for the weights to be near 1. A new
+// tier's weights start free to move, a loaded tier's near where they were
+// fitted.
+static const double MILLISECONDS = 1e3;
+static const double FREE_VARIANCE = 1e4;
+static const double LOADED_VARIANCE = 10;
+// Forgetting inflates the covariance along the directions the features
+// don't vary in; beyond this it is held.
+static const double MAX_VARIANCE = 1e6;
+
+SolveTimePredictor::SolveTimePredictor(double forgetting)
+    : margin(1.2), minSamples(20), forgetting_(forgetting),
+      models_(DegradationLadder::NUM_TIERS) {
+  for (Model& model : models_) {
+    Reset(model, FREE_VARIANCE);
+  }
+}
+
+void SolveTimePredictor::Reset(Model& model, double variance) {
+  model.weights.setZero();
+  model.covariance = Covariance::Identity() * variance;
+  model.samples = 0;
+}
+
+SolveTimePredictor::Features SolveTimePredictor::Describe(
+    const double* state, const double* coeffs, int iterations, double load) {
+  Features x;
+  x << 1, state[3] / 100, std::fabs(2 * coeffs[2]) * 100,
+      std::fabs(state[4]), std::fabs(state[5]) * 10, iterations / 100.0,
+      load;
+  return x;
+}
+
+double SolveTimePredictor::Predict(DegradationLadder::Tier tier,
+                                   const Features& x) const {
+  double ms = models_[tier].weights.dot(x);
+  return ms > 0 ? ms / MILLISECONDS : 0;
+}
+
+DegradationLadder::Tier SolveTimePredictor::Select(const Features& x,
+                                                   double budget) const {
+  for (int t = DegradationLadder::FULL_NMPC;
+       t < DegradationLadder::LQR_FALLBACK; t++) {
+    DegradationLadder::Tier tier = DegradationLadder::Tier(t);
+    if (!trained(tier) || margin * Predict(tier, x) <= budget) {
+      return tier;
+    }
+  }
+  return DegradationLadder::LQR_FALLBACK;
+}
+
+void SolveTimePredictor::Record(DegradationLadder::Tier tier,
+                                const Features& x, double seconds) {
+  Model& m = models_[tier];
+  Features px = m.covariance * x;
+  Features gain = px / (forgetting_ + x.dot(px));
+  m.weights += gain * (seconds * MILLISECONDS - m.weights.dot(x));
+  m.covariance -= gain * px.transpose();
+  if (m.covariance.trace() < MAX_VARIANCE) {
+    m.covariance /= forgetting_;
+  }
+  m.samples++;
+}
+
+bool SolveTimePredictor::Save(const std::string& path) const {
+  std::ofstream out(path);
+  out.precision(9);
+  for (int t = 0; t < DegradationLadder::NUM_TIERS; t++) {
+    if (models_[t].samples == 0) {
+      continue;
+    }
+    out << t;
+    for (int i = 0; i < FEATURES; i++) {
+      out << ' ' << models_[t].weights[i];
+    }
+    out << '\n';
+  }
+  return bool(out);
+}
+
+bool SolveTimePredictor::Load(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::vector<Model> models = models_;
+  int tier;
+  while (in >> tier) {
+    if (tier < 0 || tier >= DegradationLadder::NUM_TIERS) {
+      return false;
+    }
+    Model& model = models[tier];
+    Reset(model, LOADED_VARIANCE);
+    for (int i = 0; i < FEATURES; i++) {
+      if (!(in >> model.weights[i])) {
+        return false;
+      }
+    }
+    model.samples = minSamples;
+  }
+  if (!in.eof()) {
+    return false;
+  }
+  models_.swap(models);
+  return true;
+}
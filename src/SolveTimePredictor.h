@@ -0,0 +1,72 @@
+#ifndef SOLVE_TIME_PREDICTOR_H
+#define SOLVE_TIME_PREDICTOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "DegradationLadder.h"
+
+// Predicts how long each tier of the DegradationLadder would take to solve
+// a frame, so that the tier can be picked before the solve instead of
+// after the misses: the most accurate whose predicted time fits the time
+// left to the deadline.
+//
+// Each tier's solve time is a linear regression on the frame's Features,
+// fitted by recursive least squares with exponential forgetting as the
+// solves come in, so that it follows the host as its load shifts. A tier
+// is trusted once it has minSamples solves; one that isn't is taken to
+// fit, so that it gets tried and learned. A model fitted offline from the
+// journal, see tools/train_predictor.cpp, can be loaded to start from.
+class SolveTimePredictor {
+ public:
+  // 1, the speed, the path's curvature, the cross track and heading
+  // errors, the iterations of the frame before and the host's load, each
+  // scaled to about 1.
+  static const int FEATURES = 7;
+  typedef Eigen::Matrix<double, FEATURES, 1> Features;
+  typedef Eigen::Matrix<double, FEATURES, FEATURES> Covariance;
+
+  explicit SolveTimePredictor(double forgetting = 0.995);
+
+  // Predicted times are stretched by `margin` before they are held against
+  // the budget.
+  double margin;
+  size_t minSamples;
+
+  // `state` as MPC::Solve takes it, `coeffs` the cubic, the solver's
+  // iterations on the frame before and the host's utilization, 0 to 1.
+  static Features Describe(const double* state, const double* coeffs,
+                           int iterations, double load);
+
+  // Seconds a solve at `tier` is expected to take, at least 0.
+  double Predict(DegradationLadder::Tier tier, const Features& x) const;
+  bool trained(DegradationLadder::Tier tier) const {
+    return models_[tier].samples >= minSamples;
+  }
+  // The most accurate tier expected to solve in `budget` seconds, or the
+  // cheapest.
+  DegradationLadder::Tier Select(const Features& x, double budget) const;
+  // Learn that a solve at `tier` took `seconds`.
+  void Record(DegradationLadder::Tier tier, const Features& x,
+              double seconds);
+
+  // The weights of the trained tiers as text, a line each, and read back;
+  // the tiers read are trusted at once. False if the file can't be
+  // written, or read.
+  bool Save(const std::string& path) const;
+  bool Load(const std::string& path);
+
+ private:
+  struct Model {
+    Features weights;
+    Covariance covariance;
+    size_t samples;
+  };
+  void Reset(Model& model, double variance);
+
+  double forgetting_;
+  std::vector<Model> models_;
+};
+
+#endif /* SOLVE_TIME_PREDICTOR_H */
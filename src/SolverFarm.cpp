@@ -0,0 +1,84 @@
+#include "SolverFarm.h"
+#include <algorithm>
+
+// The most seconds of budget a problem is given.
+static const double MAX_BUDGET = 1;
+
+SolverFarm::SolverFarm(const MpcConfig& config, size_t threads)
+    : replyMargin(0.002), mpc_(config), answered_(0), expired_(0),
+      batches_(0) {
+  mpc_.batchThreads = threads;
+  frames_.reserve(UdpChannel::MAX_PEERS);
+  requests_.reserve(UdpChannel::MAX_PEERS);
+  problems_.reserve(UdpChannel::MAX_PEERS);
+  deadlines_.reserve(UdpChannel::MAX_PEERS);
+  results_.reserve(UdpChannel::MAX_PEERS);
+  statuses_.reserve(UdpChannel::MAX_PEERS);
+}
+
+size_t SolverFarm::Serve(UdpChannel& channel,
+                         std::chrono::milliseconds timeout) {
+  size_t n = channel.ReceiveLatest(frames_, timeout);
+  auto received = std::chrono::steady_clock::now();
+  requests_.clear();
+  for (size_t i = 0; i < n; i++) {
+    const UdpChannel::Datagram& frame = frames_[i];
+    Request request;
+    if (!ParseBinaryProblem(frame.message.data(),
+                            frame.message.data() + frame.message.size(),
+                            request.problem)) {
+      continue;
+    }
+    request.peer = frame.peer;
+    request.sequence = frame.sequence;
+    // Spent, or NaN.
+    if (!(request.problem.budget > replyMargin)) {
+      expired_++;
+      continue;
+    }
+    std::chrono::duration<double> budget(
+        std::min(request.problem.budget, MAX_BUDGET) - replyMargin);
+    request.deadline =
+        received +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            budget);
+    requests_.push_back(request);
+  }
+  if (requests_.empty()) {
+    return 0;
+  }
+  std::sort(requests_.begin(), requests_.end(),
+            [](const Request& a, const Request& b) {
+              return a.deadline < b.deadline;
+            });
+
+  size_t count = requests_.size();
+  problems_.resize(count);
+  deadlines_.resize(count);
+  // The actuations only; the trajectories stay on the farm.
+  MPC::Result result = {0, 0, nullptr, nullptr, 0, 0};
+  results_.assign(count, result);
+  statuses_.resize(count);
+  for (size_t k = 0; k < count; k++) {
+    const Request& request = requests_[k];
+    problems_[k].state = Eigen::Map<const State>(request.problem.state);
+    problems_[k].coeffs = Eigen::Map<const Cubic>(request.problem.coeffs);
+    deadlines_[k] = request.deadline;
+  }
+  mpc_.SolveBatch(problems_.data(), results_.data(), count, statuses_.data(),
+                  deadlines_.data());
+  batches_++;
+
+  for (size_t k = 0; k < count; k++) {
+    const Request& request = requests_[k];
+    BinaryActuation actuation;
+    actuation.deadline = request.problem.deadline;
+    actuation.delta = results_[k].delta;
+    actuation.a = results_[k].a;
+    actuation.status = statuses_[k];
+    WriteBinaryActuation(msg_, actuation);
+    channel.Send(request.peer, request.sequence, msg_);
+  }
+  answered_ += count;
+  return count;
+}
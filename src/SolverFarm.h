@@ -0,0 +1,75 @@
+#ifndef SOLVER_FARM_H
+#define SOLVER_FARM_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BinaryProtocol.h"
+#include "MPC.h"
+#include "MpcConfig.h"
+#include "UdpChannel.h"
+
+// A solver farm, for vehicles with too little compute to solve their own
+// frames: each vehicle's FarmClient fits and predicts its frame itself and
+// sends only the problem, a BinaryProblem of ten doubles and its deadline,
+// as a datagram of UdpChannel. The farm takes every problem waiting, of
+// UdpChannel::MAX_PEERS vehicles at most, the newest of each, and solves
+// them in one MPC::SolveBatch across its cores, earliest deadline first,
+// each stopped at its deadline; the answers go back numbered as the
+// problems, with their deadline tags.
+//
+// A problem's budget counts from its arrival here, less replyMargin for
+// the answer's way back. One whose budget is spent before its batch starts
+// is dropped unanswered, since the vehicle has fallen back on its own
+// controller by then. Not thread-safe: one thread serves the channel.
+class SolverFarm {
+ public:
+  // Solving with `threads` threads, 0 for one per core, see
+  // MPC::batchThreads.
+  SolverFarm(const MpcConfig& config, size_t threads);
+
+  SolverFarm(const SolverFarm&) = delete;
+  SolverFarm& operator=(const SolverFarm&) = delete;
+
+  // The batch solver, whose method and options the batches take.
+  MPC& mpc() { return mpc_; }
+
+  // Seconds of each budget kept for the answer to reach its vehicle.
+  double replyMargin;
+
+  // Wait up to `timeout` for problems, then solve and answer all that are
+  // waiting; returns how many were answered.
+  size_t Serve(UdpChannel& channel, std::chrono::milliseconds timeout);
+
+  // Problems answered, those dropped with their budgets spent, and the
+  // batches solved.
+  uint64_t answered() const { return answered_; }
+  uint64_t expired() const { return expired_; }
+  uint64_t batches() const { return batches_; }
+
+ private:
+  struct Request {
+    size_t peer;
+    uint32_t sequence;
+    BinaryProblem problem;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  MPC mpc_;
+  std::vector<UdpChannel::Datagram> frames_;
+  // The batch, in deadline order.
+  std::vector<Request> requests_;
+  std::vector<MPC::BatchProblem, Eigen::aligned_allocator<MPC::BatchProblem> >
+      problems_;
+  std::vector<std::chrono::steady_clock::time_point> deadlines_;
+  std::vector<MPC::Result> results_;
+  std::vector<MPC::Status> statuses_;
+  std::string msg_;
+  uint64_t answered_;
+  uint64_t expired_;
+  uint64_t batches_;
+};
+
+#endif /* SOLVER_FARM_H */
@@ -0,0 +1,154 @@
+#include "SparseQP.h"
+#include <algorithm>
+#include <cmath>
+
+// Equality rows are penalized this much more than inequality rows.
+static const double EQUALITY_RHO_SCALE = 1e3;
+// Residuals are only checked every this many iterations.
+static const int CHECK_INTERVAL = 5;
+// rho is rescaled when the residual balance calls for a change of more than
+// this factor, which costs a numeric refactorization.
+static const double RHO_ADAPT_FACTOR = 5;
+static const double RHO_MIN = 1e-6;
+static const double RHO_MAX = 1e6;
+
+SparseQP::SparseQP()
+    : rho(0.1), sigma(1e-6), alpha(1.6), epsAbs(1e-4), epsRel(1e-4),
+      maxIterations(4000), fixedIterations(0), n_(0), m_(0), rho_(0.1),
+      factorized_(false), converged_(false) {}
+
+void SparseQP::Setup(const SpMat& P, const SpMat& C,
+                     const std::vector<bool>& equality) {
+  n_ = P.rows();
+  m_ = C.rows();
+  P_ = P;
+  C_ = C;
+  C_.makeCompressed();
+
+  rho_ = rho;
+  rho_vec_.resize(m_);
+  for (int i = 0; i < m_; i++) {
+    rho_vec_[i] = equality[i] ? rho * EQUALITY_RHO_SCALE : rho;
+  }
+
+  // Upper triangle of the KKT matrix. Explicit zeros in C stay in the
+  // pattern so that SetConstraint() never has to insert.
+  std::vector<Eigen::Triplet<double> > t;
+  for (int j = 0; j < P.outerSize(); j++) {
+    for (SpMat::InnerIterator it(P, j); it; ++it) {
+      if (it.row() <= it.col()) {
+        t.push_back(Eigen::Triplet<double>(it.row(), it.col(), it.value()));
+      }
+    }
+  }
+  for (int i = 0; i < n_; i++) {
+    t.push_back(Eigen::Triplet<double>(i, i, sigma));
+  }
+  for (int j = 0; j < C.outerSize(); j++) {
+    for (SpMat::InnerIterator it(C, j); it; ++it) {
+      t.push_back(Eigen::Triplet<double>(it.col(), n_ + it.row(), it.value()));
+    }
+  }
+  for (int i = 0; i < m_; i++) {
+    t.push_back(Eigen::Triplet<double>(n_ + i, n_ + i, -1 / rho_vec_[i]));
+  }
+  K_.resize(n_ + m_, n_ + m_);
+  K_.setFromTriplets(t.begin(), t.end());
+  K_.makeCompressed();
+  ldlt_.analyzePattern(K_);
+  factorized_ = false;
+
+  x_ = Eigen::VectorXd::Zero(n_);
+  z_ = Eigen::VectorXd::Zero(m_);
+  y_ = Eigen::VectorXd::Zero(m_);
+  zt_ = Eigen::VectorXd::Zero(m_);
+  rhs_ = Eigen::VectorXd::Zero(n_ + m_);
+  sol_ = Eigen::VectorXd::Zero(n_ + m_);
+  cx_ = Eigen::VectorXd::Zero(m_);
+  px_ = Eigen::VectorXd::Zero(n_);
+  cty_ = Eigen::VectorXd::Zero(n_);
+}
+
+void SparseQP::SetConstraint(int row, int col, double value) {
+  C_.coeffRef(row, col) = value;
+  K_.coeffRef(col, n_ + row) = value;
+  factorized_ = false;
+}
+
+void SparseQP::WarmStart(const Eigen::VectorXd& x) {
+  x_ = x;
+  z_.noalias() = C_ * x_;
+}
+
+int SparseQP::Solve(const Eigen::VectorXd& q, const Eigen::VectorXd& l,
+                    const Eigen::VectorXd& u) {
+  Factorize();
+
+  converged_ = false;
+  int limit = fixedIterations > 0 ? fixedIterations : maxIterations;
+  int iter = 0;
+  while (iter < limit) {
+    iter++;
+    rhs_.head(n_) = sigma * x_ - q;
+    rhs_.tail(m_).array() = z_.array() - y_.array() / rho_vec_.array();
+    sol_ = ldlt_.solve(rhs_);
+
+    // Relaxed updates; zt_ holds alpha * z~ + (1 - alpha) * z.
+    zt_.array() = z_.array() + (sol_.tail(m_).array() - y_.array()) /
+                                   rho_vec_.array();
+    zt_ = alpha * zt_ + (1 - alpha) * z_;
+    x_ = alpha * sol_.head(n_) + (1 - alpha) * x_;
+    z_.array() = (zt_.array() + y_.array() / rho_vec_.array())
+                     .max(l.array())
+                     .min(u.array());
+    y_.array() += rho_vec_.array() * (zt_.array() - z_.array());
+
+    if (fixedIterations > 0 ? iter < limit : iter % CHECK_INTERVAL != 0) {
+      continue;
+    }
+    cx_.noalias() = C_ * x_;
+    px_.noalias() = P_ * x_;
+    cty_.noalias() = C_.transpose() * y_;
+    double prim = (cx_ - z_).lpNorm<Eigen::Infinity>();
+    double dual = (px_ + q + cty_).lpNorm<Eigen::Infinity>();
+    double prim_scale = std::max(cx_.lpNorm<Eigen::Infinity>(),
+                                 z_.lpNorm<Eigen::Infinity>());
+    double dual_scale = std::max(std::max(px_.lpNorm<Eigen::Infinity>(),
+                                          cty_.lpNorm<Eigen::Infinity>()),
+                                 q.lpNorm<Eigen::Infinity>());
+    if (prim <= epsAbs + epsRel * prim_scale &&
+        dual <= epsAbs + epsRel * dual_scale) {
+      converged_ = true;
+      break;
+    }
+    if (fixedIterations > 0) {
+      break;
+    }
+
+    // Balance the primal and dual residuals, relative to their scales.
+    double ratio = std::sqrt((prim / (prim_scale + 1e-10)) /
+                             (dual / (dual_scale + 1e-10) + 1e-10));
+    double next = std::min(std::max(rho_ * ratio, RHO_MIN), RHO_MAX);
+    if (next > RHO_ADAPT_FACTOR * rho_ || next < rho_ / RHO_ADAPT_FACTOR) {
+      UpdateRho(next);
+      Factorize();
+    }
+  }
+  return iter;
+}
+
+void SparseQP::UpdateRho(double next) {
+  rho_vec_ *= next / rho_;
+  rho_ = next;
+  for (int i = 0; i < m_; i++) {
+    K_.coeffRef(n_ + i, n_ + i) = -1 / rho_vec_[i];
+  }
+  factorized_ = false;
+}
+
+void SparseQP::Factorize() {
+  if (!factorized_) {
+    ldlt_.factorize(K_);
+    factorized_ = true;
+  }
+}
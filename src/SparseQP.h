@@ -0,0 +1,89 @@
+#ifndef SPARSE_QP_H
+#define SPARSE_QP_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCore"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+
+// Convex QP solver in the style of OSQP:
+//
+//   minimize    1/2 x' P x + q' x
+//   subject to  l <= C x <= u
+//
+// by ADMM on the quasi-definite KKT matrix
+//
+//   [ P + sigma I       C'       ]
+//   [      C       -diag(1/rho)  ].
+//
+// The sparsity pattern of P and C is fixed at Setup(), which also orders and
+// analyzes the KKT matrix. Afterwards constraint values can be changed in
+// place; the next Solve() refactorizes numerically and then iterates with
+// one sparse triangular solve per iteration into preallocated vectors. As in
+// OSQP, rho is rescaled (and the KKT matrix refactorized) when the primal and
+// dual residuals drift far apart.
+class SparseQP {
+ public:
+  typedef Eigen::SparseMatrix<double> SpMat;
+
+  SparseQP();
+
+  // ADMM parameters, read by Setup() (rho, sigma) and Solve() (the rest).
+  double rho;
+  double sigma;
+  double alpha;
+  double epsAbs;
+  double epsRel;
+  int maxIterations;
+  // Run exactly this many iterations, at rho as it stands, checking the
+  // tolerances only after the last; 0 to iterate to the tolerances.
+  int fixedIterations;
+
+  // P must be symmetric; only its upper triangle is used for the KKT matrix.
+  // Rows of C flagged in `equality` get a larger penalty, as in OSQP, since
+  // their bounds are always active.
+  void Setup(const SpMat& P, const SpMat& C, const std::vector<bool>& equality);
+
+  // Overwrite C(row, col), which must be part of the pattern given to Setup().
+  void SetConstraint(int row, int col, double value);
+
+  // Start the next Solve() from x, with z = C x. The multipliers are kept.
+  void WarmStart(const Eigen::VectorXd& x);
+
+  // Run ADMM from the current iterate and return the number of iterations.
+  int Solve(const Eigen::VectorXd& q, const Eigen::VectorXd& l,
+            const Eigen::VectorXd& u);
+
+  // Whether the last Solve() met the tolerances before maxIterations.
+  bool converged() const { return converged_; }
+  const Eigen::VectorXd& solution() const { return x_; }
+
+ private:
+  // Move the inequality penalty to `next`, keeping the equality ratio.
+  void UpdateRho(double next);
+  void Factorize();
+
+  int n_;
+  int m_;
+  // rho as adapted by the last Solve().
+  double rho_;
+  SpMat P_;
+  SpMat C_;
+  SpMat K_;
+  Eigen::SimplicialLDLT<SpMat, Eigen::Upper> ldlt_;
+  bool factorized_;
+  bool converged_;
+
+  Eigen::VectorXd rho_vec_;
+  Eigen::VectorXd x_;
+  Eigen::VectorXd z_;
+  Eigen::VectorXd y_;
+  Eigen::VectorXd zt_;
+  Eigen::VectorXd rhs_;
+  Eigen::VectorXd sol_;
+  Eigen::VectorXd cx_;
+  Eigen::VectorXd px_;
+  Eigen::VectorXd cty_;
+};
+
+#endif /* SPARSE_QP_H */
@@ -0,0 +1,104 @@
+#include "Speculator.h"
+#include <algorithm>
+#include <cmath>
+
+// Smoothing of the frame interval.
+static const double INTERVAL_WEIGHT = 0.2;
+// Integration step of the prediction, in seconds.
+static const double STEP = 0.01;
+// The simulator reports speed in mph and positions in meters.
+static const double MPH_TO_MPS = 0.44704;
+
+Speculator::Speculator(double Lf)
+    : positionTolerance(0.1), headingTolerance(0.005), speedTolerance(0.5),
+      steeringTolerance(0.005), throttleTolerance(0.02), Lf_(Lf),
+      steering_(0), throttle_(0), has_last_(false), interval_(0),
+      predicted_steering_(0), predicted_throttle_(0), has_prediction_(false),
+      hits_(0), misses_(0) {}
+
+void Speculator::Answered(const Telemetry& t, double steering,
+                          double throttle) {
+  if (has_last_) {
+    double seconds =
+        std::chrono::duration<double>(t.received - last_.received).count();
+    interval_ = interval_ == 0 ? seconds
+                               : (1 - INTERVAL_WEIGHT) * interval_ +
+                                     INTERVAL_WEIGHT * seconds;
+  }
+  last_ = t;
+  steering_ = steering;
+  throttle_ = throttle;
+  has_last_ = true;
+}
+
+bool Speculator::Predict(Telemetry& next) const {
+  if (!has_last_ || interval_ <= 0 || has_prediction_) {
+    return false;
+  }
+  next = last_;
+  next.received =
+      last_.received +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(interval_));
+  double x = last_.px;
+  double y = last_.py;
+  double psi = last_.psi;
+  double v = last_.v;
+  for (double t = 0; t < interval_; t += STEP) {
+    double h = std::min(STEP, interval_ - t);
+    bool commanded = t >= last_.latency;
+    double delta = commanded ? steering_ : last_.delta;
+    double a = commanded ? throttle_ : last_.a;
+    x += v * MPH_TO_MPS * cos(psi) * h;
+    y += v * MPH_TO_MPS * sin(psi) * h;
+    // The simulator's steering angle turns the other way from the model's.
+    psi -= v * MPH_TO_MPS * delta / Lf_ * h;
+    v += a * h;
+  }
+  next.px = x;
+  next.py = y;
+  next.psi = psi;
+  next.v = v;
+  next.delta = steering_;
+  next.a = throttle_;
+  // The last frame's fit and state don't hold from the predicted pose.
+  next.prepared = false;
+  return true;
+}
+
+void Speculator::Store(const Telemetry& predicted, double steering,
+                       double throttle) {
+  predicted_ = predicted;
+  predicted_steering_ = steering;
+  predicted_throttle_ = throttle;
+  has_prediction_ = true;
+}
+
+bool Speculator::Take(const Telemetry& t, std::string& msg, double& steering,
+                      double& throttle) {
+  if (!has_prediction_) {
+    return false;
+  }
+  has_prediction_ = false;
+  const Telemetry& p = predicted_;
+  // The waypoints are the same unless the simulator moved on to the next
+  // batch, which changes the fit.
+  bool match = t.binary == p.binary && t.n_waypoints == p.n_waypoints &&
+               std::equal(t.ptsx, t.ptsx + t.n_waypoints, p.ptsx) &&
+               std::equal(t.ptsy, t.ptsy + t.n_waypoints, p.ptsy) &&
+               std::hypot(t.px - p.px, t.py - p.py) <= positionTolerance &&
+               std::fabs(remainder(t.psi - p.psi, 2 * M_PI)) <=
+                   headingTolerance &&
+               std::fabs(t.v - p.v) <= speedTolerance &&
+               std::fabs(t.delta - p.delta) <= steeringTolerance &&
+               std::fabs(t.a - p.a) <= throttleTolerance;
+  if (!match) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  msg.swap(msg_);
+  steering = predicted_steering_;
+  throttle = predicted_throttle_;
+  return true;
+}
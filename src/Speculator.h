@@ -0,0 +1,73 @@
+#ifndef SPECULATOR_H
+#define SPECULATOR_H
+
+#include <chrono>
+#include <string>
+#include "Telemetry.h"
+
+// Predicts the next telemetry frame from the last one and the command sent
+// for it, so that the controller can solve for it before it arrives.
+//
+// The car is integrated forward in the simulator's world frame over the
+// measured frame interval: the actuations it reported hold for the frame's
+// estimated latency, then the command takes over, with the same kinematic
+// model as the latency compensation in main.cpp. A reply computed for the
+// prediction is kept, and given out if the real frame turns out to be
+// within tolerance of it.
+class Speculator {
+ public:
+  explicit Speculator(double Lf);
+
+  // Largest differences between a frame and its prediction for the reply
+  // to be reused: world position, heading, speed, reported steering angle
+  // and throttle.
+  double positionTolerance;
+  double headingTolerance;
+  double speedTolerance;
+  double steeringTolerance;
+  double throttleTolerance;
+
+  // Note the frame just answered and the actuations sent for it: steering
+  // in radians as the simulator reports it, and throttle.
+  void Answered(const Telemetry& t, double steering, double throttle);
+
+  // The predicted next frame. False until the frame interval is known, or
+  // if there is already a reply for the prediction.
+  bool Predict(Telemetry& next) const;
+
+  // Where the reply for the predicted frame is written, before Store().
+  std::string& reply() { return msg_; }
+
+  // Keep the reply written to reply() for the predicted frame.
+  void Store(const Telemetry& predicted, double steering, double throttle);
+
+  // If `t` matches the stored prediction, move its reply and actuations
+  // out. The prediction is used up either way.
+  bool Take(const Telemetry& t, std::string& msg, double& steering,
+            double& throttle);
+
+  unsigned long hits() const { return hits_; }
+  unsigned long misses() const { return misses_; }
+
+ private:
+  double Lf_;
+
+  // The last frame answered and its command.
+  Telemetry last_;
+  double steering_;
+  double throttle_;
+  bool has_last_;
+  // Smoothed time between frames, in seconds; 0 until measured.
+  double interval_;
+
+  Telemetry predicted_;
+  std::string msg_;
+  double predicted_steering_;
+  double predicted_throttle_;
+  bool has_prediction_;
+
+  unsigned long hits_;
+  unsigned long misses_;
+};
+
+#endif /* SPECULATOR_H */
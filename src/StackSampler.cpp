@@ -0,0 +1,226 @@
+#include "StackSampler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define STACK_SAMPLER_WALKS
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#endif
+
+#ifdef STACK_SAMPLER_WALKS
+
+namespace {
+
+const int DEPTH = 48;
+
+// Written by the handler between two stores of its sequence: odd while it
+// writes sample n into the slot, 2n + 2 once it is done.
+struct Sample {
+  std::atomic<uint64_t> sequence;
+  int64_t time;
+  const char* thread;
+  int depth;
+  uintptr_t pcs[DEPTH];
+};
+
+// Zero-initialized as statics.
+Sample samples[STACK_SAMPLES];
+std::atomic<uint64_t> taken;
+
+// Where the calling thread's stack ends, and its name; zero for a thread
+// that didn't call SampleThread.
+struct Stack {
+  uintptr_t high;
+  const char* name;
+};
+thread_local Stack stack;
+
+int64_t Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Async-signal-safe: stores to the ring and loads from the stack, within
+// the interrupted stack pointer and the end of the thread's stack.
+void Sample(int, siginfo_t*, void* context) {
+  int saved = errno;
+  const mcontext_t& m = static_cast<ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+  uintptr_t pc = m.gregs[REG_RIP];
+  uintptr_t fp = m.gregs[REG_RBP];
+  uintptr_t low = m.gregs[REG_RSP];
+#else
+  uintptr_t pc = m.pc;
+  uintptr_t fp = m.regs[29];
+  uintptr_t low = m.sp;
+#endif
+  uint64_t n = taken.fetch_add(1, std::memory_order_relaxed);
+  struct Sample& s = samples[n % STACK_SAMPLES];
+  s.sequence.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s.time = Now();
+  s.thread = stack.name;
+  int depth = 0;
+  s.pcs[depth++] = pc;
+  // Each frame holds the caller's frame pointer and the return address,
+  // and lies above the frame it called.
+  while (depth < DEPTH && fp >= low && fp % sizeof(uintptr_t) == 0 &&
+         fp + 2 * sizeof(uintptr_t) <= stack.high) {
+    const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+    if (frame[1] == 0) {
+      break;
+    }
+    // Within the call, for the symbol of a call that ends a function.
+    s.pcs[depth++] = frame[1] - 1;
+    low = fp + 2 * sizeof(uintptr_t);
+    fp = frame[0];
+  }
+  s.depth = depth;
+  s.sequence.store(2 * n + 2, std::memory_order_release);
+  errno = saved;
+}
+
+// The function at `pc`, demangled; or its module and offset.
+std::string Symbolize(uintptr_t pc) {
+  Dl_info info;
+  void* entry = nullptr;
+  if (!dladdr1(reinterpret_cast<void*>(pc), &info, &entry, RTLD_DL_SYMENT)) {
+    char text[32];
+    snprintf(text, sizeof(text), "0x%llx", (unsigned long long)pc);
+    return text;
+  }
+  // dladdr names the nearest symbol below, which needn't hold `pc` when
+  // the function holding it isn't exported.
+  const ElfW(Sym)* symbol = static_cast<const ElfW(Sym)*>(entry);
+  uintptr_t start = reinterpret_cast<uintptr_t>(info.dli_saddr);
+  if (info.dli_sname && symbol &&
+      (symbol->st_size == 0 || pc < start + symbol->st_size)) {
+    int status;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr,
+                                          &status);
+    std::string name = demangled ? demangled : info.dli_sname;
+    free(demangled);
+    // The separator of the folded format.
+    std::replace(name.begin(), name.end(), ';', ':');
+    return name;
+  }
+  std::string module = info.dli_fname ? info.dli_fname : "";
+  module = module.substr(module.rfind('/') + 1);
+  char offset[32];
+  snprintf(offset, sizeof(offset), "+0x%llx",
+           (unsigned long long)(pc - uintptr_t(info.dli_fbase)));
+  return module + offset;
+}
+
+}  // namespace
+
+bool StartStackSampler(int hz) {
+  if (hz <= 0 || hz > 1000000) {
+    return false;
+  }
+  struct sigaction action;
+  action.sa_sigaction = Sample;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  if (sigaction(SIGPROF, &action, nullptr) != 0) {
+    return false;
+  }
+  itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = std::max(1, 1000000 / hz);
+  timer.it_value = timer.it_interval;
+  return setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+}
+
+void SampleThread(const char* name) {
+  pthread_attr_t attr;
+  void* base;
+  size_t size;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+    return;
+  }
+  if (pthread_attr_getstack(&attr, &base, &size) == 0) {
+    stack.name = name;
+    stack.high = reinterpret_cast<uintptr_t>(base) + size;
+  }
+  pthread_attr_destroy(&attr);
+}
+
+uint64_t StackSamples() { return taken.load(std::memory_order_relaxed); }
+
+void WriteFoldedStacks(std::string& out, double seconds) {
+  out.clear();
+  int64_t since = Now() - int64_t(seconds * 1e9);
+  uint64_t end = taken.load(std::memory_order_acquire);
+  uint64_t begin = end > STACK_SAMPLES ? end - STACK_SAMPLES : 0;
+  // The thread's name, then the stack from the leaf out.
+  std::map<std::vector<uintptr_t>, uint64_t> stacks;
+  std::vector<uintptr_t> key;
+  for (uint64_t n = begin; n < end; n++) {
+    const struct Sample& s = samples[n % STACK_SAMPLES];
+    uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+    int64_t time = s.time;
+    const char* thread = s.thread;
+    int depth = std::min(std::max(s.depth, 0), DEPTH);
+    key.assign(1, reinterpret_cast<uintptr_t>(thread));
+    key.insert(key.end(), s.pcs, s.pcs + depth);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Torn by the handler meanwhile, or already overwritten.
+    if (sequence != 2 * n + 2 ||
+        s.sequence.load(std::memory_order_relaxed) != sequence ||
+        time < since) {
+      continue;
+    }
+    stacks[key]++;
+  }
+
+  // Symbols stay put, and are slow to look up. The stacks of different
+  // instructions in the same functions fold into one.
+  static std::mutex mutex;
+  static std::unordered_map<uintptr_t, std::string> names;
+  std::map<std::string, uint64_t> folded;
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto& entry : stacks) {
+    const char* thread = reinterpret_cast<const char*>(entry.first[0]);
+    std::string line = thread ? thread : "thread";
+    for (size_t i = entry.first.size() - 1; i > 0; i--) {
+      auto name = names.find(entry.first[i]);
+      if (name == names.end()) {
+        name = names.emplace(entry.first[i], Symbolize(entry.first[i])).first;
+      }
+      line += ';';
+      line += name->second;
+    }
+    folded[line] += entry.second;
+  }
+  for (const auto& entry : folded) {
+    out += entry.first;
+    out += ' ';
+    out += std::to_string(entry.second);
+    out += '\n';
+  }
+}
+
+#else
+
+bool StartStackSampler(int) { return false; }
+void SampleThread(const char*) {}
+uint64_t StackSamples() { return 0; }
+void WriteFoldedStacks(std::string& out, double) { out.clear(); }
+
+#endif
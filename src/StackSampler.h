@@ -0,0 +1,37 @@
+#ifndef STACK_SAMPLER_H
+#define STACK_SAMPLER_H
+
+#include <cstdint>
+#include <string>
+
+// An always-on sampling profiler, for what the threads spend their time on
+// under production load without attaching perf or a debugger. A SIGPROF
+// from setitimer(2) interrupts whichever thread is running every 1/hz
+// seconds of the process's CPU time; its handler walks the frame pointers
+// of the interrupted stack into a ring of the last SAMPLES samples, with no
+// locks or allocation. Reading the ring folds the samples into the format
+// of flamegraph.pl and speedscope.
+//
+// The walk follows the chain of saved frame pointers, so only code built
+// with them, the MPC_FRAME_POINTERS build, has its callers; elsewhere the
+// stacks are cut short, or miss frames. Only threads that called
+// SampleThread, which knows where their stack ends, are walked; the others
+// are sampled at the interrupted instruction alone. Linux on x86-64 and
+// AArch64 only; elsewhere StartStackSampler fails.
+static const size_t STACK_SAMPLES = 4096;
+
+// Start sampling at `hz` samples a second of CPU time. False if the timer
+// or the handler can't be set, and nothing is sampled.
+bool StartStackSampler(int hz);
+// Walk the calling thread's stack when it is sampled, its stacks folded
+// under `name`, which must outlive the thread.
+void SampleThread(const char* name);
+// The samples taken so far.
+uint64_t StackSamples();
+// The samples of the last `seconds` as folded stacks: a line each of the
+// thread's name and the functions from the outermost in, separated by
+// semicolons, then the samples of that stack. Functions without a symbol
+// are their module and offset, for addr2line.
+void WriteFoldedStacks(std::string& out, double seconds);
+
+#endif /* STACK_SAMPLER_H */
@@ -0,0 +1,40 @@
+#include "StagePool.h"
+#include <algorithm>
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+
+StagePool::StagePool(size_t threads)
+    : threads_(threads < 1 ? 1 : threads), pending_(0) {
+  if (threads_ > 1) {
+    pool_.reset(new Eigen::NonBlockingThreadPool(int(threads_ - 1)));
+  }
+}
+
+StagePool::~StagePool() {}
+
+void StagePool::Run(size_t begin, size_t end,
+                    const std::function<void(size_t, size_t)>& stages) {
+  size_t n = end - begin;
+  size_t parts = std::min(threads_, n);
+  if (parts <= 1) {
+    stages(begin, end);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = parts - 1;
+  }
+  for (size_t i = 1; i < parts; i++) {
+    size_t from = begin + n * i / parts;
+    size_t to = begin + n * (i + 1) / parts;
+    pool_->Schedule([this, &stages, from, to]() {
+      stages(from, to);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) {
+        done_.notify_one();
+      }
+    });
+  }
+  stages(begin, begin + n / parts);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return pending_ == 0; });
+}
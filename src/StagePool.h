@@ -0,0 +1,47 @@
+#ifndef STAGE_POOL_H
+#define STAGE_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace Eigen {
+template <typename Environment> class NonBlockingThreadPoolTempl;
+struct StlThreadEnvironment;
+}
+
+// A few threads to split the stage loops of one evaluator between, on
+// Eigen's non-blocking thread pool.
+//
+// Run() cuts [begin, end) into one contiguous range per thread, the calling
+// thread taking the first, and returns when all are done. Each stage writes
+// only its own outputs, so the results are the same bit for bit as the
+// serial loop's, whatever the split.
+class StagePool {
+ public:
+  // `threads` counts the calling thread: 1 runs everything serially.
+  explicit StagePool(size_t threads);
+  ~StagePool();
+
+  StagePool(const StagePool&) = delete;
+  StagePool& operator=(const StagePool&) = delete;
+
+  size_t threads() const { return threads_; }
+
+  void Run(size_t begin, size_t end,
+           const std::function<void(size_t, size_t)>& stages);
+
+ private:
+  typedef Eigen::NonBlockingThreadPoolTempl<Eigen::StlThreadEnvironment>
+      ThreadPool;
+
+  size_t threads_;
+  std::unique_ptr<ThreadPool> pool_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  size_t pending_;
+};
+
+#endif /* STAGE_POOL_H */
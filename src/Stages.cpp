@@ -0,0 +1,33 @@
+#include "Stages.h"
+#include <cstdio>
+
+static const char* const NAMES[STAGE_COUNT] = {
+    "receive", "has_data", "parse",     "transform",      "polyfit",
+    "prepare", "solve",    "eval",      "linear_algebra", "serialize",
+    "send",    "wire"};
+
+static Histogram histograms[STAGE_COUNT];
+
+const char* StageName(Stage stage) { return NAMES[stage]; }
+
+Histogram& StageHistogram(Stage stage) { return histograms[stage]; }
+
+void PrintStages(std::ostream& out) {
+  char line[160];
+  snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s %10s\n",
+           "stage (us)", "count", "mean", "p50", "p90", "p99", "p99.9");
+  out << line;
+  Histogram::Snapshot s;
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    histograms[i].Read(s);
+    if (s.count == 0) {
+      continue;
+    }
+    snprintf(line, sizeof(line),
+             "%-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", NAMES[i],
+             (unsigned long long)s.count, s.sum / s.count * 1e6,
+             s.Percentile(0.5) * 1e6, s.Percentile(0.9) * 1e6,
+             s.Percentile(0.99) * 1e6, s.Percentile(0.999) * 1e6);
+    out << line;
+  }
+}
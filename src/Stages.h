@@ -0,0 +1,59 @@
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <chrono>
+#include <ostream>
+#include "Histogram.h"
+#include "Trace.h"
+
+// Where the time of a frame goes: one histogram per stage of the pipeline,
+// for the whole process, recorded from whichever thread runs the stage. The
+// hardware events of some stages are counted in PerfCounters.h.
+enum Stage {
+  // From receipt of a frame until its worker starts on it.
+  STAGE_RECEIVE,
+  STAGE_HAS_DATA,
+  STAGE_PARSE,
+  // The waypoints to vehicle coordinates, and the fit.
+  STAGE_TRANSFORM,
+  STAGE_POLYFIT,
+  // Fitting a frame and predicting its state ahead of its solve, see
+  // Session::Preparer.
+  STAGE_PREPARE,
+  // MPC::Solve, and for Ipopt the parts of it in evaluating the problem and
+  // in the linear solver.
+  STAGE_SOLVE,
+  STAGE_EVAL,
+  STAGE_LINEAR_ALGEBRA,
+  // Writing the steer message, and handing it to the socket.
+  STAGE_SERIALIZE,
+  STAGE_SEND,
+  // From handing it to the socket until the kernel has sent the last of
+  // it, where that can be told; to the next millisecond when it isn't sent
+  // at once.
+  STAGE_WIRE,
+  STAGE_COUNT
+};
+
+const char* StageName(Stage stage);
+Histogram& StageHistogram(Stage stage);
+
+inline void RecordStage(Stage stage, double seconds) {
+  StageHistogram(stage).Record(seconds);
+}
+
+// The time from `start` to now, also traced when tracing is on.
+inline void RecordStage(Stage stage,
+                        std::chrono::steady_clock::time_point start) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  RecordStage(stage, std::chrono::duration<double>(now - start).count());
+  if (TracingEnabled()) {
+    TraceEvent(StageName(stage), start, now);
+  }
+}
+
+// One line per stage with samples: the count, mean, p50, p90, p99 and
+// p99.9.
+void PrintStages(std::ostream& out);
+
+#endif /* STAGES_H */
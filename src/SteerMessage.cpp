@@ -0,0 +1,74 @@
+#include "SteerMessage.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// Every decimal of up to 15 significant digits survives the trip through a
+// double, and 17 are always enough to tell doubles apart.
+static const int MIN_ROUND_TRIP_DIGITS = 15;
+static const int MAX_ROUND_TRIP_DIGITS = 17;
+
+void AppendDouble(std::string& out, double x) {
+  if (!std::isfinite(x)) {
+    out += "null";
+    return;
+  }
+  // %.15g of a double with a shorter representation is that representation,
+  // since %g drops the trailing zeros, so the first precision that reads
+  // back is the shortest.
+  char buffer[32];
+  int n = 0;
+  for (int digits = MIN_ROUND_TRIP_DIGITS; digits <= MAX_ROUND_TRIP_DIGITS;
+       digits++) {
+    n = snprintf(buffer, sizeof(buffer), "%.*g", digits, x);
+    if (digits == MAX_ROUND_TRIP_DIGITS || strtod(buffer, nullptr) == x) {
+      break;
+    }
+  }
+  out.append(buffer, n);
+}
+
+static void AppendArray(std::string& out, const char* key, const double* x,
+                        size_t n) {
+  out += key;
+  out += '[';
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0) {
+      out += ',';
+    }
+    AppendDouble(out, x[i]);
+  }
+  out += ']';
+}
+
+void WriteSteer(std::string& out, double steering, double throttle,
+                const double* mpc_x, const double* mpc_y, size_t n_mpc,
+                const double* next_x, const double* next_y, size_t n_next,
+                const double* control_t, const double* control_steering,
+                const double* control_throttle, size_t n_controls,
+                double apply_after) {
+  // The keys in the order json::dump() sorted them.
+  out.clear();
+  out += "42[\"steer\",{";
+  if (apply_after >= 0) {
+    out += "\"apply_after\":";
+    AppendDouble(out, apply_after);
+    out += ',';
+  }
+  if (n_controls > 0) {
+    AppendArray(out, "\"controls\":{\"steering_angle\":", control_steering,
+                n_controls);
+    AppendArray(out, ",\"t\":", control_t, n_controls);
+    AppendArray(out, ",\"throttle\":", control_throttle, n_controls);
+    out += "},";
+  }
+  AppendArray(out, "\"mpc_x\":", mpc_x, n_mpc);
+  AppendArray(out, ",\"mpc_y\":", mpc_y, n_mpc);
+  AppendArray(out, ",\"next_x\":", next_x, n_next);
+  AppendArray(out, ",\"next_y\":", next_y, n_next);
+  out += ",\"steering_angle\":";
+  AppendDouble(out, steering);
+  out += ",\"throttle\":";
+  AppendDouble(out, throttle);
+  out += "}]";
+}
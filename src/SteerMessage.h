@@ -0,0 +1,41 @@
+#ifndef STEER_MESSAGE_H
+#define STEER_MESSAGE_H
+
+#include <cstddef>
+#include <string>
+
+// Writes the reply to a telemetry event,
+//
+//   42["steer",{"mpc_x":[...],"mpc_y":[...],"next_x":[...],"next_y":[...],
+//               "steering_angle":...,"throttle":...}]
+//
+// into `out`, replacing what was there. The keys are in the order
+// json::dump() gave them, but there is no json object to build, and once
+// `out` has grown to the size of a message writing one doesn't allocate.
+// The predicted trajectory (green line) and the reference line (yellow) are
+// in the vehicle's coordinates.
+//
+// With `n_controls`, the inputs over the whole horizon go first, as
+//
+//   "controls":{"steering_angle":[...],"t":[...],"throttle":[...]}
+//
+// each applied from t seconds after steering_angle and throttle are. With
+// an `apply_after` of 0 or more, the first key is
+//
+//   "apply_after":...
+//
+// the seconds of simulated time after the frame it answers that the reply
+// takes effect, for a simulator stepping in lockstep with the controller.
+void WriteSteer(std::string& out, double steering, double throttle,
+                const double* mpc_x, const double* mpc_y, size_t n_mpc,
+                const double* next_x, const double* next_y, size_t n_next,
+                const double* control_t = nullptr,
+                const double* control_steering = nullptr,
+                const double* control_throttle = nullptr,
+                size_t n_controls = 0, double apply_after = -1);
+
+// Append the shortest decimal that reads back as exactly `x`, or null if it
+// isn't finite, the way JSON has it.
+void AppendDouble(std::string& out, double x);
+
+#endif /* STEER_MESSAGE_H */
@@ -0,0 +1,356 @@
+#include "Supervisor.h"
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const char ENVIRONMENT[] = "MPC_SUPERVISOR_FD";
+
+// What goes over the socket pair: from a worker, that it is warm, that it
+// listens and that it sent its first command; to it, to serve.
+static const char WARM = 'W';
+static const char LISTENING = 'L';
+static const char FIRST_COMMAND = 'C';
+static const char SERVE = 'S';
+
+// Least time between starts of workers while they keep exiting before they
+// are warm, say for a bad tuning, rather than forking as fast as they fail.
+static const double RESTART_DELAY = 1;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+namespace {
+
+struct Worker {
+  enum State { STARTING, WARM, SERVING, DRAINING };
+  pid_t pid;
+  int fd;
+  State state;
+  // Of the binary it runs: each redeploy starts a generation.
+  unsigned generation;
+  Clock::time_point started;
+};
+
+class Supervisor {
+ public:
+  Supervisor(char* argv[], size_t standby)
+      : argv_(argv), standby_(standby), generation_(0), retiring_(0),
+        last_start_(Clock::time_point()), failed_(false),
+        in_outage_(false) {}
+
+  int Run();
+
+ private:
+  bool Start();
+  // Keep standby_ workers of this generation besides the one serving.
+  void Replenish();
+  // Have the oldest warm worker of this generation serve, if the one
+  // serving isn't of it.
+  void Promote();
+  void Message(Worker& worker);
+  void Reap();
+  void Stop();
+
+  char** argv_;
+  size_t standby_;
+  std::string path_;
+  unsigned generation_;
+  std::vector<Worker> workers_;
+  // The worker a redeploy replaced, to stop once its successor listens.
+  pid_t retiring_;
+  Clock::time_point last_start_;
+  // A worker exited before it was warm, and restarts wait RESTART_DELAY.
+  bool failed_;
+  // Since the serving worker exited, until its successor's first command.
+  Clock::time_point outage_;
+  bool in_outage_;
+};
+
+bool Supervisor::Start() {
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+    std::cerr << "Failed to create a worker's socket: " << strerror(errno)
+              << std::endl;
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "Failed to fork a worker: " << strerror(errno) << std::endl;
+    close(pair[0]);
+    close(pair[1]);
+    return false;
+  }
+  if (pid == 0) {
+    // The worker's end stays open across exec, and the signals the
+    // supervisor takes from its signalfd are unblocked again.
+    fcntl(pair[1], F_SETFD, 0);
+    setenv(ENVIRONMENT, std::to_string(pair[1]).c_str(), 1);
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    execv(path_.c_str(), argv_);
+    _exit(127);
+  }
+  close(pair[1]);
+  last_start_ = Clock::now();
+  workers_.push_back(
+      Worker{pid, pair[0], Worker::STARTING, generation_, last_start_});
+  std::cout << "Started worker " << pid << std::endl;
+  return true;
+}
+
+void Supervisor::Replenish() {
+  if (failed_ && Clock::now() - last_start_ <
+                     std::chrono::duration<double>(RESTART_DELAY)) {
+    return;
+  }
+  size_t waiting = 0;
+  bool serving = false;
+  for (const Worker& worker : workers_) {
+    if (worker.generation != generation_) {
+      continue;
+    }
+    if (worker.state == Worker::SERVING) {
+      serving = true;
+    } else if (worker.state != Worker::DRAINING) {
+      waiting++;
+    }
+  }
+  // The serving one's place too, if none of this generation serves.
+  for (size_t i = waiting; i < standby_ + !serving; i++) {
+    if (!Start()) {
+      break;
+    }
+  }
+  failed_ = false;
+}
+
+void Supervisor::Promote() {
+  Worker* next = nullptr;
+  Worker* serving = nullptr;
+  for (Worker& worker : workers_) {
+    if (worker.state == Worker::SERVING) {
+      serving = &worker;
+    } else if (worker.state == Worker::WARM &&
+               worker.generation == generation_ &&
+               (!next || worker.started < next->started)) {
+      next = &worker;
+    }
+  }
+  if (!next || (serving && serving->generation == generation_)) {
+    return;
+  }
+  if (write(next->fd, &SERVE, 1) != 1) {
+    return;
+  }
+  next->state = Worker::SERVING;
+  std::cout << "Worker " << next->pid << " serving" << std::endl;
+  // A redeploy: the old worker goes once the new one listens.
+  if (serving) {
+    serving->state = Worker::DRAINING;
+    retiring_ = serving->pid;
+  }
+}
+
+void Supervisor::Message(Worker& worker) {
+  char message;
+  ssize_t n = read(worker.fd, &message, 1);
+  if (n <= 0) {
+    // Exiting; Reap has the rest when SIGCHLD comes.
+    close(worker.fd);
+    worker.fd = -1;
+    return;
+  }
+  if (message == WARM && worker.state == Worker::STARTING) {
+    worker.state = Worker::WARM;
+    std::cout << "Worker " << worker.pid << " warm after "
+              << Milliseconds(Clock::now() - worker.started) / 1000 << " s"
+              << std::endl;
+    Promote();
+  } else if (message == LISTENING && retiring_ > 0) {
+    kill(retiring_, SIGTERM);
+    retiring_ = 0;
+  } else if (message == FIRST_COMMAND && in_outage_) {
+    in_outage_ = false;
+    std::cout << "Failover: first command from worker " << worker.pid << " "
+              << Milliseconds(Clock::now() - outage_)
+              << " ms after the last worker exited" << std::endl;
+  }
+}
+
+void Supervisor::Reap() {
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (size_t i = 0; i < workers_.size(); i++) {
+      Worker& worker = workers_[i];
+      if (worker.pid != pid) {
+        continue;
+      }
+      if (WIFSIGNALED(status)) {
+        std::cout << "Worker " << pid << " killed by signal "
+                  << WTERMSIG(status) << std::endl;
+      } else {
+        std::cout << "Worker " << pid << " exited with "
+                  << WEXITSTATUS(status) << std::endl;
+      }
+      if (worker.state == Worker::SERVING) {
+        outage_ = Clock::now();
+        in_outage_ = true;
+      }
+      if (worker.pid == retiring_) {
+        retiring_ = 0;
+      }
+      failed_ = failed_ || worker.state == Worker::STARTING;
+      if (worker.fd >= 0) {
+        close(worker.fd);
+      }
+      workers_.erase(workers_.begin() + i);
+      break;
+    }
+  }
+  Promote();
+  Replenish();
+}
+
+void Supervisor::Stop() {
+  for (const Worker& worker : workers_) {
+    kill(worker.pid, SIGTERM);
+  }
+  while (waitpid(-1, nullptr, 0) > 0 || errno == EINTR) {
+  }
+}
+
+int Supervisor::Run() {
+  char path[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (length <= 0) {
+    std::cerr << "Failed to find the server's binary" << std::endl;
+    return -1;
+  }
+  path_.assign(path, length);
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  for (int signal : {SIGCHLD, SIGHUP, SIGINT, SIGTERM}) {
+    sigaddset(&signals, signal);
+  }
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+  if (signal_fd < 0) {
+    std::cerr << "Failed to take the supervisor's signals: "
+              << strerror(errno) << std::endl;
+    return -1;
+  }
+  std::cout << "Supervising " << standby_ << " standby workers of " << path_
+            << std::endl;
+  Replenish();
+
+  std::vector<pollfd> fds;
+  while (true) {
+    fds.assign(1, pollfd{signal_fd, POLLIN, 0});
+    for (const Worker& worker : workers_) {
+      fds.push_back(pollfd{worker.fd, POLLIN, 0});
+    }
+    int timeout = failed_ ? int(RESTART_DELAY * 1000) : -1;
+    if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+      std::cerr << "Supervisor poll failed: " << strerror(errno)
+                << std::endl;
+      Stop();
+      return -1;
+    }
+    // Workers are only added and removed below, after their messages.
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (fds[i].revents != 0) {
+        for (Worker& worker : workers_) {
+          if (worker.fd == fds[i].fd && worker.fd >= 0) {
+            Message(worker);
+          }
+        }
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      signalfd_siginfo info;
+      if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+        continue;
+      }
+      if (info.ssi_signo == SIGINT || info.ssi_signo == SIGTERM) {
+        std::cout << "Stopping the workers" << std::endl;
+        Stop();
+        return 0;
+      }
+      if (info.ssi_signo == SIGHUP) {
+        // The old standbys go, and the new ones take over once warm.
+        generation_++;
+        for (Worker& worker : workers_) {
+          if (worker.state == Worker::STARTING ||
+              worker.state == Worker::WARM) {
+            worker.state = Worker::DRAINING;
+            kill(worker.pid, SIGTERM);
+          }
+        }
+        std::cout << "Redeploying " << path_ << std::endl;
+      }
+      Reap();
+    } else if (failed_) {
+      Replenish();
+    }
+  }
+}
+
+}  // namespace
+
+int Supervise(char* argv[], size_t standby) {
+  return Supervisor(argv, standby).Run();
+}
+
+SupervisedWorker::SupervisedWorker() : fd_(-1), reported_(false) {
+  const char* fd = getenv(ENVIRONMENT);
+  if (fd) {
+    fd_ = atoi(fd);
+    // Not for whatever this process runs in turn.
+    fcntl(fd_, F_SETFD, FD_CLOEXEC);
+    unsetenv(ENVIRONMENT);
+  }
+}
+
+bool SupervisedWorker::WaitToServe() {
+  if (write(fd_, &WARM, 1) != 1) {
+    return false;
+  }
+  char message;
+  ssize_t n;
+  do {
+    n = read(fd_, &message, 1);
+  } while (n < 0 && errno == EINTR);
+  return n == 1 && message == SERVE;
+}
+
+void SupervisedWorker::Listening() {
+  if (fd_ >= 0 && write(fd_, &LISTENING, 1) != 1) {
+    // The supervisor is gone; there is no one to stop.
+  }
+}
+
+void SupervisedWorker::Report() {
+  if (write(fd_, &FIRST_COMMAND, 1) != 1) {
+    // The supervisor is gone, and with it the failover to time.
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <atomic>
+#include <cstddef>
+
+// The server as a supervisor of worker processes, so that when the one
+// serving crashes or is redeployed the sessions reconnect to one already
+// warm: its tapes recorded and shared, Ipopt set up and its workers' memory
+// faulted in by the warm-up solves, instead of paying for all of it on
+// their first frames.
+//
+// Each worker is the server binary run again, with the supervisor's end of
+// a socket pair in MPC_SUPERVISOR_FD. It goes through the whole of its
+// setup and warm-up, tells the supervisor it is warm and waits. The
+// supervisor keeps one worker serving and `standby` warm ones waiting. A
+// worker it tells to serve only then listens on the port, with
+// SO_REUSEPORT, so that it can take the port over from the one before it,
+// and says so. uWS can't listen on a socket it didn't open, so the port is
+// handed over this way rather than as a descriptor.
+//
+// When the serving worker exits, for whatever reason, the oldest warm
+// standby is told to serve at once and a new standby is started behind it;
+// the supervisor learns of the exit from SIGCHLD on a signalfd, so the
+// next worker is listening within a millisecond or so. SIGHUP to the
+// supervisor redeploys: standbys of the binary now at the path it was
+// started from replace the old ones, and the first of them warm serves,
+// the old serving worker getting SIGTERM once the new one listens, so that
+// the port is never without a listener; its sessions reconnect to the new
+// one. SIGTERM and SIGINT stop the workers and then the supervisor.
+// Workers die with the supervisor.
+//
+// The supervisor logs each failover: the time from the serving worker's
+// exit to its successor's first command, which is the outage the clients
+// see, their reconnecting included.
+
+// Supervise workers of this program, run with `argv`, with `standby` warm
+// ones besides the one serving, until stopped; returns the exit status.
+// Call it first thing in main, before any thread starts.
+int Supervise(char* argv[], size_t standby);
+
+// A worker's side of it.
+class SupervisedWorker {
+ public:
+  // The supervisor's socket from the environment, if this process is one
+  // of its workers.
+  SupervisedWorker();
+
+  bool supervised() const { return fd_ >= 0; }
+
+  // Tell the supervisor this process is warm, and wait to be told to
+  // serve; false if it is to exit instead.
+  bool WaitToServe();
+
+  // Tell the supervisor this process listens on the port, for the worker it
+  // replaces to go.
+  void Listening();
+
+  // A command was sent; the first after WaitToServe is reported, for the
+  // failover's time. Any thread.
+  void CommandSent() {
+    if (fd_ >= 0 && !reported_.load(std::memory_order_relaxed) &&
+        !reported_.exchange(true)) {
+      Report();
+    }
+  }
+
+ private:
+  void Report();
+
+  int fd_;
+  std::atomic<bool> reported_;
+};
+
+#endif /* SUPERVISOR_H */
@@ -0,0 +1,50 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Room for waypoints in a Telemetry. The simulator sends 6, other feeds more
+// for a longer lookahead.
+static const size_t MAX_WAYPOINTS = 64;
+
+// One telemetry event, as parsed on the event loop. Fixed size, so that
+// parsing one never allocates.
+struct Telemetry {
+  std::chrono::steady_clock::time_point received;
+  // Numbers the connection's frames from 1, in the order received.
+  uint64_t sequence;
+  size_t n_waypoints;
+  double ptsx[MAX_WAYPOINTS];
+  double ptsy[MAX_WAYPOINTS];
+  double px;
+  double py;
+  double psi;
+  double v;
+  double delta;
+  double a;
+  // Estimated delay from receipt until the reply takes effect, in seconds.
+  double latency;
+  // Whether it came in the binary framing, and so goes its reply; see
+  // BinaryProtocol.h.
+  bool binary;
+  // Whether it was prepared ahead of its solve, by the event loop in a
+  // FrameBatch or by the session's Preparer: the cubic through the
+  // waypoints in the car's frame, and the state to solve from.
+  bool prepared;
+  double coeffs[4];
+  double state[6];
+};
+
+// The reply to a telemetry event, ready to be sent.
+struct Command {
+  // When the telemetry it answers was received.
+  std::chrono::steady_clock::time_point received;
+  std::string msg;
+  // Whether msg is a binary message rather than text.
+  bool binary;
+};
+
+#endif /* TELEMETRY_H */
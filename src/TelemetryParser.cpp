@@ -0,0 +1,415 @@
+#include "TelemetryParser.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+// json with its values, objects and arrays in the current Arena. Strings
+// stay std::string, which this json.hpp insists on in its error messages;
+// the keys of a telemetry event all fit its small string buffer anyway.
+typedef nlohmann::basic_json<std::map, std::vector, std::string, bool,
+                             std::int64_t, std::uint64_t, double,
+                             ArenaAllocator>
+    ArenaJson;
+
+namespace {
+
+// Exact powers of ten: up to 1e22 every one is representable, which is
+// what makes the fast path of ReadNumber correctly rounded.
+const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+const int MAX_FAST_EXPONENT = 22;
+const uint64_t MAX_FAST_MANTISSA = uint64_t(1) << 53;
+// Longest number handed to strtod when the fast path doesn't apply.
+const size_t MAX_NUMBER_LENGTH = 64;
+
+// The fields, as bits. The waypoints are optional, for a client that leaves
+// them to the TrackMap.
+enum Field {
+  PTSX = 1 << 0,
+  PTSY = 1 << 1,
+  X = 1 << 2,
+  Y = 1 << 3,
+  PSI = 1 << 4,
+  SPEED = 1 << 5,
+  STEERING_ANGLE = 1 << 6,
+  THROTTLE = 1 << 7,
+  REQUIRED_FIELDS = X | Y | PSI | SPEED | STEERING_ANGLE | THROTTLE
+};
+
+// Nesting of unknown values we are willing to skip.
+const int MAX_DEPTH = 16;
+
+class Reader {
+ public:
+  Reader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  bool done() {
+    SkipSpace();
+    return p_ == end_;
+  }
+
+  // Skip whitespace, then take `c` if it is next.
+  bool Take(char c) {
+    SkipSpace();
+    if (p_ < end_ && *p_ == c) {
+      p_++;
+      return true;
+    }
+    return false;
+  }
+
+  // A string without escapes, as a view into the input.
+  bool ReadString(const char*& s, size_t& n) {
+    if (!Take('"')) {
+      return false;
+    }
+    s = p_;
+    while (p_ < end_ && *p_ != '"') {
+      if (*p_ == '\\') {
+        return false;
+      }
+      p_++;
+    }
+    if (p_ == end_) {
+      return false;
+    }
+    n = p_ - s;
+    p_++;
+    return true;
+  }
+
+  // A JSON number. Up to 19 significant digits and exponents within
+  // +-22 are converted exactly by one multiplication or division; the rest
+  // go through strtod.
+  bool ReadNumber(double& x) {
+    SkipSpace();
+    const char* start = p_;
+    bool negative = p_ < end_ && *p_ == '-';
+    if (negative) {
+      p_++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    const char* int_start = p_;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+      Accumulate(mantissa, digits, exponent, *p_, false);
+      p_++;
+    }
+    if (p_ == int_start) {
+      return false;
+    }
+    if (p_ < end_ && *p_ == '.') {
+      p_++;
+      const char* frac_start = p_;
+      while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+        Accumulate(mantissa, digits, exponent, *p_, true);
+        p_++;
+      }
+      if (p_ == frac_start) {
+        return false;
+      }
+    }
+    if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+      p_++;
+      bool negative_exp = false;
+      if (p_ < end_ && (*p_ == '+' || *p_ == '-')) {
+        negative_exp = *p_ == '-';
+        p_++;
+      }
+      const char* exp_start = p_;
+      int e = 0;
+      while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+        if (e < 10000) {
+          e = 10 * e + (*p_ - '0');
+        }
+        p_++;
+      }
+      if (p_ == exp_start) {
+        return false;
+      }
+      exponent += negative_exp ? -e : e;
+    }
+
+    if (digits <= 19 && mantissa <= MAX_FAST_MANTISSA &&
+        exponent >= -MAX_FAST_EXPONENT && exponent <= MAX_FAST_EXPONENT) {
+      x = double(mantissa);
+      x = exponent < 0 ? x / POW10[-exponent] : x * POW10[exponent];
+      if (negative) {
+        x = -x;
+      }
+      return true;
+    }
+    size_t length = p_ - start;
+    if (length >= MAX_NUMBER_LENGTH) {
+      return false;
+    }
+    char buffer[MAX_NUMBER_LENGTH];
+    memcpy(buffer, start, length);
+    buffer[length] = 0;
+    x = strtod(buffer, nullptr);
+    return true;
+  }
+
+  // An array of numbers into out[0, capacity).
+  bool ReadNumbers(double* out, size_t capacity, size_t& n) {
+    n = 0;
+    if (!Take('[')) {
+      return false;
+    }
+    if (Take(']')) {
+      return true;
+    }
+    do {
+      if (n == capacity || !ReadNumber(out[n])) {
+        return false;
+      }
+      n++;
+    } while (Take(','));
+    return Take(']');
+  }
+
+  // Any value, without looking at it.
+  bool SkipValue(int depth) {
+    if (depth > MAX_DEPTH) {
+      return false;
+    }
+    SkipSpace();
+    if (p_ == end_) {
+      return false;
+    }
+    switch (*p_) {
+      case '"': {
+        const char* s;
+        size_t n;
+        return ReadString(s, n);
+      }
+      case '[':
+        p_++;
+        if (Take(']')) {
+          return true;
+        }
+        do {
+          if (!SkipValue(depth + 1)) {
+            return false;
+          }
+        } while (Take(','));
+        return Take(']');
+      case '{':
+        p_++;
+        if (Take('}')) {
+          return true;
+        }
+        do {
+          const char* s;
+          size_t n;
+          if (!ReadString(s, n) || !Take(':') || !SkipValue(depth + 1)) {
+            return false;
+          }
+        } while (Take(','));
+        return Take('}');
+      case 't':
+        return Literal("true");
+      case 'f':
+        return Literal("false");
+      case 'n':
+        return Literal("null");
+      default: {
+        double x;
+        return ReadNumber(x);
+      }
+    }
+  }
+
+ private:
+  void SkipSpace() {
+    while (p_ < end_ &&
+           (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+      p_++;
+    }
+  }
+
+  bool Literal(const char* word) {
+    size_t n = strlen(word);
+    if (size_t(end_ - p_) < n || memcmp(p_, word, n) != 0) {
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  // Add one digit to the mantissa. Digits past the 19 that fit only move
+  // the decimal point; they send the number to strtod anyway.
+  static void Accumulate(uint64_t& mantissa, int& digits, int& exponent,
+                         char c, bool fraction) {
+    if (digits == 0 && c == '0') {
+      // Leading zeros aren't significant.
+      if (fraction) {
+        exponent--;
+      }
+      return;
+    }
+    if (digits < 19) {
+      mantissa = 10 * mantissa + (c - '0');
+      if (fraction) {
+        exponent--;
+      }
+    } else if (!fraction) {
+      exponent++;
+    }
+    digits++;
+  }
+
+  const char* p_;
+  const char* end_;
+};
+
+bool KeyIs(const char* s, size_t n, const char* key) {
+  return strlen(key) == n && memcmp(s, key, n) == 0;
+}
+
+}  // namespace
+
+bool ParseTelemetry(const char* begin, const char* end, Telemetry& t) {
+  Reader r(begin, end);
+  const char* s;
+  size_t n;
+  if (!r.Take('[') || !r.ReadString(s, n) || !KeyIs(s, n, "telemetry") ||
+      !r.Take(',') || !r.Take('{')) {
+    return false;
+  }
+  int seen = 0;
+  size_t n_ptsx = 0;
+  size_t n_ptsy = 0;
+  if (!r.Take('}')) {
+    do {
+      if (!r.ReadString(s, n) || !r.Take(':')) {
+        return false;
+      }
+      bool ok;
+      if (KeyIs(s, n, "ptsx")) {
+        ok = r.ReadNumbers(t.ptsx, MAX_WAYPOINTS, n_ptsx);
+        seen |= PTSX;
+      } else if (KeyIs(s, n, "ptsy")) {
+        ok = r.ReadNumbers(t.ptsy, MAX_WAYPOINTS, n_ptsy);
+        seen |= PTSY;
+      } else if (KeyIs(s, n, "x")) {
+        ok = r.ReadNumber(t.px);
+        seen |= X;
+      } else if (KeyIs(s, n, "y")) {
+        ok = r.ReadNumber(t.py);
+        seen |= Y;
+      } else if (KeyIs(s, n, "psi")) {
+        ok = r.ReadNumber(t.psi);
+        seen |= PSI;
+      } else if (KeyIs(s, n, "speed")) {
+        ok = r.ReadNumber(t.v);
+        seen |= SPEED;
+      } else if (KeyIs(s, n, "steering_angle")) {
+        ok = r.ReadNumber(t.delta);
+        seen |= STEERING_ANGLE;
+      } else if (KeyIs(s, n, "throttle")) {
+        ok = r.ReadNumber(t.a);
+        seen |= THROTTLE;
+      } else {
+        ok = r.SkipValue(0);
+      }
+      if (!ok) {
+        return false;
+      }
+    } while (r.Take(','));
+    if (!r.Take('}')) {
+      return false;
+    }
+  }
+  if (!r.Take(']') || !r.done() ||
+      (seen & REQUIRED_FIELDS) != REQUIRED_FIELDS || n_ptsx != n_ptsy) {
+    return false;
+  }
+  t.n_waypoints = n_ptsx;
+  t.binary = false;
+  return true;
+}
+
+bool ParseTelemetryJson(const char* begin, const char* end, Telemetry& t,
+                        Arena& arena) {
+  Arena::Scope scope(arena);
+  ArenaJson j = ArenaJson::parse(begin, end);
+  if (j[0].get_ref<const ArenaJson::string_t&>() != "telemetry") {
+    return false;
+  }
+  // j[1] is the data JSON object
+  const ArenaJson& data = j[1];
+  t.n_waypoints = 0;
+  if (data.count("ptsx") && data.count("ptsy")) {
+    const ArenaJson& ptsx = data["ptsx"];
+    const ArenaJson& ptsy = data["ptsy"];
+    t.n_waypoints =
+        std::min(std::min(ptsx.size(), ptsy.size()), MAX_WAYPOINTS);
+    for (size_t i = 0; i < t.n_waypoints; i++) {
+      t.ptsx[i] = ptsx[i];
+      t.ptsy[i] = ptsy[i];
+    }
+  }
+  t.px = data["x"];
+  t.py = data["y"];
+  t.psi = data["psi"];
+  t.v = data["speed"];
+  t.delta = data["steering_angle"];
+  t.a = data["throttle"];
+  t.binary = false;
+  return true;
+}
+
+bool ParseDrawRequest(const char* begin, const char* end, unsigned& every,
+                      Arena& arena) {
+  Arena::Scope scope(arena);
+  ArenaJson j = ArenaJson::parse(begin, end);
+  if (j[0].get_ref<const ArenaJson::string_t&>() != "draw" ||
+      !j[1].count("every") || !j[1]["every"].is_number_unsigned()) {
+    return false;
+  }
+  every = j[1]["every"];
+  return true;
+}
+
+bool hasData(const char* data, size_t length, const char*& begin,
+             const char*& end) {
+  begin = end = nullptr;
+  if (length <= 2 || data[0] != '4' || data[1] != '2') {
+    return false;
+  }
+  const char* first = nullptr;
+  const char* last = nullptr;
+  const char* stop = data + length;
+  for (const char* p = data + 2; p < stop; p++) {
+    switch (*p) {
+      case '[':
+        if (!first) {
+          first = p;
+        }
+        break;
+      case '}':
+        if (p + 1 < stop && p[1] == ']') {
+          last = p + 2;
+        }
+        break;
+      case 'n':
+        if (stop - p >= 4 && p[1] == 'u' && p[2] == 'l' && p[3] == 'l') {
+          return true;
+        }
+        break;
+    }
+  }
+  if (first && last && first < last) {
+    begin = first;
+    end = last;
+  }
+  return true;
+}
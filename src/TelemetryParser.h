@@ -0,0 +1,40 @@
+#ifndef TELEMETRY_PARSER_H
+#define TELEMETRY_PARSER_H
+
+#include "Arena.h"
+#include "Telemetry.h"
+
+// Checks if the SocketIO message in [data, data + length) is an event with
+// JSON data: it has to start with "42". If so, [begin, end) is set to the
+// payload, from the first '[' up to the last "}]", or left empty when the
+// event carries "null". The message needn't be NUL-terminated, and is
+// scanned once, in place.
+bool hasData(const char* data, size_t length, const char*& begin,
+             const char*& end);
+
+// Parsers for the payload of a telemetry event, ["telemetry", {...}], with
+// the fields of DATA.md. Both fill everything but `received` and `latency`,
+// and clear `binary`.
+
+// Single pass over [begin, end) straight into `t`, without building a DOM or
+// allocating. Keys may come in any order and unknown ones are skipped, but
+// anything else unexpected (another event, a missing field, more than
+// MAX_WAYPOINTS waypoints, string escapes) returns false, for the caller to
+// fall back to ParseTelemetryJson. Only the waypoints may be left out, for
+// clients that leave them to the TrackMap.
+bool ParseTelemetry(const char* begin, const char* end, Telemetry& t);
+
+// The same through json::parse, with the DOM allocated in `arena`, which is
+// reset on return. Returns false if the payload isn't a telemetry event, and
+// throws what json::parse throws on invalid JSON. Waypoints beyond
+// MAX_WAYPOINTS are dropped.
+bool ParseTelemetryJson(const char* begin, const char* end, Telemetry& t,
+                        Arena& arena);
+
+// The payload of a viewer's request for the lines, ["draw", {"every": n}],
+// through json::parse like ParseTelemetryJson: `every` is set to n, the
+// frames between replies that carry them, 0 for none. False if it isn't one.
+bool ParseDrawRequest(const char* begin, const char* end, unsigned& every,
+                      Arena& arena);
+
+#endif /* TELEMETRY_PARSER_H */
@@ -0,0 +1,296 @@
+#include "TimeSplitMPC.h"
+#include <algorithm>
+#include <cmath>
+
+// As in DenseQP.
+static const int CHECK_INTERVAL = 5;
+static const double RHO_ADAPT_FACTOR = 5;
+static const double RHO_MIN = 1e-6;
+static const double RHO_MAX = 1e6;
+
+TimeSplitMPC::TimeSplitMPC(size_t N, double dt, double Lf,
+                           const KinematicWeights& weights, double refV,
+                           size_t segments, size_t threads)
+    : maxIterations(4000), rho(0.1), sigma(1e-6), alpha(1.6),
+      tolerance(1e-4), lastIterations(0), lastConverged(false),
+      lastDefect(0), N_(N), dt_(dt), Lf_(Lf), w_(weights), ref_v_(refV),
+      rho_(0.1), pool_(new StagePool(threads)) {
+  double state_weight[6] = {0, 0, 0, w_.v, w_.cte, w_.epsi};
+  state_weight_ = Eigen::VectorXd::Zero(6 * (N - 1));
+  for (size_t k = 0; k + 1 < N; k++) {
+    state_weight_.segment<6>(6 * k) = Eigen::Map<State>(state_weight);
+  }
+  size_t count = std::max<size_t>(std::min(segments, N - 1), 1);
+  segments_.resize(count);
+  size_t first = 0;
+  for (size_t i = 0; i < count; i++) {
+    Segment& s = segments_[i];
+    s.first = first;
+    s.stages = (N - 1) * (i + 1) / count - first;
+    first += s.stages;
+    s.starts = i > 0;
+    s.ends = i + 1 < count;
+    s.m = 2 * s.stages;
+    s.n = s.m + (s.starts ? 6 : 0);
+    s.xbar = Eigen::MatrixXd::Zero(6, s.stages + 1);
+    s.gamma = Eigen::MatrixXd::Zero(6 * s.stages, s.n);
+    s.q_gamma = Eigen::MatrixXd::Zero(6 * s.stages, s.n);
+    s.residual = Eigen::VectorXd::Zero(6 * s.stages);
+    // The rate terms between segments are dropped.
+    s.R = Eigen::MatrixXd::Zero(s.n, s.n);
+    s.R.topLeftCorner(s.m, s.m) = ControlCost(s.stages + 1, w_);
+    s.H = Eigen::MatrixXd::Zero(s.n, s.n);
+    s.g = Eigen::VectorXd::Zero(s.n);
+    s.lb = Eigen::VectorXd::Zero(s.m);
+    s.ub = Eigen::VectorXd::Zero(s.m);
+    s.P = Eigen::MatrixXd::Zero(s.n, s.n);
+    s.llt = Eigen::LLT<Eigen::MatrixXd>(s.n);
+    s.start_w = Eigen::MatrixXd::Zero(s.n, 6);
+    s.end_w = Eigen::MatrixXd::Zero(s.n, 6);
+    s.x = Eigen::VectorXd::Zero(s.n);
+    s.z = Eigen::VectorXd::Zero(s.m);
+    s.z_prev = Eigen::VectorXd::Zero(s.m);
+    s.y = Eigen::VectorXd::Zero(s.m);
+    s.rhs = Eigen::VectorXd::Zero(s.n);
+    s.solved = Eigen::VectorXd::Zero(s.n);
+    s.primal = s.dual = s.primal_scale = s.dual_scale = 0;
+  }
+  ubar_ = Eigen::MatrixXd::Zero(2, N - 1);
+  xbar_ = Eigen::MatrixXd::Zero(6, N);
+  coeffs_.setZero();
+  diagonal_.resize(count - 1);
+  below_.assign(count - 1, Block::Zero());
+  lambda_.assign(count - 1, State::Zero());
+}
+
+void TimeSplitMPC::Prepare(Segment& s, const Cubic& coeffs) {
+  s.xbar = xbar_.middleCols(s.first, s.stages + 1);
+  StateJacobian A;
+  InputJacobian B;
+  for (size_t k = 0; k < s.stages; k++) {
+    State x = s.xbar.col(k);
+    Input u = ubar_.col(s.first + k);
+    BicycleLinearize(x, u, coeffs, dt_, Lf_, A, B);
+    CondenseStage(k, A, B, s.gamma);
+    // How the state responds to a change of the start.
+    if (s.starts) {
+      if (k == 0) {
+        s.gamma.block<6, 6>(0, s.m) = A;
+      } else {
+        s.gamma.block<6, 6>(6 * k, s.m).noalias() =
+            A * s.gamma.block<6, 6>(6 * (k - 1), s.m);
+      }
+    }
+    s.residual.segment<6>(6 * k) = s.xbar.col(k + 1);
+    s.residual[6 * k + 3] -= ref_v_;
+    s.lb[2 * k] = -MAX_DELTA - u[0];
+    s.ub[2 * k] = MAX_DELTA - u[0];
+    s.lb[2 * k + 1] = -MAX_A - u[1];
+    s.ub[2 * k + 1] = MAX_A - u[1];
+  }
+  s.q_gamma.noalias() =
+      state_weight_.head(6 * s.stages).asDiagonal() * s.gamma;
+  s.H.noalias() = 2 * s.gamma.transpose() * s.q_gamma;
+  s.H += 2 * s.R;
+  Eigen::Map<const Eigen::VectorXd> u_flat(ubar_.data() + 2 * s.first, s.m);
+  s.g.noalias() = 2 * s.q_gamma.transpose() * s.residual;
+  s.g.head(s.m).noalias() += 2 * s.R.topLeftCorner(s.m, s.m) * u_flat;
+  // From no change, with the multipliers of the last frame.
+  s.x.setZero();
+  s.z.setZero();
+}
+
+void TimeSplitMPC::Factorize(Segment& s) {
+  s.P = s.H;
+  s.P.diagonal().array() += sigma;
+  s.P.diagonal().head(s.m).array() += rho_;
+  s.llt.compute(s.P);
+  // The start constraint is -I on the start's change, the end's the last
+  // rows of gamma.
+  if (s.starts) {
+    s.start_w.setZero();
+    s.start_w.bottomRows<6>() = -Block::Identity();
+    s.llt.solveInPlace(s.start_w);
+  }
+  if (s.ends) {
+    s.end_w = s.gamma.bottomRows<6>().transpose();
+    s.llt.solveInPlace(s.end_w);
+  }
+}
+
+void TimeSplitMPC::FactorizeSchur() {
+  // Boundary b's row of the constraints is segment b's end less segment
+  // b + 1's start, so the complement's diagonal block takes a term of each,
+  // and the block below it is segment b's end against its start.
+  for (size_t b = 0; b < diagonal_.size(); b++) {
+    const Segment& before = segments_[b];
+    const Segment& after = segments_[b + 1];
+    Block d = before.gamma.bottomRows<6>() * before.end_w;
+    d -= after.start_w.bottomRows<6>();
+    if (b > 0) {
+      // Segment b's end against its start, over the factor above.
+      Block coupling = before.gamma.bottomRows<6>() * before.start_w;
+      below_[b] = diagonal_[b - 1]
+                      .matrixL()
+                      .solve(Block(coupling.transpose()))
+                      .transpose();
+      d.noalias() -= below_[b] * below_[b].transpose();
+    }
+    diagonal_[b].compute(d);
+  }
+}
+
+void TimeSplitMPC::SolveSchur() {
+  for (size_t b = 0; b < lambda_.size(); b++) {
+    if (b > 0) {
+      lambda_[b].noalias() -= below_[b] * lambda_[b - 1];
+    }
+    diagonal_[b].matrixL().solveInPlace(lambda_[b]);
+  }
+  for (size_t b = lambda_.size(); b-- > 0;) {
+    if (b + 1 < lambda_.size()) {
+      lambda_[b].noalias() -= below_[b + 1].transpose() * lambda_[b + 1];
+    }
+    diagonal_[b].matrixU().solveInPlace(lambda_[b]);
+  }
+}
+
+void TimeSplitMPC::Solve(Segment& s) {
+  s.rhs = sigma * s.x - s.g;
+  s.rhs.head(s.m) += rho_ * s.z - s.y;
+  s.solved = s.llt.solve(s.rhs);
+}
+
+void TimeSplitMPC::Update(Segment& s, bool check) {
+  // Segment i starts at boundary i - 1 and ends at boundary i.
+  size_t i = &s - segments_.data();
+  if (s.starts) {
+    s.solved.noalias() -= s.start_w * lambda_[i - 1];
+  }
+  if (s.ends) {
+    s.solved.noalias() -= s.end_w * lambda_[i];
+  }
+  s.x = alpha * s.solved + (1 - alpha) * s.x;
+  s.rhs.head(s.m) = alpha * s.solved.head(s.m) + (1 - alpha) * s.z;
+  s.z_prev = s.z;
+  s.z = (s.rhs.head(s.m) + s.y / rho_).cwiseMax(s.lb).cwiseMin(s.ub);
+  s.y += rho_ * (s.rhs.head(s.m) - s.z);
+  if (!check) {
+    return;
+  }
+  // The gradient of the Lagrangian: the cost's, the bounds' and the
+  // shooting constraints'.
+  s.rhs.noalias() = s.H * s.x;
+  s.solved = s.rhs + s.g;
+  s.solved.head(s.m) += s.y;
+  if (s.starts) {
+    s.solved.tail<6>() -= lambda_[i - 1];
+  }
+  if (s.ends) {
+    s.solved.noalias() += s.gamma.bottomRows<6>().transpose() * lambda_[i];
+  }
+  s.primal = (s.x.head(s.m) - s.z).lpNorm<Eigen::Infinity>();
+  s.dual = s.solved.lpNorm<Eigen::Infinity>();
+  s.primal_scale = std::max(s.x.head(s.m).lpNorm<Eigen::Infinity>(),
+                            s.z.lpNorm<Eigen::Infinity>());
+  s.dual_scale = std::max(std::max(s.rhs.lpNorm<Eigen::Infinity>(),
+                                   s.y.lpNorm<Eigen::Infinity>()),
+                          s.g.lpNorm<Eigen::Infinity>());
+}
+
+Input TimeSplitMPC::Solve(const State& state, const Cubic& coeffs) {
+  coeffs_ = coeffs;
+  for (size_t k = 0; k + 2 < N_; k++) {
+    ubar_.col(k) = ubar_.col(k + 1);
+  }
+  // One rollout for all the segments, so each starts where the one before
+  // it ends, and the shooting constraints have no constant terms.
+  BicycleRollout(state, ubar_, coeffs, dt_, Lf_, xbar_);
+  size_t S = segments_.size();
+  rho_ = rho;
+  pool_->Run(0, S, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      Prepare(segments_[i], coeffs);
+      Factorize(segments_[i]);
+    }
+  });
+  FactorizeSchur();
+
+  lastConverged = false;
+  lastIterations = 0;
+  while (lastIterations < maxIterations) {
+    lastIterations++;
+    bool check = lastIterations % CHECK_INTERVAL == 0;
+    pool_->Run(0, S, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        Solve(segments_[i]);
+      }
+    });
+    // The multipliers that make the solves meet at every boundary.
+    for (size_t b = 0; b + 1 < S; b++) {
+      lambda_[b].noalias() =
+          segments_[b].gamma.bottomRows<6>() * segments_[b].solved;
+      lambda_[b] -= segments_[b + 1].solved.tail<6>();
+    }
+    SolveSchur();
+    pool_->Run(0, S, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        Update(segments_[i], check);
+      }
+    });
+    if (!check) {
+      continue;
+    }
+    double prim = 0;
+    double dual = 0;
+    double prim_scale = 0;
+    double dual_scale = 0;
+    for (const Segment& s : segments_) {
+      prim = std::max(prim, s.primal);
+      dual = std::max(dual, s.dual);
+      prim_scale = std::max(prim_scale, s.primal_scale);
+      dual_scale = std::max(dual_scale, s.dual_scale);
+    }
+    if (prim <= tolerance * (1 + prim_scale) &&
+        dual <= tolerance * (1 + dual_scale)) {
+      lastConverged = true;
+      break;
+    }
+    double ratio = std::sqrt((prim / (prim_scale + 1e-10)) /
+                             (dual / (dual_scale + 1e-10) + 1e-10));
+    double next = std::min(std::max(rho_ * ratio, RHO_MIN), RHO_MAX);
+    if (next > RHO_ADAPT_FACTOR * rho_ || next < rho_ / RHO_ADAPT_FACTOR) {
+      rho_ = next;
+      pool_->Run(0, S, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          Factorize(segments_[i]);
+        }
+      });
+      FactorizeSchur();
+    }
+  }
+
+  lastDefect = 0;
+  for (size_t b = 0; b + 1 < S; b++) {
+    const Segment& before = segments_[b];
+    const Segment& after = segments_[b + 1];
+    State gap = before.gamma.bottomRows<6>() * before.x;
+    gap -= after.x.tail<6>();
+    lastDefect = std::max(lastDefect, gap.lpNorm<Eigen::Infinity>());
+  }
+  for (Segment& s : segments_) {
+    Eigen::Map<Eigen::VectorXd>(ubar_.data() + 2 * s.first, s.m) +=
+        s.x.head(s.m).cwiseMax(s.lb).cwiseMin(s.ub);
+  }
+  return ubar_.col(0);
+}
+
+void TimeSplitMPC::Predicted(std::vector<double>& mpc_x_vals,
+                             std::vector<double>& mpc_y_vals) const {
+  State s = xbar_.col(0);
+  for (size_t k = 0; k + 1 < N_; k++) {
+    s = BicycleStep(s, Input(ubar_.col(k)), coeffs_, dt_, Lf_);
+    mpc_x_vals.push_back(s[0]);
+    mpc_y_vals.push_back(s[1]);
+  }
+}
@@ -0,0 +1,148 @@
+#ifndef TIME_SPLIT_MPC_H
+#define TIME_SPLIT_MPC_H
+
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+#include "BicycleModel.h"
+#include "StagePool.h"
+
+// LTV-MPC over horizons of hundreds of stages, as planning runs have them,
+// decomposed in time: the horizon is cut into segments of consecutive
+// stages, each condensed on its own, as a PlatoonMPC car is, and coupled by
+// multiple shooting: each segment after the first starts from a state of
+// its own, which has to be where the one before it ends.
+//
+// The QP is solved by the ADMM iteration of DenseQP on the input bounds,
+// with the shooting constraints kept exactly at every iteration: the
+// segments solve their parts of the KKT system in parallel on a StagePool,
+// against factorizations of their own, and their start states are agreed
+// through the Schur complement of the constraints, block tridiagonal with
+// a 6 x 6 block a boundary, which is factorized and solved serially. A
+// segment of L stages costs O(L^3) to condense and factorize and O(L^2) an
+// iteration, so cutting N stages into S segments divides the work of a
+// frame by about S^2 before it is spread over the cores, while the serial
+// part grows only as S. The plan is the serial LTV QP's but for the rate
+// terms of the cost between the last input of a segment and the first of
+// the next, which are dropped.
+//
+// Each frame the inputs are shifted on a stage and rolled out from the
+// car's state, serially, which is cheap next to the QPs, to give the
+// segments their linearization trajectories.
+class TimeSplitMPC {
+ public:
+  // `segments` of about (N - 1) / segments stages each, at most N - 1.
+  TimeSplitMPC(size_t N, double dt, double Lf, const KinematicWeights& weights,
+               double refV, size_t segments, size_t threads);
+
+  // ADMM parameters, as DenseQP's: its iterations per frame at most, the
+  // penalty on the bounds, the proximal weight and the relaxation, and the
+  // residual, in the inputs' units, to stop at.
+  int maxIterations;
+  double rho;
+  double sigma;
+  double alpha;
+  double tolerance;
+
+  size_t segments() const { return segments_.size(); }
+
+  // The first actuations {delta, a} for the car at `state` on the path
+  // `coeffs`, in its frame as MPC::Solve takes them.
+  Input Solve(const State& state, const Cubic& coeffs);
+
+  // Appends the predicted trajectory in the car's frame, like MPC::Solve.
+  void Predicted(std::vector<double>& mpc_x_vals,
+                 std::vector<double>& mpc_y_vals) const;
+
+  // ADMM iterations of the last Solve, whether it met the tolerance, and
+  // how far apart at worst the end of a segment and the start of the next
+  // were in its plan, which only rounding keeps from 0.
+  int lastIterations;
+  bool lastConverged;
+  double lastDefect;
+
+ private:
+  struct Segment {
+    // Its first input, its inputs, and its variables: the changes of its
+    // inputs, m of them, then, after the first segment, of its start state.
+    size_t first;
+    size_t stages;
+    size_t m;
+    size_t n;
+    bool starts;
+    bool ends;
+    // The linearization trajectory from its start, and the condensed QP.
+    Eigen::MatrixXd xbar;
+    Eigen::MatrixXd gamma;
+    Eigen::MatrixXd q_gamma;
+    Eigen::VectorXd residual;
+    Eigen::MatrixXd R;
+    Eigen::MatrixXd H;
+    Eigen::VectorXd g;
+    Eigen::VectorXd lb;
+    Eigen::VectorXd ub;
+    // H + sigma I + rho on the inputs, factorized, and its solves of the
+    // transposed constraints on its start and on its end.
+    Eigen::MatrixXd P;
+    Eigen::LLT<Eigen::MatrixXd> llt;
+    Eigen::MatrixXd start_w;
+    Eigen::MatrixXd end_w;
+    // The ADMM iterate: the variables, the bounded copy of the inputs and
+    // its multipliers, kept from frame to frame like DenseQP's; and the
+    // right-hand side and its solve.
+    Eigen::VectorXd x;
+    Eigen::VectorXd z;
+    Eigen::VectorXd z_prev;
+    Eigen::VectorXd y;
+    Eigen::VectorXd rhs;
+    Eigen::VectorXd solved;
+    // The residuals of its last iteration checked, and their scales, as
+    // DenseQP's.
+    double primal;
+    double dual;
+    double primal_scale;
+    double dual_scale;
+  };
+  typedef Eigen::Matrix<double, 6, 6> Block;
+
+  // Linearize and condense segment s about the rolled out trajectory.
+  void Prepare(Segment& s, const Cubic& coeffs);
+  // Factorize its KKT block at the current rho, and the Schur complement.
+  void Factorize(Segment& s);
+  void FactorizeSchur();
+  // Its solve of the KKT block against the iterate; then, with the
+  // multipliers of the shooting constraints, its next iterate, and with
+  // `check` its residuals.
+  void Solve(Segment& s);
+  void Update(Segment& s, bool check);
+  // The multipliers from the segments' solves, into lambda_.
+  void SolveSchur();
+
+  size_t N_;
+  double dt_;
+  double Lf_;
+  KinematicWeights w_;
+  double ref_v_;
+  // rho as adapted by the last Solve.
+  double rho_;
+  Eigen::VectorXd state_weight_;
+  std::vector<Segment> segments_;
+  std::unique_ptr<StagePool> pool_;
+  Cubic coeffs_;
+  // The inputs of the whole horizon and their rollout from the car's state.
+  Eigen::MatrixXd ubar_;
+  Eigen::MatrixXd xbar_;
+  // Boundary b joins segment b to segment b + 1. The Schur complement's
+  // block Cholesky factor: the factors of its diagonal, and its blocks
+  // below them; and the constraints' right-hand sides and multipliers.
+  std::vector<Eigen::LLT<Block>, Eigen::aligned_allocator<Eigen::LLT<Block> > >
+      diagonal_;
+  std::vector<Block, Eigen::aligned_allocator<Block> > below_;
+  std::vector<State, Eigen::aligned_allocator<State> > lambda_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* TIME_SPLIT_MPC_H */
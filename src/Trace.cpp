@@ -0,0 +1,120 @@
+#include "Trace.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Record {
+  // 2 (i + 1) once event i is written, odd while it is being written.
+  std::atomic<uint64_t> sequence;
+  std::atomic<const char*> name;
+  std::atomic<int64_t> begin;
+  std::atomic<int64_t> end;
+  std::atomic<int64_t> id;
+};
+
+struct Buffer {
+  explicit Buffer(size_t capacity, int thread)
+      : records(new Record[capacity]), capacity(capacity), next(0),
+        thread(thread) {
+    for (size_t i = 0; i < capacity; i++) {
+      records[i].sequence.store(0, std::memory_order_relaxed);
+    }
+  }
+  std::unique_ptr<Record[]> records;
+  size_t capacity;
+  std::atomic<uint64_t> next;
+  int thread;
+};
+
+}  // namespace
+
+static std::atomic<size_t> capacity(0);
+static const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+// Every thread's buffer, kept after the thread exits for its events to be
+// dumped.
+static std::mutex buffers_mutex;
+static std::vector<Buffer*> buffers;
+static thread_local Buffer* local = nullptr;
+
+static int64_t Nanoseconds(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t - epoch)
+      .count();
+}
+
+void EnableTracing(size_t events_per_thread) {
+  capacity.store(events_per_thread, std::memory_order_relaxed);
+}
+
+bool TracingEnabled() { return capacity.load(std::memory_order_relaxed) > 0; }
+
+void TraceEvent(const char* name, std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end, int64_t id) {
+  size_t events = capacity.load(std::memory_order_relaxed);
+  if (events == 0) {
+    return;
+  }
+  if (!local) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    local = new Buffer(events, int(buffers.size()));
+    buffers.push_back(local);
+  }
+  uint64_t i = local->next.load(std::memory_order_relaxed);
+  Record& r = local->records[i % local->capacity];
+  r.sequence.store(2 * i + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  r.name.store(name, std::memory_order_relaxed);
+  r.begin.store(Nanoseconds(begin), std::memory_order_relaxed);
+  r.end.store(Nanoseconds(end), std::memory_order_relaxed);
+  r.id.store(id, std::memory_order_relaxed);
+  r.sequence.store(2 * (i + 1), std::memory_order_release);
+  local->next.store(i + 1, std::memory_order_release);
+}
+
+bool DumpTrace(const std::string& path) {
+  FILE* out = fopen(path.c_str(), "w");
+  if (!out) {
+    return false;
+  }
+  std::vector<Buffer*> all;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    all = buffers;
+  }
+  fprintf(out, "{\"traceEvents\":[");
+  const char* separator = "\n";
+  for (Buffer* b : all) {
+    uint64_t end = b->next.load(std::memory_order_acquire);
+    uint64_t begin = end > b->capacity ? end - b->capacity : 0;
+    for (uint64_t i = begin; i < end; i++) {
+      Record& r = b->records[i % b->capacity];
+      uint64_t sequence = r.sequence.load(std::memory_order_acquire);
+      if (sequence != 2 * (i + 1)) {
+        continue;
+      }
+      const char* name = r.name.load(std::memory_order_relaxed);
+      int64_t from = r.begin.load(std::memory_order_relaxed);
+      int64_t to = r.end.load(std::memory_order_relaxed);
+      int64_t id = r.id.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (r.sequence.load(std::memory_order_relaxed) != sequence) {
+        continue;
+      }
+      fprintf(out,
+              "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+              "\"ts\":%.3f,\"dur\":%.3f",
+              separator, name, b->thread, from * 1e-3, (to - from) * 1e-3);
+      if (id >= 0) {
+        fprintf(out, ",\"args\":{\"id\":%lld}", (long long)id);
+      }
+      fprintf(out, "}");
+      separator = ",\n";
+    }
+  }
+  fprintf(out, "\n]}\n");
+  return fclose(out) == 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Optional tracing of what each thread did when, for chrome://tracing or
+// Perfetto.
+//
+// Once enabled, every stage recorded through Stages.h, every Ipopt iteration
+// and every frame becomes an event in a ring buffer of the thread it ran on,
+// keeping the last `events_per_thread` of them. Writers never wait: each
+// event goes in with relaxed stores under a per-slot sequence number, and
+// DumpTrace() skips the slots that are overwritten while it reads them.
+// Disabled, an event costs one relaxed load.
+
+// Turn tracing on, before the threads that trace start. 0 leaves it off.
+void EnableTracing(size_t events_per_thread);
+bool TracingEnabled();
+
+// A span from `begin` to `end` on the calling thread. `name` must outlive
+// the trace, like a string literal; `id` is shown with the event when it
+// isn't negative.
+void TraceEvent(const char* name, std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end, int64_t id = -1);
+
+// Write the buffered events of all threads to `path` in the Chrome trace
+// event format. False if the file can't be written.
+bool DumpTrace(const std::string& path);
+
+#endif /* TRACE_H */
@@ -0,0 +1,117 @@
+#include "TrackLocalizer.h"
+#include <algorithm>
+#include <cmath>
+#include "Checkpoint.h"
+#include "TrackMap.h"
+
+// Farther waypoints in a row before a walk stops, so that one out of line
+// doesn't end it early.
+static const size_t PATIENCE = 3;
+
+TrackLocalizer::TrackLocalizer()
+    : maxJump(20), track_(nullptr), waypoint_(0), x_(0), y_(0), local_(0),
+      searched_(0) {}
+
+size_t TrackLocalizer::Nearest(const TrackMap& track, double x, double y) {
+  size_t n = track.size();
+  const double* wx = track.x();
+  const double* wy = track.y();
+  auto d2 = [&](size_t i) {
+    return (wx[i] - x) * (wx[i] - x) + (wy[i] - y) * (wy[i] - y);
+  };
+  bool found = false;
+  if (track_ == &track && waypoint_ < n &&
+      std::hypot(x - x_, y - y_) <= maxJump) {
+    double heading = track.heading(waypoint_);
+    double ds = (x - x_) * cos(heading) + (y - y_) * sin(heading);
+    size_t hinted = track.Segment(track.s()[waypoint_] + ds);
+    size_t best = waypoint_;
+    double best_d2 = d2(best);
+    size_t candidates[2] = {hinted, (hinted + 1) % n};
+    for (size_t i : candidates) {
+      if (d2(i) < best_d2) {
+        best = i;
+        best_d2 = d2(i);
+      }
+    }
+    // Strides that double while they get nearer and halve when they don't,
+    // so that a walk over k waypoints takes O(log k) steps on dense tracks.
+    size_t walked = 0;
+    size_t stride = 1;
+    for (; walked <= MAX_WALK; walked++) {
+      size_t ahead = (best + stride) % n;
+      size_t behind = (best + n - stride) % n;
+      double d_ahead = d2(ahead);
+      double d_behind = d2(behind);
+      if (std::min(d_ahead, d_behind) < best_d2) {
+        best = d_ahead < d_behind ? ahead : behind;
+        best_d2 = std::min(d_ahead, d_behind);
+        stride = std::min(2 * stride, n / 2);
+      } else if (stride > 1) {
+        stride /= 2;
+      } else {
+        break;
+      }
+    }
+    // Then a step at a time forward, then back from wherever that got to.
+    for (size_t step : {size_t(1), n - 1}) {
+      size_t i = best;
+      for (size_t misses = 0; misses < PATIENCE && walked <= MAX_WALK;
+           walked++) {
+        i = (i + step) % n;
+        double d = d2(i);
+        if (d < best_d2) {
+          best = i;
+          best_d2 = d;
+          misses = 0;
+        } else {
+          misses++;
+        }
+      }
+    }
+    if (walked <= MAX_WALK) {
+      waypoint_ = best;
+      found = true;
+      local_++;
+    }
+  }
+  if (!found) {
+    waypoint_ = track.Nearest(x, y);
+    searched_++;
+  }
+  track_ = &track;
+  x_ = x;
+  y_ = y;
+  return waypoint_;
+}
+
+double TrackLocalizer::Project(const TrackMap& track, double x, double y) {
+  return track.Project(x, y, Nearest(track, x, y));
+}
+
+void TrackLocalizer::Checkpoint(CheckpointWriter& out) const {
+  out.Count(track_ != nullptr);
+  out.Count(waypoint_);
+  out.Double(x_);
+  out.Double(y_);
+}
+
+bool TrackLocalizer::Restore(CheckpointReader& in, const TrackMap* track) {
+  size_t matched;
+  size_t waypoint;
+  double x;
+  double y;
+  if (!in.Count(matched) || !in.Count(waypoint) || !in.Double(x) ||
+      !in.Double(y)) {
+    return false;
+  }
+  if (matched && track && waypoint < track->size()) {
+    track_ = track;
+    waypoint_ = waypoint;
+    x_ = x;
+    y_ = y;
+  } else {
+    Reset();
+  }
+  return true;
+}
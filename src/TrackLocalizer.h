@@ -0,0 +1,64 @@
+#ifndef TRACK_LOCALIZER_H
+#define TRACK_LOCALIZER_H
+
+#include <cstddef>
+
+class CheckpointReader;
+class CheckpointWriter;
+class TrackMap;
+
+// Where one car is on a TrackMap, frame after frame, for the cost of a few
+// waypoints a frame however long the track.
+//
+// The car moves on by little between frames, so rather than search the
+// whole 2-d tree each time, the localizer keeps the waypoint it matched
+// last and where the car was then. The car's move along the track's heading
+// there hints at the arc length it has come to, which TrackMap::Segment
+// turns into a waypoint in O(1); from the nearer of that and the last match
+// it walks forward and back while the waypoints get nearer, in strides that
+// double, so that a dense track costs a few more steps rather than a
+// thousand times as many. Only a first call, a move of more than maxJump
+// meters, as on a reset, or a walk of more than MAX_WALK steps goes back to
+// TrackMap::Nearest.
+//
+// One per car: WaypointFit and Controller each keep one, and
+// SimEnvironments one per car it drives.
+class TrackLocalizer {
+ public:
+  // Steps walked before giving up on the hint.
+  static const size_t MAX_WALK = 64;
+
+  TrackLocalizer();
+
+  // Meters the car may move between calls and still be found locally.
+  double maxJump;
+
+  // The waypoint of `track` nearest (x, y), and the arc length of the
+  // nearest point of its spline, as TrackMap::Nearest and Project have
+  // them. The track must not be empty.
+  size_t Nearest(const TrackMap& track, double x, double y);
+  double Project(const TrackMap& track, double x, double y);
+
+  // Forget the last match, so that the next call searches the tree.
+  void Reset() { track_ = nullptr; }
+
+  // Write the last match into a checkpoint, and read it back as a match on
+  // `track`, which should be the same track as on the server that wrote
+  // it; a waypoint beyond its end, or no match, resets.
+  void Checkpoint(CheckpointWriter& out) const;
+  bool Restore(CheckpointReader& in, const TrackMap* track);
+
+  // Calls answered from the last match, and by searching the tree.
+  unsigned long local() const { return local_; }
+  unsigned long searched() const { return searched_; }
+
+ private:
+  const TrackMap* track_;
+  size_t waypoint_;
+  double x_;
+  double y_;
+  unsigned long local_;
+  unsigned long searched_;
+};
+
+#endif /* TRACK_LOCALIZER_H */
@@ -0,0 +1,452 @@
+#include "TrackMap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The compiled track format: this header, then the sections at the offsets
+// it gives, each aligned to a cache line:
+//
+//   x, y     n doubles each, the waypoints
+//   s        n + 1 doubles, the arc length at each waypoint and of the loop
+//   spline   8 n doubles, the coefficients of each segment
+//   frame    2 n doubles, the heading and curvature at each waypoint
+//   tree     n uint32s, the waypoint indices as an implicit 2-d tree
+//   bucket   n uint32s, the segment at each of n equal steps of arc length
+//
+// Everything is little-endian, and the sections are in the order of their
+// offsets, so that a given n has exactly one layout.
+static const char TRACK_MAGIC[4] = {'M', 'T', 'R', 'K'};
+static const uint32_t TRACK_VERSION = 2;
+static const uint64_t TRACK_ALIGNMENT = 64;
+
+struct TrackHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t n;
+  // Of the whole file, header included.
+  uint64_t size;
+  uint64_t x;
+  uint64_t y;
+  uint64_t s;
+  uint64_t spline;
+  uint64_t frame;
+  uint64_t tree;
+  uint64_t bucket;
+};
+
+// Newton steps projecting a point onto a segment, at most.
+static const int PROJECT_STEPS = 8;
+
+static uint64_t AlignUp(uint64_t offset) {
+  return (offset + TRACK_ALIGNMENT - 1) / TRACK_ALIGNMENT * TRACK_ALIGNMENT;
+}
+
+static TrackHeader Layout(uint64_t n) {
+  TrackHeader h;
+  memcpy(h.magic, TRACK_MAGIC, sizeof(h.magic));
+  h.version = TRACK_VERSION;
+  h.n = n;
+  h.x = AlignUp(sizeof(TrackHeader));
+  h.y = AlignUp(h.x + n * sizeof(double));
+  h.s = AlignUp(h.y + n * sizeof(double));
+  h.spline = AlignUp(h.s + (n + 1) * sizeof(double));
+  h.frame = AlignUp(h.spline + 8 * n * sizeof(double));
+  h.tree = AlignUp(h.frame + 2 * n * sizeof(double));
+  h.bucket = AlignUp(h.tree + n * sizeof(uint32_t));
+  h.size = AlignUp(h.bucket + n * sizeof(uint32_t));
+  return h;
+}
+
+// The sections are mapped as they are, so only little-endian hosts can read
+// them.
+static bool LittleEndian() {
+  uint16_t one = 1;
+  unsigned char first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+// Solve the cyclic tridiagonal system of a periodic spline through the n
+// values of each of x and y, spaced h, for their second derivatives, by
+// Sherman-Morrison around the Thomas algorithm. n must be at least 3.
+static void PeriodicSecondDerivatives(const std::vector<double>& h,
+                                      const double* x, const double* y,
+                                      std::vector<double>& mx,
+                                      std::vector<double>& my) {
+  size_t n = h.size();
+  // Row i is h[i-1] m[i-1] + 2 (h[i-1] + h[i]) m[i] + h[i] m[i+1] = d[i],
+  // with the corners h[n-1], moved into the diagonal through u.
+  double gamma = -2 * (h[n - 1] + h[0]);
+  double corner = h[n - 1];
+  std::vector<double> diag(n);
+  std::vector<double> u(n, 0.0);
+  mx.assign(n, 0.0);
+  my.assign(n, 0.0);
+  for (size_t i = 0; i < n; i++) {
+    size_t prev = (i + n - 1) % n;
+    size_t next = (i + 1) % n;
+    diag[i] = 2 * (h[prev] + h[i]);
+    mx[i] = 6 * ((x[next] - x[i]) / h[i] - (x[i] - x[prev]) / h[prev]);
+    my[i] = 6 * ((y[next] - y[i]) / h[i] - (y[i] - y[prev]) / h[prev]);
+  }
+  diag[0] -= gamma;
+  diag[n - 1] -= corner * corner / gamma;
+  u[0] = gamma;
+  u[n - 1] = corner;
+
+  // Forward elimination of the sub-diagonal, h[i-1], then back substitution
+  // against the super-diagonal, h[i].
+  for (size_t i = 1; i < n; i++) {
+    double w = h[i - 1] / diag[i - 1];
+    diag[i] -= w * h[i - 1];
+    mx[i] -= w * mx[i - 1];
+    my[i] -= w * my[i - 1];
+    u[i] -= w * u[i - 1];
+  }
+  mx[n - 1] /= diag[n - 1];
+  my[n - 1] /= diag[n - 1];
+  u[n - 1] /= diag[n - 1];
+  for (size_t i = n - 1; i-- > 0;) {
+    mx[i] = (mx[i] - h[i] * mx[i + 1]) / diag[i];
+    my[i] = (my[i] - h[i] * my[i + 1]) / diag[i];
+    u[i] = (u[i] - h[i] * u[i + 1]) / diag[i];
+  }
+
+  double denom = 1 + u[0] + corner * u[n - 1] / gamma;
+  double fx = (mx[0] + corner * mx[n - 1] / gamma) / denom;
+  double fy = (my[0] + corner * my[n - 1] / gamma) / denom;
+  for (size_t i = 0; i < n; i++) {
+    mx[i] -= fx * u[i];
+    my[i] -= fy * u[i];
+  }
+}
+
+TrackMap::TrackMap() : mapped_(nullptr), mapped_size_(0) {
+  Assign(std::vector<double>(), std::vector<double>());
+}
+
+TrackMap::~TrackMap() { Unmap(); }
+
+bool TrackMap::Load(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  TrackHeader header;
+  bool compiled = pread(fd, &header, sizeof(header), 0) ==
+                      static_cast<ssize_t>(sizeof(header)) &&
+                  memcmp(header.magic, TRACK_MAGIC, sizeof(header.magic)) == 0;
+  if (compiled) {
+    struct stat st;
+    // Only the exact layout for its n is accepted, which also bounds every
+    // section by the file.
+    TrackHeader expected = Layout(header.n);
+    bool valid = LittleEndian() && header.version == TRACK_VERSION &&
+                 header.n > 0 && header.n <= UINT32_MAX &&
+                 memcmp(&header, &expected, sizeof(header)) == 0 &&
+                 fstat(fd, &st) == 0 &&
+                 static_cast<uint64_t>(st.st_size) == header.size;
+    void* base = MAP_FAILED;
+    if (valid) {
+      base = mmap(nullptr, header.size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    Unmap();
+    image_.clear();
+    image_.shrink_to_fit();
+    mapped_ = base;
+    mapped_size_ = header.size;
+    Attach(static_cast<const char*>(base));
+    return true;
+  }
+  close(fd);
+
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::vector<double> x;
+  std::vector<double> y;
+  std::string line;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    size_t comma = line.find(',');
+    if (comma != std::string::npos) {
+      x.push_back(atof(line.c_str()));
+      y.push_back(atof(line.c_str() + comma + 1));
+    }
+  }
+  if (x.empty()) {
+    return false;
+  }
+  Assign(x, y);
+  return true;
+}
+
+void TrackMap::Assign(const std::vector<double>& x,
+                      const std::vector<double>& y) {
+  std::vector<double> px;
+  std::vector<double> py;
+  for (size_t i = 0; i < std::min(x.size(), y.size()); i++) {
+    if (px.empty() || x[i] != px.back() || y[i] != py.back()) {
+      px.push_back(x[i]);
+      py.push_back(y[i]);
+    }
+  }
+  if (px.size() > 1 && px.back() == px.front() && py.back() == py.front()) {
+    px.pop_back();
+    py.pop_back();
+  }
+  size_t n = px.size();
+
+  TrackHeader header = Layout(n);
+  std::vector<uint64_t> image(header.size / sizeof(uint64_t), 0);
+  char* base = reinterpret_cast<char*>(image.data());
+  memcpy(base, &header, sizeof(header));
+  double* ix = reinterpret_cast<double*>(base + header.x);
+  double* iy = reinterpret_cast<double*>(base + header.y);
+  double* is = reinterpret_cast<double*>(base + header.s);
+  double* ispline = reinterpret_cast<double*>(base + header.spline);
+  double* iframe = reinterpret_cast<double*>(base + header.frame);
+  uint32_t* itree = reinterpret_cast<uint32_t*>(base + header.tree);
+  uint32_t* ibucket = reinterpret_cast<uint32_t*>(base + header.bucket);
+  std::copy(px.begin(), px.end(), ix);
+  std::copy(py.begin(), py.end(), iy);
+
+  // Chord lengths approximate the arc lengths; the segment from the last
+  // waypoint closes the loop.
+  std::vector<double> h(n);
+  is[0] = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t next = (i + 1) % n;
+    h[i] = std::hypot(ix[next] - ix[i], iy[next] - iy[i]);
+    is[i + 1] = is[i] + h[i];
+  }
+  std::vector<double> mx(n, 0.0);
+  std::vector<double> my(n, 0.0);
+  if (n >= 3) {
+    PeriodicSecondDerivatives(h, ix, iy, mx, my);
+  }
+  // With fewer waypoints the segments are straight.
+  for (size_t i = 0; i < n; i++) {
+    size_t next = (i + 1) % n;
+    double* c = ispline + 8 * i;
+    const double* v[2] = {ix, iy};
+    const std::vector<double>* m[2] = {&mx, &my};
+    for (int axis = 0; axis < 2; axis++) {
+      double m0 = (*m[axis])[i];
+      double m1 = (*m[axis])[next];
+      double* a = c + 4 * axis;
+      a[0] = v[axis][i];
+      a[1] = h[i] > 0 ? (v[axis][next] - v[axis][i]) / h[i] -
+                            h[i] * (2 * m0 + m1) / 6
+                      : 0;
+      a[2] = m0 / 2;
+      a[3] = h[i] > 0 ? (m1 - m0) / (6 * h[i]) : 0;
+    }
+    double speed2 = c[1] * c[1] + c[5] * c[5];
+    iframe[2 * i] = atan2(c[5], c[1]);
+    iframe[2 * i + 1] =
+        speed2 > 0 ? 2 * (c[1] * c[6] - c[5] * c[2]) / pow(speed2, 1.5) : 0;
+  }
+
+  size_t segment = 0;
+  for (size_t b = 0; b < n; b++) {
+    double start = is[n] * b / n;
+    while (segment + 1 < n && is[segment + 1] <= start) {
+      segment++;
+    }
+    ibucket[b] = segment;
+  }
+
+  Unmap();
+  image_.swap(image);
+  Attach(reinterpret_cast<const char*>(image_.data()));
+  for (size_t i = 0; i < n; i++) {
+    itree[i] = i;
+  }
+  Build(itree, 0, n, 0);
+}
+
+bool TrackMap::Save(const std::string& path) const {
+  const char* base = mapped_ ? static_cast<const char*>(mapped_)
+                             : reinterpret_cast<const char*>(image_.data());
+  size_t size = mapped_ ? mapped_size_ : image_.size() * sizeof(uint64_t);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(base, size);
+  return static_cast<bool>(out);
+}
+
+void TrackMap::Attach(const char* base) {
+  TrackHeader header;
+  memcpy(&header, base, sizeof(header));
+  n_ = header.n;
+  x_ = reinterpret_cast<const double*>(base + header.x);
+  y_ = reinterpret_cast<const double*>(base + header.y);
+  s_ = reinterpret_cast<const double*>(base + header.s);
+  spline_ = reinterpret_cast<const double*>(base + header.spline);
+  frame_ = reinterpret_cast<const double*>(base + header.frame);
+  tree_ = reinterpret_cast<const uint32_t*>(base + header.tree);
+  bucket_ = reinterpret_cast<const uint32_t*>(base + header.bucket);
+}
+
+void TrackMap::Unmap() {
+  if (mapped_) {
+    munmap(mapped_, mapped_size_);
+    mapped_ = nullptr;
+    mapped_size_ = 0;
+  }
+}
+
+void TrackMap::Build(uint32_t* tree, size_t begin, size_t end, int depth) {
+  if (end - begin <= 1) {
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  const double* axis = depth % 2 == 0 ? x_ : y_;
+  std::nth_element(tree + begin, tree + mid, tree + end,
+                   [axis](uint32_t a, uint32_t b) {
+                     return axis[a] < axis[b];
+                   });
+  Build(tree, begin, mid, depth + 1);
+  Build(tree, mid + 1, end, depth + 1);
+}
+
+void TrackMap::Search(size_t begin, size_t end, int depth, double x, double y,
+                      size_t& best, double& best_d2) const {
+  if (begin >= end) {
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  size_t i = tree_[mid];
+  double dx = x_[i] - x;
+  double dy = y_[i] - y;
+  double d2 = dx * dx + dy * dy;
+  if (d2 < best_d2) {
+    best = i;
+    best_d2 = d2;
+  }
+  // The side of the split the point is on first, the other only if the
+  // splitting line is nearer than the best so far.
+  double split = depth % 2 == 0 ? -dx : -dy;
+  if (split < 0) {
+    Search(begin, mid, depth + 1, x, y, best, best_d2);
+    if (split * split < best_d2) {
+      Search(mid + 1, end, depth + 1, x, y, best, best_d2);
+    }
+  } else {
+    Search(mid + 1, end, depth + 1, x, y, best, best_d2);
+    if (split * split < best_d2) {
+      Search(begin, mid, depth + 1, x, y, best, best_d2);
+    }
+  }
+}
+
+size_t TrackMap::Nearest(double x, double y) const {
+  size_t best = 0;
+  double best_d2 = INFINITY;
+  Search(0, n_, 0, x, y, best, best_d2);
+  return best;
+}
+
+size_t TrackMap::Segment(double s) const {
+  double length = s_[n_];
+  s -= length * floor(s / length);
+  size_t b = std::min(static_cast<size_t>(s / length * n_), n_ - 1);
+  // A step of arc length spans more than one segment only where segments
+  // are shorter than average, so this stays a few steps.
+  size_t i = bucket_[b];
+  while (i + 1 < n_ && s_[i + 1] <= s) {
+    i++;
+  }
+  return i;
+}
+
+void TrackMap::Evaluate(double s, double& x, double& y, double& dx,
+                        double& dy) const {
+  size_t i = Segment(s);
+  double length = s_[n_];
+  double t = s - length * floor(s / length) - s_[i];
+  const double* c = spline(i);
+  x = c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+  y = c[4] + t * (c[5] + t * (c[6] + t * c[7]));
+  dx = c[1] + t * (2 * c[2] + t * 3 * c[3]);
+  dy = c[5] + t * (2 * c[6] + t * 3 * c[7]);
+}
+
+double TrackMap::Project(double x, double y) const {
+  return Project(x, y, Nearest(x, y));
+}
+
+double TrackMap::Project(double x, double y, size_t nearest) const {
+  double best_s = s_[nearest];
+  double best_d2 = INFINITY;
+  // The nearest point is on one of the two segments meeting at the nearest
+  // waypoint; Newton on the squared distance along each, within it.
+  size_t segments[2] = {(nearest + n_ - 1) % n_, nearest};
+  for (size_t i : segments) {
+    const double* c = spline(i);
+    double h = s_[i + 1] - s_[i];
+    double t = i == nearest ? 0 : h;
+    for (int k = 0; k < PROJECT_STEPS; k++) {
+      double ex = c[0] + t * (c[1] + t * (c[2] + t * c[3])) - x;
+      double ey = c[4] + t * (c[5] + t * (c[6] + t * c[7])) - y;
+      double dx = c[1] + t * (2 * c[2] + t * 3 * c[3]);
+      double dy = c[5] + t * (2 * c[6] + t * 3 * c[7]);
+      double ddx = 2 * c[2] + t * 6 * c[3];
+      double ddy = 2 * c[6] + t * 6 * c[7];
+      double gradient = ex * dx + ey * dy;
+      double hessian = dx * dx + dy * dy + ex * ddx + ey * ddy;
+      if (hessian <= 0) {
+        break;
+      }
+      double next = std::min(std::max(t - gradient / hessian, 0.0), h);
+      bool done = std::fabs(next - t) < 1e-9;
+      t = next;
+      if (done) {
+        break;
+      }
+    }
+    double ex = c[0] + t * (c[1] + t * (c[2] + t * c[3])) - x;
+    double ey = c[4] + t * (c[5] + t * (c[6] + t * c[7])) - y;
+    if (ex * ex + ey * ey < best_d2) {
+      best_d2 = ex * ex + ey * ey;
+      best_s = s_[i] + t;
+    }
+  }
+  return best_s;
+}
+
+size_t TrackMap::Ahead(double px, double py, double psi, size_t k, double* x,
+                       double* y) const {
+  return Ahead(Nearest(px, py), px, py, psi, k, x, y);
+}
+
+size_t TrackMap::Ahead(size_t nearest, double px, double py, double psi,
+                       size_t k, double* x, double* y) const {
+  size_t n = n_;
+  if (n == 0) {
+    return 0;
+  }
+  size_t start = nearest;
+  // Ahead of the car, the fit should start from the one before.
+  if ((x_[start] - px) * cos(psi) + (y_[start] - py) * sin(psi) > 0) {
+    start = (start + n - 1) % n;
+  }
+  k = std::min(k, n);
+  for (size_t j = 0; j < k; j++) {
+    size_t i = (start + j) % n;
+    x[j] = x_[i];
+    y[j] = y_[i];
+  }
+  return k;
+}
@@ -0,0 +1,114 @@
+#ifndef TRACK_MAP_H
+#define TRACK_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The whole track, loaded once, so that the waypoints of a frame can be
+// picked locally instead of taken from the simulator.
+//
+// The waypoints are kept in driving order as a closed loop, like
+// lake_track_waypoints.csv, and indexed by a 2-d tree for nearest-waypoint
+// queries in O(log n), so tracks of hundreds of thousands of points are as
+// quick to query as the lake track. Along with them go the arc length at each
+// waypoint and a periodic cubic spline through them in arc length, with the
+// heading and curvature of each segment where it starts and a bucket table
+// that finds the segment at an arc length in O(1).
+//
+// All of it lives in one image with the layout of the compiled track format
+// (see tools/compile_track.cpp), either built in memory from the waypoints or
+// mapped read-only from a compiled file, so that loading a large map costs
+// no parsing and the processes serving it share one copy in the page cache.
+class TrackMap {
+ public:
+  TrackMap();
+  ~TrackMap();
+  TrackMap(const TrackMap&) = delete;
+  TrackMap& operator=(const TrackMap&) = delete;
+
+  // Map a compiled track, or read "x,y" lines after a header line,
+  // replacing the track. False if the file can't be read, is a compiled
+  // track of another version or is damaged, or has no waypoints.
+  bool Load(const std::string& path);
+
+  // Take the waypoints from memory instead. Repeated waypoints are dropped,
+  // including a last one that closes the loop onto the first.
+  void Assign(const std::vector<double>& x, const std::vector<double>& y);
+
+  // Write the track in the compiled format, for Load to map.
+  bool Save(const std::string& path) const;
+
+  // Whether the track is mapped from a compiled file.
+  bool mapped() const { return mapped_ != nullptr; }
+
+  size_t size() const { return n_; }
+  const double* x() const { return x_; }
+  const double* y() const { return y_; }
+  // Arc length along the loop at each waypoint, size() + 1 of them: s()[0]
+  // is 0 and s()[size()] the length of the loop, back at the first waypoint.
+  const double* s() const { return s_; }
+  double length() const { return s_[n_]; }
+  // Eight coefficients for the segment from waypoint i to the next,
+  // {x0, x1, x2, x3, y0, y1, y2, y3}, with x = x0 + x1 t + x2 t^2 + x3 t^3 in
+  // t = s - s()[i], and y alike.
+  const double* spline(size_t i) const { return spline_ + 8 * i; }
+  // Heading and curvature of the spline at waypoint i.
+  double heading(size_t i) const { return frame_[2 * i]; }
+  double curvature(size_t i) const { return frame_[2 * i + 1]; }
+
+  // The segment at arc length s, taken around the loop. The track must not
+  // be empty.
+  size_t Segment(double s) const;
+  // The spline at arc length s, and its derivatives along it.
+  void Evaluate(double s, double& x, double& y, double& dx, double& dy) const;
+  // Arc length of the point of the spline nearest (x, y), near the nearest
+  // waypoint.
+  double Project(double x, double y) const;
+  // The same near waypoint `nearest`, found some other way, as by a
+  // TrackLocalizer.
+  double Project(double x, double y, size_t nearest) const;
+
+  // Index of the waypoint nearest (x, y); the track must not be empty.
+  size_t Nearest(double x, double y) const;
+
+  // The k waypoints from the last one at or behind a car at (px, py) heading
+  // psi, on along the track, as the simulator picks them, into x and y.
+  // Returns how many were written: k, or the whole track if it is shorter.
+  size_t Ahead(double px, double py, double psi, size_t k, double* x,
+               double* y) const;
+  // The same from waypoint `nearest`, the one nearest the car.
+  size_t Ahead(size_t nearest, double px, double py, double psi, size_t k,
+               double* x, double* y) const;
+
+ private:
+  // Point the sections at the image at `base`.
+  void Attach(const char* base);
+  void Unmap();
+  // Order the subtree of tree[begin, end) at `depth`: its median on the
+  // axis, x at even depths and y at odd, goes in the middle.
+  void Build(uint32_t* tree, size_t begin, size_t end, int depth);
+  void Search(size_t begin, size_t end, int depth, double x, double y,
+              size_t& best, double& best_d2) const;
+
+  // The image when built in memory, in words to keep the doubles aligned.
+  std::vector<uint64_t> image_;
+  // The image when mapped from a file.
+  void* mapped_;
+  size_t mapped_size_;
+
+  size_t n_;
+  const double* x_;
+  const double* y_;
+  const double* s_;
+  const double* spline_;
+  const double* frame_;
+  // For each of n equal steps of arc length, the segment it starts in.
+  const uint32_t* bucket_;
+  // Waypoint indices as an implicit 2-d tree: each range's root is its
+  // middle element.
+  const uint32_t* tree_;
+};
+
+#endif /* TRACK_MAP_H */
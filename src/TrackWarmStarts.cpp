@@ -0,0 +1,139 @@
+#include "TrackWarmStarts.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+// Warm start files hold this header, then a flag byte per bin and the
+// floats of each bin, filled or not.
+static const char WARM_START_MAGIC[4] = {'M', 'T', 'W', 'S'};
+static const uint32_t WARM_START_VERSION = 1;
+
+namespace {
+
+struct WarmStartHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t bins;
+  uint64_t width;
+  double length;
+};
+
+}  // namespace
+
+TrackWarmStarts::TrackWarmStarts(double length, double bin, size_t width)
+    : length_(length), width_(width), n_filled_(0), last_(0), travelled_(0),
+      lapped_(false) {
+  size_t bins = std::max(1., std::floor(length / bin + 0.5));
+  bin_ = length / bins;
+  filled_.assign(bins, 0);
+  solutions_.assign(bins * width, 0.f);
+  last_ = bins;
+}
+
+size_t TrackWarmStarts::Bin(double s) const {
+  double wrapped = std::fmod(s, length_);
+  if (wrapped < 0) {
+    wrapped += length_;
+  }
+  return std::min(size_t(wrapped / bin_), filled_.size() - 1);
+}
+
+const float* TrackWarmStarts::Find(double s) const {
+  size_t bins = filled_.size();
+  size_t bin = Bin(s);
+  for (size_t d = 0; d <= MAX_DISTANCE && 2 * d < bins; d++) {
+    size_t ahead = (bin + d) % bins;
+    size_t behind = (bin + bins - d) % bins;
+    if (filled_[ahead]) {
+      return &solutions_[ahead * width_];
+    }
+    if (filled_[behind]) {
+      return &solutions_[behind * width_];
+    }
+  }
+  return nullptr;
+}
+
+void TrackWarmStarts::Store(double s, const double* x) {
+  size_t bins = filled_.size();
+  size_t bin = Bin(s);
+  // Only steps forward count towards a lap; a jump of half the loop or more
+  // is the car being put somewhere else.
+  size_t step = (bin + bins - last_) % bins;
+  if (last_ < bins && 2 * step < bins) {
+    travelled_ += step;
+  }
+  if (travelled_ >= bins) {
+    travelled_ = 0;
+    lapped_ = true;
+  }
+  last_ = bin;
+  n_filled_ += !filled_[bin];
+  filled_[bin] = 1;
+  std::copy(x, x + width_, solutions_.begin() + bin * width_);
+}
+
+bool TrackWarmStarts::Load(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  WarmStartHeader header;
+  std::vector<unsigned char> filled(filled_.size());
+  std::vector<float> solutions(solutions_.size());
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, WARM_START_MAGIC,
+                      sizeof(header.magic)) == 0 &&
+               header.version == WARM_START_VERSION &&
+               header.bins == filled_.size() && header.width == width_ &&
+               std::abs(header.length - length_) <= 1e-6 * length_ &&
+               fread(filled.data(), 1, filled.size(), file) == filled.size() &&
+               fread(solutions.data(), sizeof(float), solutions.size(),
+                     file) == solutions.size();
+  fclose(file);
+  if (!valid) {
+    return false;
+  }
+  filled_.swap(filled);
+  solutions_.swap(solutions);
+  n_filled_ = std::count(filled_.begin(), filled_.end(), 1);
+  last_ = filled_.size();
+  travelled_ = 0;
+  lapped_ = false;
+  return true;
+}
+
+bool TrackWarmStarts::Save(const std::string& path) {
+  // Tried once a lap either way.
+  lapped_ = false;
+  // Written aside and renamed into place, so that controllers sharing the
+  // file never read a partial one.
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".%d.%p", int(getpid()),
+           static_cast<const void*>(this));
+  std::string temporary = path + suffix;
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  WarmStartHeader header;
+  memcpy(header.magic, WARM_START_MAGIC, sizeof(WARM_START_MAGIC));
+  header.version = WARM_START_VERSION;
+  header.bins = filled_.size();
+  header.width = width_;
+  header.length = length_;
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(filled_.data(), 1, filled_.size(), file) == filled_.size() &&
+      fwrite(solutions_.data(), sizeof(float), solutions_.size(), file) ==
+          solutions_.size();
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef TRACK_WARM_STARTS_H
+#define TRACK_WARM_STARTS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Solutions by position along a known track, kept on disk across runs, so
+// that a controller starting on the track warm starts its first solves
+// instead of paying for cold ones lap after lap.
+//
+// The loop is cut into bins of equal arc length, each holding the last
+// solution solved in it, in single precision: a warm start needs no more,
+// and the file stays small, a header and then a flag and `width` floats a
+// bin in native byte order. A file is only taken for the track length, bin
+// length and problem width it was written with.
+class TrackWarmStarts {
+ public:
+  // Bins of about `bin` meters around a loop of `length`, for solutions of
+  // `width` variables.
+  TrackWarmStarts(double length, double bin, size_t width);
+
+  // Replace the bins with those of `path`; false, keeping them, if it can't
+  // be read or is for another track or problem.
+  bool Load(const std::string& path);
+  // Write the bins to `path`, through a temporary file renamed into place,
+  // which clears lapped().
+  bool Save(const std::string& path);
+
+  size_t width() const { return width_; }
+  size_t bins() const { return filled_.size(); }
+  // Bins holding a solution.
+  size_t filled() const { return n_filled_; }
+  // Whether Store went once around the loop since the last Load or Save.
+  bool lapped() const { return lapped_; }
+
+  // The solution of the bin at arc length s, or failing that of the
+  // nearest one holding a solution within MAX_DISTANCE bins; nullptr if
+  // none does.
+  static const size_t MAX_DISTANCE = 2;
+  const float* Find(double s) const;
+  // Keep x as the solution of the bin at arc length s.
+  void Store(double s, const double* x);
+
+ private:
+  size_t Bin(double s) const;
+
+  double length_;
+  double bin_;
+  size_t width_;
+  std::vector<unsigned char> filled_;
+  std::vector<float> solutions_;
+  size_t n_filled_;
+  // The bin stored last, bins() before the first, and the bins moved
+  // forward since the last lap.
+  size_t last_;
+  size_t travelled_;
+  bool lapped_;
+};
+
+#endif /* TRACK_WARM_STARTS_H */
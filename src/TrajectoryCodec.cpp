@@ -0,0 +1,161 @@
+#include "TrajectoryCodec.h"
+#include <algorithm>
+#include <cmath>
+
+// Centimeters, and 1e-4 of the actuations' units.
+static const double POINT_SCALE = 100;
+static const double ACTUATION_SCALE = 1e4;
+// Far beyond any trajectory's reach, and within a varint's.
+static const double LIMIT = 1e12;
+
+static int64_t Quantize(double x, double scale) {
+  if (!std::isfinite(x)) {
+    return 0;
+  }
+  return int64_t(std::llround(std::max(-LIMIT, std::min(LIMIT, x * scale))));
+}
+
+static void Varint(std::string& out, uint64_t n) {
+  while (n >= 0x80) {
+    out.push_back(char(n | 0x80));
+    n >>= 7;
+  }
+  out.push_back(char(n));
+}
+
+static void Signed(std::string& out, int64_t n) {
+  Varint(out, (uint64_t(n) << 1) ^ uint64_t(n >> 63));
+}
+
+// Reads varints off a message, failing for good at the first bad one.
+class VarintReader {
+ public:
+  VarintReader(const char* begin, const char* end)
+      : p_(begin), end_(end), ok_(true) {}
+  uint64_t Next() {
+    uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p_ == end_) {
+        break;
+      }
+      uint8_t byte = uint8_t(*p_++);
+      n |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return n;
+      }
+    }
+    ok_ = false;
+    return 0;
+  }
+  int64_t Signed() {
+    uint64_t n = Next();
+    return int64_t(n >> 1) ^ -int64_t(n & 1);
+  }
+  bool ok() const { return ok_; }
+  bool done() const { return p_ == end_; }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool ok_;
+};
+
+TrajectoryEncoder::TrajectoryEncoder() : sequence_(0) {}
+
+void TrajectoryEncoder::Header(std::string& out, Kind kind, unsigned session,
+                               double steering, double throttle,
+                               size_t points) const {
+  out.clear();
+  out.push_back('M');
+  out.push_back('D');
+  out.push_back(char(TRAJECTORY_CODEC_VERSION));
+  out.push_back(char(kind));
+  Varint(out, session);
+  Varint(out, sequence_);
+  Signed(out, Quantize(steering, ACTUATION_SCALE));
+  Signed(out, Quantize(throttle, ACTUATION_SCALE));
+  Varint(out, points);
+}
+
+void TrajectoryEncoder::Encode(unsigned session, double steering,
+                               double throttle, const double* x,
+                               const double* y, size_t points,
+                               std::string& key, std::string& delta) {
+  sequence_++;
+  next_.resize(2 * points);
+  for (size_t i = 0; i < points; i++) {
+    next_[i] = Quantize(x[i], POINT_SCALE);
+    next_[points + i] = Quantize(y[i], POINT_SCALE);
+  }
+  // A key frame is within 10 bytes a coordinate, and mostly 2.
+  key.reserve(32 + 4 * points);
+  Header(key, KEY, session, steering, throttle, points);
+  for (size_t i = 0; i < 2 * points; i++) {
+    int64_t before = i % points == 0 ? 0 : next_[i - 1];
+    Signed(key, next_[i] - before);
+  }
+  delta.clear();
+  if (sequence_ > 1 && last_.size() == next_.size()) {
+    delta.reserve(32 + 2 * points);
+    Header(delta, DELTA, session, steering, throttle, points);
+    for (size_t i = 0; i < 2 * points; i++) {
+      int64_t step = next_[i] - (i % points == 0 ? 0 : next_[i - 1]);
+      int64_t last = last_[i] - (i % points == 0 ? 0 : last_[i - 1]);
+      Signed(delta, step - last);
+    }
+  }
+  last_.swap(next_);
+}
+
+bool TrajectoryDecoder::Decode(const char* data, size_t length,
+                               TrajectoryUpdate& update) {
+  if (length < 4 || data[0] != 'M' || data[1] != 'D' ||
+      uint8_t(data[2]) != TRAJECTORY_CODEC_VERSION ||
+      (data[3] != TrajectoryEncoder::KEY &&
+       data[3] != TrajectoryEncoder::DELTA)) {
+    return false;
+  }
+  bool delta = data[3] == TrajectoryEncoder::DELTA;
+  VarintReader in(data + 4, data + length);
+  uint64_t session = in.Next();
+  uint64_t sequence = in.Next();
+  int64_t steering = in.Signed();
+  int64_t throttle = in.Signed();
+  uint64_t points = in.Next();
+  // At least a byte a coordinate.
+  if (!in.ok() || points > length) {
+    return false;
+  }
+  auto last = last_.find(unsigned(session));
+  if (delta && (last == last_.end() || last->second.sequence + 1 != sequence ||
+                last->second.points.size() != 2 * points)) {
+    return false;
+  }
+  std::vector<int64_t> values(2 * points);
+  for (size_t i = 0; i < 2 * points; i++) {
+    int64_t step = in.Signed();
+    int64_t before = i % points == 0 ? 0 : values[i - 1];
+    if (delta) {
+      const std::vector<int64_t>& p = last->second.points;
+      step += p[i] - (i % points == 0 ? 0 : p[i - 1]);
+    }
+    values[i] = before + step;
+  }
+  if (!in.ok() || !in.done()) {
+    return false;
+  }
+  update.session = unsigned(session);
+  update.sequence = sequence;
+  update.steering = steering / ACTUATION_SCALE;
+  update.throttle = throttle / ACTUATION_SCALE;
+  update.x.resize(points);
+  update.y.resize(points);
+  for (size_t i = 0; i < points; i++) {
+    update.x[i] = values[i] / POINT_SCALE;
+    update.y[i] = values[points + i] / POINT_SCALE;
+  }
+  Last& kept = last_[unsigned(session)];
+  kept.sequence = sequence;
+  kept.points.swap(values);
+  return true;
+}
@@ -0,0 +1,81 @@
+#ifndef TRAJECTORY_CODEC_H
+#define TRAJECTORY_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// The compact dashboard stream, see Dashboard and DATA.md: a session's
+// predicted trajectory in centimeters, as varints, each update either a key
+// frame that stands alone or a delta against the session's update before.
+//
+// A message is
+//
+//   'M' 'D' version kind  session sequence steering throttle points  x... y...
+//
+// with kind 0 for a key frame and 1 for a delta, and then varints: the
+// session and the update's sequence number, LEB128; the steering angle, in
+// 1e-4 radians, and the throttle, in 1e-4, zigzag LEB128; the number of
+// points; and the points' coordinates, zigzag LEB128 each. In a key frame a
+// coordinate is its step from the point before, the first from 0; in a
+// delta it is that step less the same step in update sequence - 1, which
+// has as many points. Quantized values are carried exactly, so a delta
+// doesn't drift from the key frame it started from.
+static const uint8_t TRAJECTORY_CODEC_VERSION = 1;
+
+// Encodes one session's updates, remembering the last for the next delta.
+class TrajectoryEncoder {
+ public:
+  enum Kind { KEY = 0, DELTA = 1 };
+  TrajectoryEncoder();
+
+  // Number the update `session` gives and write it into `key` as a key
+  // frame, and into `delta` against the last update, or leave `delta`
+  // empty if that had a different number of points or there was none.
+  void Encode(unsigned session, double steering, double throttle,
+              const double* x, const double* y, size_t points,
+              std::string& key, std::string& delta);
+  // The number of the last update; 0 before the first.
+  uint64_t sequence() const { return sequence_; }
+
+ private:
+  void Header(std::string& out, Kind kind, unsigned session, double steering,
+              double throttle, size_t points) const;
+
+  uint64_t sequence_;
+  // The last update's quantized points, and this one's.
+  std::vector<int64_t> last_;
+  std::vector<int64_t> next_;
+};
+
+// A decoded update.
+struct TrajectoryUpdate {
+  unsigned session;
+  uint64_t sequence;
+  double steering;
+  double throttle;
+  std::vector<double> x;
+  std::vector<double> y;
+};
+
+// Decodes the stream of any number of sessions, keeping each one's last
+// update for its deltas.
+class TrajectoryDecoder {
+ public:
+  // False, changing nothing, if the message is malformed, or a delta
+  // against an update this decoder didn't see.
+  bool Decode(const char* data, size_t length, TrajectoryUpdate& update);
+  // Forget a session, once it is gone.
+  void Forget(unsigned session) { last_.erase(session); }
+
+ private:
+  struct Last {
+    uint64_t sequence;
+    std::vector<int64_t> points;
+  };
+  std::map<unsigned, Last> last_;
+};
+
+#endif /* TRAJECTORY_CODEC_H */
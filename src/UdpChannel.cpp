@@ -0,0 +1,162 @@
+#include "UdpChannel.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+
+static const uint8_t UDP_VERSION = 1;
+
+UdpChannel::UdpChannel()
+    : socket_(-1), buffer_(HEADER_SIZE + MAX_MESSAGE + 1, '\0'),
+      replaced_(0), stale_(0) {
+  peers_.reserve(MAX_PEERS);
+  pending_.reserve(MAX_PEERS);
+  out_.reserve(HEADER_SIZE + MAX_MESSAGE);
+}
+
+UdpChannel::~UdpChannel() {
+  if (socket_ >= 0) {
+    close(socket_);
+  }
+}
+
+bool UdpChannel::Bind(int port) {
+  socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_ < 0) {
+    return false;
+  }
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(uint16_t(port));
+  if (bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+  return true;
+}
+
+bool UdpChannel::Connect(const char* host, int port) {
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(uint16_t(port));
+  if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+    return false;
+  }
+  socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_ < 0) {
+    return false;
+  }
+  peers_.clear();
+  pending_.clear();
+  Find(address);
+  return true;
+}
+
+size_t UdpChannel::Find(const sockaddr_in& address) {
+  for (size_t i = 0; i < peers_.size(); i++) {
+    if (peers_[i].address.sin_addr.s_addr == address.sin_addr.s_addr &&
+        peers_[i].address.sin_port == address.sin_port) {
+      return i;
+    }
+  }
+  if (peers_.size() == MAX_PEERS) {
+    return MAX_PEERS;
+  }
+  Peer peer;
+  peer.address = address;
+  peer.delivered = false;
+  peer.sequence = 0;
+  peers_.push_back(peer);
+  pending_.push_back(-1);
+  return peers_.size() - 1;
+}
+
+size_t UdpChannel::ReceiveLatest(std::vector<Datagram>& frames,
+                                 std::chrono::milliseconds timeout) {
+  pollfd fd = {socket_, POLLIN, 0};
+  if (poll(&fd, 1, int(timeout.count())) <= 0) {
+    return 0;
+  }
+  size_t count = 0;
+  for (;;) {
+    sockaddr_in from;
+    socklen_t from_length = sizeof(from);
+    ssize_t length =
+        recvfrom(socket_, &buffer_[0], buffer_.size(), MSG_DONTWAIT,
+                 reinterpret_cast<sockaddr*>(&from), &from_length);
+    if (length < 0) {
+      break;
+    }
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(buffer_.data());
+    if (size_t(length) < HEADER_SIZE ||
+        size_t(length) > HEADER_SIZE + MAX_MESSAGE || header[0] != 'M' ||
+        header[1] != 'U' || header[2] != UDP_VERSION ||
+        from.sin_family != AF_INET) {
+      continue;
+    }
+    uint32_t sequence = uint32_t(header[4]) | uint32_t(header[5]) << 8 |
+                        uint32_t(header[6]) << 16 | uint32_t(header[7]) << 24;
+    size_t peer = Find(from);
+    if (peer == MAX_PEERS) {
+      continue;
+    }
+    // Ordered by serial number arithmetic, so that the numbers may wrap.
+    Peer& p = peers_[peer];
+    if (p.delivered && int32_t(sequence - p.sequence) <= 0) {
+      stale_++;
+      continue;
+    }
+    int& slot = pending_[peer];
+    if (slot >= 0) {
+      // One of the two is dropped.
+      replaced_++;
+      if (int32_t(sequence - frames[slot].sequence) <= 0) {
+        continue;
+      }
+    } else {
+      slot = int(count++);
+      if (frames.size() < count) {
+        frames.resize(count);
+      }
+    }
+    Datagram& frame = frames[slot];
+    frame.peer = peer;
+    frame.sequence = sequence;
+    frame.message.assign(buffer_.data() + HEADER_SIZE,
+                         length - HEADER_SIZE);
+  }
+  for (size_t i = 0; i < count; i++) {
+    Peer& p = peers_[frames[i].peer];
+    p.delivered = true;
+    p.sequence = frames[i].sequence;
+    pending_[frames[i].peer] = -1;
+  }
+  return count;
+}
+
+bool UdpChannel::Send(size_t peer, uint32_t sequence,
+                      const std::string& message) {
+  if (message.size() > MAX_MESSAGE || peer >= peers_.size()) {
+    return false;
+  }
+  uint8_t header[HEADER_SIZE] = {'M',
+                                 'U',
+                                 UDP_VERSION,
+                                 0,
+                                 uint8_t(sequence),
+                                 uint8_t(sequence >> 8),
+                                 uint8_t(sequence >> 16),
+                                 uint8_t(sequence >> 24)};
+  out_.assign(reinterpret_cast<const char*>(header), HEADER_SIZE);
+  out_.append(message);
+  const sockaddr_in& to = peers_[peer].address;
+  return sendto(socket_, out_.data(), out_.size(), 0,
+                reinterpret_cast<const sockaddr*>(&to), sizeof(to)) ==
+         ssize_t(out_.size());
+}
@@ -0,0 +1,87 @@
+#ifndef UDP_CHANNEL_H
+#define UDP_CHANNEL_H
+
+#include <netinet/in.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Telemetry and commands as UDP datagrams, for links where a command held
+// up behind a lost packet, as on a TCP stream, is worse than the lost
+// packet: each datagram stands alone, and only the newest counts.
+//
+// A datagram is an 8 byte header,
+//
+//   'M' 'U' version 0 sequence (little-endian uint32)
+//
+// followed by a message of BinaryProtocol.h, at most MAX_MESSAGE bytes. The
+// bridge numbers its telemetry, and each command carries the number of the
+// frame it answers, so the bridge can drop a command that arrives after a
+// newer one. Here, of the datagrams waiting from a peer only the highest
+// numbered is delivered; the others were replaced, and one numbered at or
+// below a frame already delivered is stale, having come out of order.
+class UdpChannel {
+ public:
+  static const size_t HEADER_SIZE = 8;
+  static const size_t MAX_MESSAGE = 4096;
+  // Peers kept; datagrams from more are dropped.
+  static const size_t MAX_PEERS = 64;
+
+  struct Datagram {
+    // Into peers in the order they were first heard from.
+    size_t peer;
+    uint32_t sequence;
+    std::string message;
+  };
+
+  UdpChannel();
+  ~UdpChannel();
+  UdpChannel(const UdpChannel&) = delete;
+  UdpChannel& operator=(const UdpChannel&) = delete;
+
+  // Receive on `port` of every IPv4 address. False if it can't.
+  bool Bind(int port);
+
+  // Or talk to the one peer at `host`, an IPv4 address, and `port`, as a
+  // client does, from a port of the system's choosing; it is peer 0. False
+  // if it can't.
+  bool Connect(const char* host, int port);
+
+  // Wait up to `timeout` for datagrams, then read all that are waiting:
+  // the newest of each peer's go into the first frames, and their count is
+  // returned, 0 if none came. The frames past them are kept for their
+  // buffers.
+  size_t ReceiveLatest(std::vector<Datagram>& frames,
+                       std::chrono::milliseconds timeout);
+
+  // Send `message` to `peer`, numbered `sequence`. False if it is too long
+  // or the socket refused it; there is no retrying a datagram.
+  bool Send(size_t peer, uint32_t sequence, const std::string& message);
+
+  // Datagrams dropped as replaced by newer ones, and as stale.
+  uint64_t replaced() const { return replaced_; }
+  uint64_t stale() const { return stale_; }
+
+ private:
+  struct Peer {
+    sockaddr_in address;
+    // The last sequence delivered, once there is one.
+    bool delivered;
+    uint32_t sequence;
+  };
+  // The peer at `address`, added if new; MAX_PEERS if there's no room.
+  size_t Find(const sockaddr_in& address);
+
+  int socket_;
+  std::vector<Peer> peers_;
+  // Where each peer's datagram is in the frames being received, or -1.
+  std::vector<int> pending_;
+  std::string buffer_;
+  std::string out_;
+  uint64_t replaced_;
+  uint64_t stale_;
+};
+
+#endif /* UDP_CHANNEL_H */
@@ -0,0 +1,700 @@
+#include "UringServer.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/evp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include "SocketOptions.h"
+
+// Submission entries; the completion ring is twice as long.
+static const unsigned RING_ENTRIES = 256;
+// The receive buffers the kernel picks from, each a read.
+static const unsigned RECEIVE_BUFFERS = 512;
+static const size_t RECEIVE_BUFFER_SIZE = 16384;
+static const uint16_t BUFFER_GROUP = 0;
+// The send buffers, each a write in flight.
+static const size_t SEND_SLOTS = 256;
+static const size_t SEND_SLOT_SIZE = 16384;
+// An upgrade request longer than this is refused.
+static const size_t MAX_REQUEST = 8192;
+
+// What a completion is for, in the top half of its user_data; the
+// connection is in the bottom half.
+enum Operation : uint64_t {
+  ACCEPT = 1,
+  RECEIVE = 2,
+  WRITE = 3,
+  PROVIDE = 4,
+  WAKE = 5
+};
+
+static uint64_t UserData(Operation operation, size_t connection) {
+  return operation << 32 | connection;
+}
+
+// The opcodes of RFC 6455.
+enum Opcode : uint8_t {
+  CONTINUATION = 0x0,
+  TEXT = 0x1,
+  BINARY = 0x2,
+  CLOSE = 0x8,
+  PING = 0x9,
+  PONG = 0xa
+};
+
+// The close codes sent.
+static const uint16_t PROTOCOL_ERROR = 1002;
+static const uint16_t TOO_BIG = 1009;
+
+// The longest frame header sent, unmasked with a 64 bit length.
+static const size_t MAX_HEADER = 10;
+
+static size_t WriteHeader(char* out, uint8_t opcode, size_t length) {
+  out[0] = char(0x80 | opcode);
+  if (length < 126) {
+    out[1] = char(length);
+    return 2;
+  }
+  if (length < 65536) {
+    out[1] = 126;
+    out[2] = char(length >> 8);
+    out[3] = char(length);
+    return 4;
+  }
+  out[1] = 127;
+  for (int i = 0; i < 8; i++) {
+    out[2 + i] = char(uint64_t(length) >> (56 - 8 * i));
+  }
+  return 10;
+}
+
+// Sec-WebSocket-Accept for `key`: the base64 of the SHA-1 of the key and
+// the protocol's GUID.
+static std::string AcceptKey(const std::string& key) {
+  std::string text = key + "258EAFA5-E914-47DA-95CA-C5AB0DC11B65";
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  EVP_Digest(text.data(), text.size(), digest, &length, EVP_sha1(), nullptr);
+  unsigned char encoded[64];
+  int n = EVP_EncodeBlock(encoded, digest, int(length));
+  return std::string(reinterpret_cast<char*>(encoded), size_t(n));
+}
+
+// The value of header `name`, lower case, in `request`, or empty.
+static std::string Header(const std::string& request, const char* name) {
+  size_t length = strlen(name);
+  for (size_t line = request.find("\r\n"); line != std::string::npos;
+       line = request.find("\r\n", line + 2)) {
+    size_t start = line + 2;
+    if (request.size() < start + length + 1 || request[start + length] != ':') {
+      continue;
+    }
+    bool match = true;
+    for (size_t i = 0; i < length && match; i++) {
+      match = tolower(static_cast<unsigned char>(request[start + i])) ==
+              name[i];
+    }
+    if (!match) {
+      continue;
+    }
+    size_t value = request.find_first_not_of(' ', start + length + 1);
+    size_t end = request.find("\r\n", start);
+    if (value == std::string::npos || value >= end) {
+      return std::string();
+    }
+    end = request.find_last_not_of(' ', end - 1) + 1;
+    return request.substr(value, end - value);
+  }
+  return std::string();
+}
+
+UringServer::UringServer()
+    : listener_(-1), ring_(-1), sq_map_(MAP_FAILED), sq_map_size_(0),
+      cq_map_(MAP_FAILED), cq_map_size_(0),
+      sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)), sqes_size_(0),
+      sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_array_(nullptr),
+      cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr),
+      tail_(0), accepting_(false), wake_fd_(-1), watching_(false),
+      enters_(0), completions_(0) {}
+
+UringServer::~UringServer() {
+  for (Connection& c : connections_) {
+    if (c.stage != FREE) {
+      close(c.fd);
+    }
+  }
+  if (listener_ >= 0) {
+    close(listener_);
+  }
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
+  }
+  // Closing the ring cancels what is in flight before the buffers go.
+  if (ring_ >= 0) {
+    close(ring_);
+  }
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_) {
+    munmap(cq_map_, cq_map_size_);
+  }
+  if (sq_map_ != MAP_FAILED) {
+    munmap(sq_map_, sq_map_size_);
+  }
+}
+
+bool UringServer::Listen(int port) {
+  listener_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener_ < 0) {
+    return false;
+  }
+  int on = 1;
+  setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(uint16_t(port));
+  if (bind(listener_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener_, SOMAXCONN) != 0) {
+    return false;
+  }
+
+  // Completions are run when the thread enters the kernel rather than by
+  // interrupting it; kernels before 5.19 do without.
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_COOP_TASKRUN;
+  ring_ = int(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+  if (ring_ < 0 && errno == EINVAL) {
+    memset(&params, 0, sizeof(params));
+    ring_ = int(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+  }
+  if (ring_ < 0) {
+    return false;
+  }
+  sq_map_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cq_map_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+  }
+  sq_map_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+  if (sq_map_ == MAP_FAILED) {
+    return false;
+  }
+  cq_map_ = params.features & IORING_FEAT_SINGLE_MMAP
+                ? sq_map_
+                : mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES));
+  if (cq_map_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+    return false;
+  }
+  char* sq = static_cast<char*>(sq_map_);
+  char* cq = static_cast<char*>(cq_map_);
+  sq_head_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+  cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  tail_ = *sq_tail_;
+
+  // The receive buffers, provided to the kernel as a group it takes one
+  // from for each read, and given back once read.
+  receive_buffers_.resize(RECEIVE_BUFFERS * RECEIVE_BUFFER_SIZE);
+  ProvideBuffers(0, RECEIVE_BUFFERS);
+
+  // The send buffers, registered as one.
+  send_buffers_.resize(SEND_SLOTS * SEND_SLOT_SIZE);
+  iovec all;
+  all.iov_base = send_buffers_.data();
+  all.iov_len = send_buffers_.size();
+  if (syscall(__NR_io_uring_register, ring_, IORING_REGISTER_BUFFERS, &all,
+              1) != 0) {
+    return false;
+  }
+  for (size_t i = SEND_SLOTS; i-- > 0;) {
+    free_slots_.push_back(int(i));
+  }
+  wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wake_fd_ < 0) {
+    return false;
+  }
+  connections_.reserve(MAX_CONNECTIONS);
+  Accept();
+  WatchWake();
+  return true;
+}
+
+io_uring_sqe* UringServer::NextSqe() {
+  // Full: submit what is queued to make room, without waiting.
+  if (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) > sq_mask_) {
+    __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+    syscall(__NR_io_uring_enter, ring_, tail_ - *sq_head_, 0, 0, nullptr, 0);
+    enters_++;
+  }
+  uint32_t index = tail_ & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  tail_++;
+  return sqe;
+}
+
+void UringServer::ProvideBuffers(uint16_t first, unsigned count) {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = int(count);
+  sqe->addr = reinterpret_cast<uint64_t>(
+      &receive_buffers_[first * RECEIVE_BUFFER_SIZE]);
+  sqe->len = RECEIVE_BUFFER_SIZE;
+  sqe->off = first;
+  sqe->buf_group = BUFFER_GROUP;
+  // It only fails if the group is full, which it can't be.
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = UserData(PROVIDE, 0);
+}
+
+void UringServer::Accept() {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listener_;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = UserData(ACCEPT, 0);
+  accepting_ = true;
+}
+
+void UringServer::WatchWake() {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = wake_fd_;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = UserData(WAKE, 0);
+  watching_ = true;
+}
+
+void UringServer::Wake() {
+  uint64_t one = 1;
+  if (write(wake_fd_, &one, sizeof(one)) < 0) {
+    // Full, which wakes it all the same.
+  }
+}
+
+void UringServer::Receive(size_t connection) {
+  Connection& c = connections_[connection];
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = c.fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BUFFER_GROUP;
+  sqe->user_data = UserData(RECEIVE, connection);
+  c.receiving = true;
+}
+
+void UringServer::Write(size_t connection) {
+  Connection& c = connections_[connection];
+  if (c.stage == FREE || c.stage == SHUT || c.slot >= 0 || c.out.empty()) {
+    return;
+  }
+  if (free_slots_.empty()) {
+    waiting_.push_back(connection);
+    return;
+  }
+  c.slot = free_slots_.back();
+  free_slots_.pop_back();
+  char* buffer = &send_buffers_[c.slot * SEND_SLOT_SIZE];
+  size_t length = std::min(c.out.size(), SEND_SLOT_SIZE);
+  memcpy(buffer, c.out.data(), length);
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = c.fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer);
+  sqe->len = uint32_t(length);
+  sqe->buf_index = 0;
+  sqe->user_data = UserData(WRITE, connection);
+}
+
+void UringServer::Append(Connection& c, uint8_t opcode, const char* data,
+                         size_t length) {
+  char header[MAX_HEADER];
+  c.out.append(header, WriteHeader(header, opcode, length));
+  c.out.append(data, length);
+}
+
+bool UringServer::Send(size_t connection, const char* data, size_t length,
+                       bool binary) {
+  if (connection >= connections_.size() ||
+      connections_[connection].stage != OPEN) {
+    return false;
+  }
+  Append(connections_[connection], binary ? BINARY : TEXT, data, length);
+  Write(connection);
+  return true;
+}
+
+void UringServer::Close(size_t connection, uint16_t code) {
+  Connection& c = connections_[connection];
+  if (c.stage != OPEN && c.stage != UPGRADING) {
+    return;
+  }
+  if (c.stage == OPEN) {
+    char payload[2] = {char(code >> 8), char(code)};
+    Append(c, CLOSE, payload, sizeof(payload));
+  }
+  c.stage = CLOSING;
+  if (c.out.empty()) {
+    Shut(connection);
+  } else {
+    Write(connection);
+  }
+}
+
+void UringServer::Shut(size_t connection) {
+  Connection& c = connections_[connection];
+  // Ends the receive and fails the write in flight, whose completions
+  // release the connection.
+  shutdown(c.fd, SHUT_RDWR);
+  c.stage = SHUT;
+  c.out.clear();
+}
+
+UringServer::Event& UringServer::Push(std::vector<Event>& events, size_t& n,
+                                      Event::Type type, size_t connection) {
+  if (n == events.size()) {
+    events.emplace_back();
+  }
+  Event& event = events[n++];
+  event.type = type;
+  event.connection = connection;
+  event.binary = false;
+  event.data.clear();
+  return event;
+}
+
+void UringServer::Release(size_t connection, std::vector<Event>& events,
+                          size_t& n) {
+  Connection& c = connections_[connection];
+  if (c.stage != SHUT || c.receiving || c.slot >= 0) {
+    return;
+  }
+  close(c.fd);
+  c.stage = FREE;
+  if (c.opened) {
+    Push(events, n, Event::CLOSED, connection);
+  }
+  free_connections_.push_back(connection);
+}
+
+size_t UringServer::Poll(std::vector<Event>& events,
+                         std::chrono::milliseconds timeout) {
+  size_t n = 0;
+  if (!accepting_) {
+    Accept();
+  }
+  if (!watching_) {
+    WatchWake();
+  }
+  // One call submits all that was queued since the last, and waits unless
+  // completions are already in.
+  bool waiting = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) == *cq_head_;
+  __kernel_timespec ts;
+  ts.tv_sec = timeout.count() / 1000;
+  ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+  io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.ts = reinterpret_cast<uint64_t>(&ts);
+  __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+  syscall(__NR_io_uring_enter, ring_, tail_ - *sq_head_, waiting ? 1 : 0,
+          IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  enters_++;
+
+  uint32_t head = *cq_head_;
+  uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    io_uring_cqe cqe = cqes_[head & cq_mask_];
+    // Freed before it is handled, as handling it can queue more.
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    completions_++;
+    Completed(cqe, events, n);
+  }
+  return n;
+}
+
+void UringServer::Completed(const io_uring_cqe& cqe,
+                            std::vector<Event>& events, size_t& n) {
+  Operation operation = Operation(cqe.user_data >> 32);
+  size_t connection = size_t(cqe.user_data & 0xffffffff);
+  bool more = cqe.flags & IORING_CQE_F_MORE;
+  switch (operation) {
+    case ACCEPT: {
+      accepting_ = more;
+      if (cqe.res < 0) {
+        return;
+      }
+      if (free_connections_.empty() &&
+          connections_.size() == MAX_CONNECTIONS) {
+        close(cqe.res);
+        return;
+      }
+      if (free_connections_.empty()) {
+        free_connections_.push_back(connections_.size());
+        connections_.emplace_back();
+      }
+      size_t k = free_connections_.back();
+      free_connections_.pop_back();
+      Connection& c = connections_[k];
+      c.fd = cqe.res;
+      c.stage = UPGRADING;
+      c.opened = false;
+      c.in.clear();
+      c.message.clear();
+      c.fragmented = false;
+      c.out.clear();
+      c.slot = -1;
+      SetNoDelay(c.fd, true);
+      Receive(k);
+      return;
+    }
+    case RECEIVE: {
+      Connection& c = connections_[connection];
+      c.receiving = more;
+      if (cqe.flags & IORING_CQE_F_BUFFER) {
+        uint16_t id = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe.res > 0 && c.stage != SHUT) {
+          Received(connection, &receive_buffers_[id * RECEIVE_BUFFER_SIZE],
+                   size_t(cqe.res), events, n);
+        }
+        ProvideBuffers(id, 1);
+      }
+      if (!more && c.stage != SHUT) {
+        // Out of buffers for a moment, or the peer is gone.
+        if (cqe.res == -ENOBUFS) {
+          Receive(connection);
+        } else if (cqe.res <= 0) {
+          Shut(connection);
+        }
+      }
+      Release(connection, events, n);
+      return;
+    }
+    case WRITE: {
+      Connection& c = connections_[connection];
+      free_slots_.push_back(c.slot);
+      c.slot = -1;
+      if (cqe.res < 0) {
+        if (c.stage != SHUT) {
+          Shut(connection);
+        }
+      } else if (c.stage != SHUT) {
+        c.out.erase(0, size_t(cqe.res));
+        if (c.stage == CLOSING && c.out.empty()) {
+          Shut(connection);
+        } else {
+          Write(connection);
+        }
+      }
+      Release(connection, events, n);
+      // The slot goes to a connection that was waiting for one.
+      while (!waiting_.empty() && !free_slots_.empty()) {
+        size_t next = waiting_.back();
+        waiting_.pop_back();
+        Write(next);
+      }
+      return;
+    }
+    case WAKE: {
+      watching_ = more;
+      uint64_t count;
+      if (read(wake_fd_, &count, sizeof(count)) < 0) {
+        // Already read on an earlier completion.
+      }
+      return;
+    }
+    case PROVIDE:
+      return;
+  }
+}
+
+void UringServer::Received(size_t connection, const char* data, size_t length,
+                           std::vector<Event>& events, size_t& n) {
+  Connection& c = connections_[connection];
+  c.in.append(data, length);
+  if (c.stage == UPGRADING && !Upgrade(connection, events, n)) {
+    return;
+  }
+  if (c.stage == OPEN) {
+    Frames(connection, events, n);
+  }
+}
+
+bool UringServer::Upgrade(size_t connection, std::vector<Event>& events,
+                          size_t& n) {
+  Connection& c = connections_[connection];
+  size_t end = c.in.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    if (c.in.size() > MAX_REQUEST) {
+      Shut(connection);
+    }
+    return false;
+  }
+  std::string request = c.in.substr(0, end + 2);
+  c.in.erase(0, end + 4);
+  std::string key = Header(request, "sec-websocket-key");
+  size_t path = request.find(' ');
+  size_t path_end =
+      path == std::string::npos ? path : request.find(' ', path + 1);
+  if (key.empty() || request.compare(0, 4, "GET ") != 0 ||
+      path_end == std::string::npos) {
+    static const char refusal[] =
+        "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n"
+        "Connection: close\r\n\r\n";
+    c.out.append(refusal, sizeof(refusal) - 1);
+    c.stage = CLOSING;
+    Write(connection);
+    return false;
+  }
+  c.out += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+           "Connection: Upgrade\r\nSec-WebSocket-Accept: ";
+  c.out += AcceptKey(key);
+  c.out += "\r\n\r\n";
+  Write(connection);
+  c.stage = OPEN;
+  c.opened = true;
+  Push(events, n, Event::OPENED, connection).data =
+      request.substr(path + 1, path_end - path - 1);
+  return true;
+}
+
+void UringServer::Frames(size_t connection, std::vector<Event>& events,
+                         size_t& n) {
+  Connection& c = connections_[connection];
+  size_t at = 0;
+  bool open = true;
+  while (open) {
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(c.in.data()) + at;
+    size_t available = c.in.size() - at;
+    if (available < 2) {
+      break;
+    }
+    bool fin = p[0] & 0x80;
+    uint8_t opcode = p[0] & 0x0f;
+    uint64_t length = p[1] & 0x7f;
+    size_t header = 2;
+    if (length == 126) {
+      header = 4;
+    } else if (length == 127) {
+      header = 10;
+    }
+    if (available < header + 4) {
+      break;
+    }
+    if (header == 4) {
+      length = uint64_t(p[2]) << 8 | p[3];
+    } else if (header == 10) {
+      length = 0;
+      for (int i = 0; i < 8; i++) {
+        length = length << 8 | p[2 + i];
+      }
+    }
+    // Clients mask all they send, and extensions set the reserved bits.
+    bool control = opcode & 0x8;
+    if (!(p[1] & 0x80) || (p[0] & 0x70) ||
+        (control && (!fin || length > 125))) {
+      Close(connection, PROTOCOL_ERROR);
+      break;
+    }
+    if (length > MAX_MESSAGE) {
+      Close(connection, TOO_BIG);
+      break;
+    }
+    if (available < header + 4 + length) {
+      break;
+    }
+    const unsigned char* mask = p + header;
+    char* payload = &c.in[at + header + 4];
+    for (size_t i = 0; i < length; i++) {
+      payload[i] ^= char(mask[i & 3]);
+    }
+    at += header + 4 + length;
+    switch (opcode) {
+      case TEXT:
+      case BINARY:
+        if (c.fragmented) {
+          Close(connection, PROTOCOL_ERROR);
+          open = false;
+        } else if (fin) {
+          Event& event = Push(events, n, Event::MESSAGE, connection);
+          event.binary = opcode == BINARY;
+          event.data.assign(payload, length);
+        } else {
+          c.message.assign(payload, length);
+          c.messageBinary = opcode == BINARY;
+          c.fragmented = true;
+        }
+        break;
+      case CONTINUATION:
+        if (!c.fragmented || c.message.size() + length > MAX_MESSAGE) {
+          Close(connection, c.fragmented ? TOO_BIG : PROTOCOL_ERROR);
+          open = false;
+        } else {
+          c.message.append(payload, length);
+          if (fin) {
+            Event& event = Push(events, n, Event::MESSAGE, connection);
+            event.binary = c.messageBinary;
+            event.data.swap(c.message);
+            c.message.clear();
+            c.fragmented = false;
+          }
+        }
+        break;
+      case CLOSE:
+        // Answered with its code, or none if it had none.
+        if (length >= 2) {
+          Close(connection, uint16_t(uint8_t(payload[0]) << 8 |
+                                     uint8_t(payload[1])));
+        } else {
+          Append(c, CLOSE, nullptr, 0);
+          c.stage = CLOSING;
+          Write(connection);
+        }
+        open = false;
+        break;
+      case PING:
+        Append(c, PONG, payload, length);
+        Write(connection);
+        break;
+      case PONG:
+        break;
+      default:
+        Close(connection, PROTOCOL_ERROR);
+        open = false;
+    }
+  }
+  if (c.stage == OPEN) {
+    c.in.erase(0, at);
+  } else {
+    c.in.clear();
+  }
+}
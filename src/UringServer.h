@@ -0,0 +1,150 @@
+#ifndef URING_SERVER_H
+#define URING_SERVER_H
+
+#include <linux/io_uring.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Websocket connections served on an io_uring of their own instead of
+// libuv's epoll loop, which takes a system call for every read and every
+// write. Here one io_uring_enter submits all the writes queued since the
+// last and waits for what completed: a multishot accept takes the
+// connections, and a multishot receive on each fills buffers the kernel
+// picks from a group provided to it, so that a read is never asked for and
+// a buffer is only taken by data that came; replies are written from
+// buffers registered once, which the kernel doesn't map again for each
+// write. Speaks RFC 6455 as the simulator does:
+// the upgrade, text and binary messages, fragments, pings and closes,
+// without extensions. Single threaded but for Wake(); needs Linux 6.0.
+class UringServer {
+ public:
+  // Received messages longer than this close their connection.
+  static const size_t MAX_MESSAGE = 1 << 20;
+  // Connections kept; more are closed as they are accepted.
+  static const size_t MAX_CONNECTIONS = 1024;
+
+  struct Event {
+    enum Type { OPENED, MESSAGE, CLOSED };
+    Type type;
+    // Numbered from 0 by slot: a number is reused after its CLOSED.
+    size_t connection;
+    bool binary;
+    // The request's path on OPENED, the payload of a MESSAGE.
+    std::string data;
+  };
+
+  UringServer();
+  ~UringServer();
+  UringServer(const UringServer&) = delete;
+  UringServer& operator=(const UringServer&) = delete;
+
+  // Listen on `port` of every IPv4 address. False if it can't, or the
+  // kernel has no io_uring to serve it with.
+  bool Listen(int port);
+
+  // Submit what is queued, wait up to `timeout` for completions, and take
+  // all that are in: the connections opened and closed and the messages
+  // received go into the first events, and their count is returned. The
+  // events past them are kept for their buffers.
+  size_t Poll(std::vector<Event>& events, std::chrono::milliseconds timeout);
+
+  // Queue `data` as a message on `connection`, written on the next Poll.
+  // False if the connection is gone.
+  bool Send(size_t connection, const char* data, size_t length, bool binary);
+
+  // Close `connection` with `code`; its CLOSED follows.
+  void Close(size_t connection, uint16_t code);
+
+  // Have a Poll that waits return now, or the next one not wait; from any
+  // thread, for work done elsewhere to be sent. The rest are the Poll's
+  // thread's only.
+  void Wake();
+
+  // io_uring_enter calls and the completions they reaped, for the
+  // completions each call amortizes.
+  uint64_t enters() const { return enters_; }
+  uint64_t completions() const { return completions_; }
+
+ private:
+  // A connection is read until it is SHUT, and its slot is FREE again once
+  // nothing of it is in flight; CLOSING, it is shut once written out.
+  enum Stage { FREE, UPGRADING, OPEN, CLOSING, SHUT };
+  struct Connection {
+    int fd;
+    Stage stage;
+    // Whether its OPENED went out, for a CLOSED to follow.
+    bool opened;
+    // Bytes received and not yet framed, and a fragmented message so far.
+    std::string in;
+    std::string message;
+    bool messageBinary;
+    bool fragmented;
+    // Bytes to write, the front of them in the write in flight if any.
+    std::string out;
+    // The send buffer of the write in flight, or -1.
+    int slot;
+    // Whether the multishot receive is armed.
+    bool receiving;
+  };
+
+  io_uring_sqe* NextSqe();
+  void Accept();
+  void WatchWake();
+  void Receive(size_t connection);
+  // Write the front of the connection's output, if none is in flight.
+  void Write(size_t connection);
+  void Append(Connection& c, uint8_t opcode, const char* data, size_t length);
+  void Completed(const io_uring_cqe& cqe, std::vector<Event>& events,
+                 size_t& n);
+  void Received(size_t connection, const char* data, size_t length,
+                std::vector<Event>& events, size_t& n);
+  bool Upgrade(size_t connection, std::vector<Event>& events, size_t& n);
+  void Frames(size_t connection, std::vector<Event>& events, size_t& n);
+  // Stop reading and writing; the slot is freed once nothing is in flight.
+  void Shut(size_t connection);
+  void Release(size_t connection, std::vector<Event>& events, size_t& n);
+  Event& Push(std::vector<Event>& events, size_t& n, Event::Type type,
+              size_t connection);
+  // Give the kernel `count` receive buffers from `first` on to read into.
+  void ProvideBuffers(uint16_t first, unsigned count);
+
+  int listener_;
+  int ring_;
+  // The rings as mapped, and their sizes.
+  void* sq_map_;
+  size_t sq_map_size_;
+  void* cq_map_;
+  size_t cq_map_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  uint32_t* sq_head_;
+  uint32_t* sq_tail_;
+  uint32_t sq_mask_;
+  uint32_t* sq_array_;
+  uint32_t* cq_head_;
+  uint32_t* cq_tail_;
+  uint32_t cq_mask_;
+  io_uring_cqe* cqes_;
+  // The tail of the SQEs filled, published on submission.
+  uint32_t tail_;
+  bool accepting_;
+  // An eventfd Wake() writes to, and whether a multishot poll watches it.
+  int wake_fd_;
+  bool watching_;
+  // The receive buffers, provided to the kernel.
+  std::vector<char> receive_buffers_;
+  // The registered send buffers, and those not in flight.
+  std::vector<char> send_buffers_;
+  std::vector<int> free_slots_;
+  // Connections with output waiting for a send buffer.
+  std::vector<size_t> waiting_;
+  std::vector<Connection> connections_;
+  std::vector<size_t> free_connections_;
+  uint64_t enters_;
+  uint64_t completions_;
+};
+
+#endif /* URING_SERVER_H */
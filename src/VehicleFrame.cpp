@@ -0,0 +1,8 @@
+#include "VehicleFrame.h"
+#include "SimdKernels.h"
+
+void ToVehicleFrame(double px, double py, double psi, const double* x,
+                    const double* y, size_t n, double* vehicle_x,
+                    double* vehicle_y) {
+  Kernels().toVehicleFrame(px, py, psi, x, y, n, vehicle_x, vehicle_y);
+}
@@ -0,0 +1,16 @@
+#ifndef VEHICLE_FRAME_H
+#define VEHICLE_FRAME_H
+
+#include <cstddef>
+
+// Express the world points (x[i], y[i]), i < n, in the frame of a vehicle at
+// (px, py) heading psi: x along the heading, y to the left. The rotation is
+// set up once and applied to all the points as Eigen array expressions over
+// the x and y buffers, so it vectorizes and serves a whole track as well as
+// the waypoints of a frame. The outputs may alias the inputs. Built for
+// each instruction set, see SimdKernels.h.
+void ToVehicleFrame(double px, double py, double psi, const double* x,
+                    const double* y, size_t n, double* vehicle_x,
+                    double* vehicle_y);
+
+#endif /* VEHICLE_FRAME_H */
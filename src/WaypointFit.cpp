@@ -0,0 +1,479 @@
+#include "WaypointFit.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "PerfCounters.h"
+#include "Polyfit.h"
+#include "Polynomial.h"
+#include "Stages.h"
+#include "TrackMap.h"
+#include "VehicleFrame.h"
+
+// Sample points of a re-expressed curve.
+static const int NODES = 6;
+// Newton steps to find the curve point at a node, at most; the first node
+// starts from a straight-line guess and each one after from the node before.
+static const int NEWTON_STEPS = 8;
+static const double NEWTON_TOLERANCE = 1e-9;
+// Below this slope of the vehicle x along the cached curve, it is too close
+// to folding back to be a function of x.
+static const double MIN_FORWARD_SLOPE = 0.1;
+// A downdate that leaves 1 - |R^-T a|^2 below this, or a diagonal of R
+// below this much of its largest, leaves too little of the fit to trust.
+static const double MIN_DOWNDATE = 1e-8;
+
+static double Node(int j) { return -cos(M_PI * (j + 0.5) / NODES); }
+
+// FNV-1a over the bit patterns of the coordinates, a word at a time.
+static uint64_t Hash(const double* x, const double* y, size_t n) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t words[2];
+    memcpy(&words[0], &x[i], sizeof(double));
+    memcpy(&words[1], &y[i], sizeof(double));
+    h = (h ^ words[0]) * 1099511628211ull;
+    h = (h ^ words[1]) * 1099511628211ull;
+  }
+  return h;
+}
+
+WaypointFit::WaypointFit()
+    : weightDistance(0), reuse(true), maxReuseRotation(0.02), slide(true),
+      minSlide(40), slideRefit(32), coeffs_(Eigen::Vector4d::Zero()),
+      cached_(false), cache_hash_(0), cache_n_(0), cache_first_(0),
+      cache_last_(0), factored_(false), qr_scale_(1), slides_(0),
+      reused_(0), refitted_(0), slid_(0) {
+  Eigen::Matrix<double, NODES, 4> A;
+  for (int j = 0; j < NODES; j++) {
+    double power = 1;
+    for (int i = 0; i < 4; i++) {
+      A(j, i) = power;
+      power *= Node(j);
+    }
+  }
+  Eigen::Matrix4d AtA = A.transpose() * A;
+  projection_ = AtA.ldlt().solve(A.transpose());
+}
+
+void WaypointFit::Reserve(size_t n) {
+  if (size_t(vandermonde_.rows()) < n) {
+    vandermonde_.resize(n, 4);
+    weights_.resize(n);
+    vehicle_x_.resize(n);
+    vehicle_y_.resize(n);
+    cache_x_.resize(n);
+    cache_y_.resize(n);
+    anchor_x_.resize(n);
+    anchor_y_.resize(n);
+  }
+}
+
+const Eigen::Vector4d& WaypointFit::FitWorld(double px, double py, double psi,
+                                             const double* x, const double* y,
+                                             size_t n) {
+  Reserve(n);
+  // The fixed-size fit of 6 points is cheaper than re-expressing one.
+  auto start = std::chrono::steady_clock::now();
+  if (n == 6 && weightDistance <= 0) {
+    refitted_++;
+    PerfScope transform_counts(STAGE_TRANSFORM);
+    ToVehicleFrame(px, py, psi, x, y, n, vehicle_x_.data(),
+                   vehicle_y_.data());
+    transform_counts.Stop();
+    auto transformed = std::chrono::steady_clock::now();
+    RecordStage(STAGE_TRANSFORM, std::chrono::duration<double>(
+                                     transformed - start).count());
+    PerfScope fit_counts(STAGE_POLYFIT);
+    Fit(vehicle_x_.data(), vehicle_y_.data(), n);
+    fit_counts.Stop();
+    RecordStage(STAGE_POLYFIT, transformed);
+    return coeffs_;
+  }
+  uint64_t hash = Hash(x, y, n);
+  bool same = cached_ && hash == cache_hash_ && n == cache_n_ &&
+              memcmp(x, cache_x_.data(), n * sizeof(double)) == 0 &&
+              memcmp(y, cache_y_.data(), n * sizeof(double)) == 0;
+  if (reuse && same && n >= 4 &&
+      std::fabs(remainder(psi - cache_psi_, 2 * M_PI)) <= maxReuseRotation) {
+    // The span of the waypoints in the new frame, from the two that bound
+    // it in the cached one; close enough for placing the nodes.
+    double ends_x[2] = {x[cache_first_], x[cache_last_]};
+    double ends_y[2] = {y[cache_first_], y[cache_last_]};
+    double lo;
+    double hi;
+    ToVehicleFrame(px, py, psi, ends_x, ends_y, 1, &lo, ends_y);
+    ToVehicleFrame(px, py, psi, ends_x + 1, ends_y + 1, 1, &hi, ends_y + 1);
+    if (lo < hi && Reexpress(px, py, psi, lo, hi)) {
+      reused_++;
+      RecordStage(STAGE_POLYFIT, start);
+      return coeffs_;
+    }
+  }
+  if (slide && factored_ && n == cache_n_ && n >= minSlide &&
+      slides_ < slideRefit &&
+      std::fabs(remainder(psi - cache_psi_, 2 * M_PI)) <= maxReuseRotation) {
+    size_t k = Shift(x, y, n);
+    if (k > 0 && Slide(x, y, n, k)) {
+      cache_hash_ = hash;
+      double ends_x[2] = {x[cache_first_], x[cache_last_]};
+      double ends_y[2] = {y[cache_first_], y[cache_last_]};
+      double lo;
+      double hi;
+      ToVehicleFrame(px, py, psi, ends_x, ends_y, 1, &lo, ends_y);
+      ToVehicleFrame(px, py, psi, ends_x + 1, ends_y + 1, 1, &hi,
+                     ends_y + 1);
+      if (lo < hi && Reexpress(px, py, psi, lo, hi)) {
+        slid_++;
+        RecordStage(STAGE_POLYFIT, start);
+        return coeffs_;
+      }
+    }
+  }
+
+  refitted_++;
+  auto transform = std::chrono::steady_clock::now();
+  PerfScope transform_counts(STAGE_TRANSFORM);
+  ToVehicleFrame(px, py, psi, x, y, n, vehicle_x_.data(), vehicle_y_.data());
+  transform_counts.Stop();
+  auto transformed = std::chrono::steady_clock::now();
+  RecordStage(STAGE_TRANSFORM,
+              std::chrono::duration<double>(transformed - transform).count());
+  PerfScope fit_counts(STAGE_POLYFIT);
+  Fit(vehicle_x_.data(), vehicle_y_.data(), n);
+  fit_counts.Stop();
+  RecordStage(STAGE_POLYFIT, transformed);
+  cached_ = true;
+  cache_hash_ = hash;
+  cache_n_ = n;
+  std::copy(x, x + n, cache_x_.data());
+  std::copy(y, y + n, cache_y_.data());
+  cache_px_ = px;
+  cache_py_ = py;
+  cache_psi_ = psi;
+  cache_coeffs_ = coeffs_;
+  auto xs = vehicle_x_.head(n);
+  cache_first_ = 0;
+  cache_last_ = 0;
+  if (n > 0) {
+    xs.minCoeff(&cache_first_);
+    xs.maxCoeff(&cache_last_);
+  }
+  factored_ = false;
+  if (slide && weightDistance <= 0 && n >= std::max<size_t>(minSlide, 5)) {
+    anchor_x_.head(n) = xs;
+    anchor_y_.head(n) = vehicle_y_.head(n);
+    Factor(n);
+  }
+  return coeffs_;
+}
+
+size_t WaypointFit::Shift(const double* x, const double* y,
+                          size_t n) const {
+  // The first waypoint of the new set among the cached ones, then the rest
+  // after it; at least 4 must stay.
+  for (size_t k = 1; k + 4 < n; k++) {
+    if (cache_x_[k] == x[0] && cache_y_[k] == y[0]) {
+      size_t kept = n - k;
+      if (memcmp(x, cache_x_.data() + k, kept * sizeof(double)) == 0 &&
+          memcmp(y, cache_y_.data() + k, kept * sizeof(double)) == 0) {
+        return k;
+      }
+    }
+  }
+  return 0;
+}
+
+bool WaypointFit::Slide(const double* x, const double* y, size_t n,
+                        size_t k) {
+  // The new waypoints in the cached frame, added before the old ones are
+  // removed so that R keeps its rank throughout.
+  size_t kept = n - k;
+  ToVehicleFrame(cache_px_, cache_py_, cache_psi_, x + kept, y + kept, k,
+                 vehicle_x_.data(), vehicle_y_.data());
+  for (size_t i = 0; i < k; i++) {
+    AddRow(vehicle_x_[i], vehicle_y_[i]);
+  }
+  for (size_t i = 0; i < k; i++) {
+    if (!RemoveRow(anchor_x_[i], anchor_y_[i])) {
+      factored_ = false;
+      return false;
+    }
+  }
+  slides_++;
+  std::copy(anchor_x_.data() + k, anchor_x_.data() + n, anchor_x_.data());
+  std::copy(anchor_y_.data() + k, anchor_y_.data() + n, anchor_y_.data());
+  std::copy(vehicle_x_.data(), vehicle_x_.data() + k,
+            anchor_x_.data() + kept);
+  std::copy(vehicle_y_.data(), vehicle_y_.data() + k,
+            anchor_y_.data() + kept);
+  std::copy(x, x + n, cache_x_.data());
+  std::copy(y, y + n, cache_y_.data());
+  auto xs = anchor_x_.head(n);
+  xs.minCoeff(&cache_first_);
+  xs.maxCoeff(&cache_last_);
+
+  // R c = Q' y, on the scaled abscissae.
+  double largest = qr_r_.diagonal().cwiseAbs().maxCoeff();
+  for (int i = 3; i >= 0; i--) {
+    if (std::fabs(qr_r_(i, i)) <= MIN_DOWNDATE * largest) {
+      factored_ = false;
+      return false;
+    }
+    double sum = qr_z_[i];
+    for (int j = i + 1; j < 4; j++) {
+      sum -= qr_r_(i, j) * cache_coeffs_[j];
+    }
+    cache_coeffs_[i] = sum / qr_r_(i, i);
+  }
+  double power = 1;
+  for (int i = 0; i < 4; i++) {
+    cache_coeffs_[i] /= power;
+    power *= qr_scale_;
+  }
+  return true;
+}
+
+void WaypointFit::Factor(size_t n) {
+  auto xs = anchor_x_.head(n);
+  qr_scale_ = xs.cwiseAbs().maxCoeff();
+  if (qr_scale_ == 0) {
+    qr_scale_ = 1;
+  }
+  qr_r_.setZero();
+  qr_z_.setZero();
+  for (size_t i = 0; i < n; i++) {
+    AddRow(anchor_x_[i], anchor_y_[i]);
+  }
+  factored_ = true;
+  slides_ = 0;
+}
+
+void WaypointFit::AddRow(double X, double Y) {
+  double u = X / qr_scale_;
+  double a[4] = {1, u, u * u, u * u * u};
+  double b = Y;
+  // Rotate the row into each row of R in turn, zeroing its entries.
+  for (int k = 0; k < 4; k++) {
+    double r = std::hypot(qr_r_(k, k), a[k]);
+    if (r == 0) {
+      continue;
+    }
+    double c = qr_r_(k, k) / r;
+    double s = a[k] / r;
+    qr_r_(k, k) = r;
+    for (int j = k + 1; j < 4; j++) {
+      double t = c * qr_r_(k, j) + s * a[j];
+      a[j] = c * a[j] - s * qr_r_(k, j);
+      qr_r_(k, j) = t;
+    }
+    double t = c * qr_z_[k] + s * b;
+    b = c * b - s * qr_z_[k];
+    qr_z_[k] = t;
+  }
+}
+
+bool WaypointFit::RemoveRow(double X, double Y) {
+  double u = X / qr_scale_;
+  double a[4] = {1, u, u * u, u * u * u};
+  // p = R^-T a; the rest determine a cubic while |p| < 1.
+  double p[4];
+  double norm = 0;
+  for (int j = 0; j < 4; j++) {
+    if (qr_r_(j, j) <= 0) {
+      return false;
+    }
+    double sum = a[j];
+    for (int i = 0; i < j; i++) {
+      sum -= qr_r_(i, j) * p[i];
+    }
+    p[j] = sum / qr_r_(j, j);
+    norm += p[j] * p[j];
+  }
+  if (norm >= 1 - MIN_DOWNDATE) {
+    return false;
+  }
+  // The rotations that take (p, alpha) to (0, 1), from the last.
+  double alpha = std::sqrt(1 - norm);
+  double c[4];
+  double s[4];
+  for (int i = 3; i >= 0; i--) {
+    double scale = alpha + std::fabs(p[i]);
+    double ca = alpha / scale;
+    double sb = p[i] / scale;
+    double h = std::sqrt(ca * ca + sb * sb);
+    c[i] = ca / h;
+    s[i] = sb / h;
+    alpha = scale * h;
+  }
+  for (int j = 0; j < 4; j++) {
+    double carry = 0;
+    for (int i = j; i >= 0; i--) {
+      double t = c[i] * carry + s[i] * qr_r_(i, j);
+      qr_r_(i, j) = c[i] * qr_r_(i, j) - s[i] * carry;
+      carry = t;
+    }
+  }
+  double zeta = Y;
+  for (int i = 0; i < 4; i++) {
+    qr_z_[i] = (qr_z_[i] - s[i] * zeta) / c[i];
+    zeta = c[i] * zeta - s[i] * qr_z_[i];
+  }
+  return true;
+}
+
+bool WaypointFit::Reexpress(double px, double py, double psi, double lo,
+                            double hi) {
+  // The new vehicle in the cached frame.
+  double ox;
+  double oy;
+  ToVehicleFrame(cache_px_, cache_py_, cache_psi_, &px, &py, 1, &ox, &oy);
+  double c = cos(psi - cache_psi_);
+  double s = sin(psi - cache_psi_);
+  const Eigen::Vector4d& p = cache_coeffs_;
+
+  // Along the cached curve (X, p(X)), the new frame sees
+  //   x(X) = (X - ox) c + (p(X) - oy) s,  y(X) = (p(X) - oy) c - (X - ox) s.
+  double mid = (lo + hi) / 2;
+  double half = std::max((hi - lo) / 2, 1e-6);
+  Eigen::Matrix<double, NODES, 1> samples;
+  double X = ox + (mid + half * Node(0)) * c;
+  for (int j = 0; j < NODES; j++) {
+    double target = mid + half * Node(j);
+    for (int k = 0; k < NEWTON_STEPS; k++) {
+      double slope = c + PolyEval<3, 1>(p, X) * s;
+      if (slope < MIN_FORWARD_SLOPE) {
+        return false;
+      }
+      double step =
+          ((X - ox) * c + (PolyEval<3>(p, X) - oy) * s - target) / slope;
+      X -= step;
+      if (std::fabs(step) < NEWTON_TOLERANCE) {
+        break;
+      }
+    }
+    samples[j] = (PolyEval<3>(p, X) - oy) * c - (X - ox) * s;
+  }
+  Project(samples, mid, half);
+  return true;
+}
+
+bool WaypointFit::FitTrack(const TrackMap& track, double px, double py,
+                           double psi, double behind, double ahead) {
+  if (track.size() < 2) {
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  double c = cos(psi);
+  double s = sin(psi);
+  double s0 = localizer_.Project(track, px, py);
+  // The span in the car's x, from the ends of the arc.
+  double ends[2];
+  double arcs[2] = {s0 - behind, s0 + ahead};
+  for (int e = 0; e < 2; e++) {
+    double x, y, dx, dy;
+    track.Evaluate(arcs[e], x, y, dx, dy);
+    ends[e] = (x - px) * c + (y - py) * s;
+  }
+  if (ends[0] >= ends[1]) {
+    return false;
+  }
+  double mid = (ends[0] + ends[1]) / 2;
+  double half = (ends[1] - ends[0]) / 2;
+
+  // Along the track, the car sees x(S) = (X(S) - px) c + (Y(S) - py) s.
+  Eigen::Matrix<double, NODES, 1> samples;
+  double S = s0 + mid + half * Node(0);
+  for (int j = 0; j < NODES; j++) {
+    double target = mid + half * Node(j);
+    double x, y, dx, dy;
+    for (int k = 0; k < NEWTON_STEPS; k++) {
+      track.Evaluate(S, x, y, dx, dy);
+      double slope = dx * c + dy * s;
+      if (slope < MIN_FORWARD_SLOPE) {
+        return false;
+      }
+      double step = ((x - px) * c + (y - py) * s - target) / slope;
+      S -= step;
+      if (std::fabs(step) < NEWTON_TOLERANCE) {
+        break;
+      }
+    }
+    track.Evaluate(S, x, y, dx, dy);
+    samples[j] = (y - py) * c - (x - px) * s;
+  }
+  Project(samples, mid, half);
+  RecordStage(STAGE_POLYFIT, start);
+  return true;
+}
+
+void WaypointFit::Project(const Eigen::Matrix<double, NODES, 1>& samples,
+                          double mid, double half) {
+  // The cubic in u = (x - mid) / half, expanded into powers of x.
+  Eigen::Vector4d q = projection_ * samples;
+  Eigen::Vector4d u_power(1, 0, 0, 0);
+  coeffs_.setZero();
+  for (int i = 0; i < 4; i++) {
+    coeffs_ += q[i] * u_power;
+    // u_power *= (x - mid) / half
+    Eigen::Vector4d next = Eigen::Vector4d::Zero();
+    for (int k = 0; k < 3; k++) {
+      next[k] -= u_power[k] * mid / half;
+      next[k + 1] += u_power[k] / half;
+    }
+    u_power = next;
+  }
+}
+
+const Eigen::Vector4d& WaypointFit::Fit(const double* x, const double* y,
+                                        size_t n) {
+  typedef Eigen::Map<const Eigen::Matrix<double, 6, 1> > SixPoints;
+  if (n == 6 && weightDistance <= 0) {
+    coeffs_ = polyfit<3>(SixPoints(x), SixPoints(y));
+    return coeffs_;
+  }
+
+  coeffs_.setZero();
+  if (n == 0) {
+    return coeffs_;
+  }
+  Eigen::Map<const Eigen::VectorXd> xs(x, n);
+  Eigen::Map<const Eigen::VectorXd> ys(y, n);
+  int order = int(std::min<size_t>(n - 1, 3));
+
+  Reserve(n);
+  auto A = vandermonde_.topRows(n).leftCols(order + 1);
+  auto w = weights_.head(n);
+  // As in polyfit<3>, on abscissae scaled to [-1, 1].
+  double scale = xs.cwiseAbs().maxCoeff();
+  if (scale == 0) {
+    scale = 1;
+  }
+  A.col(0).setOnes();
+  for (int i = 0; i < order; i++) {
+    A.col(i + 1) = A.col(i).cwiseProduct(xs) / scale;
+  }
+  if (weightDistance > 0) {
+    for (size_t i = 0; i < n; i++) {
+      double d = std::hypot(x[i], y[i]) / weightDistance;
+      w[i] = 1 / (1 + d * d);
+    }
+  } else {
+    w.setOnes();
+  }
+
+  Eigen::Matrix4d AtWA;
+  Eigen::Vector4d AtWy;
+  auto normal = AtWA.topLeftCorner(order + 1, order + 1);
+  auto rhs = AtWy.head(order + 1);
+  normal.noalias() = A.transpose() * w.asDiagonal() * A;
+  rhs.noalias() = A.transpose() * w.cwiseProduct(ys);
+  coeffs_.head(order + 1) = normal.ldlt().solve(rhs);
+
+  double power = 1;
+  for (int i = 0; i <= order; i++) {
+    coeffs_[i] /= power;
+    power *= scale;
+  }
+  return coeffs_;
+}
@@ -0,0 +1,164 @@
+#ifndef WAYPOINT_FIT_H
+#define WAYPOINT_FIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Eigen-3.3/Eigen/Core"
+#include "TrackLocalizer.h"
+
+// The cubic reference line through the waypoints of a frame, in vehicle
+// coordinates, for any number of waypoints.
+//
+// The simulator's 6 go through the fixed-size polyfit<3>. Other counts, and
+// weighted fits, solve the weighted normal equations in buffers that grow
+// to the most waypoints seen and are reused after, so a longer lookahead
+// doesn't cost an allocation per frame.
+//
+// The simulator sends the same waypoints for many frames in a row, until
+// the car passes one. FitWorld() keeps the fit of a waypoint set, keyed on a
+// hash of its contents, with the pose it was made in. Later frames with the
+// same set re-express that curve in the new pose instead of fitting again:
+// the curve is sampled at fixed Chebyshev nodes over the span of the
+// waypoints in the new vehicle frame, and projected back onto a cubic with a
+// constant pseudo-inverse. A translation alone would give the same cubic
+// exactly; a rotation doesn't quite, so a set is refitted once the heading
+// has turned more than maxReuseRotation from where it was fitted. The
+// fixed-size fit of 6 waypoints costs less than re-expressing, so this only
+// pays for the dynamic fits, and those are all it is used for.
+//
+// When the set has slid on instead, the first waypoints dropped and as many
+// new ones after the last, the unweighted fit follows it without fitting
+// again: it keeps the R of the QR factorization of the set's Vandermonde
+// matrix in the frame of its last full fit, with Q' y. Each waypoint that
+// enters is a Givens update of R, and each that leaves a downdate, as in
+// LINPACK's dchud and dchdd. The cubic then comes from R by back
+// substitution, and is re-expressed in the new pose like a reused one. A
+// full fit is made every slideRefit slides, and whenever a downdate would
+// leave R near singular.
+//
+// With a TrackMap, FitTrack() takes the reference from the track's spline
+// instead, in the same way: the spline is sampled at the nodes over a span
+// of arc length around the car and projected, with no waypoints to fit.
+// The car is placed on the track by localizer(), from where it was the
+// frame before.
+class TrackMap;
+
+class WaypointFit {
+ public:
+  WaypointFit();
+
+  // Waypoints are weighted 1 / (1 + (d / weightDistance)^2) by their
+  // distance d from the car, so that the fit follows the road near the car
+  // more closely than far ahead; 0 weighs them all the same.
+  double weightDistance;
+
+  // Fit y(x) to the n points. With fewer than 4 the order drops to what
+  // they determine, and without any the line is y = 0.
+  const Eigen::Vector4d& Fit(const double* x, const double* y, size_t n);
+
+  // Reuse fits of unchanged waypoints in FitWorld(), while the heading is
+  // within maxReuseRotation radians of the one they were made at.
+  bool reuse;
+  double maxReuseRotation;
+
+  // Update unweighted fits of at least minSlide waypoints as their set
+  // slides, with a full fit after slideRefit slides; the rotation limit of
+  // reuse applies. Re-expressing costs about what fitting 40 waypoints
+  // does, so fewer are fitted afresh.
+  bool slide;
+  size_t minSlide;
+  unsigned slideRefit;
+
+  // Fit the n world points (x[i], y[i]) as seen from a vehicle at (px, py)
+  // heading psi, reusing the last fit if they haven't changed.
+  const Eigen::Vector4d& FitWorld(double px, double py, double psi,
+                                  const double* x, const double* y, size_t n);
+
+  // The track from `behind` meters of arc length behind the car at (px, py)
+  // heading psi to `ahead` meters ahead of it, in its frame, into coeffs().
+  // False if the track folds back over that span, as seen from the car.
+  bool FitTrack(const TrackMap& track, double px, double py, double psi,
+                double behind, double ahead);
+
+  // FitWorld() calls answered by re-expressing an earlier fit, and by
+  // fitting.
+  unsigned long reused() const { return reused_; }
+  unsigned long refitted() const { return refitted_; }
+  // Those answered by sliding an earlier fit.
+  unsigned long slid() const { return slid_; }
+
+  // Coefficients of the last fit, in increasing order.
+  const Eigen::Vector4d& coeffs() const { return coeffs_; }
+
+  // Where FitTrack() last found the car on its track.
+  TrackLocalizer& localizer() { return localizer_; }
+  const TrackLocalizer& localizer() const { return localizer_; }
+
+ private:
+  void Reserve(size_t n);
+  // The cached curve in the vehicle frame at (px, py, psi), over [lo, hi]
+  // of its x, into coeffs_. False if the curve folds back in that frame.
+  bool Reexpress(double px, double py, double psi, double lo, double hi);
+  // The cubic through samples at the nodes over [mid - half, mid + half] of
+  // x, into coeffs_.
+  void Project(const Eigen::Matrix<double, 6, 1>& samples, double mid,
+               double half);
+  // The number of waypoints the cached set has slid on by to become
+  // (x, y), 0 if it hasn't.
+  size_t Shift(const double* x, const double* y, size_t n) const;
+  // Slide the cached set and its factorization on by k, to (x, y), and
+  // solve for its cubic in the cached frame. False if a downdate fails.
+  bool Slide(const double* x, const double* y, size_t n, size_t k);
+  // The factorization of the n cached waypoints, at anchor_x_, anchor_y_.
+  void Factor(size_t n);
+  // Givens update and downdate of the factorization by a waypoint at
+  // (X, Y) in the cached frame. RemoveRow returns false, leaving R
+  // unusable, if the rows left wouldn't determine a cubic.
+  void AddRow(double X, double Y);
+  bool RemoveRow(double X, double Y);
+
+  Eigen::Vector4d coeffs_;
+  Eigen::MatrixXd vandermonde_;
+  Eigen::VectorXd weights_;
+  // The waypoints of the frame in vehicle coordinates.
+  Eigen::VectorXd vehicle_x_;
+  Eigen::VectorXd vehicle_y_;
+
+  // The cached waypoint set, its hash, the pose it was fitted from and the
+  // fit in that pose's frame.
+  bool cached_;
+  uint64_t cache_hash_;
+  size_t cache_n_;
+  Eigen::VectorXd cache_x_;
+  Eigen::VectorXd cache_y_;
+  double cache_px_;
+  double cache_py_;
+  double cache_psi_;
+  Eigen::Vector4d cache_coeffs_;
+  // The waypoints with the smallest and largest x in the cached frame.
+  Eigen::Index cache_first_;
+  Eigen::Index cache_last_;
+  // The cached waypoints in the cached frame, and R and Q' y of their
+  // Vandermonde matrix on X / qr_scale_; slides since the last full fit.
+  Eigen::VectorXd anchor_x_;
+  Eigen::VectorXd anchor_y_;
+  bool factored_;
+  Eigen::Matrix4d qr_r_;
+  Eigen::Vector4d qr_z_;
+  double qr_scale_;
+  unsigned slides_;
+  // Least-squares projection of samples at the Chebyshev nodes onto the
+  // cubics over [-1, 1].
+  Eigen::Matrix<double, 4, 6> projection_;
+
+  unsigned long reused_;
+  unsigned long refitted_;
+  unsigned long slid_;
+
+  TrackLocalizer localizer_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif /* WAYPOINT_FIT_H */
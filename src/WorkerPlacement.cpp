@@ -0,0 +1,42 @@
+#include "WorkerPlacement.h"
+#include <algorithm>
+
+WorkerPlacement::WorkerPlacement(const std::vector<size_t>& nodes)
+    : node_(nodes), sessions_(nodes.size()) {
+  size_t n = nodes.empty() ? 0 : *std::max_element(nodes.begin(),
+                                                   nodes.end()) + 1;
+  node_workers_.resize(n);
+  node_sessions_.resize(n);
+  for (size_t node : nodes) {
+    node_workers_[node]++;
+  }
+}
+
+size_t WorkerPlacement::Assign() {
+  // Compare sessions per worker as cross products, so that nodes of
+  // different sizes fill in proportion.
+  size_t best_node = 0;
+  for (size_t node = 1; node < node_workers_.size(); node++) {
+    if (node_workers_[node] > 0 &&
+        (node_workers_[best_node] == 0 ||
+         node_sessions_[node] * node_workers_[best_node] <
+             node_sessions_[best_node] * node_workers_[node])) {
+      best_node = node;
+    }
+  }
+  size_t best = node_.size();
+  for (size_t worker = 0; worker < node_.size(); worker++) {
+    if (node_[worker] == best_node &&
+        (best == node_.size() || sessions_[worker] < sessions_[best])) {
+      best = worker;
+    }
+  }
+  sessions_[best]++;
+  node_sessions_[best_node]++;
+  return best;
+}
+
+void WorkerPlacement::Release(size_t worker) {
+  sessions_[worker]--;
+  node_sessions_[node_[worker]]--;
+}
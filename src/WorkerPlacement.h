@@ -0,0 +1,32 @@
+#ifndef WORKER_PLACEMENT_H
+#define WORKER_PLACEMENT_H
+
+#include <cstddef>
+#include <vector>
+
+// Which worker each new session goes to, with the workers grouped by NUMA
+// node: the node with the fewest sessions per worker, and its worker with
+// the fewest sessions, the lowest numbered on ties. A session stays on its
+// worker, so its controller's tapes and workspaces, allocated there on
+// first touch, stay on the worker's node. Event loop thread only.
+class WorkerPlacement {
+ public:
+  // The node of each worker, numbered from 0.
+  explicit WorkerPlacement(const std::vector<size_t>& nodes);
+
+  // The worker for a new session, counted as one more on it.
+  size_t Assign();
+  // A session of `worker` closed.
+  void Release(size_t worker);
+
+  size_t sessions(size_t worker) const { return sessions_[worker]; }
+
+ private:
+  std::vector<size_t> node_;
+  std::vector<size_t> sessions_;
+  // Per node: workers, and sessions on them.
+  std::vector<size_t> node_workers_;
+  std::vector<size_t> node_sessions_;
+};
+
+#endif /* WORKER_PLACEMENT_H */
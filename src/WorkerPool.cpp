@@ -0,0 +1,50 @@
+#include "WorkerPool.h"
+#include "StackSampler.h"
+
+WorkerPool::WorkerPool(size_t threads) {
+  for (size_t i = 0; i < threads; i++) {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+    workers_.back()->stopping = false;
+  }
+  for (size_t i = 0; i < threads; i++) {
+    Worker* worker = workers_[i].get();
+    worker->thread = std::thread(Run, worker);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  for (size_t i = 0; i < workers_.size(); i++) {
+    std::lock_guard<std::mutex> lock(workers_[i]->mutex);
+    workers_[i]->stopping = true;
+    workers_[i]->wake.notify_one();
+  }
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->thread.join();
+  }
+}
+
+void WorkerPool::Submit(size_t worker, std::function<void()> task) {
+  Worker& w = *workers_[worker];
+  std::lock_guard<std::mutex> lock(w.mutex);
+  w.tasks.push_back(std::move(task));
+  w.wake.notify_one();
+}
+
+void WorkerPool::Run(Worker* worker) {
+  SampleThread("solver");
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(worker->mutex);
+      worker->wake.wait(lock, [worker] {
+        return worker->stopping || !worker->tasks.empty();
+      });
+      if (worker->tasks.empty()) {
+        return;
+      }
+      task = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+    }
+    task();
+  }
+}
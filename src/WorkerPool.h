@@ -0,0 +1,47 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with a queue of its own.
+//
+// Tasks are submitted to a particular worker and run there in order. Work
+// that keeps per-thread state, like CppAD's memory allocator, stays on one
+// thread this way, as a race's rivals do; see MPC::SetupThreads for the
+// thread numbers. The sessions' frames go on a FrameScheduler instead.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t threads);
+  // Runs the queued tasks, then joins the workers.
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  size_t size() const { return workers_.size(); }
+
+  // Queue `task` on worker `worker`, in [0, size()).
+  void Submit(size_t worker, std::function<void()> task);
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()> > tasks;
+    bool stopping;
+    std::thread thread;
+  };
+
+  static void Run(Worker* worker);
+
+  std::vector<std::unique_ptr<Worker> > workers_;
+};
+
+#endif /* WORKER_POOL_H */
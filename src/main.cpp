@@ -1,188 +1,1320 @@
+#include <malloc.h>
 #include <math.h>
+#include <sys/mman.h>
 #include <uWS/uWS.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/QR"
+#include "AdmissionControl.h"
+#include "BinaryProtocol.h"
+#include "Checkpoint.h"
+#include "Controller.h"
+#include "Dashboard.h"
+#include "EnergyMeter.h"
+#include "FrameBatch.h"
+#include "FrameJournal.h"
+#include "FrameLog.h"
+#include "FrameScheduler.h"
+#include "Handoff.h"
+#include "HeapAllocator.h"
+#include "HugePages.h"
+#include "HttpClient.h"
 #include "MPC.h"
-#include "json.hpp"
+#include "Metrics.h"
+#include "PerfCounters.h"
+#include "PeriodicExecutor.h"
+#include "Planner.h"
+#include "Polynomial.h"
+#include "Proxy.h"
+#include "Published.h"
+#include "Realtime.h"
+#include "Session.h"
+#include "ShadowEvaluator.h"
+#include "SimdKernels.h"
+#include "SocketOptions.h"
+#include "ShmChannel.h"
+#include "Snapshot.h"
+#include "SolverFarm.h"
+#include "StackSampler.h"
+#include "Speculator.h"
+#include "Stages.h"
+#include "SteerMessage.h"
+#include "Supervisor.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "Trace.h"
+#include "TrackMap.h"
+#include "UdpChannel.h"
+#ifdef MPC_IO_URING
+#include "UringServer.h"
+#endif
+#include "WaypointFit.h"
+#include "WorkerPlacement.h"
 
-// for convenience
-using json = nlohmann::json;
+// The port the simulator connects to, and the proxy's when proxying; another
+// behind tools/impair_proxy, which takes 4567 and relays to 4568.
+const int listen_port = 4567;
+// Emulated actuation latency: commands are held back this long, in seconds.
+// 0 sends them right away. The state is predicted over the measured latency,
+// which includes this, see Latency().
+const double emulated_latency = 0.1;
+// Lockstep with a simulator that steps on its own clock: replies go out as
+// soon as they are solved, each saying when it takes effect, emulated_latency
+// seconds of simulated time after the frame it answers, see WriteSteer's
+// apply_after; and the state is predicted over exactly that. Runs go as fast
+// as the solves, with the same dynamics as in real time.
+const bool lockstep = false;
+// Frames between latency reports, per connection.
+const size_t latency_report_interval = 100;
+// Solver threads for the connections; 0 for one per core. Ipopt solves with
+// MUMPS still take turns, see MPC::serializeIpopt.
+const size_t worker_threads = 0;
+// Event loops, each a uWS::Hub on a thread of its own listening on the
+// port, with SO_REUSEPORT when there are several so that the kernel shares
+// the connections out between them; 0 for one per core. A hub serves the
+// connections it accepts to the end, their frames going to the workers all
+// the same.
+const size_t io_threads = 1;
+// Cores to pin the workers to, one each in turn, like "2-5"; empty leaves
+// them to the scheduler. io_cpu pins the event loops, hub k to io_cpu + k,
+// -1 doesn't. Best with the cores kept free of other work, e.g. by isolcpus.
+const char* const worker_cpus = "";
+const int io_cpu = -1;
+// SCHED_FIFO priorities, 1 to 99, for the workers and the event loops; 0
+// keeps normal scheduling. Needs CAP_SYS_NICE or an RLIMIT_RTPRIO that
+// allows it. Preemptions while solving are in /metrics either way.
+const int worker_priority = 0;
+const int io_priority = 0;
+// Group the workers by NUMA node: each runs on its node's cores, unless
+// worker_cpus says otherwise, with its sessions' memory on the node, and new
+// connections go to the node with the fewest sessions per worker.
+const bool numa_placement = false;
+// Ipopt's linear solver, see MpcConfig::linearSolver; bench/mpc_replay.cpp
+// compares them on recorded frames.
+const MpcConfig::LinearSolver linear_solver = MpcConfig::MUMPS;
+// The sessions' Ipopt options, tolerances, linear solver and Hessian, from
+// this named profile over linear_solver, see ApplySolverProfile; empty for
+// none. A connection may pick another by its URL, as in
+// ws://host:4567/?profile=realtime; bench/solver_profiles.cpp compares them.
+const char* const solver_profile = "";
+// Keep the sparsity patterns of the tapes in this directory across runs, see
+// MpcConfig::patternCache; empty to compute them at every start.
+const char* const pattern_cache = "";
+// Keep what startup derives, the sparsity patterns and the track compiled,
+// in a snapshot under this directory for this binary, tuning and track,
+// and start from it the next time, see Snapshot; it takes the place of
+// pattern_cache. Empty for none.
+const char* const snapshot_path = "";
+// The weights, reference speed and horizon from this tuning file, see
+// LoadTuning and tools/tune.cpp; empty for MpcConfig's defaults.
+const char* const tuning_path = "";
+// A command is due once per control period: the solve gets what is left of
+// it after parsing and fitting the frame.
+const double control_period = 0.1;
+// Drop a frame rather than solve it once it has waited this long, in
+// seconds, since its state is too old to act on; 0 solves every frame that
+// a newer one doesn't replace first. Drops and waiting frames are in
+// /metrics.
+const double stale_frame_age = 0;
+// Solve each session once per control_period on the clock, with the newest
+// frame that came in since its last cycle, rather than as each frame comes,
+// see PeriodicExecutor; how late the cycles start and those missed are in
+// /metrics. The timer's thread runs at cycle_priority under SCHED_FIFO if
+// it is above 0. Not in builds with MPC_COROUTINES.
+const bool time_triggered = false;
+const int cycle_priority = 0;
+// Hibernate a session once its vehicle has sent nothing for this many
+// seconds: its controller goes into a checkpoint like a handoff's, and its
+// tapes, workspaces and buffers are freed, until the next frame rebuilds
+// it warm started from the checkpoint. Memory then grows with the vehicles
+// driving rather than those connected; the hibernated sessions are in
+// /metrics. 0 never hibernates; not in builds with MPC_COROUTINES.
+const double hibernate_after = 0;
+// Warm start Ipopt's multipliers too, shifted a stage, and its barrier
+// parameter from this, see MPC::warmStartDuals and warmStartMu.
+const bool warm_start_duals = true;
+const double warm_start_mu = 1e-4;
+// Answer a solve that misses its deadline with the sensitivity update of the
+// last converged one, see MPC::sensitivity.
+const bool sensitivity_update = true;
+// Stop a solve as soon as it diverges, stalls or enters Ipopt's restoration
+// phase, and answer as for one that missed its deadline, see
+// MPC::abortHopeless; the aborts are in /metrics.
+const bool abort_hopeless = true;
+// Solve in full every this many frames, and track the last plan in between,
+// see MPC::solveEvery; 1 solves every frame.
+const size_t solve_every = 1;
+// Solve only when the car strays from the last plan or the path changes
+// shape, and at least every forced_solve_interval frames, see
+// MPC::eventTriggered.
+const bool event_triggered = false;
+const size_t forced_solve_interval = 5;
+// Send the inputs of the whole horizon with each reply, with their times,
+// for a client to play back between replies and so steer at a rate of its
+// own while the frames come slower, see WriteSteer and DATA.md. Only IPOPT
+// solves have them.
+const bool send_controls = false;
+// Keep this many solutions for the laps after, see MpcConfig::cacheEntries;
+// 0 for none.
+const size_t solution_cache_entries = 0;
+// How the controller solves each frame, see MPC::Method.
+const MPC::Method method = MPC::IPOPT;
+// The network weights of the POLICY method, and how often IPOPT checks it
+// and how far off it may be before saying so, see MPC::LoadPolicy.
+const char* const policy_path = "mpc-policy.txt";
+const size_t policy_check_every = 20;
+const double policy_tolerance = 0.05;
+// Let the controller pick N and dt from the speed, see HorizonScheduler.
+const bool adaptive_horizon = false;
+// Fall back to cheaper methods while frames miss the control period, see
+// DegradationLadder.
+const bool degrade = true;
+// Pick each frame's tier before solving it instead, from its predicted
+// solve time, see MPC::predictTier; starting from the model in
+// solve_time_model, from tools/train_predictor.cpp, if there is one.
+const bool predict_tier = false;
+const char* const solve_time_model = "";
+// Energy mode, for units on battery: meter the CPU's joules per solve with
+// the platform's energy counters, see EnergyMeter and
+// mpc_solve_energy_joules_total; hold each controller at the cheapest tier
+// that keeps the car within energy_error_bound meters of the path, see
+// MPC::energyMode; and let the CPU idle longer between frames, with the
+// frames coalesced for energy_coalesce_ms at least and the threads' timers
+// firing up to energy_timer_slack_us late, together.
+const bool energy_mode = false;
+const double energy_error_bound = 0.5;
+const unsigned energy_coalesce_ms = 2;
+const unsigned energy_timer_slack_us = 500;
+// Answer with the LQR law on long, nearly straight stretches, see
+// MPC::hybridLqr.
+const bool hybrid_lqr = false;
+// Solve for the predicted next frame while waiting for it, see Speculator.
+const bool speculate = false;
+// Down-weight far waypoints in the fit beyond about this many meters; 0 fits
+// them all the same, see WaypointFit.
+const double fit_weight_distance = 0;
+// Pick the waypoints of each frame from this track, a waypoint CSV or a track
+// compiled by compile_track, instead of taking the simulator's, see TrackMap;
+// empty to take the simulator's.
+const char* const track_map_path = "";
+// The reference follows the track's spline from this far behind the car to
+// this far ahead, in meters of arc length. Where the track folds back over
+// that span, as seen from the car, the waypoints ahead are fitted instead,
+// track_lookahead of them.
+const double track_behind = 10;
+const double track_ahead = 40;
+const size_t track_lookahead = 6;
+// Keep the solutions by position along the track map in this file across
+// runs, in bins of warm_start_bin meters, and warm start cold solves from
+// them, see MPC::LoadWarmStarts; empty to not keep them. Written after each
+// lap.
+const char* const warm_start_path = "";
+const double warm_start_bin = 2;
+// Answer the frames this control table covers from it, see
+// MPC::LoadControlTable and tools/build_control_table.cpp; empty to solve
+// every frame.
+const char* const control_table_path = "";
+// Start solves with nothing to warm start from at the nearest of these
+// motion primitives, see MPC::LoadPrimitives and tools/build_primitives.cpp;
+// empty to start them from zeros.
+const char* const primitives_path = "";
+// Race each solve against a cold started solver and one with a limited
+// memory Hessian, and answer with the first to converge, see
+// MPC::AddRival. Only pays with a thread-safe linear_solver.
+const bool race_solvers = false;
+// Solve from zeros and from rollouts of the path's curvature and of the
+// LQR law too, in parallel, and answer with the lowest cost, see
+// MPC::AddStart.
+const bool multi_start = false;
+// Start each solve from a pass of MPPI and let Ipopt polish it in at most
+// polish_iterations, instead of from the last solution, see
+// MPC::MPPI_START.
+const bool mppi_polish = false;
+const int polish_iterations = 10;
+// Solves of each problem on made-up frames before a session's first real
+// one, and before accepting connections on each worker, so that no frame
+// pays for first-time setup or page faults, see MPC::WarmUp; 0 to not.
+const size_t warm_up_solves = 3;
+// Lock the process's memory in RAM, and keep what the allocator frees
+// mapped, so that warmed-up pages are never faulted in again.
+const bool lock_memory = false;
+// Back the heap, and so the controllers' tapes and workspaces, with huge
+// pages, see HugePages.h; the server starts itself again to take it up.
+const HugePageMode huge_pages = NO_HUGE_PAGES;
+// Prepare the simulator's frames that arrive together, from any
+// connections, in one batch on the event loop before they go to their
+// workers, see FrameBatch: those read in the same loop iteration, or with
+// a coalesce_window_ms, within that many milliseconds of the first. Up to
+// coalesce_frames at once. Pays with many connections; frames with other
+// waypoints, a track map or a weighted fit are prepared on their workers.
+const bool coalesce = false;
+const unsigned coalesce_window_ms = 0;
+const size_t coalesce_frames = 64;
+// Fit each frame and predict its state in a task of its own ahead of its
+// solve, so that it runs on an idle worker while the session's frame before
+// is still being solved, see Session::Preparer. The stages' rates are the
+// counts of mpc_stage_seconds in /metrics.
+const bool prepare_ahead = false;
+// Also serve a simulator bridge on this host through shared memory of this
+// name, like "/mpc", with BinaryProtocol.h's messages, see ShmChannel; empty
+// to serve websockets only. Its frames are solved on a thread of its own by
+// a controller of the sessions' tuning.
+const char* const shm_name = "";
+// Also serve bridges over UDP on this port, each datagram a frame or a
+// reply of BinaryProtocol.h numbered as in UdpChannel, so that a lost
+// datagram holds up nothing after it and only the newest frame of a bridge
+// is solved; -1 to not. Like the shared memory's, the frames are solved on
+// a thread of its own, by a controller per bridge.
+const int udp_port = -1;
+// Also serve the simulator's websockets on this port from an io_uring
+// instead of libuv's loop, see UringServer, which batches the reads and
+// writes of all its connections into one system call a round; -1 to not.
+// Its connections are solved on the workers like the sessions, each by a
+// controller of its own, but without their speculation, preparing ahead,
+// dashboards or handoffs, and replies go out as soon as they are solved,
+// as the bridges' do. Linux only.
+const int uring_port = -1;
+// Also serve as a solver farm on this UDP port, for vehicles that prepare
+// their frames themselves and send only the problems, see FarmClient: the
+// problems waiting are solved in a batch across farm_threads threads, 0 for
+// one per core, each stopped at its deadline, by controllers of the
+// sessions' tuning and method, see SolverFarm; -1 to not.
+const int farm_port = -1;
+const size_t farm_threads = 0;
+// Replies carry the predicted trajectory and the reference line, which only
+// a viewer draws, once in this many frames, and only the actuations
+// otherwise; 0 never. A connection may ask for another rate with
+// 42["draw",{"every":n}], see DATA.md.
+const unsigned draw_every = 0;
+// Websocket connections to this path are dashboards, streamed every
+// session's predicted trajectory as it is solved, see Dashboard; empty for
+// none. With ?encoding=compact, they are streamed TrajectoryCodec's
+// quantized deltas instead of JSON.
+const char* const dashboard_path = "/dashboard";
+// POSTs of batches of problems to this path are planned on the workers in
+// the time the sessions' frames leave them, see Planner; empty for none.
+// plan_chunk problems go in a task, due plan_slack seconds after their
+// request, and each solve is stopped after plan_budget seconds.
+const char* const plan_path = "/plan";
+const size_t plan_chunk = 16;
+const double plan_slack = 1;
+const double plan_budget = 1;
+// GETs and POSTs to this path hand sessions over between servers, see
+// Handoffs; empty for none. A checkpoint posted is kept for
+// checkpoint_max_age seconds for its session to reconnect, and one over
+// checkpoint_max_bytes is refused.
+const char* const checkpoint_path = "/checkpoint";
+const double checkpoint_max_age = 5;
+const size_t checkpoint_max_bytes = 1 << 20;
+// Run as a front proxy instead, relaying the connections to the solver
+// nodes listed in this file, one host:port a line, see Proxy; the file is
+// read again on SIGHUP. Empty to serve the sessions here.
+const char* const proxy_backends_path = "";
+// Run as a supervisor of worker processes instead, one serving and
+// supervise_standby warm and waiting to take over when it exits or on
+// SIGHUP, see Supervisor.h.
+const bool supervise = false;
+const size_t supervise_standby = 1;
+// Admission control, see AdmissionControl: a new session is refused once
+// it would take the workers' utilization over admission_refuse, and held
+// to admission_tier over admission_degrade; the held ones go back to the
+// full tier under admission_lift. Sampled every admission_interval
+// seconds.
+const bool admission_control = true;
+const double admission_degrade = 0.7;
+const double admission_refuse = 0.9;
+const double admission_lift = 0.5;
+const DegradationLadder::Tier admission_tier = DegradationLadder::RTI_STEP;
+const double admission_interval = 1;
+// Send each steer message at once, without Nagle's algorithm, see
+// SetNoDelay; and cork each dashboard's updates while they are written, so
+// that they go out in full segments, see SetCork.
+const bool control_nodelay = true;
+const bool dashboard_cork = true;
+// Time each steer message from the send call until the kernel has sent the
+// last of it, into the wire stage; Linux only.
+const bool measure_wire = false;
+// Record the frames received to this file, for bench/mpc_replay.cpp; empty
+// to not record.
+const char* const record_path = "";
+// Journal what each frame was answered with to this file, see
+// FrameJournal.h; empty to not. The file is rotated at journal_rotate_bytes,
+// keeping journal_keep of the old ones, and each solver thread holds up to
+// journal_records records for the journal's thread to write, past which
+// they are dropped. The records are written in blocks of journal_block,
+// deflated if journal_compress. While it is on, the solver's per frame
+// messages are in the journal instead of on stdout; tools/mpc_logcat reads
+// it.
+const char* const journal_path = "";
+const size_t journal_rotate_bytes = 64 << 20;
+const size_t journal_keep = 4;
+const size_t journal_records = 4096;
+const size_t journal_block = 1024;
+const bool journal_compress = true;
+// Trace the stages of each frame and Ipopt's iterations, keeping this many
+// events per thread, see Trace.h; 0 to not trace. The trace is written to
+// trace_path-<n>.json on SIGUSR2, and when a frame misses the control period
+// unless one was written less than trace_dump_interval seconds before.
+const size_t trace_events = 0;
+const char* const trace_path = "mpc-trace";
+const double trace_dump_interval = 5;
+// Sample the threads' stacks this many times a second of CPU time, see
+// StackSampler.h; 0 not to. The samples of the last ?seconds=, 30 unless
+// given, are served folded at profile_path, for flamegraph.pl or
+// speedscope; whole stacks need the MPC_FRAME_POINTERS build.
+const int profile_hz = 100;
+const char* const profile_path = "/profile";
+// Evaluate a candidate engine in the shadow of the sessions', see
+// ShadowEvaluator: this fraction of the frames is solved again with
+// shadow_method, under shadow_profile, a solver profile, or the sessions'
+// tuning if empty; on shadow_threads threads at idle priority, on
+// shadow_cpus if given. Its answers go into the metrics only; those further
+// than shadow_tolerance from the sent ones count as disagreements. 0 not
+// to.
+const double shadow_fraction = 0;
+const MPC::Method shadow_method = MPC::LINEAR_TIME_VARYING;
+const char* const shadow_profile = "";
+const size_t shadow_threads = 1;
+const char* const shadow_cpus = "";
+const double shadow_tolerance = 0.01;
+// Service level objectives of each session over its last slo_window
+// commands, see SloTracker: at least slo_compliance of them sent within
+// control_period of their frame's receipt, and the slo_quantile-quantiles
+// of the age of the state they were computed from and of their
+// inter-departure jitter at most slo_age and slo_jitter seconds, 0 for no
+// target. Checked every slo_check_every commands; a violation is logged,
+// counted, and posted as json to slo_alert_path on slo_alert_host:
+// slo_alert_port if the host is given.
+const size_t slo_window = 200;
+const size_t slo_check_every = 50;
+const double slo_compliance = 0.99;
+const double slo_quantile = 0.99;
+const double slo_age = 0.2;
+const double slo_jitter = 0.02;
+const char* const slo_alert_host = "";
+const int slo_alert_port = 8080;
+const char* const slo_alert_path = "/alerts";
 
-// This is the length from front to CoG that has a similar radius.
-double Lf = 2.67;
-const double latency = 0.1;
+// The track, when track_map_path is set, and the tuning every session
+// starts from, with tuning_path's: loaded before the workers start, and
+// again on SIGHUP, see Reload. Sessions take up a reload between frames,
+// see BetweenFrames; the planner and the bridges keep what they started
+// with.
+Published<TrackMap> track_maps;
+Published<MpcConfig> tunings(std::make_shared<MpcConfig>());
+// The snapshot of snapshot_path, once opened, and its compiled track.
+Snapshot snapshot;
+const char SNAPSHOT_TRACK[] = "track.bin";
+// Writes the frames when record_path is set, under recorder_mutex from any
+// hub.
+FrameRecorder recorder;
+std::mutex recorder_mutex;
+// Written when journal_path is set, from any solver thread.
+FrameJournal journal;
+// When admission_control is on; sampled on hub 0's loop.
+std::unique_ptr<AdmissionControl> admission;
+// In energy_mode, if the platform has counters; shared by the controllers.
+EnergyMeter energy_meter;
+// When shadow_fraction is set.
+std::unique_ptr<ShadowEvaluator> shadow;
+// When time_triggered is on; ticks the sessions' cycles.
+std::unique_ptr<PeriodicExecutor> cycles;
+
+// Write the trace to the next trace_path-<n>.json.
+void WriteTrace(const char* reason) {
+  static std::atomic<int> traces(0);
+  std::string path =
+      std::string(trace_path) + "-" + std::to_string(traces++) + ".json";
+  if (DumpTrace(path)) {
+    std::cout << "Trace (" << reason << "): " << path << std::endl;
+  } else {
+    std::cerr << "Failed to write " << path << std::endl;
+  }
+}
 
 // For converting back and forth between radians and degrees.
 constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.rfind("}]");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
+// Where the references come from, see ReferenceSource: the track map as it
+// was loaded before the workers start, kept by reference_track. Sessions
+// put their own version of the track in it, see SessionReference.
+ReferenceSource reference;
+std::shared_ptr<const TrackMap> reference_track;
+
+// Load the track and the tuning from their files again and publish them;
+// on a thread of libuv's pool. Either keeps the version it had if its file
+// fails to load.
+void Reload() {
+  if (*tuning_path) {
+    std::shared_ptr<MpcConfig> tuning(new MpcConfig());
+    if (LoadTuning(tuning_path, *tuning)) {
+      tunings.Publish(tuning);
+      std::cout << "Reloaded the tuning " << tuning_path << std::endl;
+    } else {
+      std::cerr << "Failed to reload the tuning " << tuning_path << std::endl;
+    }
+  }
+  if (*track_map_path) {
+    std::shared_ptr<TrackMap> track(new TrackMap());
+    if (track->Load(track_map_path)) {
+      track_maps.Publish(track);
+      std::cout << "Reloaded the track map: " << track->size()
+                << " waypoints" << std::endl;
+    } else {
+      std::cerr << "Failed to reload the track map " << track_map_path
+                << std::endl;
+    }
   }
-  return "";
 }
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++) {
-    result += coeffs[i] * pow(x, i);
+// What was out of the ordinary in the last solve of `mpc`, on stdout.
+void PrintSolve(const MPC& mpc) {
+  const MPC::SolveStats& stats = mpc.stats();
+  if (stats.status == MPC::DEADLINE_EXCEEDED) {
+    std::cout << "MPC: solve stopped at the deadline" << std::endl;
+  } else if (stats.status == MPC::BEST_FEASIBLE) {
+    std::cout << "MPC: using the best feasible iterate, cost "
+              << stats.cost << std::endl;
+  } else if (stats.status == MPC::FAILED) {
+    std::cout << "MPC: solve failed" << std::endl;
+  }
+  if (mpc.checkedPolicy && mpc.policyError > policy_tolerance) {
+    std::cout << "MPC: policy off by " << mpc.policyError << " from Ipopt"
+              << std::endl;
+  }
+  if (mpc.usedPrediction) {
+    std::cout << "MPC: steering with the sensitivity update" << std::endl;
+  }
+  if (mpc.usedFallback) {
+    std::cout << "MPC: steering with the LQR fallback" << std::endl;
   }
-  return result;
 }
 
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
+// Journal the answer `out` to frame `t` on `connection`.
+void Journal(unsigned connection, const Telemetry& t, const MPC& mpc,
+             const Controller::Output& out) {
+  const MPC::SolveStats& stats = mpc.stats();
+  JournalRecord r;
+  r.time = journal.Since(t.received);
+  r.sequence = t.sequence;
+  r.connection = connection;
+  r.status = stats.status;
+  r.flags = (t.binary ? JournalRecord::BINARY : 0) |
+            (t.prepared ? JournalRecord::PREPARED : 0) |
+            (mpc.usedPrediction ? JournalRecord::SENSITIVITY_UPDATE : 0) |
+            (mpc.usedFallback ? JournalRecord::LQR_FALLBACK : 0) |
+            (mpc.checkedPolicy ? JournalRecord::CHECKED_POLICY : 0) |
+            (mpc.energyStep ? JournalRecord::ENERGY_STEP : 0) |
+            (mpc.ladderStep ? JournalRecord::LADDER_STEP : 0);
+  r.iterations = std::min(stats.iterations, 0xffff);
+  r.tier = mpc.tier();
+  r.px = t.px;
+  r.py = t.py;
+  r.psi = t.psi;
+  r.v = t.v;
+  r.delta = t.delta;
+  r.a = t.a;
+  r.latency = t.latency;
+  r.load = mpc.hostLoad;
+  for (int i = 0; i < 6; i++) {
+    r.state[i] = out.state[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    r.reference[i] = out.reference[i];
+  }
+  r.steering = out.steering;
+  r.throttle = out.throttle;
+  r.cost = stats.cost;
+  r.constraintViolation = stats.constraintViolation;
+  r.solveSeconds = stats.seconds;
+  r.policyError = mpc.checkedPolicy ? mpc.policyError : 0;
+  r.seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - t.received)
+          .count();
+  journal.Write(r);
+}
 
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
+// The reply to one telemetry frame on `connection` from its controller,
+// rendered into `msg`, with the lines to draw if `draw`; the controller's
+// output is left in `out`. The actuations sent are also returned in the
+// units the simulator reports them in, radians of steering and throttle.
+// Runs on the solver thread.
+void Control(unsigned connection, Controller& controller, const Telemetry& t,
+             bool draw, Controller::Output& out, double& steering,
+             double& throttle, string& msg) {
+  auto deadline =
+      t.received + chrono::duration_cast<chrono::steady_clock::duration>(
+                       chrono::duration<double>(control_period));
+  controller.Step(t, deadline, out);
+  const MPC& mpc = controller.mpc();
+  if (!journal.isOpen()) {
+    PrintSolve(mpc);
+  } else if (!mpc.speculative) {
+    Journal(connection, t, mpc, out);
   }
 
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+  // Calculate steering angle and throttle using MPC. Both are in between
+  // [-1, 1].
+  double steer_value = out.steering / deg2rad(25);
+  double throttle_value = out.throttle;
+  steering = out.steering;
+  throttle = out.throttle;
+
+  //.. add (x,y) points to list here, points are in reference to the
+  // vehicle's coordinate system
+  // the points in the simulator are connected by a Green line (mpc) and a
+  // Yellow line (next)
+  auto serialize = chrono::steady_clock::now();
+  size_t points = 0;
+  size_t reference_points = 0;
+  if (draw) {
+    Controller::DrawReference(out);
+    points = out.points;
+    reference_points = Controller::REFERENCE_POINTS;
+  }
+  // The inputs ahead in the steer message's units too.
+  for (size_t i = 0; i < out.controls; i++) {
+    out.controlSteering[i] /= deg2rad(25);
+  }
+  if (t.binary) {
+    WriteBinarySteer(msg, steer_value, throttle_value, out.x, out.y, points,
+                     out.referenceX, out.referenceY, reference_points);
+    if (out.controls > 0) {
+      AppendBinaryControls(msg, out.controlT, out.controlSteering,
+                           out.controlThrottle, out.controls);
     }
+    if (lockstep) {
+      AppendBinaryApply(msg, t.latency);
+    }
+  } else {
+    WriteSteer(msg, steer_value, throttle_value, out.x, out.y, points,
+               out.referenceX, out.referenceY, reference_points, out.controlT,
+               out.controlSteering, out.controlThrottle, out.controls,
+               lockstep ? t.latency : -1);
   }
+  RecordStage(STAGE_SERIALIZE, serialize);
+}
 
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
+// Delay from receipt of a frame until its command takes effect, taking half
+// the round trip as the time to the simulator. The emulated latency stands
+// in until there are measurements, and in lockstep, where it is exact.
+double Latency(const Session& session) {
+  if (lockstep || session.response.count() == 0 ||
+      session.roundTrip.count() == 0) {
+    return emulated_latency;
+  }
+  return session.response.mean() + session.roundTrip.mean() / 2;
 }
 
-int main() {
-  uWS::Hub h;
+// Steer messages the kernel hadn't sent all of when the send call returned,
+// polled every millisecond until it has; one for each hub, on its thread.
+struct WireTimes {
+  struct Pending {
+    std::shared_ptr<Session> session;
+    chrono::steady_clock::time_point send;
+  };
+  uv_timer_t timer;
+  std::vector<Pending> pending;
+};
+thread_local std::unique_ptr<WireTimes> wire;
 
-  // MPC is initialized here!
-  MPC mpc;
+void PollWire(uv_timer_t* timer) {
+  auto now = chrono::steady_clock::now();
+  std::vector<WireTimes::Pending>& pending = wire->pending;
+  size_t kept = 0;
+  for (size_t i = 0; i < pending.size(); i++) {
+    Session& session = *pending[i].session;
+    if (!session.open) {
+      continue;
+    }
+    if (UnsentBytes(session.fd) > 0) {
+      pending[kept++] = std::move(pending[i]);
+      continue;
+    }
+    RecordStage(STAGE_WIRE,
+                chrono::duration<double>(now - pending[i].send).count());
+  }
+  pending.resize(kept);
+  if (pending.empty()) {
+    uv_timer_stop(timer);
+  }
+}
 
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
-                     uWS::OpCode opCode) {
-    // "42" at the start of the message means there's a websocket message event.
-    // The 4 signifies a websocket message
-    // The 2 signifies a websocket event
-    string sdata = string(data).substr(0, length);
-    if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
-      string s = hasData(sdata);
-      if (s != "") {
-        auto j = json::parse(s);
-        string event = j[0].get<string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"];
-          double v = j[1]["speed"];
-          double delta = j[1]["steering_angle"];
-          double a = j[1]["throttle"];
-
-          // transform to car coordinates 
-          for (int i = 0; i < ptsx.size(); i++){
-            double shift_x = ptsx[i] - px;
-            double shift_y = ptsy[i] - py;
-
-            ptsx[i] = (shift_x * cos (psi) + shift_y * sin (psi));
-            ptsy[i] = (-shift_x * sin (psi) + shift_y * cos (psi));
-          }
+void StartWireTimes(uv_loop_t* loop) {
+  wire.reset(new WireTimes());
+  uv_timer_init(loop, &wire->timer);
+}
 
-          double* ptrx = &ptsx[0];
-          Eigen::Map<Eigen::VectorXd> ptsx_transform(ptrx, 6);
+// Time `session`'s message sent at `send` to the wire, see measure_wire.
+void TimeWire(Session& session, chrono::steady_clock::time_point send) {
+  int unsent = UnsentBytes(session.fd);
+  if (unsent == 0) {
+    RecordStage(STAGE_WIRE, send);
+  } else if (unsent > 0) {
+    if (wire->pending.empty()) {
+      uv_timer_start(&wire->timer, PollWire, 1, 1);
+    }
+    wire->pending.push_back({session.shared_from_this(), send});
+  }
+}
 
+// The hub's sessions, looked over every second for those to hibernate, see
+// hibernate_after; one for each hub, on its thread.
+struct Sleepers {
+  std::vector<std::shared_ptr<Session> > sessions;
+  uv_timer_t timer;
+};
+thread_local std::unique_ptr<Sleepers> sleepers;
 
-          double* ptry = &ptsy[0];
-          Eigen::Map<Eigen::VectorXd> ptsy_transform(ptry, 6);
+void SweepSleepers(uv_timer_t*) {
+  auto now = chrono::steady_clock::now();
+  std::vector<std::shared_ptr<Session> >& sessions = sleepers->sessions;
+  size_t kept = 0;
+  for (size_t i = 0; i < sessions.size(); i++) {
+    Session& session = *sessions[i];
+    if (!session.open) {
+      continue;
+    }
+    if (!session.hibernating() &&
+        now - session.lastPosted() >
+            chrono::duration<double>(hibernate_after)) {
+#ifndef MPC_COROUTINES
+      session.Hibernate();
+#endif
+    }
+    sessions[kept++] = std::move(sessions[i]);
+  }
+  sessions.resize(kept);
+}
 
-          auto coeffs = polyfit(ptsx_transform, ptsy_transform, 3 );
+void StartSleepers(uv_loop_t* loop) {
+  sleepers.reset(new Sleepers());
+  uv_timer_init(loop, &sleepers->timer);
+  uv_timer_start(&sleepers->timer, SweepSleepers, 1000, 1000);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&sleepers->timer));
+}
 
-          // auto coeffs = polyfit(ptsx_v, ptsy_v, 3);
-          // The cross track error is calculated by evaluating at polynomial at x, f(x) 
-          // and subtracting y.
-          double cte = polyeval(coeffs, 0);
-          // Due to the sign starting at 0, the orientation error is -f'(x).
-          // derivative of coeffs[0] + coeffs[1] * x -> coeffs[1]
-          double epsi = - atan(coeffs[1]);
+// Alert hook of connection `id`'s SloTracker; event loop thread. The post
+// is made off the loop, and dropped if the receiver can't be reached.
+void SloAlert(unsigned id, const SloTracker::Report& report) {
+  metrics.sloViolations[report.objective].fetch_add(
+      1, std::memory_order_relaxed);
+  std::cout << "Connection " << id << " violates its "
+            << SloTracker::Name(report.objective) << " objective: "
+            << report.value << " against " << report.target << " after "
+            << report.commands << " commands" << std::endl;
+  if (!*slo_alert_host) {
+    return;
+  }
+  char body[256];
+  snprintf(body, sizeof(body),
+           "{\"connection\":%u,\"objective\":\"%s\",\"value\":%.9g,"
+           "\"target\":%.9g,\"commands\":%zu}",
+           id, SloTracker::Name(report.objective), report.value,
+           report.target, report.commands);
+  std::string message(body);
+  std::thread([message]() {
+    int status;
+    std::string response;
+    if (!HttpRequest(slo_alert_host, slo_alert_port, "POST", slo_alert_path,
+                     message, 1, status, response) ||
+        status / 100 != 2) {
+      std::cerr << "Failed to post an SLO alert to " << slo_alert_host
+                << std::endl;
+    }
+  }).detach();
+}
 
-          double est_px = v * latency ;
-          double est_py = 0.;
-          double est_psi = 0. - v * delta / Lf * latency;
-          double est_v = v + a * latency;
-          double est_cte = cte + v * sin(epsi) * latency;
-          double est_epsi = epsi - v * delta / Lf * latency;
+// This process's side of the supervisor, if one started it.
+SupervisedWorker supervised_worker;
 
-          Eigen::VectorXd state(6);
-          state << est_px, est_py, est_psi, est_v, est_cte, est_epsi ;
+// Send `command` if its session is still open, and time it. The command goes
+// back to the session for its buffer to be reused.
+void Send(Session& session, std::unique_ptr<Command> command) {
+  if (!session.open) {
+    return;
+  }
+  auto send = chrono::steady_clock::now();
+  session.ws.send(command->msg.data(), command->msg.length(),
+                  command->binary ? uWS::OpCode::BINARY : uWS::OpCode::TEXT);
+  supervised_worker.CommandSent();
 
-          //Display the MPC predicted trajectory 
-          vector<double> mpc_x_vals;
-          vector<double> mpc_y_vals;
+  RecordStage(STAGE_SEND, send);
+  if (wire) {
+    TimeWire(session, send);
+  }
+  auto now = chrono::steady_clock::now();
+  double response = chrono::duration<double>(now - command->received).count();
+  session.response.Record(response);
+  // The state was measured at most when its frame was received, so the
+  // response is the age the server can vouch for.
+  metrics.commandAge.Record(response);
+  if (session.slo) {
+    session.slo->Record(now, response);
+    if (session.slo->lastJitter() >= 0) {
+      metrics.commandJitter.Record(session.slo->lastJitter());
+    }
+  }
+  if (response > control_period) {
+    metrics.deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+    static std::mutex trace_mutex;
+    static chrono::steady_clock::time_point last_trace;
+    if (TracingEnabled()) {
+      std::lock_guard<std::mutex> lock(trace_mutex);
+      if (last_trace == chrono::steady_clock::time_point() ||
+          now - last_trace > chrono::duration<double>(trace_dump_interval)) {
+        last_trace = now;
+        WriteTrace("deadline missed");
+      }
+    }
+  }
+  session.Recycle(std::move(command));
+  session.lastSent = now;
+  session.sent = true;
+  if (session.response.count() % latency_report_interval == 0) {
+    std::cout << "Latency: response " << session.response.Percentile(0.5)
+              << " / " << session.response.Percentile(0.95) << " / "
+              << session.response.Percentile(0.99) << " s (p50 / p95 / p99)"
+              << ", round trip " << session.roundTrip.Percentile(0.5)
+              << " / " << session.roundTrip.Percentile(0.95) << " / "
+              << session.roundTrip.Percentile(0.99) << " s, estimate "
+              << Latency(session) << " s, frames dropped "
+              << session.dropped() << " replaced / " << session.stale()
+              << " stale, " << session.pending() << " waiting" << std::endl;
+  }
+}
 
-          auto solution = mpc.Solve(state, coeffs, mpc_x_vals, mpc_y_vals);
+#ifndef MPC_COROUTINES
+// A command held back on its session's event loop for the actuation
+// latency.
+struct DelayedSend {
+  uv_timer_t timer;
+  std::unique_ptr<Command> command;
+  std::shared_ptr<Session> session;
+};
 
-          // Calculate steering angle and throttle using MPC. Both are in between [-1, 1].
-          double steer_value = - solution[0] / deg2rad(25);
-          double throttle_value = solution[1];
+void OnDelayedSend(uv_timer_t* timer) {
+  DelayedSend* delayed = static_cast<DelayedSend*>(timer->data);
+  Send(*delayed->session, std::move(delayed->command));
+  uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+    delete static_cast<DelayedSend*>(handle->data);
+  });
+}
+#endif
 
-          json msgJson;
-          msgJson["steering_angle"] = steer_value;
-          msgJson["throttle"] = throttle_value;
+// Latency
+// The purpose is to mimic real driving conditions where
+// the car does actuate the commands instantly.
+//
+// Feel free to play around with this value but should be to drive
+// around the track with 100ms latency.
+//
+// NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
+// SUBMITTING.
+//
+// The command is held on a timer rather than by sleeping, so that the loop
+// keeps serving telemetry and other connections in the meantime. In
+// lockstep the simulator holds it instead.
+#ifdef MPC_COROUTINES
+Task SendAfterLatency(uv_loop_t* loop, Session& session,
+                      std::unique_ptr<Command> command) {
+  if (emulated_latency <= 0 || lockstep) {
+    Send(session, std::move(command));
+    co_return;
+  }
+  std::shared_ptr<Session> held = session.shared_from_this();
+  co_await Sleep(loop, chrono::duration<double>(emulated_latency));
+  Send(*held, std::move(command));
+}
+#else
+void SendAfterLatency(uv_loop_t* loop, Session& session,
+                      std::unique_ptr<Command> command) {
+  if (emulated_latency <= 0 || lockstep) {
+    Send(session, std::move(command));
+    return;
+  }
+  DelayedSend* delayed = new DelayedSend();
+  delayed->command = std::move(command);
+  delayed->session = session.shared_from_this();
+  uv_timer_init(loop, &delayed->timer);
+  delayed->timer.data = delayed;
+  uv_timer_start(&delayed->timer, OnDelayedSend,
+                 uint64_t(emulated_latency * 1000 + 0.5), 0);
+}
+#endif
 
+// The tuning of the sessions' controllers, from `tuning`.
+MpcConfig SessionConfig(const MpcConfig& tuning) {
+  MpcConfig config = tuning;
+  config.linearSolver = linear_solver;
+  ApplySolverProfile(config, solver_profile);
+  config.patternCache = snapshot.open() ? snapshot.directory().c_str()
+                                        : pattern_cache;
+  config.cacheEntries = solution_cache_entries;
+  // The rollouts and scenarios spread over every core; no other method uses
+  // the threads.
+  size_t cores = std::thread::hardware_concurrency();
+  config.mppiThreads = method == MPC::PATH_INTEGRAL ? cores : 1;
+  config.scenarioThreads = method == MPC::ROBUST ? cores : 1;
+  return config;
+}
 
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
+// The same from the current tuning.
+MpcConfig SessionConfig() { return SessionConfig(*tunings.Get()); }
 
-          //Display the waypoints/reference line
-          vector<double> next_x_vals;
-          vector<double> next_y_vals;
+// The sessions' reference, on `track`.
+ReferenceSource SessionReference(const Published<TrackMap>::Reader& track) {
+  ReferenceSource source = reference;
+  source.track = track.get();
+  return source;
+}
 
-          double poly_inc = 2.5;
-          int num_points = 25;
+// Tune a new controller of SessionConfig(), and warm it up.
+void TuneController(Controller& controller) {
+  MPC& mpc = controller.mpc();
+  MpcConfig config = mpc.config();
+  mpc.method = method;
+  mpc.warmStartDuals = warm_start_duals;
+  mpc.warmStartMu = warm_start_mu;
+  mpc.sensitivity = sensitivity_update;
+  mpc.solveEvery = solve_every;
+  mpc.eventTriggered = event_triggered;
+  mpc.keepControls = send_controls;
+  mpc.trigger.maxFrames = forced_solve_interval;
+  mpc.anytime = true;
+  if (mppi_polish) {
+    mpc.start = MPC::MPPI_START;
+    mpc.polishIterations = polish_iterations;
+  }
+  mpc.abortHopeless = abort_hopeless;
+  mpc.adaptiveHorizon = adaptive_horizon;
+  mpc.degrade = degrade;
+  mpc.predictTier = predict_tier;
+  if (predict_tier && *solve_time_model &&
+      !mpc.predictor.Load(solve_time_model)) {
+    std::cout << "No solve time model in " << solve_time_model
+              << ", learning one" << std::endl;
+  }
+  mpc.energyMode = energy_mode;
+  mpc.governor.errorBound = energy_error_bound;
+  if (energy_meter.available()) {
+    mpc.energyMeter = &energy_meter;
+  }
+  mpc.hybridLqr = hybrid_lqr;
+  const TrackMap* track = controller.source().track;
+  if (*warm_start_path && track &&
+      !mpc.LoadWarmStarts(warm_start_path, track->length(),
+                          warm_start_bin)) {
+    std::cout << "No warm starts in " << warm_start_path << " for the track"
+              << std::endl;
+  }
+  mpc.policyCheckEvery = policy_check_every;
+  if (method == MPC::POLICY && !mpc.LoadPolicy(policy_path)) {
+    std::cout << "No policy weights in " << policy_path << ", solving with "
+              << "Ipopt" << std::endl;
+  }
+  if (*control_table_path && !mpc.LoadControlTable(control_table_path)) {
+    std::cout << "No control table for this tuning in " << control_table_path
+              << std::endl;
+  }
+  if (*primitives_path && !mpc.LoadPrimitives(primitives_path)) {
+    std::cout << "No motion primitives for this tuning in " << primitives_path
+              << std::endl;
+  }
+  if (race_solvers) {
+    mpc.AddRival(config, false);
+    MpcConfig quasi_newton = config;
+    quasi_newton.hessian = MpcConfig::LIMITED_MEMORY;
+    mpc.AddRival(quasi_newton, true);
+  }
+  if (multi_start) {
+    mpc.AddStart(MPC::ZERO_START);
+    mpc.AddStart(MPC::CURVATURE_START);
+    mpc.AddStart(MPC::FALLBACK_START);
+    mpc.lowestCost = true;
+  }
+  mpc.WarmUp(warm_up_solves);
+  controller.fit().weightDistance = fit_weight_distance;
+}
 
-          for(int i=1 ; i<num_points; i++){
-            next_x_vals.push_back(poly_inc * i);
-            next_y_vals.push_back(polyeval(coeffs, poly_inc * i));
-          }
+// A controller for the planner: the sessions' tuning, with every problem
+// solved in full from a cold start, so that its answer doesn't depend on
+// the problems it solved before.
+std::unique_ptr<Controller> PlanController() {
+  MpcConfig config = SessionConfig();
+  config.cacheEntries = 0;
+  std::unique_ptr<Controller> controller(new Controller(config, reference));
+  TuneController(*controller);
+  MPC& mpc = controller->mpc();
+  mpc.warmStart = false;
+  mpc.warmStartDuals = false;
+  mpc.sensitivity = false;
+  mpc.solveEvery = 1;
+  mpc.eventTriggered = false;
+  mpc.degrade = false;
+  mpc.predictTier = false;
+  mpc.energyMode = false;
+  return controller;
+}
+
+// A candidate for shadow evaluation: the sessions' tuning under
+// shadow_profile, solved with shadow_method on every frame at full tier, so
+// that it is compared with the live engine at its best.
+std::unique_ptr<Controller> ShadowController() {
+  MpcConfig config = SessionConfig();
+  if (*shadow_profile && !ApplySolverProfile(config, shadow_profile)) {
+    std::cout << "No solver profile " << shadow_profile << std::endl;
+  }
+  std::unique_ptr<Controller> controller(new Controller(config, reference));
+  TuneController(*controller);
+  MPC& mpc = controller->mpc();
+  mpc.method = shadow_method;
+  mpc.solveEvery = 1;
+  mpc.eventTriggered = false;
+  mpc.degrade = false;
+  mpc.predictTier = false;
+  mpc.energyMode = false;
+  mpc.energyMeter = nullptr;
+  return controller;
+}
+
+// The controller of a session, with the solver profile its connection
+// asked for, if any, on the current track and tuning; on its worker, before
+// the first frame and again after a reload.
+void SetupSession(Session& session) {
+  track_maps.Refresh(session.track);
+  tunings.Refresh(session.tuning);
+  MpcConfig config = SessionConfig(*session.tuning.get());
+  if (!session.profile.empty() &&
+      !ApplySolverProfile(config, session.profile)) {
+    std::cout << "No solver profile " << session.profile << std::endl;
+  }
+  session.controller.reset(
+      new Controller(config, SessionReference(session.track)));
+  TuneController(*session.controller);
+  session.speculator.reset(
+      new Speculator(session.controller->mpc().config().Lf));
+}
+
+// Write the controller of a session gone quiet into its checkpoint, as for
+// a handoff, before the session lets it go; on its worker.
+void HibernateSession(Session& session) {
+  std::string().swap(session.hibernation);
+  CheckpointWriter out(session.hibernation);
+  session.controller->Checkpoint(out);
+  if (shadow) {
+    shadow->Close(session.id);
+  }
+  std::cout << "Connection " << session.id << " hibernated in "
+            << session.hibernation.size() << " bytes" << std::endl;
+}
+
+// Build the controller of a hibernated session again, warm started from its
+// checkpoint; on its worker, ahead of the frame that woke it.
+void WakeSession(Session& session) {
+  SetupSession(session);
+  if (!RestoreController(session, session.hibernation)) {
+    std::cerr << "Failed to restore connection " << session.id
+              << " from hibernation" << std::endl;
+  }
+  std::string().swap(session.hibernation);
+  std::cout << "Connection " << session.id << " woke" << std::endl;
+}
+
+// Fit a frame and predict its state ahead of its solve; on any worker.
+void PrepareAhead(Session& session, Telemetry& t) {
+  static const double Lf = SessionConfig().Lf;
+  if (!session.prepareFit) {
+    session.prepareFit.reset(new WaypointFit());
+    session.prepareFit->weightDistance = fit_weight_distance;
+  }
+  // A new track may have been allocated where the old one was.
+  if (track_maps.Refresh(session.prepareTrack)) {
+    session.prepareFit->localizer().Reset();
+  }
+  PrepareFrame(*session.prepareFit, t, SessionReference(session.prepareTrack),
+               Lf);
+}
+
+// Whether a reply carries the lines, one in `every`; `undrawn` counts the
+// replies since the last that did.
+bool Draw(unsigned every, unsigned& undrawn) {
+  if (every == 0 || ++undrawn < every) {
+    return false;
+  }
+  undrawn = 0;
+  return true;
+}
+
+// Answer a frame into `msg`, from the speculative reply when it matches; on
+// the session's worker. Speculative replies carry no lines, so a frame to
+// draw is solved.
+void Reply(Session& session, const Telemetry& t, string& msg) {
+  RecordStage(STAGE_RECEIVE, t.received);
+  Speculator& speculator = *session.speculator;
+  bool draw = Draw(session.drawEvery.load(std::memory_order_relaxed),
+                   session.undrawn);
+  double steering;
+  double throttle;
+  // Held to a cheaper tier since it was admitted, until the node has room.
+  int floor = session.tierFloor.load(std::memory_order_relaxed);
+  if (floor != DegradationLadder::FULL_NMPC && admission->Lift()) {
+    floor = DegradationLadder::FULL_NMPC;
+    session.tierFloor = floor;
+    std::cout << "Connection " << session.id << " back to the full tier"
+              << std::endl;
+  }
+  session.controller->mpc().ladder.SetFloor(DegradationLadder::Tier(floor));
+  if (!(speculate && !draw && speculator.Take(t, msg, steering, throttle))) {
+    Control(session.id, *session.controller, t, draw, session.output,
+            steering, throttle, msg);
+    session.unpublished = true;
+    if (shadow) {
+      shadow->Offer(session.id, t, session.output,
+                    session.controller->mpc().stats().seconds);
+    }
+  }
+  speculator.Answered(t, steering, throttle);
+  if (TracingEnabled()) {
+    TraceEvent("frame", t.received, chrono::steady_clock::now(), session.id);
+  }
+}
+
+// Take up the session's new tuning in its controller in place, when it
+// changes the weights and ref_v alone: no tape is recorded, see
+// MPC::Retune. False if it takes a new controller.
+bool RetuneSession(Session& session, const MpcConfig& old) {
+  const MpcConfig& tuning = *session.tuning.get();
+  return tuning.N == old.N && tuning.dt == old.dt &&
+         session.controller->mpc().Retune(tuning.weights, tuning.refV);
+}
+
+// Between frames a session gets the next frame's RTI step ready while the
+// simulator runs, or solves for the predicted next frame when speculating,
+// and writes its warm starts back once a lap has gone into them.
+void BetweenFrames(Session& session) {
+  // A reload is taken up here, so that the last frame was answered by the
+  // old controller and the next is by a new one, built on the new track and
+  // tuning, or by the same one retuned for new weights alone; the old track
+  // goes once no session is on it.
+  std::shared_ptr<const MpcConfig> old_tuning = session.tuning.value;
+  bool track = track_maps.Refresh(session.track);
+  bool tuning = tunings.Refresh(session.tuning);
+  if (tuning && !track && RetuneSession(session, *old_tuning)) {
+    std::cout << "Connection " << session.id << " took up the tuning"
+              << std::endl;
+  } else if (track || tuning) {
+    SetupSession(session);
+    if (shadow) {
+      shadow->Close(session.id);
+    }
+    std::cout << "Connection " << session.id << " took up the reload"
+              << std::endl;
+  }
+  if (session.unpublished) {
+    const Controller::Output& out = session.output;
+    Dashboard::Publish(session.id, session.dashboardEncoder, out.steering,
+                       out.throttle, out.x, out.y, out.points);
+    session.unpublished = false;
+  }
+  CheckpointController(session);
+  MPC& mpc = session.controller->mpc();
+  Speculator& speculator = *session.speculator;
+  mpc.Prepare();
+  if (mpc.warmStarts() && mpc.warmStarts()->lapped() &&
+      !mpc.SaveWarmStarts(warm_start_path)) {
+    std::cerr << "Failed to write " << warm_start_path << std::endl;
+  }
+  // Only Ipopt is slow enough to be worth it. A prediction that misses
+  // still warm starts the real solve.
+  Telemetry next;
+  if (speculate && mpc.active() == MPC::IPOPT && speculator.Predict(next)) {
+    double steering;
+    double throttle;
+    mpc.speculative = true;
+    Control(session.id, *session.controller, next, false, session.output,
+            steering, throttle, speculator.reply());
+    mpc.speculative = false;
+    speculator.Store(next, steering, throttle);
+  }
+}
+
+// The frames waiting to be prepared together, with their sessions, and what
+// closes the batch: the end of the loop iteration, or a timer; one for each
+// hub, on its thread.
+struct Intake {
+  Intake() : batch(coalesce_frames), Lf(SessionConfig().Lf) {
+    frames.reserve(coalesce_frames);
+  }
+  FrameBatch batch;
+  std::vector<std::pair<std::shared_ptr<Session>, std::unique_ptr<Telemetry> > >
+      frames;
+  double Lf;
+  uv_check_t check;
+  uv_timer_t timer;
+};
+thread_local std::unique_ptr<Intake> intake;
+// The hub's dashboard subscribers; one for each hub, on its thread.
+thread_local std::unique_ptr<Dashboard> dashboard;
+// The hub's batch planner, on its thread, and the controllers the planners
+// share.
+thread_local std::unique_ptr<Planner> planner;
+std::unique_ptr<Planner::Solvers> plan_solvers;
+// The sessions that may be handed over, on every hub.
+std::unique_ptr<Handoffs> handoffs;
 
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
-
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car does actuate the commands instantly.
-          //
-          // Feel free to play around with this value but should be to drive
-          // around the track with 100ms latency.
-          //
-          // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-          // SUBMITTING.
-          this_thread::sleep_for(chrono::milliseconds(int(latency * 1000)));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+// Prepare the waiting frames and hand them to their sessions' workers. A
+// frame alone costs less prepared on its worker, see bench/frame_batch.cpp.
+void FlushIntake() {
+  if (intake->frames.empty()) {
+    return;
+  }
+  uv_timer_stop(&intake->timer);
+  bool together = intake->frames.size() > 1;
+  if (together) {
+    intake->batch.Prepare(intake->Lf);
+  }
+  for (size_t i = 0; i < intake->frames.size(); i++) {
+    Session& session = *intake->frames[i].first;
+    std::unique_ptr<Telemetry>& t = intake->frames[i].second;
+    if (together) {
+      intake->batch.Coeffs(i, t->coeffs);
+      intake->batch.State(i, t->state);
+      t->prepared = true;
+    }
+    if (session.open) {
+      session.Post(std::move(t));
+    }
+  }
+  intake->frames.clear();
+  intake->batch.Clear();
+}
+
+// The coalescing window in effect, see energy_mode.
+unsigned CoalesceWindow() {
+  return energy_mode ? std::max(coalesce_window_ms, energy_coalesce_ms)
+                     : coalesce_window_ms;
+}
+
+void StartIntake(uv_loop_t* loop) {
+  intake.reset(new Intake());
+  uv_timer_init(loop, &intake->timer);
+  uv_check_init(loop, &intake->check);
+  if (CoalesceWindow() == 0) {
+    uv_check_start(&intake->check, [](uv_check_t*) { FlushIntake(); });
+  }
+}
+
+// Hand a parsed frame to the session's worker, through the intake if it
+// goes in a batch; event loop thread.
+void Received(Session& session, std::unique_ptr<Telemetry> t,
+              chrono::steady_clock::time_point received) {
+  t->received = received;
+  if (session.sent) {
+    session.roundTrip.Record(
+        chrono::duration<double>(received - session.lastSent).count());
+    session.sent = false;
+  }
+  CheckpointLatencies(session);
+  t->latency = Latency(session);
+  t->prepared = false;
+  if (intake && FrameBatch::Fits(*t) && !*track_map_path &&
+      fit_weight_distance <= 0) {
+    intake->batch.Add(*t);
+    intake->frames.emplace_back(session.shared_from_this(), std::move(t));
+    if (intake->batch.full()) {
+      FlushIntake();
+    } else if (intake->frames.size() == 1 && CoalesceWindow() > 0) {
+      uv_timer_start(&intake->timer, [](uv_timer_t*) { FlushIntake(); },
+                     CoalesceWindow(), 0);
+    }
+    return;
+  }
+  session.Post(std::move(t));
+}
+
+// The workers the hubs share, and the placement of the hubs' connections on
+// them, under placement_mutex.
+struct Workers {
+  Workers(FrameScheduler& scheduler, const std::vector<size_t>& nodes)
+      : scheduler(scheduler), placement(nodes), next_connection(0) {}
+  FrameScheduler& scheduler;
+  std::mutex placement_mutex;
+  WorkerPlacement placement;
+  std::atomic<unsigned> next_connection;
+};
+
+// Serve the simulator on hub `h`: its sessions are opened, fed and closed
+// on its loop, and solved on the workers.
+void Serve(uWS::Hub& h, Workers& workers) {
+  uv_loop_t* loop = h.getLoop();
+
+  h.onMessage([](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+                 uWS::OpCode opCode) {
+    // "42" at the start of the message means there's a websocket message event.
+    // The 4 signifies a websocket message
+    // The 2 signifies a websocket event
+    auto received = chrono::steady_clock::now();
+    if (dashboard && dashboard->IsSubscriber(ws.getUserData())) {
+      return;
+    }
+    Session* session = static_cast<Session*>(ws.getUserData());
+    const char* begin;
+    const char* end;
+    if (!session) {
+      return;
+    }
+    if (recorder.isOpen()) {
+      std::lock_guard<std::mutex> lock(recorder_mutex);
+      recorder.Write(session->id, received, opCode == uWS::OpCode::BINARY,
+                     data, length);
+    }
+    auto scan = chrono::steady_clock::now();
+    if (opCode == uWS::OpCode::BINARY) {
+      std::unique_ptr<Telemetry> t = session->NewFrame();
+      PerfScope parse_counts(STAGE_PARSE);
+      bool parsed = ParseBinaryTelemetry(data, data + length, *t);
+      parse_counts.Stop();
+      RecordStage(STAGE_PARSE, scan);
+      if (parsed) {
+        Received(*session, std::move(t), received);
+      }
+      return;
+    }
+    bool event = hasData(data, length, begin, end);
+    auto parse = chrono::steady_clock::now();
+    RecordStage(STAGE_HAS_DATA,
+                chrono::duration<double>(parse - scan).count());
+    if (event) {
+      if (begin != end) {
+        // The dedicated parser handles what the simulator sends; anything it
+        // doesn't expect goes through json::parse.
+        std::unique_ptr<Telemetry> t = session->NewFrame();
+        PerfScope parse_counts(STAGE_PARSE);
+        bool parsed = ParseTelemetry(begin, end, *t) ||
+                      ParseTelemetryJson(begin, end, *t, session->arena);
+        parse_counts.Stop();
+        RecordStage(STAGE_PARSE, parse);
+        unsigned every;
+        if (parsed) {
+          Received(*session, std::move(t), received);
+        } else if (ParseDrawRequest(begin, end, every, session->arena)) {
+          session->drawEvery = every;
         }
       } else {
         // Manual driving
@@ -192,36 +1324,978 @@ int main() {
     }
   });
 
-  // We don't need this since we're not using HTTP but if it's removed the
-  // program
-  // doesn't compile :-(
+  // /metrics for Prometheus, built from atomics on the event loop, so a
+  // scrape never waits on a solve; on whichever hub accepted it.
   h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
-                     size_t, size_t) {
+                     size_t length, size_t remaining) {
     const std::string s = "<h1>Hello world!</h1>";
-    if (req.getUrl().valueLength == 1) {
+    uWS::Header url = req.getUrl();
+    if (planner && planner->Request(res, req, data, length, remaining)) {
+      return;
+    }
+    std::string path = url.toString();
+    if (handoffs && path.compare(0, path.find('?'), checkpoint_path) == 0) {
+      handoffs->Request(res, req, QueryParameter(path, "handoff"), data,
+                        length, remaining);
+      return;
+    }
+    if (path == "/metrics") {
+      static thread_local std::string body;
+      WriteMetrics(body);
+      res->end(body.data(), body.length());
+    } else if (profile_hz > 0 &&
+               path.compare(0, path.find('?'), profile_path) == 0) {
+      std::string seconds = QueryParameter(path, "seconds");
+      static thread_local std::string body;
+      WriteFoldedStacks(body, seconds.empty() ? 30 : atof(seconds.c_str()));
+      res->end(body.data(), body.length());
+    } else if (url.valueLength == 1) {
       res->end(s.data(), s.length());
     } else {
       // i guess this should be done more gracefully?
       res->end(nullptr, 0);
     }
   });
+  // The rest of a planner's body, and its client gone before the answers.
+  h.onHttpData([](uWS::HttpResponse *res, char *data, size_t length,
+                  size_t remaining) {
+    if (planner) {
+      planner->Data(res, data, length, remaining);
+    }
+    if (handoffs) {
+      handoffs->Data(res, data, length, remaining);
+    }
+  });
+  h.onCancelledHttpRequest([](uWS::HttpResponse *res) {
+    if (planner) {
+      planner->Cancelled(res);
+    }
+    if (handoffs) {
+      handoffs->Cancelled(res);
+    }
+  });
 
-  h.onConnection([](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+  h.onConnection([loop, &workers](uWS::WebSocket<uWS::SERVER> ws,
+                                  uWS::HttpRequest req) {
+    std::string url = req.getUrl().toString();
+    if (dashboard && url.compare(0, url.find('?'), dashboard_path) == 0) {
+      dashboard->Subscribe(ws, QueryParameter(url, "encoding") == "compact");
+      std::cout << "Dashboard connected" << std::endl;
+      return;
+    }
+    // A session more than the workers can solve in time would make every
+    // session late; refused, it can try another node.
+    AdmissionControl::Decision decision =
+        admission ? admission->Admit() : AdmissionControl::ADMIT;
+    if (decision == AdmissionControl::REFUSE) {
+      static const char reason[] = "Overloaded";
+      std::cout << "Refused a connection at utilization "
+                << admission->utilization() << std::endl;
+      ws.close(1013, reason, sizeof(reason) - 1);
+      return;
+    }
+    std::string profile = QueryParameter(url, "profile");
+    // A session handed over from another server goes on from its
+    // checkpoint, if one was posted for it.
+    std::string key = handoffs ? QueryParameter(url, "handoff") : "";
+    LatencyEstimator response;
+    LatencyEstimator roundTrip;
+    std::string resume;
+    bool resumed = !key.empty() &&
+                   handoffs->Take(key, response, roundTrip, resume);
+    size_t worker;
+    {
+      std::lock_guard<std::mutex> lock(workers.placement_mutex);
+      worker = workers.placement.Assign();
+    }
+    std::shared_ptr<Session> session = Session::Open(
+        loop, ws, workers.scheduler, worker,
+        chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(control_period)),
+        [profile, resume](Session& session) {
+          session.profile = profile;
+          SetupSession(session);
+          if (!resume.empty() && !RestoreController(session, resume)) {
+            std::cerr << "Failed to restore connection " << session.id
+                      << " from its checkpoint" << std::endl;
+          }
+        },
+        prepare_ahead ? Session::Preparer(PrepareAhead) : Session::Preparer(),
+        Reply, BetweenFrames,
+        [loop](Session& session, std::unique_ptr<Command> command) {
+          SendAfterLatency(loop, session, std::move(command));
+        });
+    session->id = workers.next_connection++;
+    SloTracker::Targets targets;
+    targets.window = slo_window;
+    targets.checkEvery = slo_check_every;
+    targets.deadline = control_period;
+    targets.compliance = slo_compliance;
+    targets.quantile = slo_quantile;
+    targets.age = slo_age;
+    targets.jitter = slo_jitter;
+    unsigned id = session->id;
+    session->slo.reset(
+        new SloTracker(targets, [id](const SloTracker::Report& report) {
+          SloAlert(id, report);
+        }));
+    if (control_nodelay && !SetNoDelay(session->fd, true)) {
+      std::cerr << "Failed to set TCP_NODELAY on connection " << session->id
+                << std::endl;
+    }
+    session->staleAfter =
+        chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(stale_frame_age));
+    session->drawEvery = draw_every;
+#ifndef MPC_COROUTINES
+    if (cycles) {
+      session->timeTriggered = true;
+      chrono::steady_clock::duration period =
+          chrono::duration_cast<chrono::steady_clock::duration>(
+              chrono::duration<double>(control_period));
+      // A tick that comes as the session closes finds it gone.
+      std::weak_ptr<Session> weak = session;
+      session->cycleTimer = cycles->Add(
+          chrono::steady_clock::now() + period, period,
+          [weak](PeriodicExecutor::Clock::time_point due) {
+            if (std::shared_ptr<Session> session = weak.lock()) {
+              session->Tick(due);
+            }
+          });
+    }
+    if (sleepers) {
+      session->hibernate = HibernateSession;
+      session->wake = WakeSession;
+      sleepers->sessions.push_back(session);
+    }
+#endif
+    if (decision == AdmissionControl::DEGRADE) {
+      session->tierFloor = admission_tier;
+      std::cout << "Connection " << session->id << " held to "
+                << DegradationLadder::Name(admission_tier)
+                << " at utilization " << admission->utilization()
+                << std::endl;
+    }
+    if (!key.empty()) {
+      session->handoffKey = key;
+      handoffs->Open(key, session);
+    }
+    if (resumed) {
+      session->response = response;
+      session->roundTrip = roundTrip;
+      std::cout << "Connection " << session->id << " resumed " << key
+                << std::endl;
+    }
+    metrics.connections.fetch_add(1, std::memory_order_relaxed);
+    // The session keeps itself alive until Close().
+    ws.setUserData(session.get());
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, size_t length) {
+  h.onDisconnection([&workers](uWS::WebSocket<uWS::SERVER> ws, int code,
+                               char *message, size_t length) {
+    if (dashboard && dashboard->IsSubscriber(ws.getUserData())) {
+      dashboard->Unsubscribe(ws);
+      ws.close();
+      return;
+    }
+    Session* session = static_cast<Session*>(ws.getUserData());
+    if (session) {
+      ws.setUserData(nullptr);
+      if (handoffs && !session->handoffKey.empty()) {
+        handoffs->Close(session->handoffKey, session);
+      }
+      {
+        std::lock_guard<std::mutex> lock(workers.placement_mutex);
+        workers.placement.Release(session->worker());
+      }
+      if (session->cycleTimer) {
+        cycles->Remove(session->cycleTimer);
+      }
+      session->Close();
+      if (shadow) {
+        shadow->Close(session->id);
+      }
+      metrics.connections.fetch_sub(1, std::memory_order_relaxed);
+      uint64_t solved = session->solved();
+      std::cout << "Connection " << session->id << ": " << solved
+                << " frames solved, "
+                << (solved ? 1e3 * session->solveSeconds() / solved : 0)
+                << " ms a solve, " << session->cpuSeconds() << " s of CPU"
+                << std::endl;
+    }
     ws.close();
     std::cout << "Disconnected" << std::endl;
   });
+}
 
-  int port = 4567;
-  if (h.listen(port)) {
-    std::cout << "Listening to port " << port << std::endl;
-  } else {
+// Run hub `k` on the calling thread, pinned by io_cpu and io_priority, until
+// its loop stops.
+void RunHub(uWS::Hub& h, size_t k, Workers& workers) {
+  SampleThread("io");
+  if (io_cpu >= 0 && !PinThread(io_cpu + int(k))) {
+    std::cerr << "Failed to pin event loop " << k << " to CPU " << io_cpu + k
+              << std::endl;
+  }
+  if (io_priority > 0 && !SetFifoPriority(io_priority)) {
+    std::cerr << "Failed to set event loop " << k << " to SCHED_FIFO"
+              << std::endl;
+  }
+  if (coalesce || energy_mode) {
+    StartIntake(h.getLoop());
+  }
+  if (measure_wire) {
+    StartWireTimes(h.getLoop());
+  }
+  if (hibernate_after > 0) {
+    StartSleepers(h.getLoop());
+  }
+  if (*dashboard_path) {
+    dashboard.reset(new Dashboard(h.getLoop(), dashboard_cork));
+  }
+  if (plan_solvers) {
+    Planner::Options options;
+    options.path = plan_path;
+    options.chunk = plan_chunk;
+    options.slack = plan_slack;
+    options.budget = plan_budget;
+    planner.reset(new Planner(h.getLoop(), workers.scheduler, *plan_solvers,
+                              options));
+  }
+  h.run();
+}
+
+// Answer the frames of the bridge on `channel` until the process ends, each
+// in the framing and with the controller of a websocket session; on a
+// thread of its own. Frames the bridge wrote over before they were read
+// count as replaced.
+void ServeShm(ShmChannel& channel) {
+  MPC::Allocator allocator;
+  MPC::Allocator::Scope scope(allocator);
+  Controller controller(SessionConfig(), reference);
+  TuneController(controller);
+  // The bridge applies a command as soon as it reads it: the emulated
+  // latency stands in for the rest of the way, as it does before there are
+  // round trips to measure on a websocket.
+  LatencyEstimator response;
+  std::string message;
+  std::string msg;
+  Telemetry t;
+  uint64_t skipped = 0;
+  unsigned undrawn = 0;
+  Controller::Output out;
+  for (;;) {
+    if (!channel.Read(ShmChannel::TELEMETRY, message, chrono::seconds(1))) {
+      continue;
+    }
+    auto received = chrono::steady_clock::now();
+    PerfScope parse_counts(STAGE_PARSE);
+    bool parsed = ParseBinaryTelemetry(message.data(),
+                                       message.data() + message.size(), t);
+    parse_counts.Stop();
+    RecordStage(STAGE_PARSE, received);
+    if (!parsed) {
+      continue;
+    }
+    uint64_t replaced = channel.skipped(ShmChannel::TELEMETRY) - skipped;
+    skipped += replaced;
+    metrics.framesReplaced.fetch_add(replaced, std::memory_order_relaxed);
+    t.received = received;
+    t.latency = emulated_latency +
+                (!lockstep && response.count() > 0 ? response.mean() : 0);
+    t.prepared = false;
+    double steering;
+    double throttle;
+    Control(0, controller, t, Draw(draw_every, undrawn), out, steering,
+            throttle, msg);
+    auto send = chrono::steady_clock::now();
+    channel.Write(ShmChannel::COMMAND, msg.data(), msg.size());
+    RecordStage(STAGE_SEND, send);
+    response.Record(
+        chrono::duration<double>(chrono::steady_clock::now() - received)
+            .count());
+  }
+}
+
+// Answer the bridges on `channel` until the process ends, the newest frame
+// of each at a time, echoing its number; on a thread of its own. Each bridge
+// has a controller of its own, as a websocket session does.
+void ServeUdp(UdpChannel& channel) {
+  MPC::Allocator allocator;
+  MPC::Allocator::Scope scope(allocator);
+  struct Bridge {
+    Controller controller;
+    LatencyEstimator response;
+    Telemetry t;
+    Controller::Output out;
+    unsigned undrawn;
+    Bridge() : controller(SessionConfig(), reference), undrawn(0) {}
+  };
+  std::vector<std::unique_ptr<Bridge>> bridges;
+  std::vector<UdpChannel::Datagram> frames;
+  std::string msg;
+  uint64_t replaced = 0;
+  uint64_t stale = 0;
+  for (;;) {
+    size_t n = channel.ReceiveLatest(frames, chrono::milliseconds(1000));
+    auto received = chrono::steady_clock::now();
+    metrics.framesReplaced.fetch_add(channel.replaced() - replaced,
+                                     std::memory_order_relaxed);
+    metrics.framesStale.fetch_add(channel.stale() - stale,
+                                  std::memory_order_relaxed);
+    replaced = channel.replaced();
+    stale = channel.stale();
+    for (size_t i = 0; i < n; i++) {
+      const UdpChannel::Datagram& frame = frames[i];
+      while (bridges.size() <= frame.peer) {
+        bridges.emplace_back(new Bridge());
+        TuneController(bridges.back()->controller);
+      }
+      Bridge& bridge = *bridges[frame.peer];
+      Telemetry& t = bridge.t;
+      auto parse = chrono::steady_clock::now();
+      PerfScope parse_counts(STAGE_PARSE);
+      bool parsed = ParseBinaryTelemetry(
+          frame.message.data(), frame.message.data() + frame.message.size(), t);
+      parse_counts.Stop();
+      RecordStage(STAGE_PARSE, parse);
+      if (!parsed) {
+        continue;
+      }
+      // The frames of bridges ahead in the batch delay the ones behind.
+      t.received = received;
+      t.latency =
+          emulated_latency +
+          (!lockstep && bridge.response.count() > 0 ? bridge.response.mean()
+                                                    : 0);
+      t.prepared = false;
+      double steering;
+      double throttle;
+      Control(frame.peer, bridge.controller, t,
+              Draw(draw_every, bridge.undrawn), bridge.out, steering,
+              throttle, msg);
+      auto send = chrono::steady_clock::now();
+      channel.Send(frame.peer, frame.sequence, msg);
+      RecordStage(STAGE_SEND, send);
+      bridge.response.Record(
+          chrono::duration<double>(chrono::steady_clock::now() - received)
+              .count());
+    }
+  }
+}
+
+#ifdef MPC_IO_URING
+// A connection of ServeUring's: its frames are solved on the workers as a
+// session's are, the newest waiting at a time, and the replies go back to
+// the ring's thread to be sent.
+struct UringSession {
+  size_t connection;
+  size_t worker;
+  // Built by the first task, and only touched by the running one.
+  std::unique_ptr<Controller> controller;
+  MPC::Allocator allocator;
+  Controller::Output out;
+  unsigned undrawn;
+  // From the ring's thread: the newest frame, one the worker is done with,
+  // and whether a task is queued or running.
+  Mailbox<Telemetry> frames;
+  Mailbox<Telemetry> spare;
+  std::atomic<bool> scheduled;
+  std::atomic<bool> closed;
+  std::atomic<unsigned> drawEvery;
+  // The ring's thread only.
+  LatencyEstimator response;
+  Arena arena;
+};
+
+// Replies solved on the workers for the ring's thread to send.
+struct UringReplies {
+  struct Reply {
+    std::shared_ptr<UringSession> session;
+    std::string msg;
+    bool binary;
+    chrono::steady_clock::time_point received;
+  };
+  UringServer& server;
+  std::mutex mutex;
+  std::vector<Reply> ready;
+};
+
+// Solve the session's waiting frames, and release its controller once it
+// is closed; on a worker.
+void RunUringSession(std::shared_ptr<UringSession> session,
+                     UringReplies& replies) {
+  MPC::Allocator::Scope scope(session->allocator);
+  for (;;) {
+    if (session->closed.load()) {
+      session->controller.reset();
+      return;
+    }
+    std::unique_ptr<Telemetry> t = session->frames.Take();
+    if (!t) {
+      session->scheduled = false;
+      // A frame or the close may have come after the Take.
+      if ((session->frames.empty() && !session->closed.load()) ||
+          session->scheduled.exchange(true)) {
+        return;
+      }
+      continue;
+    }
+    if (!session->controller) {
+      session->controller.reset(new Controller(SessionConfig(), reference));
+      TuneController(*session->controller);
+    }
+    UringReplies::Reply reply;
+    double steering;
+    double throttle;
+    Control(unsigned(session->connection), *session->controller, *t,
+            Draw(session->drawEvery.load(std::memory_order_relaxed),
+                 session->undrawn),
+            session->out, steering, throttle, reply.msg);
+    reply.session = session;
+    reply.binary = t->binary;
+    reply.received = t->received;
+    session->spare.Post(std::move(t));
+    {
+      std::lock_guard<std::mutex> lock(replies.mutex);
+      replies.ready.push_back(std::move(reply));
+    }
+    replies.server.Wake();
+  }
+}
+
+// Answer the websockets on `server` until the process ends, with the
+// framing and parsing of the uWS sessions; on a thread of its own. Each
+// connection is placed on a worker, as a session is, and its frames are
+// solved there, while this thread only parses them and sends the replies:
+// those that came in one round are written together on the next.
+void ServeUring(UringServer& server, Workers& workers) {
+  std::vector<std::shared_ptr<UringSession>> sessions;
+  std::vector<UringServer::Event> events;
+  std::vector<UringReplies::Reply> sending;
+  UringReplies replies{server, {}, {}};
+  auto period = chrono::duration_cast<chrono::steady_clock::duration>(
+      chrono::duration<double>(control_period));
+  for (;;) {
+    size_t n = server.Poll(events, chrono::milliseconds(1000));
+    auto received = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+      const UringServer::Event& event = events[i];
+      if (event.type == UringServer::Event::OPENED) {
+        std::shared_ptr<UringSession> session(new UringSession());
+        session->connection = event.connection;
+        {
+          std::lock_guard<std::mutex> lock(workers.placement_mutex);
+          session->worker = workers.placement.Assign();
+        }
+        session->undrawn = 0;
+        session->scheduled = false;
+        session->closed = false;
+        session->drawEvery = draw_every;
+        if (sessions.size() <= event.connection) {
+          sessions.resize(event.connection + 1);
+        }
+        sessions[event.connection] = session;
+        metrics.connections.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      std::shared_ptr<UringSession>& session = sessions[event.connection];
+      if (event.type == UringServer::Event::CLOSED) {
+        {
+          std::lock_guard<std::mutex> lock(workers.placement_mutex);
+          workers.placement.Release(session->worker);
+        }
+        // The controller goes on a worker, by a task of its own unless one
+        // is queued or running.
+        session->closed = true;
+        if (!session->scheduled.exchange(true)) {
+          std::shared_ptr<UringSession> closing = session;
+          workers.scheduler.Submit(
+              session->worker, received,
+              [closing, &replies] { RunUringSession(closing, replies); });
+        }
+        session.reset();
+        metrics.connections.fetch_sub(1, std::memory_order_relaxed);
+        continue;
+      }
+      std::unique_ptr<Telemetry> t = session->spare.Take();
+      if (!t) {
+        t.reset(new Telemetry());
+      }
+      const char* data = event.data.data();
+      auto parse = chrono::steady_clock::now();
+      bool parsed = false;
+      if (event.binary) {
+        PerfScope parse_counts(STAGE_PARSE);
+        parsed = ParseBinaryTelemetry(data, data + event.data.size(), *t);
+      } else {
+        const char* begin;
+        const char* end;
+        if (!hasData(data, event.data.size(), begin, end)) {
+          continue;
+        }
+        if (begin == end) {
+          // Manual driving
+          static const char manual[] = "42[\"manual\",{}]";
+          server.Send(event.connection, manual, sizeof(manual) - 1, false);
+          continue;
+        }
+        PerfScope parse_counts(STAGE_PARSE);
+        parsed = ParseTelemetry(begin, end, *t) ||
+                 ParseTelemetryJson(begin, end, *t, session->arena);
+        parse_counts.Stop();
+        unsigned every;
+        if (!parsed && ParseDrawRequest(begin, end, every, session->arena)) {
+          session->drawEvery = every;
+        }
+      }
+      if (!parsed) {
+        continue;
+      }
+      RecordStage(STAGE_PARSE, parse);
+      t->received = received;
+      t->latency = emulated_latency +
+                   (!lockstep && session->response.count() > 0
+                        ? session->response.mean()
+                        : 0);
+      t->prepared = false;
+      if (!session->frames.Post(std::move(t))) {
+        metrics.framesReplaced.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (!session->scheduled.exchange(true)) {
+        std::shared_ptr<UringSession> running = session;
+        workers.scheduler.Submit(
+            session->worker, received + period,
+            [running, &replies] { RunUringSession(running, replies); });
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(replies.mutex);
+      sending.swap(replies.ready);
+    }
+    for (UringReplies::Reply& reply : sending) {
+      UringSession& session = *reply.session;
+      // A reply to a connection closed since is dropped.
+      if (session.closed.load()) {
+        continue;
+      }
+      auto send = chrono::steady_clock::now();
+      server.Send(session.connection, reply.msg.data(), reply.msg.size(),
+                  reply.binary);
+      supervised_worker.CommandSent();
+      RecordStage(STAGE_SEND, send);
+      session.response.Record(
+          chrono::duration<double>(chrono::steady_clock::now() -
+                                   reply.received)
+              .count());
+    }
+    sending.clear();
+  }
+}
+#endif
+
+// Solve the vehicles' problems on `channel` in batches until the process
+// ends; on a thread of its own.
+void ServeFarm(UdpChannel& channel) {
+  SolverFarm farm(SessionConfig(), farm_threads);
+  farm.mpc().method = method;
+  farm.mpc().anytime = true;
+  farm.mpc().abortHopeless = abort_hopeless;
+  uint64_t replaced = 0;
+  uint64_t stale = 0;
+  uint64_t expired = 0;
+  for (;;) {
+    farm.Serve(channel, chrono::milliseconds(1000));
+    // Problems replaced by newer ones, and those too old to solve.
+    metrics.framesReplaced.fetch_add(channel.replaced() - replaced,
+                                     std::memory_order_relaxed);
+    metrics.framesStale.fetch_add(
+        channel.stale() - stale + farm.expired() - expired,
+        std::memory_order_relaxed);
+    replaced = channel.replaced();
+    stale = channel.stale();
+    expired = farm.expired();
+  }
+}
+
+// Relay the connections on listen_port to proxy_backends_path's nodes, on
+// this thread, until the loop ends.
+int ServeProxy() {
+  std::vector<std::string> backends;
+  if (!Proxy::ReadBackends(proxy_backends_path, backends)) {
+    std::cerr << "Failed to read the backends " << proxy_backends_path
+              << std::endl;
+    return -1;
+  }
+  uWS::Hub h;
+  Proxy proxy(h, Proxy::Options());
+  if (!proxy.SetBackends(backends)) {
+    std::cerr << "Bad backend in " << proxy_backends_path << std::endl;
+    return -1;
+  }
+  if (!h.listen(listen_port)) {
     std::cerr << "Failed to listen to port" << std::endl;
     return -1;
   }
+  std::cout << "Proxying port " << listen_port << " to " << backends.size()
+            << (backends.size() == 1 ? " backend" : " backends") << std::endl;
+  // SIGHUP reads the backends again; the file is small enough to read on
+  // the loop.
+  uv_signal_t reload_signal;
+  uv_signal_init(h.getLoop(), &reload_signal);
+  reload_signal.data = &proxy;
+  uv_signal_start(&reload_signal,
+                  [](uv_signal_t* signal, int) {
+                    std::vector<std::string> backends;
+                    if (!Proxy::ReadBackends(proxy_backends_path, backends) ||
+                        !static_cast<Proxy*>(signal->data)
+                             ->SetBackends(backends)) {
+                      std::cerr << "Failed to reload the backends "
+                                << proxy_backends_path << std::endl;
+                      return;
+                    }
+                    std::cout << "Reloaded " << backends.size()
+                              << " backends" << std::endl;
+                  },
+                  SIGHUP);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&reload_signal));
   h.run();
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (huge_pages != NO_HUGE_PAGES && !UseHugePages(huge_pages, argv)) {
+    std::cerr << "No huge pages for the heap in this glibc" << std::endl;
+  }
+  if (*proxy_backends_path) {
+    return ServeProxy();
+  }
+  if (supervise && !supervised_worker.supervised()) {
+    return Supervise(argv, supervise_standby);
+  }
+  if (*tuning_path) {
+    std::shared_ptr<MpcConfig> tuning(new MpcConfig());
+    if (!LoadTuning(tuning_path, *tuning)) {
+      std::cerr << "Failed to load the tuning " << tuning_path << std::endl;
+      return -1;
+    }
+    tunings.Publish(tuning);
+  }
+  if (*snapshot_path) {
+    if (!snapshot.Open(snapshot_path, {tuning_path, track_map_path})) {
+      std::cerr << "Failed to open a snapshot in " << snapshot_path
+                << std::endl;
+      return -1;
+    }
+    std::cout << (snapshot.complete() ? "Starting from the snapshot "
+                                      : "Building the snapshot ")
+              << snapshot.directory() << std::endl;
+  }
+  if (*track_map_path) {
+    std::shared_ptr<TrackMap> track(new TrackMap());
+    std::string compiled = snapshot.Path(SNAPSHOT_TRACK);
+    if (!snapshot.complete() || !track->Load(compiled)) {
+      if (!track->Load(track_map_path)) {
+        std::cerr << "Failed to load the track map " << track_map_path
+                  << std::endl;
+        return -1;
+      }
+      if (snapshot.open() && !track->mapped() && !track->Save(compiled)) {
+        std::cerr << "Failed to write " << compiled << std::endl;
+      }
+    }
+    std::cout << "Track map: " << track->size() << " waypoints"
+              << std::endl;
+    track_maps.Publish(track);
+    reference_track = track;
+    reference.track = track.get();
+  }
+  reference.behind = track_behind;
+  reference.ahead = track_ahead;
+  reference.lookahead = track_lookahead;
+  if (*record_path && !recorder.Open(record_path)) {
+    std::cerr << "Failed to create " << record_path << std::endl;
+    return -1;
+  }
+  if (*journal_path &&
+      !journal.Open(journal_path, journal_rotate_bytes, journal_keep,
+                    journal_records, journal_block, journal_compress)) {
+    std::cerr << "Failed to create " << journal_path << std::endl;
+    return -1;
+  }
+  EnableTracing(trace_events);
+  if (profile_hz > 0 && !StartStackSampler(profile_hz)) {
+    std::cerr << "Failed to start the stack sampler" << std::endl;
+  }
+  if (energy_mode) {
+    if (energy_meter.Open()) {
+      std::cout << "Energy counters: " << energy_meter.source() << std::endl;
+    } else {
+      std::cout << "No energy counters to read, solves go unmetered"
+                << std::endl;
+    }
+    // Before the workers and event loops start, for them to inherit.
+    if (!SetTimerSlack(uint64_t(energy_timer_slack_us) * 1000)) {
+      std::cerr << "Failed to set the timer slack" << std::endl;
+    }
+  }
+  if (event_triggered) {
+    metrics.forcedSolveInterval.store(forced_solve_interval,
+                                      std::memory_order_relaxed);
+  }
+
+  // Each connection gets a controller of its own, placed on one of the
+  // workers, which share out the frames; the event loop only parses and
+  // sends.
+  size_t threads = worker_threads > 0 ? worker_threads
+                                      : max(1u, thread::hardware_concurrency());
+  // CppAD numbers the sessions' allocators, see MPC::Allocator, and any
+  // threads their controllers start, so as many as it allows.
+  MPC::SetupThreads(CPPAD_MAX_NUM_THREADS);
+  if (lock_memory) {
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      std::cerr << "Failed to lock memory: " << strerror(errno) << std::endl;
+    }
+  }
+  std::vector<NumaNode> nodes;
+  if (numa_placement) {
+    nodes = NumaNodes();
+  } else {
+    nodes.push_back(NumaNode{-1, std::vector<int>()});
+  }
+  std::vector<size_t> worker_nodes(threads);
+  for (size_t i = 0; i < threads; i++) {
+    worker_nodes[i] = i % nodes.size();
+  }
+  FrameScheduler scheduler(threads, worker_nodes);
+  std::vector<int> cpus = ParseCpuList(worker_cpus);
+  for (size_t i = 0; i < threads; i++) {
+    int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    const NumaNode& node = nodes[worker_nodes[i]];
+    scheduler.Pin(i, [i, cpu, node] {
+      if (cpu >= 0 && !PinThread(cpu)) {
+        std::cerr << "Failed to pin worker " << i << " to CPU " << cpu
+                  << std::endl;
+      }
+      // The sessions' controllers are built on their workers, so their
+      // memory is first touched on the node.
+      if (cpu < 0 && !node.cpus.empty() && !PinThread(node.cpus)) {
+        std::cerr << "Failed to pin worker " << i << " to NUMA node "
+                  << node.id << std::endl;
+      }
+      if (node.id >= 0 && !PreferMemoryNode(node.id)) {
+        std::cerr << "Failed to prefer NUMA node " << node.id
+                  << " for worker " << i << std::endl;
+      }
+      if (worker_priority > 0 && !SetFifoPriority(worker_priority)) {
+        std::cerr << "Failed to set worker " << i << " to SCHED_FIFO"
+                  << std::endl;
+      }
+    });
+  }
+  // A controller warmed up and dropped on each worker, under an allocator
+  // of its own, leaves its memory held for the first sessions' allocators
+  // to take over.
+  if (warm_up_solves > 0) {
+    for (size_t i = 0; i < threads; i++) {
+      scheduler.Pin(i, [] {
+        MPC::Allocator allocator;
+        MPC::Allocator::Scope scope(allocator);
+        MPC(SessionConfig()).WarmUp(warm_up_solves);
+      });
+    }
+  }
+  Workers workers(scheduler, worker_nodes);
+  if (*plan_path) {
+    plan_solvers.reset(new Planner::Solvers(PlanController, threads));
+  }
+  if (*checkpoint_path) {
+    handoffs.reset(new Handoffs(checkpoint_max_age, checkpoint_max_bytes));
+  }
+  if (admission_control) {
+    AdmissionControl::Options options;
+    options.degradeAbove = admission_degrade;
+    options.refuseAbove = admission_refuse;
+    options.liftBelow = admission_lift;
+    options.tier = admission_tier;
+    admission.reset(new AdmissionControl(threads, options));
+  }
+  if (shadow_fraction > 0) {
+    ShadowEvaluator::Options options;
+    options.fraction = shadow_fraction;
+    options.threads = shadow_threads;
+    options.cpus = ParseCpuList(shadow_cpus);
+    options.tolerance = shadow_tolerance;
+    shadow.reset(new ShadowEvaluator(ShadowController, options));
+  }
+#ifdef MPC_COROUTINES
+  if (hibernate_after > 0) {
+    std::cerr << "hibernate_after needs a build without MPC_COROUTINES"
+              << std::endl;
+    return -1;
+  }
+#endif
+  if (time_triggered) {
+#ifdef MPC_COROUTINES
+    std::cerr << "time_triggered needs a build without MPC_COROUTINES"
+              << std::endl;
+    return -1;
+#else
+    cycles.reset(new PeriodicExecutor(cycle_priority));
+    if (!cycles->ok()) {
+      std::cerr << "Failed to make the cycle timer" << std::endl;
+      return -1;
+    }
+#endif
+  }
+
+  // Once each worker has run its warm-up, a snapshot being built has all
+  // it takes, and a supervised worker is warm and waits for its turn to
+  // serve.
+  bool building = snapshot.open() && !snapshot.complete();
+  if (supervised_worker.supervised() || building) {
+    std::vector<std::future<void> > warm;
+    for (size_t i = 0; i < threads; i++) {
+      std::shared_ptr<std::promise<void> > done(new std::promise<void>());
+      warm.push_back(done->get_future());
+      scheduler.Pin(i, [done] { done->set_value(); });
+    }
+    for (std::future<void>& w : warm) {
+      w.wait();
+    }
+  }
+  if (building && !snapshot.Commit()) {
+    std::cerr << "Failed to complete the snapshot " << snapshot.directory()
+              << std::endl;
+  }
+  if (supervised_worker.supervised() && !supervised_worker.WaitToServe()) {
+    return 0;
+  }
+
+  // The hubs are all listening before any runs, so that a port taken fails
+  // the start; hub 0 then runs on this thread, the others on their own. A
+  // supervised worker shares the port with the one it replaces.
+  size_t io_loops = io_threads > 0 ? io_threads
+                                   : max(1u, thread::hardware_concurrency());
+  bool reuse_port = io_loops > 1 || supervised_worker.supervised();
+  std::vector<std::unique_ptr<uWS::Hub> > hubs;
+  for (size_t k = 0; k < io_loops; k++) {
+    hubs.emplace_back(new uWS::Hub());
+    Serve(*hubs[k], workers);
+    if (!hubs[k]->listen(listen_port, nullptr,
+                         reuse_port ? uS::ListenOptions::REUSE_PORT : 0)) {
+      std::cerr << "Failed to listen to port" << std::endl;
+      return -1;
+    }
+  }
+  supervised_worker.Listening();
+  std::cout << "Listening to port " << listen_port << " on " << io_loops
+            << (io_loops > 1 ? " event loops" : " event loop") << std::endl;
+  std::cout << "SIMD kernels: " << IsaName(Kernels().isa) << std::endl;
+  std::cout << "Heap allocator: " << HeapAllocatorName(HeapAllocator())
+            << std::endl;
+  uv_loop_t* loop = hubs[0]->getLoop();
+
+  // Admission control's samples.
+  uv_timer_t admission_timer;
+  if (admission) {
+    uint64_t interval = uint64_t(admission_interval * 1000 + 0.5);
+    uv_timer_init(loop, &admission_timer);
+    uv_timer_start(&admission_timer,
+                   [](uv_timer_t*) {
+                     admission->Sample(
+                         chrono::steady_clock::now(),
+                         metrics.connections.load(std::memory_order_relaxed));
+                   },
+                   interval, interval);
+    uv_unref(reinterpret_cast<uv_handle_t*>(&admission_timer));
+  }
+  // SIGUSR1 prints the stage histograms, while everything keeps running.
+  uv_signal_t stages_signal;
+  uv_signal_init(loop, &stages_signal);
+  uv_signal_start(&stages_signal,
+                  [](uv_signal_t*, int) { PrintStages(std::cout); }, SIGUSR1);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&stages_signal));
+  // SIGUSR2 writes the trace.
+  uv_signal_t trace_signal;
+  if (TracingEnabled()) {
+    uv_signal_init(loop, &trace_signal);
+    uv_signal_start(&trace_signal,
+                    [](uv_signal_t*, int) { WriteTrace("requested"); },
+                    SIGUSR2);
+    uv_unref(reinterpret_cast<uv_handle_t*>(&trace_signal));
+  }
+  // SIGHUP reloads the track and the tuning, on the loop's thread pool, one
+  // reload at a time.
+  uv_signal_t reload_signal;
+  uv_signal_init(loop, &reload_signal);
+  uv_signal_start(&reload_signal,
+                  [](uv_signal_t* signal, int) {
+                    static uv_work_t work;
+                    static bool reloading = false;
+                    if (reloading) {
+                      std::cout << "Still reloading" << std::endl;
+                      return;
+                    }
+                    reloading = true;
+                    uv_queue_work(signal->loop, &work,
+                                  [](uv_work_t*) { Reload(); },
+                                  [](uv_work_t*, int) { reloading = false; });
+                  },
+                  SIGHUP);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&reload_signal));
+
+  std::vector<std::thread> loops;
+  ShmChannel channel;
+  if (*shm_name) {
+    if (!channel.Create(shm_name)) {
+      std::cerr << "Failed to create the shared memory " << shm_name
+                << std::endl;
+      return -1;
+    }
+    std::cout << "Serving the bridge on " << shm_name << std::endl;
+    loops.emplace_back([&channel] { ServeShm(channel); });
+  }
+  UdpChannel datagrams;
+  if (udp_port >= 0) {
+    if (!datagrams.Bind(udp_port)) {
+      std::cerr << "Failed to bind UDP port " << udp_port << std::endl;
+      return -1;
+    }
+    std::cout << "Serving bridges on UDP port " << udp_port << std::endl;
+    loops.emplace_back([&datagrams] { ServeUdp(datagrams); });
+  }
+#ifdef MPC_IO_URING
+  UringServer uring;
+  if (uring_port >= 0) {
+    if (!uring.Listen(uring_port)) {
+      std::cerr << "Failed to serve port " << uring_port << " on io_uring"
+                << std::endl;
+      return -1;
+    }
+    std::cout << "Serving websockets on port " << uring_port << " on io_uring"
+              << std::endl;
+    loops.emplace_back([&uring, &workers] { ServeUring(uring, workers); });
+  }
+#endif
+  UdpChannel farm_datagrams;
+  if (farm_port >= 0) {
+    if (!farm_datagrams.Bind(farm_port)) {
+      std::cerr << "Failed to bind UDP port " << farm_port << std::endl;
+      return -1;
+    }
+    std::cout << "Serving as a solver farm on UDP port " << farm_port
+              << std::endl;
+    loops.emplace_back([&farm_datagrams] { ServeFarm(farm_datagrams); });
+  }
+  for (size_t k = 1; k < io_loops; k++) {
+    uWS::Hub* hub = hubs[k].get();
+    loops.emplace_back([hub, k, &workers] { RunHub(*hub, k, workers); });
+  }
+  RunHub(*hubs[0], 0, workers);
+  for (std::thread& thread : loops) {
+    thread.join();
+  }
 }
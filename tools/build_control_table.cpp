@@ -0,0 +1,117 @@
+// Solves the controller's NMPC over a grid of (v, cte, epsi, curvature) and
+// writes the actuations as the control table MPC::LoadControlTable answers
+// from. Then checks the interpolation at points between the grid points
+// against MPC::Solve, and prints how far off it is.
+//
+//   build_control_table table.bin [points per axis] [checks]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "ControlTable.h"
+#include "MPC.h"
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s table.bin [points per axis] [checks]\n",
+            argv[0]);
+    return 1;
+  }
+  uint32_t points = argc > 2 ? atoi(argv[2]) : 9;
+  size_t checks = argc > 3 ? atoi(argv[3]) : 1000;
+  if (points < 2) {
+    fprintf(stderr, "at least 2 points per axis\n");
+    return 1;
+  }
+
+  // The range the car drives in on the lake track; the solver answers the
+  // rest.
+  MpcConfig config;
+  ControlTable::Axis axes[ControlTable::DIMENSIONS] = {
+      {0, 1.2 * config.refV, points},
+      {-2, 2, points},
+      {-0.4, 0.4, points},
+      {-0.08, 0.08, points}};
+  ControlTable::Model model = {double(config.N), config.dt, config.Lf,
+                               config.refV};
+  ControlTable table(axes, model);
+
+  // In grid order, each point warm starts from the last, which differs from
+  // it along the last axis only.
+  MPC mpc(config);
+  mpc.fallback = false;
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+  size_t failed = 0;
+  for (size_t i = 0; i < table.size(); i++) {
+    double q[ControlTable::DIMENSIONS];
+    table.Point(i, q);
+    State state;
+    Cubic coeffs;
+    ControlTable::Sample(q, state, coeffs);
+    mpc_x.clear();
+    mpc_y.clear();
+    std::vector<double> u = mpc.Solve(state, coeffs, mpc_x, mpc_y);
+    if (mpc.stats().status == MPC::CONVERGED) {
+      table.Set(i, Input(u[0], u[1]));
+    } else {
+      failed++;
+    }
+    if ((i + 1) % 1000 == 0) {
+      fprintf(stderr, "%zu / %zu\n", i + 1, table.size());
+    }
+  }
+  if (!table.Save(argv[1])) {
+    fprintf(stderr, "failed to write %s\n", argv[1]);
+    return 1;
+  }
+  printf("%s: %zu points, %zu failed\n", argv[1], table.size(), failed);
+
+  // Uniformly over the grid, so mostly between its points.
+  std::mt19937 random(1);
+  double delta_error = 0;
+  double a_error = 0;
+  double delta_max = 0;
+  double a_max = 0;
+  size_t checked = 0;
+  size_t missed = 0;
+  for (size_t c = 0; c < checks; c++) {
+    double q[ControlTable::DIMENSIONS];
+    for (int d = 0; d < ControlTable::DIMENSIONS; d++) {
+      const ControlTable::Axis& axis =
+          table.axis(ControlTable::Dimension(d));
+      std::uniform_real_distribution<double> along(axis.lo, axis.hi);
+      q[d] = along(random);
+    }
+    Input tabled;
+    if (!table.Lookup(q, tabled)) {
+      missed++;
+      continue;
+    }
+    State state;
+    Cubic coeffs;
+    ControlTable::Sample(q, state, coeffs);
+    mpc_x.clear();
+    mpc_y.clear();
+    std::vector<double> u = mpc.Solve(state, coeffs, mpc_x, mpc_y);
+    if (mpc.stats().status != MPC::CONVERGED) {
+      continue;
+    }
+    double de = std::abs(tabled[0] - u[0]);
+    double ae = std::abs(tabled[1] - u[1]);
+    delta_error += de;
+    a_error += ae;
+    delta_max = std::max(delta_max, de);
+    a_max = std::max(a_max, ae);
+    checked++;
+  }
+  if (checked > 0) {
+    printf("%zu checks (%zu next to failed points): delta error mean %.5f "
+           "max %.5f rad, a error mean %.5f max %.5f\n",
+           checked, missed, delta_error / checked, delta_max,
+           a_error / checked, a_max);
+  }
+  return 0;
+}
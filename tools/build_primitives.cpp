@@ -0,0 +1,120 @@
+// Solves the controller's NMPC over a grid of (v, curvature) and writes the
+// solutions as the motion primitives MPC::LoadPrimitives starts cold solves
+// from. Then solves frames at random between the grid points, with errors
+// off the path, cold from zeros and from the nearest primitive, and prints
+// the iterations and time of each.
+//
+//   build_primitives primitives.bin [speeds] [curvatures] [checks]
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "ControlTable.h"
+#include "MPC.h"
+#include "MotionPrimitives.h"
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "usage: %s primitives.bin [speeds] [curvatures] [checks]\n",
+            argv[0]);
+    return 1;
+  }
+  uint32_t speeds = argc > 2 ? atoi(argv[2]) : 13;
+  uint32_t curvatures = argc > 3 ? atoi(argv[3]) : 17;
+  size_t checks = argc > 4 ? atoi(argv[4]) : 200;
+  if (speeds < 2 || curvatures < 2) {
+    fprintf(stderr, "at least 2 points per axis\n");
+    return 1;
+  }
+
+  // The range the car drives in on the lake track, as the control table's.
+  MpcConfig config;
+  ControlTable::Axis axes[MotionPrimitives::DIMENSIONS] = {
+      {0, 1.2 * config.refV, speeds}, {-0.08, 0.08, curvatures}};
+  ControlTable::Model model = {double(config.N), config.dt, config.Lf,
+                               config.refV};
+  MPC mpc(config);
+  mpc.fallback = false;
+  MotionPrimitives library(axes, model, mpc.variables());
+  std::vector<double> x;
+  std::vector<double> mpc_x;
+  std::vector<double> mpc_y;
+
+  // In grid order, each point warm starts from the last, which differs from
+  // it in curvature only.
+  size_t failed = 0;
+  for (size_t i = 0; i < library.size(); i++) {
+    double q[ControlTable::DIMENSIONS] = {};
+    library.Point(i, q[ControlTable::V], q[ControlTable::CURVATURE]);
+    State state;
+    Cubic coeffs;
+    ControlTable::Sample(q, state, coeffs);
+    mpc_x.clear();
+    mpc_y.clear();
+    mpc.Solve(state, coeffs, mpc_x, mpc_y);
+    if (mpc.stats().status == MPC::CONVERGED && mpc.Solution(x)) {
+      library.Set(i, x.data());
+    } else {
+      failed++;
+    }
+  }
+  if (!library.Save(argv[1])) {
+    fprintf(stderr, "failed to write %s\n", argv[1]);
+    return 1;
+  }
+  printf("%s: %zu primitives of %zu variables, %zu kB, %zu failed\n",
+         argv[1], library.size(), library.width(),
+         (library.size() * (1 + 4 * library.width())) >> 10, failed);
+
+  // Each check as the first solve of a session: nothing to warm start from.
+  MPC cold(config);
+  MPC seeded(config);
+  cold.warmStart = false;
+  seeded.warmStart = false;
+  cold.fallback = false;
+  seeded.fallback = false;
+  if (!seeded.LoadPrimitives(argv[1])) {
+    fprintf(stderr, "failed to load %s\n", argv[1]);
+    return 1;
+  }
+  std::mt19937 random(1);
+  MPC* const controllers[2] = {&cold, &seeded};
+  double iterations[2] = {0, 0};
+  double ms[2] = {0, 0};
+  size_t converged[2] = {0, 0};
+  for (size_t c = 0; c < checks; c++) {
+    double q[ControlTable::DIMENSIONS];
+    std::uniform_real_distribution<double> v(axes[0].lo, axes[0].hi);
+    std::uniform_real_distribution<double> curvature(axes[1].lo, axes[1].hi);
+    std::uniform_real_distribution<double> cte(-1, 1);
+    std::uniform_real_distribution<double> epsi(-0.2, 0.2);
+    q[ControlTable::V] = v(random);
+    q[ControlTable::CTE] = cte(random);
+    q[ControlTable::EPSI] = epsi(random);
+    q[ControlTable::CURVATURE] = curvature(random);
+    State state;
+    Cubic coeffs;
+    ControlTable::Sample(q, state, coeffs);
+    for (int k = 0; k < 2; k++) {
+      mpc_x.clear();
+      mpc_y.clear();
+      controllers[k]->Solve(state, coeffs, mpc_x, mpc_y);
+      const MPC::SolveStats& stats = controllers[k]->stats();
+      iterations[k] += stats.iterations;
+      ms[k] += stats.seconds * 1e3;
+      converged[k] += stats.status == MPC::CONVERGED;
+    }
+  }
+  const char* const names[2] = {"zeros", "primitive"};
+  printf("%-10s %10s %10s %10s\n", "start", "iter mean", "ms mean",
+         "converged");
+  for (int k = 0; k < 2; k++) {
+    printf("%-10s %10.1f %10.3f %6zu/%zu\n", names[k],
+           iterations[k] / std::max<size_t>(checks, 1),
+           ms[k] / std::max<size_t>(checks, 1), converged[k], checks);
+  }
+  return 0;
+}
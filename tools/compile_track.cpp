@@ -0,0 +1,27 @@
+// Compiles a waypoint CSV into the binary track format that TrackMap maps
+// read-only, with the arc lengths, spline and spatial index precomputed.
+//
+//   compile_track waypoints.csv track.bin
+
+#include <iostream>
+#include "TrackMap.h"
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " waypoints.csv track.bin"
+              << std::endl;
+    return 1;
+  }
+  TrackMap track;
+  if (!track.Load(argv[1])) {
+    std::cerr << "Failed to read the waypoints from " << argv[1] << std::endl;
+    return 1;
+  }
+  if (!track.Save(argv[2])) {
+    std::cerr << "Failed to write " << argv[2] << std::endl;
+    return 1;
+  }
+  std::cout << argv[2] << ": " << track.size() << " waypoints, "
+            << track.length() << " m loop" << std::endl;
+  return 0;
+}
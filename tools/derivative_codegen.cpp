@@ -0,0 +1,490 @@
+// Writes a stage of the full formulation and its derivatives as
+// straight-line C++, see GeneratedStages.h, for one model and integrator
+// over the stage lengths of MpcConfig's defaults:
+//
+//   derivative_codegen GeneratedStages.cpp [kinematic|dynamic]
+//                      [euler|midpoint|rk4]
+//
+// StageStep runs once on a scalar that records its operations into an
+// expression graph, folding constants and sharing repeated subexpressions.
+// The derivatives are taken on the graph in forward mode, by the stage's
+// variables, and taken again for the Hessian; each function then gets the
+// operations its outputs reach, in order, one assignment each.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "MpcConfig.h"
+#include "ProblemPolicies.h"
+
+namespace {
+
+// A stage's variables, the path's coefficients and the multipliers are the
+// inputs of the functions written.
+enum Op { CONST, VAR, COEFF, LAMBDA, ADD, SUB, MUL, DIV, NEG, SIN, COS, ATAN2 };
+const int STAGE_VARS = KinematicModel::STATES + KinematicModel::INPUTS;
+
+struct Node {
+  Op op;
+  int a;
+  int b;
+  double value;
+};
+
+// The expression graph, each node in it once. The operands of a node come
+// before it.
+class Graph {
+ public:
+  int Constant(double value) { return Add(Node{CONST, -1, -1, value}); }
+  int Input(Op op, int index) { return Add(Node{op, index, -1, 0}); }
+
+  int Unary(Op op, int a) {
+    const Node n = nodes_[a];
+    if (n.op == CONST) {
+      return Constant(op == NEG ? -n.value
+                                : op == SIN ? std::sin(n.value)
+                                            : std::cos(n.value));
+    }
+    if (op == NEG && n.op == NEG) {
+      return n.a;
+    }
+    return Add(Node{op, a, -1, 0});
+  }
+
+  int Binary(Op op, int a, int b) {
+    const Node x = nodes_[a];
+    const Node y = nodes_[b];
+    if (x.op == CONST && y.op == CONST) {
+      switch (op) {
+        case ADD:
+          return Constant(x.value + y.value);
+        case SUB:
+          return Constant(x.value - y.value);
+        case MUL:
+          return Constant(x.value * y.value);
+        case DIV:
+          return Constant(x.value / y.value);
+        default:
+          return Constant(std::atan2(x.value, y.value));
+      }
+    }
+    switch (op) {
+      case ADD:
+        if (Is(a, 0)) {
+          return b;
+        }
+        if (Is(b, 0)) {
+          return a;
+        }
+        break;
+      case SUB:
+        if (Is(b, 0)) {
+          return a;
+        }
+        if (Is(a, 0)) {
+          return Unary(NEG, b);
+        }
+        if (a == b) {
+          return Constant(0);
+        }
+        break;
+      case MUL:
+        if (Is(a, 0) || Is(b, 0)) {
+          return Constant(0);
+        }
+        if (Is(a, 1)) {
+          return b;
+        }
+        if (Is(b, 1)) {
+          return a;
+        }
+        if (Is(a, -1)) {
+          return Unary(NEG, b);
+        }
+        if (Is(b, -1)) {
+          return Unary(NEG, a);
+        }
+        break;
+      case DIV:
+        if (Is(a, 0)) {
+          return Constant(0);
+        }
+        if (Is(b, 1)) {
+          return a;
+        }
+        break;
+      default:
+        break;
+    }
+    // One order for the operands of the commutative operations.
+    if ((op == ADD || op == MUL) && b < a) {
+      std::swap(a, b);
+    }
+    return Add(Node{op, a, b, 0});
+  }
+
+  const Node& operator[](int i) const { return nodes_[i]; }
+  int size() const { return int(nodes_.size()); }
+
+ private:
+  bool Is(int i, double value) const {
+    return nodes_[i].op == CONST && nodes_[i].value == value;
+  }
+
+  int Add(const Node& node) {
+    uint64_t bits;
+    memcpy(&bits, &node.value, sizeof(bits));
+    auto key = std::make_tuple(int(node.op), node.a, node.b, bits);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      return found->second;
+    }
+    nodes_.push_back(node);
+    index_[key] = int(nodes_.size()) - 1;
+    return int(nodes_.size()) - 1;
+  }
+
+  std::vector<Node> nodes_;
+  std::map<std::tuple<int, int, int, uint64_t>, int> index_;
+};
+
+// The graph being recorded.
+Graph* graph;
+
+// A scalar that records what is done with it into the graph.
+struct Sym {
+  Sym() : id(-1) {}
+  Sym(double value) : id(graph->Constant(value)) {}
+  static Sym Of(int id) {
+    Sym s;
+    s.id = id;
+    return s;
+  }
+  Sym& operator+=(const Sym& other) {
+    id = graph->Binary(ADD, id, other.id);
+    return *this;
+  }
+  int id;
+};
+
+Sym operator+(const Sym& a, const Sym& b) {
+  return Sym::Of(graph->Binary(ADD, a.id, b.id));
+}
+Sym operator-(const Sym& a, const Sym& b) {
+  return Sym::Of(graph->Binary(SUB, a.id, b.id));
+}
+Sym operator*(const Sym& a, const Sym& b) {
+  return Sym::Of(graph->Binary(MUL, a.id, b.id));
+}
+Sym operator/(const Sym& a, const Sym& b) {
+  return Sym::Of(graph->Binary(DIV, a.id, b.id));
+}
+Sym operator*(const Sym& a, double b) { return a * Sym(b); }
+Sym operator/(const Sym& a, double b) { return a / Sym(b); }
+Sym operator+(double a, const Sym& b) { return Sym(a) + b; }
+Sym operator-(double a, const Sym& b) { return Sym(a) - b; }
+Sym operator*(double a, const Sym& b) { return Sym(a) * b; }
+Sym sin(const Sym& a) { return Sym::Of(graph->Unary(SIN, a.id)); }
+Sym cos(const Sym& a) { return Sym::Of(graph->Unary(COS, a.id)); }
+Sym atan2(const Sym& y, const Sym& x) {
+  return Sym::Of(graph->Binary(ATAN2, y.id, x.id));
+}
+
+// The derivatives of the nodes before `end` by the VAR inputs, STAGE_VARS
+// node ids for each, the new nodes added to g.
+std::vector<std::vector<int> > Derive(Graph& g, int end) {
+  const int zero = g.Constant(0);
+  const int one = g.Constant(1);
+  std::vector<std::vector<int> > d(end, std::vector<int>(STAGE_VARS, zero));
+  for (int i = 0; i < end; i++) {
+    const Node n = g[i];
+    std::vector<int>& di = d[i];
+    switch (n.op) {
+      case VAR:
+        di[n.a] = one;
+        break;
+      case ADD:
+      case SUB:
+        for (int j = 0; j < STAGE_VARS; j++) {
+          di[j] = g.Binary(n.op, d[n.a][j], d[n.b][j]);
+        }
+        break;
+      case MUL:
+        for (int j = 0; j < STAGE_VARS; j++) {
+          di[j] = g.Binary(ADD, g.Binary(MUL, d[n.a][j], n.b),
+                           g.Binary(MUL, n.a, d[n.b][j]));
+        }
+        break;
+      case DIV:
+        // (a' - (a / b) b') / b
+        for (int j = 0; j < STAGE_VARS; j++) {
+          int scaled = g.Binary(MUL, i, d[n.b][j]);
+          di[j] = g.Binary(DIV, g.Binary(SUB, d[n.a][j], scaled), n.b);
+        }
+        break;
+      case NEG:
+        for (int j = 0; j < STAGE_VARS; j++) {
+          di[j] = g.Unary(NEG, d[n.a][j]);
+        }
+        break;
+      case SIN: {
+        int slope = g.Unary(COS, n.a);
+        for (int j = 0; j < STAGE_VARS; j++) {
+          di[j] = g.Binary(MUL, slope, d[n.a][j]);
+        }
+        break;
+      }
+      case COS: {
+        int slope = g.Unary(NEG, g.Unary(SIN, n.a));
+        for (int j = 0; j < STAGE_VARS; j++) {
+          di[j] = g.Binary(MUL, slope, d[n.a][j]);
+        }
+        break;
+      }
+      case ATAN2: {
+        // (x y' - y x') / (x^2 + y^2) for atan2(y, x).
+        int norm = g.Binary(ADD, g.Binary(MUL, n.a, n.a),
+                            g.Binary(MUL, n.b, n.b));
+        for (int j = 0; j < STAGE_VARS; j++) {
+          di[j] = g.Binary(DIV,
+                           g.Binary(SUB, g.Binary(MUL, n.b, d[n.a][j]),
+                                    g.Binary(MUL, n.a, d[n.b][j])),
+                           norm);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return d;
+}
+
+std::string Operand(const Graph& g, int i) {
+  const Node& n = g[i];
+  char text[64];
+  switch (n.op) {
+    case CONST:
+      snprintf(text, sizeof(text), "%.17g", n.value);
+      if (strpbrk(text, ".en") == nullptr) {
+        strcat(text, ".0");
+      }
+      return n.value < 0 ? "(" + std::string(text) + ")" : text;
+    case VAR:
+      snprintf(text, sizeof(text), "w[%d]", n.a);
+      return text;
+    case COEFF:
+      snprintf(text, sizeof(text), "c[%d]", n.a);
+      return text;
+    case LAMBDA:
+      snprintf(text, sizeof(text), "lambda[%d]", n.a);
+      return text;
+    default:
+      snprintf(text, sizeof(text), "v%d", i);
+      return text;
+  }
+}
+
+// A function of `signature` setting out[k] to outputs[k], with the
+// operations they reach; returns how many there are.
+int Emit(FILE* f, const Graph& g, const std::string& signature,
+         const std::vector<int>& outputs) {
+  std::vector<bool> used(g.size(), false);
+  for (int o : outputs) {
+    used[o] = true;
+  }
+  for (int i = g.size() - 1; i >= 0; i--) {
+    const Node& n = g[i];
+    if (used[i] && n.op >= ADD) {
+      used[n.a] = true;
+      if (n.op != NEG && n.op != SIN && n.op != COS) {
+        used[n.b] = true;
+      }
+    }
+  }
+  static const char* const INFIX[] = {"", "", "", "", " + ", " - ", " * ",
+                                      " / "};
+  fprintf(f, "%s {\n", signature.c_str());
+  int operations = 0;
+  for (int i = 0; i < g.size(); i++) {
+    const Node& n = g[i];
+    if (!used[i] || n.op < ADD) {
+      continue;
+    }
+    std::string a = Operand(g, n.a);
+    std::string value;
+    switch (n.op) {
+      case NEG:
+        value = "-" + a;
+        break;
+      case SIN:
+        value = "std::sin(" + a + ")";
+        break;
+      case COS:
+        value = "std::cos(" + a + ")";
+        break;
+      case ATAN2:
+        value = "std::atan2(" + a + ", " + Operand(g, n.b) + ")";
+        break;
+      default:
+        value = a + INFIX[n.op] + Operand(g, n.b);
+    }
+    fprintf(f, "  const double v%d = %s;\n", i, value.c_str());
+    operations++;
+  }
+  for (size_t k = 0; k < outputs.size(); k++) {
+    fprintf(f, "  out[%zu] = %s;\n", k, Operand(g, outputs[k]).c_str());
+  }
+  fprintf(f, "}\n\n");
+  return operations;
+}
+
+// The functions of stage number s, of `model` on `slopes` over dt.
+template <class Model>
+void Generate(FILE* f, const Model& model, size_t slopes, double dt, int s) {
+  Graph g;
+  graph = &g;
+  Sym w[STAGE_VARS];
+  Sym c[4];
+  Sym lambda[Model::STATES];
+  Sym next[Model::STATES];
+  for (int i = 0; i < STAGE_VARS; i++) {
+    w[i] = Sym::Of(g.Input(VAR, i));
+  }
+  for (int i = 0; i < 4; i++) {
+    c[i] = Sym::Of(g.Input(COEFF, i));
+  }
+  for (size_t i = 0; i < Model::STATES; i++) {
+    lambda[i] = Sym::Of(g.Input(LAMBDA, int(i)));
+  }
+  StageStep(model, slopes, dt, c, w, next);
+  Sym sum(0.);
+  for (size_t i = 0; i < Model::STATES; i++) {
+    sum += lambda[i] * next[i];
+  }
+
+  std::vector<int> step;
+  std::vector<int> jacobian;
+  std::vector<int> hessian;
+  std::vector<std::vector<int> > d = Derive(g, g.size());
+  for (size_t i = 0; i < Model::STATES; i++) {
+    step.push_back(next[i].id);
+    for (int j = 0; j < STAGE_VARS; j++) {
+      jacobian.push_back(d[next[i].id][j]);
+    }
+  }
+  std::vector<int> gradient = d[sum.id];
+  std::vector<std::vector<int> > d2 = Derive(g, g.size());
+  for (int i = 0; i < STAGE_VARS; i++) {
+    for (int j = 0; j <= i; j++) {
+      hessian.push_back(d2[gradient[i]][j]);
+    }
+  }
+
+  char name[128];
+  snprintf(name, sizeof(name), "void step_%d(const double* c, "
+           "const double* w, double* out)", s);
+  int a = Emit(f, g, name, step);
+  snprintf(name, sizeof(name), "void jacobian_%d(const double* c, "
+           "const double* w, double* out)", s);
+  int b = Emit(f, g, name, jacobian);
+  snprintf(name, sizeof(name), "void hessian_%d(const double* c, "
+           "const double* w, const double* lambda, double* out)", s);
+  int h = Emit(f, g, name, hessian);
+  printf("dt %g: %d, %d and %d operations\n", dt, a, b, h);
+  graph = nullptr;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  MpcConfig config;
+  const char* model = argc > 2 ? argv[2] : "kinematic";
+  const char* integrator = argc > 3 ? argv[3] : "euler";
+  bool known = true;
+  if (strcmp(model, "dynamic") == 0) {
+    config.model = MpcConfig::DYNAMIC;
+  } else {
+    known = known && strcmp(model, "kinematic") == 0;
+  }
+  size_t slopes = 1;
+  if (strcmp(integrator, "midpoint") == 0) {
+    config.integrator = MpcConfig::MIDPOINT;
+    slopes = 2;
+  } else if (strcmp(integrator, "rk4") == 0) {
+    config.integrator = MpcConfig::RK4;
+    slopes = 4;
+  } else {
+    known = known && strcmp(integrator, "euler") == 0;
+  }
+  if (argc < 2 || argc > 4 || !known) {
+    fprintf(stderr,
+            "usage: %s GeneratedStages.cpp [kinematic|dynamic] "
+            "[euler|midpoint|rk4]\n",
+            argv[0]);
+    return 1;
+  }
+
+  // The stage lengths of the problems MPC builds up front.
+  std::vector<double> lengths;
+  std::vector<Horizon> horizons = config.horizons;
+  horizons.push_back(config.shortHorizon);
+  for (const Horizon& horizon : horizons) {
+    bool seen = false;
+    for (double dt : lengths) {
+      seen = seen || dt == horizon.dt;
+    }
+    if (!seen) {
+      lengths.push_back(horizon.dt);
+    }
+  }
+
+  FILE* f = fopen(argv[1], "w");
+  if (f == nullptr) {
+    fprintf(stderr, "Failed to create %s\n", argv[1]);
+    return 1;
+  }
+  fprintf(f,
+          "// Written by tools/derivative_codegen for the %s model on %s;\n"
+          "// see GeneratedStages.h.\n\n"
+          "#include \"GeneratedStages.h\"\n"
+          "#include <cmath>\n\n"
+          "namespace {\n\n",
+          model, integrator);
+  for (size_t s = 0; s < lengths.size(); s++) {
+    if (config.model == MpcConfig::DYNAMIC) {
+      Generate(f, DynamicModel(config.Lf, config.tires), slopes, lengths[s],
+               int(s));
+    } else {
+      Generate(f, KinematicModel(config.Lf), slopes, lengths[s], int(s));
+    }
+  }
+  fprintf(f, "}  // namespace\n\n"
+             "const GeneratedStage GENERATED_STAGES[] = {\n");
+  const char* model_name =
+      config.model == MpcConfig::DYNAMIC ? "DYNAMIC" : "KINEMATIC";
+  const char* integrator_name = slopes == 1   ? "EULER"
+                                : slopes == 2 ? "MIDPOINT"
+                                              : "RK4";
+  for (size_t s = 0; s < lengths.size(); s++) {
+    fprintf(f,
+            "    {MpcConfig::%s, MpcConfig::%s, %.17g, %.17g,\n"
+            "     {%.17g, %.17g, %.17g, %.17g},\n"
+            "     step_%zu, jacobian_%zu, hessian_%zu},\n",
+            model_name, integrator_name, lengths[s], config.Lf,
+            config.tires.mass, config.tires.lr, config.tires.frontStiffness,
+            config.tires.rearStiffness, s, s, s);
+  }
+  fprintf(f, "};\n\nconst size_t GENERATED_STAGE_COUNT = %zu;\n",
+          lengths.size());
+  if (fclose(f) != 0) {
+    fprintf(stderr, "Failed to write %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
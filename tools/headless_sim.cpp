@@ -0,0 +1,134 @@
+// Drives the controller around a track in process, faster than real time:
+// a car of SimEnvironments, turning with the Lf of MpcConfig, stands in for
+// the simulator, sends each frame as the simulator's telemetry (see
+// DATA.md), and applies the reply its latency of simulated time later, as in
+// lockstep. Prints each lap's time and cross track error, and the time per
+// frame of the controller, parsing included.
+//
+// Usage: headless_sim [waypoints.csv] [laps]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Controller.h"
+#include "SimEnvironments.h"
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+#include "TrackMap.h"
+
+// Laps given up on after this many frames each.
+static const size_t MAX_LAP_FRAMES = 20000;
+
+// The frame of `t` as the simulator sends it.
+static std::string Frame(const Telemetry& t) {
+  std::string frame = "[\"telemetry\",{\"ptsx\":[";
+  char buffer[160];
+  for (size_t k = 0; k < t.n_waypoints; k++) {
+    snprintf(buffer, sizeof(buffer), "%s%.7g", k ? "," : "", t.ptsx[k]);
+    frame += buffer;
+  }
+  frame += "],\"ptsy\":[";
+  for (size_t k = 0; k < t.n_waypoints; k++) {
+    snprintf(buffer, sizeof(buffer), "%s%.7g", k ? "," : "", t.ptsy[k]);
+    frame += buffer;
+  }
+  snprintf(buffer, sizeof(buffer),
+           "],\"psi\":%.7g,\"psi_unity\":%.7g,\"speed\":%.7g,"
+           "\"steering_angle\":%.7g,",
+           t.psi, fmod(2.5 * M_PI - t.psi, 2 * M_PI), t.v, t.delta);
+  frame += buffer;
+  snprintf(buffer, sizeof(buffer), "\"throttle\":%.7g,\"x\":%.7g,\"y\":%.7g}]",
+           t.a, t.px, t.py);
+  frame += buffer;
+  return frame;
+}
+
+static double Percentile(std::vector<double>& sorted, double p) {
+  size_t i = std::min(sorted.size() - 1,
+                      size_t(p * (sorted.size() - 1) + 0.5));
+  return sorted[i];
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  int laps = argc > 2 ? atoi(argv[2]) : 3;
+  TrackMap track;
+  if (!track.Load(path) || track.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", path);
+    return 1;
+  }
+
+  Controller controller;
+  Controller::Output out;
+  SimEnvironments car(track, 1, controller.mpc().config().Lf);
+  double time = 0;
+  double start = 0;
+  double cte_sum = 0;
+  double cte_max = 0;
+  size_t lap_frames = 0;
+  std::vector<double> frame_ms;
+  auto wall = std::chrono::steady_clock::now();
+
+  printf("%-4s %10s %10s %10s %10s\n", "lap", "time s", "cte mean", "cte max",
+         "frames");
+  int lap = 0;
+  while (lap < laps) {
+    Telemetry t;
+    car.Observe(&t);
+    std::string frame = Frame(t);
+    auto begin = std::chrono::steady_clock::now();
+    ParseTelemetry(frame.data(), frame.data() + frame.size(), t);
+    t.received = begin;
+    t.latency = car.latency;
+    controller.Step(t,
+                    begin + std::chrono::duration_cast<
+                                std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(car.period)),
+                    out);
+    frame_ms.push_back(
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - begin).count());
+    SimEnvironments::Action action = {out.steering, out.throttle};
+    car.Step(&action);
+    time += car.period;
+
+    double cte = car.cte(0);
+    cte_sum += cte;
+    cte_max = std::max(cte_max, cte);
+    lap_frames++;
+    if (car.off(0) || lap_frames > MAX_LAP_FRAMES) {
+      printf("%-4d %10s %10.3f %10.3f %10zu  %s\n", lap + 1, "-",
+             cte_sum / lap_frames, cte_max, lap_frames,
+             car.off(0) ? "off the track" : "too slow");
+      return 1;
+    }
+    if (car.progress(0) >= track.length() * (lap + 1)) {
+      printf("%-4d %10.2f %10.3f %10.3f %10zu\n", lap + 1, time - start,
+             cte_sum / lap_frames, cte_max, lap_frames);
+      fflush(stdout);
+      start = time;
+      cte_sum = 0;
+      cte_max = 0;
+      lap_frames = 0;
+      lap++;
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - wall).count();
+  size_t frames = frame_ms.size();
+  double total_ms = 0;
+  for (double ms : frame_ms) {
+    total_ms += ms;
+  }
+  std::sort(frame_ms.begin(), frame_ms.end());
+  printf("\n%zu frames in %.2f s: %.0f frames/s, %.0fx real time\n", frames,
+         seconds, frames / seconds, time / seconds);
+  printf("frame ms: mean %.3f p50 %.3f p99 %.3f max %.3f\n", total_ms / frames,
+         Percentile(frame_ms, 0.5), Percentile(frame_ms, 0.99),
+         frame_ms.back());
+  return 0;
+}
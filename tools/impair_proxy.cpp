@@ -0,0 +1,391 @@
+// A bad network between the simulator and the server, for seeing how the
+// latency compensation, the stale frame dropping and the degradation ladder
+// hold up: relays each connection message for message, as netem would
+// shape it, and reports what the simulator's side of it saw.
+//
+//   impair_proxy [port] [server host:port] [name=value...]
+//
+// listens on port, 4567 unless given, for the simulator, and connects each
+// connection to the server, 127.0.0.1:4568 unless given; build the server
+// with listen_port at that port. The impairments apply to the telemetry and
+// to the commands alike, or to one of them with a telemetry. or command.
+// prefix:
+//
+//   delay=ms    every message held this long,
+//   jitter=ms   plus or minus up to this much, uniformly,
+//   loss=p      dropped with probability p,
+//   reorder=p   sent at once with probability p, ahead of those held,
+//
+// and seed=n seeds the draws, report=s sets the seconds between reports.
+// Messages that aren't reordered keep their order, as netem's do. Each
+// report covers the messages since the last: those relayed, lost and
+// reordered each way; the age of the state each command was computed from
+// as the simulator gets it, from the simulator sending the newest frame the
+// server had been given to the command arriving; the jitter of the
+// intervals between commands arriving; and, from the frames, the car's
+// distance from the waypoints' polyline and its speed. The server's side,
+// frames dropped as stale and tiers degraded to, is in its /metrics.
+#include <uWS/uWS.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Telemetry.h"
+#include "TelemetryParser.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// How one direction is shaped, in seconds and probabilities.
+struct Impairment {
+  double delay;
+  double jitter;
+  double loss;
+  double reorder;
+};
+
+enum Direction { TELEMETRY, COMMAND, DIRECTIONS };
+static const char* const DIRECTION_NAMES[DIRECTIONS] = {"telemetry",
+                                                         "command"};
+
+static Impairment impairments[DIRECTIONS];
+static std::mt19937_64 random_engine;
+
+// One simulator connection and its connection to the server.
+struct Link {
+  uWS::WebSocket<uWS::SERVER> client;
+  uWS::WebSocket<uWS::CLIENT> server;
+  bool open;
+  bool connected;
+  // Frames sent before the server's side connected, in order.
+  std::vector<std::pair<std::string, uWS::OpCode> > held;
+  // Per direction, when the last message held is due, so that the next one
+  // that isn't reordered goes after it.
+  Clock::time_point due[DIRECTIONS];
+  // When the simulator sent the newest frame the server has been given,
+  // and when the last two commands arrived.
+  Clock::time_point newestFrame;
+  Clock::time_point lastCommand;
+  double lastInterval;
+};
+
+// What the simulator's side saw since the last report.
+struct Report {
+  size_t relayed[DIRECTIONS];
+  size_t lost[DIRECTIONS];
+  size_t reordered[DIRECTIONS];
+  std::vector<double> age;
+  std::vector<double> jitter;
+  std::vector<double> cte;
+  double speed;
+  size_t frames;
+};
+static Report report;
+
+// A message on its way, due on its timer.
+struct Delayed {
+  uv_timer_t timer;
+  std::shared_ptr<Link> link;
+  Direction direction;
+  std::string message;
+  uWS::OpCode opCode;
+  Clock::time_point sent;
+};
+
+static double Seconds(Clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+static double Percentile(std::vector<double>& samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t k = std::min(samples.size() - 1,
+                      size_t(p * (samples.size() - 1) + 0.5));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+// The car's distance from the polyline through the frame's waypoints.
+static double Distance(const Telemetry& t) {
+  double best = INFINITY;
+  for (size_t k = 0; k + 1 < t.n_waypoints; k++) {
+    double dx = t.ptsx[k + 1] - t.ptsx[k];
+    double dy = t.ptsy[k + 1] - t.ptsy[k];
+    double length = dx * dx + dy * dy;
+    double s = length > 0 ? ((t.px - t.ptsx[k]) * dx +
+                             (t.py - t.ptsy[k]) * dy) / length
+                          : 0;
+    s = std::min(std::max(s, 0.0), 1.0);
+    best = std::min(best, std::hypot(t.px - t.ptsx[k] - s * dx,
+                                     t.py - t.ptsy[k] - s * dy));
+  }
+  return best;
+}
+
+// Hand `message` over to its receiver, and measure it.
+static void Deliver(Link& link, Direction direction,
+                    const std::string& message, uWS::OpCode opCode,
+                    Clock::time_point sent) {
+  if (!link.open) {
+    return;
+  }
+  report.relayed[direction]++;
+  if (direction == TELEMETRY) {
+    if (!link.connected) {
+      link.held.emplace_back(message, opCode);
+      return;
+    }
+    link.server.send(message.data(), message.size(), opCode);
+    link.newestFrame = std::max(link.newestFrame, sent);
+    return;
+  }
+  link.client.send(message.data(), message.size(), opCode);
+  Clock::time_point now = Clock::now();
+  if (link.newestFrame != Clock::time_point()) {
+    report.age.push_back(Seconds(now - link.newestFrame));
+  }
+  if (link.lastCommand != Clock::time_point()) {
+    double interval = Seconds(now - link.lastCommand);
+    if (link.lastInterval >= 0) {
+      report.jitter.push_back(std::fabs(interval - link.lastInterval));
+    }
+    link.lastInterval = interval;
+  }
+  link.lastCommand = now;
+}
+
+static void OnDue(uv_timer_t* timer) {
+  Delayed* delayed = static_cast<Delayed*>(timer->data);
+  Deliver(*delayed->link, delayed->direction, delayed->message,
+          delayed->opCode, delayed->sent);
+  uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+    delete static_cast<Delayed*>(handle->data);
+  });
+}
+
+// Shape a message sent now: lose it, send it at once, or hold it.
+static void Impair(uv_loop_t* loop, const std::shared_ptr<Link>& link,
+                   Direction direction, const char* data, size_t length,
+                   uWS::OpCode opCode) {
+  const Impairment& impairment = impairments[direction];
+  std::uniform_real_distribution<double> uniform(0, 1);
+  Clock::time_point now = Clock::now();
+  if (uniform(random_engine) < impairment.loss) {
+    report.lost[direction]++;
+    return;
+  }
+  double hold = impairment.delay +
+                impairment.jitter * (2 * uniform(random_engine) - 1);
+  Clock::time_point due =
+      now + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(std::max(hold, 0.0)));
+  if (uniform(random_engine) < impairment.reorder) {
+    report.reordered[direction]++;
+    due = now;
+  } else {
+    due = std::max(due, link->due[direction]);
+    link->due[direction] = due;
+  }
+  if (due <= now) {
+    Deliver(*link, direction, std::string(data, length), opCode, now);
+    return;
+  }
+  Delayed* delayed = new Delayed();
+  delayed->link = link;
+  delayed->direction = direction;
+  delayed->message.assign(data, length);
+  delayed->opCode = opCode;
+  delayed->sent = now;
+  uv_timer_init(loop, &delayed->timer);
+  delayed->timer.data = delayed;
+  uv_timer_start(&delayed->timer, OnDue,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                     due - now).count(),
+                 0);
+}
+
+// The frame's tracking into the report, if it is telemetry.
+static void Track(const char* data, size_t length) {
+  const char* begin;
+  const char* end;
+  Telemetry t;
+  if (!hasData(data, length, begin, end) || begin == end ||
+      !ParseTelemetry(begin, end, t)) {
+    return;
+  }
+  if (t.n_waypoints >= 2) {
+    report.cte.push_back(Distance(t));
+  }
+  report.speed += t.v;
+  report.frames++;
+}
+
+static void OnReport(uv_timer_t* timer) {
+  for (int d = 0; d < DIRECTIONS; d++) {
+    printf("%-9s relayed %6zu lost %5zu reordered %5zu\n", DIRECTION_NAMES[d],
+           report.relayed[d], report.lost[d], report.reordered[d]);
+  }
+  size_t ages = report.age.size();
+  double cte_max = report.cte.empty()
+                       ? 0
+                       : *std::max_element(report.cte.begin(),
+                                           report.cte.end());
+  printf("age ms p50 %.1f p95 %.1f p99 %.1f (%zu commands)\n",
+         1e3 * Percentile(report.age, 0.5), 1e3 * Percentile(report.age, 0.95),
+         1e3 * Percentile(report.age, 0.99), ages);
+  printf("jitter ms p50 %.1f p95 %.1f p99 %.1f\n",
+         1e3 * Percentile(report.jitter, 0.5),
+         1e3 * Percentile(report.jitter, 0.95),
+         1e3 * Percentile(report.jitter, 0.99));
+  printf("cte m p50 %.3f p95 %.3f max %.3f, speed mph %.1f\n\n",
+         Percentile(report.cte, 0.5), Percentile(report.cte, 0.95), cte_max,
+         report.frames ? report.speed / report.frames : 0.0);
+  fflush(stdout);
+  report = Report();
+}
+
+// Set impairment `name` to `value`, in one direction or both; false if
+// there is no such.
+static bool Set(const std::string& name, double value) {
+  for (int d = 0; d < DIRECTIONS; d++) {
+    std::string prefix = std::string(DIRECTION_NAMES[d]) + ".";
+    if (name.compare(0, prefix.size(), prefix) == 0) {
+      Impairment saved = impairments[1 - d];
+      if (!Set(name.substr(prefix.size()), value)) {
+        return false;
+      }
+      impairments[1 - d] = saved;
+      return true;
+    }
+  }
+  for (int d = 0; d < DIRECTIONS; d++) {
+    Impairment& impairment = impairments[d];
+    if (name == "delay") {
+      impairment.delay = 1e-3 * value;
+    } else if (name == "jitter") {
+      impairment.jitter = 1e-3 * value;
+    } else if (name == "loss") {
+      impairment.loss = value;
+    } else if (name == "reorder") {
+      impairment.reorder = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  int port = argc > 1 ? atoi(argv[1]) : 4567;
+  std::string server = argc > 2 ? argv[2] : "127.0.0.1:4568";
+  double interval = 5;
+  report = Report();
+  for (int i = 3; i < argc; i++) {
+    const char* equals = strchr(argv[i], '=');
+    std::string name(argv[i], equals ? equals - argv[i] : strlen(argv[i]));
+    double value = equals ? atof(equals + 1) : 0;
+    if (name == "seed") {
+      random_engine.seed(uint64_t(value));
+    } else if (name == "report") {
+      interval = value;
+    } else if (!equals || !Set(name, value)) {
+      fprintf(stderr, "unknown impairment %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  uWS::Hub hub;
+  uv_loop_t* loop = hub.getLoop();
+  hub.onConnection([&](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    std::shared_ptr<Link>* link = new std::shared_ptr<Link>(new Link());
+    (*link)->client = ws;
+    (*link)->open = true;
+    (*link)->connected = false;
+    (*link)->lastInterval = -1;
+    ws.setUserData(link);
+    std::string url = req.getUrl().toString();
+    hub.connect("ws://" + server + url, new std::shared_ptr<Link>(*link));
+  });
+  hub.onMessage([loop](uWS::WebSocket<uWS::SERVER> ws, char* data,
+                       size_t length, uWS::OpCode opCode) {
+    std::shared_ptr<Link>* link =
+        static_cast<std::shared_ptr<Link>*>(ws.getUserData());
+    if (link) {
+      Track(data, length);
+      Impair(loop, *link, TELEMETRY, data, length, opCode);
+    }
+  });
+  hub.onDisconnection([](uWS::WebSocket<uWS::SERVER> ws, int code,
+                         char* message, size_t length) {
+    std::shared_ptr<Link>* link =
+        static_cast<std::shared_ptr<Link>*>(ws.getUserData());
+    if (!link) {
+      return;
+    }
+    ws.setUserData(nullptr);
+    if ((*link)->open) {
+      (*link)->open = false;
+      if ((*link)->connected) {
+        (*link)->server.close();
+      }
+    }
+    delete link;
+  });
+
+  // The server's side.
+  hub.onConnection([](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    Link& link = **static_cast<std::shared_ptr<Link>*>(ws.getUserData());
+    if (!link.open) {
+      ws.close();
+      return;
+    }
+    link.server = ws;
+    link.connected = true;
+    for (const auto& frame : link.held) {
+      ws.send(frame.first.data(), frame.first.size(), frame.second);
+    }
+    link.held.clear();
+  });
+  hub.onMessage([loop](uWS::WebSocket<uWS::CLIENT> ws, char* data,
+                       size_t length, uWS::OpCode opCode) {
+    std::shared_ptr<Link>& link =
+        *static_cast<std::shared_ptr<Link>*>(ws.getUserData());
+    Impair(loop, link, COMMAND, data, length, opCode);
+  });
+  hub.onDisconnection([](uWS::WebSocket<uWS::CLIENT> ws, int code,
+                         char* message, size_t length) {
+    std::shared_ptr<Link>* link =
+        static_cast<std::shared_ptr<Link>*>(ws.getUserData());
+    if ((*link)->open) {
+      (*link)->open = false;
+      (*link)->client.close();
+    }
+    delete link;
+  });
+  hub.onError([](void* user) {
+    std::shared_ptr<Link>* link = static_cast<std::shared_ptr<Link>*>(user);
+    fprintf(stderr, "failed to connect to the server\n");
+    if ((*link)->open) {
+      (*link)->open = false;
+      (*link)->client.close();
+    }
+    delete link;
+  });
+
+  if (!hub.listen(port)) {
+    fprintf(stderr, "failed to listen to port %d\n", port);
+    return 1;
+  }
+  uv_timer_t report_timer;
+  uv_timer_init(loop, &report_timer);
+  uint64_t every = uint64_t(1e3 * interval);
+  uv_timer_start(&report_timer, OnReport, every, every);
+  hub.run();
+  return 0;
+}
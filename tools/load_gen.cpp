@@ -0,0 +1,305 @@
+// Many simulators at once against one server, for sizing hosts: how many
+// cars one mpc process drives at a control period before its commands come
+// late.
+//
+//   load_gen [server host:port] [name=value...]
+//
+// connects to the server, 127.0.0.1:4567 unless given, in stages: start
+// sessions at first, step more each stage, up to max. Each session sends a
+// telemetry frame every period, in the simulator's format (see DATA.md),
+// spread over the period so that they don't all arrive at once, and times
+// the steer message that answers it. The frames are those of a recording
+// when frames= names one (see FrameLog.h), its telemetry in order, each
+// session from a place of its own; else a car driving along the waypoints
+// of waypoints=, ../lake_track_waypoints.csv unless given.
+//
+//   start=n step=n max=n   sessions, 8, 8 and 512 unless given,
+//   stage=s settle=s       seconds per stage, 20, the first settle of them,
+//                          3, not counted, for the new sessions' first
+//                          solves,
+//   period=ms              between a session's frames, 100,
+//   deadline=ms            for the command, the period unless given,
+//   hold=ms                the server's emulated_latency, 100, taken off
+//                          each command's time; 0 for a lockstep server,
+//   budget=p               the share of frames that may miss, 0.01.
+//
+// A frame misses when its command comes after the deadline, or not before
+// the session's next frame. Each stage prints the sessions, the commands'
+// times at p50, p99 and max, the share of frames that missed and the
+// commands per second. The ramp stops two stages after the first over the
+// budget, or at max, and the knee is the most sessions of a stage within
+// it: the load to size a host by.
+#include <uWS/uWS.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "FrameLog.h"
+#include "../bench/LakeFrames.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Frame {
+  std::string data;
+  uWS::OpCode opCode;
+};
+
+struct Session {
+  size_t index;
+  uWS::WebSocket<uWS::CLIENT> ws;
+  bool open;
+  uv_timer_t timer;
+  size_t next;
+  // The last frame sent, and whether its command came.
+  Clock::time_point sent;
+  bool answered;
+};
+
+// What the sessions saw since the stage settled.
+struct Stage {
+  std::vector<double> ms;
+  size_t frames;
+  size_t missed;
+  size_t dropped;
+};
+
+static std::vector<Frame> frames;
+static std::vector<std::unique_ptr<Session> > sessions;
+static Stage stage;
+static Clock::time_point counting;
+static std::string server = "127.0.0.1:4567";
+static size_t start_sessions = 8;
+static size_t step_sessions = 8;
+static size_t max_sessions = 512;
+static double stage_seconds = 20;
+static double settle_seconds = 3;
+static double period = 0.1;
+static double deadline = -1;
+static double hold = 0.1;
+static double budget = 0.01;
+// The most sessions within the budget, and the stages over it since.
+static size_t knee = 0;
+static int over = 0;
+
+static double Seconds(Clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+static double Percentile(std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min(sorted.size() - 1,
+                         size_t(p * (sorted.size() - 1) + 0.5))];
+}
+
+static uint64_t Milliseconds(double seconds) {
+  return uint64_t(1e3 * seconds + 0.5);
+}
+
+static void OnFrameDue(uv_timer_t* timer) {
+  Session& session = *static_cast<Session*>(timer->data);
+  if (!session.open) {
+    return;
+  }
+  Clock::time_point now = Clock::now();
+  if (session.sent >= counting && session.sent != Clock::time_point()) {
+    stage.frames++;
+    stage.missed += !session.answered;
+  }
+  const Frame& frame = frames[session.next];
+  session.next = (session.next + 1) % frames.size();
+  session.ws.send(frame.data.data(), frame.data.size(), frame.opCode);
+  session.sent = now;
+  session.answered = false;
+}
+
+// Whether a message from the server is a steer message: binary, or text
+// with the event.
+static bool IsCommand(const char* data, size_t length, uWS::OpCode opCode) {
+  static const char STEER[] = "42[\"steer\"";
+  return opCode == uWS::OpCode::BINARY ||
+         (length >= sizeof(STEER) - 1 &&
+          memcmp(data, STEER, sizeof(STEER) - 1) == 0);
+}
+
+static void Open(uWS::Hub& hub, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    std::unique_ptr<Session> session(new Session());
+    session->index = sessions.size();
+    session->open = false;
+    // Far apart in the frames; the period is spread by onConnection.
+    session->next = session->index * 7919 % frames.size();
+    session->answered = true;
+    hub.connect("ws://" + server + "/", session.get());
+    sessions.push_back(std::move(session));
+  }
+}
+
+static void OnStageEnd(uv_timer_t* timer) {
+  uWS::Hub& hub = *static_cast<uWS::Hub*>(timer->data);
+  size_t open = 0;
+  for (const auto& session : sessions) {
+    open += session->open;
+  }
+  double seconds = stage_seconds - settle_seconds;
+  std::sort(stage.ms.begin(), stage.ms.end());
+  double missed = stage.frames ? double(stage.missed) / stage.frames : 1;
+  printf("%8zu %8zu %10.1f %10.1f %10.1f %9.2f%% %10.0f %8zu\n",
+         sessions.size(), open, Percentile(stage.ms, 0.5),
+         Percentile(stage.ms, 0.99),
+         stage.ms.empty() ? 0.0 : stage.ms.back(), 100 * missed,
+         stage.ms.size() / seconds, stage.dropped);
+  fflush(stdout);
+  if (missed <= budget && open == sessions.size()) {
+    knee = sessions.size();
+    over = 0;
+  } else {
+    over++;
+  }
+  if (over >= 2 || sessions.size() >= max_sessions) {
+    printf("knee: %zu sessions at %.0f ms, %.0f ms deadline\n", knee,
+           1e3 * period, 1e3 * deadline);
+    exit(0);
+  }
+  stage = Stage();
+  counting = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(settle_seconds));
+  Open(hub, std::min(step_sessions, max_sessions - sessions.size()));
+}
+
+// The frames to send, from a recording or the waypoints.
+static bool LoadFrames(const char* recording, const char* waypoints) {
+  if (recording) {
+    std::vector<RecordedFrame> recorded;
+    if (!ReadFrames(recording, recorded)) {
+      return false;
+    }
+    for (const RecordedFrame& r : recorded) {
+      if (r.binary || r.data.find("\"telemetry\"") != std::string::npos) {
+        frames.push_back(Frame{r.data, r.binary ? uWS::OpCode::BINARY
+                                                : uWS::OpCode::TEXT});
+      }
+    }
+    return !frames.empty();
+  }
+  std::vector<double> x;
+  std::vector<double> y;
+  if (!ReadWaypoints(waypoints, x, y) || x.size() < 6) {
+    return false;
+  }
+  for (const std::string& frame : MakeFrames(x, y)) {
+    frames.push_back(Frame{"42" + frame, uWS::OpCode::TEXT});
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const char* recording = nullptr;
+  const char* waypoints = "../lake_track_waypoints.csv";
+  int first = 1;
+  if (argc > 1 && !strchr(argv[1], '=')) {
+    server = argv[1];
+    first = 2;
+  }
+  for (int i = first; i < argc; i++) {
+    const char* equals = strchr(argv[i], '=');
+    std::string name(argv[i], equals ? equals - argv[i] : strlen(argv[i]));
+    const char* text = equals ? equals + 1 : "";
+    double value = atof(text);
+    if (name == "frames") {
+      recording = text;
+    } else if (name == "waypoints") {
+      waypoints = text;
+    } else if (name == "start") {
+      start_sessions = size_t(value);
+    } else if (name == "step") {
+      step_sessions = size_t(value);
+    } else if (name == "max") {
+      max_sessions = size_t(value);
+    } else if (name == "stage") {
+      stage_seconds = value;
+    } else if (name == "settle") {
+      settle_seconds = value;
+    } else if (name == "period") {
+      period = 1e-3 * value;
+    } else if (name == "deadline") {
+      deadline = 1e-3 * value;
+    } else if (name == "hold") {
+      hold = 1e-3 * value;
+    } else if (name == "budget") {
+      budget = value;
+    } else {
+      fprintf(stderr, "unknown setting %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (deadline < 0) {
+    deadline = period;
+  }
+  if (!LoadFrames(recording, waypoints)) {
+    fprintf(stderr, "no telemetry in %s\n", recording ? recording : waypoints);
+    return 1;
+  }
+
+  uWS::Hub hub;
+  uv_loop_t* loop = hub.getLoop();
+  hub.onConnection([loop](uWS::WebSocket<uWS::CLIENT> ws,
+                          uWS::HttpRequest req) {
+    Session& session = *static_cast<Session*>(ws.getUserData());
+    session.ws = ws;
+    session.open = true;
+    uv_timer_init(loop, &session.timer);
+    session.timer.data = &session;
+    double phase = fmod(session.index * 0.6180339887, 1.0);
+    uv_timer_start(&session.timer, OnFrameDue, Milliseconds(phase * period),
+                   Milliseconds(period));
+  });
+  hub.onMessage([](uWS::WebSocket<uWS::CLIENT> ws, char* data, size_t length,
+                   uWS::OpCode opCode) {
+    Session& session = *static_cast<Session*>(ws.getUserData());
+    if (session.answered || !IsCommand(data, length, opCode)) {
+      return;
+    }
+    session.answered = true;
+    double seconds = Seconds(Clock::now() - session.sent) - hold;
+    if (session.sent >= counting) {
+      stage.ms.push_back(1e3 * seconds);
+      stage.missed += seconds > deadline;
+    }
+  });
+  hub.onDisconnection([](uWS::WebSocket<uWS::CLIENT> ws, int code,
+                         char* message, size_t length) {
+    Session& session = *static_cast<Session*>(ws.getUserData());
+    if (session.open) {
+      session.open = false;
+      uv_timer_stop(&session.timer);
+      stage.dropped++;
+    }
+  });
+  hub.onError([](void* user) {
+    Session& session = *static_cast<Session*>(user);
+    fprintf(stderr, "session %zu failed to connect to %s\n", session.index,
+            server.c_str());
+    stage.dropped++;
+  });
+
+  printf("%8s %8s %10s %10s %10s %10s %10s %8s\n", "sessions", "open",
+         "p50 ms", "p99 ms", "max ms", "missed", "commands/s", "dropped");
+  fflush(stdout);
+  counting = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(settle_seconds));
+  Open(hub, std::min(start_sessions, max_sessions));
+  uv_timer_t stage_timer;
+  uv_timer_init(loop, &stage_timer);
+  stage_timer.data = &hub;
+  uint64_t every = Milliseconds(stage_seconds);
+  uv_timer_start(&stage_timer, OnStageEnd, every, every);
+  hub.run();
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Converts the files of a frame journal, see FrameJournal.h, into CSV, or
+// JSON with an object per line, one frame each in the order of the files
+// given, oldest first:
+//
+//   mpc_logcat [--json] mpc-journal.2 mpc-journal.1 mpc-journal > frames.csv
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "FrameJournal.h"
+
+// Column c of `record` as text into `out`.
+static void Format(const JournalRecord& record, size_t c, char* out,
+                   size_t size) {
+  const JournalColumn& column = JOURNAL_COLUMNS[c];
+  const unsigned char* field =
+      reinterpret_cast<const unsigned char*>(&record) + column.offset;
+  if (column.type == JournalColumn::DOUBLE) {
+    double value;
+    memcpy(&value, field, sizeof(value));
+    snprintf(out, size, "%.9g", value);
+    return;
+  }
+  unsigned long long value = 0;
+  switch (column.size) {
+    case 1:
+      value = *field;
+      break;
+    case 2: {
+      uint16_t v;
+      memcpy(&v, field, 2);
+      value = v;
+      break;
+    }
+    case 4: {
+      uint32_t v;
+      memcpy(&v, field, 4);
+      value = v;
+      break;
+    }
+    default: {
+      uint64_t v;
+      memcpy(&v, field, 8);
+      value = v;
+    }
+  }
+  snprintf(out, size, "%llu", value);
+}
+
+int main(int argc, char** argv) {
+  bool json = argc > 1 && strcmp(argv[1], "--json") == 0;
+  int first = json ? 2 : 1;
+  if (argc <= first) {
+    fprintf(stderr, "usage: %s [--json] journal...\n", argv[0]);
+    return 1;
+  }
+  if (!json) {
+    for (size_t c = 0; c < JOURNAL_COLUMN_COUNT; c++) {
+      printf("%s%s", c ? "," : "", JOURNAL_COLUMNS[c].name);
+    }
+    printf("\n");
+  }
+  char value[64];
+  std::vector<JournalRecord> records;
+  for (int i = first; i < argc; i++) {
+    records.clear();
+    if (!ReadJournal(argv[i], records)) {
+      fprintf(stderr, "Failed to read the journal %s\n", argv[i]);
+      return 1;
+    }
+    for (const JournalRecord& r : records) {
+      for (size_t c = 0; c < JOURNAL_COLUMN_COUNT; c++) {
+        Format(r, c, value, sizeof(value));
+        // JSON has no NaN or infinities.
+        bool number = JOURNAL_COLUMNS[c].type == JournalColumn::UNSIGNED ||
+                      strpbrk(value, "ni") == nullptr;
+        if (json) {
+          printf("%s\"%s\":%s", c ? "," : "{", JOURNAL_COLUMNS[c].name,
+                 number ? value : "null");
+        } else {
+          printf("%s%s", c ? "," : "", value);
+        }
+      }
+      printf(json ? "}\n" : "\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,308 @@
+// A long run against one server, for memory that creeps: drives it with a
+// command of its own, as load_gen or mpc_replay, for hours, scrapes its
+// /metrics all along, and flags what kept growing and a heap gone
+// fragmented.
+//
+//   soak [server host:port] [name=value...] [-- command args...]
+//
+// scrapes the server, 127.0.0.1:4567 unless given, which must be an IPv4
+// address, and runs the command after "--" beside it, as
+//
+//   soak hours=8 -- ./load_gen start=64 max=64 stage=36000
+//
+// until it exits or the time is up, when it is sent SIGTERM. Without a
+// command the server is driven by something else.
+//
+//   hours=h          how long at most, 4,
+//   every=s          seconds between scrapes, 10,
+//   report=s         seconds between reports, 600,
+//   warmup=s         seconds not judged, for the sessions and the caches to
+//                    fill, 600,
+//   growth=p         the rise over the judged samples that is growth, 0.05,
+//   floor=bytes      and the least of it, 1048576,
+//   fragmentation=p  the share of the heap free in malloc's arenas that is
+//                    fragmented, 0.5,
+//   out=path         the samples as CSV, soak.csv.
+//
+// The samples are the resident memory, the heap as malloc holds it, CppAD's
+// allocators, and the sessions' tapes, solver workspaces and buffers, the
+// last per open session; see Metrics.h. A series grows when, cut into four
+// quarters, the median of each is over the one before and the last is
+// over the first by the growth and the floor: a steady rise, which the ups
+// and downs of allocation don't make. Reports give each series' first and
+// last quarters so far; the end flags them, and exits 1 if any was.
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HttpClient.h"
+
+typedef std::chrono::steady_clock Clock;
+
+enum Series {
+  RSS,
+  HEAP_INUSE,
+  HEAP_FREE,
+  HEAP_MAPPED,
+  CPPAD_INUSE,
+  CPPAD_AVAILABLE,
+  TAPES,
+  WORKSPACE,
+  BUFFERS_PER_SESSION,
+  SERIES
+};
+
+static const char* const SERIES_NAMES[SERIES] = {
+    "rss",         "heap_inuse", "heap_free", "heap_mapped",
+    "cppad_inuse", "cppad_available", "tapes", "workspace",
+    "buffers_per_session"};
+
+// Those that must not grow; the free ones come and go.
+static const bool JUDGED[SERIES] = {true,  true, false, true, true,
+                                    false, true, true,  true};
+
+struct Sample {
+  double seconds;
+  double connections;
+  double values[SERIES];
+};
+
+// The value of the line of metric `name`, labels included, summed over the
+// lines that have it.
+static double Metric(const std::string& text, const char* name) {
+  double sum = 0;
+  size_t length = strlen(name);
+  size_t at = 0;
+  while ((at = text.find(name, at)) != std::string::npos) {
+    bool line_start = at == 0 || text[at - 1] == '\n';
+    at += length;
+    if (line_start && at < text.size() &&
+        (text[at] == ' ' || text[at] == '{')) {
+      size_t space = text.find(' ', at);
+      if (space != std::string::npos) {
+        sum += atof(text.c_str() + space + 1);
+      }
+    }
+  }
+  return sum;
+}
+
+static bool Scrape(const std::string& host, int port, double seconds,
+                   Sample& sample) {
+  int status = 0;
+  std::string text;
+  if (!HttpRequest(host.c_str(), port, "GET", "/metrics", "", 5, status,
+                   text) ||
+      status != 200) {
+    return false;
+  }
+  sample.seconds = seconds;
+  sample.connections = Metric(text, "mpc_connections");
+  double* v = sample.values;
+  v[RSS] = Metric(text, "process_resident_memory_bytes");
+  v[HEAP_INUSE] = Metric(text, "mpc_heap_bytes{state=\"inuse\"}");
+  v[HEAP_FREE] = Metric(text, "mpc_heap_bytes{state=\"free\"}");
+  v[HEAP_MAPPED] = Metric(text, "mpc_heap_bytes{state=\"mapped\"}");
+  // Summed over the threads.
+  v[CPPAD_INUSE] = 0;
+  v[CPPAD_AVAILABLE] = 0;
+  for (size_t at = 0;
+       (at = text.find("\nmpc_cppad_memory_bytes{", at)) != std::string::npos;
+       at++) {
+    size_t end = text.find('\n', at + 1);
+    std::string line = text.substr(at + 1, end - at - 1);
+    size_t space = line.rfind(' ');
+    double value = atof(line.c_str() + space + 1);
+    if (line.find("state=\"inuse\"") != std::string::npos) {
+      v[CPPAD_INUSE] += value;
+    } else {
+      v[CPPAD_AVAILABLE] += value;
+    }
+  }
+  v[TAPES] = Metric(text, "mpc_session_memory_bytes{use=\"tapes\"}");
+  v[WORKSPACE] = Metric(text, "mpc_session_memory_bytes{use=\"workspace\"}");
+  double buffers = Metric(text, "mpc_session_memory_bytes{use=\"buffers\"}");
+  v[BUFFERS_PER_SESSION] =
+      sample.connections > 0 ? buffers / sample.connections : 0;
+  return true;
+}
+
+static double Median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                   values.end());
+  return values[values.size() / 2];
+}
+
+// The medians of series `s` over four quarters of `samples`.
+static void Quarters(const std::vector<Sample>& samples, int s,
+                     double medians[4]) {
+  for (int q = 0; q < 4; q++) {
+    std::vector<double> values;
+    for (size_t i = samples.size() * q / 4; i < samples.size() * (q + 1) / 4;
+         i++) {
+      values.push_back(samples[i].values[s]);
+    }
+    medians[q] = Median(values);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::string server = "127.0.0.1:4567";
+  double hours = 4;
+  double every = 10;
+  double report = 600;
+  double warmup = 600;
+  double growth = 0.05;
+  double floor_bytes = 1 << 20;
+  double fragmentation = 0.5;
+  std::string out = "soak.csv";
+  char** command = nullptr;
+  int first = 1;
+  if (argc > 1 && strcmp(argv[1], "--") != 0 && !strchr(argv[1], '=')) {
+    server = argv[1];
+    first = 2;
+  }
+  for (int i = first; i < argc; i++) {
+    if (strcmp(argv[i], "--") == 0) {
+      command = argv + i + 1;
+      break;
+    }
+    const char* equals = strchr(argv[i], '=');
+    std::string name(argv[i], equals ? equals - argv[i] : strlen(argv[i]));
+    const char* text = equals ? equals + 1 : "";
+    double value = atof(text);
+    if (name == "hours") {
+      hours = value;
+    } else if (name == "every") {
+      every = value;
+    } else if (name == "report") {
+      report = value;
+    } else if (name == "warmup") {
+      warmup = value;
+    } else if (name == "growth") {
+      growth = value;
+    } else if (name == "floor") {
+      floor_bytes = value;
+    } else if (name == "fragmentation") {
+      fragmentation = value;
+    } else if (name == "out") {
+      out = text;
+    } else {
+      fprintf(stderr, "unknown setting %s\n", argv[i]);
+      return 1;
+    }
+  }
+  size_t colon = server.find(':');
+  std::string host = server.substr(0, colon);
+  int port =
+      colon == std::string::npos ? 4567 : atoi(server.c_str() + colon + 1);
+  FILE* csv = fopen(out.c_str(), "w");
+  if (!csv) {
+    fprintf(stderr, "failed to create %s\n", out.c_str());
+    return 1;
+  }
+  fprintf(csv, "seconds,connections");
+  for (int s = 0; s < SERIES; s++) {
+    fprintf(csv, ",%s", SERIES_NAMES[s]);
+  }
+  fprintf(csv, "\n");
+
+  pid_t driver = 0;
+  if (command && *command) {
+    driver = fork();
+    if (driver == 0) {
+      execvp(command[0], command);
+      _exit(127);
+    }
+    if (driver < 0) {
+      fprintf(stderr, "failed to start %s\n", command[0]);
+      return 1;
+    }
+  }
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point next = start;
+  double last_report = 0;
+  size_t failed = 0;
+  // The samples after the warm-up.
+  std::vector<Sample> judged;
+  while (true) {
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    if (seconds >= 3600 * hours ||
+        (driver > 0 && waitpid(driver, nullptr, WNOHANG) == driver)) {
+      break;
+    }
+    Sample sample;
+    if (Scrape(host, port, seconds, sample)) {
+      fprintf(csv, "%.1f,%.0f", sample.seconds, sample.connections);
+      for (int s = 0; s < SERIES; s++) {
+        fprintf(csv, ",%.0f", sample.values[s]);
+      }
+      fprintf(csv, "\n");
+      fflush(csv);
+      if (seconds >= warmup) {
+        judged.push_back(sample);
+      }
+    } else {
+      failed++;
+    }
+    if (seconds - last_report >= report && judged.size() >= 4) {
+      last_report = seconds;
+      printf("%.2f h, %zu sessions, %zu failed scrapes\n", seconds / 3600,
+             size_t(sample.connections), failed);
+      for (int s = 0; s < SERIES; s++) {
+        double q[4];
+        Quarters(judged, s, q);
+        printf("  %-20s %14.0f -> %14.0f\n", SERIES_NAMES[s], q[0], q[3]);
+      }
+      fflush(stdout);
+    }
+    next += std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(every));
+    std::this_thread::sleep_until(next);
+  }
+  if (driver > 0) {
+    kill(driver, SIGTERM);
+    waitpid(driver, nullptr, 0);
+  }
+  fclose(csv);
+
+  if (judged.size() < 8) {
+    printf("too few samples after the warm-up to judge: %zu\n",
+           judged.size());
+    return 1;
+  }
+  int flagged = 0;
+  for (int s = 0; s < SERIES; s++) {
+    double q[4];
+    Quarters(judged, s, q);
+    bool grows = JUDGED[s] && q[1] > q[0] && q[2] > q[1] && q[3] > q[2] &&
+                 q[3] - q[0] > std::max(growth * q[0], floor_bytes);
+    printf("%-20s %14.0f -> %14.0f%s\n", SERIES_NAMES[s], q[0], q[3],
+           grows ? "  GROWS" : "");
+    flagged += grows;
+  }
+  // The last quarter's share of the arenas free.
+  std::vector<double> shares;
+  for (size_t i = judged.size() * 3 / 4; i < judged.size(); i++) {
+    double held = judged[i].values[HEAP_INUSE] + judged[i].values[HEAP_FREE];
+    shares.push_back(held > 0 ? judged[i].values[HEAP_FREE] / held : 0);
+  }
+  double share = Median(shares);
+  bool fragmented = share > fragmentation;
+  printf("heap free in the arenas: %.1f%%%s\n", 100 * share,
+         fragmented ? "  FRAGMENTED" : "");
+  flagged += fragmented;
+  return flagged > 0 ? 1 : 0;
+}
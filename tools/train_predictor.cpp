@@ -0,0 +1,78 @@
+// Fits the solve time model of SolveTimePredictor to the solves in a frame
+// journal, see FrameJournal.h, and writes it for the server's
+// solve_time_model, to start the sessions' predictors from:
+//
+//   train_predictor model.txt mpc-journal.2 mpc-journal.1 mpc-journal
+//
+// The files are read oldest first, and each connection's frames replayed
+// in order into a predictor that doesn't forget, which is least squares;
+// every solve is predicted before it is learned, and the mean absolute
+// error of those predictions, by tier, is printed as the model's expected
+// error. Only journals with the tier and load columns train it.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <vector>
+#include "FrameJournal.h"
+#include "SolveTimePredictor.h"
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: train_predictor model.txt journal...\n");
+    return 1;
+  }
+  std::vector<JournalRecord> records;
+  for (int i = 2; i < argc; i++) {
+    std::vector<JournalRecord> file;
+    if (!ReadJournal(argv[i], file)) {
+      fprintf(stderr, "Failed to read %s\n", argv[i]);
+      return 1;
+    }
+    records.insert(records.end(), file.begin(), file.end());
+  }
+  // The rings of the solver threads interleave the connections.
+  std::stable_sort(records.begin(), records.end(),
+                   [](const JournalRecord& a, const JournalRecord& b) {
+                     return a.connection != b.connection
+                                ? a.connection < b.connection
+                                : a.sequence < b.sequence;
+                   });
+
+  SolveTimePredictor predictor(1);
+  std::vector<double> error(DegradationLadder::NUM_TIERS, 0);
+  std::vector<size_t> predicted(DegradationLadder::NUM_TIERS, 0);
+  std::vector<size_t> solves(DegradationLadder::NUM_TIERS, 0);
+  std::map<uint32_t, int> iterations;
+  for (const JournalRecord& r : records) {
+    int before = iterations[r.connection];
+    iterations[r.connection] = r.iterations;
+    if (r.tier >= DegradationLadder::NUM_TIERS || r.solveSeconds <= 0) {
+      continue;
+    }
+    DegradationLadder::Tier tier = DegradationLadder::Tier(r.tier);
+    SolveTimePredictor::Features x =
+        SolveTimePredictor::Describe(r.state, r.reference, before, r.load);
+    if (predictor.trained(tier)) {
+      error[tier] += std::fabs(predictor.Predict(tier, x) - r.solveSeconds);
+      predicted[tier]++;
+    }
+    predictor.Record(tier, x, r.solveSeconds);
+    solves[tier]++;
+  }
+
+  printf("%-14s %8s %16s\n", "tier", "solves", "mean error (ms)");
+  for (int t = 0; t < DegradationLadder::NUM_TIERS; t++) {
+    if (solves[t] == 0) {
+      continue;
+    }
+    printf("%-14s %8zu %16.3f\n",
+           DegradationLadder::Name(DegradationLadder::Tier(t)), solves[t],
+           predicted[t] ? 1e3 * error[t] / predicted[t] : 0.0);
+  }
+  if (!predictor.Save(argv[1])) {
+    fprintf(stderr, "Failed to write %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
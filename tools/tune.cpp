@@ -0,0 +1,447 @@
+// Tunes the controller in closed loop: each candidate tuning drives laps of
+// a car of SimEnvironments around the track, scored by its lap time and
+// cross track error, with a candidate on every core at once.
+//
+//   tune grid job.txt [shard/shards] > results.csv
+//   tune search job.txt [candidates] [seed] > results.csv
+//   tune aggregate best.txt results.csv...
+//
+// A job file names the track and the laps each candidate drives, and the
+// tuning parameters of SetTuning, each fixed or ranging over grid points,
+// evenly spaced or, with "log", spaced by ratio:
+//
+//   track ../lake_track_waypoints.csv
+//   laps 1
+//   cte 1 100 5 log
+//   delta 100 10000 5 log
+//   ref_v 40 80 5
+//   dt 0.05
+//
+// grid tries every combination of the grid points, or of them only every
+// shards-th from the shard-th, numbered from 0, so that nodes sharing the
+// job file split it between them. search tries random candidates first,
+// then fits a Gaussian process to the scores so far and tries the
+// candidates of the greatest expected improvement, between the ranges'
+// ends; it runs on one node. Either prints a CSV line per candidate, lower
+// scores better; aggregate ranks the lines of any number of runs and writes
+// the best candidate as a tuning file for the server's tuning_path. As with
+// parallel_solves, MUMPS solves take turns.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Controller.h"
+#include "Eigen-3.3/Eigen/Dense"
+#include "MPC.h"
+#include "MpcConfig.h"
+#include "SimEnvironments.h"
+#include "Telemetry.h"
+#include "TrackMap.h"
+
+// The score of a candidate that completed its laps is its mean lap time in
+// seconds and CTE_SECONDS per meter of mean cross track error; one that
+// didn't scores FAILED and up, the less of the laps it drove the more.
+static const double CTE_SECONDS = 10;
+static const double FAILED = 1000;
+// Frames a lap may take before the candidate is given up on, and the
+// wall-clock time a solve may take, generous so that candidates solving
+// side by side don't cut each other's solves short.
+static const size_t MAX_LAP_FRAMES = 3000;
+static const double SOLVE_SECONDS = 1;
+// Random candidates sampled for each pick of the search, and the length
+// scale of its Gaussian process over ranges scaled to [0, 1].
+static const size_t SEARCH_SAMPLES = 2000;
+static const double LENGTH_SCALE = 0.25;
+
+struct Parameter {
+  std::string name;
+  double low;
+  double high;
+  // 1 for a fixed parameter, at low.
+  size_t points;
+  bool log;
+
+  // The value at u in [0, 1] of the range.
+  double At(double u) const {
+    if (points == 1) {
+      return low;
+    }
+    return log ? low * pow(high / low, u) : low + (high - low) * u;
+  }
+};
+
+struct Job {
+  std::string track;
+  int laps;
+  std::vector<Parameter> parameters;
+};
+
+struct Outcome {
+  double score;
+  double lapTime;
+  double cteMean;
+  double cteMax;
+  // The share of the laps driven.
+  double driven;
+};
+
+static bool ReadJob(const char* path, Job& job) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "can't read %s\n", path);
+    return false;
+  }
+  job.track = "../lake_track_waypoints.csv";
+  job.laps = 1;
+  std::string line;
+  MpcConfig check;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name) || name[0] == '#') {
+      continue;
+    }
+    if (name == "track") {
+      fields >> job.track;
+      continue;
+    }
+    if (name == "laps") {
+      fields >> job.laps;
+      continue;
+    }
+    Parameter p = {name, 0, 0, 1, false};
+    std::string scale;
+    if (!(fields >> p.low) || !SetTuning(check, name, p.low)) {
+      fprintf(stderr, "bad line in %s: %s\n", path, line.c_str());
+      return false;
+    }
+    if (fields >> p.high >> p.points) {
+      p.log = fields >> scale && scale == "log";
+      if (p.points < 2 || (p.log && (p.low <= 0 || p.high <= 0))) {
+        fprintf(stderr, "bad range in %s: %s\n", path, line.c_str());
+        return false;
+      }
+    } else {
+      p.points = 1;
+    }
+    job.parameters.push_back(p);
+  }
+  return job.laps > 0;
+}
+
+// Drive `laps` laps with `config`, from the first waypoint.
+static Outcome Evaluate(const TrackMap& track, const MpcConfig& config,
+                        int laps) {
+  Controller controller(config);
+  Controller::Output out;
+  SimEnvironments car(track, 1, config.Lf);
+  double cte_sum = 0;
+  double cte_max = 0;
+  size_t frames = 0;
+  const double distance = track.length() * laps;
+  while (car.progress(0) < distance && !car.off(0) &&
+         frames < MAX_LAP_FRAMES * laps) {
+    Telemetry t;
+    car.Observe(&t);
+    t.received = std::chrono::steady_clock::now();
+    controller.Step(t,
+                    t.received + std::chrono::duration_cast<
+                                     std::chrono::steady_clock::duration>(
+                                     std::chrono::duration<double>(
+                                         SOLVE_SECONDS)),
+                    out);
+    SimEnvironments::Action action = {out.steering, out.throttle};
+    car.Step(&action);
+    cte_sum += car.cte(0);
+    cte_max = std::max(cte_max, car.cte(0));
+    frames++;
+  }
+  Outcome o;
+  o.lapTime = frames * car.period / laps;
+  o.cteMean = cte_sum / std::max<size_t>(frames, 1);
+  o.cteMax = cte_max;
+  o.driven = std::max(0., std::min(1., car.progress(0) / distance));
+  o.score = o.driven >= 1 ? o.lapTime + CTE_SECONDS * o.cteMean
+                          : FAILED * (2 - o.driven);
+  return o;
+}
+
+static void PrintHeader(const Job& job) {
+  printf("score,lap_time,cte_mean,cte_max,driven");
+  for (const Parameter& p : job.parameters) {
+    printf(",%s", p.name.c_str());
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+// Evaluate each of `candidates`, values of the job's parameters in order,
+// on every core, printing each line as it is done, into outcomes.
+static void EvaluateAll(const Job& job, const TrackMap& track,
+                        const std::vector<std::vector<double> >& candidates,
+                        std::vector<Outcome>& outcomes) {
+  outcomes.resize(candidates.size());
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  std::atomic<size_t> next(0);
+  std::mutex print_mutex;
+  std::vector<std::thread> workers;
+  for (size_t w = 0; w < std::min(cores, candidates.size()); w++) {
+    workers.emplace_back([&] {
+      for (size_t i = next++; i < candidates.size(); i = next++) {
+        MpcConfig config;
+        for (size_t k = 0; k < job.parameters.size(); k++) {
+          SetTuning(config, job.parameters[k].name, candidates[i][k]);
+        }
+        Outcome o = Evaluate(track, config, job.laps);
+        outcomes[i] = o;
+        std::lock_guard<std::mutex> lock(print_mutex);
+        printf("%.4f,%.2f,%.4f,%.4f,%.3f", o.score, o.lapTime, o.cteMean,
+               o.cteMax, o.driven);
+        for (double value : candidates[i]) {
+          printf(",%.6g", value);
+        }
+        printf("\n");
+        fflush(stdout);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+static int Grid(const Job& job, const TrackMap& track, size_t shard,
+                size_t shards) {
+  size_t total = 1;
+  for (const Parameter& p : job.parameters) {
+    total *= p.points;
+  }
+  std::vector<std::vector<double> > candidates;
+  for (size_t i = shard; i < total; i += shards) {
+    std::vector<double> values;
+    size_t rest = i;
+    for (const Parameter& p : job.parameters) {
+      size_t k = rest % p.points;
+      rest /= p.points;
+      values.push_back(p.At(p.points > 1 ? double(k) / (p.points - 1) : 0));
+    }
+    candidates.push_back(values);
+  }
+  fprintf(stderr, "%zu of %zu candidates\n", candidates.size(), total);
+  PrintHeader(job);
+  std::vector<Outcome> outcomes;
+  EvaluateAll(job, track, candidates, outcomes);
+  return 0;
+}
+
+// The Gaussian process's squared exponential kernel.
+static double Kernel(const Eigen::VectorXd& a, const Eigen::VectorXd& b) {
+  return exp(-(a - b).squaredNorm() / (2 * LENGTH_SCALE * LENGTH_SCALE));
+}
+
+static int Search(const Job& job, const TrackMap& track, size_t count,
+                  unsigned seed) {
+  std::vector<size_t> ranged;
+  for (size_t k = 0; k < job.parameters.size(); k++) {
+    if (job.parameters[k].points > 1) {
+      ranged.push_back(k);
+    }
+  }
+  const size_t d = ranged.size();
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  auto sample = [&] {
+    Eigen::VectorXd u(d);
+    for (size_t j = 0; j < d; j++) {
+      u[j] = uniform(random);
+    }
+    return u;
+  };
+  auto values = [&](const Eigen::VectorXd& u) {
+    std::vector<double> v;
+    for (const Parameter& p : job.parameters) {
+      v.push_back(p.At(0));
+    }
+    for (size_t j = 0; j < d; j++) {
+      v[ranged[j]] = job.parameters[ranged[j]].At(u[j]);
+    }
+    return v;
+  };
+
+  PrintHeader(job);
+  size_t batch = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<Eigen::VectorXd> tried;
+  std::vector<double> scores;
+  while (tried.size() < count) {
+    size_t n = std::min(batch, count - tried.size());
+    std::vector<Eigen::VectorXd> picks;
+    if (tried.size() < std::max(batch, 2 * d + 1)) {
+      for (size_t i = 0; i < n; i++) {
+        picks.push_back(sample());
+      }
+    } else {
+      // Each pick of a batch is taken as scoring the process's mean there,
+      // so that the next one looks elsewhere.
+      std::vector<Eigen::VectorXd> points = tried;
+      std::vector<double> y = scores;
+      for (size_t i = 0; i < n; i++) {
+        size_t m = points.size();
+        Eigen::VectorXd target(m);
+        for (size_t j = 0; j < m; j++) {
+          target[j] = y[j];
+        }
+        double mean = target.mean();
+        double spread = sqrt((target.array() - mean).square().mean());
+        if (spread <= 0) {
+          spread = 1;
+        }
+        target = (target.array() - mean) / spread;
+        Eigen::MatrixXd K(m, m);
+        for (size_t a = 0; a < m; a++) {
+          for (size_t b = 0; b < m; b++) {
+            K(a, b) = Kernel(points[a], points[b]) + (a == b ? 1e-6 : 0);
+          }
+        }
+        Eigen::LLT<Eigen::MatrixXd> llt(K);
+        Eigen::VectorXd alpha = llt.solve(target);
+        double best = target.minCoeff();
+        Eigen::VectorXd pick;
+        double pick_mean = 0;
+        double pick_ei = -1;
+        Eigen::VectorXd k(m);
+        for (size_t s = 0; s < SEARCH_SAMPLES; s++) {
+          Eigen::VectorXd u = sample();
+          for (size_t j = 0; j < m; j++) {
+            k[j] = Kernel(u, points[j]);
+          }
+          double mu = k.dot(alpha);
+          double sigma = sqrt(std::max(1e-12, 1 - k.dot(llt.solve(k))));
+          double z = (best - mu) / sigma;
+          double ei = (best - mu) * 0.5 * erfc(-z / sqrt(2)) +
+                      sigma * exp(-z * z / 2) / sqrt(2 * M_PI);
+          if (ei > pick_ei) {
+            pick = u;
+            pick_mean = mu;
+            pick_ei = ei;
+          }
+        }
+        picks.push_back(pick);
+        points.push_back(pick);
+        y.push_back(mean + spread * pick_mean);
+      }
+    }
+    std::vector<std::vector<double> > candidates;
+    for (const Eigen::VectorXd& u : picks) {
+      candidates.push_back(values(u));
+    }
+    std::vector<Outcome> outcomes;
+    EvaluateAll(job, track, candidates, outcomes);
+    for (size_t i = 0; i < picks.size(); i++) {
+      tried.push_back(picks[i]);
+      scores.push_back(outcomes[i].score);
+    }
+  }
+  return 0;
+}
+
+static int Aggregate(const char* best_path, int files, char** paths) {
+  std::string header;
+  std::vector<std::pair<double, std::string> > lines;
+  for (int f = 0; f < files; f++) {
+    std::ifstream in(paths[f]);
+    if (!in) {
+      fprintf(stderr, "can't read %s\n", paths[f]);
+      return 1;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.compare(0, 6, "score,") == 0) {
+        if (!header.empty() && line != header) {
+          fprintf(stderr, "%s is of another job\n", paths[f]);
+          return 1;
+        }
+        header = line;
+      } else if (!line.empty()) {
+        lines.push_back(std::make_pair(atof(line.c_str()), line));
+      }
+    }
+  }
+  if (lines.empty()) {
+    fprintf(stderr, "no candidates\n");
+    return 1;
+  }
+  std::sort(lines.begin(), lines.end());
+  printf("%s\n", header.c_str());
+  for (const auto& line : lines) {
+    printf("%s\n", line.second.c_str());
+  }
+
+  // The parameters follow the five columns of the outcome.
+  std::ofstream best(best_path);
+  std::istringstream names(header);
+  std::istringstream values(lines[0].second);
+  std::string name;
+  std::string value;
+  for (int column = 0; std::getline(names, name, ',') &&
+                       std::getline(values, value, ',');
+       column++) {
+    if (column >= 5) {
+      best << name << " " << value << "\n";
+    }
+  }
+  if (!best) {
+    fprintf(stderr, "can't write %s\n", best_path);
+    return 1;
+  }
+  fprintf(stderr, "best of %zu: %s\n", lines.size(), lines[0].second.c_str());
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc >= 4 && strcmp(argv[1], "aggregate") == 0) {
+    return Aggregate(argv[2], argc - 3, argv + 3);
+  }
+  bool grid = argc >= 3 && strcmp(argv[1], "grid") == 0;
+  bool search = argc >= 3 && strcmp(argv[1], "search") == 0;
+  if (!grid && !search) {
+    fprintf(stderr,
+            "usage: %s grid job.txt [shard/shards]\n"
+            "       %s search job.txt [candidates] [seed]\n"
+            "       %s aggregate best.txt results.csv...\n",
+            argv[0], argv[0], argv[0]);
+    return 1;
+  }
+  Job job;
+  if (!ReadJob(argv[2], job)) {
+    return 1;
+  }
+  TrackMap track;
+  if (!track.Load(job.track) || track.size() < 6) {
+    fprintf(stderr, "no waypoints in %s\n", job.track.c_str());
+    return 1;
+  }
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  MPC::SetupThreads(cores + 1);
+  if (grid) {
+    size_t shard = 0;
+    size_t shards = 1;
+    if (argc > 3 && (sscanf(argv[3], "%zu/%zu", &shard, &shards) != 2 ||
+                     shard >= shards)) {
+      fprintf(stderr, "bad shard %s\n", argv[3]);
+      return 1;
+    }
+    return Grid(job, track, shard, shards);
+  }
+  return Search(job, track, argc > 3 ? atoi(argv[3]) : 64,
+                argc > 4 ? atoi(argv[4]) : 1);
+}